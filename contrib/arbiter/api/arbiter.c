@@ -13,6 +13,7 @@
 #include "proto.h"
 #include "arbiterlimits.h"
 #include "sockhub/sockhub.h"
+#include "shmhub.h"
 
 #ifdef TEST
 // standalone test without postgres functions
@@ -42,6 +43,8 @@ typedef unsigned xid_t;
 
 static void DiscardConnection()
 {
+	if (ShmHubEnabled())
+		return;
 	if (connected)
 	{
 		close(conns[leader].sock);
@@ -58,6 +61,23 @@ static int arbiter_recv_results(ArbiterConn arbiter, int maxlen, xid_t *results)
 	int recved;
 	int needed;
 
+	if (ShmHubEnabled())
+	{
+		needed = ShmHubRecv(results, maxlen * sizeof(xid_t));
+		if (needed < 0)
+		{
+			elog(WARNING, "Failed to recv results from arbiter through sockhub");
+			return 0;
+		}
+		assert(needed % sizeof(xid_t) == 0);
+		if (needed > maxlen * sizeof(xid_t))
+		{
+			elog(ERROR, "The message body will not fit into the results array");
+			return 0;
+		}
+		return needed / sizeof(xid_t);
+	}
+
 	recved = 0;
 	needed = sizeof(ShubMessageHdr);
 	while (recved < needed)
@@ -187,11 +207,28 @@ static bool ArbiterConnect(ArbiterConn conn)
 	return false;
 }
 
+static bool arbiter_send(ArbiterConn arbiter, char *buf, int size)
+{
+	int sent;
+
+	if (ShmHubEnabled())
+		return ShmHubSend(buf, size);
+
+	sent = 0;
+	while (sent < size)
+	{
+		int newbytes = write(arbiter->sock, buf + sent, size - sent);
+		if (newbytes == -1)
+			return false;
+		sent += newbytes;
+	}
+	return true;
+}
+
 static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
 {
 	va_list argv;
 	int i;
-	int sent;
 	char buf[COMMAND_BUFFER_SIZE];
 	int datasize;
 	char *cursor = buf;
@@ -217,17 +254,11 @@ static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
 	assert(msg->size + sizeof(ShubMessageHdr) == datasize);
 	assert(datasize <= COMMAND_BUFFER_SIZE);
 
-	sent = 0;
-	while (sent < datasize)
+	if (!arbiter_send(arbiter, buf, datasize))
 	{
-		int newbytes = write(arbiter->sock, buf + sent, datasize - sent);
-		if (newbytes == -1)
-		{
-			DiscardConnection();
-			elog(ERROR, "Failed to send a command to arbiter");
-			return false;
-		}
-		sent += newbytes;
+		DiscardConnection();
+		elog(ERROR, "Failed to send a command to arbiter");
+		return false;
 	}
 	return true;
 }
@@ -278,6 +309,11 @@ void ArbiterConfig(char *servers, char *sock_dir)
 static ArbiterConn GetConnection()
 {
 	int tries = 3 * connum;
+
+	/* sockhub is connected to arbiter on behalf of all backends */
+	if (ShmHubEnabled())
+		return conns + leader;
+
 	while (!connected && (tries > 0))
 	{
 		ArbiterConn c = conns + leader;
@@ -560,7 +596,6 @@ bool ArbiterDetectDeadLock(int port, TransactionId xid, void* data, int size)
 	char* buf = (char*)malloc(data_size);
 	ShubMessageHdr* msg = (ShubMessageHdr*)buf;
 	xid_t* body = (xid_t*)(msg+1);
-	int sent;
 	int reslen;
 	xid_t results[RESULTS_SIZE];
 	ArbiterConn arbiter = GetConnection();
@@ -574,16 +609,10 @@ bool ArbiterDetectDeadLock(int port, TransactionId xid, void* data, int size)
 	*body++ = xid;
 	memcpy(body, data, size);
 
-	sent = 0;
-	while (sent < data_size)
+	if (!arbiter_send(arbiter, buf, data_size))
 	{
-		int new_bytes = write(arbiter->sock, buf + sent, data_size - sent);
-		if (new_bytes == -1)
-		{
-			elog(ERROR, "Failed to send a command to arbiter");
-			return false;
-		}
-		sent += new_bytes;
+		elog(ERROR, "Failed to send a command to arbiter");
+		return false;
 	}
 
 	reslen = arbiter_recv_results(arbiter, RESULTS_SIZE, results);
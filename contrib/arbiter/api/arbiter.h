@@ -15,6 +15,26 @@ void ArbiterConfig(char *servers, char *sock_dir);
 
 void ArbiterInitSnapshot(Snapshot snapshot);
 
+/**
+ * Returns the size of shared memory needed for communication of backends with
+ * sockhub. 'bufferSize' is the size of the queue of requests.
+ */
+Size ArbiterShmemSize(int bufferSize);
+
+/**
+ * Allocates the request queue and response channels in shared memory. Should
+ * be called from shmem_startup_hook. After this call the Arbiter API sends
+ * requests to sockhub through shared memory instead of the unix socket.
+ */
+void ArbiterShmemInit(int bufferSize);
+
+/**
+ * Main loop of the sockhub background worker serving backends through shared
+ * memory. Sends the requests of backends to the arbiters given by 'servers'
+ * and passes the responses back. Never returns.
+ */
+void ArbiterHubMain(char *servers, int bufferSize);
+
 /**
  * Starts a new global transaction. Returns the
  * transaction id, fills the 'snapshot' and 'gxmin' on success. 'gxmin' is the
@@ -0,0 +1,480 @@
+/*
+ * Shared memory transport between backends and sockhub.
+ *
+ * Backends append their requests to the ring buffer in shared memory and
+ * wait on their latches for the response, which sockhub puts into the
+ * channel of the backend. Sockhub sends everything accumulated in the ring
+ * to the arbiter with one write, without copying the requests to its own
+ * buffer. Channel of a backend is its pgprocno + 1: arbiter treats channels
+ * as independent clients, 0 is used by direct connections.
+ */
+#include "postgres.h"
+
+#include <string.h>
+
+#include "miscadmin.h"
+#include "access/twophase.h"
+#include "postmaster/autovacuum.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+#include "arbiter.h"
+#include "arbiterlimits.h"
+#include "shmhub.h"
+#include "sockhub/sockhub.h"
+
+/* Time to sleep waiting for free space in the request queue (microseconds) */
+#define SHMHUB_QUEUE_WAIT 100
+/* Time to wait for the response of arbiter before the request is considered lost (milliseconds) */
+#define SHMHUB_RESPONSE_TIMEOUT 10000
+
+/*
+ * Arbiter answers the requests of a channel in order, so responses are matched
+ * with requests by counting them. Responses to the requests abandoned by the
+ * backend (or by the previous owner of the channel) are dropped.
+ */
+typedef struct
+{
+	Latch	   *latch;		/* latch of the backend waiting for the response */
+	uint64		requestEnd;	/* position in the queue after the last request */
+	uint64		nRequests;	/* number of requests sent through the channel */
+	uint64		nResponses;	/* number of them which are answered or failed */
+	bool		failed;		/* request is lost or response does not fit in 'data' */
+	int			size;		/* size of the response body */
+	char		data[SHMHUB_RESPONSE_SIZE];
+} ShmHubChannel;
+
+typedef struct
+{
+	slock_t		lock;
+	Latch	   *hubLatch;	/* latch of sockhub, NULL if it is not started yet */
+	uint64		head;		/* end of space reserved by backends */
+	uint64		committed;	/* end of data completely written by backends */
+	uint64		tail;		/* end of data sent to arbiter */
+	int			bufferSize;
+	int			nChannels;
+	char	   *buffer;		/* ring buffer of 'bufferSize' bytes */
+	ShmHubChannel channels[FLEXIBLE_ARRAY_MEMBER];
+} ShmHub;
+
+static ShmHub *hub;
+static bool registered;
+static int	skipBytes;		/* rest of the response which does not fit in the channel */
+
+/*
+ * All processes having PGPROC can talk to arbiter. MaxBackends is not
+ * calculated yet when shared memory is requested, so do it ourselves.
+ */
+static int ShmHubChannels(void)
+{
+	return MaxConnections + autovacuum_max_workers + 1 + max_worker_processes
+		+ NUM_AUXILIARY_PROCS + max_prepared_xacts;
+}
+
+Size ArbiterShmemSize(int bufferSize)
+{
+	return MAXALIGN(offsetof(ShmHub, channels) + ShmHubChannels()*sizeof(ShmHubChannel)) + bufferSize;
+}
+
+void ArbiterShmemInit(int bufferSize)
+{
+	bool found;
+	int nChannels = ShmHubChannels();
+
+	if (nChannels >= MAX_TRANSACTIONS)
+		elog(ERROR, "Number of processes %d exceeds the number of channels supported by arbiter", nChannels);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	hub = ShmemInitStruct("sockhub", ArbiterShmemSize(bufferSize), &found);
+	if (!found)
+	{
+		SpinLockInit(&hub->lock);
+		hub->hubLatch = NULL;
+		hub->head = hub->committed = hub->tail = 0;
+		hub->bufferSize = bufferSize;
+		hub->nChannels = nChannels;
+		hub->buffer = (char*)hub + MAXALIGN(offsetof(ShmHub, channels) + nChannels*sizeof(ShmHubChannel));
+		memset(hub->channels, 0, nChannels*sizeof(ShmHubChannel));
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+bool ShmHubEnabled(void)
+{
+	return hub != NULL;
+}
+
+/*
+ * Put message to the queue. If 'request' is true, then the sender is going to
+ * wait for the response in its channel. Fails if sockhub is not running, as
+ * nobody would send the message then.
+ */
+static bool ShmHubPut(void *buf, int size, bool request)
+{
+	ShmHubChannel *ch = &hub->channels[MyProc->pgprocno];
+	Latch *hubLatch;
+	uint64 pos;
+	int offs;
+
+	if (size > hub->bufferSize)
+	{
+		elog(WARNING, "Message of size %d does not fit in sockhub queue", size);
+		return false;
+	}
+	((ShubMessageHdr*)buf)->chan = MyProc->pgprocno + 1;
+
+	SpinLockAcquire(&hub->lock);
+	while (hub->hubLatch != NULL && hub->head + size - hub->tail > hub->bufferSize)
+	{
+		hubLatch = hub->hubLatch;
+		SpinLockRelease(&hub->lock);
+		SetLatch(hubLatch);
+		/* Disconnect message is sent at process exit, when interrupts should not be serviced */
+		if (request)
+			CHECK_FOR_INTERRUPTS();
+		pg_usleep(SHMHUB_QUEUE_WAIT);
+		SpinLockAcquire(&hub->lock);
+	}
+	if (hub->hubLatch == NULL)
+	{
+		SpinLockRelease(&hub->lock);
+		if (request)
+			elog(WARNING, "Sockhub is not running");
+		return false;
+	}
+	pos = hub->head;
+	hub->head += size;
+	if (request)
+	{
+		ch->latch = MyLatch;
+		ch->requestEnd = hub->head;
+		ch->nRequests += 1;
+		ch->failed = false;
+	}
+	SpinLockRelease(&hub->lock);
+
+	/* Space is reserved, so the message can be copied without holding the lock */
+	offs = pos % hub->bufferSize;
+	if (offs + size <= hub->bufferSize)
+		memcpy(hub->buffer + offs, buf, size);
+	else
+	{
+		int tail = hub->bufferSize - offs;
+		memcpy(hub->buffer + offs, buf, tail);
+		memcpy(hub->buffer, (char*)buf + tail, size - tail);
+	}
+
+	/*
+	 * Messages are committed in the order of their positions, so that sockhub
+	 * can send the committed part of the queue while other backends are still
+	 * copying messages following it. Copying takes no time, so just spin.
+	 */
+	SpinLockAcquire(&hub->lock);
+	while (hub->committed != pos)
+	{
+		SpinLockRelease(&hub->lock);
+		SPIN_DELAY();
+		SpinLockAcquire(&hub->lock);
+	}
+	hub->committed = pos + size;
+	hubLatch = hub->hubLatch;
+	SpinLockRelease(&hub->lock);
+
+	if (hubLatch != NULL)
+		SetLatch(hubLatch);
+	return true;
+}
+
+/*
+ * Arbiter has to forget about the channel before it is reused by another process.
+ */
+static void ShmHubDisconnect(int code, Datum arg)
+{
+	ShubMessageHdr hdr;
+	hdr.size = 0;
+	hdr.code = MSG_DISCONNECT;
+	ShmHubPut(&hdr, sizeof(hdr), false);
+}
+
+bool ShmHubSend(void *buf, int size)
+{
+	if (!registered)
+	{
+		on_shmem_exit(ShmHubDisconnect, 0);
+		registered = true;
+	}
+	return ShmHubPut(buf, size, true);
+}
+
+int ShmHubRecv(void *buf, int maxsize)
+{
+	ShmHubChannel *ch = &hub->channels[MyProc->pgprocno];
+	TimestampTz deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), SHMHUB_RESPONSE_TIMEOUT);
+	int size;
+
+	while (true)
+	{
+		int rc;
+		bool done;
+		long secs;
+		int usecs;
+
+		SpinLockAcquire(&hub->lock);
+		done = ch->nResponses == ch->nRequests;
+		SpinLockRelease(&hub->lock);
+		if (done)
+			break;
+
+		/* The response to the abandoned request will be dropped by sockhub */
+		CHECK_FOR_INTERRUPTS();
+		TimestampDifference(GetCurrentTimestamp(), deadline, &secs, &usecs);
+		if (secs == 0 && usecs == 0)
+		{
+			elog(WARNING, "Sockhub did not receive response from arbiter in %d ms", SHMHUB_RESPONSE_TIMEOUT);
+			return -1;
+		}
+
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   secs*1000 + usecs/1000 + 1);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+		ResetLatch(MyLatch);
+	}
+	if (ch->failed)
+		return -1;
+
+	size = ch->size;
+	memcpy(buf, ch->data, Min(size, maxsize));
+	return size;
+}
+
+/*
+ * Fail the requests which will never get a response: the ones sent to arbiter
+ * through the broken connection, or all pending ones if 'all' is true.
+ */
+static void ShmHubFailRequests(bool all)
+{
+	int i;
+
+	SpinLockAcquire(&hub->lock);
+	for (i = 0; i < hub->nChannels; i++)
+	{
+		ShmHubChannel *ch = &hub->channels[i];
+		if (ch->nResponses != ch->nRequests && (all || ch->requestEnd <= hub->tail))
+		{
+			ch->failed = true;
+			ch->nResponses = ch->nRequests;
+			SetLatch(ch->latch);
+		}
+	}
+	SpinLockRelease(&hub->lock);
+}
+
+static void ShmHubReconnect(Shub *shub)
+{
+	ShubReconnect(shub);
+	ShmHubFailRequests(false);
+	shub->out_buffer_used = 0;
+	skipBytes = 0;
+}
+
+static void ShmHubWrite(Shub *shub, char const *data, int size)
+{
+	while (!ShubWriteSocket(shub->output, data, size))
+	{
+		shub->params->error_handler("Failed to write to inet socket", SHUB_RECOVERABLE_ERROR);
+		ShmHubReconnect(shub);
+	}
+}
+
+/*
+ * Send everything committed to the queue since the last call. Backends still
+ * copying their messages will wake us up when they finish.
+ */
+static void ShmHubFlush(Shub *shub)
+{
+	uint64 head;
+	uint64 tail;
+
+	SpinLockAcquire(&hub->lock);
+	head = hub->committed;
+	tail = hub->tail;
+	SpinLockRelease(&hub->lock);
+
+	if (head != tail)
+	{
+		int offs = tail % hub->bufferSize;
+		int size = head - tail;
+
+		if (offs + size <= hub->bufferSize)
+			ShmHubWrite(shub, hub->buffer + offs, size);
+		else
+		{
+			ShmHubWrite(shub, hub->buffer + offs, hub->bufferSize - offs);
+			ShmHubWrite(shub, hub->buffer, offs + size - hub->bufferSize);
+		}
+
+		SpinLockAcquire(&hub->lock);
+		hub->tail = head;
+		SpinLockRelease(&hub->lock);
+	}
+}
+
+static void ShmHubDeliver(int chan, char *body, int size)
+{
+	ShmHubChannel *ch;
+	Latch *latch;
+	bool awaited;
+
+	if (chan <= 0 || chan > hub->nChannels)
+	{
+		elog(LOG, "Sockhub received response for unknown channel %d", chan);
+		return;
+	}
+	ch = &hub->channels[chan - 1];
+
+	/* Only the backend which sent the request can send another one */
+	SpinLockAcquire(&hub->lock);
+	awaited = ch->nResponses + 1 == ch->nRequests;
+	SpinLockRelease(&hub->lock);
+
+	if (awaited && size <= SHMHUB_RESPONSE_SIZE)
+		memcpy(ch->data, body, size);
+	else if (awaited)
+		elog(LOG, "Response of size %d does not fit in channel %d", size, chan);
+
+	SpinLockAcquire(&hub->lock);
+	if (ch->nResponses != ch->nRequests)
+		ch->nResponses += 1;
+	if (awaited)
+	{
+		ch->size = size;
+		ch->failed = size > SHMHUB_RESPONSE_SIZE;
+	}
+	latch = ch->latch;
+	SpinLockRelease(&hub->lock);
+
+	if (latch != NULL)
+		SetLatch(latch);
+}
+
+/*
+ * Read as much responses as possible and pass them to backends.
+ */
+static void ShmHubReceive(Shub *shub)
+{
+	int bufferSize = shub->params->buffer_size;
+	int available = shub->out_buffer_used;
+	int pos = 0;
+	int rc = ShubReadSocketEx(shub->output, shub->out_buffer + available, 1, bufferSize - available);
+
+	if (rc <= 0)
+	{
+		shub->params->error_handler("Failed to read inet socket", SHUB_RECOVERABLE_ERROR);
+		ShmHubReconnect(shub);
+		return;
+	}
+	available += rc;
+
+	if (skipBytes != 0)
+	{
+		pos = Min(skipBytes, available);
+		skipBytes -= pos;
+	}
+	while (pos + sizeof(ShubMessageHdr) <= available)
+	{
+		ShubMessageHdr *hdr = (ShubMessageHdr*)&shub->out_buffer[pos];
+		int size = sizeof(ShubMessageHdr) + hdr->size;
+
+		if (pos + size <= available)
+		{
+			ShmHubDeliver(hdr->chan, (char*)(hdr + 1), hdr->size);
+			pos += size;
+		}
+		else if (size > bufferSize)
+		{
+			/* message will never fit in the buffer: fail the request and skip the rest of it */
+			ShmHubDeliver(hdr->chan, NULL, hdr->size);
+			skipBytes = pos + size - available;
+			pos = available;
+		}
+		else
+			break;
+	}
+	/* Move partly fetched message (if any) to the beginning of buffer */
+	memmove(shub->out_buffer, shub->out_buffer + pos, available - pos);
+	shub->out_buffer_used = available - pos;
+}
+
+/*
+ * Nobody will send the queued requests once sockhub exits, so backends should
+ * not wait for their responses or put new requests.
+ */
+static void ShmHubStop(int code, Datum arg)
+{
+	SpinLockAcquire(&hub->lock);
+	hub->hubLatch = NULL;
+	SpinLockRelease(&hub->lock);
+	ShmHubFailRequests(true);
+}
+
+static void ShmHubErrorHandler(char const *msg, ShubErrorSeverity severity)
+{
+	elog(severity == SHUB_FATAL_ERROR ? FATAL : LOG, "%s: %m", msg);
+}
+
+void ArbiterHubMain(char *servers, int bufferSize)
+{
+	Shub shub;
+	ShubParams params;
+
+	Assert(hub != NULL);
+	BackgroundWorkerUnblockSignals();
+
+	ShubInitParams(&params);
+	if (!ShubParamsSetHosts(&params, servers))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("Invalid list of arbiters: %s", servers)));
+	params.file = NULL;
+	params.buffer_size = Max(bufferSize, sizeof(ShubMessageHdr) + SHMHUB_RESPONSE_SIZE);
+	params.error_handler = ShmHubErrorHandler;
+	ShubInitialize(&shub, &params);
+
+	/*
+	 * Requests left by the previous incarnation of sockhub were failed when it
+	 * exited, so discard the rest of them. Wait for the backends which were
+	 * copying their messages at that moment.
+	 */
+	SpinLockAcquire(&hub->lock);
+	while (hub->committed != hub->head)
+	{
+		SpinLockRelease(&hub->lock);
+		SPIN_DELAY();
+		SpinLockAcquire(&hub->lock);
+	}
+	hub->tail = hub->head;
+	hub->hubLatch = MyLatch;
+	SpinLockRelease(&hub->lock);
+	on_shmem_exit(ShmHubStop, 0);
+
+	while (true)
+	{
+		int rc;
+
+		ResetLatch(MyLatch);
+		ShmHubFlush(&shub);
+
+		rc = WaitLatchOrSocket(MyLatch, WL_LATCH_SET | WL_SOCKET_READABLE | WL_POSTMASTER_DEATH, shub.output, -1);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+		if (rc & WL_SOCKET_READABLE)
+			ShmHubReceive(&shub);
+	}
+}
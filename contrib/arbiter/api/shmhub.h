@@ -0,0 +1,32 @@
+#ifndef SHMHUB_H
+#define SHMHUB_H
+
+#include "postgres.h"
+
+/* Maximal size of response body which can be passed to backend through shared memory */
+#define SHMHUB_RESPONSE_SIZE (1024*sizeof(TransactionId))
+
+/**
+ * Returns true if backends communicate with sockhub through shared memory,
+ * i.e. ArbiterShmemInit() was called.
+ */
+bool ShmHubEnabled(void);
+
+/**
+ * Appends the message (header included) to the request queue and wakes up
+ * sockhub. Channel of the message is set to the one of the current backend.
+ * Returns false if the message is too large for the queue or sockhub is not
+ * running.
+ */
+bool ShmHubSend(void *buf, int size);
+
+/**
+ * Waits for the response to the last request sent by this backend and copies
+ * at most 'maxsize' bytes of its body to 'buf'. Returns the size of the body,
+ * or -1 if the request was lost because of sockhub reconnect or exit, the
+ * response did not fit in the channel or did not arrive in time. The wait can
+ * be interrupted by query cancel.
+ */
+int ShmHubRecv(void *buf, int maxsize);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * Reservation of local XIDs at arbiter.
+ *
+ * Local transactions of a node take XIDs from a range reserved at arbiter,
+ * so that they never collide with XIDs of global transactions. Size of the
+ * range adapts to the rate of local transactions, and the next range is
+ * reserved in advance by the backend which notices that the current one is
+ * close to exhaustion. That backend owns the prefetch until arbiter answers:
+ * others do not ask arbiter concurrently, because arbiter does not track
+ * reservations per node and could hand out overlapping ranges.
+ */
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "access/clog.h"
+#include "access/commit_ts.h"
+#include "access/subtrans.h"
+#include "access/transam.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "utils/timestamp.h"
+
+#include "arbiter.h"
+#include "xidreserve.h"
+
+/* Time the reserved range of local XIDs should last (microseconds) */
+#define XID_RESERVE_PERIOD   100000
+/* Next range is reserved in advance when this fraction of the current range remains */
+#define XID_PREFETCH_FRACTION 4
+/* Delay between checks whether the range reserved in advance has arrived (microseconds) */
+#define XID_PREFETCH_WAIT    100
+
+static bool registered = false;
+
+void ArbiterXidReserveInit(ArbiterXidReserve *reserve, LWLockId lock, int size)
+{
+	reserve->lock = lock;
+	reserve->nextXid = InvalidTransactionId;
+	reserve->nReservedXids = 0;
+	reserve->xidRangeSize = 0;
+	reserve->nConsumedXids = 0;
+	reserve->xidRangeStart = 0;
+	reserve->xidReserveSize = size;
+	reserve->prefetchedXid = InvalidTransactionId;
+	reserve->nPrefetchedXids = 0;
+	reserve->prefetchOwner = 0;
+	reserve->nXidReservations = 0;
+	reserve->nXidPrefetches = 0;
+	reserve->nXidReserveStalls = 0;
+	reserve->xidReserveStallTime = 0;
+}
+
+/*
+ * Start assigning local XIDs from the given range. Size of the next reserved range is adapted to the rate
+ * at which the previous one was consumed, so that a range lasts about XID_RESERVE_PERIOD.
+ * Should be called with XidGenLock and reserve->lock held.
+ */
+static void ArbiterUseXidRange(ArbiterXidReserve *reserve, TransactionId first, size_t nXids, int minSize, int maxSize)
+{
+	TimestampTz now = GetCurrentTimestamp();
+
+	if (reserve->xidRangeSize != 0)
+	{
+		long secs;
+		int usecs;
+		int64 elapsed;
+		int64 expected;
+		int64 size;
+
+		TimestampDifference(reserve->xidRangeStart, now, &secs, &usecs);
+		elapsed = (int64)secs*USECS_PER_SEC + usecs;
+		if (elapsed == 0)
+			elapsed = 1;
+		expected = (int64)reserve->nConsumedXids*XID_RESERVE_PERIOD/elapsed;
+		size = ((int64)reserve->xidReserveSize + expected + 1)/2;
+		if (size > maxSize)
+			size = maxSize;
+		if (size < minSize)
+			size = minSize;
+		reserve->xidReserveSize = size;
+	}
+	reserve->nextXid = first;
+	reserve->nReservedXids = nXids;
+	reserve->xidRangeSize = nXids;
+	reserve->nConsumedXids = 0;
+	reserve->xidRangeStart = now;
+
+	Assert(TransactionIdFollowsOrEquals(reserve->nextXid, ShmemVariableCache->nextXid));
+
+	/* Advance ShmemVariableCache->nextXid formward until new Xid */
+	while (TransactionIdPrecedes(ShmemVariableCache->nextXid, reserve->nextXid))
+	{
+		ExtendCLOG(ShmemVariableCache->nextXid);
+		ExtendCommitTs(ShmemVariableCache->nextXid);
+		ExtendSUBTRANS(ShmemVariableCache->nextXid);
+		TransactionIdAdvance(ShmemVariableCache->nextXid);
+	}
+}
+
+/*
+ * Switch to the range of XIDs reserved in advance, if any.
+ * Should be called with XidGenLock and reserve->lock held.
+ */
+static bool ArbiterUsePrefetchedXids(ArbiterXidReserve *reserve, int minSize, int maxSize)
+{
+	size_t nXids = reserve->nPrefetchedXids;
+
+	if (nXids == 0)
+		return false;
+
+	reserve->nPrefetchedXids = 0;
+	if (TransactionIdPrecedes(reserve->prefetchedXid, ShmemVariableCache->nextXid))
+	{
+		/* Global transactions have already moved nextXid past this range */
+		return false;
+	}
+	ArbiterUseXidRange(reserve, reserve->prefetchedXid, nXids, minSize, maxSize);
+	return true;
+}
+
+TransactionId ArbiterXidReserveNext(ArbiterXidReserve *reserve, int minSize, int maxSize)
+{
+	TransactionId xid;
+
+	if (reserve->nReservedXids == 0 && !ArbiterUsePrefetchedXids(reserve, minSize, maxSize))
+	{
+		TimestampTz stallStart = GetCurrentTimestamp();
+		long secs;
+		int usecs;
+
+		/*
+		 * Range reserved in advance by other backend will not overlap with the one
+		 * we are going to reserve, so wait for it instead of asking arbiter concurrently.
+		 * Local transactions cannot get an XID meanwhile anyway, but global ones can,
+		 * so do not keep XidGenLock while sleeping.
+		 */
+		while (reserve->prefetchOwner != 0)
+		{
+			LWLockRelease(reserve->lock);
+			LWLockRelease(XidGenLock);
+			CHECK_FOR_INTERRUPTS();
+			pg_usleep(XID_PREFETCH_WAIT);
+			LWLockAcquire(XidGenLock, LW_EXCLUSIVE);
+			LWLockAcquire(reserve->lock, LW_EXCLUSIVE);
+		}
+		/* Other backend might have switched to the prefetched range already */
+		if (reserve->nReservedXids == 0 && !ArbiterUsePrefetchedXids(reserve, minSize, maxSize))
+		{
+			TransactionId first;
+			int nXids;
+
+			nXids = ArbiterReserve(ShmemVariableCache->nextXid, reserve->xidReserveSize, &first);
+			if (nXids < 1)
+				elog(ERROR, "failed to reserve a local range of xids on arbiter");
+			reserve->nXidReservations += 1;
+			ArbiterUseXidRange(reserve, first, nXids, minSize, maxSize);
+		}
+		TimestampDifference(stallStart, GetCurrentTimestamp(), &secs, &usecs);
+		reserve->nXidReserveStalls += 1;
+		reserve->xidReserveStallTime += (uint64)secs*USECS_PER_SEC + usecs;
+	}
+	Assert(ShmemVariableCache->nextXid == reserve->nextXid);
+	xid = reserve->nextXid++;
+	reserve->nReservedXids -= 1;
+	reserve->nConsumedXids += 1;
+	return xid;
+}
+
+/*
+ * Give up the prefetch if the backend exits while waiting for arbiter, e.g. when it is terminated
+ * in ShmHubRecv(). Otherwise other backends would wait for the prefetched range forever.
+ * The owner holds no LWLocks while it waits for arbiter.
+ */
+static void ArbiterXidReserveRelease(int code, Datum arg)
+{
+	ArbiterXidReserve *reserve = (ArbiterXidReserve *) DatumGetPointer(arg);
+
+	if (reserve->prefetchOwner != MyProcPid)
+		return;
+
+	LWLockAcquire(reserve->lock, LW_EXCLUSIVE);
+	reserve->prefetchOwner = 0;
+	LWLockRelease(reserve->lock);
+}
+
+void ArbiterXidReservePrefetch(ArbiterXidReserve *reserve)
+{
+	TransactionId from;
+	TransactionId first = InvalidTransactionId;
+	int nXids;
+	int count = 0;
+
+	/* Cheap check without lock first, as it is performed for each transaction */
+	if (reserve->prefetchOwner != 0 || reserve->nPrefetchedXids != 0 || reserve->nReservedXids == 0
+		|| reserve->nReservedXids > reserve->xidRangeSize/XID_PREFETCH_FRACTION)
+		return;
+
+	if (!registered)
+	{
+		before_shmem_exit(ArbiterXidReserveRelease, PointerGetDatum(reserve));
+		registered = true;
+	}
+
+	LWLockAcquire(reserve->lock, LW_EXCLUSIVE);
+	if (reserve->prefetchOwner != 0 || reserve->nPrefetchedXids != 0 || reserve->nReservedXids == 0
+		|| reserve->nReservedXids > reserve->xidRangeSize/XID_PREFETCH_FRACTION)
+	{
+		LWLockRelease(reserve->lock);
+		return;
+	}
+	reserve->prefetchOwner = MyProcPid;
+	from = reserve->nextXid + reserve->nReservedXids;
+	nXids = reserve->xidReserveSize;
+	LWLockRelease(reserve->lock);
+
+	PG_TRY();
+	{
+		count = ArbiterReserve(from, nXids, &first);
+	}
+	PG_CATCH();
+	{
+		LWLockAcquire(reserve->lock, LW_EXCLUSIVE);
+		reserve->prefetchOwner = 0;
+		LWLockRelease(reserve->lock);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	LWLockAcquire(reserve->lock, LW_EXCLUSIVE);
+	reserve->prefetchOwner = 0;
+	if (count > 0)
+	{
+		reserve->prefetchedXid = first;
+		reserve->nPrefetchedXids = count;
+		reserve->nXidReservations += 1;
+		reserve->nXidPrefetches += 1;
+	}
+	LWLockRelease(reserve->lock);
+}
+
+void ArbiterXidReserveStats(ArbiterXidReserve *reserve, Datum *values)
+{
+	LWLockAcquire(reserve->lock, LW_SHARED);
+	values[0] = Int64GetDatum(reserve->xidReserveSize);
+	values[1] = Int64GetDatum(reserve->nReservedXids);
+	values[2] = Int64GetDatum(reserve->nPrefetchedXids);
+	values[3] = Int64GetDatum(reserve->nXidReservations);
+	values[4] = Int64GetDatum(reserve->nXidPrefetches);
+	values[5] = Int64GetDatum(reserve->nXidReserveStalls);
+	values[6] = Int64GetDatum(reserve->xidReserveStallTime);
+	LWLockRelease(reserve->lock);
+}
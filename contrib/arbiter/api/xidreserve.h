@@ -0,0 +1,67 @@
+#ifndef XIDRESERVE_H
+#define XIDRESERVE_H
+
+#include "postgres.h"
+#include "storage/lwlock.h"
+#include "utils/timestamp.h"
+
+/* Number of values reported by ArbiterXidReserveStats() */
+#define XID_RESERVE_STATS_COLS 7
+
+/*
+ * Ranges of XIDs reserved at arbiter for local transactions of the node.
+ * Lives in shared memory of the extension, fields are protected by 'lock'.
+ */
+typedef struct
+{
+	LWLockId lock;
+	TransactionId nextXid; /* next XID for local transaction */
+	size_t nReservedXids;  /* number of XIDs reserved for local transactions */
+	size_t xidRangeSize;  /* number of XIDs in the range being used for local transactions */
+	size_t nConsumedXids; /* number of XIDs assigned from this range */
+	TimestampTz xidRangeStart; /* when this range was taken into use */
+	size_t xidReserveSize; /* number of XIDs to reserve next time, adapted to the consumption rate */
+	TransactionId prefetchedXid; /* first XID of the range reserved in advance */
+	size_t nPrefetchedXids; /* number of XIDs reserved in advance, 0 if none */
+	int    prefetchOwner; /* pid of the backend reserving the next range at arbiter, 0 if none */
+	uint64 nXidReservations; /* number of ranges reserved at arbiter */
+	uint64 nXidPrefetches;   /* number of them reserved in advance */
+	uint64 nXidReserveStalls; /* number of times assignment of local XID waited for arbiter */
+	uint64 xidReserveStallTime; /* total time of these waits, microseconds */
+} ArbiterXidReserve;
+
+/**
+ * Initializes the reservation state in shared memory. 'lock' protects it,
+ * 'size' is the number of XIDs to reserve first time.
+ */
+void ArbiterXidReserveInit(ArbiterXidReserve *reserve, LWLockId lock, int size);
+
+/**
+ * Returns the next local XID, reserving a new range at arbiter if the current
+ * one is exhausted. Number of XIDs reserved at once adapts to the consumption
+ * rate within 'minSize' and 'maxSize'.
+ * Should be called with XidGenLock and reserve->lock held.
+ * While another backend reserves the next range in advance both locks are
+ * released to wait for it, so the caller should not rely on the state
+ * protected by them being unchanged. Throws an error if arbiter refuses to
+ * reserve XIDs.
+ */
+TransactionId ArbiterXidReserveNext(ArbiterXidReserve *reserve, int minSize, int maxSize);
+
+/**
+ * Reserves the next range at arbiter when the current one is close to
+ * exhaustion, so that backends do not have to wait for arbiter while holding
+ * XidGenLock. Should be called without locks held and not while an XID is
+ * being assigned, e.g. at transaction start: the wait for arbiter can be
+ * interrupted, and the transaction should not have a half-assigned XID then.
+ */
+void ArbiterXidReservePrefetch(ArbiterXidReserve *reserve);
+
+/**
+ * Fills 'values' with the reservation statistics: current reservation size,
+ * XIDs left in the current range and in the range reserved in advance, number
+ * of reservations and prefetches, number and total time of stalls.
+ */
+void ArbiterXidReserveStats(ArbiterXidReserve *reserve, Datum *values);
+
+#endif
@@ -263,6 +263,11 @@ static void reconnect(Shub* shub)
     }
 }
 
+void ShubReconnect(Shub* shub)
+{
+    reconnect(shub);
+}
+
 static void notify_disconnect(Shub* shub, int chan)
 {
     ShubMessageHdr* hdr;
@@ -309,19 +314,24 @@ void ShubInitialize(Shub* shub, ShubParams* params)
 
     shub->params = params;
 
-    sock.sa_family = AF_UNIX;
-    assert(strlen(params->file) < sizeof(sock.sa_data));
-    strcpy(sock.sa_data, params->file);
-    unlink(params->file);
-    shub->input = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (shub->input < 0) {
-        shub->params->error_handler("Failed to create local socket", SHUB_FATAL_ERROR);
-    }
-    if (bind(shub->input, &sock, ((char*)sock.sa_data - (char*)&sock) + strlen(params->file)) < 0) {
-        shub->params->error_handler("Failed to bind local socket", SHUB_FATAL_ERROR);
-    }
-    if (listen(shub->input, params->queue_size) < 0) {
-        shub->params->error_handler("Failed to listen local socket", SHUB_FATAL_ERROR);
+    if (params->file != NULL) {
+        sock.sa_family = AF_UNIX;
+        assert(strlen(params->file) < sizeof(sock.sa_data));
+        strcpy(sock.sa_data, params->file);
+        unlink(params->file);
+        shub->input = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (shub->input < 0) {
+            shub->params->error_handler("Failed to create local socket", SHUB_FATAL_ERROR);
+        }
+        if (bind(shub->input, &sock, ((char*)sock.sa_data - (char*)&sock) + strlen(params->file)) < 0) {
+            shub->params->error_handler("Failed to bind local socket", SHUB_FATAL_ERROR);
+        }
+        if (listen(shub->input, params->queue_size) < 0) {
+            shub->params->error_handler("Failed to listen local socket", SHUB_FATAL_ERROR);
+        }
+    } else { 
+        /* clients are not connected through sockets, i.e. use shared memory */
+        shub->input = -1;
     }
     shub->output = -1;
 #ifdef USE_EPOLL
@@ -333,7 +343,9 @@ void ShubInitialize(Shub* shub, ShubParams* params)
     FD_ZERO(&shub->inset);
     shub->max_fd = 0;
 #endif
-    ShubAddSocket(shub, shub->input);
+    if (shub->input >= 0) {
+        ShubAddSocket(shub, shub->input);
+    }
     reconnect(shub);
 
     shub->in_buffer = malloc(params->buffer_size);
@@ -49,7 +49,7 @@ typedef struct
     int delay;
     int queue_size;
     int max_attempts;
-    char const* file;
+    char const* file; /* path of local socket, NULL if clients do not use sockets */
     host_t *leader;
     ShubErrorHandler error_handler;
 } ShubParams;
@@ -79,6 +79,7 @@ int ShubWriteSocket(int sd, void const* buf, int size);
 void ShubInitParams(ShubParams* params);
 int  ShubParamsSetHosts(ShubParams* params, char* hoststring);
 void ShubInitialize(Shub* shub, ShubParams* params);
+void ShubReconnect(Shub* shub);
 void ShubLoop(Shub* shub);
 
 #endif
@@ -0,0 +1,994 @@
+/*
+ * dtmbench: distributed transaction benchmark
+ *
+ * Runs bank-transfer style workloads against a cluster using one of the
+ * transaction managers built on the XTM API (pg_dtm, pg_tsdtm, multimaster
+ * and pg_shard's DTM mode), and reports throughput together with latency
+ * histograms for each phase of a transaction.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include <pqxx/connection>
+#include <pqxx/transaction>
+#include <pqxx/nontransaction>
+
+using namespace std;
+using namespace pqxx;
+
+template<class T>
+class my_unique_ptr
+{
+    T* ptr;
+
+  public:
+    my_unique_ptr(T* p = NULL) : ptr(p) {}
+    ~my_unique_ptr() { delete ptr; }
+    T& operator*() { return *ptr; }
+    T* operator->() { return ptr; }
+    T* get() { return ptr; }
+    void operator=(T* p) { delete ptr; ptr = p; }
+    void operator=(my_unique_ptr& other) {
+        ptr = other.ptr;
+        other.ptr = NULL;
+    }
+};
+
+typedef void* (*thread_proc_t)(void*);
+typedef int64_t csn_t;
+
+#define USEC 1000000
+
+static time_t getCurrentTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (time_t)tv.tv_sec*USEC + tv.tv_usec;
+}
+
+/*
+ * Phases of a transaction whose latencies are tracked separately. Managers
+ * which have no distinct step for a phase simply record nothing for it.
+ */
+enum phase_t
+{
+    PHASE_BEGIN,    /* start transaction, obtain global transaction id */
+    PHASE_SNAPSHOT, /* join the global transaction on the other nodes */
+    PHASE_EXECUTE,  /* statements of the workload */
+    PHASE_PREPARE,  /* first phase of two-phase commit */
+    PHASE_COMMIT,   /* commit (prepared) transaction */
+    PHASE_TOTAL,    /* whole transaction, from begin to commit */
+    N_PHASES
+};
+
+static char const* const phaseNames[N_PHASES] = {
+    "begin", "snapshot", "execute", "prepare", "commit", "total"
+};
+
+/*
+ * Log-linear latency histogram: values are grouped by their highest set bit,
+ * and each such range is split into 2^SUB_BITS equal buckets, which bounds
+ * the relative error of reported percentiles by 1/2^SUB_BITS.
+ */
+class histogram
+{
+    enum { SUB_BITS = 5, SUB_BUCKETS = 1 << SUB_BITS, N_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS };
+
+    uint64_t buckets[N_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t maxValue;
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return (size_t)value;
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BITS;
+        return (size_t)((shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1)));
+    }
+
+    /* largest value falling into the given bucket */
+    static uint64_t bucketLimit(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        int shift = (int)(bucket / SUB_BUCKETS) - 1;
+        uint64_t base = (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return base + ((uint64_t)1 << shift) - 1;
+    }
+
+  public:
+    histogram() {
+        reset();
+    }
+
+    void reset() {
+        memset(buckets, 0, sizeof buckets);
+        count = sum = maxValue = 0;
+    }
+
+    void add(uint64_t value) {
+        buckets[bucketOf(value)] += 1;
+        count += 1;
+        sum += value;
+        if (value > maxValue) {
+            maxValue = value;
+        }
+    }
+
+    void merge(histogram const& other) {
+        for (size_t i = 0; i < N_BUCKETS; i++) {
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        sum += other.sum;
+        if (other.maxValue > maxValue) {
+            maxValue = other.maxValue;
+        }
+    }
+
+    uint64_t samples() const { return count; }
+    uint64_t max() const { return maxValue; }
+    double mean() const { return count ? (double)sum / count : 0.0; }
+
+    /* smallest bucket limit below which the given fraction of samples falls */
+    uint64_t percentile(double fraction) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(fraction * count);
+        if (rank >= count) {
+            rank = count - 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < N_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen > rank) {
+                uint64_t limit = bucketLimit(i);
+                return limit < maxValue ? limit : maxValue;
+            }
+        }
+        return maxValue;
+    }
+};
+
+/* per-phase latencies of transactions of one kind */
+struct latencies
+{
+    histogram phases[N_PHASES];
+
+    void merge(latencies const& other) {
+        for (int i = 0; i < N_PHASES; i++) {
+            phases[i].merge(other.phases[i]);
+        }
+    }
+};
+
+/* measures consecutive phases of a transaction */
+class stopwatch
+{
+    latencies& lat;
+    time_t start;
+    time_t last;
+
+  public:
+    stopwatch(latencies& l) : lat(l) {
+        start = last = getCurrentTime();
+    }
+
+    void lap(phase_t phase) {
+        time_t now = getCurrentTime();
+        lat.phases[phase].add(now - last);
+        last = now;
+    }
+
+    void skip() {
+        last = getCurrentTime();
+    }
+
+    void finish() {
+        lat.phases[PHASE_TOTAL].add(getCurrentTime() - start);
+    }
+};
+
+struct thread
+{
+    pthread_t t;
+    size_t transactions;
+    size_t updates;
+    size_t selects;
+    size_t aborts;
+    size_t inconsistencies;
+    latencies lat;
+    int id;
+
+    void start(int tid, thread_proc_t proc) {
+        id = tid;
+        transactions = 0;
+        updates = 0;
+        selects = 0;
+        aborts = 0;
+        inconsistencies = 0;
+        pthread_create(&t, NULL, proc, this);
+    }
+
+    void wait() {
+        pthread_join(t, NULL);
+    }
+};
+
+enum output_format_t
+{
+    OUTPUT_TEXT,
+    OUTPUT_CSV,
+    OUTPUT_JSON
+};
+
+struct config
+{
+    int nReaders;
+    int nWriters;
+    int nIterations;
+    int nAccounts;
+    int startId;
+    int diapason;
+    int updatePercent;
+    bool deadlockFree;
+    bool maxSnapshot;
+    bool makeSavepoints;
+    char const* isolationLevel;
+    char const* managerName;
+    char const* workloadName;
+    output_format_t output;
+    vector<string> connections;
+
+    config() {
+        nReaders = 1;
+        nWriters = 10;
+        nIterations = 1000;
+        nAccounts = 100000;
+        startId = 0;
+        diapason = 100000;
+        updatePercent = 100;
+        deadlockFree = false;
+        maxSnapshot = false;
+        makeSavepoints = false;
+        isolationLevel = NULL;
+        managerName = "dtm";
+        workloadName = "mixed";
+        output = OUTPUT_TEXT;
+    }
+};
+
+config cfg;
+bool running;
+
+void exec(transaction_base& txn, char const* sql, ...)
+{
+    va_list args;
+    va_start(args, sql);
+    char buf[1024];
+    vsprintf(buf, sql, args);
+    va_end(args);
+    txn.exec(buf);
+}
+
+template<class T>
+T execQuery( transaction_base& txn, char const* sql, ...)
+{
+    va_list args;
+    va_start(args, sql);
+    char buf[1024];
+    vsprintf(buf, sql, args);
+    va_end(args);
+    result r = txn.exec(buf);
+    return r[0][0].as(T());
+}
+
+/* runs a statement while cleaning up, ignoring any errors */
+void execQuietly(transaction_base& txn, char const* sql, ...)
+{
+    va_list args;
+    va_start(args, sql);
+    char buf[1024];
+    vsprintf(buf, sql, args);
+    va_end(args);
+    try {
+        txn.exec(buf);
+    } catch (pqxx_exception const& x) {}
+}
+
+inline csn_t maxCsn(csn_t t1, csn_t t2) {
+    return t1 < t2 ? t2 : t1;
+}
+
+/*
+ * A distributed transaction in progress: the participating nodes, in the
+ * order in which they joined, and the global transaction identifier used
+ * for two-phase commit.
+ */
+struct global_transaction
+{
+    vector<nontransaction*> txns;
+    char gtid[64];
+    bool prepared;
+};
+
+/*
+ * Transaction manager specific parts of the benchmark. A manager knows how
+ * to set up the nodes, and how to begin and finish a transaction spanning
+ * the given connections. Managers replicating or distributing data on their
+ * own run each transaction through a single connection.
+ */
+class manager
+{
+  public:
+    virtual ~manager() {}
+    virtual char const* name() const = 0;
+    virtual char const* defaultIsolationLevel() const { return "read committed"; }
+    virtual bool multiNode() const { return true; }
+    virtual void initialize() = 0;
+    virtual void begin(global_transaction& gtx, stopwatch& sw, int threadId, int seqno) = 0;
+    virtual void commit(global_transaction& gtx, stopwatch& sw) = 0;
+
+    virtual void rollback(global_transaction& gtx) {
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            execQuietly(*gtx.txns[i], "rollback");
+        }
+    }
+
+  protected:
+    void beginLocal(global_transaction& gtx) {
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            exec(*gtx.txns[i], "begin transaction isolation level %s", cfg.isolationLevel);
+        }
+    }
+
+    void commitLocal(global_transaction& gtx) {
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            exec(*gtx.txns[i], "commit transaction");
+        }
+    }
+
+    /* creates the extension and accounts table on the given nodes */
+    void createAccounts(char const* extension, size_t nNodes) {
+        for (size_t i = 0; i < nNodes; i++) {
+            connection conn(cfg.connections[i]);
+            {
+                nontransaction txn(conn);
+                exec(txn, "drop extension if exists %s", extension);
+                exec(txn, "create extension %s", extension);
+                exec(txn, "drop table if exists t");
+                exec(txn, "create table t(u int primary key, v int)");
+            }
+            work txn(conn);
+            exec(txn, "insert into t (select generate_series(0,%d), %d)", cfg.nAccounts-1, 0);
+            txn.commit();
+        }
+    }
+};
+
+/* pg_dtm: global transactions and snapshots are handed out by the arbiter */
+class dtm_manager : public manager
+{
+  public:
+    char const* name() const { return "dtm"; }
+    char const* defaultIsolationLevel() const { return "repeatable read"; }
+
+    void initialize() {
+        createAccounts("pg_dtm", cfg.connections.size());
+    }
+
+    void begin(global_transaction& gtx, stopwatch& sw, int threadId, int seqno) {
+        int64_t xid = execQuery<int64_t>(*gtx.txns[0], "select dtm_begin_transaction()");
+        sw.lap(PHASE_BEGIN);
+        for (size_t i = 1; i < gtx.txns.size(); i++) {
+            exec(*gtx.txns[i], "select dtm_join_transaction(%ld)", xid);
+        }
+        sw.lap(PHASE_SNAPSHOT);
+        beginLocal(gtx);
+    }
+
+    void commit(global_transaction& gtx, stopwatch& sw) {
+        commitLocal(gtx);
+        sw.lap(PHASE_COMMIT);
+    }
+};
+
+/*
+ * pg_tsdtm: timestamp-based snapshots are agreed upon by the participants,
+ * and the commit timestamp is the maximum of the ones they propose during
+ * two-phase commit.
+ */
+class tsdtm_manager : public manager
+{
+  public:
+    char const* name() const { return "tsdtm"; }
+
+    void initialize() {
+        createAccounts("pg_tsdtm", cfg.connections.size());
+    }
+
+    void begin(global_transaction& gtx, stopwatch& sw, int threadId, int seqno) {
+        sprintf(gtx.gtid, "%d.%d.%d", cfg.startId, threadId, seqno);
+        beginLocal(gtx);
+        csn_t snapshot = execQuery<csn_t>(*gtx.txns[0], "select dtm_extend('%s')", gtx.gtid);
+        sw.lap(PHASE_BEGIN);
+        if (cfg.maxSnapshot) {
+            for (size_t i = 1; i < gtx.txns.size(); i++) {
+                snapshot = maxCsn(snapshot, execQuery<csn_t>(*gtx.txns[i], "select dtm_extend('%s')", gtx.gtid));
+            }
+            for (size_t i = 0; i < gtx.txns.size(); i++) {
+                execQuery<csn_t>(*gtx.txns[i], "select dtm_access(%ld, '%s')", snapshot, gtx.gtid);
+            }
+        } else {
+            for (size_t i = 1; i < gtx.txns.size(); i++) {
+                snapshot = execQuery<csn_t>(*gtx.txns[i], "select dtm_access(%ld, '%s')", snapshot, gtx.gtid);
+            }
+        }
+        sw.lap(PHASE_SNAPSHOT);
+    }
+
+    void commit(global_transaction& gtx, stopwatch& sw) {
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            exec(*gtx.txns[i], "prepare transaction '%s'", gtx.gtid);
+        }
+        gtx.prepared = true;
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            exec(*gtx.txns[i], "select dtm_begin_prepare('%s')", gtx.gtid);
+        }
+        csn_t csn = 0;
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            csn = execQuery<csn_t>(*gtx.txns[i], "select dtm_prepare('%s', %ld)", gtx.gtid, csn);
+        }
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            exec(*gtx.txns[i], "select dtm_end_prepare('%s', %ld)", gtx.gtid, csn);
+        }
+        sw.lap(PHASE_PREPARE);
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            exec(*gtx.txns[i], "commit prepared '%s'", gtx.gtid);
+        }
+        sw.lap(PHASE_COMMIT);
+    }
+
+    void rollback(global_transaction& gtx) {
+        for (size_t i = 0; i < gtx.txns.size(); i++) {
+            execQuietly(*gtx.txns[i], "rollback");
+            if (gtx.prepared) {
+                execQuietly(*gtx.txns[i], "rollback prepared '%s'", gtx.gtid);
+            }
+        }
+    }
+};
+
+/*
+ * multimaster: every node holds all data, so a transaction runs on a single
+ * node and the commit replicates it to the others.
+ */
+class multimaster_manager : public manager
+{
+  public:
+    char const* name() const { return "multimaster"; }
+    char const* defaultIsolationLevel() const { return "repeatable read"; }
+    bool multiNode() const { return false; }
+
+    void initialize() {
+        createAccounts("multimaster", 1);
+    }
+
+    void begin(global_transaction& gtx, stopwatch& sw, int threadId, int seqno) {
+        beginLocal(gtx);
+        sw.lap(PHASE_BEGIN);
+    }
+
+    void commit(global_transaction& gtx, stopwatch& sw) {
+        commitLocal(gtx);
+        sw.lap(PHASE_COMMIT);
+    }
+};
+
+/*
+ * pg_shard: transactions run on the master, which forwards them to the
+ * worker nodes holding the shards; with pg_shard.use_dtm_transactions on,
+ * the master coordinates them through the distributed transaction manager.
+ */
+class shard_manager : public manager
+{
+  public:
+    char const* name() const { return "shard"; }
+    bool multiNode() const { return false; }
+
+    void initialize() {
+        connection conn(cfg.connections[0]);
+        {
+            nontransaction txn(conn);
+            exec(txn, "drop extension if exists pg_shard cascade");
+            exec(txn, "create extension pg_shard");
+            exec(txn, "drop table if exists t");
+            exec(txn, "create table t(u int primary key, v int)");
+            exec(txn, "select master_create_distributed_table(table_name := 't', partition_column := 'u')");
+            exec(txn, "select master_create_worker_shards(table_name := 't', shard_count := 100, replication_factor := 1)");
+        }
+        work txn(conn);
+        for (int i = 0; i < cfg.nAccounts; i++) {
+            exec(txn, "insert into t values (%d,0)", i);
+        }
+        txn.commit();
+    }
+
+    void begin(global_transaction& gtx, stopwatch& sw, int threadId, int seqno) {
+        beginLocal(gtx);
+        sw.lap(PHASE_BEGIN);
+    }
+
+    void commit(global_transaction& gtx, stopwatch& sw) {
+        commitLocal(gtx);
+        sw.lap(PHASE_COMMIT);
+    }
+};
+
+manager* mgr;
+
+static manager* createManager(char const* name)
+{
+    if (strcmp(name, "dtm") == 0) {
+        return new dtm_manager();
+    } else if (strcmp(name, "tsdtm") == 0) {
+        return new tsdtm_manager();
+    } else if (strcmp(name, "multimaster") == 0) {
+        return new multimaster_manager();
+    } else if (strcmp(name, "shard") == 0) {
+        return new shard_manager();
+    }
+    return NULL;
+}
+
+/*
+ * Workloads set the number of reader and writer threads and the share of
+ * writer transactions which transfer money rather than check balances.
+ */
+static bool applyWorkload(char const* name)
+{
+    if (strcmp(name, "transfers") == 0) {
+        cfg.nReaders = 0;
+        cfg.updatePercent = 100;
+    } else if (strcmp(name, "readers") == 0) {
+        cfg.nWriters = 0;
+        if (cfg.nReaders == 0) {
+            cfg.nReaders = 1;
+        }
+    } else if (strcmp(name, "mixed") != 0) {
+        return false;
+    }
+    cfg.workloadName = name;
+    return true;
+}
+
+/* opens a connection to every node */
+static void connectAll(vector< my_unique_ptr<connection> >& conns)
+{
+    for (size_t i = 0; i < conns.size(); i++) {
+        conns[i] = new connection(cfg.connections[i]);
+    }
+}
+
+/*
+ * Readers compute the total balance over all accounts. As transfers keep it
+ * unchanged, any other total than zero exposes an inconsistent snapshot.
+ */
+void* reader(void* arg)
+{
+    thread& t = *(thread*)arg;
+    vector< my_unique_ptr<connection> > conns(cfg.connections.size());
+    connectAll(conns);
+    size_t nNodes = mgr->multiNode() ? conns.size() : 1;
+
+    while (running && (cfg.nWriters != 0 || t.transactions < (size_t)cfg.nIterations)) {
+        global_transaction gtx;
+        vector< my_unique_ptr<nontransaction> > txns(nNodes);
+        size_t first = mgr->multiNode() ? 0 : random() % conns.size();
+        for (size_t i = 0; i < nNodes; i++) {
+            txns[i] = new nontransaction(*conns[(first + i) % conns.size()]);
+            gtx.txns.push_back(txns[i].get());
+        }
+        gtx.prepared = false;
+
+        stopwatch sw(t.lat);
+        try {
+            mgr->begin(gtx, sw, t.id, (int)t.transactions);
+            int64_t sum = 0;
+            for (size_t i = 0; i < nNodes; i++) {
+                sum += execQuery<int64_t>(*gtx.txns[i], "select sum(v) from t");
+            }
+            sw.lap(PHASE_EXECUTE);
+            mgr->commit(gtx, sw);
+            sw.finish();
+            if (sum != 0) {
+                t.inconsistencies += 1;
+            }
+        } catch (pqxx_exception const& x) {
+            mgr->rollback(gtx);
+            t.aborts += 1;
+            continue;
+        }
+        t.transactions += 1;
+        t.selects += nNodes;
+    }
+    return NULL;
+}
+
+/*
+ * Writers transfer a unit between two random accounts. With several nodes
+ * taking part in a transaction, the accounts are debited and credited on
+ * two different nodes; otherwise, a share of the transactions only reads
+ * both balances, as set by the update percentage.
+ */
+void* writer(void* arg)
+{
+    thread& t = *(thread*)arg;
+    vector< my_unique_ptr<connection> > conns(cfg.connections.size());
+    connectAll(conns);
+
+    for (int i = 0; i < cfg.nIterations; i++)
+    {
+        int srcAcc = cfg.startId + random() % cfg.diapason;
+        int dstAcc = cfg.startId + random() % cfg.diapason;
+
+        if (cfg.deadlockFree && srcAcc > dstAcc) { // avoid deadlocks
+            int tmpAcc = dstAcc;
+            dstAcc = srcAcc;
+            srcAcc = tmpAcc;
+        }
+
+        global_transaction gtx;
+        my_unique_ptr<nontransaction> srcTx, dstTx;
+        if (mgr->multiNode()) {
+            size_t srcCon, dstCon;
+            do {
+                srcCon = random() % conns.size();
+                dstCon = random() % conns.size();
+            } while (srcCon == dstCon);
+            srcTx = new nontransaction(*conns[srcCon]);
+            dstTx = new nontransaction(*conns[dstCon]);
+            gtx.txns.push_back(srcTx.get());
+            gtx.txns.push_back(dstTx.get());
+        } else {
+            srcTx = new nontransaction(*conns[random() % conns.size()]);
+            gtx.txns.push_back(srcTx.get());
+        }
+        nontransaction& src = *gtx.txns.front();
+        nontransaction& dst = *gtx.txns.back();
+        gtx.prepared = false;
+
+        bool update = random() % 100 < cfg.updatePercent;
+        stopwatch sw(t.lat);
+        try {
+            mgr->begin(gtx, sw, t.id, i);
+            if (cfg.makeSavepoints) {
+                for (size_t j = 0; j < gtx.txns.size(); j++) {
+                    exec(*gtx.txns[j], "savepoint c%d", (int)j);
+                }
+            }
+            if (update) {
+                exec(src, "update t set v = v - 1 where u=%d", srcAcc);
+                exec(dst, "update t set v = v + 1 where u=%d", dstAcc);
+            } else {
+                int64_t sum = execQuery<int64_t>(src, "select v from t where u=%d", srcAcc)
+                    + execQuery<int64_t>(dst, "select v from t where u=%d", dstAcc);
+                if (sum > cfg.nIterations*cfg.nWriters || sum < -cfg.nIterations*cfg.nWriters) {
+                    t.inconsistencies += 1;
+                }
+            }
+            sw.lap(PHASE_EXECUTE);
+            mgr->commit(gtx, sw);
+            sw.finish();
+        } catch (pqxx_exception const& x) {
+            mgr->rollback(gtx);
+            t.aborts += 1;
+            i -= 1;
+            continue;
+        }
+
+        t.transactions += 1;
+        if (update) {
+            t.updates += 2;
+        } else {
+            t.selects += 2;
+        }
+    }
+    return NULL;
+}
+
+static void printText(latencies const& readLat, latencies const& writeLat)
+{
+    latencies const* kinds[2] = { &writeLat, &readLat };
+    char const* kindNames[2] = { "writers", "readers" };
+
+    printf("%-8s %-9s %10s %10s %10s %10s %10s %10s\n",
+           "threads", "phase", "count", "mean(us)", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+    for (int k = 0; k < 2; k++) {
+        for (int p = 0; p < N_PHASES; p++) {
+            histogram const& h = kinds[k]->phases[p];
+            if (h.samples() == 0) {
+                continue;
+            }
+            printf("%-8s %-9s %10lu %10.1f %10lu %10lu %10lu %10lu\n",
+                   kindNames[k], phaseNames[p], (unsigned long)h.samples(), h.mean(),
+                   (unsigned long)h.percentile(0.5), (unsigned long)h.percentile(0.99),
+                   (unsigned long)h.percentile(0.999), (unsigned long)h.max());
+        }
+    }
+}
+
+static void printCsv(latencies const& readLat, latencies const& writeLat, double tps)
+{
+    latencies const* kinds[2] = { &writeLat, &readLat };
+    char const* kindNames[2] = { "writers", "readers" };
+
+    printf("manager,workload,hosts,readers,writers,tps,threads,phase,count,mean_us,p50_us,p99_us,p999_us,max_us\n");
+    for (int k = 0; k < 2; k++) {
+        for (int p = 0; p < N_PHASES; p++) {
+            histogram const& h = kinds[k]->phases[p];
+            if (h.samples() == 0) {
+                continue;
+            }
+            printf("%s,%s,%ld,%d,%d,%f,%s,%s,%lu,%.1f,%lu,%lu,%lu,%lu\n",
+                   mgr->name(), cfg.workloadName, (long)cfg.connections.size(),
+                   cfg.nReaders, cfg.nWriters, tps, kindNames[k], phaseNames[p],
+                   (unsigned long)h.samples(), h.mean(),
+                   (unsigned long)h.percentile(0.5), (unsigned long)h.percentile(0.99),
+                   (unsigned long)h.percentile(0.999), (unsigned long)h.max());
+        }
+    }
+}
+
+static void printJsonLatencies(char const* kind, latencies const& lat)
+{
+    bool first = true;
+
+    printf("\"%s\":{", kind);
+    for (int p = 0; p < N_PHASES; p++) {
+        histogram const& h = lat.phases[p];
+        if (h.samples() == 0) {
+            continue;
+        }
+        printf("%s\"%s\":{\"count\":%lu, \"mean\":%.1f, \"p50\":%lu, \"p99\":%lu, \"p999\":%lu, \"max\":%lu}",
+               first ? "" : ", ", phaseNames[p], (unsigned long)h.samples(), h.mean(),
+               (unsigned long)h.percentile(0.5), (unsigned long)h.percentile(0.99),
+               (unsigned long)h.percentile(0.999), (unsigned long)h.max());
+        first = false;
+    }
+    printf("}");
+}
+
+int main (int argc, char* argv[])
+{
+    bool initialize = false;
+    int localNodes = 0;
+    int localPort = 5432;
+
+    if (argc == 1){
+        printf("Use -h to show usage options\n");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            switch (argv[i][1]) {
+            case 't':
+                cfg.managerName = argv[++i];
+                continue;
+            case 'W':
+                cfg.workloadName = argv[++i];
+                continue;
+            case 'r':
+                cfg.nReaders = atoi(argv[++i]);
+                continue;
+            case 'w':
+                cfg.nWriters = atoi(argv[++i]);
+                continue;
+            case 'a':
+                cfg.nAccounts = atoi(argv[++i]);
+                continue;
+            case 'n':
+                cfg.nIterations = atoi(argv[++i]);
+                continue;
+            case 's':
+                cfg.startId = atoi(argv[++i]);
+                continue;
+            case 'd':
+                cfg.diapason = atoi(argv[++i]);
+                continue;
+            case 'p':
+                cfg.updatePercent = atoi(argv[++i]);
+                continue;
+            case 'l':
+                cfg.isolationLevel = argv[++i];
+                continue;
+            case 'C':
+            case 'c':
+                cfg.connections.push_back(string(argv[++i]));
+                continue;
+            case 'L':
+                localNodes = atoi(argv[++i]);
+                continue;
+            case 'P':
+                localPort = atoi(argv[++i]);
+                continue;
+            case 'o':
+                i += 1;
+                if (strcmp(argv[i], "csv") == 0) {
+                    cfg.output = OUTPUT_CSV;
+                } else if (strcmp(argv[i], "json") == 0) {
+                    cfg.output = OUTPUT_JSON;
+                } else {
+                    cfg.output = OUTPUT_TEXT;
+                }
+                continue;
+            case 'f':
+                cfg.deadlockFree = true;
+                continue;
+            case 'm':
+                cfg.maxSnapshot = true;
+                continue;
+            case 'x':
+                cfg.makeSavepoints = true;
+                continue;
+            case 'i':
+                initialize = true;
+                continue;
+            }
+        }
+        printf("Options:\n"
+               "\t-t STR\ttransaction manager: dtm, tsdtm, multimaster, shard (dtm)\n"
+               "\t-W STR\tworkload: transfers, readers, mixed (mixed)\n"
+               "\t-r N\tnumber of readers (1)\n"
+               "\t-w N\tnumber of writers (10)\n"
+               "\t-a N\tnumber of accounts (100000)\n"
+               "\t-s N\tperform updates starting from this id (0)\n"
+               "\t-d N\tperform updates in this diapason (#accounts)\n"
+               "\t-n N\tnumber of iterations (1000)\n"
+               "\t-p N\tupdate percent (100)\n"
+               "\t-l STR\tisolation level (depends on the manager)\n"
+               "\t-c STR\tdatabase connection string\n"
+               "\t-L N\tconnect to N nodes of a local cluster instead\n"
+               "\t-P N\tport of the first node of the local cluster (5432)\n"
+               "\t-o STR\toutput format: text, csv, json (text)\n"
+               "\t-f\tavoid deadlocks by ordering accounts\n"
+               "\t-m\tchoose maximal snapshot\n"
+               "\t-x\tmake savepoints\n"
+               "\t-i\tinitialize database\n");
+        return 1;
+    }
+
+    mgr = createManager(cfg.managerName);
+    if (mgr == NULL) {
+        printf("Unknown transaction manager %s\n", cfg.managerName);
+        return 1;
+    }
+    if (!applyWorkload(cfg.workloadName)) {
+        printf("Unknown workload %s\n", cfg.workloadName);
+        return 1;
+    }
+    if (cfg.isolationLevel == NULL) {
+        cfg.isolationLevel = mgr->defaultIsolationLevel();
+    }
+
+    for (int i = 0; i < localNodes; i++) {
+        char connStr[128];
+        sprintf(connStr, "dbname=postgres host=localhost port=%d sslmode=disable", localPort + i);
+        cfg.connections.push_back(string(connStr));
+    }
+    if (cfg.connections.size() == 0) {
+        printf("At least one connection has to be specified\n");
+        return 1;
+    }
+    if (mgr->multiNode() && cfg.connections.size() < 2) {
+        printf("At least two connections has to be specified\n");
+        return 1;
+    }
+
+    if (cfg.startId + cfg.diapason > cfg.nAccounts) {
+        cfg.diapason = cfg.nAccounts - cfg.startId;
+    }
+
+    if (initialize) {
+        mgr->initialize();
+        printf("%d accounts inserted\n", cfg.nAccounts);
+        return 0;
+    }
+
+    time_t start = getCurrentTime();
+    running = true;
+
+    vector<thread> readers(cfg.nReaders);
+    vector<thread> writers(cfg.nWriters);
+    size_t nUpdates = 0;
+    size_t nSelects = 0;
+    size_t nWrites = 0;
+    size_t nReads = 0;
+    size_t nAborts = 0;
+    size_t nInconsistencies = 0;
+    latencies readLat, writeLat;
+
+    for (int i = 0; i < cfg.nReaders; i++) {
+        readers[i].start(i, reader);
+    }
+    for (int i = 0; i < cfg.nWriters; i++) {
+        writers[i].start(i, writer);
+    }
+
+    for (int i = 0; i < cfg.nWriters; i++) {
+        writers[i].wait();
+        nUpdates += writers[i].updates;
+        nSelects += writers[i].selects;
+        nWrites += writers[i].transactions;
+        nAborts += writers[i].aborts;
+        nInconsistencies += writers[i].inconsistencies;
+        writeLat.merge(writers[i].lat);
+    }
+
+    running = false;
+
+    for (int i = 0; i < cfg.nReaders; i++) {
+        readers[i].wait();
+        nSelects += readers[i].selects;
+        nReads += readers[i].transactions;
+        nAborts += readers[i].aborts;
+        nInconsistencies += readers[i].inconsistencies;
+        readLat.merge(readers[i].lat);
+    }
+
+    time_t elapsed = getCurrentTime() - start;
+    if (elapsed == 0) {
+        printf("Test is completed too fast\n");
+        return 1;
+    }
+    double tps = (double)((nWrites + nReads)*USEC)/elapsed;
+
+    switch (cfg.output) {
+    case OUTPUT_TEXT:
+        printf("manager=%s workload=%s hosts=%ld readers=%d writers=%d\n",
+               mgr->name(), cfg.workloadName, (long)cfg.connections.size(), cfg.nReaders, cfg.nWriters);
+        printf("TPS=%f, TPS(writes)=%f, TPS(reads)=%f, aborts=%ld, inconsistencies=%ld\n",
+               tps, (double)(nWrites*USEC)/elapsed, (double)(nReads*USEC)/elapsed,
+               (long)nAborts, (long)nInconsistencies);
+        printText(readLat, writeLat);
+        break;
+    case OUTPUT_CSV:
+        printCsv(readLat, writeLat, tps);
+        break;
+    case OUTPUT_JSON:
+        printf(
+            "{\"manager\":\"%s\", \"workload\":\"%s\", \"tps\":%f, \"update_tps\":%f, \"read_tps\":%f,"
+            " \"transactions\":%ld, \"selects\":%ld, \"updates\":%ld, \"aborts\":%ld, \"abort_percent\": %d,"
+            " \"inconsistencies\":%ld, \"readers\":%d, \"writers\":%d, \"update_percent\":%d,"
+            " \"accounts\":%d, \"iterations\":%d, \"hosts\":%ld, ",
+            mgr->name(), cfg.workloadName, tps,
+            (double)(nWrites*USEC)/elapsed, (double)(nReads*USEC)/elapsed,
+            (long)(nWrites + nReads), (long)nSelects, (long)nUpdates, (long)nAborts,
+            (int)(nAborts*100/(nWrites + nReads + 0.0001)), (long)nInconsistencies,
+            cfg.nReaders, cfg.nWriters, cfg.updatePercent,
+            cfg.nAccounts, cfg.nIterations, (long)cfg.connections.size());
+        printf("\"latency\":{");
+        printJsonLatencies("writers", writeLat);
+        printf(", ");
+        printJsonLatencies("readers", readLat);
+        printf("}}\n");
+        break;
+    }
+
+    delete mgr;
+    return 0;
+}
+// vim: sts=4 ts=4 sw=4 expandtab
@@ -632,9 +632,11 @@ static void MtmTransReceiver(Datum arg)
 						case MSG_READY:
 							Assert(ts->status == TRANSACTION_STATUS_ABORTED || ts->status == TRANSACTION_STATUS_IN_PROGRESS);
 							Assert(ts->nVotes < ds->nNodes);
+							MtmStatRecordPeer(msg->node-1, MTM_PEER_STAT_REPLICATION, ts->startTime);
 							if (++ts->nVotes == ds->nNodes) { 
 								/* All nodes are finished their transactions */
 								if (ts->status == TRANSACTION_STATUS_IN_PROGRESS) {
+									ts->phaseStart = MtmStatRecord(MTM_STAT_REPLICATION, ts->phaseStart);
 									ts->nVotes = 1; /* I voted myself */
 									ts->cmd = MSG_PREPARE;
 								} else { 
@@ -649,12 +651,14 @@ static void MtmTransReceiver(Datum arg)
 						case MSG_PREPARED:
  						    Assert(ts->status == TRANSACTION_STATUS_IN_PROGRESS);
 							Assert(ts->nVotes < ds->nNodes);
+							MtmStatRecordPeer(msg->node-1, MTM_PEER_STAT_PREPARE, ts->phaseStart);
 							if (msg->csn > ts->csn) {
 								ts->csn = msg->csn;
 								MtmSyncClock(ts->csn);
 							}
 							if (++ts->nVotes == ds->nNodes) { 
 								/* ts->csn is maximum of CSNs at all nodes */
+								ts->phaseStart = MtmStatRecord(MTM_STAT_PREPARE, ts->phaseStart);
 								ts->nVotes = 1; /* I voted myself */
 								ts->cmd = MSG_COMMIT;
 								ts->csn = MtmAssignCSN();
@@ -666,8 +670,10 @@ static void MtmTransReceiver(Datum arg)
 						case MSG_COMMITTED:
 							Assert(ts->status == TRANSACTION_STATUS_UNKNOWN);
 							Assert(ts->nVotes < ds->nNodes);
+							MtmStatRecordPeer(msg->node-1, MTM_PEER_STAT_COMMIT, ts->phaseStart);
 							if (++ts->nVotes == ds->nNodes) { 									
 								/* All nodes have the same CSN */
+								MtmStatRecord(MTM_STAT_COMMIT, ts->phaseStart);
 								MtmWakeUpBackend(ts);
 							}
 							break;
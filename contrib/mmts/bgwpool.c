@@ -7,8 +7,11 @@
 #include "storage/spin.h"
 #include "storage/pg_sema.h"
 #include "storage/shmem.h"
+#include "storage/lwlock.h"
+#include "access/clog.h"
+#include "utils/hsearch.h"
 
-#include "bgwpool.h"
+#include "multimaster.h"
 
 typedef struct
 {
@@ -26,6 +29,7 @@ static void BgwPoolMainLoop(Datum arg)
     BgwPool* pool = ctx->constructor();
     int size;
     void* work;
+    timestamp_t enqueueTime;
 
     BackgroundWorkerUnblockSignals();
 	BackgroundWorkerInitializeConnection(pool->dbname, NULL);
@@ -37,13 +41,16 @@ static void BgwPoolMainLoop(Datum arg)
         SpinLockAcquire(&pool->lock);
         size = *(int*)&pool->queue[pool->head];
         Assert(size < pool->size);
-        work = palloc(size);
+        /* work is prepended with the time it was queued at */
+        work = palloc(size - sizeof(timestamp_t));
         pool->active -= 1;
         if (pool->head + size + 4 > pool->size) { 
-            memcpy(work, pool->queue, size);
+            memcpy(&enqueueTime, pool->queue, sizeof(timestamp_t));
+            memcpy(work, pool->queue + sizeof(timestamp_t), size - sizeof(timestamp_t));
             pool->head = INTALIGN(size);
         } else { 
-            memcpy(work, &pool->queue[pool->head+4], size);
+            memcpy(&enqueueTime, &pool->queue[pool->head+4], sizeof(timestamp_t));
+            memcpy(work, &pool->queue[pool->head+4+sizeof(timestamp_t)], size - sizeof(timestamp_t));
             pool->head += 4 + INTALIGN(size);
         }
         if (pool->size == pool->head) { 
@@ -54,7 +61,8 @@ static void BgwPoolMainLoop(Datum arg)
             PGSemaphoreUnlock(&pool->overflow);
         }
         SpinLockRelease(&pool->lock);
-        pool->executor(id, work, size);
+        MtmStatRecord(MTM_STAT_APPLY_QUEUE, enqueueTime);
+        pool->executor(id, work, size - sizeof(timestamp_t));
         pfree(work);
     }
 }
@@ -97,8 +105,10 @@ void BgwPoolStart(int nWorkers, BgwPoolConstructor constructor)
     }
 }
 
-void BgwPoolExecute(BgwPool* pool, void* work, size_t size)
+void BgwPoolExecute(BgwPool* pool, void* work, size_t workSize)
 {
+    size_t size = workSize + sizeof(timestamp_t);
+    timestamp_t now = MtmGetSystemTime();
     Assert(size+4 <= pool->size);
  
     SpinLockAcquire(&pool->lock);
@@ -116,10 +126,12 @@ void BgwPoolExecute(BgwPool* pool, void* work, size_t size)
             n_active += pool->active;
             *(int*)&pool->queue[pool->tail] = size;
             if (pool->size - pool->tail >= size + 4) { 
-                memcpy(&pool->queue[pool->tail+4], work, size);
+                memcpy(&pool->queue[pool->tail+4], &now, sizeof(timestamp_t));
+                memcpy(&pool->queue[pool->tail+4+sizeof(timestamp_t)], work, workSize);
                 pool->tail += 4 + INTALIGN(size);
             } else { 
-                memcpy(pool->queue, work, size);
+                memcpy(pool->queue, &now, sizeof(timestamp_t));
+                memcpy(pool->queue + sizeof(timestamp_t), work, workSize);
                 pool->tail = INTALIGN(size);
             }
             if (pool->tail == pool->size) {
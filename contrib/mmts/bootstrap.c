@@ -0,0 +1,362 @@
+/*
+ * bootstrap.c
+ *
+ * Parallel initial copy of data to the joining or recovering node.
+ *
+ * If replication slot of the node was dropped at donor (or never existed), its changes can not be
+ * obtained using logical replication. In this case receiver creates new slot, which exports snapshot
+ * consistent with the start position of the slot, and starts multimaster.bootstrap_workers background workers.
+ * Each worker imports this snapshot at donor and copies tables (largest first) using COPY protocol,
+ * grabbing next table from the shared counter. Once all tables are copied, receiver starts replication
+ * from the consistent point of the slot, so no changes are lost or applied twice.
+ * The first worker also sets sequences of the node to their current values at donor.
+ *
+ * The receiver which claimed the bootstrap releases it at exit, so that an error in the receiver
+ * doesn't block bootstrap of the node forever.
+ */
+
+#include <unistd.h>
+#include "postgres.h"
+#include "fmgr.h"
+#include "libpq-fe.h"
+#include "miscadmin.h"
+#include "access/clog.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/pg_sema.h"
+#include "storage/spin.h"
+#include "utils/hsearch.h"
+
+#include "multimaster.h"
+
+#define BOOTSTRAP_POLL_DELAY 100000 /* usec */
+
+int MtmBootstrapWorkers;
+
+/* State of the bootstrap claimed by this receiver, released by MtmBootstrapRelease */
+static bool MtmBootstrapClaimed;
+static BackgroundWorkerHandle** MtmBootstrapHandles;
+static int MtmBootstrapStarted;
+
+/*
+ * User tables of donor. Tables are ordered by size, so that the largest tables are started first
+ * and do not delay the end of the bootstrap. All workers use the same snapshot, so the list is the same for all of them.
+ */
+static char const* const MtmTablesQuery =
+	"SELECT format('%I.%I', n.nspname, c.relname) FROM pg_class c JOIN pg_namespace n ON c.relnamespace = n.oid "
+	"WHERE c.relkind = 'r' AND c.relpersistence = 'p' AND n.nspname NOT IN ('pg_catalog', 'information_schema', '" MULTIMASTER_SCHEMA_NAME "') "
+	"AND n.nspname NOT LIKE 'pg_toast%' ORDER BY c.relpages DESC, c.oid";
+
+/*
+ * User sequences of donor
+ */
+static char const* const MtmSequencesQuery =
+	"SELECT format('%I.%I', n.nspname, c.relname) FROM pg_class c JOIN pg_namespace n ON c.relnamespace = n.oid "
+	"WHERE c.relkind = 'S' AND c.relpersistence = 'p' AND n.nspname NOT IN ('pg_catalog', 'information_schema', '" MULTIMASTER_SCHEMA_NAME "') "
+	"ORDER BY c.oid";
+
+/*
+ * Get connection string of the node from multimaster.conn_strings
+ */
+static char* MtmGetConnStr(int nodeId)
+{
+	char* conn_str = MtmConnStrs;
+	char* conn_str_end = conn_str + strlen(conn_str);
+	int i = 0;
+
+	while (conn_str < conn_str_end) {
+		char* p = strchr(conn_str, ',');
+		if (p == NULL) {
+			p = conn_str_end;
+		}
+		if (++i == nodeId) {
+			return psprintf("%.*s", (int)(p - conn_str), conn_str);
+		}
+		conn_str = p + 1;
+	}
+	elog(ERROR, "NodeID %d is out of range [1,%d]", nodeId, i);
+	return NULL;
+}
+
+static PGconn* MtmBootstrapConnect(int nodeId)
+{
+	PGconn* conn = PQconnectdb(MtmGetConnStr(nodeId));
+	if (PQstatus(conn) != CONNECTION_OK) {
+		char* msg = pstrdup(PQerrorMessage(conn));
+		PQfinish(conn);
+		elog(ERROR, "Bootstrap: could not connect to node %d: %s", nodeId, msg);
+	}
+	return conn;
+}
+
+/*
+ * Execute statement and check its result
+ */
+static PGresult* MtmBootstrapExec(PGconn* conn, char const* sql, ExecStatusType expected)
+{
+	PGresult* res = PQexec(conn, sql);
+	if (PQresultStatus(res) != expected) {
+		char* msg = pstrdup(PQerrorMessage(conn));
+		PQclear(res);
+		elog(ERROR, "Bootstrap: command '%s' failed: %s", sql, msg);
+	}
+	return res;
+}
+
+static void MtmBootstrapCommand(PGconn* conn, char const* sql)
+{
+	PQclear(MtmBootstrapExec(conn, sql, PGRES_COMMAND_OK));
+}
+
+/*
+ * Stream content of the table from donor to local node.
+ * Old content of the table is deleted in the same transaction, so copy can be retried.
+ * Triggers and foreign key checks are disabled, because tables are copied in arbitrary order.
+ */
+static void MtmBootstrapCopyTable(PGconn* src, PGconn* dst, char const* table)
+{
+	PGresult* res;
+	char* buf;
+	int len;
+
+	MtmBootstrapCommand(dst, "BEGIN");
+	MtmBootstrapCommand(dst, "SET LOCAL session_replication_role = replica");
+	MtmBootstrapCommand(dst, psprintf("DELETE FROM ONLY %s", table));
+
+	PQclear(MtmBootstrapExec(src, psprintf("COPY %s TO STDOUT", table), PGRES_COPY_OUT));
+	PQclear(MtmBootstrapExec(dst, psprintf("COPY %s FROM STDIN", table), PGRES_COPY_IN));
+
+	while ((len = PQgetCopyData(src, &buf, 0)) > 0) {
+		if (PQputCopyData(dst, buf, len) <= 0) {
+			elog(ERROR, "Bootstrap: failed to copy table %s to local node: %s", table, PQerrorMessage(dst));
+		}
+		PQfreemem(buf);
+		CHECK_FOR_INTERRUPTS();
+	}
+	if (len == -2) {
+		elog(ERROR, "Bootstrap: failed to copy table %s from donor: %s", table, PQerrorMessage(src));
+	}
+	res = PQgetResult(src);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		elog(ERROR, "Bootstrap: failed to copy table %s from donor: %s", table, PQerrorMessage(src));
+	}
+	PQclear(res);
+
+	if (PQputCopyEnd(dst, NULL) <= 0) {
+		elog(ERROR, "Bootstrap: failed to copy table %s to local node: %s", table, PQerrorMessage(dst));
+	}
+	res = PQgetResult(dst);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		elog(ERROR, "Bootstrap: failed to copy table %s to local node: %s", table, PQerrorMessage(dst));
+	}
+	PQclear(res);
+	MtmBootstrapCommand(dst, "COMMIT");
+}
+
+/*
+ * Set sequences of local node to their values at donor.
+ * Sequences are not transactional, so donor returns their current values rather than those seen by the snapshot.
+ * They can only be larger, so values used by the copied rows are never generated again.
+ */
+static int MtmBootstrapCopySequences(PGconn* src, PGconn* dst)
+{
+	PGresult* seqs = MtmBootstrapExec(src, MtmSequencesQuery, PGRES_TUPLES_OK);
+	int nSeqs = PQntuples(seqs);
+	int i;
+
+	for (i = 0; i < nSeqs; i++) {
+		char const* seq = PQgetvalue(seqs, i, 0);
+		PGresult* res = MtmBootstrapExec(src, psprintf("SELECT last_value, is_called FROM %s", seq), PGRES_TUPLES_OK);
+		char* name = PQescapeLiteral(dst, seq, strlen(seq));
+
+		PQclear(MtmBootstrapExec(dst, psprintf("SELECT pg_catalog.setval(%s, %s, %s)", name,
+											   PQgetvalue(res, 0, 0), *PQgetvalue(res, 0, 1) == 't' ? "true" : "false"),
+								 PGRES_TUPLES_OK));
+		PQfreemem(name);
+		PQclear(res);
+		CHECK_FOR_INTERRUPTS();
+	}
+	PQclear(seqs);
+	return nSeqs;
+}
+
+/*
+ * Main function of bootstrap worker. Started by receiver in MtmBootstrap.
+ */
+void MtmBootstrapWorkerMain(Datum arg)
+{
+	MtmState* ds = MtmGetState();
+	MtmBootstrapState* bs = &ds->bootstrap;
+	PGconn* src;
+	PGconn* dst;
+	PGresult* tables;
+	int nTables;
+	int nCopied = 0;
+
+	BackgroundWorkerUnblockSignals();
+
+	src = MtmBootstrapConnect(bs->donor);
+	dst = MtmBootstrapConnect(MtmNodeId);
+
+	MtmBootstrapCommand(src, "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ READ ONLY");
+	MtmBootstrapCommand(src, psprintf("SET TRANSACTION SNAPSHOT '%s'", bs->snapshot));
+
+	/* Worker is not counted as completed if this fails, so bootstrap is retried */
+	if (DatumGetInt32(arg) == 1) {
+		int nSeqs = MtmBootstrapCopySequences(src, dst);
+		elog(LOG, "Bootstrap worker %d copied %d sequences from node %d", (int)DatumGetInt32(arg), nSeqs, bs->donor);
+	}
+
+	tables = MtmBootstrapExec(src, MtmTablesQuery, PGRES_TUPLES_OK);
+	nTables = PQntuples(tables);
+
+	while (true) {
+		int i;
+		SpinLockAcquire(&ds->spinlock);
+		i = bs->nextTable++;
+		SpinLockRelease(&ds->spinlock);
+		if (i >= nTables) {
+			break;
+		}
+		MtmBootstrapCopyTable(src, dst, PQgetvalue(tables, i, 0));
+		nCopied += 1;
+	}
+	PQclear(tables);
+	MtmBootstrapCommand(src, "COMMIT");
+	PQfinish(src);
+	PQfinish(dst);
+
+	SpinLockAcquire(&ds->spinlock);
+	bs->nCompleted += 1;
+	SpinLockRelease(&ds->spinlock);
+
+	elog(LOG, "Bootstrap worker %d copied %d tables from node %d", (int)DatumGetInt32(arg), nCopied, bs->donor);
+	proc_exit(0);
+}
+
+/*
+ * Release the bootstrap claimed by this receiver if it exits before MtmBootstrap completes, e.g. because of an error.
+ * Workers are stopped, as nobody waits for them anymore.
+ */
+static void MtmBootstrapRelease(int code, Datum arg)
+{
+	MtmState* ds = MtmGetState();
+	int i;
+
+	if (!MtmBootstrapClaimed) {
+		return;
+	}
+	for (i = 0; i < MtmBootstrapStarted; i++) {
+		TerminateBackgroundWorker(MtmBootstrapHandles[i]);
+	}
+	SpinLockAcquire(&ds->spinlock);
+	ds->bootstrap.donor = 0;
+	SpinLockRelease(&ds->spinlock);
+	MtmBootstrapClaimed = false;
+}
+
+/*
+ * Check if data of this node has to be copied from the donor, i.e. replication slot of this node doesn't exist at donor.
+ * Only one receiver can perform bootstrap: it is claimed by this function and released by MtmBootstrap
+ * or at exit of the receiver.
+ */
+bool MtmIsBootstrapNeeded(int donorId, char const* slotName)
+{
+	MtmState* ds = MtmGetState();
+	PGconn* conn;
+	PGresult* res;
+	bool slotExists;
+	bool claimed = false;
+
+	if (MtmBootstrapWorkers == 0) {
+		return false;
+	}
+	conn = MtmBootstrapConnect(donorId);
+	res = MtmBootstrapExec(conn, psprintf("SELECT 1 FROM pg_replication_slots WHERE slot_name = '%s'", slotName), PGRES_TUPLES_OK);
+	slotExists = PQntuples(res) != 0;
+	PQclear(res);
+	PQfinish(conn);
+
+	if (!slotExists) {
+		SpinLockAcquire(&ds->spinlock);
+		if (ds->bootstrap.donor == 0) {
+			ds->bootstrap.donor = donorId;
+			claimed = true;
+		}
+		SpinLockRelease(&ds->spinlock);
+	}
+	if (claimed && !MtmBootstrapClaimed) {
+		MtmBootstrapClaimed = true;
+		before_shmem_exit(MtmBootstrapRelease, (Datum)0);
+	}
+	return claimed;
+}
+
+/*
+ * Copy all tables from donor using snapshot exported by creation of replication slot.
+ * Connection used to create the slot must be kept idle until this function returns.
+ * Returns true if all tables were copied.
+ */
+bool MtmBootstrap(int donorId, char const* snapshotName)
+{
+	MtmState* ds = MtmGetState();
+	MtmBootstrapState* bs = &ds->bootstrap;
+	BackgroundWorkerHandle** handles = (BackgroundWorkerHandle**)palloc(MtmBootstrapWorkers*sizeof(BackgroundWorkerHandle*));
+	BackgroundWorker worker;
+	int nWorkers = 0;
+	int nStopped;
+	bool ok;
+	int i;
+	timestamp_t start = MtmGetSystemTime();
+
+	Assert(bs->donor == donorId && MtmBootstrapClaimed);
+	MtmBootstrapHandles = handles;
+	SpinLockAcquire(&ds->spinlock);
+	strncpy(bs->snapshot, snapshotName, sizeof(bs->snapshot)-1);
+	bs->nextTable = 0;
+	bs->nCompleted = 0;
+	SpinLockRelease(&ds->spinlock);
+
+	MemSet(&worker, 0, sizeof(BackgroundWorker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy(worker.bgw_library_name, "multimaster");
+	strcpy(worker.bgw_function_name, "MtmBootstrapWorkerMain");
+
+	for (i = 0; i < MtmBootstrapWorkers; i++) {
+		snprintf(worker.bgw_name, BGW_MAXLEN, "mtm_bootstrap_%d_%d", donorId, i+1);
+		worker.bgw_main_arg = Int32GetDatum(i+1);
+		if (!RegisterDynamicBackgroundWorker(&worker, &handles[nWorkers])) {
+			elog(WARNING, "Bootstrap: could only start %d of %d workers", nWorkers, MtmBootstrapWorkers);
+			break;
+		}
+		nWorkers += 1;
+		MtmBootstrapStarted = nWorkers;
+	}
+	elog(LOG, "Bootstrap: copy data from node %d using snapshot %s by %d workers", donorId, snapshotName, nWorkers);
+
+	/* Workers which failed to start or exited with error are not counted in nCompleted */
+	do {
+		MtmSleep(BOOTSTRAP_POLL_DELAY);
+		CHECK_FOR_INTERRUPTS();
+		for (i = 0, nStopped = 0; i < nWorkers; i++) {
+			pid_t pid;
+			nStopped += GetBackgroundWorkerPid(handles[i], &pid) == BGWH_STOPPED;
+		}
+	} while (nStopped < nWorkers);
+
+	SpinLockAcquire(&ds->spinlock);
+	ok = nWorkers != 0 && bs->nCompleted == nWorkers;
+	bs->donor = 0;
+	SpinLockRelease(&ds->spinlock);
+	MtmBootstrapClaimed = false;
+	MtmBootstrapStarted = 0;
+
+	pfree(handles);
+	if (ok) {
+		elog(LOG, "Bootstrap: data from node %d is copied in %ld msec", donorId, (long)((MtmGetSystemTime() - start)/1000));
+	}
+	return ok;
+}
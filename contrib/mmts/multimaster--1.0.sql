@@ -18,3 +18,13 @@ AS 'MODULE_PATHNAME','mtm_get_snapshot'
 LANGUAGE C;
 
 CREATE TABLE IF NOT EXISTS mtm.ddl_log (issued timestamp with time zone not null, query text);
+
+CREATE FUNCTION mtm.get_commit_stats(OUT phase text, OUT node integer, OUT count bigint, OUT rate float8, OUT avg_usec float8, OUT median_usec bigint, OUT p99_usec bigint, OUT max_usec bigint) RETURNS SETOF record
+AS 'MODULE_PATHNAME','mtm_get_commit_stats'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.reset_commit_stats() RETURNS void
+AS 'MODULE_PATHNAME','mtm_reset_commit_stats'
+LANGUAGE C;
+
+CREATE VIEW mtm.commit_stats AS SELECT * FROM mtm.get_commit_stats();
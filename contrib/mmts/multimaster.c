@@ -98,6 +98,7 @@ static void MtmPrepareTransaction(MtmCurrentTrans* x);
 static void MtmEndTransaction(MtmCurrentTrans* x, bool commit);
 static TransactionId MtmGetOldestXmin(Relation rel, bool ignoreVacuum);
 static bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
+static void MtmXidInMVCCSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot, bool *inSnapshot, bool *resolved);
 static TransactionId MtmAdjustOldestXid(TransactionId xid);
 static bool MtmDetectGlobalDeadLock(PGPROC* proc);
 static void MtmAddSubtransactions(MtmTransState* ts, TransactionId* subxids, int nSubxids);
@@ -124,7 +125,8 @@ static TransactionManager MtmTM = {
 	PgGetGlobalTransactionId, 
 	MtmXidInMVCCSnapshot, 
 	MtmDetectGlobalDeadLock, 
-	MtmGetName 
+	MtmGetName,
+	MtmXidInMVCCSnapshotBatch
 };
 
 bool  MtmDoReplication;
@@ -177,11 +179,16 @@ void MtmUnlock(void)
  *  System time manipulation functions
  */
 
-timestamp_t MtmGetCurrentTime(void)
+timestamp_t MtmGetSystemTime(void)
 {
     struct timeval tv;
     gettimeofday(&tv, NULL);
-    return (timestamp_t)tv.tv_sec*USEC + tv.tv_usec + dtm->timeShift;
+    return (timestamp_t)tv.tv_sec*USEC + tv.tv_usec;
+}
+
+timestamp_t MtmGetCurrentTime(void)
+{
+    return MtmGetSystemTime() + dtm->timeShift;
 }
 
 void MtmSleep(timestamp_t interval)
@@ -249,6 +256,7 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
     static timestamp_t maxSleepTime;
 #endif
     timestamp_t delay = MIN_WAIT_TIMEOUT;
+    timestamp_t sleepStart = 0;
     Assert(xid != InvalidTransactionId);
 
 	MtmLock(LW_SHARED);
@@ -267,12 +275,18 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
                 MTM_TUPLE_TRACE("%d: tuple with xid=%d(csn=%ld) is invisibile in snapshot %ld\n",
 								getpid(), xid, ts->csn, dtmTx.snapshot);
                 MtmUnlock();
+                if (sleepStart != 0) { 
+                    MtmStatRecord(MTM_STAT_INDOUBT_SLEEP, sleepStart);
+                }
                 return true;
             }
             if (ts->status == TRANSACTION_STATUS_UNKNOWN)
             {
                 MTM_TRACE("%d: wait for in-doubt transaction %u in snapshot %lu\n", getpid(), xid, dtmTx.snapshot);
                 MtmUnlock();
+                if (sleepStart == 0) { 
+                    sleepStart = MtmGetSystemTime();
+                }
 #if TRACE_SLEEP_TIME
                 {
                 timestamp_t delta, now = MtmGetCurrentTime();
@@ -305,6 +319,9 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
                 MTM_TUPLE_TRACE("%d: tuple with xid=%d(csn= %ld) is %s in snapshot %ld\n",
 								getpid(), xid, ts->csn, invisible ? "rollbacked" : "committed", dtmTx.snapshot);
                 MtmUnlock();
+                if (sleepStart != 0) { 
+                    MtmStatRecord(MTM_STAT_INDOUBT_SLEEP, sleepStart);
+                }
                 return invisible;
             }
         }
@@ -315,9 +332,48 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
         }
     }
 	MtmUnlock();
+    if (sleepStart != 0) { 
+        MtmStatRecord(MTM_STAT_INDOUBT_SLEEP, sleepStart);
+    }
 	return PgXidInMVCCSnapshot(xid, snapshot);
 }    
 
+/*
+ * Check visibility of several XIDs (usually all XIDs of heap page) with single lock acquisition.
+ * In-doubt transactions are left unresolved: MtmXidInMVCCSnapshot will wait for them if needed.
+ */
+static void MtmXidInMVCCSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot, bool *inSnapshot, bool *resolved)
+{
+	int i;
+
+	MtmLock(LW_SHARED);
+	for (i = 0; i < nXids; i++) {
+		MtmTransState* ts = (MtmTransState*)hash_search(xid2state, &xids[i], HASH_FIND, NULL);
+		if (ts == NULL || ts->status == TRANSACTION_STATUS_IN_PROGRESS) {
+			/* mark to be checked by standard rules after releasing the lock */
+			resolved[i] = false;
+			inSnapshot[i] = true;
+		} else if (ts->csn > dtmTx.snapshot) {
+			resolved[i] = true;
+			inSnapshot[i] = true;
+		} else if (ts->status == TRANSACTION_STATUS_UNKNOWN) {
+			resolved[i] = false;
+			inSnapshot[i] = false;
+		} else {
+			resolved[i] = true;
+			inSnapshot[i] = ts->status != TRANSACTION_STATUS_COMMITTED;
+		}
+	}
+	MtmUnlock();
+
+	for (i = 0; i < nXids; i++) {
+		if (!resolved[i] && inSnapshot[i]) {
+			inSnapshot[i] = PgXidInMVCCSnapshot(xids[i], snapshot);
+			resolved[i] = true;
+		}
+	}
+}
+
 static uint32 MtmXidHashFunc(const void *key, Size keysize)
 {
 	return (uint32)*(TransactionId*)key;
@@ -435,6 +491,7 @@ static void MtmInitialize()
         dtm->transListTail = &dtm->transListHead;		
         dtm->nReceivers = 0;
 		dtm->timeShift = 0;
+		memset(&dtm->bootstrap, 0, sizeof(dtm->bootstrap));
 		PGSemaphoreCreate(&dtm->votingSemaphore);
 		PGSemaphoreReset(&dtm->votingSemaphore);
 		SpinLockInit(&dtm->spinlock);
@@ -444,6 +501,7 @@ static void MtmInitialize()
 		dtmTx.xid = InvalidTransactionId;
 	}
 	xid2state = MtmCreateHash();
+	MtmStatInitialize();
     MtmDoReplication = true;
 	TM = &MtmTM;
 	LWLockRelease(AddinShmemInitLock);
@@ -543,6 +601,7 @@ MtmCheckClusterLock()
 static void MtmPrepareTransaction(MtmCurrentTrans* x)
 { 
 	MtmTransState* ts;
+	timestamp_t startTime;
 	int i;
 	
 	if (!x->isDistributed) {
@@ -550,6 +609,7 @@ static void MtmPrepareTransaction(MtmCurrentTrans* x)
 	}
 
 	x->xid = GetCurrentTransactionId();
+	startTime = MtmGetSystemTime();
 				  
 	MtmLock(LW_EXCLUSIVE);
 	MtmCheckClusterLock();
@@ -563,6 +623,7 @@ static void MtmPrepareTransaction(MtmCurrentTrans* x)
 	ts->procno = MyProc->pgprocno;
 	ts->nVotes = 0; 
 	ts->done = false;
+	ts->startTime = ts->phaseStart = startTime;
 				  
 	if (TransactionIdIsValid(x->gtid.xid)) { 
 		ts->gtid = x->gtid;
@@ -806,6 +867,22 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.bootstrap_workers",
+		"Number of workers copying data to the node which replication slot doesn't exist at donor",
+		"If replication slot of recovering node was dropped, its content is copied from donor in parallel by the specified number of workers. "
+		"Zero disables bootstrap",
+		&MtmBootstrapWorkers,
+		4,
+		0,
+		max_worker_processes,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.vacuum_delay",
 		"Minimal age of records which can be vacuumed (seconds)",
@@ -1345,12 +1422,16 @@ MtmVoteForTransaction(MtmTransState* ts)
 	if (!MtmIsCoordinator(ts)) {
 		ts->cmd = ts->status == TRANSACTION_STATUS_ABORTED ? MSG_ABORTED : MSG_READY;
 		MtmSendNotificationMessage(ts); /* send READY message to coordinator */
-	} else if (++ts->nVotes == dtm->nNodes) { /* everybody already voted except me */
-		if (ts->status != TRANSACTION_STATUS_ABORTED) {
-			Assert(ts->status == TRANSACTION_STATUS_IN_PROGRESS);
-			ts->cmd = MSG_PREPARE;
-			ts->nVotes = 1; /* I voted myself */
-			MtmSendNotificationMessage(ts);			
+	} else {
+		ts->phaseStart = MtmStatRecord(MTM_STAT_LOCAL_PREPARE, ts->startTime);
+		if (++ts->nVotes == dtm->nNodes) { /* everybody already voted except me */
+			if (ts->status != TRANSACTION_STATUS_ABORTED) {
+				Assert(ts->status == TRANSACTION_STATUS_IN_PROGRESS);
+				ts->phaseStart = MtmStatRecord(MTM_STAT_REPLICATION, ts->phaseStart);
+				ts->cmd = MSG_PREPARE;
+				ts->nVotes = 1; /* I voted myself */
+				MtmSendNotificationMessage(ts);			
+			}
 		}
 	}
 	MTM_TRACE("%d: Node %d waiting latch...\n", getpid(), MtmNodeId);
@@ -1360,6 +1441,9 @@ MtmVoteForTransaction(MtmTransState* ts)
 		ResetLatch(&MyProc->procLatch);			
 		MtmLock(LW_SHARED);
 	}
+	if (MtmIsCoordinator(ts)) { 
+		MtmStatRecord(ts->status == TRANSACTION_STATUS_ABORTED ? MTM_STAT_ABORT : MTM_STAT_TOTAL, ts->startTime);
+	}
 	MTM_TRACE("%d: Node %d receives response...\n", getpid(), MtmNodeId);
 }
 
@@ -85,9 +85,22 @@ typedef struct MtmTransState
 	struct MtmTransState* nextVoting;  /* Next element in L1-list of voting transactions. */
     struct MtmTransState* next;        /* Next element in L1 list of all finished transaction present in xid2state hash */
 	bool done;
+	timestamp_t    startTime;          /* time of pre-commit of transaction at coordinator */
+	timestamp_t    phaseStart;         /* start time of the current commit phase at coordinator */
 	TransactionId xids[1];             /* transaction ID at replicas: varying size MtmNodes */
 } MtmTransState;
 
+/*
+ * State of parallel copy of data from donor, shared by receiver and bootstrap workers
+ */
+typedef struct
+{
+	int  donor;                        /* node ID of donor or 0 if no bootstrap is in progress */
+	char snapshot[NAMEDATALEN];        /* name of snapshot exported at donor by creation of replication slot */
+	int  nextTable;                    /* index of the next table to be copied */
+	int  nCompleted;                   /* number of workers which have copied all their tables */
+} MtmBootstrapState;
+
 typedef struct
 {
 	MtmNodeStatus status;              /* Status of this node */
@@ -112,8 +125,36 @@ typedef struct
     MtmTransState** transListTail;     /* Tail of L1 list of all finished transactionds, used to append new elements.
 								  		  This list is expected to be in CSN ascending order, by strict order may be violated */
     BgwPool pool;                      /* Pool of background workers for applying logical replication patches */
+	MtmBootstrapState bootstrap;       /* State of copying data from donor to this node */
 } MtmState;
 
+/*
+ * Phases of commit of distributed transaction, for which latency statistics is collected
+ */
+typedef enum
+{
+	MTM_STAT_LOCAL_PREPARE,  /* coordinator: from pre-commit until commit record is written */
+	MTM_STAT_REPLICATION,    /* coordinator: waiting for all replicas to apply transaction (READY votes) */
+	MTM_STAT_PREPARE,        /* coordinator: PREPARE/PREPARED round */
+	MTM_STAT_COMMIT,         /* coordinator: COMMIT/COMMITTED round */
+	MTM_STAT_TOTAL,          /* coordinator: whole commit of distributed transaction */
+	MTM_STAT_ABORT,          /* coordinator: commit of distributed transaction rejected by cluster */
+	MTM_STAT_APPLY_QUEUE,    /* replica: time spent by transaction in the queue of apply workers */
+	MTM_STAT_INDOUBT_SLEEP,  /* readers waiting for completion of in-doubt transactions */
+	MTM_STAT_N_PHASES
+} MtmStatPhase;
+
+/*
+ * Phases of commit for which latency statistics is collected per peer node
+ */
+typedef enum
+{
+	MTM_PEER_STAT_REPLICATION, /* from pre-commit until READY vote of the peer */
+	MTM_PEER_STAT_PREPARE,     /* PREPARE/PREPARED round trip */
+	MTM_PEER_STAT_COMMIT,      /* COMMIT/COMMITTED round trip */
+	MTM_PEER_STAT_N_PHASES
+} MtmPeerStatPhase;
+
 #define MtmIsCoordinator(ts) (ts->gtid.node == MtmNodeId)
 
 extern char* MtmConnStrs;
@@ -124,6 +165,7 @@ extern char* MtmDatabaseName;
 extern int   MtmConnectAttempts;
 extern int   MtmConnectTimeout;
 extern int   MtmReconnectAttempts;
+extern int   MtmBootstrapWorkers;
 
 extern void  MtmArbiterInitialize(void);
 extern int   MtmStartReceivers(char* nodes, int nodeId);
@@ -143,6 +185,13 @@ extern void  MtmUnlock(void);
 extern void  MtmDropNode(int nodeId, bool dropSlot);
 extern MtmState* MtmGetState(void);
 extern timestamp_t MtmGetCurrentTime(void);
+extern timestamp_t MtmGetSystemTime(void);
 extern void  MtmSleep(timestamp_t interval);
 extern bool  MtmIsRecoveredNode(int nodeId);
+extern bool  MtmIsBootstrapNeeded(int donorId, char const* slotName);
+extern bool  MtmBootstrap(int donorId, char const* snapshotName);
+extern void  MtmBootstrapWorkerMain(Datum arg);
+extern void  MtmStatInitialize(void);
+extern timestamp_t MtmStatRecord(MtmStatPhase phase, timestamp_t start);
+extern void  MtmStatRecordPeer(int nodeId, MtmPeerStatPhase phase, timestamp_t start);
 #endif
@@ -39,6 +39,7 @@
 
 typedef struct ReceiverArgs { 
 	int receiver_node;
+	int receiver_donor;
     char* receiver_conn_string;
     char receiver_slot[16];
 } ReceiverArgs;
@@ -195,6 +196,17 @@ feTimestampDifference(int64 start_time, int64 stop_time,
 	}
 }
 
+/*
+ * Drop the slot created for bootstrap, so that the next attempt starts bootstrap from scratch
+ */
+static void
+receiver_drop_slot(PGconn *conn, char const *slot)
+{
+	char *query = psprintf("DROP_REPLICATION_SLOT \"%s\"", slot);
+	PQclear(PQexec(conn, query));
+	pfree(query);
+}
+
 static void
 pglogical_receiver_main(Datum main_arg)
 {
@@ -210,6 +222,9 @@ pglogical_receiver_main(Datum main_arg)
 #endif
     ByteBuffer buf;
 	XLogRecPtr originStartPos;
+	XLogRecPtr consistentPoint = InvalidXLogRecPtr;
+	char* snapshotName = NULL;
+	bool bootstrap;
 
 	/* Register functions for SIGTERM/SIGHUP management */
 	pqsignal(SIGHUP, receiver_raw_sighup);
@@ -224,6 +239,12 @@ pglogical_receiver_main(Datum main_arg)
 	BackgroundWorkerInitializeConnection(MtmDatabaseName, NULL);
 
 	mode = MtmReceiverSlotMode(args->receiver_node);	
+
+	/* If slot of recovering node doesn't exist at donor, copy data and create new slot consistent with it */
+	bootstrap = mode == SLOT_OPEN_EXISTED && MtmIsBootstrapNeeded(args->receiver_donor, args->receiver_slot);
+	if (bootstrap) {
+		mode = SLOT_OPEN_ALWAYS;
+	}
     
 	/* Establish connection to remote server */
 	conn = PQconnectdb(args->receiver_conn_string);
@@ -249,7 +270,7 @@ pglogical_receiver_main(Datum main_arg)
 		if (PQresultStatus(res) != PGRES_TUPLES_OK)
 		{
 			const char *sqlstate = PQresultErrorField(res, PG_DIAG_SQLSTATE);
-			if (!sqlstate || strcmp(sqlstate, ERRCODE_DUPLICATE_OBJECT_STR) != 0)
+			if (bootstrap || !sqlstate || strcmp(sqlstate, ERRCODE_DUPLICATE_OBJECT_STR) != 0)
 			{
 				PQclear(res);
 				ereport(ERROR, (errmsg("%s: Could not create logical slot",
@@ -257,11 +278,46 @@ pglogical_receiver_main(Datum main_arg)
 				proc_exit(1);
 			}
 		}
+		else if (bootstrap)
+		{
+			/* Result of CREATE_REPLICATION_SLOT is (slot_name, consistent_point, snapshot_name, output_plugin) */
+			uint32 hi, lo;
+			if (sscanf(PQgetvalue(res, 0, 1), "%X/%X", &hi, &lo) != 2) {
+				PQclear(res);
+				ereport(ERROR, (errmsg("%s: Could not parse consistent point of logical slot",
+									   worker_proc)));
+			}
+			consistentPoint = ((uint64)hi << 32) | lo;
+			snapshotName = pstrdup(PQgetvalue(res, 0, 2));
+		}
 		PQclear(res);
 		resetPQExpBuffer(query);
 	}
-	/* Start logical replication at specified position */
-	originStartPos = replorigin_session_get_progress(false);
+	if (bootstrap) {
+		bool copied = false;
+
+		/* Replication connection should be idle until all bootstrap workers import the exported snapshot */
+		PG_TRY();
+		{
+			copied = MtmBootstrap(args->receiver_donor, snapshotName);
+		}
+		PG_CATCH();
+		{
+			receiver_drop_slot(conn, args->receiver_slot);
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		if (!copied) {
+			receiver_drop_slot(conn, args->receiver_slot);
+			ereport(ERROR, (errmsg("%s: Failed to copy data from node %d",
+								   worker_proc, args->receiver_donor)));
+		}
+		/* Start logical replication exactly from the position corresponding to the copied data */
+		originStartPos = consistentPoint;
+	} else {
+		/* Start logical replication at specified position */
+		originStartPos = replorigin_session_get_progress(false);
+	}
 	appendPQExpBuffer(query, "START_REPLICATION SLOT \"%s\" LOGICAL %u/%u (\"startup_params_format\" '1', \"max_proto_version\" '%d',  \"min_proto_version\" '%d')",
 					  args->receiver_slot,
 					  (uint32) (originStartPos >> 32),
@@ -566,6 +622,7 @@ int MtmStartReceivers(char* conns, int node_id)
             ctx->receiver_conn_string = psprintf("replication=database %.*s", (int)(p - conn_str), conn_str);
             sprintf(ctx->receiver_slot, "mtm_slot_%d", node_id);
             ctx->receiver_node = node_id;
+            ctx->receiver_donor = i;
 
             /* Worker parameter and registration */
             snprintf(worker.bgw_name, BGW_MAXLEN, "mtm_worker_%d_%d", node_id, i);
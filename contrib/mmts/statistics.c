@@ -0,0 +1,251 @@
+/*
+ * statistics.c
+ *
+ * Latency statistics of commit phases of distributed transactions.
+ *
+ * Histograms are kept in shared memory and updated with atomic increments
+ * without any locks, so statistics is always collected. Buckets are
+ * log-linear: each power of two interval of microseconds is split into
+ * MTM_STAT_SUB_BUCKETS buckets, so percentiles are accurate to 25%.
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "access/clog.h"
+#include "access/htup_details.h"
+#include "port/atomics.h"
+#include "storage/lwlock.h"
+#include "storage/pg_sema.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+
+#include "multimaster.h"
+
+#define MTM_STAT_SUB_BITS    2
+#define MTM_STAT_SUB_BUCKETS (1 << MTM_STAT_SUB_BITS)
+/* Values are limited by INT_MAX microseconds (~35 minutes) */
+#define MTM_STAT_BUCKETS     ((32 - MTM_STAT_SUB_BITS) * MTM_STAT_SUB_BUCKETS)
+
+#define Natts_mtm_commit_stats 8
+
+typedef struct
+{
+	pg_atomic_uint64 count;
+	pg_atomic_uint64 total;   /* sum of latencies (usec) */
+	pg_atomic_uint64 max;
+	pg_atomic_uint64 buckets[MTM_STAT_BUCKETS];
+} MtmHistogram;
+
+typedef struct
+{
+	TimestampTz resetTime;
+	int         nNodes;
+	MtmHistogram phases[MTM_STAT_N_PHASES];
+	MtmHistogram peers[1]; /* MTM_PEER_STAT_N_PHASES histograms per node: varying size MtmNodes */
+} MtmStatistics;
+
+static MtmStatistics* stat;
+
+static char const* const phaseName[] =
+{
+	"local_prepare",
+	"replication",
+	"prepare",
+	"commit",
+	"total",
+	"abort",
+	"apply_queue",
+	"indoubt_sleep"
+};
+
+static char const* const peerPhaseName[] =
+{
+	"replication",
+	"prepare",
+	"commit"
+};
+
+PG_FUNCTION_INFO_V1(mtm_get_commit_stats);
+PG_FUNCTION_INFO_V1(mtm_reset_commit_stats);
+
+static int MtmStatBucket(uint64 value)
+{
+	int msb;
+	if (value < MTM_STAT_SUB_BUCKETS) {
+		return (int)value;
+	}
+	if (value > INT_MAX) {
+		value = INT_MAX;
+	}
+	msb = fls((int)value) - 1;
+	return (msb - MTM_STAT_SUB_BITS + 1) * MTM_STAT_SUB_BUCKETS + (int)((value >> (msb - MTM_STAT_SUB_BITS)) & (MTM_STAT_SUB_BUCKETS - 1));
+}
+
+/* Upper bound of values falling in the bucket */
+static uint64 MtmStatBucketLimit(int bucket)
+{
+	int shift;
+	if (bucket < MTM_STAT_SUB_BUCKETS) {
+		return bucket;
+	}
+	shift = bucket / MTM_STAT_SUB_BUCKETS - 1;
+	return ((uint64)(MTM_STAT_SUB_BUCKETS + bucket % MTM_STAT_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+static void MtmHistogramReset(MtmHistogram* h)
+{
+	int i;
+	pg_atomic_init_u64(&h->count, 0);
+	pg_atomic_init_u64(&h->total, 0);
+	pg_atomic_init_u64(&h->max, 0);
+	for (i = 0; i < MTM_STAT_BUCKETS; i++) {
+		pg_atomic_init_u64(&h->buckets[i], 0);
+	}
+}
+
+static void MtmHistogramAdd(MtmHistogram* h, uint64 value)
+{
+	uint64 max = pg_atomic_read_u64(&h->max);
+	pg_atomic_fetch_add_u64(&h->count, 1);
+	pg_atomic_fetch_add_u64(&h->total, value);
+	pg_atomic_fetch_add_u64(&h->buckets[MtmStatBucket(value)], 1);
+	while (value > max && !pg_atomic_compare_exchange_u64(&h->max, &max, value));
+}
+
+static uint64 MtmHistogramPercentile(MtmHistogram* h, uint64 count, double percent)
+{
+	uint64 rank = (uint64)(count * percent / 100.0);
+	uint64 seen = 0;
+	int i;
+	for (i = 0; i < MTM_STAT_BUCKETS; i++) {
+		seen += pg_atomic_read_u64(&h->buckets[i]);
+		if (seen > rank) {
+			return Min(MtmStatBucketLimit(i), pg_atomic_read_u64(&h->max));
+		}
+	}
+	return pg_atomic_read_u64(&h->max);
+}
+
+static MtmHistogram* MtmPeerHistogram(int nodeId, MtmPeerStatPhase phase)
+{
+	return &stat->peers[nodeId*MTM_PEER_STAT_N_PHASES + phase];
+}
+
+static void MtmStatReset(void)
+{
+	int i;
+	for (i = 0; i < MTM_STAT_N_PHASES; i++) {
+		MtmHistogramReset(&stat->phases[i]);
+	}
+	for (i = 0; i < stat->nNodes*MTM_PEER_STAT_N_PHASES; i++) {
+		MtmHistogramReset(&stat->peers[i]);
+	}
+	stat->resetTime = GetCurrentTimestamp();
+}
+
+/* This function is called with AddinShmemInitLock set */
+void MtmStatInitialize(void)
+{
+	bool found;
+	stat = (MtmStatistics*)ShmemInitStruct("mtm_statistics",
+										   offsetof(MtmStatistics, peers) + MtmNodes*MTM_PEER_STAT_N_PHASES*sizeof(MtmHistogram),
+										   &found);
+	if (!found) {
+		stat->nNodes = MtmNodes;
+		MtmStatReset();
+	}
+}
+
+/*
+ * Add duration of phase started at 'start' to the statistics. Returns current time, which is start of the next phase.
+ */
+timestamp_t MtmStatRecord(MtmStatPhase phase, timestamp_t start)
+{
+	timestamp_t now = MtmGetSystemTime();
+	MtmHistogramAdd(&stat->phases[phase], now > start ? now - start : 0);
+	return now;
+}
+
+void MtmStatRecordPeer(int nodeId, MtmPeerStatPhase phase, timestamp_t start)
+{
+	timestamp_t now = MtmGetSystemTime();
+	Assert(nodeId >= 0 && nodeId < stat->nNodes);
+	MtmHistogramAdd(MtmPeerHistogram(nodeId, phase), now > start ? now - start : 0);
+}
+
+/*
+ * Returns row per commit phase and per commit phase of each peer node:
+ * (phase, node, count, rate, avg_usec, median_usec, p99_usec, max_usec)
+ */
+Datum
+mtm_get_commit_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	int nRows;
+
+	if (SRF_IS_FIRSTCALL()) {
+		TupleDesc desc;
+		MemoryContext oldcontext;
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE) {
+			elog(ERROR, "return type must be a row type");
+		}
+		funcctx->tuple_desc = BlessTupleDesc(desc);
+		MemoryContextSwitchTo(oldcontext);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	nRows = MTM_STAT_N_PHASES + stat->nNodes*MTM_PEER_STAT_N_PHASES;
+
+	while (funcctx->call_cntr < nRows) {
+		int row = funcctx->call_cntr;
+		MtmHistogram* h;
+		Datum values[Natts_mtm_commit_stats];
+		bool nulls[Natts_mtm_commit_stats];
+		uint64 count;
+		double seconds;
+		long secs;
+		int usecs;
+
+		memset(nulls, false, sizeof(nulls));
+		if (row < MTM_STAT_N_PHASES) {
+			h = &stat->phases[row];
+			values[0] = CStringGetTextDatum(phaseName[row]);
+			nulls[1] = true;
+		} else {
+			int nodeId = (row - MTM_STAT_N_PHASES) / MTM_PEER_STAT_N_PHASES;
+			int phase = (row - MTM_STAT_N_PHASES) % MTM_PEER_STAT_N_PHASES;
+			if (nodeId + 1 == MtmNodeId) {
+				funcctx->call_cntr += 1;
+				continue;
+			}
+			h = MtmPeerHistogram(nodeId, phase);
+			values[0] = CStringGetTextDatum(peerPhaseName[phase]);
+			values[1] = Int32GetDatum(nodeId + 1);
+		}
+		count = pg_atomic_read_u64(&h->count);
+		TimestampDifference(stat->resetTime, GetCurrentTimestamp(), &secs, &usecs);
+		seconds = secs + usecs / 1000000.0;
+
+		values[2] = Int64GetDatum(count);
+		values[3] = Float8GetDatum(seconds > 0 ? count / seconds : 0);
+		values[4] = Float8GetDatum(count != 0 ? (double)pg_atomic_read_u64(&h->total) / count : 0);
+		values[5] = Int64GetDatum(MtmHistogramPercentile(h, count, 50));
+		values[6] = Int64GetDatum(MtmHistogramPercentile(h, count, 99));
+		values[7] = Int64GetDatum(pg_atomic_read_u64(&h->max));
+
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
+
+Datum
+mtm_reset_commit_stats(PG_FUNCTION_ARGS)
+{
+	MtmStatReset();
+	PG_RETURN_VOID();
+}
@@ -13,3 +13,19 @@ CREATE FUNCTION mm_drop_node(node integer, drop_slot bool default false) RETURNS
 AS 'MODULE_PATHNAME','mm_drop_node'
 LANGUAGE C;
 
+
+CREATE FUNCTION mm_get_xid_reserve_stats(
+    OUT reserve_size bigint,
+    OUT reserved_xids bigint,
+    OUT prefetched_xids bigint,
+    OUT reservations bigint,
+    OUT prefetches bigint,
+    OUT stalls bigint,
+    OUT stall_time bigint)
+AS 'MODULE_PATHNAME','mm_get_xid_reserve_stats'
+LANGUAGE C;
+
+CREATE SCHEMA IF NOT EXISTS mm;
+
+-- Utility statements are replicated as inserts into this table
+CREATE TABLE IF NOT EXISTS mm.ddl_log (issued timestamp with time zone not null, query text, search_path text);
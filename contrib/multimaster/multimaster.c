@@ -11,6 +11,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "libpq-fe.h"
 #include "postmaster/postmaster.h"
@@ -31,12 +32,21 @@
 #include "storage/procarray.h"
 #include "executor/executor.h"
 #include "access/twophase.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/indexing.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "commands/extension.h"
+#include "nodes/makefuncs.h"
 #include "utils/guc.h"
 #include "utils/hsearch.h"
 #include "utils/tqual.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 #include "commands/dbcommands.h"
 #include "miscadmin.h"
 #include "postmaster/autovacuum.h"
@@ -47,19 +57,30 @@
 #include "replication/slot.h"
 #include "port/atomics.h"
 #include "tcop/utility.h"
+#include "parser/parser.h"
+#include "parser/scanner.h"
 
 #include "arbiter.h"
+#include "xidreserve.h"
 #include "sockhub.h"
 #include "multimaster.h"
 #include "bgwpool.h"
 
+/* maximal number of active global transactions in a snapshot lease shared by readers */
+#define DTM_LEASE_MAX_XCNT 1024
+
 typedef struct
 {
 	LWLockId hashLock;
 	LWLockId xidLock;
 	TransactionId minXid;  /* XID of oldest transaction visible by any active transaction (local or global) */
-	TransactionId nextXid; /* next XID for local transaction */
-	size_t nReservedXids;  /* number of XIDs reserved for local transactions */
+	ArbiterXidReserve xids; /* ranges of XIDs reserved for local transactions */
+	LWLockId leaseLock;
+	TimestampTz leaseTime; /* when the snapshot lease was obtained from arbiter, 0 if there is no lease */
+	TransactionId leaseXmin;
+	TransactionId leaseXmax;
+	int leaseXcnt;
+	TransactionId leaseXip[DTM_LEASE_MAX_XCNT];
 	int64  disabledNodeMask;
     int    nNodes;
     pg_atomic_uint32 nReceivers;
@@ -73,6 +94,14 @@ typedef struct
     int count;
 } LocalTransaction;
 
+/* how a utility statement is replicated to other nodes */
+typedef enum
+{
+	MM_DDL_LOCAL,     /* not replicated: session state, node local maintenance and temporary objects */
+	MM_DDL_LOG,       /* logged in mm.ddl_log and executed by peers as part of the replicated transaction */
+	MM_DDL_BROADCAST  /* can not be executed inside transaction: executed at all nodes through libpq */
+} MMDDLReplication;
+
 #define DTM_SHMEM_SIZE (64*1024*1024)
 #define DTM_HASH_SIZE  1003
 
@@ -86,6 +115,7 @@ PG_MODULE_MAGIC;
 PG_FUNCTION_INFO_V1(mm_start_replication);
 PG_FUNCTION_INFO_V1(mm_stop_replication);
 PG_FUNCTION_INFO_V1(mm_drop_node);
+PG_FUNCTION_INFO_V1(mm_get_xid_reserve_stats);
 
 static Snapshot DtmGetSnapshot(Snapshot snapshot);
 static void DtmMergeWithGlobalSnapshot(Snapshot snapshot);
@@ -96,6 +126,9 @@ static void DtmInitialize(void);
 static void DtmSubXactCallback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg);
 static void DtmXactCallback(XactEvent event, void *arg);
 static TransactionId DtmGetNextXid(void);
+static bool DtmSnapshotLeaseIsValid(TimestampTz now);
+static void DtmGetSnapshotLease(Snapshot snapshot);
+static bool DtmPinSnapshotLease(Snapshot snapshot);
 static TransactionId DtmGetNewTransactionId(bool isSubXact);
 static TransactionId DtmGetOldestXmin(Relation rel, bool ignoreVacuum);
 static TransactionId DtmGetGlobalTransactionId(void);
@@ -111,9 +144,17 @@ static void DtmShmemStartup(void);
 static void DtmBackgroundWorker(Datum arg);
 
 static void MMMarkTransAsLocal(TransactionId xid);
+static void MMBeginReadOnlyTransaction(void);
 static BgwPool* MMPoolConstructor(void);
 static bool MMRunUtilityStmt(PGconn* conn, char const* sql);
-static void MMBroadcastUtilityStmt(char const* sql, bool ignoreError);
+static void MMBroadcastUtilityStmt(char const* sql, bool ignoreError, bool inTransaction);
+static bool MMProcessDDLCommand(char const* queryString);
+static MMDDLReplication MMGetDDLReplication(Node* parsetree);
+static bool MMIsTempRelation(RangeVar* rv);
+static char const* MMGetStatementText(Node* parsetree, char const* queryString);
+static void MMExecuteUtility(Node *parsetree, const char *queryString,
+							 ProcessUtilityContext context, ParamListInfo params,
+							 DestReceiver *dest, char *completionTag);
 
 static HTAB* xid_in_doubt;
 static HTAB* local_trans;
@@ -122,7 +163,10 @@ static DtmState* dtm;
 static TransactionId DtmNextXid;
 static SnapshotData DtmSnapshot = { HeapTupleSatisfiesMVCC };
 static bool DtmHasGlobalSnapshot;
+static bool DtmReadOnly;
+static int DtmSnapshotLeaseTime;
 static int DtmLocalXidReserve;
+static int DtmMaxLocalXidReserve;
 static CommandId DtmCurcid;
 static Snapshot DtmLastSnapshot;
 static TransactionManager DtmTM = {
@@ -135,11 +179,16 @@ static TransactionManager DtmTM = {
 	DtmGetGlobalTransactionId,
 	PgXidInMVCCSnapshot,
     DtmDetectGlobalDeadLock,
-	DtmGetName
+	DtmGetName,
+	PgXidInMVCCSnapshotBatch
 };
 
 bool  MMDoReplication;
 char* MMDatabaseName;
+bool  MMApplyingDDL;
+
+static bool  MMReplicateDDL;
+static bool  MMInReplicatedDDL;
 
 static char* MMConnStrs;
 static int   MMNodeId;
@@ -150,6 +199,7 @@ static int   MMWorkers;
 static char *Arbiters;
 static char *ArbitersCopy;
 static int   DtmBufferSize;
+static bool  DtmBufferShmem;
 static bool  DtmVoted;
 
 static ExecutorFinish_hook_type PreviousExecutorFinishHook;
@@ -186,7 +236,7 @@ static void DumpSnapshot(Snapshot s, char *name)
 	cursor += sprintf(
 		cursor,
 		"snapshot %s(%p) for transaction %d: xmin=%d, xmax=%d, active=[",
-		name, s, GetCurrentTransactionId(), s->xmin, s->xmax
+		name, s, GetCurrentTransactionIdIfAny(), s->xmin, s->xmax
 	);
 	for (i = 0; i < s->xcnt; i++) {
 		if (i == 0) {
@@ -270,7 +320,9 @@ GetLocalSnapshot:
 		if (TransactionIdIsInDoubt(xid))
 			goto GetLocalSnapshot;
 
-    GetCurrentTransactionId();
+    /* Read-only transactions cannot be assigned XID, they pin the snapshot lease instead */
+    if (!DtmReadOnly)
+        GetCurrentTransactionId();
     DumpSnapshot(dst, "local");
 	DumpSnapshot(src, "DTM");
 
@@ -361,6 +413,8 @@ static void DtmUpdateRecentXmin(Snapshot snapshot)
 /*
  * Get new XID. For global transaction is it previsly set by dtm_begin_transaction or dtm_join_transaction.
  * Local transactions are using range of local Xids obtains from DTM.
+ * Should be called with XidGenLock held, which is released for a while if other backend is reserving
+ * the next range of local Xids.
  */
 static TransactionId DtmGetNextXid()
 {
@@ -382,31 +436,12 @@ static TransactionId DtmGetNextXid()
 				ExtendSUBTRANS(ShmemVariableCache->nextXid);
 				TransactionIdAdvance(ShmemVariableCache->nextXid);
 			}
-			dtm->nReservedXids = 0;
+			dtm->xids.nReservedXids = 0;
 		}
 	}
 	else
 	{
-		if (dtm->nReservedXids == 0)
-		{
-            XTM_INFO("%d: reserve new XID range\n", getpid());
-			dtm->nReservedXids = ArbiterReserve(ShmemVariableCache->nextXid, DtmLocalXidReserve, &dtm->nextXid);
-			Assert(dtm->nReservedXids > 0);
-			Assert(TransactionIdFollowsOrEquals(dtm->nextXid, ShmemVariableCache->nextXid));
-
-			/* Advance ShmemVariableCache->nextXid formward until new Xid */
-			while (TransactionIdPrecedes(ShmemVariableCache->nextXid, dtm->nextXid))
-			{
-				XTM_INFO("Extend CLOG for local transaction to %d\n", ShmemVariableCache->nextXid);
-				ExtendCLOG(ShmemVariableCache->nextXid);
-				ExtendCommitTs(ShmemVariableCache->nextXid);
-				ExtendSUBTRANS(ShmemVariableCache->nextXid);
-				TransactionIdAdvance(ShmemVariableCache->nextXid);
-			}
-		}
-		Assert(ShmemVariableCache->nextXid == dtm->nextXid);
-		xid = dtm->nextXid++;
-		dtm->nReservedXids -= 1;
+		xid = ArbiterXidReserveNext(&dtm->xids, DtmLocalXidReserve, DtmMaxLocalXidReserve);
 		XTM_INFO("Obtain new local XID %d\n", xid);
 	}
 	LWLockRelease(dtm->xidLock);
@@ -428,6 +463,8 @@ DtmGetNewTransactionId(bool isSubXact)
 	TransactionId xid;
 
 	XTM_INFO("%d: GetNewTransactionId\n", getpid());
+	if (DtmReadOnly)
+		elog(ERROR, "cannot assign XID to read-only global transaction");
 	/*
 	 * Workers synchronize transaction state at the beginning of each parallel
 	 * operation, so we can't account for new XIDs after that point.
@@ -627,15 +664,102 @@ DtmGetNewTransactionId(bool isSubXact)
 }
 
 
+/*
+ * Snapshot lease can be used while it is not older than snapshot_lease_time and
+ * its xmin is not behind the global xmin, so vacuum has not removed tuples visible to it.
+ * Lease without xmin (there were no active global transactions) restricts nothing:
+ * local snapshot is used instead of it.
+ * Should be called with dtm->leaseLock held.
+ */
+static bool DtmSnapshotLeaseIsValid(TimestampTz now)
+{
+	return dtm->leaseTime != 0
+		&& !TimestampDifferenceExceeds(dtm->leaseTime, now, DtmSnapshotLeaseTime)
+		&& (!TransactionIdIsValid(dtm->leaseXmin) || !TransactionIdPrecedes(dtm->leaseXmin, dtm->minXid));
+}
+
+/*
+ * Get global snapshot for read-only transaction. Read-only transactions are not registered at arbiter:
+ * they share the snapshot lease cached in shared memory, which is refreshed from arbiter
+ * by the first reader finding it expired.
+ */
+static void DtmGetSnapshotLease(Snapshot snapshot)
+{
+	TimestampTz now = GetCurrentTimestamp();
+
+	LWLockAcquire(dtm->leaseLock, LW_SHARED);
+	if (!DtmSnapshotLeaseIsValid(now))
+	{
+		LWLockRelease(dtm->leaseLock);
+		LWLockAcquire(dtm->leaseLock, LW_EXCLUSIVE);
+		/* Lease may be already refreshed by other reader */
+		if (!DtmSnapshotLeaseIsValid(now))
+		{
+			XTM_INFO("%d: refresh snapshot lease\n", getpid());
+			ArbiterGetSnapshot(InvalidTransactionId, snapshot, &dtm->minXid);
+			if (snapshot->xcnt <= DTM_LEASE_MAX_XCNT)
+			{
+				dtm->leaseXmin = snapshot->xmin;
+				dtm->leaseXmax = snapshot->xmax;
+				dtm->leaseXcnt = snapshot->xcnt;
+				memcpy(dtm->leaseXip, snapshot->xip, snapshot->xcnt*sizeof(TransactionId));
+				dtm->leaseTime = now;
+			}
+			LWLockRelease(dtm->leaseLock);
+			return;
+		}
+	}
+	ArbiterInitSnapshot(snapshot);
+	snapshot->xmin = dtm->leaseXmin;
+	snapshot->xmax = dtm->leaseXmax;
+	snapshot->xcnt = dtm->leaseXcnt;
+	memcpy(snapshot->xip, dtm->leaseXip, dtm->leaseXcnt*sizeof(TransactionId));
+	LWLockRelease(dtm->leaseLock);
+}
+
+/*
+ * Nothing but xmin of the backend prevents vacuum at this node from removing tuples visible
+ * to the snapshot lease of read-only transaction, as such transactions are not registered at arbiter.
+ * So install xmin of the merged snapshot as backend xmin and then check that global xmin has not passed
+ * the lease in the meantime. It should be done for each snapshot, because backend xmin is reset
+ * between statements with read committed isolation level.
+ * Returns false if the lease has expired and the snapshot should be taken again.
+ */
+static bool DtmPinSnapshotLease(Snapshot snapshot)
+{
+	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+	if (!TransactionIdIsValid(MyPgXact->xmin) || TransactionIdPrecedes(snapshot->xmin, MyPgXact->xmin))
+		MyPgXact->xmin = snapshot->xmin;
+	LWLockRelease(ProcArrayLock);
+
+	if (TransactionIdIsValid(DtmSnapshot.xmin) && TransactionIdPrecedes(DtmSnapshot.xmin, dtm->minXid))
+		return false;
+
+	if (TransactionIdPrecedes(snapshot->xmin, TransactionXmin))
+		TransactionXmin = snapshot->xmin;
+	if (TransactionIdFollows(RecentXmin, snapshot->xmin))
+		RecentXmin = snapshot->xmin;
+	return true;
+}
+
 static Snapshot DtmGetSnapshot(Snapshot snapshot)
 {
-	if (TransactionIdIsValid(DtmNextXid) && snapshot != &CatalogSnapshotData)
+	if ((TransactionIdIsValid(DtmNextXid) || DtmReadOnly) && snapshot != &CatalogSnapshotData)
 	{
 		if (!DtmHasGlobalSnapshot && (snapshot != DtmLastSnapshot || DtmCurcid != GetCurrentCommandId(false))) {
-			ArbiterGetSnapshot(DtmNextXid, &DtmSnapshot, &dtm->minXid);
+			if (DtmReadOnly)
+				DtmGetSnapshotLease(&DtmSnapshot);
+			else
+				ArbiterGetSnapshot(DtmNextXid, &DtmSnapshot, &dtm->minXid);
         }
 		DtmLastSnapshot = snapshot;
 		DtmMergeWithGlobalSnapshot(snapshot);
+		/* Snapshot is not used yet, so take it again if the lease has expired meanwhile */
+		while (DtmReadOnly && !DtmPinSnapshotLease(snapshot))
+		{
+			DtmGetSnapshotLease(&DtmSnapshot);
+			DtmMergeWithGlobalSnapshot(snapshot);
+		}
 		DtmCurcid = snapshot->curcid;
 		if (!IsolationUsesXactSnapshot())
 		{
@@ -743,8 +867,10 @@ static void DtmInitialize()
 		LWLockPadded* locks = GetNamedLWLockTranche("multimaster");
 		dtm->hashLock = (LWLock*)&locks[0];
 		dtm->xidLock = (LWLock*)&locks[1];
-		dtm->nReservedXids = 0;
+		dtm->leaseLock = (LWLock*)&locks[2];
 		dtm->minXid = InvalidTransactionId;
+		ArbiterXidReserveInit(&dtm->xids, dtm->xidLock, DtmLocalXidReserve);
+		dtm->leaseTime = 0;
         dtm->nNodes = MMNodes;
 		dtm->disabledNodeMask = 0;
         pg_atomic_write_u32(&dtm->nReceivers, 0);
@@ -794,24 +920,32 @@ DtmXactCallback(XactEvent event, void *arg)
     switch (event) 
     {
     case XACT_EVENT_START: 
+        /* Reserve the next range of local XIDs before this transaction can get an XID */
+        ArbiterXidReservePrefetch(&dtm->xids);
       //XTM_INFO("%d: normal=%d, initialized=%d, replication=%d, bgw=%d, vacuum=%d\n", 
       //           getpid(), IsNormalProcessingMode(), dtm->initialized, MMDoReplication, IsBackgroundWorker, IsAutoVacuumWorkerProcess());
         if (IsNormalProcessingMode() && dtm->initialized && MMDoReplication && !am_walsender && !IsBackgroundWorker && !IsAutoVacuumWorkerProcess()) { 
-            MMBeginTransaction();
+            if (XactReadOnly) {
+                MMBeginReadOnlyTransaction();
+            } else {
+                MMBeginTransaction();
+            }
         }
         break;
-#if 0
     case XACT_EVENT_PRE_COMMIT:
     case XACT_EVENT_PARALLEL_PRE_COMMIT:
     { 
+        /*
+         * Transaction changing only local objects (temporary tables,...) is voted against at arbiter,
+         * so it is not sent to other nodes: they can not join it after it is completed
+         */
         TransactionId xid = GetCurrentTransactionIdIfAny();
-        if (!MMIsDistributedTrans && TransactionIdIsValid(xid)) {
+        if (!MMIsDistributedTrans && TransactionIdIsValid(xid) && TransactionIdIsValid(DtmNextXid)) {
             XTM_INFO("%d: Will ignore transaction %u\n", getpid(), xid);
             MMMarkTransAsLocal(xid);               
         }
         break;
     }
-#endif
     case XACT_EVENT_COMMIT:
     case XACT_EVENT_ABORT:
 		if (TransactionIdIsValid(DtmNextXid))
@@ -846,6 +980,11 @@ DtmXactCallback(XactEvent event, void *arg)
 			DtmNextXid = InvalidTransactionId;
 			DtmLastSnapshot = NULL;
         }
+        else if (DtmReadOnly)
+        {
+            DtmReadOnly = false;
+            DtmLastSnapshot = NULL;
+        }
         MMIsDistributedTrans = false;
         break;
       default:
@@ -904,7 +1043,7 @@ _PG_init(void)
 
 	DefineCustomIntVariable(
 		"multimaster.local_xid_reserve",
-		"Number of XIDs reserved by node for local transactions",
+		"Minimal number of XIDs reserved by node for local transactions",
 		NULL,
 		&DtmLocalXidReserve,
 		100,
@@ -917,6 +1056,36 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.max_local_xid_reserve",
+		"Maximal number of XIDs reserved by node for local transactions at once",
+		"Number of reserved XIDs grows from multimaster.local_xid_reserve up to this limit when local transactions are frequent",
+		&DtmMaxLocalXidReserve,
+		100000,
+		1,
+		INT_MAX,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.snapshot_lease_time",
+		"Time during which read-only transactions share the same global snapshot",
+		"Read-only transactions are not registered at arbiter, but use snapshot obtained by other reader if it is not older than this",
+		&DtmSnapshotLeaseTime,
+		100,
+		0,
+		INT_MAX,
+		PGC_BACKEND,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.buffer_size",
 		"Size of sockhub buffer for connection to DTM daemon, if 0, then direct connection will be used",
@@ -932,6 +1101,32 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomBoolVariable(
+		"multimaster.replicate_ddl",
+		"Replicate utility statements of this session to other nodes",
+		NULL,
+		&MMReplicateDDL,
+		true,
+		PGC_USERSET,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.buffer_shmem",
+		"Use shared memory instead of unix socket for communication of backends with sockhub",
+		NULL,
+		&DtmBufferShmem,
+		false,
+		PGC_POSTMASTER,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomStringVariable(
 		"multimaster.arbiters",
 		"The comma separated host:port pairs where arbiters reside",
@@ -979,7 +1174,7 @@ _PG_init(void)
 	 * resources in dtm_shmem_startup().
 	 */
 	RequestAddinShmemSpace(DTM_SHMEM_SIZE + MMQueueSize);
-	RequestNamedLWLockTranche("multimaster", 2);
+	RequestNamedLWLockTranche("multimaster", 3);
 
     MMNodes = MMStartReceivers(MMConnStrs, MMNodeId);
     if (MMNodes < 2) { 
@@ -990,6 +1185,11 @@ _PG_init(void)
 	ArbitersCopy = strdup(Arbiters);
 	if (DtmBufferSize != 0)
 	{
+		if (DtmBufferShmem)
+		{
+			RequestAddinShmemSpace(ArbiterShmemSize(DtmBufferSize));
+			DtmWorker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+		}
 		ArbiterConfig(Arbiters, Unix_socket_directories);
 		RegisterBackgroundWorker(&DtmWorker);
 	}
@@ -1027,6 +1227,9 @@ static void DtmShmemStartup(void)
 		PreviousShmemStartupHook();
 	}
 	DtmInitialize();
+	if (DtmBufferSize != 0 && DtmBufferShmem) {
+		ArbiterShmemInit(DtmBufferSize);
+	}
 }
 
 /*
@@ -1047,6 +1250,25 @@ void MMBeginTransaction(void)
 	XTM_INFO("%d: Start global transaction %d, dtm->minXid=%d\n", getpid(), DtmNextXid, dtm->minXid);
 
     DtmVoted = false;
+	DtmHasGlobalSnapshot = true;
+	DtmReadOnly = false;
+	DtmLastSnapshot = NULL;
+    MMIsDistributedTrans = false;
+}
+
+/*
+ * Read-only transactions are not registered at arbiter and use the snapshot lease shared by
+ * readers at this node. With read committed isolation level they take the current lease for each statement.
+ */
+static void MMBeginReadOnlyTransaction(void)
+{
+	if (dtm == NULL)
+		elog(ERROR, "DTM is not properly initialized, please check that pg_dtm plugin was added to shared_preload_libraries list in postgresql.conf");
+    Assert(!RecoveryInProgress());
+	DtmGetSnapshotLease(&DtmSnapshot);
+	XTM_INFO("%d: Start read-only transaction, xmin=%d, xmax=%d\n", getpid(), DtmSnapshot.xmin, DtmSnapshot.xmax);
+
+	DtmReadOnly = true;
 	DtmHasGlobalSnapshot = true;
 	DtmLastSnapshot = NULL;
     MMIsDistributedTrans = false;
@@ -1065,6 +1287,7 @@ void MMJoinTransaction(TransactionId xid)
 	XTM_INFO("%d: Join global transaction %d, dtm->minXid=%d\n", getpid(), DtmNextXid, dtm->minXid);
 
 	DtmHasGlobalSnapshot = true;
+	DtmReadOnly = false;
 	DtmLastSnapshot = NULL;
     MMIsDistributedTrans = true;
 
@@ -1114,6 +1337,10 @@ void DtmBackgroundWorker(Datum arg)
 
 	snprintf(unix_sock_path, sizeof(unix_sock_path), "%s/sh.unix", Unix_socket_directories);
 
+	if (DtmBufferShmem) {
+		ArbiterHubMain(ArbitersCopy, DtmBufferSize);
+	}
+
 	ShubInitParams(&params);
 	
 	if (!ShubParamsSetHosts(&params, ArbitersCopy))
@@ -1224,7 +1451,7 @@ mm_drop_node(PG_FUNCTION_ARGS)
 		dtm->nNodes -= 1;
 		if (!IsTransactionBlock())
 		{
-			MMBroadcastUtilityStmt(psprintf("select mm_drop_node(%d,%s)", nodeId, dropSlot ? "true" : "false"), true);
+			MMBroadcastUtilityStmt(psprintf("select mm_drop_node(%d,%s)", nodeId, dropSlot ? "true" : "false"), true, true);
 		}
 		if (dropSlot) 
 		{
@@ -1234,6 +1461,29 @@ mm_drop_node(PG_FUNCTION_ARGS)
     PG_RETURN_VOID();
 }
 		
+/*
+ * Report how local XIDs are reserved at arbiter: current reservation size, XIDs left in the current range
+ * and in the range reserved in advance, number of reservations, and how often and how long assignment
+ * of local XIDs had to wait for arbiter.
+ */
+Datum
+mm_get_xid_reserve_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc desc;
+	Datum values[XID_RESERVE_STATS_COLS];
+	bool nulls[XID_RESERVE_STATS_COLS];
+
+	if (dtm == NULL)
+		elog(ERROR, "DTM is not properly initialized");
+	if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	memset(nulls, false, sizeof(nulls));
+	ArbiterXidReserveStats(&dtm->xids, values);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(desc), values, nulls)));
+}
+
 /*
  * Execute statement with specified parameters and check its result
  */
@@ -1249,7 +1499,12 @@ static bool MMRunUtilityStmt(PGconn* conn, char const* sql)
 	return ret;
 }
 
-static void MMBroadcastUtilityStmt(char const* sql, bool ignoreError)
+/*
+ * Execute statement at all nodes (including this one) through libpq. Replication of DDL is switched off in these
+ * sessions, because each node executes the statement itself. Statements which can not be executed inside transaction
+ * are executed without the commit loop.
+ */
+static void MMBroadcastUtilityStmt(char const* sql, bool ignoreError, bool inTransaction)
 {
 	char* conn_str = pstrdup(MMConnStrs);
 	char* conn_str_end = conn_str + strlen(conn_str);
@@ -1293,7 +1548,13 @@ static void MMBroadcastUtilityStmt(char const* sql, bool ignoreError)
 	{ 
 		if (conns[i]) 
 		{
-			if (!MMRunUtilityStmt(conns[i], "BEGIN TRANSACTION") && !ignoreError)
+			if (!MMRunUtilityStmt(conns[i], "SET multimaster.replicate_ddl = off") && !ignoreError)
+			{
+				errorMsg = "Failed to switch off replication at node %d";
+				failedNode = i;
+				break;
+			}
+			if (inTransaction && !MMRunUtilityStmt(conns[i], "BEGIN TRANSACTION") && !ignoreError)
 			{
 				errorMsg = "Failed to start transaction at node %d";
 				failedNode = i;
@@ -1307,7 +1568,11 @@ static void MMBroadcastUtilityStmt(char const* sql, bool ignoreError)
 			}
 		}
 	}
-	if (failedNode >= 0 && !ignoreError)  
+	if (!inTransaction)
+	{
+		/* statement is already completed at all nodes */
+	}
+	else if (failedNode >= 0 && !ignoreError)  
 	{
 		for (i = 0; i < MMNodes; i++) 
 		{ 
@@ -1339,59 +1604,360 @@ static void MMBroadcastUtilityStmt(char const* sql, bool ignoreError)
 	}
 }
 
+/*
+ * Replicate utility statement by inserting it in DDL log table: the insert is delivered to other nodes
+ * through the logical replication stream within the same transaction, so DDL shares ordering and commit
+ * protocol with DML, and is executed by the receiving node when it applies the insert.
+ * Returns true if statement was broadcast to all nodes (including this one) and should not be executed locally.
+ */
+static bool MMProcessDDLCommand(char const* queryString)
+{
+	RangeVar   *rv;
+	Relation	rel;
+	TupleDesc	tupDesc;
+	HeapTuple	tup;
+	Datum		values[Natts_mm_ddl_log];
+	bool		nulls[Natts_mm_ddl_log];
+	TimestampTz ts = GetCurrentTimestamp();
+
+	rv = makeRangeVar(MULTIMASTER_SCHEMA_NAME, MULTIMASTER_DDL_TABLE, -1);
+	rel = heap_openrv_extended(rv, RowExclusiveLock, true);
+
+	if (rel == NULL) {
+		/* Extension is not yet created at this node: fall back to broadcasting statement */
+		if (!IsTransactionBlock()) {
+			MMBroadcastUtilityStmt(queryString, false, true);
+			return true;
+		}
+		return false;
+	}
+
+	tupDesc = RelationGetDescr(rel);
+
+	memset(nulls, false, sizeof(nulls));
+	values[Anum_mm_ddl_log_issued - 1] = TimestampTzGetDatum(ts);
+	values[Anum_mm_ddl_log_query - 1] = CStringGetTextDatum(queryString);
+	/* peers resolve unqualified names of the statement using search path of this session */
+	if (namespace_search_path != NULL) {
+		values[Anum_mm_ddl_log_search_path - 1] = CStringGetTextDatum(namespace_search_path);
+	} else {
+		nulls[Anum_mm_ddl_log_search_path - 1] = true;
+	}
+
+	tup = heap_form_tuple(tupDesc, values, nulls);
+	simple_heap_insert(rel, tup);
+	CatalogUpdateIndexes(rel, tup);
+
+	heap_freetuple(tup);
+	heap_close(rel, RowExclusiveLock);
+
+	MMIsDistributedTrans = true;
+	return false;
+}
+
+/*
+ * Check whether statement creates or alters temporary relation, which exists only in this session
+ */
+static bool MMIsTempRelation(RangeVar* rv)
+{
+	Oid relid;
+
+	if (rv->relpersistence == RELPERSISTENCE_TEMP) {
+		return true;
+	}
+	relid = RangeVarGetRelid(rv, NoLock, true);
+	return OidIsValid(relid) && get_rel_persistence(relid) == RELPERSISTENCE_TEMP;
+}
+
+/*
+ * Choose how utility statement is replicated. Only statements changing schema or other persistent objects
+ * are replicated: the list is explicit, so that statements changing session state (DISCARD, LOCK, ...) or data
+ * (EXPLAIN ANALYZE of DML) are never executed at peers a second time.
+ */
+static MMDDLReplication MMGetDDLReplication(Node* parsetree)
+{
+	switch (nodeTag(parsetree))
+	{
+		case T_CreateStmt:
+			return MMIsTempRelation(((CreateStmt*)parsetree)->relation) ? MM_DDL_LOCAL : MM_DDL_LOG;
+		case T_CreateTableAsStmt:
+			/* rows of the new table are replicated as DML, so peers create it without data */
+			return MMIsTempRelation(((CreateTableAsStmt*)parsetree)->into->rel) ? MM_DDL_LOCAL : MM_DDL_LOG;
+		case T_ViewStmt:
+			return MMIsTempRelation(((ViewStmt*)parsetree)->view) ? MM_DDL_LOCAL : MM_DDL_LOG;
+		case T_CreateSeqStmt:
+			return MMIsTempRelation(((CreateSeqStmt*)parsetree)->sequence) ? MM_DDL_LOCAL : MM_DDL_LOG;
+		case T_AlterTableStmt:
+			return MMIsTempRelation(((AlterTableStmt*)parsetree)->relation) ? MM_DDL_LOCAL : MM_DDL_LOG;
+		case T_IndexStmt:
+			return MMIsTempRelation(((IndexStmt*)parsetree)->relation) ? MM_DDL_LOCAL : MM_DDL_LOG;
+		case T_TruncateStmt:
+		{
+			ListCell* cell;
+			foreach (cell, ((TruncateStmt*)parsetree)->relations) {
+				if (!MMIsTempRelation((RangeVar*)lfirst(cell))) {
+					return MM_DDL_LOG;
+				}
+			}
+			return MM_DDL_LOCAL;
+		}
+		case T_DropStmt:
+		case T_AlterDomainStmt:
+		case T_GrantStmt:
+		case T_GrantRoleStmt:
+		case T_AlterDefaultPrivilegesStmt:
+		case T_DefineStmt:
+		case T_CommentStmt:
+		case T_CreateFunctionStmt:
+		case T_AlterFunctionStmt:
+		case T_RenameStmt:
+		case T_RuleStmt:
+		case T_CreateDomainStmt:
+		case T_AlterSeqStmt:
+		case T_CreateTrigStmt:
+		case T_CreatePLangStmt:
+		case T_CreateRoleStmt:
+		case T_AlterRoleStmt:
+		case T_DropRoleStmt:
+		case T_CreateSchemaStmt:
+		case T_AlterDatabaseSetStmt:
+		case T_AlterRoleSetStmt:
+		case T_CreateConversionStmt:
+		case T_CreateCastStmt:
+		case T_CreateOpClassStmt:
+		case T_CreateOpFamilyStmt:
+		case T_AlterOpFamilyStmt:
+		case T_AlterObjectSchemaStmt:
+		case T_AlterOwnerStmt:
+		case T_AlterOperatorStmt:
+		case T_DropOwnedStmt:
+		case T_ReassignOwnedStmt:
+		case T_CompositeTypeStmt:
+		case T_CreateEnumStmt:
+		case T_CreateRangeStmt:
+		case T_AlterTSDictionaryStmt:
+		case T_AlterTSConfigurationStmt:
+		case T_CreateFdwStmt:
+		case T_AlterFdwStmt:
+		case T_CreateForeignServerStmt:
+		case T_AlterForeignServerStmt:
+		case T_CreateUserMappingStmt:
+		case T_AlterUserMappingStmt:
+		case T_DropUserMappingStmt:
+		case T_SecLabelStmt:
+		case T_CreateForeignTableStmt:
+		case T_ImportForeignSchemaStmt:
+		case T_CreateExtensionStmt:
+		case T_AlterExtensionStmt:
+		case T_AlterExtensionContentsStmt:
+		case T_CreateEventTrigStmt:
+		case T_AlterEventTrigStmt:
+		case T_RefreshMatViewStmt:
+		case T_CreatePolicyStmt:
+		case T_AlterPolicyStmt:
+		case T_CreateTransformStmt:
+			return MM_DDL_LOG;
+		/* statements which can not be executed inside transaction */
+		case T_AlterEnumStmt:
+		case T_CreatedbStmt:
+		case T_DropdbStmt:
+			return MM_DDL_BROADCAST;
+		default:
+			/* session state, node local maintenance (VACUUM, CLUSTER, REINDEX, tablespaces, ALTER SYSTEM,...) */
+			return MM_DDL_LOCAL;
+	}
+}
+
+/*
+ * Location of the relation the statement works on in the query string, or -1 if it is not known
+ */
+static int MMGetStatementLocation(Node* parsetree)
+{
+	switch (nodeTag(parsetree))
+	{
+		case T_CreateStmt:
+			return ((CreateStmt*)parsetree)->relation->location;
+		case T_CreateTableAsStmt:
+			return ((CreateTableAsStmt*)parsetree)->into->rel->location;
+		case T_ViewStmt:
+			return ((ViewStmt*)parsetree)->view->location;
+		case T_CreateSeqStmt:
+			return ((CreateSeqStmt*)parsetree)->sequence->location;
+		case T_AlterTableStmt:
+			return ((AlterTableStmt*)parsetree)->relation->location;
+		case T_IndexStmt:
+			return ((IndexStmt*)parsetree)->relation->location;
+		case T_TruncateStmt:
+			return ((RangeVar*)linitial(((TruncateStmt*)parsetree)->relations))->location;
+		default:
+			return -1;
+	}
+}
+
+/*
+ * Extract text of the statement from the query string, which may contain several statements (and DML among them)
+ * if it was sent by a client as a simple query, or executed by EXECUTE of PL/pgSQL or a SQL function.
+ * Parse nodes do not keep statement boundaries, so the string is split at top level semicolons by the SQL scanner.
+ * The statement is the one containing location of its relation if the node has it, otherwise the one which
+ * parses to the same tree (locations are ignored by equal()). Returns the whole string if it is not found.
+ */
+static char const* MMGetStatementText(Node* parsetree, char const* queryString)
+{
+	core_yyscan_t yyscanner;
+	core_yy_extra_type yyextra;
+	core_YYSTYPE yylval;
+	YYLTYPE yylloc;
+	int location = MMGetStatementLocation(parsetree);
+	int start = -1;
+	int end;
+	int depth = 0;
+	int nStmts = 0;
+	int tok;
+	char const* result = queryString;
+
+	yyscanner = scanner_init(queryString, &yyextra, ScanKeywords, NumScanKeywords);
+	yyextra.escape_string_warning = false;
+	do {
+		tok = core_yylex(&yylval, &yylloc, yyscanner);
+		if (tok == '(') {
+			depth += 1;
+		} else if (tok == ')') {
+			depth -= 1;
+		}
+		if (tok == 0 || (tok == ';' && depth == 0)) {
+			if (start >= 0) {
+				char* stmt;
+				List* parsed;
+
+				if (tok == 0 && nStmts == 0) {
+					/* the only statement */
+					break;
+				}
+				nStmts += 1;
+				end = tok == 0 ? strlen(queryString) : yylloc;
+				while (end > start && isspace((unsigned char)queryString[end-1])) {
+					end -= 1;
+				}
+				stmt = pnstrdup(queryString + start, end - start);
+				if (location >= 0) {
+					if (location >= start && location < end) {
+						result = stmt;
+						break;
+					}
+				} else {
+					parsed = raw_parser(stmt);
+					if (list_length(parsed) == 1 && equal(linitial(parsed), parsetree)) {
+						result = stmt;
+						break;
+					}
+				}
+				pfree(stmt);
+			}
+			start = -1;
+		} else if (start < 0) {
+			start = yylloc;
+		}
+	} while (tok != 0);
+	scanner_finish(yyscanner);
+
+	return result;
+}
+
+static void MMExecuteUtility(Node *parsetree, const char *queryString,
+							 ProcessUtilityContext context, ParamListInfo params,
+							 DestReceiver *dest, char *completionTag)
+{
+	if (PreviousProcessUtilityHook != NULL)
+	{
+		PreviousProcessUtilityHook(parsetree, queryString, context,
+								   params, dest, completionTag);
+	}
+	else
+	{
+		standard_ProcessUtility(parsetree, queryString, context,
+								params, dest, completionTag);
+	}
+}
+
 static void MMProcessUtility(Node *parsetree, const char *queryString,
 							 ProcessUtilityContext context, ParamListInfo params,
 							 DestReceiver *dest, char *completionTag)
 {
-	bool skipCommand;
-	switch (nodeTag(parsetree))
+	/*
+	 * Concurrent index build and drop commit several transactions, which are not allowed to have XID,
+	 * but XIDs of replicated transactions are assigned by arbiter at transaction start.
+	 */
+	if (MMDoReplication && !IsBackgroundWorker
+		&& ((IsA(parsetree, IndexStmt) && ((IndexStmt*)parsetree)->concurrent)
+			|| (IsA(parsetree, DropStmt) && ((DropStmt*)parsetree)->concurrent)))
 	{
-		case T_TransactionStmt:
-		case T_PlannedStmt:
-		case T_ClosePortalStmt:
-		case T_FetchStmt:
-		case T_DoStmt:
-		case T_CopyStmt:
-		case T_PrepareStmt:
-		case T_ExecuteStmt:
-		case T_NotifyStmt:
-		case T_ListenStmt:
-		case T_UnlistenStmt:
-		case T_LoadStmt:
-		case T_VariableSetStmt:
-		case T_VariableShowStmt:
-			skipCommand = true;
-			break;
-	    default:
-			skipCommand = false;			
-			break;
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("CONCURRENTLY is not supported by multimaster"),
+				 errhint("Create or drop the index without CONCURRENTLY.")));
 	}
-	if (skipCommand || IsTransactionBlock()) { 
-		if (PreviousProcessUtilityHook != NULL)
-		{
-			PreviousProcessUtilityHook(parsetree, queryString, context,
-									   params, dest, completionTag);
-		}
-		else
+	/*
+	 * Statements executed by the apply workers are already replicated. Subcommands and statements nested
+	 * in a replicated statement (for example in the script of an extension) are replicated as part of it,
+	 * but other nested statements (in DO blocks and functions) are replicated on their own.
+	 */
+	if (MMDoReplication && MMReplicateDDL && !IsBackgroundWorker && !MMInReplicatedDDL && !creating_extension
+		&& context != PROCESS_UTILITY_SUBCOMMAND)
+	{
+		switch (MMGetDDLReplication(parsetree))
 		{
-			standard_ProcessUtility(parsetree, queryString, context,
-									params, dest, completionTag);
-		}
-		if (!skipCommand) {
-			MMIsDistributedTrans = false;
+		  case MM_DDL_LOG:
+			if (MMProcessDDLCommand(MMGetStatementText(parsetree, queryString))) {
+				return;
+			}
+			MMInReplicatedDDL = true;
+			PG_TRY();
+			{
+				MMExecuteUtility(parsetree, queryString, context, params, dest, completionTag);
+			}
+			PG_CATCH();
+			{
+				MMInReplicatedDDL = false;
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			MMInReplicatedDDL = false;
+			return;
+		  case MM_DDL_BROADCAST:
+			/* if the statement is executed inside transaction, the error is reported locally */
+			if (context == PROCESS_UTILITY_TOPLEVEL && !IsTransactionBlock()) {
+				MMBroadcastUtilityStmt(MMGetStatementText(parsetree, queryString), false, false);
+				return;
+			}
+			break;
+		  case MM_DDL_LOCAL:
+			break;
 		}
-	} else { 		
-		MMBroadcastUtilityStmt(queryString, false);
 	}
+	if (MMApplyingDDL && IsA(parsetree, CreateTableAsStmt)) {
+		/* rows of the table are replicated separately */
+		CreateTableAsStmt* stmt = (CreateTableAsStmt*)copyObject(parsetree);
+		stmt->into->skipData = true;
+		parsetree = (Node*)stmt;
+	}
+	MMExecuteUtility(parsetree, queryString, context, params, dest, completionTag);
 }
+
 static void
 MMExecutorFinish(QueryDesc *queryDesc)
 {
     if (MMDoReplication) { 
         CmdType operation = queryDesc->operation;
         EState *estate = queryDesc->estate;
-        if (estate->es_processed != 0) { 
-            MMIsDistributedTrans |= operation == CMD_INSERT || operation == CMD_UPDATE || operation == CMD_DELETE;
+        if (estate->es_processed != 0 && (operation == CMD_INSERT || operation == CMD_UPDATE || operation == CMD_DELETE)) { 
+            /* changes of temporary and unlogged tables are not replicated */
+            int i;
+            for (i = 0; i < estate->es_num_result_relations; i++) { 
+                if (estate->es_result_relations[i].ri_RelationDesc->rd_rel->relpersistence == RELPERSISTENCE_PERMANENT) { 
+                    MMIsDistributedTrans = true;
+                    break;
+                }
+            }
         }
     }
     if (PreviousExecutorFinishHook != NULL)
@@ -7,6 +7,14 @@
 /* #define XTM_INFO(fmt, ...) fprintf(stderr, fmt, ## __VA_ARGS__) */
 #define XTM_INFO(fmt, ...)
 
+#define MULTIMASTER_SCHEMA_NAME     "mm"
+#define MULTIMASTER_DDL_TABLE       "ddl_log"
+
+#define Natts_mm_ddl_log            3
+#define Anum_mm_ddl_log_issued      1
+#define Anum_mm_ddl_log_query       2
+#define Anum_mm_ddl_log_search_path 3
+
 extern int  MMStartReceivers(char* nodes, int node_id);
 extern void MMBeginTransaction(void);
 extern void MMJoinTransaction(TransactionId xid);
@@ -16,5 +24,6 @@ extern void MMExecute(void* work, int size);
 extern void MMExecutor(int id, void* work, size_t size);
 
 extern char* MMDatabaseName;
+extern bool  MMApplyingDDL;
 
 #endif
@@ -39,6 +39,7 @@
 #include "utils/tqual.h"
 #include "utils/builtins.h"
 #include "utils/datetime.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
@@ -69,6 +70,7 @@ static void process_remote_commit(StringInfo s);
 static void process_remote_insert(StringInfo s, Relation rel);
 static void process_remote_update(StringInfo s, Relation rel);
 static void process_remote_delete(StringInfo s, Relation rel);
+static bool is_ddl_log(Relation rel);
 
 /*
  * Search the index 'idxrel' for a tuple identified by 'skey' in 'rel'.
@@ -461,6 +463,20 @@ process_remote_commit(StringInfo s)
     CommitTransactionCommand();
 }
 
+/*
+ * Check whether relation is the log of replicated utility statements.
+ */
+static bool
+is_ddl_log(Relation rel)
+{
+	char *nspname;
+
+	if (strcmp(RelationGetRelationName(rel), MULTIMASTER_DDL_TABLE) != 0)
+		return false;
+	nspname = get_namespace_name(RelationGetNamespace(rel));
+	return nspname != NULL && strcmp(nspname, MULTIMASTER_SCHEMA_NAME) == 0;
+}
+
 static void
 process_remote_insert(StringInfo s, Relation rel)
 {
@@ -470,6 +486,8 @@ process_remote_insert(StringInfo s, Relation rel)
 	TupleTableSlot *oldslot;
 	ResultRelInfo *relinfo;
 	ScanKey	   *index_keys;
+	char	   *ddl = NULL;
+	char	   *search_path = NULL;
 	int			i;
 
 	estate = create_rel_estate(rel);
@@ -547,11 +565,51 @@ process_remote_insert(StringInfo s, Relation rel)
 
 	ExecCloseIndices(estate->es_result_relation_info);
 
+	/* execute replicated utility statement as part of the applied transaction */
+	if (is_ddl_log(rel) && !new_tuple.isnull[Anum_mm_ddl_log_query-1])
+	{
+		ddl = TextDatumGetCString(new_tuple.values[Anum_mm_ddl_log_query-1]);
+		if (!new_tuple.isnull[Anum_mm_ddl_log_search_path-1])
+			search_path = TextDatumGetCString(new_tuple.values[Anum_mm_ddl_log_search_path-1]);
+	}
+
     heap_close(rel, NoLock);
     ExecResetTupleTable(estate->es_tupleTable, true);
     FreeExecutorState(estate);
 
 	CommandCounterIncrement();
+
+	if (ddl != NULL)
+	{
+		int rc;
+		int save_nestlevel = NewGUCNestLevel();
+
+		/* resolve names of the statement in the same way as the session which issued it */
+		if (search_path != NULL)
+			(void) set_config_option("search_path", search_path,
+									 PGC_USERSET, PGC_S_SESSION,
+									 GUC_ACTION_SAVE, true, 0, false);
+
+		MMApplyingDDL = true;
+		PG_TRY();
+		{
+			SPI_connect();
+			rc = SPI_execute(ddl, false, 0);
+			SPI_finish();
+		}
+		PG_CATCH();
+		{
+			MMApplyingDDL = false;
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		MMApplyingDDL = false;
+
+		AtEOXact_GUC(true, save_nestlevel);
+		if (rc < 0)
+			elog(ERROR, "Failed to execute utility statement %s", ddl);
+		CommandCounterIncrement();
+	}
 }
 
 static void
@@ -0,0 +1,34 @@
+--
+-- Replication of utility statements through mm.ddl_log.
+-- Runs in the replicated database of a multimaster node, see README.md.
+--
+SELECT clock_timestamp() AS start \gset
+
+-- Query string with several statements: only the text of each
+-- replicated statement is logged, DML around it is replicated as rows.
+DO $$
+BEGIN
+	EXECUTE 'CREATE TABLE ddl_t(k int primary key, v int); '
+		'INSERT INTO ddl_t VALUES (1, 1), (2, 2); '
+		'CREATE INDEX ddl_t_v ON ddl_t(v);'
+		'UPDATE ddl_t SET v = v + 10; '
+		'CREATE TABLE ddl_c AS SELECT * FROM ddl_t WHERE k = 1; '
+		'ALTER TABLE ddl_c ADD COLUMN w text; '
+		'DELETE FROM ddl_t WHERE k = 2; '
+		'DROP TABLE ddl_c';
+END $$;
+
+SELECT query FROM mm.ddl_log WHERE issued >= :'start' ORDER BY issued;
+SELECT * FROM ddl_t ORDER BY k;
+
+-- Semicolons inside parentheses do not end the statement.
+DO $$
+BEGIN
+	EXECUTE 'CREATE RULE ddl_r AS ON INSERT TO ddl_t DO ALSO (SELECT 1; SELECT 2); '
+		'INSERT INTO ddl_t VALUES (3, 3)';
+END $$;
+
+SELECT query FROM mm.ddl_log WHERE issued >= :'start' AND query LIKE '%RULE%';
+SELECT * FROM ddl_t ORDER BY k;
+
+DROP TABLE ddl_t;
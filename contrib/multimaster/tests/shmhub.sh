@@ -0,0 +1,109 @@
+#!/bin/sh
+#
+# Check the shared memory transport between backends and sockhub
+# (multimaster.buffer_shmem) on a cluster of two nodes: concurrent
+# transactions get their responses from arbiter, a backend waiting for
+# arbiter can be cancelled, and requests fail instead of hanging when
+# arbiter is gone.
+#
+# Usage: ./shmhub.sh [PORT]  (postgres, multimaster and arbiter are to be
+# installed, the nodes use PORT+1 and PORT+2)
+
+PORT=${1:-5450}
+ARBITER=../../arbiter/bin/arbiter
+BASE=$(mktemp -d /tmp/shmhub-test.XXXXXX)
+failed=0
+
+psql_node()
+{
+	port=$(($PORT + $1))
+	shift
+	psql -X -q -At -h $BASE -p $port postgres "$@"
+}
+
+check()
+{
+	if [ "$2" = "$3" ]; then
+		echo "$1: ok"
+	else
+		echo "$1: FAILED (got '$2', expected '$3')"
+		failed=1
+	fi
+}
+
+cleanup()
+{
+	for i in 1 2; do
+		pg_ctl -D $BASE/node$i -m immediate stop > /dev/null 2>&1
+	done
+	kill -9 $(cat $BASE/arbiter/arbiter.pid) > /dev/null 2>&1
+	[ $failed = 0 ] && rm -rf $BASE
+}
+trap cleanup EXIT
+
+mkdir $BASE/arbiter
+$ARBITER -i 0 -r 127.0.0.1:$PORT -d $BASE/arbiter -l $BASE/arbiter.log || exit 1
+
+conn_strings="dbname=postgres host=127.0.0.1 port=$(($PORT + 1)),dbname=postgres host=127.0.0.1 port=$(($PORT + 2))"
+for i in 1 2; do
+	initdb -D $BASE/node$i > /dev/null 2>&1 || exit 1
+	cat >> $BASE/node$i/postgresql.conf <<EOC
+port = $(($PORT + $i))
+unix_socket_directories = '$BASE'
+shared_preload_libraries = 'multimaster'
+max_connections = 40
+max_prepared_transactions = 40
+max_worker_processes = 30
+wal_level = logical
+max_wal_senders = 10
+max_replication_slots = 10
+wal_sender_timeout = 0
+multimaster.workers = 4
+multimaster.queue_size = 1048576
+multimaster.arbiters = '127.0.0.1:$PORT'
+multimaster.buffer_size = 65536
+multimaster.buffer_shmem = on
+multimaster.conn_strings = '$conn_strings'
+multimaster.node_id = $i
+EOC
+	cat >> $BASE/node$i/pg_hba.conf <<EOC
+local replication all trust
+host replication all 127.0.0.1/32 trust
+EOC
+	pg_ctl -D $BASE/node$i -l $BASE/node$i.log -w start > /dev/null || exit 1
+done
+
+# wait until the nodes replicate to each other
+sleep 15
+psql_node 1 <<EOC
+CREATE EXTENSION multimaster;
+CREATE TABLE t (k int PRIMARY KEY, v int);
+INSERT INTO t SELECT k, 0 FROM generate_series(1, 100) k;
+EOC
+
+# Requests of many backends share the queue and responses are routed back to them
+cat > $BASE/update.sql <<EOC
+\setrandom k 1 100
+UPDATE t SET v = v + 1 WHERE k = :k;
+EOC
+pgbench -n -h $BASE -p $(($PORT + 1)) -c 8 -j 4 -t 100 -f $BASE/update.sql postgres > $BASE/pgbench.log 2>&1
+sleep 2
+check "concurrent transactions" "$(psql_node 1 -c 'SELECT sum(v) FROM t')" 800
+check "concurrent transactions replicated" "$(psql_node 2 -c 'SELECT sum(v) FROM t')" 800
+
+# Backend waiting for the response of the stopped arbiter can be cancelled
+kill -STOP $(cat $BASE/arbiter/arbiter.pid)
+psql_node 1 -c 'UPDATE t SET v = v + 1 WHERE k = 1' > $BASE/cancel.log 2>&1 &
+sleep 2
+kill -INT $(ps -eo pid,args | awk '/[p]ostgres: .* postgres \[local\]/ {print $1}')
+wait
+kill -CONT $(cat $BASE/arbiter/arbiter.pid)
+check "cancel wait for arbiter" "$(grep -c 'canceling statement due to user request' $BASE/cancel.log)" 1
+check "transaction after cancel" \
+	"$(psql_node 1 -c 'WITH u AS (UPDATE t SET v = v + 1 WHERE k = 1 RETURNING k) SELECT count(*) FROM u')" 1
+
+# Without arbiter requests fail instead of waiting forever
+kill -9 $(cat $BASE/arbiter/arbiter.pid)
+check "no arbiter" "$(psql_node 1 -c 'UPDATE t SET v = v + 1 WHERE k = 1' 2>&1 | grep -c 'ERROR')" 1
+
+exit $failed
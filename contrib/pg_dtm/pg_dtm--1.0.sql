@@ -9,6 +9,14 @@ CREATE FUNCTION dtm_join_transaction(xid integer) RETURNS void
 AS 'MODULE_PATHNAME','dtm_join_transaction'
 LANGUAGE C;
 
+CREATE FUNCTION dtm_begin_readonly_transaction() RETURNS text
+AS 'MODULE_PATHNAME','dtm_begin_readonly_transaction'
+LANGUAGE C;
+
+CREATE FUNCTION dtm_join_readonly_transaction(snapshot text) RETURNS void
+AS 'MODULE_PATHNAME','dtm_join_readonly_transaction'
+LANGUAGE C;
+
 CREATE FUNCTION dtm_get_current_snapshot_xmin() RETURNS integer
 AS 'MODULE_PATHNAME','dtm_get_current_snapshot_xmin'
 LANGUAGE C;
@@ -20,3 +28,14 @@ LANGUAGE C;
 CREATE FUNCTION dtm_get_current_snapshot_xcnt() RETURNS integer
 AS 'MODULE_PATHNAME','dtm_get_current_snapshot_xcnt'
 LANGUAGE C;
+
+CREATE FUNCTION dtm_get_xid_reserve_stats(
+    OUT reserve_size bigint,
+    OUT reserved_xids bigint,
+    OUT prefetched_xids bigint,
+    OUT reservations bigint,
+    OUT prefetches bigint,
+    OUT stalls bigint,
+    OUT stall_time bigint)
+AS 'MODULE_PATHNAME','dtm_get_xid_reserve_stats'
+LANGUAGE C;
@@ -11,6 +11,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "postmaster/postmaster.h"
 #include "postmaster/bgworker.h"
@@ -29,12 +30,14 @@
 #include "storage/proc.h"
 #include "storage/procarray.h"
 #include "access/twophase.h"
+#include "access/htup_details.h"
 #include <utils/guc.h>
 #include "utils/hsearch.h"
 #include "utils/tqual.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 #include "commands/dbcommands.h"
 #include "miscadmin.h"
 #include "postmaster/autovacuum.h"
@@ -44,14 +47,23 @@
 
 #include "sockhub.h"
 #include "arbiter.h"
+#include "xidreserve.h"
+
+/* maximal number of active global transactions in a snapshot lease shared by readers */
+#define DTM_LEASE_MAX_XCNT 1024
 
 typedef struct
 {
 	LWLockId hashLock;
 	LWLockId xidLock;
 	TransactionId minXid;  /* XID of oldest transaction visible by any active transaction (local or global) */
-	TransactionId nextXid; /* next XID for local transaction */
-	size_t nReservedXids;  /* number of XIDs reserved for local transactions */
+	ArbiterXidReserve xids; /* ranges of XIDs reserved for local transactions */
+	LWLockId leaseLock;
+	TimestampTz leaseTime; /* when the snapshot lease was obtained from arbiter, 0 if there is no lease */
+	TransactionId leaseXmin;
+	TransactionId leaseXmax;
+	int leaseXcnt;
+	TransactionId leaseXip[DTM_LEASE_MAX_XCNT];
 } DtmState;
 
 typedef struct
@@ -77,6 +89,9 @@ static void DtmInitialize(void);
 static void DtmSubXactCallback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg);
 static void DtmXactCallback(XactEvent event, void *arg);
 static TransactionId DtmGetNextXid(void);
+static bool DtmSnapshotLeaseIsValid(TimestampTz now);
+static void DtmGetSnapshotLease(Snapshot snapshot);
+static void DtmPinSnapshotLease(Snapshot snapshot);
 static TransactionId DtmGetNewTransactionId(bool isSubXact);
 static TransactionId DtmGetOldestXmin(Relation rel, bool ignoreVacuum);
 static TransactionId DtmGetGlobalTransactionId(void);
@@ -105,8 +120,11 @@ static Snapshot CurrentTransactionSnapshot;
 static TransactionId DtmNextXid;
 static SnapshotData DtmSnapshot = { HeapTupleSatisfiesMVCC };
 static bool DtmHasGlobalSnapshot;
+static bool DtmReadOnly;
+static int DtmSnapshotLeaseTime;
 static bool DtmGlobalXidAssigned;
 static int DtmLocalXidReserve;
+static int DtmMaxLocalXidReserve;
 static CommandId DtmCurcid;
 static Snapshot DtmLastSnapshot;
 static TransactionManager DtmTM = {
@@ -119,12 +137,14 @@ static TransactionManager DtmTM = {
 	DtmGetGlobalTransactionId,
 	PgXidInMVCCSnapshot,
     DtmDetectGlobalDeadLock,
-	DtmGetName
+	DtmGetName,
+	PgXidInMVCCSnapshotBatch
 };
 
 static char *Arbiters;
 static char *ArbitersCopy;
 static int DtmBufferSize;
+static bool DtmBufferShmem;
 
 static BackgroundWorker DtmWorker = {
 	"DtmWorker",
@@ -152,7 +172,7 @@ static void DumpSnapshot(Snapshot s, char *name)
 	cursor += sprintf(
 		cursor,
 		"snapshot %s(%p) for transaction %d: xmin=%d, xmax=%d, active=[",
-		name, s, GetCurrentTransactionId(), s->xmin, s->xmax
+		name, s, GetCurrentTransactionIdIfAny(), s->xmin, s->xmax
 	);
 	for (i = 0; i < s->xcnt; i++) {
 		if (i == 0) {
@@ -324,6 +344,8 @@ static void DtmUpdateRecentXmin(Snapshot snapshot)
 /*
  * Get new XID. For global transaction is it previsly set by dtm_begin_transaction or dtm_join_transaction.
  * Local transactions are using range of local Xids obtains from DTM.
+ * Should be called with XidGenLock held, which is released for a while if other backend is reserving
+ * the next range of local Xids.
  */
 static TransactionId DtmGetNextXid()
 {
@@ -345,38 +367,14 @@ static TransactionId DtmGetNextXid()
 				ExtendSUBTRANS(ShmemVariableCache->nextXid);
 				TransactionIdAdvance(ShmemVariableCache->nextXid);
 			}
-			dtm->nReservedXids = 0;
+			dtm->xids.nReservedXids = 0;
 		}
 	}
 	else
 	{
-		if (dtm->nReservedXids == 0)
-		{
-			dtm->nReservedXids = ArbiterReserve(ShmemVariableCache->nextXid, DtmLocalXidReserve, &dtm->nextXid);
-			if (dtm->nReservedXids < 1)
-			{
-				elog(WARNING, "failed to reserve a local range of xids on arbiter");
-				goto end;
-			}
-
-			Assert(TransactionIdFollowsOrEquals(dtm->nextXid, ShmemVariableCache->nextXid));
-
-			/* Advance ShmemVariableCache->nextXid formward until new Xid */
-			while (TransactionIdPrecedes(ShmemVariableCache->nextXid, dtm->nextXid))
-			{
-				XTM_INFO("Extend CLOG for local transaction to %d\n", ShmemVariableCache->nextXid);
-				ExtendCLOG(ShmemVariableCache->nextXid);
-				ExtendCommitTs(ShmemVariableCache->nextXid);
-				ExtendSUBTRANS(ShmemVariableCache->nextXid);
-				TransactionIdAdvance(ShmemVariableCache->nextXid);
-			}
-		}
-		Assert(ShmemVariableCache->nextXid == dtm->nextXid);
-		xid = dtm->nextXid++;
-		dtm->nReservedXids -= 1;
+		xid = ArbiterXidReserveNext(&dtm->xids, DtmLocalXidReserve, DtmMaxLocalXidReserve);
 		XTM_INFO("Obtain new local XID %d\n", xid);
 	}
-end:
 	LWLockRelease(dtm->xidLock);
 	return xid;
 }
@@ -401,6 +399,8 @@ DtmGetNewTransactionId(bool isSubXact)
 		/* We should not assign new Xid if we do not use previous one */
 		elog(ERROR, "dtm_begin/join_transaction should be called prior to begin of global transaction");
 	}
+	if (DtmReadOnly)
+		elog(ERROR, "cannot assign XID to read-only global transaction");
 	/*
 	 * Workers synchronize transaction state at the beginning of each parallel
 	 * operation, so we can't account for new XIDs after that point.
@@ -601,6 +601,84 @@ DtmGetNewTransactionId(bool isSubXact)
 	return xid;
 }
 
+/*
+ * Snapshot lease can be used while it is not older than snapshot_lease_time and
+ * its xmin is not behind the global xmin, so vacuum has not removed tuples visible to it.
+ * Lease without xmin (there were no active global transactions) restricts nothing:
+ * local snapshot is used instead of it.
+ * Should be called with dtm->leaseLock held.
+ */
+static bool DtmSnapshotLeaseIsValid(TimestampTz now)
+{
+	return dtm->leaseTime != 0
+		&& !TimestampDifferenceExceeds(dtm->leaseTime, now, DtmSnapshotLeaseTime)
+		&& (!TransactionIdIsValid(dtm->leaseXmin) || !TransactionIdPrecedes(dtm->leaseXmin, dtm->minXid));
+}
+
+/*
+ * Get global snapshot for read-only transaction. Read-only transactions are not registered at arbiter:
+ * they share the snapshot lease cached in shared memory, which is refreshed from arbiter
+ * by the first reader finding it expired.
+ */
+static void DtmGetSnapshotLease(Snapshot snapshot)
+{
+	TimestampTz now = GetCurrentTimestamp();
+
+	LWLockAcquire(dtm->leaseLock, LW_SHARED);
+	if (!DtmSnapshotLeaseIsValid(now))
+	{
+		LWLockRelease(dtm->leaseLock);
+		LWLockAcquire(dtm->leaseLock, LW_EXCLUSIVE);
+		/* Lease may be already refreshed by other reader */
+		if (!DtmSnapshotLeaseIsValid(now))
+		{
+			XTM_INFO("%d: refresh snapshot lease\n", getpid());
+			ArbiterGetSnapshot(InvalidTransactionId, snapshot, &dtm->minXid);
+			if (snapshot->xcnt <= DTM_LEASE_MAX_XCNT)
+			{
+				dtm->leaseXmin = snapshot->xmin;
+				dtm->leaseXmax = snapshot->xmax;
+				dtm->leaseXcnt = snapshot->xcnt;
+				memcpy(dtm->leaseXip, snapshot->xip, snapshot->xcnt*sizeof(TransactionId));
+				dtm->leaseTime = now;
+			}
+			LWLockRelease(dtm->leaseLock);
+			return;
+		}
+	}
+	ArbiterInitSnapshot(snapshot);
+	snapshot->xmin = dtm->leaseXmin;
+	snapshot->xmax = dtm->leaseXmax;
+	snapshot->xcnt = dtm->leaseXcnt;
+	memcpy(snapshot->xip, dtm->leaseXip, dtm->leaseXcnt*sizeof(TransactionId));
+	LWLockRelease(dtm->leaseLock);
+}
+
+/*
+ * Nothing but xmin of the backend prevents vacuum at this node from removing tuples visible
+ * to the snapshot lease of read-only transaction, as such transactions are not registered at arbiter.
+ * So install xmin of the merged snapshot as backend xmin and then check that global xmin has not passed
+ * the lease in the meantime. It should be done for each snapshot, because backend xmin is reset
+ * between statements with read committed isolation level.
+ */
+static void DtmPinSnapshotLease(Snapshot snapshot)
+{
+	LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+	if (!TransactionIdIsValid(MyPgXact->xmin) || TransactionIdPrecedes(snapshot->xmin, MyPgXact->xmin))
+		MyPgXact->xmin = snapshot->xmin;
+	LWLockRelease(ProcArrayLock);
+
+	if (TransactionIdIsValid(DtmSnapshot.xmin) && TransactionIdPrecedes(DtmSnapshot.xmin, dtm->minXid))
+		ereport(ERROR,
+				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+				 errmsg("snapshot lease of read-only global transaction has expired")));
+
+	if (TransactionIdPrecedes(snapshot->xmin, TransactionXmin))
+		TransactionXmin = snapshot->xmin;
+	if (TransactionIdFollows(RecentXmin, snapshot->xmin))
+		RecentXmin = snapshot->xmin;
+}
+
 static Snapshot DtmGetSnapshot(Snapshot snapshot)
 {
 	if (DtmGlobalXidAssigned)
@@ -611,18 +689,21 @@ static Snapshot DtmGetSnapshot(Snapshot snapshot)
 		 */
 		return PgGetSnapshotData(snapshot);
 	}
-	if (TransactionIdIsValid(DtmNextXid) && snapshot != &CatalogSnapshotData)
+	if ((TransactionIdIsValid(DtmNextXid) || DtmReadOnly) && snapshot != &CatalogSnapshotData)
 	{		
 		if (!DtmHasGlobalSnapshot && (snapshot != DtmLastSnapshot || DtmCurcid != GetCurrentCommandId(false))) {
 			ArbiterGetSnapshot(DtmNextXid, &DtmSnapshot, &dtm->minXid);
 		}
 		DtmLastSnapshot = snapshot;
 		DtmMergeWithGlobalSnapshot(snapshot);
+		if (DtmReadOnly)
+			DtmPinSnapshotLease(snapshot);
 		DtmCurcid = snapshot->curcid;
-		if (!IsolationUsesXactSnapshot())
+		if (!IsolationUsesXactSnapshot() && !DtmReadOnly)
 		{
 			/* Use single global snapshot during all transaction for repeatable read isolation level,
-			 * but obtain new global snapshot each time it is requested for read committed isolation level
+			 * but obtain new global snapshot each time it is requested for read committed isolation level.
+			 * Read-only transactions have to use the same snapshot at all nodes, so they keep it till the end.
 			 */
 			DtmHasGlobalSnapshot = false;
 		}
@@ -723,8 +804,10 @@ static void DtmInitialize()
 	{
 		dtm->hashLock = LWLockAssign();
 		dtm->xidLock = LWLockAssign();
-		dtm->nReservedXids = 0;
+		dtm->leaseLock = LWLockAssign();
 		dtm->minXid = InvalidTransactionId;
+		ArbiterXidReserveInit(&dtm->xids, dtm->xidLock, DtmLocalXidReserve);
+		dtm->leaseTime = 0;
 		RegisterXactCallback(DtmXactCallback, NULL);
 		RegisterSubXactCallback(DtmSubXactCallback, NULL);
 	}
@@ -755,6 +838,12 @@ static void
 DtmXactCallback(XactEvent event, void *arg)
 {
 	XTM_INFO("%d: DtmXactCallbackevent=%d isGlobal=%d, nextxid=%d\n", getpid(), event, DtmGlobalXidAssigned, DtmNextXid);
+	if (event == XACT_EVENT_START)
+	{
+		/* Reserve the next range of local XIDs before this transaction can get an XID */
+		ArbiterXidReservePrefetch(&dtm->xids);
+	}
+	else
 	if (event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT)
 	{
 		if (DtmGlobalXidAssigned)
@@ -793,6 +882,11 @@ DtmXactCallback(XactEvent event, void *arg)
 			DtmNextXid = InvalidTransactionId;
 			DtmLastSnapshot = NULL;
 		}
+		else if (DtmReadOnly)
+		{
+			DtmReadOnly = false;
+			DtmLastSnapshot = NULL;
+		}
 	}
 }
 
@@ -821,11 +915,11 @@ _PG_init(void)
 	 * resources in imcs_shmem_startup().
 	 */
 	RequestAddinShmemSpace(DTM_SHMEM_SIZE);
-	RequestAddinLWLocks(2);
+	RequestAddinLWLocks(3);
 
 	DefineCustomIntVariable(
 		"dtm.local_xid_reserve",
-		"Number of XIDs reserved by node for local transactions",
+		"Minimal number of XIDs reserved by node for local transactions",
 		NULL,
 		&DtmLocalXidReserve,
 		100,
@@ -838,6 +932,36 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"dtm.max_local_xid_reserve",
+		"Maximal number of XIDs reserved by node for local transactions at once",
+		"Number of reserved XIDs grows from dtm.local_xid_reserve up to this limit when local transactions are frequent",
+		&DtmMaxLocalXidReserve,
+		100000,
+		1,
+		INT_MAX,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"dtm.snapshot_lease_time",
+		"Time during which read-only transactions share the same global snapshot",
+		"Read-only transactions are not registered at arbiter, but use snapshot obtained by other reader if it is not older than this",
+		&DtmSnapshotLeaseTime,
+		100,
+		0,
+		INT_MAX,
+		PGC_BACKEND,
+		GUC_UNIT_MS,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"dtm.buffer_size",
 		"Size of sockhub buffer for connection to arbiters, if 0, then direct connection will be used",
@@ -853,6 +977,19 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomBoolVariable(
+		"dtm.buffer_shmem",
+		"Use shared memory instead of unix socket for communication of backends with sockhub",
+		NULL,
+		&DtmBufferShmem,
+		false,
+		PGC_POSTMASTER,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomStringVariable(
 		"dtm.arbiters",
 		"The comma separated host:port pairs where arbiters reside",
@@ -869,6 +1006,11 @@ _PG_init(void)
 	ArbitersCopy = strdup(Arbiters);
 	if (DtmBufferSize != 0)
 	{
+		if (DtmBufferShmem)
+		{
+			RequestAddinShmemSpace(ArbiterShmemSize(DtmBufferSize));
+			DtmWorker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+		}
 		ArbiterConfig(Arbiters, Unix_socket_directories);
 		RegisterBackgroundWorker(&DtmWorker);
 	}
@@ -897,6 +1039,8 @@ static void DtmShmemStartup(void)
 	if (prev_shmem_startup_hook)
 		prev_shmem_startup_hook();
 	DtmInitialize();
+	if (DtmBufferSize != 0 && DtmBufferShmem)
+		ArbiterShmemInit(DtmBufferSize);
 }
 
 /*
@@ -907,9 +1051,12 @@ PG_MODULE_MAGIC;
 
 PG_FUNCTION_INFO_V1(dtm_begin_transaction);
 PG_FUNCTION_INFO_V1(dtm_join_transaction);
+PG_FUNCTION_INFO_V1(dtm_begin_readonly_transaction);
+PG_FUNCTION_INFO_V1(dtm_join_readonly_transaction);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmax);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmin);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xcnt);
+PG_FUNCTION_INFO_V1(dtm_get_xid_reserve_stats);
 
 Datum
 dtm_get_current_snapshot_xmin(PG_FUNCTION_ARGS)
@@ -929,10 +1076,33 @@ dtm_get_current_snapshot_xcnt(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(CurrentTransactionSnapshot->xcnt);
 }
 
+/*
+ * Report how local XIDs are reserved at arbiter: current reservation size, XIDs left in the current range
+ * and in the range reserved in advance, number of reservations, and how often and how long assignment
+ * of local XIDs had to wait for arbiter.
+ */
+Datum
+dtm_get_xid_reserve_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc desc;
+	Datum values[XID_RESERVE_STATS_COLS];
+	bool nulls[XID_RESERVE_STATS_COLS];
+
+	if (dtm == NULL)
+		elog(ERROR, "DTM is not properly initialized");
+	if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	memset(nulls, false, sizeof(nulls));
+	ArbiterXidReserveStats(&dtm->xids, values);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(desc), values, nulls)));
+}
+
 Datum
 dtm_begin_transaction(PG_FUNCTION_ARGS)
 {
-	if (TransactionIdIsValid(DtmNextXid))
+	if (TransactionIdIsValid(DtmNextXid) || DtmReadOnly)
 		elog(ERROR, "dtm_begin/join_transaction should be called only once for global transaction");
 	if (dtm == NULL)
 		elog(ERROR, "DTM is not properly initialized, please check that pg_dtm plugin was added to shared_preload_libraries list in postgresql.conf");
@@ -950,7 +1120,7 @@ dtm_begin_transaction(PG_FUNCTION_ARGS)
 
 Datum dtm_join_transaction(PG_FUNCTION_ARGS)
 {
-	if (TransactionIdIsValid(DtmNextXid))
+	if (TransactionIdIsValid(DtmNextXid) || DtmReadOnly)
 		elog(ERROR, "dtm_begin/join_transaction should be called only once for global transaction");
 	DtmNextXid = PG_GETARG_INT32(0);
 	if (!TransactionIdIsValid(DtmNextXid))
@@ -966,6 +1136,97 @@ Datum dtm_join_transaction(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
+/*
+ * Start read-only global transaction using the snapshot lease shared by readers at this node.
+ * Returns the snapshot in "xmin:xmax:xip,..." form, to be passed to dtm_join_readonly_transaction
+ * at other nodes accessed by the transaction.
+ */
+Datum
+dtm_begin_readonly_transaction(PG_FUNCTION_ARGS)
+{
+	StringInfoData str;
+	int i;
+
+	if (TransactionIdIsValid(DtmNextXid) || DtmReadOnly)
+		elog(ERROR, "dtm_begin/join_transaction should be called only once for global transaction");
+	if (dtm == NULL)
+		elog(ERROR, "DTM is not properly initialized, please check that pg_dtm plugin was added to shared_preload_libraries list in postgresql.conf");
+
+	DtmGetSnapshotLease(&DtmSnapshot);
+	XTM_INFO("%d: Start read-only global transaction, xmin=%d, xmax=%d\n", getpid(), DtmSnapshot.xmin, DtmSnapshot.xmax);
+
+	DtmReadOnly = true;
+	DtmHasGlobalSnapshot = true;
+	DtmGlobalXidAssigned = true;
+	DtmLastSnapshot = NULL;
+
+	initStringInfo(&str);
+	appendStringInfo(&str, "%u:%u:", DtmSnapshot.xmin, DtmSnapshot.xmax);
+	for (i = 0; i < DtmSnapshot.xcnt; i++)
+		appendStringInfo(&str, i == 0 ? "%u" : ",%u", DtmSnapshot.xip[i]);
+
+	PG_RETURN_TEXT_P(cstring_to_text(str.data));
+}
+
+/*
+ * Join read-only global transaction with the snapshot returned by dtm_begin_readonly_transaction.
+ */
+Datum
+dtm_join_readonly_transaction(PG_FUNCTION_ARGS)
+{
+	char *str = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	char *p = str;
+	char *endp;
+
+	if (TransactionIdIsValid(DtmNextXid) || DtmReadOnly)
+		elog(ERROR, "dtm_begin/join_transaction should be called only once for global transaction");
+	if (dtm == NULL)
+		elog(ERROR, "DTM is not properly initialized, please check that pg_dtm plugin was added to shared_preload_libraries list in postgresql.conf");
+
+	ArbiterInitSnapshot(&DtmSnapshot);
+	DtmSnapshot.xmin = strtoul(p, &endp, 10);
+	if (endp == p || *endp != ':')
+		goto bad_format;
+	p = endp + 1;
+	DtmSnapshot.xmax = strtoul(p, &endp, 10);
+	if (endp == p || *endp != ':')
+		goto bad_format;
+	p = endp + 1;
+	DtmSnapshot.xcnt = 0;
+	while (*p != '\0')
+	{
+		if (DtmSnapshot.xcnt == GetMaxSnapshotXidCount())
+			goto bad_format;
+		DtmSnapshot.xip[DtmSnapshot.xcnt++] = strtoul(p, &endp, 10);
+		if (endp == p || (*endp != ',' && *endp != '\0'))
+			goto bad_format;
+		p = *endp == ',' ? endp + 1 : endp;
+	}
+	if (!TransactionIdIsNormal(DtmSnapshot.xmin) || TransactionIdPrecedes(DtmSnapshot.xmax, DtmSnapshot.xmin))
+		goto bad_format;
+
+	/* Vacuum at this node may have already removed tuples visible to the snapshot */
+	if (TransactionIdPrecedes(DtmSnapshot.xmin, dtm->minXid))
+		ereport(ERROR,
+				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+				 errmsg("snapshot lease of read-only global transaction has expired")));
+
+	XTM_INFO("%d: Join read-only global transaction, xmin=%d, xmax=%d\n", getpid(), DtmSnapshot.xmin, DtmSnapshot.xmax);
+
+	DtmReadOnly = true;
+	DtmHasGlobalSnapshot = true;
+	DtmGlobalXidAssigned = true;
+	DtmLastSnapshot = NULL;
+
+	PG_RETURN_VOID();
+
+bad_format:
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid global snapshot \"%s\"", str)));
+	PG_RETURN_VOID();
+}
+
 void DtmBackgroundWorker(Datum arg)
 {
 	Shub shub;
@@ -974,6 +1235,9 @@ void DtmBackgroundWorker(Datum arg)
 
 	snprintf(unix_sock_path, sizeof(unix_sock_path), "%s/sh.unix", Unix_socket_directories);
 
+	if (DtmBufferShmem)
+		ArbiterHubMain(ArbitersCopy, DtmBufferSize);
+
 	ShubInitParams(&params);
 
 	ShubParamsSetHosts(&params, ArbitersCopy);
@@ -50,10 +50,40 @@ typedef struct NodeConnectionEntry
 } NodeConnectionEntry;
 
 
+/*
+ * PreparedStatementKey acts as the key to index into the (process-local) hash
+ * keeping track of statements prepared on remote connections. As query strings
+ * are of arbitrary length, the key only holds a hash of the query string and
+ * parameter types; entries keep the full values to detect collisions.
+ */
+typedef struct PreparedStatementKey
+{
+	PGconn *connection; /* connection on which the statement was prepared */
+	uint32 queryHash;   /* hash of query string and parameter types */
+} PreparedStatementKey;
+
+
+/* PreparedStatementEntry keeps track of the prepared statements themselves. */
+typedef struct PreparedStatementEntry
+{
+	PreparedStatementKey cacheKey;      /* hash entry key */
+	char statementName[NAMEDATALEN];    /* name of statement on remote server */
+	char *queryString;                  /* query string the statement executes */
+	int parameterCount;                 /* number of parameters in query */
+	Oid *parameterTypes;                /* types of parameters in query */
+} PreparedStatementEntry;
+
+
 /* function declarations for obtaining and using a connection */
 extern PGconn * GetConnection(char *nodeName, int32 nodePort, bool openNew);
+extern PGconn * OpenNodeConnection(char *nodeName, int32 nodePort, bool replication);
+extern PGconn * StartDatabaseConnection(char *nodeName, int32 nodePort,
+										const char *databaseName,
+										const char *clientEncoding);
 extern void PurgeConnection(PGconn *connection);
 extern void ReportRemoteError(PGconn *connection, PGresult *result);
+extern char * PrepareRemoteStatement(PGconn *connection, const char *queryString,
+									 int parameterCount, const Oid *parameterTypes);
 
 
 #endif /* PG_SHARD_CONNECTION_H */
@@ -0,0 +1,98 @@
+/*-------------------------------------------------------------------------
+ *
+ * include/connection_broker.h
+ *
+ * Declarations for public functions and types related to the connection
+ * broker, a background worker which runs commands on worker nodes on behalf
+ * of backends using a shared pool of connections.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_SHARD_CONNECTION_BROKER_H
+#define PG_SHARD_CONNECTION_BROKER_H
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "libpq-fe.h"
+
+#include "connection.h"
+
+#include "nodes/pg_list.h"
+
+
+/* size of each of the message queues between a backend and the broker */
+#define BROKER_QUEUE_SIZE 16384
+
+/* time the broker sleeps when idle, and the time it polls busy connections */
+#define BROKER_IDLE_TIMEOUT_MS 1000
+#define BROKER_POLL_TIMEOUT_MS 100
+
+/* time the broker waits for a new connection, like connect_timeout elsewhere */
+#define BROKER_CONNECT_TIMEOUT_MS 5000
+
+/* time a backend sleeps while waiting for the broker */
+#define BROKER_CLIENT_WAIT_MS 10
+
+/* delay before the postmaster restarts a broker which exited */
+#define BROKER_RESTART_SECONDS 5
+
+/* flags sent along with requests to the broker */
+#define BROKER_PIN_CONNECTIONS 0x01
+
+
+/*
+ * BrokerCommand describes a command the broker runs on a worker node. The
+ * values of any parameters are given in their text representation, and their
+ * types may be left unspecified.
+ */
+typedef struct BrokerCommand
+{
+	char *nodeName;                 /* node on which to run the command */
+	int32 nodePort;                 /* port of that node */
+	char *queryString;              /* command to run */
+	int parameterCount;             /* number of parameters of the command */
+	Oid *parameterTypes;            /* types of parameters, or InvalidOid */
+	const char **parameterValues;   /* values of parameters, NULL if null */
+} BrokerCommand;
+
+
+/*
+ * BrokerResult holds the outcome of a command run by the broker. It mirrors
+ * the parts of a PGresult pg_shard relies on. Values are stored row by row,
+ * with null values represented as NULL.
+ */
+typedef struct BrokerResult
+{
+	ExecStatusType resultStatus;    /* status of the command's last result */
+	char *sqlState;                 /* error code if the command failed */
+	char *errorMessage;             /* error message if the command failed */
+	char *affectedTupleCount;       /* the result's PQcmdTuples string */
+	int columnCount;                /* number of columns in the result */
+	int rowCount;                   /* number of rows in the result */
+	char **valueArray;              /* rowCount * columnCount values */
+} BrokerResult;
+
+
+/* config variables managed via guc.c */
+extern int ConnectionBrokerSlots;
+extern int ConnectionBrokerPoolSize;
+extern bool UseConnectionBroker;
+
+
+/* function declarations for using the connection broker */
+extern void InitializeConnectionBroker(void);
+extern bool ConnectionBrokerAvailable(void);
+extern List * BrokerExecuteCommandList(List *brokerCommandList, bool pinConnections);
+extern BrokerResult * BrokerExecuteCommand(BrokerCommand *brokerCommand,
+										   bool pinConnections);
+extern char * BrokerResultGetValue(BrokerResult *brokerResult, int rowIndex,
+								   int columnIndex);
+extern void ReportBrokerError(BrokerCommand *brokerCommand, BrokerResult *brokerResult);
+extern void ConnectionBrokerMain(Datum mainArgument);
+
+
+#endif /* PG_SHARD_CONNECTION_BROKER_H */
@@ -44,6 +44,7 @@ typedef struct WorkerNode
 extern List * SortList(List *pointerList,
 					   int (*ComparisonFunction)(const void *, const void *));
 extern Oid ResolveRelationId(text *relationName);
+extern text * IntegerToText(int32 value);
 
 /* function declarations for initializing a distributed table */
 extern Datum master_create_distributed_table(PG_FUNCTION_ARGS);
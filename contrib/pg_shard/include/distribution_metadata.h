@@ -43,6 +43,13 @@
 							  "FROM pgs_distribution_metadata.shard_placement " \
 							  "WHERE shard_id = $1"
 
+/* query for placements of all shards of a distributed table */
+#define TABLE_SHARD_PLACEMENT_QUERY \
+	"SELECT p.id, p.shard_id, p.shard_state, p.node_name, p.node_port " \
+	"FROM   pgs_distribution_metadata.shard_placement AS p " \
+	"JOIN   pgs_distribution_metadata.shard           AS s " \
+	"ON p.shard_id = s.id WHERE s.relation_id = $1"
+
 /* human-readable names for addressing columns of shard placement queries */
 #define TLIST_NUM_SHARD_PLACEMENT_ID 1
 #define TLIST_NUM_SHARD_PLACEMENT_SHARD_ID 2
@@ -103,35 +110,30 @@ typedef struct ShardPlacement
 } ShardPlacement;
 
 
-/*
- * ShardIntervalListCacheEntry contains the information for a cache entry in
- * shard interval list cache entry.
- */
-typedef struct ShardIntervalListCacheEntry
-{
-	Oid distributedTableId; /* cache key */
-	List *shardIntervalList;
-} ShardIntervalListCacheEntry;
-
-
 /*
  * ShardLockType specifies the kinds of locks that can be acquired for a given
- * shard, i.e. one to change data in that shard or a lock to change placements
- * of the shard itself (the shard's metadata).
+ * shard, i.e. one to change data in that shard, a lock to change placements
+ * of the shard itself (the shard's metadata), or one held while the shard is
+ * moved or split.
  */
 typedef enum
 {
 	SHARD_LOCK_INVALID_FIRST = 0,
 	SHARD_LOCK_DATA = 3,
-	SHARD_LOCK_METADATA = 4
+	SHARD_LOCK_METADATA = 4,
+	SHARD_LOCK_RELOCATION = 5
 } ShardLockType;
 
 /* function declarations to access and manipulate the metadata */
 extern List * LookupShardIntervalList(Oid distributedTableId);
 extern List * LoadShardIntervalList(Oid distributedTableId);
 extern ShardInterval * LoadShardInterval(int64 shardId);
+extern Oid LoadShardRelationId(int64 shardId);
 extern List * LoadFinalizedShardPlacementList(int64 shardId);
 extern List * LoadShardPlacementList(int64 shardId);
+extern List * LoadTableShardPlacementList(Oid distributedTableId);
+extern bool LoadPartitionMetadata(Oid distributedTableId, char *partitionMethod,
+								  char **partitionKey);
 extern Var * PartitionColumn(Oid distributedTableId);
 extern char PartitionType(Oid distributedTableId);
 extern bool IsDistributedTable(Oid tableId);
@@ -143,10 +145,12 @@ extern int64 CreateShardRow(Oid distributedTableId, char shardStorage,
 							text *shardMinValue, text *shardMaxValue);
 extern int64 CreateShardPlacementRow(int64 shardId, ShardState shardState,
 									 char *nodeName, uint32 nodePort);
+extern void DeleteShardRow(int64 shardId);
 extern void DeleteShardPlacementRow(int64 shardPlacementId);
 extern void UpdateShardPlacementRowState(int64 shardPlacementId, ShardState newState);
 extern void LockShardData(int64 shardId, LOCKMODE lockMode);
 extern void LockShardDistributionMetadata(int64 shardId, LOCKMODE lockMode);
+extern void LockShardRelocation(int64 shardId);
 extern void LockRelationDistributionMetadata(Oid relationId, LOCKMODE lockMode);
 
 #endif /* PG_SHARD_DISTRIBUTION_METADATA_H */
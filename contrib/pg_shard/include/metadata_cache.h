@@ -0,0 +1,90 @@
+/*-------------------------------------------------------------------------
+ *
+ * include/metadata_cache.h
+ *
+ * Declarations for public functions and types related to caching of the
+ * distribution metadata in shared and backend-local memory.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_SHARD_METADATA_CACHE_H
+#define PG_SHARD_METADATA_CACHE_H
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+
+#include "distribution_metadata.h"
+
+#include "nodes/pg_list.h"
+#include "nodes/primnodes.h"
+#include "utils/palloc.h"
+
+
+/* maximum number of distributed tables tracked by the shared metadata cache */
+#define MAX_SHARED_CACHE_TABLES 1024
+
+/* number of backend-local cache entries to allocate initially */
+#define INITIAL_LOCAL_CACHE_SIZE 32
+
+
+/*
+ * DistTableCacheEntry holds the distribution metadata of a single table within
+ * a backend's local cache. Entries are created for tables which are not
+ * distributed as well, so repeated lookups for regular tables are cheap.
+ *
+ * The shard interval list keeps the order in which shards were loaded from the
+ * metadata tables. The shard interval array holds the same intervals sorted by
+ * their minimum values; if these intervals do not overlap, the array may be
+ * binary searched to find the single shard containing a given value.
+ */
+typedef struct DistTableCacheEntry
+{
+	Oid relationId;                 /* cache key */
+	bool isValid;                   /* false while (re)building the entry */
+	bool isDistributedTable;        /* true if a partition row exists */
+
+	char partitionMethod;           /* method used to partition the table */
+	Var *partitionColumn;           /* column used to partition the table */
+
+	List *shardIntervalList;        /* shard intervals in load order */
+	int shardIntervalArrayLength;   /* number of shard intervals */
+	ShardInterval **sortedShardIntervalArray; /* intervals sorted by min value */
+	bool hasDisjointShardIntervals; /* true if sorted intervals never overlap */
+	FmgrInfo *comparisonFunction;   /* btree comparison function for intervals */
+	Oid comparisonCollation;        /* collation to use with the function */
+
+	MemoryContext entryContext;     /* holds all memory used by the entry */
+} DistTableCacheEntry;
+
+
+/*
+ * ShardPlacementCacheEntry maps a shard identifier to the placements of that
+ * shard within a backend's local cache. These entries are only created while
+ * building the cache entry of the shard's table, and live in its memory.
+ */
+typedef struct ShardPlacementCacheEntry
+{
+	int64 shardId;              /* cache key */
+	Oid relationId;             /* id of the shard's distributed table */
+	List *shardPlacementList;   /* placements of the shard */
+} ShardPlacementCacheEntry;
+
+
+/* config variable managed via guc.c */
+extern int MetadataCacheSize;
+
+
+/* function declarations to initialize and access the metadata cache */
+extern void InitializeMetadataCache(void);
+extern DistTableCacheEntry * LookupDistTableCacheEntry(Oid relationId);
+extern List * LookupShardPlacementCacheList(int64 shardId);
+extern ShardInterval * FindShardIntervalByValue(DistTableCacheEntry *cacheEntry,
+												Datum partitionValue);
+extern Datum invalidate_distribution_metadata_cache(PG_FUNCTION_ARGS);
+
+
+#endif /* PG_SHARD_METADATA_CACHE_H */
@@ -0,0 +1,113 @@
+/*-------------------------------------------------------------------------
+ *
+ * include/move_shards.h
+ *
+ * Declarations for public functions and types to move and split shards while
+ * modifications to them continue.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_SHARD_MOVE_SHARDS_H
+#define PG_SHARD_MOVE_SHARDS_H
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "libpq-fe.h"
+
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+
+
+/* output plugin used to decode changes made to shards during a copy */
+#define SHARD_MOVE_OUTPUT_PLUGIN "test_decoding"
+
+/* catch-up rounds are repeated while they apply more changes than this */
+#define CATCH_UP_CHANGE_THRESHOLD 1000
+
+/* maximum number of catch-up rounds before blocking modifications */
+#define MAX_CATCH_UP_ROUNDS 16
+
+/* maximum number of decoded changes fetched from a slot at once */
+#define CATCH_UP_BATCH_SIZE 10000
+
+/* time to wait for copy data before checking for interrupts */
+#define COPY_POLL_TIMEOUT_MS 1000
+
+/* templates for SQL commands used during online shard copies */
+#define REPLICA_IDENTITY_QUERY "SELECT c.relreplident, quote_ident(ic.relname) " \
+							   "FROM pg_class c LEFT JOIN pg_index i ON " \
+							   "(i.indrelid = c.oid AND i.indisreplident) " \
+							   "LEFT JOIN pg_class ic ON (ic.oid = i.indexrelid) " \
+							   "WHERE c.oid = %s::regclass"
+#define REPLICA_IDENTITY_FULL_COMMAND "ALTER TABLE %s REPLICA IDENTITY FULL"
+#define REPLICA_IDENTITY_COMMAND "ALTER TABLE %s REPLICA IDENTITY %s"
+#define CREATE_LOGICAL_SLOT_COMMAND "CREATE_REPLICATION_SLOT %s LOGICAL %s"
+#define DROP_LOGICAL_SLOT_QUERY "SELECT pg_drop_replication_slot('%s')"
+#define BEGIN_REPEATABLE_READ_COMMAND "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ"
+#define SET_SNAPSHOT_COMMAND "SET TRANSACTION SNAPSHOT %s"
+#define COPY_OUT_COMMAND "COPY %s TO STDOUT"
+#define COPY_OUT_HASH_RANGE_COMMAND "COPY (SELECT * FROM %s WHERE %s(%s) " \
+									"BETWEEN %d AND %d) TO STDOUT"
+#define COPY_IN_COMMAND "COPY %s FROM STDIN"
+#define GET_SLOT_CHANGES_QUERY "SELECT data FROM pg_logical_slot_get_changes('%s', " \
+							   "NULL, %d)"
+
+/* slot names may only contain lowercase letters, digits, and underscores */
+#define LOGICAL_SLOT_NAME_FORMAT "pg_shard_copy_" INT64_FORMAT "_%d"
+
+
+/*
+ * OnlineCopyTarget describes a shard placement being built from the rows of a
+ * source placement. When rows are filtered, only those whose partition column
+ * hashes into the target's token range are copied; this is used to split hash
+ * partitioned shards.
+ */
+typedef struct OnlineCopyTarget
+{
+	int64 shardId;              /* id of the shard being built */
+	char *shardName;            /* unquoted name of the shard's table */
+	char *nodeName;             /* node on which the placement is built */
+	int32 nodePort;             /* port of that node */
+	bool filterRows;            /* true if only a hash token range is copied */
+	int32 minHashToken;         /* smallest hash token copied, if filtering */
+	int32 maxHashToken;         /* largest hash token copied, if filtering */
+
+	PGconn *copyOutConnection;  /* reads rows from the source placement */
+	PGconn *connection;         /* writes rows into the new placement */
+	bool copyDone;              /* true once all snapshot rows were copied */
+	StringInfo changeBatch;     /* statements applying the current changes */
+	int changeCount;            /* number of statements in the batch */
+} OnlineCopyTarget;
+
+
+/*
+ * OnlineCopySource describes a placement whose rows are copied to one or more
+ * targets. A logical replication slot on its node captures all modifications
+ * made after the snapshot the copy uses, so they can be applied afterwards.
+ */
+typedef struct OnlineCopySource
+{
+	int64 shardId;                  /* id of the shard being copied */
+	char *shardName;                /* unquoted name of the shard's table */
+	char *nodeName;                 /* node holding the source placement */
+	int32 nodePort;                 /* port of that node */
+	List *targetList;               /* OnlineCopyTarget list */
+	char *resetIdentityCommand;     /* restores the original replica identity */
+
+	char slotName[NAMEDATALEN];     /* name of the slot capturing changes */
+	bool slotCreated;               /* true once the slot exists */
+	PGconn *replicationConnection;  /* exports the snapshot used for copying */
+	PGconn *connection;             /* fetches decoded changes from the slot */
+} OnlineCopySource;
+
+
+/* function declarations for online shard movement */
+extern Datum master_move_shard_placement(PG_FUNCTION_ARGS);
+extern Datum master_split_shard(PG_FUNCTION_ARGS);
+
+
+#endif /* PG_SHARD_MOVE_SHARDS_H */
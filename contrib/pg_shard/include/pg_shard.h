@@ -16,6 +16,7 @@
 
 #include "access/tupdesc.h"
 #include "catalog/indexing.h"
+#include "nodes/params.h"
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
 #include "nodes/plannodes.h"
@@ -74,6 +75,18 @@ typedef struct DistributedPlan
 
 	bool selectFromMultipleShards; /* does the select run across multiple shards? */
 	CreateStmt *createTemporaryTableStmt; /* valid for multiple shard selects */
+
+	/*
+	 * Generic plans of prepared statements still reference unbound parameters
+	 * and so cannot select shards at planning time. Such plans are templates:
+	 * their task list holds one task per shard (with an empty placement list)
+	 * whose query string refers to parameters as $n placeholders, and shard
+	 * selection happens when the plan is bound to parameter values at the
+	 * start of execution.
+	 */
+	Query *parameterizedQuery; /* planned query, valid for plan templates only */
+	Query *originalQuery;      /* unplanned query, used to replan when needed */
+	int cursorOptions;         /* cursor options used when replanning */
 } DistributedPlan;
 
 
@@ -89,6 +102,7 @@ typedef struct Task
 	StringInfo queryString;     /* SQL string suitable for immediate remote execution */
 	List *taskPlacementList;    /* ShardPlacements on which the task can be executed */
 	int64 shardId;              /* Denormalized shardId of tasks for convenience */
+	ParamListInfo boundParams;  /* values for $n placeholders in query, if any */
 } Task;
 
 
@@ -16,6 +16,8 @@
 #include "postgres.h"
 #include "fmgr.h"
 
+#include "nodes/pg_list.h"
+
 
 /* templates for SQL commands used during shard placement repair */
 #define DROP_REGULAR_TABLE_COMMAND "DROP TABLE IF EXISTS %s"
@@ -25,6 +27,7 @@
 
 
 /* function declarations for shard repair functionality */
+extern List * RecreateTableDDLCommandList(Oid relationId, int64 shardId);
 extern Datum master_copy_shard_placement(PG_FUNCTION_ARGS);
 extern Datum worker_copy_shard_placement(PG_FUNCTION_ARGS);
 
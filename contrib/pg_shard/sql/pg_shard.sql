@@ -9,6 +9,12 @@ RETURNS text
 AS 'MODULE_PATHNAME'
 LANGUAGE C STABLE STRICT;
 
+-- needed by triggers on our metadata tables
+CREATE FUNCTION invalidate_distribution_metadata_cache()
+RETURNS trigger
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
 DO $$
 DECLARE
 	use_citus_metadata boolean := false;
@@ -182,6 +188,20 @@ BEGIN
 			'pgs_distribution_metadata.shard_placement', '');
 		PERFORM pg_catalog.pg_extension_config_dump(
 			'pgs_distribution_metadata.partition', '');
+
+		-- drop cached metadata of distributed tables whose metadata changes
+		CREATE TRIGGER partition_cache_invalidate
+			AFTER INSERT OR UPDATE OR DELETE ON pgs_distribution_metadata.partition
+			FOR EACH ROW
+			EXECUTE PROCEDURE invalidate_distribution_metadata_cache('relation_id');
+		CREATE TRIGGER shard_cache_invalidate
+			AFTER INSERT OR UPDATE OR DELETE ON pgs_distribution_metadata.shard
+			FOR EACH ROW
+			EXECUTE PROCEDURE invalidate_distribution_metadata_cache('relation_id');
+		CREATE TRIGGER shard_placement_cache_invalidate
+			AFTER INSERT OR UPDATE OR DELETE ON pgs_distribution_metadata.shard_placement
+			FOR EACH ROW
+			EXECUTE PROCEDURE invalidate_distribution_metadata_cache('shard_id');
 	END IF;
 END;
 $$;
@@ -215,6 +235,20 @@ RETURNS void
 AS 'MODULE_PATHNAME'
 LANGUAGE C STRICT;
 
+CREATE FUNCTION master_move_shard_placement(shard_id bigint,
+											source_node_name text,
+											source_node_port integer,
+											target_node_name text,
+											target_node_port integer)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION master_split_shard(shard_id bigint, split_value integer)
+RETURNS bigint[]
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
 CREATE FUNCTION partition_column_to_node_string(table_oid oid)
 RETURNS text
 AS 'MODULE_PATHNAME'
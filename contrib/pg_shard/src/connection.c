@@ -19,6 +19,7 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "access/hash.h"
 #include "commands/dbcommands.h"
 #include "lib/stringinfo.h"
 #include "mb/pg_wchar.h"
@@ -36,10 +37,27 @@
  */
 static HTAB *NodeConnectionHash = NULL;
 
+/*
+ * PreparedStatementHash tracks statements prepared on cached connections. It
+ * is created by the first call to PrepareRemoteStatement.
+ */
+static HTAB *PreparedStatementHash = NULL;
+
+/* counter used to generate unique names for remote prepared statements */
+static uint32 PreparedStatementCounter = 0;
+
 
 /* local function forward declarations */
 static HTAB * CreateNodeConnectionHash(void);
-static PGconn * ConnectToNode(char *nodeName, char *nodePort);
+static HTAB * CreatePreparedStatementHash(void);
+static uint32 PreparedStatementHashValue(const char *queryString, int parameterCount,
+										 const Oid *parameterTypes);
+static bool PreparedStatementMatches(PreparedStatementEntry *preparedStatementEntry,
+									 const char *queryString, int parameterCount,
+									 const Oid *parameterTypes);
+static void PurgePreparedStatements(PGconn *connection);
+static PGconn * ConnectToNode(char *nodeName, char *nodePort, const char *databaseName,
+							   const char *clientEncoding, bool replication);
 static char * ConnectionGetOptionValue(PGconn *connection, char *optionKeyword);
 
 
@@ -102,7 +120,9 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 		StringInfo nodePortString = makeStringInfo();
 		appendStringInfo(nodePortString, "%d", nodePort);
 
-		connection = ConnectToNode(nodeName, nodePortString->data);
+		connection = ConnectToNode(nodeName, nodePortString->data,
+								   get_database_name(MyDatabaseId),
+								   GetDatabaseEncodingName(), false);
 		if (connection != NULL)
 		{
 			nodeConnectionEntry = hash_search(NodeConnectionHash, &nodeConnectionKey,
@@ -115,6 +135,72 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 }
 
 
+/*
+ * OpenNodeConnection establishes a new connection to the specified node which
+ * is not tracked by the connection hash; the caller is responsible for closing
+ * it using PQfinish. If replication is true, the connection uses the streaming
+ * replication protocol in database mode, which allows it to create logical
+ * replication slots. This function returns NULL if no connection could be
+ * established.
+ */
+PGconn *
+OpenNodeConnection(char *nodeName, int32 nodePort, bool replication)
+{
+	StringInfo nodePortString = makeStringInfo();
+
+	if (strnlen(nodeName, MAX_NODE_LENGTH + 1) > MAX_NODE_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hostname exceeds the maximum length of %d",
+							   MAX_NODE_LENGTH)));
+	}
+
+	appendStringInfo(nodePortString, "%d", nodePort);
+
+	return ConnectToNode(nodeName, nodePortString->data,
+						 get_database_name(MyDatabaseId), GetDatabaseEncodingName(),
+						 replication);
+}
+
+
+/*
+ * StartDatabaseConnection starts to establish a new connection to the specified
+ * database on a node, using the given client encoding. Like OpenNodeConnection,
+ * it does not track the connection, but it needs no access to the local
+ * database, so processes serving other backends may use it on their behalf.
+ * The function returns without waiting for the connection to be made; callers
+ * complete it using PQconnectPoll, and have to enforce a connect timeout as
+ * libpq ignores it for such connections. If the connection could not even be
+ * started, its status is CONNECTION_BAD.
+ */
+PGconn *
+StartDatabaseConnection(char *nodeName, int32 nodePort, const char *databaseName,
+						const char *clientEncoding)
+{
+	char nodePortString[MAX_PORT_LENGTH + 1];
+
+	const char *keywordArray[] = {
+		"host", "port", "fallback_application_name", "client_encoding", "dbname", NULL
+	};
+	const char *valueArray[] = {
+		nodeName, nodePortString, "pg_shard", clientEncoding, databaseName, NULL
+	};
+
+	Assert(sizeof(keywordArray) == sizeof(valueArray));
+
+	if (strnlen(nodeName, MAX_NODE_LENGTH + 1) > MAX_NODE_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hostname exceeds the maximum length of %d",
+							   MAX_NODE_LENGTH)));
+	}
+
+	snprintf(nodePortString, sizeof(nodePortString), "%d", nodePort);
+
+	return PQconnectStartParams(keywordArray, valueArray, false);
+}
+
+
 /*
  * PurgeConnection removes the given connection from the connection hash and
  * closes it using PQfinish. If our hash does not contain the given connection,
@@ -150,6 +236,8 @@ PurgeConnection(PGconn *connection)
 	pfree(nodeNameString);
 	pfree(nodePortString);
 
+	PurgePreparedStatements(connection);
+
 	nodeConnectionEntry = hash_search(NodeConnectionHash, &nodeConnectionKey,
 									  HASH_REMOVE, &entryFound);
 	if (entryFound)
@@ -166,6 +254,7 @@ PurgeConnection(PGconn *connection)
 									 "connection than that provided by caller",
 									 nodeConnectionKey.nodeName,
 									 nodeConnectionKey.nodePort)));
+			PurgePreparedStatements(nodeConnectionEntry->connection);
 			PQfinish(nodeConnectionEntry->connection);
 		}
 	}
@@ -231,6 +320,104 @@ ReportRemoteError(PGconn *connection, PGresult *result)
 }
 
 
+/*
+ * PrepareRemoteStatement returns the name of a statement prepared on the given
+ * connection which executes the provided query string. The statement is only
+ * prepared on the first request for a given query string and set of parameter
+ * types; later requests reuse it, so repeated executions of the same query
+ * need neither be parsed nor planned again by the remote server.
+ *
+ * If the statement cannot be prepared, this function reports the remote error
+ * at the WARNING level and returns NULL.
+ */
+char *
+PrepareRemoteStatement(PGconn *connection, const char *queryString,
+					   int parameterCount, const Oid *parameterTypes)
+{
+	PreparedStatementKey preparedStatementKey;
+	PreparedStatementEntry *preparedStatementEntry = NULL;
+	PGresult *result = NULL;
+	char *statementName = NULL;
+	bool entryFound = false;
+
+	/* if first call, initialize the prepared statement hash */
+	if (PreparedStatementHash == NULL)
+	{
+		PreparedStatementHash = CreatePreparedStatementHash();
+	}
+
+	memset(&preparedStatementKey, 0, sizeof(preparedStatementKey));
+	preparedStatementKey.connection = connection;
+	preparedStatementKey.queryHash = PreparedStatementHashValue(queryString,
+																parameterCount,
+																parameterTypes);
+
+	preparedStatementEntry = hash_search(PreparedStatementHash, &preparedStatementKey,
+										 HASH_ENTER, &entryFound);
+	if (entryFound)
+	{
+		if (PreparedStatementMatches(preparedStatementEntry, queryString,
+									 parameterCount, parameterTypes))
+		{
+			return preparedStatementEntry->statementName;
+		}
+
+		/*
+		 * Another query hashed to the same key. This is rare enough that we
+		 * simply fall back to the unnamed statement, which the remote server
+		 * replaces on each use.
+		 */
+		statementName = "";
+	}
+	else
+	{
+		/* start with an empty name so failures below leave no usable entry */
+		preparedStatementEntry->statementName[0] = '\0';
+		preparedStatementEntry->queryString = NULL;
+		preparedStatementEntry->parameterCount = 0;
+		preparedStatementEntry->parameterTypes = NULL;
+
+		PreparedStatementCounter++;
+		snprintf(preparedStatementEntry->statementName, NAMEDATALEN,
+				 "pg_shard_statement_%u", PreparedStatementCounter);
+
+		statementName = preparedStatementEntry->statementName;
+	}
+
+	result = PQprepare(connection, statementName, queryString, parameterCount,
+					   parameterTypes);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportRemoteError(connection, result);
+		PQclear(result);
+
+		if (!entryFound)
+		{
+			hash_search(PreparedStatementHash, &preparedStatementKey, HASH_REMOVE, NULL);
+		}
+
+		return NULL;
+	}
+
+	PQclear(result);
+
+	if (!entryFound)
+	{
+		Size parameterTypesSize = parameterCount * sizeof(Oid);
+
+		preparedStatementEntry->queryString =
+			MemoryContextStrdup(CacheMemoryContext, queryString);
+		preparedStatementEntry->parameterCount = parameterCount;
+		preparedStatementEntry->parameterTypes =
+			MemoryContextAlloc(CacheMemoryContext, Max(parameterTypesSize, 1));
+		memcpy(preparedStatementEntry->parameterTypes, parameterTypes,
+			   parameterTypesSize);
+	}
+
+	return statementName;
+}
+
+
 /*
  * CreateNodeConnectionHash returns a newly created hash table suitable for
  * storing unlimited connections indexed by node name and port.
@@ -256,28 +443,142 @@ CreateNodeConnectionHash(void)
 
 
 /*
- * ConnectToNode opens a connection to a remote PostgreSQL server. The function
- * configures the connection's fallback application name to 'pg_shard' and sets
- * the remote encoding to match the local one. This function requires that the
- * port be specified as a string for easier use with libpq functions.
+ * CreatePreparedStatementHash returns a newly created hash table suitable for
+ * tracking statements prepared on remote connections.
+ */
+static HTAB *
+CreatePreparedStatementHash(void)
+{
+	HTAB *preparedStatementHash = NULL;
+	HASHCTL info;
+	int hashFlags = 0;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(PreparedStatementKey);
+	info.entrysize = sizeof(PreparedStatementEntry);
+	info.hash = tag_hash;
+	info.hcxt = CacheMemoryContext;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	preparedStatementHash = hash_create("pg_shard prepared statements", 64, &info,
+										hashFlags);
+
+	return preparedStatementHash;
+}
+
+
+/*
+ * PreparedStatementHashValue computes a hash over a query string and the types
+ * of its parameters, for use in a PreparedStatementKey.
+ */
+static uint32
+PreparedStatementHashValue(const char *queryString, int parameterCount,
+						   const Oid *parameterTypes)
+{
+	uint32 queryHash = DatumGetUInt32(hash_any((const unsigned char *) queryString,
+											   strlen(queryString)));
+
+	if (parameterCount > 0)
+	{
+		uint32 typesHash = DatumGetUInt32(hash_any((const unsigned char *) parameterTypes,
+												   parameterCount * sizeof(Oid)));
+
+		queryHash ^= typesHash;
+	}
+
+	return queryHash;
+}
+
+
+/*
+ * PreparedStatementMatches returns whether the given prepared statement entry
+ * was prepared for exactly the provided query string and parameter types.
+ */
+static bool
+PreparedStatementMatches(PreparedStatementEntry *preparedStatementEntry,
+						 const char *queryString, int parameterCount,
+						 const Oid *parameterTypes)
+{
+	if (preparedStatementEntry->parameterCount != parameterCount)
+	{
+		return false;
+	}
+
+	if (strcmp(preparedStatementEntry->queryString, queryString) != 0)
+	{
+		return false;
+	}
+
+	return (memcmp(preparedStatementEntry->parameterTypes, parameterTypes,
+				   parameterCount * sizeof(Oid)) == 0);
+}
+
+
+/*
+ * PurgePreparedStatements forgets all statements prepared on the given
+ * connection. It is called before a connection is closed, as the statements
+ * cease to exist along with the remote session.
+ */
+static void
+PurgePreparedStatements(PGconn *connection)
+{
+	HASH_SEQ_STATUS status;
+	PreparedStatementEntry *preparedStatementEntry = NULL;
+
+	if (PreparedStatementHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, PreparedStatementHash);
+
+	while ((preparedStatementEntry = hash_seq_search(&status)) != NULL)
+	{
+		if (preparedStatementEntry->cacheKey.connection != connection)
+		{
+			continue;
+		}
+
+		if (preparedStatementEntry->queryString != NULL)
+		{
+			pfree(preparedStatementEntry->queryString);
+		}
+
+		if (preparedStatementEntry->parameterTypes != NULL)
+		{
+			pfree(preparedStatementEntry->parameterTypes);
+		}
+
+		hash_search(PreparedStatementHash, &preparedStatementEntry->cacheKey,
+					HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * ConnectToNode opens a connection to a database on a remote PostgreSQL server.
+ * The function configures the connection's fallback application name to
+ * 'pg_shard' and sets the remote encoding as requested. This function requires
+ * that the port be specified as a string for easier use with libpq functions.
+ * If asked to, the connection is made in logical replication (database) mode.
  *
  * We attempt to connect up to MAX_CONNECT_ATTEMPT times. After that we give up
  * and return NULL.
  */
 static PGconn *
-ConnectToNode(char *nodeName, char *nodePort)
+ConnectToNode(char *nodeName, char *nodePort, const char *databaseName,
+			  const char *clientEncoding, bool replication)
 {
 	PGconn *connection = NULL;
-	const char *clientEncoding = GetDatabaseEncodingName();
-	const char *dbname = get_database_name(MyDatabaseId);
 
 	const char *keywordArray[] = {
 		"host", "port", "fallback_application_name",
-		"client_encoding", "connect_timeout", "dbname", NULL
+		"client_encoding", "connect_timeout", "dbname", "replication", NULL
 	};
 	const char *valueArray[] = {
 		nodeName, nodePort, "pg_shard", clientEncoding,
-		CLIENT_CONNECT_TIMEOUT_SECONDS, dbname, NULL
+		CLIENT_CONNECT_TIMEOUT_SECONDS, databaseName, (replication ? "database" : NULL),
+		NULL
 	};
 
 	Assert(sizeof(keywordArray) == sizeof(valueArray));
@@ -0,0 +1,1953 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/connection_broker.c
+ *
+ * This file contains the connection broker, a background worker which runs
+ * commands on worker nodes on behalf of backends. Without the broker, every
+ * backend keeps its own connection to every worker node it has accessed, so
+ * the number of connections each worker has to serve grows with the number of
+ * backends on the master. The broker instead keeps a pool of connections per
+ * worker node and multiplexes the commands of all backends over them.
+ *
+ * Backends talk to the broker through pairs of message queues in shared
+ * memory. A backend takes a free slot, sends a request holding a batch of
+ * commands, and waits for the response holding their results. Connections
+ * are normally returned to the pool as soon as a command completes. Requests
+ * may however ask for the connections to be pinned to the backend instead;
+ * these connections then run all later commands of the backend until it
+ * releases its slot at the end of its transaction. This gives distributed
+ * transactions the affinity they need to remote transactions.
+ *
+ * The broker never blocks on a single node: new connections are made without
+ * waiting for them, and the broker sleeps until any of its latch, the sockets
+ * of busy connections, or its own wakeup pipe become ready. An error while
+ * serving a backend only fails that backend's request.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "connection.h"
+#include "connection_broker.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "access/xact.h"
+#include "commands/dbcommands.h"
+#include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
+#include "mb/pg_wchar.h"
+#include "nodes/pg_list.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/postmaster.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/pmsignal.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+#include "utils/errcodes.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+#include "utils/timestamp.h"
+
+
+/*
+ * BrokerSlotState tracks the use of a slot. A backend claims a free slot, sets
+ * up its queues, and then activates it. Once the backend detached from the
+ * queues, the broker frees the slot again. If the broker exits before noticing,
+ * whichever of the broker's exit handler and the backend comes last frees it.
+ */
+typedef enum
+{
+	BROKER_SLOT_FREE = 0,
+	BROKER_SLOT_CLAIMED = 1,
+	BROKER_SLOT_ACTIVE = 2,
+	BROKER_SLOT_DETACHED = 3
+} BrokerSlotState;
+
+
+/*
+ * BrokerSlot describes one pair of message queues through which a backend
+ * sends requests to the broker and receives responses. The queues themselves
+ * follow the slot array in shared memory.
+ */
+typedef struct BrokerSlot
+{
+	BrokerSlotState state;  /* how far the slot is in use */
+	pid_t backendPid;       /* process id of the backend using the slot */
+	pid_t brokerPid;        /* broker serving the slot, 0 if it exited */
+} BrokerSlot;
+
+
+/*
+ * BrokerControl is the shared state of the connection broker. The mutex
+ * protects all fields but the slot count, which never changes.
+ */
+typedef struct BrokerControl
+{
+	slock_t mutex;          /* protects the fields below */
+	pid_t brokerPid;        /* process id of the broker, 0 if not running */
+	PGPROC *brokerProc;     /* process of the broker, to wake it up */
+	int slotCount;          /* number of slots in the array */
+	BrokerSlot slots[FLEXIBLE_ARRAY_MEMBER];
+} BrokerControl;
+
+
+/*
+ * PooledConnection is a connection owned by the broker. While a command runs
+ * on it, or while it is pinned to a backend, the connection is owned by that
+ * backend's slot; otherwise it is idle and may serve any backend which needs a
+ * connection to the same node and database.
+ */
+typedef struct PooledConnection
+{
+	char nodeName[MAX_NODE_LENGTH + 1]; /* node the connection is made to */
+	int32 nodePort;                     /* port of that node */
+	char databaseName[NAMEDATALEN];     /* database the connection is made to */
+	char clientEncoding[NAMEDATALEN];   /* encoding used by the connection */
+	PGconn *connection;                 /* the connection itself */
+	int ownerSlot;                      /* slot owning the connection, or -1 */
+	bool pinned;                        /* true if kept until the slot is freed */
+	bool busy;                          /* true while a command runs on it */
+	bool connecting;                    /* true until the connection is made */
+	PostgresPollingStatusType pollingStatus; /* what a new connection waits for */
+	TimestampTz connectStartTime;       /* when making the connection started */
+} PooledConnection;
+
+
+/* BrokerTask tracks the execution of one command of a request in the broker */
+typedef struct BrokerTask
+{
+	BrokerCommand command;              /* command to run */
+	PooledConnection *pooledConnection; /* connection running it, once started */
+	bool started;                       /* true once the command was sent */
+	bool done;                          /* true once the command completed */
+	int connectAttempts;                /* number of connections made for it */
+	PGresult *result;                   /* last (or first failed) result */
+	char *failureMessage;               /* set if the command could not be sent */
+} BrokerTask;
+
+
+/* BrokerClient is the broker's state for a backend using one of the slots */
+typedef struct BrokerClient
+{
+	bool attached;                  /* true while serving a backend */
+	MemoryContext clientContext;    /* holds queue handles and requests */
+	MemoryContext requestContext;   /* holds the current request's state */
+	shm_mq_handle *requestHandle;   /* queue the backend sends requests on */
+	shm_mq_handle *responseHandle;  /* queue the broker sends responses on */
+
+	bool requestActive;             /* true while running a request's commands */
+	bool requestFailed;             /* true once an error aborted the request */
+	bool pinConnections;            /* true if the request pins connections */
+	char *databaseName;             /* database of the requesting backend */
+	char *clientEncoding;           /* encoding of the requesting backend */
+	int taskCount;                  /* number of commands in the request */
+	BrokerTask *taskArray;          /* state of those commands */
+
+	bool responsePending;           /* true until the response was sent */
+	StringInfo response;            /* response being sent */
+} BrokerClient;
+
+
+/* config variable managed via guc.c to enable the broker */
+int ConnectionBrokerSlots = 0;
+
+/* config variable managed via guc.c to limit the broker's idle connections */
+int ConnectionBrokerPoolSize = 8;
+
+/* config variable managed via guc.c to let backends bypass the broker */
+bool UseConnectionBroker = true;
+
+/* shared memory state, which remains unset unless the broker is enabled */
+static BrokerControl *Broker = NULL;
+static char *BrokerQueueArea = NULL;
+static shmem_startup_hook_type PreviousShmemStartupHook = NULL;
+
+/* state of a backend using the broker */
+static int ClientSlotIndex = -1;
+static pid_t ClientBrokerPid = 0;
+static shm_mq_handle *ClientRequestHandle = NULL;
+static shm_mq_handle *ClientResponseHandle = NULL;
+static MemoryContext BrokerClientContext = NULL;
+static bool ClientPinsConnections = false;
+static bool ClientLostPinnedConnections = false;
+static bool ClientExitCallbackSet = false;
+
+/* state of the broker itself */
+static volatile sig_atomic_t BrokerGotSigterm = false;
+static volatile sig_atomic_t BrokerGotSighup = false;
+static int BrokerWakeupPipe[2] = { -1, -1 };
+static BrokerClient *BrokerClientArray = NULL;
+static List *ConnectionPool = NIL;
+
+
+/* local function forward declarations */
+static Size ConnectionBrokerShmemSize(void);
+static void ConnectionBrokerShmemStartup(void);
+static shm_mq * BrokerRequestQueue(int slotIndex);
+static shm_mq * BrokerResponseQueue(int slotIndex);
+static bool AcquireBrokerSlot(void);
+static void ReleaseBrokerSlot(void);
+static void BrokerClientShmemExit(int code, Datum argument);
+static void BrokerXactCallback(XactEvent event, void *argument);
+static bool WaitForBroker(void);
+static StringInfo BuildRequest(List *brokerCommandList, bool pinConnections);
+static List * ParseResponse(char *responseData, Size responseSize, int commandCount);
+static List * FailedResultList(int commandCount, char *errorMessage);
+static void SendString(StringInfo buffer, const char *string);
+static char * GetString(StringInfo buffer);
+static void BrokerSigtermHandler(SIGNAL_ARGS);
+static void BrokerSighupHandler(SIGNAL_ARGS);
+static void BrokerSigusr1Handler(SIGNAL_ARGS);
+static void WakeBroker(void);
+static void BrokerShmemExit(int code, Datum argument);
+static void AttachNewClients(void);
+static void ServeClientSafely(int slotIndex);
+static void ServeClient(int slotIndex);
+static void FailRequest(BrokerClient *client, char *errorMessage);
+static void ParseRequest(BrokerClient *client, char *requestData, Size requestSize);
+static void StartTasks(int slotIndex);
+static bool SendTask(int slotIndex, BrokerTask *task);
+static bool StartConnection(int slotIndex, BrokerTask *task);
+static bool AdvanceConnection(int slotIndex, BrokerTask *task);
+static void PollTasks(int slotIndex);
+static void FinishTask(BrokerClient *client, BrokerTask *task, bool keepConnection);
+static StringInfo BuildResponse(BrokerClient *client);
+static void DetachClient(int slotIndex);
+static PooledConnection * FindPooledConnection(int ownerSlot, BrokerCommand *command,
+											   char *databaseName, char *clientEncoding);
+static void ClosePooledConnection(PooledConnection *pooledConnection);
+static void TrimConnectionPool(void);
+static void WaitForBrokerEvents(void);
+
+
+/*
+ * InitializeConnectionBroker defines the broker's configuration variables. If
+ * pg_shard is being loaded through shared_preload_libraries and the broker is
+ * enabled, it also requests the shared memory for the broker's message queues
+ * and registers the broker as a background worker.
+ */
+void
+InitializeConnectionBroker(void)
+{
+	DefineCustomIntVariable("pg_shard.connection_broker_slots",
+							"Sets the number of backends which may use the connection "
+							"broker at once",
+							"Zero disables the connection broker.",
+							&ConnectionBrokerSlots, 0, 0, MAX_BACKENDS, PGC_POSTMASTER, 0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pg_shard.connection_broker_pool_size",
+							"Sets the maximum number of idle connections the connection "
+							"broker keeps per worker node", NULL,
+							&ConnectionBrokerPoolSize, 8, 0, INT_MAX, PGC_SIGHUP, 0, NULL,
+							NULL, NULL);
+
+	DefineCustomBoolVariable("pg_shard.use_connection_broker",
+							 "Runs remote commands through the connection broker if it "
+							 "is running", NULL, &UseConnectionBroker, true, PGC_USERSET,
+							 0, NULL, NULL, NULL);
+
+	if (process_shared_preload_libraries_in_progress && ConnectionBrokerSlots > 0)
+	{
+		BackgroundWorker worker;
+
+		RequestAddinShmemSpace(ConnectionBrokerShmemSize());
+
+		PreviousShmemStartupHook = shmem_startup_hook;
+		shmem_startup_hook = ConnectionBrokerShmemStartup;
+
+		memset(&worker, 0, sizeof(worker));
+		snprintf(worker.bgw_name, BGW_MAXLEN, "pg_shard connection broker");
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = BROKER_RESTART_SECONDS;
+		worker.bgw_main = NULL;
+		snprintf(worker.bgw_library_name, BGW_MAXLEN, "pg_shard");
+		snprintf(worker.bgw_function_name, BGW_MAXLEN, "ConnectionBrokerMain");
+
+		RegisterBackgroundWorker(&worker);
+	}
+
+	RegisterXactCallback(BrokerXactCallback, NULL);
+}
+
+
+/*
+ * ConnectionBrokerAvailable returns whether the current backend can run its
+ * remote commands through the broker. This requires the broker to be running
+ * and a free slot to talk to it. If all slots are taken, callers are expected
+ * to fall back to their own connections rather than wait for one to be freed,
+ * as the backends holding the slots might in turn wait for them.
+ */
+bool
+ConnectionBrokerAvailable(void)
+{
+	if (Broker == NULL || !UseConnectionBroker || !IsUnderPostmaster)
+	{
+		return false;
+	}
+
+	if (ClientSlotIndex >= 0)
+	{
+		return true;
+	}
+
+	return AcquireBrokerSlot();
+}
+
+
+/*
+ * BrokerExecuteCommandList runs the given list of commands through the broker
+ * and returns a list holding the result of each. Commands run concurrently on
+ * distinct connections, except for commands to a node to which a connection
+ * is already pinned; these run on that connection one after the other. If the
+ * connections are to be pinned, they run all later commands of this backend to
+ * their nodes until the current transaction ends.
+ *
+ * Failures to talk to the broker are not raised as errors, as this function is
+ * also used to finish remote transactions at commit; instead, all commands are
+ * reported as failed.
+ */
+List *
+BrokerExecuteCommandList(List *brokerCommandList, bool pinConnections)
+{
+	int commandCount = list_length(brokerCommandList);
+	StringInfo request = NULL;
+	List *resultList = NIL;
+	shm_mq_result queueResult = SHM_MQ_SUCCESS;
+	Size responseSize = 0;
+	void *responseData = NULL;
+
+	if (ClientLostPinnedConnections)
+	{
+		return FailedResultList(commandCount, "connection broker exited during the "
+											  "transaction");
+	}
+
+	if (ClientSlotIndex < 0 && !ConnectionBrokerAvailable())
+	{
+		return FailedResultList(commandCount, "connection broker is not available");
+	}
+
+	request = BuildRequest(brokerCommandList, pinConnections);
+	if (pinConnections)
+	{
+		ClientPinsConnections = true;
+	}
+
+	for (;;)
+	{
+		queueResult = shm_mq_send(ClientRequestHandle, request->len, request->data, true);
+		if (queueResult != SHM_MQ_WOULD_BLOCK || !WaitForBroker())
+		{
+			break;
+		}
+	}
+
+	if (queueResult == SHM_MQ_SUCCESS)
+	{
+		for (;;)
+		{
+			queueResult = shm_mq_receive(ClientResponseHandle, &responseSize,
+										 &responseData, true);
+			if (queueResult != SHM_MQ_WOULD_BLOCK || !WaitForBroker())
+			{
+				break;
+			}
+		}
+	}
+
+	if (queueResult == SHM_MQ_SUCCESS)
+	{
+		resultList = ParseResponse((char *) responseData, responseSize, commandCount);
+	}
+	else
+	{
+		resultList = FailedResultList(commandCount, "lost connection to connection "
+													"broker");
+
+		ClientLostPinnedConnections = ClientPinsConnections;
+		ReleaseBrokerSlot();
+	}
+
+	if (ClientSlotIndex >= 0 && !ClientPinsConnections)
+	{
+		ReleaseBrokerSlot();
+	}
+
+	return resultList;
+}
+
+
+/*
+ * BrokerExecuteCommand runs a single command through the broker and returns its
+ * result. See BrokerExecuteCommandList for details.
+ */
+BrokerResult *
+BrokerExecuteCommand(BrokerCommand *brokerCommand, bool pinConnections)
+{
+	List *resultList = BrokerExecuteCommandList(list_make1(brokerCommand),
+												pinConnections);
+
+	return (BrokerResult *) linitial(resultList);
+}
+
+
+/*
+ * BrokerResultGetValue returns the value at the given row and column of the
+ * result, or NULL if the value is null.
+ */
+char *
+BrokerResultGetValue(BrokerResult *brokerResult, int rowIndex, int columnIndex)
+{
+	Assert(rowIndex < brokerResult->rowCount);
+	Assert(columnIndex < brokerResult->columnCount);
+
+	return brokerResult->valueArray[rowIndex * brokerResult->columnCount + columnIndex];
+}
+
+
+/*
+ * ReportBrokerError reports the failure of a command run through the broker at
+ * the WARNING level, in the same form ReportRemoteError uses for commands run
+ * on a backend's own connections.
+ */
+void
+ReportBrokerError(BrokerCommand *brokerCommand, BrokerResult *brokerResult)
+{
+	char *sqlStateString = brokerResult->sqlState;
+	char *remoteMessage = brokerResult->errorMessage;
+	char *errorPrefix = "Connection failed to";
+	int sqlState = ERRCODE_CONNECTION_FAILURE;
+
+	if (sqlStateString != NULL && strlen(sqlStateString) == 5)
+	{
+		sqlState = MAKE_SQLSTATE(sqlStateString[0], sqlStateString[1], sqlStateString[2],
+								 sqlStateString[3], sqlStateString[4]);
+
+		/* use more specific error prefix for result failures */
+		if (sqlState != ERRCODE_CONNECTION_FAILURE)
+		{
+			errorPrefix = "Bad result from";
+		}
+	}
+
+	if (remoteMessage == NULL)
+	{
+		remoteMessage = "";
+	}
+
+	ereport(WARNING, (errcode(sqlState),
+					  errmsg("%s %s:%d", errorPrefix, brokerCommand->nodeName,
+							 brokerCommand->nodePort),
+					  errdetail("Remote message: %s", remoteMessage)));
+}
+
+
+/*
+ * ConnectionBrokerShmemSize returns the amount of shared memory required by the
+ * broker's slots and message queues.
+ */
+static Size
+ConnectionBrokerShmemSize(void)
+{
+	Size controlSize = add_size(offsetof(BrokerControl, slots),
+								mul_size(ConnectionBrokerSlots, sizeof(BrokerSlot)));
+	Size queueSize = mul_size(mul_size(ConnectionBrokerSlots, 2), BROKER_QUEUE_SIZE);
+
+	return add_size(MAXALIGN(controlSize), queueSize);
+}
+
+
+/*
+ * ConnectionBrokerShmemStartup allocates and initializes the broker's shared
+ * state, or attaches to it if it already exists.
+ */
+static void
+ConnectionBrokerShmemStartup(void)
+{
+	Size controlSize = add_size(offsetof(BrokerControl, slots),
+								mul_size(ConnectionBrokerSlots, sizeof(BrokerSlot)));
+	bool alreadyInitialized = false;
+
+	if (PreviousShmemStartupHook != NULL)
+	{
+		PreviousShmemStartupHook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	Broker = ShmemInitStruct("pg_shard connection broker", ConnectionBrokerShmemSize(),
+							 &alreadyInitialized);
+	BrokerQueueArea = ((char *) Broker) + MAXALIGN(controlSize);
+	if (!alreadyInitialized)
+	{
+		SpinLockInit(&Broker->mutex);
+		Broker->brokerPid = 0;
+		Broker->brokerProc = NULL;
+		Broker->slotCount = ConnectionBrokerSlots;
+
+		for (int slotIndex = 0; slotIndex < ConnectionBrokerSlots; slotIndex++)
+		{
+			BrokerSlot *slot = &Broker->slots[slotIndex];
+
+			slot->state = BROKER_SLOT_FREE;
+			slot->backendPid = 0;
+			slot->brokerPid = 0;
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/* BrokerRequestQueue returns the queue the given slot's requests are sent on. */
+static shm_mq *
+BrokerRequestQueue(int slotIndex)
+{
+	return (shm_mq *) (BrokerQueueArea + (Size) (2 * slotIndex) * BROKER_QUEUE_SIZE);
+}
+
+
+/* BrokerResponseQueue returns the queue the given slot's responses are sent on. */
+static shm_mq *
+BrokerResponseQueue(int slotIndex)
+{
+	return (shm_mq *) (BrokerQueueArea + (Size) (2 * slotIndex + 1) * BROKER_QUEUE_SIZE);
+}
+
+
+/*
+ * AcquireBrokerSlot takes a free slot for the current backend, creates its
+ * message queues, and asks the broker to attach to them. The function returns
+ * false if the broker is not running or all slots are taken.
+ */
+static bool
+AcquireBrokerSlot(void)
+{
+	volatile BrokerControl *broker = Broker;
+	int slotIndex = -1;
+	pid_t brokerPid = 0;
+	bool slotActivated = false;
+	PGPROC *brokerProc = NULL;
+	MemoryContext oldContext = NULL;
+	shm_mq *requestQueue = NULL;
+	shm_mq *responseQueue = NULL;
+
+	SpinLockAcquire(&broker->mutex);
+	brokerPid = broker->brokerPid;
+	for (int candidateIndex = 0; brokerPid != 0 && candidateIndex < broker->slotCount;
+		 candidateIndex++)
+	{
+		volatile BrokerSlot *slot = &broker->slots[candidateIndex];
+
+		if (slot->state == BROKER_SLOT_FREE)
+		{
+			slot->state = BROKER_SLOT_CLAIMED;
+			slot->backendPid = MyProcPid;
+			slot->brokerPid = brokerPid;
+
+			slotIndex = candidateIndex;
+			break;
+		}
+	}
+	SpinLockRelease(&broker->mutex);
+
+	if (slotIndex < 0)
+	{
+		return false;
+	}
+
+	requestQueue = shm_mq_create(BrokerRequestQueue(slotIndex), BROKER_QUEUE_SIZE);
+	shm_mq_set_sender(requestQueue, MyProc);
+	responseQueue = shm_mq_create(BrokerResponseQueue(slotIndex), BROKER_QUEUE_SIZE);
+	shm_mq_set_receiver(responseQueue, MyProc);
+
+	/* activate the slot unless the broker exited in the meantime */
+	SpinLockAcquire(&broker->mutex);
+	if (broker->slots[slotIndex].brokerPid == brokerPid)
+	{
+		broker->slots[slotIndex].state = BROKER_SLOT_ACTIVE;
+		brokerProc = broker->brokerProc;
+		slotActivated = true;
+	}
+	else
+	{
+		broker->slots[slotIndex].state = BROKER_SLOT_FREE;
+		broker->slots[slotIndex].backendPid = 0;
+	}
+	SpinLockRelease(&broker->mutex);
+
+	if (!slotActivated)
+	{
+		return false;
+	}
+
+	if (BrokerClientContext == NULL)
+	{
+		BrokerClientContext = AllocSetContextCreate(TopMemoryContext,
+													"Connection Broker Client",
+													ALLOCSET_SMALL_MINSIZE,
+													ALLOCSET_SMALL_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+	}
+
+	oldContext = MemoryContextSwitchTo(BrokerClientContext);
+	ClientRequestHandle = shm_mq_attach(requestQueue, NULL, NULL);
+	ClientResponseHandle = shm_mq_attach(responseQueue, NULL, NULL);
+	MemoryContextSwitchTo(oldContext);
+
+	ClientSlotIndex = slotIndex;
+	ClientBrokerPid = brokerPid;
+
+	if (!ClientExitCallbackSet)
+	{
+		before_shmem_exit(BrokerClientShmemExit, (Datum) 0);
+		ClientExitCallbackSet = true;
+	}
+
+	SetLatch(&brokerProc->procLatch);
+
+	return true;
+}
+
+
+/*
+ * ReleaseBrokerSlot detaches the current backend from its slot's message queues
+ * and thereby hands the slot back to the broker, which frees it and returns any
+ * connections pinned to the backend to the pool. If the broker serving the slot
+ * exited, the backend frees the slot itself.
+ */
+static void
+ReleaseBrokerSlot(void)
+{
+	volatile BrokerControl *broker = Broker;
+	volatile BrokerSlot *slot = NULL;
+
+	if (ClientSlotIndex < 0)
+	{
+		return;
+	}
+
+	shm_mq_detach(BrokerRequestQueue(ClientSlotIndex));
+	shm_mq_detach(BrokerResponseQueue(ClientSlotIndex));
+
+	slot = &broker->slots[ClientSlotIndex];
+
+	SpinLockAcquire(&broker->mutex);
+	if (slot->backendPid == MyProcPid && slot->state == BROKER_SLOT_ACTIVE)
+	{
+		if (slot->brokerPid == ClientBrokerPid)
+		{
+			slot->state = BROKER_SLOT_DETACHED;
+		}
+		else
+		{
+			slot->state = BROKER_SLOT_FREE;
+			slot->backendPid = 0;
+			slot->brokerPid = 0;
+		}
+	}
+	SpinLockRelease(&broker->mutex);
+
+	MemoryContextReset(BrokerClientContext);
+	ClientRequestHandle = NULL;
+	ClientResponseHandle = NULL;
+	ClientSlotIndex = -1;
+	ClientBrokerPid = 0;
+	ClientPinsConnections = false;
+}
+
+
+/* BrokerClientShmemExit releases the slot of an exiting backend. */
+static void
+BrokerClientShmemExit(int code, Datum argument)
+{
+	ReleaseBrokerSlot();
+}
+
+
+/*
+ * BrokerXactCallback releases the current backend's slot at the end of each
+ * transaction. This returns connections pinned during the transaction to the
+ * pool; as the callback is registered before any callback finishing remote
+ * transactions, it runs after all of them.
+ */
+static void
+BrokerXactCallback(XactEvent event, void *argument)
+{
+	if (event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT ||
+		event == XACT_EVENT_PREPARE)
+	{
+		ReleaseBrokerSlot();
+		ClientLostPinnedConnections = false;
+	}
+}
+
+
+/*
+ * WaitForBroker sleeps until the broker made progress on the current backend's
+ * request, or a short timeout elapsed. It returns false if the broker serving
+ * the backend's slot exited in the meantime.
+ */
+static bool
+WaitForBroker(void)
+{
+	volatile BrokerControl *broker = Broker;
+	bool brokerRunning = false;
+
+	WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT, BROKER_CLIENT_WAIT_MS);
+	ResetLatch(MyLatch);
+
+	CHECK_FOR_INTERRUPTS();
+
+	SpinLockAcquire(&broker->mutex);
+	brokerRunning = (broker->slots[ClientSlotIndex].brokerPid == ClientBrokerPid);
+	SpinLockRelease(&broker->mutex);
+
+	return brokerRunning;
+}
+
+
+/*
+ * BuildRequest serializes the given commands into a request for the broker. The
+ * request also identifies the database and encoding to connect with.
+ */
+static StringInfo
+BuildRequest(List *brokerCommandList, bool pinConnections)
+{
+	StringInfo request = makeStringInfo();
+	ListCell *commandCell = NULL;
+
+	pq_sendint(request, (pinConnections ? BROKER_PIN_CONNECTIONS : 0), 4);
+	SendString(request, get_database_name(MyDatabaseId));
+	SendString(request, GetDatabaseEncodingName());
+	pq_sendint(request, list_length(brokerCommandList), 4);
+
+	foreach(commandCell, brokerCommandList)
+	{
+		BrokerCommand *command = (BrokerCommand *) lfirst(commandCell);
+
+		SendString(request, command->nodeName);
+		pq_sendint(request, command->nodePort, 4);
+		SendString(request, command->queryString);
+		pq_sendint(request, command->parameterCount, 4);
+
+		for (int parameterIndex = 0; parameterIndex < command->parameterCount;
+			 parameterIndex++)
+		{
+			Oid parameterType = InvalidOid;
+			if (command->parameterTypes != NULL)
+			{
+				parameterType = command->parameterTypes[parameterIndex];
+			}
+
+			pq_sendint(request, (int) parameterType, 4);
+			SendString(request, command->parameterValues[parameterIndex]);
+		}
+	}
+
+	return request;
+}
+
+
+/*
+ * ParseResponse deserializes the broker's response to a request holding the
+ * given number of commands, and returns the list of their results.
+ */
+static List *
+ParseResponse(char *responseData, Size responseSize, int commandCount)
+{
+	List *resultList = NIL;
+	StringInfoData response;
+
+	response.data = responseData;
+	response.len = (int) responseSize;
+	response.maxlen = (int) responseSize;
+	response.cursor = 0;
+
+	for (int commandIndex = 0; commandIndex < commandCount; commandIndex++)
+	{
+		BrokerResult *result = (BrokerResult *) palloc0(sizeof(BrokerResult));
+		int valueCount = 0;
+
+		result->resultStatus = (ExecStatusType) pq_getmsgint(&response, 4);
+		result->sqlState = GetString(&response);
+		result->errorMessage = GetString(&response);
+		result->affectedTupleCount = GetString(&response);
+		result->columnCount = (int) pq_getmsgint(&response, 4);
+		result->rowCount = (int) pq_getmsgint(&response, 4);
+
+		valueCount = result->columnCount * result->rowCount;
+		result->valueArray = (char **) palloc0(Max(valueCount, 1) * sizeof(char *));
+		for (int valueIndex = 0; valueIndex < valueCount; valueIndex++)
+		{
+			result->valueArray[valueIndex] = GetString(&response);
+		}
+
+		resultList = lappend(resultList, result);
+	}
+
+	return resultList;
+}
+
+
+/*
+ * FailedResultList returns a list of the given number of results, all of which
+ * report a connection failure with the given message.
+ */
+static List *
+FailedResultList(int commandCount, char *errorMessage)
+{
+	List *resultList = NIL;
+
+	for (int commandIndex = 0; commandIndex < commandCount; commandIndex++)
+	{
+		BrokerResult *result = (BrokerResult *) palloc0(sizeof(BrokerResult));
+
+		result->resultStatus = PGRES_FATAL_ERROR;
+		result->errorMessage = errorMessage;
+		result->affectedTupleCount = "";
+
+		resultList = lappend(resultList, result);
+	}
+
+	return resultList;
+}
+
+
+/*
+ * SendString appends a possibly null string to a message, preceded by its
+ * length; null strings are sent as a length of -1.
+ */
+static void
+SendString(StringInfo buffer, const char *string)
+{
+	if (string == NULL)
+	{
+		pq_sendint(buffer, -1, 4);
+	}
+	else
+	{
+		int stringLength = strlen(string);
+
+		pq_sendint(buffer, stringLength, 4);
+		pq_sendbytes(buffer, string, stringLength);
+	}
+}
+
+
+/* GetString reads a string appended by SendString into a new palloc'd string. */
+static char *
+GetString(StringInfo buffer)
+{
+	char *string = NULL;
+	int stringLength = (int) pq_getmsgint(buffer, 4);
+
+	if (stringLength >= 0)
+	{
+		string = palloc(stringLength + 1);
+		memcpy(string, pq_getmsgbytes(buffer, stringLength), stringLength);
+		string[stringLength] = '\0';
+	}
+
+	return string;
+}
+
+
+/*
+ * ConnectionBrokerMain is the entry point of the connection broker. The broker
+ * attaches to the slots backends activate, runs the commands they send, and
+ * sends back the results until it is asked to shut down.
+ */
+void
+ConnectionBrokerMain(Datum mainArgument)
+{
+	volatile BrokerControl *broker = Broker;
+
+	if (pipe(BrokerWakeupPipe) < 0 ||
+		fcntl(BrokerWakeupPipe[0], F_SETFL, O_NONBLOCK) < 0 ||
+		fcntl(BrokerWakeupPipe[1], F_SETFL, O_NONBLOCK) < 0)
+	{
+		ereport(FATAL, (errmsg("could not create wakeup pipe for connection broker: "
+							   "%m")));
+	}
+
+	pqsignal(SIGTERM, BrokerSigtermHandler);
+	pqsignal(SIGHUP, BrokerSighupHandler);
+	pqsignal(SIGUSR1, BrokerSigusr1Handler);
+	BackgroundWorkerUnblockSignals();
+
+	BrokerClientArray = (BrokerClient *) MemoryContextAllocZero(
+		TopMemoryContext, broker->slotCount * sizeof(BrokerClient));
+
+	on_shmem_exit(BrokerShmemExit, (Datum) 0);
+
+	SpinLockAcquire(&broker->mutex);
+	broker->brokerPid = MyProcPid;
+	broker->brokerProc = MyProc;
+	SpinLockRelease(&broker->mutex);
+
+	while (!BrokerGotSigterm)
+	{
+		ResetLatch(MyLatch);
+
+		if (BrokerGotSighup)
+		{
+			BrokerGotSighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+			TrimConnectionPool();
+		}
+
+		AttachNewClients();
+
+		for (int slotIndex = 0; slotIndex < broker->slotCount; slotIndex++)
+		{
+			if (BrokerClientArray[slotIndex].attached)
+			{
+				ServeClientSafely(slotIndex);
+			}
+		}
+
+		WaitForBrokerEvents();
+	}
+
+	proc_exit(0);
+}
+
+
+/* BrokerSigtermHandler asks the broker to shut down. */
+static void
+BrokerSigtermHandler(SIGNAL_ARGS)
+{
+	int savedErrno = errno;
+
+	BrokerGotSigterm = true;
+	SetLatch(MyLatch);
+	WakeBroker();
+
+	errno = savedErrno;
+}
+
+
+/* BrokerSighupHandler asks the broker to reload the configuration files. */
+static void
+BrokerSighupHandler(SIGNAL_ARGS)
+{
+	int savedErrno = errno;
+
+	BrokerGotSighup = true;
+	SetLatch(MyLatch);
+	WakeBroker();
+
+	errno = savedErrno;
+}
+
+
+/*
+ * BrokerSigusr1Handler handles the signals through which other processes set
+ * the broker's latch, and additionally wakes the broker up while it waits for
+ * the sockets of its connections.
+ */
+static void
+BrokerSigusr1Handler(SIGNAL_ARGS)
+{
+	int savedErrno = errno;
+
+	latch_sigusr1_handler();
+	WakeBroker();
+
+	errno = savedErrno;
+}
+
+
+/*
+ * WakeBroker writes a byte to the broker's wakeup pipe. If the pipe is full,
+ * the broker is woken up anyway, so failures to write are ignored.
+ */
+static void
+WakeBroker(void)
+{
+	int savedErrno = errno;
+
+	while (write(BrokerWakeupPipe[1], "", 1) < 0 && errno == EINTR)
+	{
+		/* retry if interrupted by another signal */
+	}
+
+	errno = savedErrno;
+}
+
+
+/*
+ * BrokerShmemExit marks the broker as no longer running, so that backends stop
+ * waiting for it. Slots whose backends already detached are freed; all others
+ * are left for their backends to free.
+ */
+static void
+BrokerShmemExit(int code, Datum argument)
+{
+	volatile BrokerControl *broker = Broker;
+
+	SpinLockAcquire(&broker->mutex);
+	broker->brokerPid = 0;
+	broker->brokerProc = NULL;
+
+	for (int slotIndex = 0; slotIndex < broker->slotCount; slotIndex++)
+	{
+		volatile BrokerSlot *slot = &broker->slots[slotIndex];
+		if (slot->brokerPid != MyProcPid)
+		{
+			continue;
+		}
+
+		slot->brokerPid = 0;
+		if (slot->state == BROKER_SLOT_DETACHED)
+		{
+			slot->state = BROKER_SLOT_FREE;
+			slot->backendPid = 0;
+		}
+	}
+	SpinLockRelease(&broker->mutex);
+}
+
+
+/*
+ * AttachNewClients attaches the broker to the message queues of all slots which
+ * backends activated since the last call.
+ */
+static void
+AttachNewClients(void)
+{
+	volatile BrokerControl *broker = Broker;
+
+	for (int slotIndex = 0; slotIndex < broker->slotCount; slotIndex++)
+	{
+		BrokerClient *client = &BrokerClientArray[slotIndex];
+		volatile BrokerSlot *slot = &broker->slots[slotIndex];
+		bool slotActive = false;
+		MemoryContext oldContext = NULL;
+		shm_mq *requestQueue = NULL;
+		shm_mq *responseQueue = NULL;
+
+		if (client->attached)
+		{
+			continue;
+		}
+
+		SpinLockAcquire(&broker->mutex);
+		slotActive = (slot->brokerPid == MyProcPid &&
+					  (slot->state == BROKER_SLOT_ACTIVE ||
+					   slot->state == BROKER_SLOT_DETACHED));
+		SpinLockRelease(&broker->mutex);
+
+		if (!slotActive)
+		{
+			continue;
+		}
+
+		client->clientContext = AllocSetContextCreate(TopMemoryContext,
+													  "Connection Broker Slot",
+													  ALLOCSET_SMALL_MINSIZE,
+													  ALLOCSET_SMALL_INITSIZE,
+													  ALLOCSET_DEFAULT_MAXSIZE);
+		client->requestContext = AllocSetContextCreate(client->clientContext,
+													   "Connection Broker Request",
+													   ALLOCSET_DEFAULT_MINSIZE,
+													   ALLOCSET_DEFAULT_INITSIZE,
+													   ALLOCSET_DEFAULT_MAXSIZE);
+
+		requestQueue = BrokerRequestQueue(slotIndex);
+		responseQueue = BrokerResponseQueue(slotIndex);
+		shm_mq_set_receiver(requestQueue, MyProc);
+		shm_mq_set_sender(responseQueue, MyProc);
+
+		oldContext = MemoryContextSwitchTo(client->clientContext);
+		client->requestHandle = shm_mq_attach(requestQueue, NULL, NULL);
+		client->responseHandle = shm_mq_attach(responseQueue, NULL, NULL);
+		MemoryContextSwitchTo(oldContext);
+
+		client->attached = true;
+		client->requestActive = false;
+		client->responsePending = false;
+	}
+}
+
+
+/*
+ * ServeClientSafely serves the given slot's backend like ServeClient, but
+ * recovers from any error raised while doing so, such as a malformed request
+ * or running out of memory. The error is logged, and the backend's current
+ * request fails with the error's message. If the error left the request in a
+ * state in which no response can be built, the backend is let go instead.
+ */
+static void
+ServeClientSafely(int slotIndex)
+{
+	MemoryContext oldContext = CurrentMemoryContext;
+
+	PG_TRY();
+	{
+		ServeClient(slotIndex);
+	}
+	PG_CATCH();
+	{
+		BrokerClient *client = &BrokerClientArray[slotIndex];
+		ErrorData *errorData = NULL;
+
+		MemoryContextSwitchTo(oldContext);
+
+		EmitErrorReport();
+		errorData = CopyErrorData();
+		FlushErrorState();
+
+		if (client->requestActive && !client->requestFailed)
+		{
+			FailRequest(client, errorData->message);
+		}
+		else
+		{
+			DetachClient(slotIndex);
+		}
+
+		FreeErrorData(errorData);
+	}
+	PG_END_TRY();
+}
+
+
+/*
+ * FailRequest fails the commands of the client's current request which did not
+ * complete yet with the given message. Their connections are closed, as they
+ * may have been left in any state. The response is sent as usual.
+ */
+static void
+FailRequest(BrokerClient *client, char *errorMessage)
+{
+	client->requestFailed = true;
+
+	for (int taskIndex = 0; taskIndex < client->taskCount; taskIndex++)
+	{
+		BrokerTask *task = &client->taskArray[taskIndex];
+		if (task->done)
+		{
+			continue;
+		}
+
+		if (task->pooledConnection != NULL)
+		{
+			FinishTask(client, task, false);
+		}
+
+		task->done = true;
+		task->failureMessage = MemoryContextStrdup(client->requestContext,
+												   errorMessage);
+	}
+}
+
+
+/*
+ * ServeClient advances the state of the given slot's backend as far as
+ * possible without blocking: it receives a new request, starts and polls its
+ * commands, and sends the response once all of them completed. Backends which
+ * detached from their queues are let go.
+ */
+static void
+ServeClient(int slotIndex)
+{
+	BrokerClient *client = &BrokerClientArray[slotIndex];
+	shm_mq_result queueResult = SHM_MQ_SUCCESS;
+
+	if (!client->responsePending)
+	{
+		Size requestSize = 0;
+		void *requestData = NULL;
+
+		/* backends send nothing while waiting, but may detach when canceled */
+		queueResult = shm_mq_receive(client->requestHandle, &requestSize, &requestData,
+									 true);
+		if (queueResult == SHM_MQ_DETACHED ||
+			(queueResult == SHM_MQ_SUCCESS && client->requestActive))
+		{
+			DetachClient(slotIndex);
+			return;
+		}
+		else if (queueResult == SHM_MQ_SUCCESS)
+		{
+			ParseRequest(client, (char *) requestData, requestSize);
+		}
+	}
+
+	if (client->requestActive)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(client->requestContext);
+		bool allTasksDone = true;
+
+		StartTasks(slotIndex);
+		PollTasks(slotIndex);
+
+		MemoryContextSwitchTo(oldContext);
+
+		for (int taskIndex = 0; taskIndex < client->taskCount; taskIndex++)
+		{
+			allTasksDone = allTasksDone && client->taskArray[taskIndex].done;
+		}
+
+		if (allTasksDone)
+		{
+			client->response = BuildResponse(client);
+			client->requestActive = false;
+			client->responsePending = true;
+		}
+	}
+
+	if (client->responsePending)
+	{
+		queueResult = shm_mq_send(client->responseHandle, client->response->len,
+								  client->response->data, true);
+		if (queueResult == SHM_MQ_DETACHED)
+		{
+			DetachClient(slotIndex);
+		}
+		else if (queueResult == SHM_MQ_SUCCESS)
+		{
+			client->responsePending = false;
+			MemoryContextReset(client->requestContext);
+		}
+	}
+}
+
+
+/*
+ * ParseRequest deserializes a backend's request into the tasks tracking the
+ * execution of its commands.
+ */
+static void
+ParseRequest(BrokerClient *client, char *requestData, Size requestSize)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(client->requestContext);
+	StringInfoData request;
+	int flags = 0;
+
+	request.data = requestData;
+	request.len = (int) requestSize;
+	request.maxlen = (int) requestSize;
+	request.cursor = 0;
+
+	client->requestFailed = false;
+
+	flags = (int) pq_getmsgint(&request, 4);
+	client->pinConnections = ((flags & BROKER_PIN_CONNECTIONS) != 0);
+	client->databaseName = GetString(&request);
+	client->clientEncoding = GetString(&request);
+	client->taskCount = (int) pq_getmsgint(&request, 4);
+	client->taskArray = (BrokerTask *) palloc0(Max(client->taskCount, 1) *
+											   sizeof(BrokerTask));
+
+	for (int taskIndex = 0; taskIndex < client->taskCount; taskIndex++)
+	{
+		BrokerCommand *command = &client->taskArray[taskIndex].command;
+
+		command->nodeName = GetString(&request);
+		command->nodePort = (int32) pq_getmsgint(&request, 4);
+		command->queryString = GetString(&request);
+		command->parameterCount = (int) pq_getmsgint(&request, 4);
+		command->parameterTypes = (Oid *) palloc0(Max(command->parameterCount, 1) *
+												  sizeof(Oid));
+		command->parameterValues = (const char **) palloc0(
+			Max(command->parameterCount, 1) * sizeof(char *));
+
+		for (int parameterIndex = 0; parameterIndex < command->parameterCount;
+			 parameterIndex++)
+		{
+			command->parameterTypes[parameterIndex] = (Oid) pq_getmsgint(&request, 4);
+			command->parameterValues[parameterIndex] = GetString(&request);
+		}
+	}
+
+	client->requestActive = true;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * StartTasks sends each command of the slot's current request which has not yet
+ * been started, unless the connection it has to run on is still busy with an
+ * earlier command of the same request.
+ */
+static void
+StartTasks(int slotIndex)
+{
+	BrokerClient *client = &BrokerClientArray[slotIndex];
+
+	for (int taskIndex = 0; taskIndex < client->taskCount; taskIndex++)
+	{
+		BrokerTask *task = &client->taskArray[taskIndex];
+		PooledConnection *pinnedConnection = NULL;
+
+		if (task->started)
+		{
+			continue;
+		}
+
+		pinnedConnection = FindPooledConnection(slotIndex, &task->command,
+												client->databaseName,
+												client->clientEncoding);
+		if (pinnedConnection != NULL && pinnedConnection->busy)
+		{
+			continue;
+		}
+
+		task->started = true;
+		if (!SendTask(slotIndex, task))
+		{
+			task->done = true;
+		}
+	}
+}
+
+
+/*
+ * SendTask picks a connection for the given task and sends its command. The
+ * connection pinned to the slot for the command's node is used if there is
+ * one; otherwise an idle connection is taken from the pool. As idle connections
+ * may have been closed by their nodes, a failure to send on one of them is
+ * retried on another. If there are none left, a new connection is started; the
+ * command is sent once PollTasks completes it. The function returns false if
+ * the command could not be sent.
+ */
+static bool
+SendTask(int slotIndex, BrokerTask *task)
+{
+	BrokerClient *client = &BrokerClientArray[slotIndex];
+	BrokerCommand *command = &task->command;
+
+	for (;;)
+	{
+		PooledConnection *pooledConnection = NULL;
+		bool retryCommand = false;
+		int querySent = 0;
+
+		pooledConnection = FindPooledConnection(slotIndex, command, client->databaseName,
+												client->clientEncoding);
+		if (pooledConnection == NULL)
+		{
+			pooledConnection = FindPooledConnection(-1, command, client->databaseName,
+													client->clientEncoding);
+		}
+
+		if (pooledConnection == NULL)
+		{
+			break;
+		}
+
+		pooledConnection->ownerSlot = slotIndex;
+		pooledConnection->busy = true;
+		if (client->pinConnections)
+		{
+			pooledConnection->pinned = true;
+		}
+		task->pooledConnection = pooledConnection;
+
+		querySent = PQsendQueryParams(pooledConnection->connection, command->queryString,
+									  command->parameterCount, command->parameterTypes,
+									  command->parameterValues, NULL, NULL, 0);
+		if (querySent != 0)
+		{
+			return true;
+		}
+
+		task->failureMessage = pstrdup(PQerrorMessage(pooledConnection->connection));
+		task->pooledConnection = NULL;
+
+		/* pinned connections are part of a remote transaction; don't retry */
+		retryCommand = !pooledConnection->pinned;
+		ClosePooledConnection(pooledConnection);
+
+		if (!retryCommand)
+		{
+			return false;
+		}
+	}
+
+	task->failureMessage = NULL;
+
+	return StartConnection(slotIndex, task);
+}
+
+
+/*
+ * StartConnection starts a new connection for the given task to the node and
+ * database of its command, and adds it to the pool, owned by the given slot.
+ * The function returns false if the connection could not even be started.
+ */
+static bool
+StartConnection(int slotIndex, BrokerTask *task)
+{
+	BrokerClient *client = &BrokerClientArray[slotIndex];
+	BrokerCommand *command = &task->command;
+	PooledConnection *pooledConnection = NULL;
+	MemoryContext oldContext = NULL;
+	PGconn *connection = StartDatabaseConnection(command->nodeName, command->nodePort,
+												 client->databaseName,
+												 client->clientEncoding);
+
+	task->connectAttempts++;
+
+	if (PQstatus(connection) == CONNECTION_BAD)
+	{
+		task->failureMessage = pstrdup(PQerrorMessage(connection));
+		PQfinish(connection);
+		return false;
+	}
+
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	pooledConnection = palloc0(sizeof(PooledConnection));
+	strlcpy(pooledConnection->nodeName, command->nodeName, MAX_NODE_LENGTH + 1);
+	pooledConnection->nodePort = command->nodePort;
+	strlcpy(pooledConnection->databaseName, client->databaseName, NAMEDATALEN);
+	strlcpy(pooledConnection->clientEncoding, client->clientEncoding, NAMEDATALEN);
+	pooledConnection->connection = connection;
+	pooledConnection->ownerSlot = slotIndex;
+	pooledConnection->pinned = client->pinConnections;
+	pooledConnection->busy = true;
+	pooledConnection->connecting = true;
+	pooledConnection->pollingStatus = PGRES_POLLING_WRITING;
+	pooledConnection->connectStartTime = GetCurrentTimestamp();
+
+	ConnectionPool = lappend(ConnectionPool, pooledConnection);
+	MemoryContextSwitchTo(oldContext);
+
+	task->pooledConnection = pooledConnection;
+
+	return true;
+}
+
+
+/*
+ * AdvanceConnection continues to make the new connection of the given task if
+ * its socket is ready, and sends the task's command once the connection is
+ * made. Like ConnectToNode, failed or timed out connections are retried up to
+ * MAX_CONNECT_ATTEMPTS times. The function returns true once the command was
+ * sent, and false while the connection is still being made or if the task
+ * failed; the task is then marked as done.
+ */
+static bool
+AdvanceConnection(int slotIndex, BrokerTask *task)
+{
+	BrokerClient *client = &BrokerClientArray[slotIndex];
+	BrokerCommand *command = &task->command;
+	PooledConnection *pooledConnection = task->pooledConnection;
+	PGconn *connection = pooledConnection->connection;
+	char *errorMessage = NULL;
+	struct pollfd pollDescriptor;
+
+	pollDescriptor.fd = PQsocket(connection);
+	pollDescriptor.events = POLLOUT;
+	pollDescriptor.revents = 0;
+	if (pooledConnection->pollingStatus == PGRES_POLLING_READING)
+	{
+		pollDescriptor.events = POLLIN;
+	}
+
+	/* libpq may only be asked to continue once the socket is ready */
+	if (poll(&pollDescriptor, 1, 0) > 0)
+	{
+		PostgresPollingStatusType pollingStatus = PQconnectPoll(connection);
+		if (pollingStatus == PGRES_POLLING_OK)
+		{
+			int querySent = 0;
+
+			pooledConnection->connecting = false;
+
+			querySent = PQsendQueryParams(connection, command->queryString,
+										  command->parameterCount,
+										  command->parameterTypes,
+										  command->parameterValues, NULL, NULL, 0);
+			if (querySent != 0)
+			{
+				return true;
+			}
+
+			task->failureMessage = pstrdup(PQerrorMessage(connection));
+			FinishTask(client, task, false);
+			return false;
+		}
+		else if (pollingStatus != PGRES_POLLING_FAILED)
+		{
+			pooledConnection->pollingStatus = pollingStatus;
+			return false;
+		}
+
+		errorMessage = pstrdup(PQerrorMessage(connection));
+	}
+	else if (TimestampDifferenceExceeds(pooledConnection->connectStartTime,
+										GetCurrentTimestamp(), BROKER_CONNECT_TIMEOUT_MS))
+	{
+		errorMessage = psprintf("could not connect to %s:%d: timeout expired",
+								command->nodeName, command->nodePort);
+	}
+	else
+	{
+		return false;
+	}
+
+	task->pooledConnection = NULL;
+	ClosePooledConnection(pooledConnection);
+
+	if (task->connectAttempts < MAX_CONNECT_ATTEMPTS && StartConnection(slotIndex, task))
+	{
+		return false;
+	}
+
+	if (task->failureMessage == NULL)
+	{
+		task->failureMessage = errorMessage;
+	}
+
+	task->done = true;
+
+	return false;
+}
+
+
+/*
+ * PollTasks reads whatever input arrived on the connections of the slot's
+ * running tasks, and marks the tasks whose commands completed as done. Of the
+ * results a command produces, the first failed one is kept, or else the last.
+ */
+static void
+PollTasks(int slotIndex)
+{
+	BrokerClient *client = &BrokerClientArray[slotIndex];
+
+	for (int taskIndex = 0; taskIndex < client->taskCount; taskIndex++)
+	{
+		BrokerTask *task = &client->taskArray[taskIndex];
+		PGconn *connection = NULL;
+
+		if (!task->started || task->done)
+		{
+			continue;
+		}
+
+		if (task->pooledConnection->connecting && !AdvanceConnection(slotIndex, task))
+		{
+			continue;
+		}
+
+		connection = task->pooledConnection->connection;
+		if (PQconsumeInput(connection) == 0)
+		{
+			task->failureMessage = pstrdup(PQerrorMessage(connection));
+			FinishTask(client, task, false);
+			continue;
+		}
+
+		while (PQisBusy(connection) == 0)
+		{
+			ExecStatusType resultStatus = 0;
+			PGresult *result = PQgetResult(connection);
+			if (result == NULL)
+			{
+				FinishTask(client, task, true);
+				break;
+			}
+
+			resultStatus = PQresultStatus(task->result);
+			if (task->result == NULL || (resultStatus != PGRES_FATAL_ERROR &&
+										 resultStatus != PGRES_BAD_RESPONSE))
+			{
+				PQclear(task->result);
+				task->result = result;
+			}
+			else
+			{
+				PQclear(result);
+			}
+		}
+	}
+}
+
+
+/*
+ * FinishTask marks the given task as done and hands back its connection. The
+ * connection stays with the slot if it was pinned to the slot; otherwise
+ * it is returned to the pool, unless it was left in a remote transaction or
+ * failed, in which case it is closed.
+ */
+static void
+FinishTask(BrokerClient *client, BrokerTask *task, bool keepConnection)
+{
+	PooledConnection *pooledConnection = task->pooledConnection;
+
+	task->done = true;
+	task->pooledConnection = NULL;
+
+	pooledConnection->busy = false;
+
+	if (!keepConnection || PQstatus(pooledConnection->connection) != CONNECTION_OK)
+	{
+		ClosePooledConnection(pooledConnection);
+	}
+	else if (!pooledConnection->pinned)
+	{
+		if (PQtransactionStatus(pooledConnection->connection) == PQTRANS_IDLE)
+		{
+			pooledConnection->ownerSlot = -1;
+		}
+		else
+		{
+			ClosePooledConnection(pooledConnection);
+		}
+	}
+}
+
+
+/*
+ * BuildResponse serializes the results of the slot's current request into the
+ * response for the backend, and releases the results.
+ */
+static StringInfo
+BuildResponse(BrokerClient *client)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(client->requestContext);
+	StringInfo response = makeStringInfo();
+
+	for (int taskIndex = 0; taskIndex < client->taskCount; taskIndex++)
+	{
+		BrokerTask *task = &client->taskArray[taskIndex];
+		PGresult *result = task->result;
+
+		if (task->failureMessage != NULL || result == NULL)
+		{
+			char *errorMessage = task->failureMessage;
+			if (errorMessage == NULL)
+			{
+				errorMessage = "command returned no result";
+			}
+
+			pq_sendint(response, PGRES_FATAL_ERROR, 4);
+			SendString(response, NULL);
+			SendString(response, errorMessage);
+			SendString(response, "");
+			pq_sendint(response, 0, 4);
+			pq_sendint(response, 0, 4);
+		}
+		else
+		{
+			int columnCount = PQnfields(result);
+			int rowCount = PQntuples(result);
+			char *errorMessage = PQresultErrorField(result, PG_DIAG_MESSAGE_PRIMARY);
+
+			if (errorMessage == NULL && PQresultErrorMessage(result)[0] != '\0')
+			{
+				char *lastNewlineIndex = NULL;
+
+				errorMessage = pstrdup(PQresultErrorMessage(result));
+				lastNewlineIndex = strrchr(errorMessage, '\n');
+
+				/* trim trailing newline, if any */
+				if (lastNewlineIndex != NULL)
+				{
+					*lastNewlineIndex = '\0';
+				}
+			}
+
+			pq_sendint(response, PQresultStatus(result), 4);
+			SendString(response, PQresultErrorField(result, PG_DIAG_SQLSTATE));
+			SendString(response, errorMessage);
+			SendString(response, PQcmdTuples(result));
+			pq_sendint(response, columnCount, 4);
+			pq_sendint(response, rowCount, 4);
+
+			for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+			{
+				for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+				{
+					char *value = NULL;
+					if (!PQgetisnull(result, rowIndex, columnIndex))
+					{
+						value = PQgetvalue(result, rowIndex, columnIndex);
+					}
+
+					SendString(response, value);
+				}
+			}
+
+			PQclear(result);
+			task->result = NULL;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return response;
+}
+
+
+/*
+ * DetachClient lets go of the backend using the given slot and frees the slot.
+ * Connections pinned to the backend are returned to the pool if they are idle
+ * and outside of a remote transaction, and closed otherwise; this also aborts
+ * the commands of backends which detached while waiting for them.
+ */
+static void
+DetachClient(int slotIndex)
+{
+	volatile BrokerControl *broker = Broker;
+	volatile BrokerSlot *slot = &broker->slots[slotIndex];
+	BrokerClient *client = &BrokerClientArray[slotIndex];
+	ListCell *connectionCell = NULL;
+	List *closedConnectionList = NIL;
+
+	if (client->requestActive)
+	{
+		for (int taskIndex = 0; taskIndex < client->taskCount; taskIndex++)
+		{
+			PQclear(client->taskArray[taskIndex].result);
+		}
+	}
+
+	foreach(connectionCell, ConnectionPool)
+	{
+		PooledConnection *pooledConnection = (PooledConnection *) lfirst(connectionCell);
+		if (pooledConnection->ownerSlot != slotIndex)
+		{
+			continue;
+		}
+
+		if (pooledConnection->busy ||
+			PQtransactionStatus(pooledConnection->connection) != PQTRANS_IDLE)
+		{
+			closedConnectionList = lappend(closedConnectionList, pooledConnection);
+		}
+		else
+		{
+			pooledConnection->ownerSlot = -1;
+			pooledConnection->pinned = false;
+		}
+	}
+
+	foreach(connectionCell, closedConnectionList)
+	{
+		ClosePooledConnection((PooledConnection *) lfirst(connectionCell));
+	}
+	list_free(closedConnectionList);
+
+	shm_mq_detach(BrokerRequestQueue(slotIndex));
+	shm_mq_detach(BrokerResponseQueue(slotIndex));
+
+	MemoryContextDelete(client->clientContext);
+	memset(client, 0, sizeof(BrokerClient));
+
+	SpinLockAcquire(&broker->mutex);
+	slot->state = BROKER_SLOT_FREE;
+	slot->backendPid = 0;
+	slot->brokerPid = 0;
+	SpinLockRelease(&broker->mutex);
+
+	TrimConnectionPool();
+}
+
+
+/*
+ * FindPooledConnection returns a connection to the command's node and database
+ * pinned to the given slot, or an idle one if the slot is -1. The function
+ * returns NULL if there is no such connection.
+ */
+static PooledConnection *
+FindPooledConnection(int ownerSlot, BrokerCommand *command, char *databaseName,
+					 char *clientEncoding)
+{
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, ConnectionPool)
+	{
+		PooledConnection *pooledConnection = (PooledConnection *) lfirst(connectionCell);
+
+		if (pooledConnection->ownerSlot == ownerSlot &&
+			(ownerSlot < 0 || pooledConnection->pinned) &&
+			pooledConnection->nodePort == command->nodePort &&
+			strncmp(pooledConnection->nodeName, command->nodeName,
+					MAX_NODE_LENGTH + 1) == 0 &&
+			strncmp(pooledConnection->databaseName, databaseName, NAMEDATALEN) == 0 &&
+			strncmp(pooledConnection->clientEncoding, clientEncoding, NAMEDATALEN) == 0)
+		{
+			return pooledConnection;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* ClosePooledConnection closes the given connection and removes it from the pool. */
+static void
+ClosePooledConnection(PooledConnection *pooledConnection)
+{
+	ConnectionPool = list_delete_ptr(ConnectionPool, pooledConnection);
+
+	PQfinish(pooledConnection->connection);
+	pfree(pooledConnection);
+}
+
+
+/*
+ * TrimConnectionPool closes idle connections beyond the configured number per
+ * node and database.
+ */
+static void
+TrimConnectionPool(void)
+{
+	List *closedConnectionList = NIL;
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, ConnectionPool)
+	{
+		PooledConnection *pooledConnection = (PooledConnection *) lfirst(connectionCell);
+		ListCell *otherCell = NULL;
+		int idleCount = 0;
+
+		if (pooledConnection->ownerSlot >= 0)
+		{
+			continue;
+		}
+
+		/* count the idle connections to the same node preceding this one */
+		foreach(otherCell, ConnectionPool)
+		{
+			PooledConnection *otherConnection = (PooledConnection *) lfirst(otherCell);
+			if (otherConnection == pooledConnection)
+			{
+				break;
+			}
+
+			if (otherConnection->ownerSlot < 0 &&
+				otherConnection->nodePort == pooledConnection->nodePort &&
+				strcmp(otherConnection->nodeName, pooledConnection->nodeName) == 0 &&
+				strcmp(otherConnection->databaseName,
+					   pooledConnection->databaseName) == 0)
+			{
+				idleCount++;
+			}
+		}
+
+		if (idleCount >= ConnectionBrokerPoolSize)
+		{
+			closedConnectionList = lappend(closedConnectionList, pooledConnection);
+		}
+	}
+
+	foreach(connectionCell, closedConnectionList)
+	{
+		ClosePooledConnection((PooledConnection *) lfirst(connectionCell));
+	}
+	list_free(closedConnectionList);
+}
+
+
+/*
+ * WaitForBrokerEvents sleeps until the broker has something to do. The broker
+ * waits on its latch, which backends set when they activate a slot and message
+ * queues set when they have been written to or read from. While commands are
+ * running, it also waits for their connections' sockets, for a short time so
+ * that connection timeouts are noticed. As WaitLatchOrSocket only waits for a
+ * single socket, the broker then polls the sockets together with its wakeup
+ * pipe; the signal setting the latch also writes to that pipe, so the latch
+ * cannot be set unnoticed between checking it and starting to poll.
+ */
+static void
+WaitForBrokerEvents(void)
+{
+	struct pollfd *pollDescriptors = NULL;
+	int descriptorCount = 0;
+	ListCell *connectionCell = NULL;
+	int waitResult = 0;
+	char drainBuffer[64];
+
+	/* bytes written from here on either follow a set latch or interrupt the poll */
+	while (read(BrokerWakeupPipe[0], drainBuffer, sizeof(drainBuffer)) > 0)
+	{
+		/* drain the pipe */
+	}
+
+	foreach(connectionCell, ConnectionPool)
+	{
+		PooledConnection *pooledConnection = (PooledConnection *) lfirst(connectionCell);
+		if (pooledConnection->busy)
+		{
+			descriptorCount++;
+		}
+	}
+
+	if (descriptorCount == 0)
+	{
+		waitResult = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+							   BROKER_IDLE_TIMEOUT_MS);
+		if ((waitResult & WL_POSTMASTER_DEATH) != 0)
+		{
+			proc_exit(1);
+		}
+
+		return;
+	}
+
+	pollDescriptors = (struct pollfd *) palloc0((descriptorCount + 1) *
+												sizeof(struct pollfd));
+	pollDescriptors[0].fd = BrokerWakeupPipe[0];
+	pollDescriptors[0].events = POLLIN;
+	descriptorCount = 1;
+
+	foreach(connectionCell, ConnectionPool)
+	{
+		PooledConnection *pooledConnection = (PooledConnection *) lfirst(connectionCell);
+		if (!pooledConnection->busy)
+		{
+			continue;
+		}
+
+		pollDescriptors[descriptorCount].fd = PQsocket(pooledConnection->connection);
+		pollDescriptors[descriptorCount].events = POLLIN;
+		if (pooledConnection->connecting &&
+			pooledConnection->pollingStatus == PGRES_POLLING_WRITING)
+		{
+			pollDescriptors[descriptorCount].events = POLLOUT;
+		}
+
+		descriptorCount++;
+	}
+
+	if (!TestLatch(MyLatch))
+	{
+		(void) poll(pollDescriptors, descriptorCount, BROKER_POLL_TIMEOUT_MS);
+	}
+
+	pfree(pollDescriptors);
+
+	if (!PostmasterIsAlive())
+	{
+		proc_exit(1);
+	}
+}
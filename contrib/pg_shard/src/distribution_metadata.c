@@ -16,6 +16,7 @@
 #include "miscadmin.h"
 
 #include "distribution_metadata.h"
+#include "metadata_cache.h"
 
 #include <stddef.h>
 #include <string.h>
@@ -36,16 +37,11 @@
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
-
-
-/*
- * ShardIntervalListCache is used for caching shard interval lists. It begins
- * initialized to empty list as there are no items in the cache.
- */
-static List *ShardIntervalListCache = NIL;
+#include "utils/snapmgr.h"
 
 
 /* local function forward declarations */
@@ -55,65 +51,28 @@ static ShardPlacement * TupleToShardPlacement(HeapTuple heapTuple,
 											  TupleDesc tupleDescriptor);
 static void AcquireShardLock(int64 shardId, ShardLockType shardLockType,
 							 LOCKMODE lockMode);
+static int ExecuteMetadataPlan(SPIPlanPtr spiPlan, Datum *argValues, long rowCount);
 
 
 /*
- * LookupShardIntervalList is wrapper around LoadShardIntervalList that uses a
- * cache to avoid multiple lookups of a distributed table's shards within a
- * single session.
+ * LookupShardIntervalList is wrapper around LoadShardIntervalList that uses the
+ * metadata cache to avoid repeated lookups of a distributed table's shards. The
+ * returned list belongs to the cache and must not be modified by callers.
  */
 List *
 LookupShardIntervalList(Oid distributedTableId)
 {
-	ShardIntervalListCacheEntry *matchingCacheEntry = NULL;
-	ListCell *cacheEntryCell = NULL;
-
-	/* search the cache */
-	foreach(cacheEntryCell, ShardIntervalListCache)
-	{
-		ShardIntervalListCacheEntry *cacheEntry = lfirst(cacheEntryCell);
-		if (cacheEntry->distributedTableId == distributedTableId)
-		{
-			matchingCacheEntry = cacheEntry;
-			break;
-		}
-	}
-
-	/* if not found in the cache, load the shard interval and put it in cache */
-	if (matchingCacheEntry == NULL)
-	{
-		MemoryContext oldContext = MemoryContextSwitchTo(CacheMemoryContext);
-
-		List *loadedIntervalList = LoadShardIntervalList(distributedTableId);
-		if (loadedIntervalList != NIL)
-		{
-			matchingCacheEntry = palloc0(sizeof(ShardIntervalListCacheEntry));
-			matchingCacheEntry->distributedTableId = distributedTableId;
-			matchingCacheEntry->shardIntervalList = loadedIntervalList;
+	DistTableCacheEntry *cacheEntry = LookupDistTableCacheEntry(distributedTableId);
 
-			ShardIntervalListCache = lappend(ShardIntervalListCache, matchingCacheEntry);
-		}
-
-		MemoryContextSwitchTo(oldContext);
-	}
-
-	/*
-	 * The only case we don't cache the shard list is when the distributed table
-	 * doesn't have any shards. This is to force reloading shard list on next call.
-	 */
-	if (matchingCacheEntry == NULL)
-	{
-		return NIL;
-	}
-
-	return matchingCacheEntry->shardIntervalList;
+	return cacheEntry->shardIntervalList;
 }
 
 
 /*
  * LoadShardIntervalList returns a list of shard intervals related for a given
  * distributed table. The function returns an empty list if no shards can be
- * found for the given relation.
+ * found for the given relation. As its results may be cached, the function
+ * reads the metadata using the latest snapshot rather than the transaction's.
  */
 List *
 LoadShardIntervalList(Oid distributedTableId)
@@ -145,7 +104,7 @@ LoadShardIntervalList(Oid distributedTableId)
 		Assert(spiStatus == 0);
 	}
 
-	spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 0);
+	spiStatus = ExecuteMetadataPlan(spiPlan, argValues, 0);
 	Assert(spiStatus == SPI_OK_SELECT);
 
 	oldContext = MemoryContextSwitchTo(upperContext);
@@ -218,6 +177,50 @@ LoadShardInterval(int64 shardId)
 }
 
 
+/*
+ * LoadShardRelationId returns the identifier of the distributed table to which
+ * the specified shard belongs. Unlike LoadShardInterval, this function doesn't
+ * interpret the shard's min and max values, and returns InvalidOid rather than
+ * throwing an error if no shard can be found using the provided identifier.
+ */
+Oid
+LoadShardRelationId(int64 shardId)
+{
+	Oid relationId = InvalidOid;
+	Oid argTypes[] = { INT8OID };
+	Datum argValues[] = { Int64GetDatum(shardId) };
+	const int argCount = sizeof(argValues) / sizeof(argValues[0]);
+	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
+	static SPIPlanPtr spiPlan = NULL;
+
+	SPI_connect();
+
+	if (spiPlan == NULL)
+	{
+		spiPlan = SPI_prepare("SELECT relation_id FROM pgs_distribution_metadata.shard "
+							  "WHERE id = $1", argCount, argTypes);
+
+		spiStatus = SPI_keepplan(spiPlan);
+		Assert(spiStatus == 0);
+	}
+
+	spiStatus = ExecuteMetadataPlan(spiPlan, argValues, 1);
+	Assert(spiStatus == SPI_OK_SELECT);
+
+	if (SPI_processed == 1)
+	{
+		bool isNull = false;
+		Datum relationIdDatum = SPI_getbinval(SPI_tuptable->vals[0],
+											  SPI_tuptable->tupdesc, 1, &isNull);
+		relationId = DatumGetObjectId(relationIdDatum);
+	}
+
+	SPI_finish();
+
+	return relationId;
+}
+
+
 /*
  * LoadFinalizedShardPlacementList returns all placements for a given shard that
  * are in the finalized state. Like LoadShardPlacementList, this function throws
@@ -245,8 +248,9 @@ LoadFinalizedShardPlacementList(int64 shardId)
 
 /*
  * LoadShardPlacementList gathers metadata for every placement of a given shard
- * and returns a list of ShardPlacements containing that metadata. The function
- * throws an error if the specified shard has not been placed.
+ * and returns a list of ShardPlacements containing that metadata. Placements of
+ * shards whose table is in the metadata cache are served from the cache. The
+ * function throws an error if the specified shard has not been placed.
  */
 List *
 LoadShardPlacementList(int64 shardId)
@@ -257,12 +261,20 @@ LoadShardPlacementList(int64 shardId)
 	const int argCount = sizeof(argValues) / sizeof(argValues[0]);
 	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
 	static SPIPlanPtr spiPlan = NULL;
+	MemoryContext upperContext = NULL, oldContext = NULL;
+
+	/* placements of shards belonging to cached tables need no catalog access */
+	shardPlacementList = LookupShardPlacementCacheList(shardId);
+	if (shardPlacementList != NIL)
+	{
+		return shardPlacementList;
+	}
 
 	/*
 	 * SPI_connect switches to an SPI-specific MemoryContext. See the comment
 	 * in LoadShardIntervalList for a more extensive explanation.
 	 */
-	MemoryContext upperContext = CurrentMemoryContext, oldContext = NULL;
+	upperContext = CurrentMemoryContext;
 	SPI_connect();
 
 	if (spiPlan == NULL)
@@ -303,21 +315,19 @@ LoadShardPlacementList(int64 shardId)
 
 
 /*
- * PartitionColumn looks up the column used to partition a given distributed
- * table and returns a reference to a Var representing that column. If no entry
- * can be found using the provided identifier, this function throws an error.
+ * LoadTableShardPlacementList gathers metadata for the placements of all shards
+ * of a given distributed table and returns a list of ShardPlacements containing
+ * that metadata. Like LoadShardIntervalList, this function reads the metadata
+ * using the latest snapshot and returns an empty list if no placements exist.
  */
-Var *
-PartitionColumn(Oid distributedTableId)
+List *
+LoadTableShardPlacementList(Oid distributedTableId)
 {
-	Var *partitionColumn = NULL;
+	List *shardPlacementList = NIL;
 	Oid argTypes[] = { OIDOID };
 	Datum argValues[] = { ObjectIdGetDatum(distributedTableId) };
 	const int argCount = sizeof(argValues) / sizeof(argValues[0]);
 	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
-	bool isNull = false;
-	Datum keyDatum = 0;
-	char *partitionColumnName = NULL;
 	static SPIPlanPtr spiPlan = NULL;
 
 	/*
@@ -329,61 +339,59 @@ PartitionColumn(Oid distributedTableId)
 
 	if (spiPlan == NULL)
 	{
-		spiPlan = SPI_prepare("SELECT key FROM pgs_distribution_metadata.partition "
-							  "WHERE relation_id = $1", argCount, argTypes);
+		spiPlan = SPI_prepare(TABLE_SHARD_PLACEMENT_QUERY, argCount, argTypes);
 
 		spiStatus = SPI_keepplan(spiPlan);
 		Assert(spiStatus == 0);
 	}
 
-	spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 1);
+	spiStatus = ExecuteMetadataPlan(spiPlan, argValues, 0);
 	Assert(spiStatus == SPI_OK_SELECT);
 
-	if (SPI_processed != 1)
-	{
-		char *relationName = get_rel_name(distributedTableId);
-
-		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
-						errmsg("no partition column is defined for relation \"%s\"",
-							   relationName)));
-	}
-
-	keyDatum = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isNull);
 	oldContext = MemoryContextSwitchTo(upperContext);
-	partitionColumnName = TextDatumGetCString(keyDatum);
 
-	partitionColumn = ColumnNameToColumn(distributedTableId, partitionColumnName);
+	for (uint32 rowNumber = 0; rowNumber < SPI_processed; rowNumber++)
+	{
+		HeapTuple heapTuple = SPI_tuptable->vals[rowNumber];
+		ShardPlacement *shardPlacement = TupleToShardPlacement(heapTuple,
+															   SPI_tuptable->tupdesc);
+		shardPlacementList = lappend(shardPlacementList, shardPlacement);
+	}
 
 	MemoryContextSwitchTo(oldContext);
 
 	SPI_finish();
 
-	return partitionColumn;
+	return shardPlacementList;
 }
 
 
 /*
- * PartitionType looks up the type used to partition a given distributed
- * table and returns a char representing this type. If no entry can be found
- * using the provided identifer, this function throws an error.
+ * LoadPartitionMetadata looks up the partition row of a given table using the
+ * latest snapshot. If the table is distributed, the function sets the output
+ * parameters to the table's partition method and key and returns true; else it
+ * returns false without touching these parameters.
  */
-char
-PartitionType(Oid distributedTableId)
+bool
+LoadPartitionMetadata(Oid distributedTableId, char *partitionMethod, char **partitionKey)
 {
-	char partitionType = 0;
+	bool isDistributedTable = false;
 	Oid argTypes[] = { OIDOID };
 	Datum argValues[] = { ObjectIdGetDatum(distributedTableId) };
 	const int argCount = sizeof(argValues) / sizeof(argValues[0]);
 	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
-	bool isNull = false;
-	Datum partitionTypeDatum = 0;
 	static SPIPlanPtr spiPlan = NULL;
 
+	/*
+	 * SPI_connect switches to an SPI-specific MemoryContext. See the comment
+	 * in LoadShardIntervalList for a more extensive explanation.
+	 */
+	MemoryContext upperContext = CurrentMemoryContext, oldContext = NULL;
 	SPI_connect();
 
 	if (spiPlan == NULL)
 	{
-		spiPlan = SPI_prepare("SELECT partition_method "
+		spiPlan = SPI_prepare("SELECT partition_method, key "
 							  "FROM pgs_distribution_metadata.partition "
 							  "WHERE relation_id = $1", argCount, argTypes);
 
@@ -391,10 +399,43 @@ PartitionType(Oid distributedTableId)
 		Assert(spiStatus == 0);
 	}
 
-	spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 1);
+	spiStatus = ExecuteMetadataPlan(spiPlan, argValues, 1);
 	Assert(spiStatus == SPI_OK_SELECT);
 
-	if (SPI_processed != 1)
+	isDistributedTable = (SPI_processed == 1);
+	if (isDistributedTable)
+	{
+		HeapTuple heapTuple = SPI_tuptable->vals[0];
+		TupleDesc tupleDescriptor = SPI_tuptable->tupdesc;
+		bool isNull = false;
+
+		Datum methodDatum = SPI_getbinval(heapTuple, tupleDescriptor, 1, &isNull);
+		Datum keyDatum = SPI_getbinval(heapTuple, tupleDescriptor, 2, &isNull);
+
+		oldContext = MemoryContextSwitchTo(upperContext);
+
+		(*partitionMethod) = DatumGetChar(methodDatum);
+		(*partitionKey) = TextDatumGetCString(keyDatum);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	SPI_finish();
+
+	return isDistributedTable;
+}
+
+
+/*
+ * PartitionColumn looks up the column used to partition a given distributed
+ * table and returns a reference to a Var representing that column. If no entry
+ * can be found using the provided identifier, this function throws an error.
+ */
+Var *
+PartitionColumn(Oid distributedTableId)
+{
+	DistTableCacheEntry *cacheEntry = LookupDistTableCacheEntry(distributedTableId);
+	if (!cacheEntry->isDistributedTable)
 	{
 		char *relationName = get_rel_name(distributedTableId);
 
@@ -403,13 +444,29 @@ PartitionType(Oid distributedTableId)
 							   relationName)));
 	}
 
-	partitionTypeDatum = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1,
-									   &isNull);
-	partitionType = DatumGetChar(partitionTypeDatum);
+	return copyObject(cacheEntry->partitionColumn);
+}
 
-	SPI_finish();
 
-	return partitionType;
+/*
+ * PartitionType looks up the type used to partition a given distributed
+ * table and returns a char representing this type. If no entry can be found
+ * using the provided identifer, this function throws an error.
+ */
+char
+PartitionType(Oid distributedTableId)
+{
+	DistTableCacheEntry *cacheEntry = LookupDistTableCacheEntry(distributedTableId);
+	if (!cacheEntry->isDistributedTable)
+	{
+		char *relationName = get_rel_name(distributedTableId);
+
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+						errmsg("no partition column is defined for relation \"%s\"",
+							   relationName)));
+	}
+
+	return cacheEntry->partitionMethod;
 }
 
 
@@ -420,15 +477,9 @@ PartitionType(Oid distributedTableId)
 bool
 IsDistributedTable(Oid tableId)
 {
-	Oid metadataNamespaceOid = get_namespace_oid("pgs_distribution_metadata", false);
+	Oid metadataNamespaceOid = InvalidOid;
 	Oid tableNamespaceOid = InvalidOid;
-	Oid partitionMetadataTableOid = InvalidOid;
-	bool isDistributedTable = false;
-	Oid argTypes[] = { OIDOID };
-	Datum argValues[] = { ObjectIdGetDatum(tableId) };
-	const int argCount = sizeof(argValues) / sizeof(argValues[0]);
-	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
-	static SPIPlanPtr spiPlan = NULL;
+	DistTableCacheEntry *cacheEntry = NULL;
 
 	/* short-circuit if the input is invalid */
 	if (tableId == InvalidOid)
@@ -437,38 +488,23 @@ IsDistributedTable(Oid tableId)
 	}
 
 	/*
-	 * The query below hits the partition metadata table, so if we don't detect
-	 * that and short-circuit, we'll get infinite recursion in the planner.
+	 * Loading the metadata of a table hits the metadata tables themselves, so
+	 * if we don't detect those and short-circuit, we'll get infinite recursion
+	 * in the planner.
 	 *
 	 * Within CitusDB, a view rewrite the query to reference CitusDB catalogs,
 	 * so we also need to catch whether the table exists in a system namespace.
 	 */
+	metadataNamespaceOid = get_namespace_oid("pgs_distribution_metadata", false);
 	tableNamespaceOid = get_rel_namespace(tableId);
-	partitionMetadataTableOid = get_relname_relid("partition", metadataNamespaceOid);
-	if (IsSystemNamespace(tableNamespaceOid) || tableId == partitionMetadataTableOid)
+	if (IsSystemNamespace(tableNamespaceOid) || tableNamespaceOid == metadataNamespaceOid)
 	{
 		return false;
 	}
 
-	SPI_connect();
-
-	if (spiPlan == NULL)
-	{
-		spiPlan = SPI_prepare("SELECT NULL FROM pgs_distribution_metadata.partition "
-							  "WHERE relation_id = $1", argCount, argTypes);
-
-		spiStatus = SPI_keepplan(spiPlan);
-		Assert(spiStatus == 0);
-	}
-
-	spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 1);
-	Assert(spiStatus == SPI_OK_SELECT);
-
-	isDistributedTable = (SPI_processed == 1);
-
-	SPI_finish();
+	cacheEntry = LookupDistTableCacheEntry(tableId);
 
-	return isDistributedTable;
+	return cacheEntry->isDistributedTable;
 }
 
 
@@ -808,6 +844,45 @@ CreateShardPlacementRow(int64 shardId, ShardState shardState, char *nodeName,
 }
 
 
+/*
+ * DeleteShardRow removes the row corresponding to the provided shard identifier,
+ * erroring out if it cannot find such a row. Callers must have removed all the
+ * shard's placement rows beforehand.
+ */
+void
+DeleteShardRow(int64 shardId)
+{
+	Oid argTypes[] = { INT8OID };
+	Datum argValues[] = { Int64GetDatum(shardId) };
+	const int argCount = sizeof(argValues) / sizeof(argValues[0]);
+	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
+	static SPIPlanPtr spiPlan = NULL;
+
+	SPI_connect();
+
+	if (spiPlan == NULL)
+	{
+		spiPlan = SPI_prepare("DELETE FROM pgs_distribution_metadata.shard "
+							  "WHERE id = $1", argCount, argTypes);
+
+		spiStatus = SPI_keepplan(spiPlan);
+		Assert(spiStatus == 0);
+	}
+
+	spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 0);
+	Assert(spiStatus == SPI_OK_DELETE);
+
+	if (SPI_processed != 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+						errmsg("shard with ID " INT64_FORMAT " does not exist",
+							   shardId)));
+	}
+
+	SPI_finish();
+}
+
+
 /*
  * DeleteShardPlacementRow removes the row corresponding to the provided shard
  * placement identifier, erroring out if it cannot find such a row.
@@ -913,6 +988,20 @@ LockShardDistributionMetadata(int64 shardId, LOCKMODE lockMode)
 }
 
 
+/*
+ * LockShardRelocation returns after acquiring the lock serializing moves and
+ * splits of the specified shard, blocking if required. Unlike the other shard
+ * locks, this one does not conflict with any lock taken by modifications, so
+ * it may be held while a shard's rows are copied. The lock is released at
+ * transaction end.
+ */
+void
+LockShardRelocation(int64 shardId)
+{
+	AcquireShardLock(shardId, SHARD_LOCK_RELOCATION, ExclusiveLock);
+}
+
+
 /*
  * LockRelationDistributionMetadata returns after getting a the lock used for a
  * relation's distribution metadata, blocking if required. Only ExclusiveLock
@@ -953,4 +1042,28 @@ AcquireShardLock(int64 shardId, ShardLockType shardLockType, LOCKMODE lockMode)
 						 (uint16) shardLockType);
 
 	(void) LockAcquire(&lockTag, lockMode, sessionLock, dontWait);
+
+	/*
+	 * Like LockRelationOid, make sure we see any metadata changes committed by
+	 * the previous lock holder before reading cached placements of the shard.
+	 */
+	AcceptInvalidationMessages();
+}
+
+
+/*
+ * ExecuteMetadataPlan executes a prepared read-only SPI plan against the latest
+ * snapshot and returns the SPI status code. Metadata read this way may safely
+ * be cached beyond the end of the current transaction, even when that
+ * transaction uses a snapshot taken at its start.
+ */
+static int
+ExecuteMetadataPlan(SPIPlanPtr spiPlan, Datum *argValues, long rowCount)
+{
+	Snapshot latestSnapshot = GetLatestSnapshot();
+	bool readOnly = false;
+	bool fireTriggers = false;
+
+	return SPI_execute_snapshot(spiPlan, argValues, NULL, latestSnapshot,
+								InvalidSnapshot, readOnly, fireTriggers, rowCount);
 }
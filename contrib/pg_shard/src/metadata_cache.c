@@ -0,0 +1,1219 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/metadata_cache.c
+ *
+ * This file contains functions to cache distribution metadata. Each backend
+ * keeps the metadata of the tables it has accessed in a local cache. When
+ * pg_shard is loaded through shared_preload_libraries, the metadata is also
+ * copied into a cache in shared memory, so new backends can populate their
+ * local caches without querying the metadata tables.
+ *
+ * Both caches are kept current using relcache invalidations: triggers on the
+ * metadata tables send an invalidation for the distributed table whose rows
+ * changed, and every backend drops the table's local and shared entries when
+ * it processes that invalidation.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "connection.h"
+#include "distribution_metadata.h"
+#include "metadata_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "nodes/memnodes.h" /* IWYU pragma: keep */
+#include "nodes/pg_list.h"
+#include "nodes/primnodes.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/elog.h"
+#include "utils/errcodes.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
+
+
+/* LWLocks are referenced by pointer starting with PostgreSQL 9.4 */
+#if (PG_VERSION_NUM >= 90400)
+typedef LWLock *MetadataCacheLockId;
+#else
+typedef LWLockId MetadataCacheLockId;
+#endif
+
+
+/*
+ * MetadataCacheControl is the header of the shared metadata cache. Shard
+ * intervals and placements of cached tables are copied into an arena which
+ * follows the header; space in the arena is handed out sequentially and only
+ * reclaimed by resetting the entire cache once it fills up.
+ */
+typedef struct MetadataCacheControl
+{
+	MetadataCacheLockId lock;   /* protects the cache hash and arena */
+	uint64 nextLoadToken;       /* identifies the next backend to load an entry */
+	Size arenaSize;             /* total size of the arena in bytes */
+	Size arenaUsed;             /* bytes of the arena handed out so far */
+} MetadataCacheControl;
+
+
+/*
+ * SharedTableCacheEntry describes the cached distribution metadata of a table
+ * in shared memory. A backend about to load an uncached table's metadata first
+ * enters an invalid placeholder entry carrying a unique token. Invalidations
+ * remove the entry, so the backend may only publish what it loaded if it still
+ * finds its own placeholder afterwards.
+ */
+typedef struct SharedTableCacheEntry
+{
+	Oid relationId;             /* cache key */
+	bool isValid;               /* false while a backend loads the entry */
+	uint64 loadToken;           /* token of the backend loading the entry */
+
+	bool isDistributedTable;    /* true if a partition row exists */
+	char partitionMethod;       /* method used to partition the table */
+	NameData partitionKey;      /* name of the partition column */
+	Oid valueTypeId;            /* type of shard interval min and max values */
+	int32 shardCount;           /* number of shard intervals in arena */
+	int32 placementCount;       /* number of shard placements in arena */
+	Size dataOffset;            /* offset of intervals and placements in arena */
+} SharedTableCacheEntry;
+
+
+/* SharedShardInterval is the shared memory form of a ShardInterval */
+typedef struct SharedShardInterval
+{
+	int64 shardId;
+	Datum minValue;
+	Datum maxValue;
+} SharedShardInterval;
+
+
+/* SharedShardPlacement is the shared memory form of a ShardPlacement */
+typedef struct SharedShardPlacement
+{
+	int64 placementId;
+	int64 shardId;
+	int32 shardState;
+	int32 nodePort;
+	char nodeName[MAX_NODE_LENGTH + 1];
+} SharedShardPlacement;
+
+
+/*
+ * TableMetadata holds the distribution metadata of a table as read from either
+ * the metadata tables or the shared cache, before it is turned into a local
+ * cache entry.
+ */
+typedef struct TableMetadata
+{
+	bool isDistributedTable;
+	char partitionMethod;
+	char *partitionKey;
+	List *shardIntervalList;
+	List *shardPlacementList;
+} TableMetadata;
+
+
+/* amount of shared memory to use for the metadata cache, in kilobytes */
+int MetadataCacheSize = 2048;
+
+/* shared memory state, which remains unset unless pg_shard is preloaded */
+static MetadataCacheControl *MetadataCache = NULL;
+static char *MetadataCacheArena = NULL;
+static HTAB *SharedTableCacheHash = NULL;
+static shmem_startup_hook_type PreviousShmemStartupHook = NULL;
+
+/* backend-local caches for distributed tables and shard placements */
+static HTAB *DistTableCacheHash = NULL;
+static HTAB *ShardPlacementCacheHash = NULL;
+
+/* number of invalidations processed by this backend, to detect concurrent ones */
+static uint64 LocalInvalidationCount = 0;
+
+/*
+ * Callers may still reference the memory of invalidated entries, so that memory
+ * is only freed once the current transaction ends.
+ */
+static List *RetiredEntryContextList = NIL;
+
+/* set once the current transaction has changed any distribution metadata */
+static bool MetadataChangedInTransaction = false;
+
+/*
+ * Identifiers of the metadata tables, used to detect changes to the tables
+ * themselves. These are only valid if MetadataTableIdsValid is set.
+ */
+static bool MetadataTableIdsValid = false;
+static bool MetadataTablesAreViews = false;
+static Oid MetadataTableIds[3] = { InvalidOid, InvalidOid, InvalidOid };
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(invalidate_distribution_metadata_cache);
+
+
+/* local function forward declarations */
+static Size MetadataCacheShmemSize(void);
+static void MetadataCacheShmemStartup(void);
+static void CreateLocalCacheHashes(void);
+static bool MetadataIsCacheable(void);
+static void LoadTableMetadata(Oid relationId, TableMetadata *tableMetadata);
+static bool ReadSharedTableCacheEntry(Oid relationId, TableMetadata *tableMetadata,
+									  uint64 *loadToken);
+static void PublishSharedTableCacheEntry(Oid relationId, TableMetadata *tableMetadata,
+										 uint64 loadToken);
+static void BuildDistTableCacheEntry(DistTableCacheEntry *cacheEntry,
+									 TableMetadata *tableMetadata);
+static int CompareShardIntervals(const void *leftElement, const void *rightElement,
+								 void *context);
+static void EnterShardPlacementCacheEntries(DistTableCacheEntry *cacheEntry,
+											List *shardPlacementList);
+static void RemoveDistTableCacheEntry(DistTableCacheEntry *cacheEntry);
+static void InvalidateMetadataCacheCallback(Datum argument, Oid relationId);
+static void InvalidateSharedTableCacheEntry(Oid relationId);
+static void ResetSharedMetadataCache(void);
+static void MetadataCacheXactCallback(XactEvent event, void *argument);
+static Oid ChangedRowRelationId(HeapTuple heapTuple, TupleDesc tupleDescriptor,
+								char *columnName);
+
+
+/*
+ * InitializeMetadataCache defines the metadata cache's configuration variable
+ * and registers the callbacks the cache relies on. If pg_shard is being loaded
+ * through shared_preload_libraries, it also requests the shared memory for the
+ * shared cache; otherwise only backend-local caching is performed.
+ */
+void
+InitializeMetadataCache(void)
+{
+	DefineCustomIntVariable("pg_shard.metadata_cache_size",
+							"Sets the amount of shared memory used to cache "
+							"distribution metadata", NULL, &MetadataCacheSize, 2048, 0,
+							MAX_KILOBYTES, PGC_POSTMASTER, GUC_UNIT_KB, NULL, NULL,
+							NULL);
+
+	if (process_shared_preload_libraries_in_progress && MetadataCacheSize > 0)
+	{
+		RequestAddinShmemSpace(MetadataCacheShmemSize());
+#if (PG_VERSION_NUM >= 90600)
+		RequestNamedLWLockTranche("pg_shard", 1);
+#else
+		RequestAddinLWLocks(1);
+#endif
+
+		PreviousShmemStartupHook = shmem_startup_hook;
+		shmem_startup_hook = MetadataCacheShmemStartup;
+	}
+
+	CacheRegisterRelcacheCallback(InvalidateMetadataCacheCallback, (Datum) 0);
+	RegisterXactCallback(MetadataCacheXactCallback, NULL);
+}
+
+
+/*
+ * LookupDistTableCacheEntry returns the cache entry holding the distribution
+ * metadata of the specified table, loading that metadata if the table is not
+ * yet cached. The entry is owned by the cache and remains valid until the next
+ * time invalidation messages are processed.
+ */
+DistTableCacheEntry *
+LookupDistTableCacheEntry(Oid relationId)
+{
+	DistTableCacheEntry *cacheEntry = NULL;
+	DistTableCacheEntry newEntry;
+	List *shardPlacementList = NIL;
+	bool entryFound = false;
+
+	/* CitusDB views can't carry our triggers, so load afresh on every call */
+	if (!MetadataIsCacheable())
+	{
+		TableMetadata tableMetadata;
+
+		LoadTableMetadata(relationId, &tableMetadata);
+
+		cacheEntry = palloc0(sizeof(DistTableCacheEntry));
+		cacheEntry->relationId = relationId;
+		cacheEntry->entryContext = CurrentMemoryContext;
+		BuildDistTableCacheEntry(cacheEntry, &tableMetadata);
+
+		return cacheEntry;
+	}
+
+	if (DistTableCacheHash == NULL)
+	{
+		CreateLocalCacheHashes();
+	}
+
+	cacheEntry = hash_search(DistTableCacheHash, &relationId, HASH_FIND, &entryFound);
+	if (entryFound && cacheEntry->isValid)
+	{
+		return cacheEntry;
+	}
+
+	/*
+	 * Loading may process invalidation messages, so we build the entry outside
+	 * of the hash and retry if any invalidation arrived while we were loading.
+	 * The entry's memory context only becomes a child of CacheMemoryContext
+	 * once the entry is complete, so errors during loading don't leak memory.
+	 */
+	for (;;)
+	{
+		uint64 invalidationCount = LocalInvalidationCount;
+		TableMetadata tableMetadata;
+		MemoryContext oldContext = NULL;
+
+		memset(&newEntry, 0, sizeof(DistTableCacheEntry));
+		newEntry.relationId = relationId;
+		newEntry.entryContext = AllocSetContextCreate(CurrentMemoryContext,
+													  "pg_shard table cache entry",
+													  ALLOCSET_SMALL_MINSIZE,
+													  ALLOCSET_SMALL_INITSIZE,
+													  ALLOCSET_DEFAULT_MAXSIZE);
+
+		oldContext = MemoryContextSwitchTo(newEntry.entryContext);
+
+		LoadTableMetadata(relationId, &tableMetadata);
+		BuildDistTableCacheEntry(&newEntry, &tableMetadata);
+		shardPlacementList = tableMetadata.shardPlacementList;
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (invalidationCount == LocalInvalidationCount)
+		{
+			break;
+		}
+
+		MemoryContextDelete(newEntry.entryContext);
+	}
+
+	MemoryContextSetParent(newEntry.entryContext, CacheMemoryContext);
+
+	cacheEntry = hash_search(DistTableCacheHash, &relationId, HASH_ENTER, &entryFound);
+	if (entryFound)
+	{
+		RemoveDistTableCacheEntry(cacheEntry);
+		cacheEntry = hash_search(DistTableCacheHash, &relationId, HASH_ENTER, NULL);
+	}
+
+	memcpy(cacheEntry, &newEntry, sizeof(DistTableCacheEntry));
+	EnterShardPlacementCacheEntries(cacheEntry, shardPlacementList);
+	cacheEntry->isValid = true;
+
+	return cacheEntry;
+}
+
+
+/*
+ * LookupShardPlacementCacheList returns a copy of the cached placements of the
+ * specified shard, or an empty list if the shard's table is not in this
+ * backend's cache.
+ */
+List *
+LookupShardPlacementCacheList(int64 shardId)
+{
+	ShardPlacementCacheEntry *placementEntry = NULL;
+	List *shardPlacementList = NIL;
+	ListCell *shardPlacementCell = NULL;
+	bool entryFound = false;
+
+	if (ShardPlacementCacheHash == NULL)
+	{
+		return NIL;
+	}
+
+	placementEntry = hash_search(ShardPlacementCacheHash, &shardId, HASH_FIND,
+								 &entryFound);
+	if (!entryFound)
+	{
+		return NIL;
+	}
+
+	foreach(shardPlacementCell, placementEntry->shardPlacementList)
+	{
+		ShardPlacement *cachedPlacement = (ShardPlacement *) lfirst(shardPlacementCell);
+		ShardPlacement *shardPlacement = palloc0(sizeof(ShardPlacement));
+
+		memcpy(shardPlacement, cachedPlacement, sizeof(ShardPlacement));
+		shardPlacement->nodeName = pstrdup(cachedPlacement->nodeName);
+
+		shardPlacementList = lappend(shardPlacementList, shardPlacement);
+	}
+
+	return shardPlacementList;
+}
+
+
+/*
+ * FindShardIntervalByValue binary searches the sorted shard intervals of the
+ * given cache entry for the one containing the provided partition value. The
+ * function returns NULL if no interval contains the value, or if the entry's
+ * intervals overlap, in which case callers need to fall back to pruning.
+ */
+ShardInterval *
+FindShardIntervalByValue(DistTableCacheEntry *cacheEntry, Datum partitionValue)
+{
+	ShardInterval **shardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	FmgrInfo *comparisonFunction = cacheEntry->comparisonFunction;
+	Oid comparisonCollation = cacheEntry->comparisonCollation;
+	int lowerBound = 0;
+	int upperBound = cacheEntry->shardIntervalArrayLength;
+
+	if (!cacheEntry->hasDisjointShardIntervals)
+	{
+		return NULL;
+	}
+
+	/* find the first interval whose minimum value is above the given value */
+	while (lowerBound < upperBound)
+	{
+		int middleIndex = lowerBound + ((upperBound - lowerBound) / 2);
+		ShardInterval *shardInterval = shardIntervalArray[middleIndex];
+		Datum comparisonDatum = FunctionCall2Coll(comparisonFunction,
+												  comparisonCollation,
+												  shardInterval->minValue,
+												  partitionValue);
+
+		if (DatumGetInt32(comparisonDatum) <= 0)
+		{
+			lowerBound = middleIndex + 1;
+		}
+		else
+		{
+			upperBound = middleIndex;
+		}
+	}
+
+	/* the interval before that one is the only one which may contain the value */
+	if (lowerBound > 0)
+	{
+		ShardInterval *shardInterval = shardIntervalArray[lowerBound - 1];
+		Datum comparisonDatum = FunctionCall2Coll(comparisonFunction,
+												  comparisonCollation,
+												  partitionValue,
+												  shardInterval->maxValue);
+
+		if (DatumGetInt32(comparisonDatum) <= 0)
+		{
+			return shardInterval;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * invalidate_distribution_metadata_cache is a trigger function installed on
+ * the metadata tables. It sends a relcache invalidation for the distributed
+ * table whose metadata changed, which causes all backends to drop that table
+ * from their caches. The trigger's only argument names the column identifying
+ * the table: either a relation_id column or a shard_id column.
+ */
+Datum
+invalidate_distribution_metadata_cache(PG_FUNCTION_ARGS)
+{
+	TriggerData *triggerData = (TriggerData *) fcinfo->context;
+	Trigger *trigger = NULL;
+	TupleDesc tupleDescriptor = NULL;
+	char *columnName = NULL;
+	HeapTuple changedTuples[2] = { NULL, NULL };
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+	{
+		ereport(ERROR, (errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+						errmsg("function must be called as a trigger")));
+	}
+
+	trigger = triggerData->tg_trigger;
+	if (trigger->tgnargs != 1 || !TRIGGER_FIRED_FOR_ROW(triggerData->tg_event) ||
+		!TRIGGER_FIRED_AFTER(triggerData->tg_event))
+	{
+		ereport(ERROR, (errcode(ERRCODE_E_R_I_E_TRIGGER_PROTOCOL_VIOLATED),
+						errmsg("function must be fired AFTER ROW with one argument")));
+	}
+
+	columnName = trigger->tgargs[0];
+	tupleDescriptor = triggerData->tg_relation->rd_att;
+
+	/* updates may move rows between tables, so look at the old and new rows */
+	changedTuples[0] = triggerData->tg_trigtuple;
+	if (TRIGGER_FIRED_BY_UPDATE(triggerData->tg_event))
+	{
+		changedTuples[1] = triggerData->tg_newtuple;
+	}
+
+	for (int tupleIndex = 0; tupleIndex < 2; tupleIndex++)
+	{
+		Oid relationId = InvalidOid;
+
+		if (changedTuples[tupleIndex] == NULL)
+		{
+			continue;
+		}
+
+		/*
+		 * Dropping a table sends an invalidation for it by itself, so there is
+		 * nothing to do if the table no longer exists.
+		 */
+		relationId = ChangedRowRelationId(changedTuples[tupleIndex], tupleDescriptor,
+										  columnName);
+		if (relationId != InvalidOid &&
+			SearchSysCacheExists1(RELOID, ObjectIdGetDatum(relationId)))
+		{
+			CacheInvalidateRelcacheByRelid(relationId);
+		}
+	}
+
+	MetadataChangedInTransaction = true;
+
+	return PointerGetDatum(NULL);
+}
+
+
+/*
+ * MetadataCacheShmemSize returns the amount of shared memory required by the
+ * shared metadata cache.
+ */
+static Size
+MetadataCacheShmemSize(void)
+{
+	Size controlSize = sizeof(MetadataCacheControl);
+	Size arenaSize = mul_size(MetadataCacheSize, 1024);
+	Size hashSize = hash_estimate_size(MAX_SHARED_CACHE_TABLES,
+									   sizeof(SharedTableCacheEntry));
+
+	return add_size(add_size(MAXALIGN(controlSize), arenaSize), hashSize);
+}
+
+
+/*
+ * MetadataCacheShmemStartup allocates and initializes the shared metadata cache
+ * and its hash table, or attaches to them if they already exist.
+ */
+static void
+MetadataCacheShmemStartup(void)
+{
+	Size controlSize = add_size(MAXALIGN(sizeof(MetadataCacheControl)),
+								mul_size(MetadataCacheSize, 1024));
+	bool alreadyInitialized = false;
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	if (PreviousShmemStartupHook != NULL)
+	{
+		PreviousShmemStartupHook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	MetadataCache = ShmemInitStruct("pg_shard metadata cache", controlSize,
+									&alreadyInitialized);
+	MetadataCacheArena = ((char *) MetadataCache) +
+						 MAXALIGN(sizeof(MetadataCacheControl));
+	if (!alreadyInitialized)
+	{
+#if (PG_VERSION_NUM >= 90600)
+		MetadataCache->lock = &(GetNamedLWLockTranche("pg_shard"))->lock;
+#else
+		MetadataCache->lock = LWLockAssign();
+#endif
+		MetadataCache->nextLoadToken = 1;
+		MetadataCache->arenaSize = mul_size(MetadataCacheSize, 1024);
+		MetadataCache->arenaUsed = 0;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(SharedTableCacheEntry);
+	info.hash = tag_hash;
+
+	SharedTableCacheHash = ShmemInitHash("pg_shard metadata cache hash",
+										 MAX_SHARED_CACHE_TABLES,
+										 MAX_SHARED_CACHE_TABLES, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+
+/*
+ * CreateLocalCacheHashes creates the backend-local hashes holding cached
+ * tables and shard placements.
+ */
+static void
+CreateLocalCacheHashes(void)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(DistTableCacheEntry);
+	info.hash = tag_hash;
+	info.hcxt = CacheMemoryContext;
+
+	DistTableCacheHash = hash_create("pg_shard table cache", INITIAL_LOCAL_CACHE_SIZE,
+									 &info, hashFlags);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(int64);
+	info.entrysize = sizeof(ShardPlacementCacheEntry);
+	info.hash = tag_hash;
+	info.hcxt = CacheMemoryContext;
+
+	ShardPlacementCacheHash = hash_create("pg_shard placement cache",
+										  INITIAL_LOCAL_CACHE_SIZE, &info, hashFlags);
+}
+
+
+/*
+ * MetadataIsCacheable returns whether the metadata tables are regular tables,
+ * which carry the triggers needed to invalidate cached metadata. Within CitusDB
+ * the metadata "tables" are views over CitusDB's catalogs instead, and nothing
+ * may be cached. As a side effect, this function remembers the identifiers of
+ * the metadata tables so that changes to the tables themselves are detected.
+ */
+static bool
+MetadataIsCacheable(void)
+{
+	if (!MetadataTableIdsValid)
+	{
+		Oid metadataNamespaceOid = get_namespace_oid("pgs_distribution_metadata",
+													 false);
+		Oid partitionTableOid = get_relname_relid("partition", metadataNamespaceOid);
+
+		MetadataTableIds[0] = partitionTableOid;
+		MetadataTableIds[1] = get_relname_relid("shard", metadataNamespaceOid);
+		MetadataTableIds[2] = get_relname_relid("shard_placement", metadataNamespaceOid);
+
+		MetadataTablesAreViews = (get_rel_relkind(partitionTableOid) != RELKIND_RELATION);
+		MetadataTableIdsValid = true;
+	}
+
+	return !MetadataTablesAreViews;
+}
+
+
+/*
+ * LoadTableMetadata reads the distribution metadata of a table into the given
+ * struct, preferring the shared cache over the metadata tables. Metadata read
+ * from the tables is published to the shared cache where possible.
+ */
+static void
+LoadTableMetadata(Oid relationId, TableMetadata *tableMetadata)
+{
+	uint64 loadToken = 0;
+
+	memset(tableMetadata, 0, sizeof(TableMetadata));
+
+	/* never publish metadata this transaction may still roll back */
+	if (MetadataCache != NULL && !MetadataChangedInTransaction && MetadataIsCacheable())
+	{
+		bool foundInSharedCache = ReadSharedTableCacheEntry(relationId, tableMetadata,
+															&loadToken);
+		if (foundInSharedCache)
+		{
+			return;
+		}
+	}
+
+	tableMetadata->isDistributedTable =
+		LoadPartitionMetadata(relationId, &tableMetadata->partitionMethod,
+							  &tableMetadata->partitionKey);
+	if (tableMetadata->isDistributedTable)
+	{
+		tableMetadata->shardIntervalList = LoadShardIntervalList(relationId);
+		tableMetadata->shardPlacementList = LoadTableShardPlacementList(relationId);
+	}
+
+	if (loadToken != 0)
+	{
+		PublishSharedTableCacheEntry(relationId, tableMetadata, loadToken);
+	}
+}
+
+
+/*
+ * ReadSharedTableCacheEntry copies the specified table's metadata out of the
+ * shared cache and returns true if it is cached. Otherwise, the function enters
+ * a placeholder for the table, sets loadToken to that placeholder's token and
+ * returns false; the token is left as zero if no placeholder could be entered.
+ */
+static bool
+ReadSharedTableCacheEntry(Oid relationId, TableMetadata *tableMetadata,
+						  uint64 *loadToken)
+{
+	SharedTableCacheEntry *sharedEntry = NULL;
+	bool entryFound = false;
+
+	LWLockAcquire(MetadataCache->lock, LW_SHARED);
+
+	sharedEntry = hash_search(SharedTableCacheHash, &relationId, HASH_FIND, &entryFound);
+	if (entryFound && sharedEntry->isValid)
+	{
+		char *entryData = MetadataCacheArena + sharedEntry->dataOffset;
+		SharedShardInterval *sharedIntervals = (SharedShardInterval *) entryData;
+		SharedShardPlacement *sharedPlacements =
+			(SharedShardPlacement *) (sharedIntervals + sharedEntry->shardCount);
+
+		tableMetadata->isDistributedTable = sharedEntry->isDistributedTable;
+		tableMetadata->partitionMethod = sharedEntry->partitionMethod;
+		tableMetadata->partitionKey = pstrdup(NameStr(sharedEntry->partitionKey));
+
+		for (int shardIndex = 0; shardIndex < sharedEntry->shardCount; shardIndex++)
+		{
+			ShardInterval *shardInterval = palloc0(sizeof(ShardInterval));
+			shardInterval->id = sharedIntervals[shardIndex].shardId;
+			shardInterval->relationId = relationId;
+			shardInterval->minValue = sharedIntervals[shardIndex].minValue;
+			shardInterval->maxValue = sharedIntervals[shardIndex].maxValue;
+			shardInterval->valueTypeId = sharedEntry->valueTypeId;
+
+			tableMetadata->shardIntervalList =
+				lappend(tableMetadata->shardIntervalList, shardInterval);
+		}
+
+		for (int placementIndex = 0; placementIndex < sharedEntry->placementCount;
+			 placementIndex++)
+		{
+			SharedShardPlacement *sharedPlacement = &sharedPlacements[placementIndex];
+			ShardPlacement *shardPlacement = palloc0(sizeof(ShardPlacement));
+			shardPlacement->id = sharedPlacement->placementId;
+			shardPlacement->shardId = sharedPlacement->shardId;
+			shardPlacement->shardState = (ShardState) sharedPlacement->shardState;
+			shardPlacement->nodeName = pstrdup(sharedPlacement->nodeName);
+			shardPlacement->nodePort = sharedPlacement->nodePort;
+
+			tableMetadata->shardPlacementList =
+				lappend(tableMetadata->shardPlacementList, shardPlacement);
+		}
+
+		LWLockRelease(MetadataCache->lock);
+
+		return true;
+	}
+
+	LWLockRelease(MetadataCache->lock);
+
+	/* not cached yet, so enter a placeholder to publish our results later */
+	LWLockAcquire(MetadataCache->lock, LW_EXCLUSIVE);
+
+	sharedEntry = hash_search(SharedTableCacheHash, &relationId, HASH_ENTER_NULL,
+							  &entryFound);
+	if (sharedEntry != NULL && !(entryFound && sharedEntry->isValid))
+	{
+		sharedEntry->isValid = false;
+		sharedEntry->loadToken = MetadataCache->nextLoadToken++;
+
+		(*loadToken) = sharedEntry->loadToken;
+	}
+
+	LWLockRelease(MetadataCache->lock);
+
+	return false;
+}
+
+
+/*
+ * PublishSharedTableCacheEntry copies the given metadata of the specified table
+ * into the shared cache, provided the placeholder entered by this backend has
+ * not been removed by an invalidation in the meantime. Tables whose shard
+ * interval values aren't passed by value are not published.
+ */
+static void
+PublishSharedTableCacheEntry(Oid relationId, TableMetadata *tableMetadata,
+							 uint64 loadToken)
+{
+	SharedTableCacheEntry *sharedEntry = NULL;
+	int shardCount = list_length(tableMetadata->shardIntervalList);
+	int placementCount = list_length(tableMetadata->shardPlacementList);
+	Oid valueTypeId = InvalidOid;
+	Size dataSize = 0;
+	bool publishable = true;
+	bool entryFound = false;
+
+	if (shardCount > 0)
+	{
+		ShardInterval *firstInterval = linitial(tableMetadata->shardIntervalList);
+		valueTypeId = firstInterval->valueTypeId;
+		publishable = get_typbyval(valueTypeId);
+	}
+
+	if (tableMetadata->isDistributedTable &&
+		strlen(tableMetadata->partitionKey) >= NAMEDATALEN)
+	{
+		publishable = false;
+	}
+
+	dataSize = MAXALIGN(mul_size(shardCount, sizeof(SharedShardInterval)) +
+						mul_size(placementCount, sizeof(SharedShardPlacement)));
+
+	LWLockAcquire(MetadataCache->lock, LW_EXCLUSIVE);
+
+	sharedEntry = hash_search(SharedTableCacheHash, &relationId, HASH_FIND, &entryFound);
+	if (!entryFound || sharedEntry->isValid || sharedEntry->loadToken != loadToken)
+	{
+		/* an invalidation or another backend got there first */
+		LWLockRelease(MetadataCache->lock);
+		return;
+	}
+
+	if (publishable && dataSize > MetadataCache->arenaSize - MetadataCache->arenaUsed)
+	{
+		/* arena space is never reused, so start over once it is exhausted */
+		HASH_SEQ_STATUS status;
+		SharedTableCacheEntry *otherEntry = NULL;
+
+		hash_seq_init(&status, SharedTableCacheHash);
+		while ((otherEntry = hash_seq_search(&status)) != NULL)
+		{
+			if (otherEntry->isValid)
+			{
+				hash_search(SharedTableCacheHash, &otherEntry->relationId, HASH_REMOVE,
+							NULL);
+			}
+		}
+
+		MetadataCache->arenaUsed = 0;
+		publishable = (dataSize <= MetadataCache->arenaSize);
+	}
+
+	if (publishable)
+	{
+		char *entryData = MetadataCacheArena + MetadataCache->arenaUsed;
+		SharedShardInterval *sharedIntervals = (SharedShardInterval *) entryData;
+		SharedShardPlacement *sharedPlacements =
+			(SharedShardPlacement *) (sharedIntervals + shardCount);
+		ListCell *shardIntervalCell = NULL;
+		ListCell *shardPlacementCell = NULL;
+		int shardIndex = 0;
+		int placementIndex = 0;
+
+		foreach(shardIntervalCell, tableMetadata->shardIntervalList)
+		{
+			ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+			SharedShardInterval *sharedInterval = &sharedIntervals[shardIndex++];
+
+			sharedInterval->shardId = shardInterval->id;
+			sharedInterval->minValue = shardInterval->minValue;
+			sharedInterval->maxValue = shardInterval->maxValue;
+		}
+
+		foreach(shardPlacementCell, tableMetadata->shardPlacementList)
+		{
+			ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
+			SharedShardPlacement *sharedPlacement = &sharedPlacements[placementIndex++];
+
+			sharedPlacement->placementId = shardPlacement->id;
+			sharedPlacement->shardId = shardPlacement->shardId;
+			sharedPlacement->shardState = (int32) shardPlacement->shardState;
+			sharedPlacement->nodePort = shardPlacement->nodePort;
+			strlcpy(sharedPlacement->nodeName, shardPlacement->nodeName,
+					MAX_NODE_LENGTH + 1);
+		}
+
+		sharedEntry->isDistributedTable = tableMetadata->isDistributedTable;
+		sharedEntry->partitionMethod = tableMetadata->partitionMethod;
+		memset(&sharedEntry->partitionKey, 0, sizeof(NameData));
+		if (tableMetadata->isDistributedTable)
+		{
+			strlcpy(NameStr(sharedEntry->partitionKey), tableMetadata->partitionKey,
+					NAMEDATALEN);
+		}
+		sharedEntry->valueTypeId = valueTypeId;
+		sharedEntry->shardCount = shardCount;
+		sharedEntry->placementCount = placementCount;
+		sharedEntry->dataOffset = MetadataCache->arenaUsed;
+		sharedEntry->isValid = true;
+
+		MetadataCache->arenaUsed += dataSize;
+	}
+	else
+	{
+		hash_search(SharedTableCacheHash, &relationId, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(MetadataCache->lock);
+}
+
+
+/*
+ * BuildDistTableCacheEntry fills in the given cache entry from the provided
+ * metadata. This includes resolving the partition column and building the
+ * array of shard intervals sorted by their minimum values. All memory is
+ * allocated in the current memory context.
+ */
+static void
+BuildDistTableCacheEntry(DistTableCacheEntry *cacheEntry, TableMetadata *tableMetadata)
+{
+	TypeCacheEntry *typeEntry = NULL;
+	ListCell *shardIntervalCell = NULL;
+	int shardIntervalCount = list_length(tableMetadata->shardIntervalList);
+	int shardIndex = 0;
+
+	cacheEntry->isDistributedTable = tableMetadata->isDistributedTable;
+	if (!cacheEntry->isDistributedTable)
+	{
+		return;
+	}
+
+	cacheEntry->partitionMethod = tableMetadata->partitionMethod;
+	cacheEntry->partitionColumn = ColumnNameToColumn(cacheEntry->relationId,
+													 tableMetadata->partitionKey);
+	cacheEntry->shardIntervalList = tableMetadata->shardIntervalList;
+	cacheEntry->shardIntervalArrayLength = shardIntervalCount;
+	cacheEntry->sortedShardIntervalArray = palloc0((shardIntervalCount + 1) *
+												   sizeof(ShardInterval *));
+
+	foreach(shardIntervalCell, cacheEntry->shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		cacheEntry->sortedShardIntervalArray[shardIndex++] = shardInterval;
+	}
+
+	if (shardIntervalCount == 0)
+	{
+		return;
+	}
+
+	/* hash-partitioned tables compare hash values, which have no collation */
+	if (cacheEntry->partitionMethod != HASH_PARTITION_TYPE)
+	{
+		cacheEntry->comparisonCollation = cacheEntry->partitionColumn->varcollid;
+	}
+
+	typeEntry = lookup_type_cache(cacheEntry->sortedShardIntervalArray[0]->valueTypeId,
+								  TYPECACHE_CMP_PROC_FINFO);
+	if (!OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+	{
+		return;
+	}
+
+	cacheEntry->comparisonFunction = &(typeEntry->cmp_proc_finfo);
+
+	qsort_arg(cacheEntry->sortedShardIntervalArray, shardIntervalCount,
+			  sizeof(ShardInterval *), CompareShardIntervals, cacheEntry);
+
+	/* the array may only be searched if each interval ends before the next one */
+	cacheEntry->hasDisjointShardIntervals = true;
+	for (shardIndex = 1; shardIndex < shardIntervalCount; shardIndex++)
+	{
+		ShardInterval *previousInterval =
+			cacheEntry->sortedShardIntervalArray[shardIndex - 1];
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+		Datum comparisonDatum = FunctionCall2Coll(cacheEntry->comparisonFunction,
+												  cacheEntry->comparisonCollation,
+												  previousInterval->maxValue,
+												  shardInterval->minValue);
+
+		if (DatumGetInt32(comparisonDatum) >= 0)
+		{
+			cacheEntry->hasDisjointShardIntervals = false;
+			break;
+		}
+	}
+}
+
+
+/*
+ * CompareShardIntervals is a qsort_arg comparator ordering shard intervals by
+ * their minimum values, using the comparison function of the given entry.
+ */
+static int
+CompareShardIntervals(const void *leftElement, const void *rightElement, void *context)
+{
+	ShardInterval *leftInterval = *((ShardInterval **) leftElement);
+	ShardInterval *rightInterval = *((ShardInterval **) rightElement);
+	DistTableCacheEntry *cacheEntry = (DistTableCacheEntry *) context;
+
+	Datum comparisonDatum = FunctionCall2Coll(cacheEntry->comparisonFunction,
+											  cacheEntry->comparisonCollation,
+											  leftInterval->minValue,
+											  rightInterval->minValue);
+
+	return DatumGetInt32(comparisonDatum);
+}
+
+
+/*
+ * EnterShardPlacementCacheEntries groups the given placements by shard and
+ * enters them into the placement cache, in the memory of the table's entry.
+ */
+static void
+EnterShardPlacementCacheEntries(DistTableCacheEntry *cacheEntry,
+								List *shardPlacementList)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(cacheEntry->entryContext);
+	ListCell *shardPlacementCell = NULL;
+
+	foreach(shardPlacementCell, shardPlacementList)
+	{
+		ShardPlacement *shardPlacement = (ShardPlacement *) lfirst(shardPlacementCell);
+		ShardPlacementCacheEntry *placementEntry = NULL;
+		bool entryFound = false;
+
+		placementEntry = hash_search(ShardPlacementCacheHash, &shardPlacement->shardId,
+									 HASH_ENTER, &entryFound);
+		if (!entryFound || placementEntry->relationId != cacheEntry->relationId)
+		{
+			placementEntry->relationId = cacheEntry->relationId;
+			placementEntry->shardPlacementList = NIL;
+		}
+
+		placementEntry->shardPlacementList =
+			lappend(placementEntry->shardPlacementList, shardPlacement);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * RemoveDistTableCacheEntry removes the given entry and the placements of its
+ * shards from the local caches. The memory they used is freed at the end of
+ * the current transaction.
+ */
+static void
+RemoveDistTableCacheEntry(DistTableCacheEntry *cacheEntry)
+{
+	Oid relationId = cacheEntry->relationId;
+	MemoryContext entryContext = cacheEntry->entryContext;
+	ListCell *shardIntervalCell = NULL;
+
+	foreach(shardIntervalCell, cacheEntry->shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		ShardPlacementCacheEntry *placementEntry = NULL;
+		bool entryFound = false;
+
+		placementEntry = hash_search(ShardPlacementCacheHash, &shardInterval->id,
+									 HASH_FIND, &entryFound);
+		if (entryFound && placementEntry->relationId == relationId)
+		{
+			hash_search(ShardPlacementCacheHash, &shardInterval->id, HASH_REMOVE, NULL);
+		}
+	}
+
+	hash_search(DistTableCacheHash, &relationId, HASH_REMOVE, NULL);
+
+	if (entryContext != NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+		RetiredEntryContextList = lappend(RetiredEntryContextList, entryContext);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+}
+
+
+/*
+ * InvalidateMetadataCacheCallback is the relcache invalidation callback of the
+ * metadata cache. It drops the specified table from the local and shared
+ * caches; if the relation identifier is invalid or refers to one of the
+ * metadata tables themselves, the callback drops all cached metadata.
+ */
+static void
+InvalidateMetadataCacheCallback(Datum argument, Oid relationId)
+{
+	bool resetAll = (relationId == InvalidOid);
+
+	LocalInvalidationCount++;
+
+	if (MetadataTableIdsValid)
+	{
+		for (uint32 tableIndex = 0; tableIndex < lengthof(MetadataTableIds); tableIndex++)
+		{
+			if (MetadataTableIds[tableIndex] == relationId)
+			{
+				resetAll = true;
+			}
+		}
+	}
+
+	if (resetAll)
+	{
+		MetadataTableIdsValid = false;
+	}
+
+	if (DistTableCacheHash != NULL)
+	{
+		if (resetAll)
+		{
+			HASH_SEQ_STATUS status;
+			DistTableCacheEntry *cacheEntry = NULL;
+
+			hash_seq_init(&status, DistTableCacheHash);
+			while ((cacheEntry = hash_seq_search(&status)) != NULL)
+			{
+				RemoveDistTableCacheEntry(cacheEntry);
+			}
+		}
+		else
+		{
+			DistTableCacheEntry *cacheEntry = NULL;
+			bool entryFound = false;
+
+			cacheEntry = hash_search(DistTableCacheHash, &relationId, HASH_FIND,
+									 &entryFound);
+			if (entryFound)
+			{
+				RemoveDistTableCacheEntry(cacheEntry);
+			}
+		}
+	}
+
+	if (MetadataCache != NULL)
+	{
+		if (resetAll)
+		{
+			ResetSharedMetadataCache();
+		}
+		else
+		{
+			InvalidateSharedTableCacheEntry(relationId);
+		}
+	}
+}
+
+
+/*
+ * InvalidateSharedTableCacheEntry removes the specified table's entry from the
+ * shared cache, including any placeholder a backend loading it may have left.
+ */
+static void
+InvalidateSharedTableCacheEntry(Oid relationId)
+{
+	bool entryFound = false;
+
+	/* most invalidations are for uncached tables, so check under a shared lock */
+	LWLockAcquire(MetadataCache->lock, LW_SHARED);
+	hash_search(SharedTableCacheHash, &relationId, HASH_FIND, &entryFound);
+	LWLockRelease(MetadataCache->lock);
+
+	if (entryFound)
+	{
+		LWLockAcquire(MetadataCache->lock, LW_EXCLUSIVE);
+		hash_search(SharedTableCacheHash, &relationId, HASH_REMOVE, NULL);
+		LWLockRelease(MetadataCache->lock);
+	}
+}
+
+
+/*
+ * ResetSharedMetadataCache removes all entries from the shared cache and frees
+ * all space in its arena.
+ */
+static void
+ResetSharedMetadataCache(void)
+{
+	HASH_SEQ_STATUS status;
+	SharedTableCacheEntry *sharedEntry = NULL;
+
+	LWLockAcquire(MetadataCache->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, SharedTableCacheHash);
+	while ((sharedEntry = hash_seq_search(&status)) != NULL)
+	{
+		hash_search(SharedTableCacheHash, &sharedEntry->relationId, HASH_REMOVE, NULL);
+	}
+
+	MetadataCache->arenaUsed = 0;
+
+	LWLockRelease(MetadataCache->lock);
+}
+
+
+/*
+ * MetadataCacheXactCallback frees the memory of entries invalidated during the
+ * transaction and clears the flag marking metadata changes once the transaction
+ * which made them has ended.
+ */
+static void
+MetadataCacheXactCallback(XactEvent event, void *argument)
+{
+	if (event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT ||
+		event == XACT_EVENT_PREPARE)
+	{
+		ListCell *entryContextCell = NULL;
+
+		foreach(entryContextCell, RetiredEntryContextList)
+		{
+			MemoryContext entryContext = (MemoryContext) lfirst(entryContextCell);
+			MemoryContextDelete(entryContext);
+		}
+
+		list_free(RetiredEntryContextList);
+		RetiredEntryContextList = NIL;
+
+		MetadataChangedInTransaction = false;
+	}
+}
+
+
+/*
+ * ChangedRowRelationId returns the identifier of the distributed table a changed
+ * metadata row refers to, using the named column. A shard_id column is resolved
+ * through the shard's row; InvalidOid is returned if that row doesn't exist.
+ */
+static Oid
+ChangedRowRelationId(HeapTuple heapTuple, TupleDesc tupleDescriptor, char *columnName)
+{
+	int columnNumber = SPI_fnumber(tupleDescriptor, columnName);
+	Oid columnTypeId = InvalidOid;
+	Datum columnDatum = 0;
+	bool isNull = false;
+
+	if (columnNumber <= 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" does not exist", columnName)));
+	}
+
+	columnTypeId = SPI_gettypeid(tupleDescriptor, columnNumber);
+	columnDatum = SPI_getbinval(heapTuple, tupleDescriptor, columnNumber, &isNull);
+	if (isNull)
+	{
+		return InvalidOid;
+	}
+
+	if (columnTypeId == OIDOID)
+	{
+		return DatumGetObjectId(columnDatum);
+	}
+	else if (columnTypeId == INT8OID)
+	{
+		return LoadShardRelationId(DatumGetInt64(columnDatum));
+	}
+	else
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("column \"%s\" must be of type oid or bigint",
+							   columnName)));
+	}
+
+	return InvalidOid;
+}
@@ -0,0 +1,1894 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/move_shards.c
+ *
+ * This file contains functions to move shard placements between nodes and to
+ * split shards while modifications to them continue. Rows are first copied
+ * using a consistent snapshot, after which changes made in the meantime are
+ * read from a logical replication slot and applied to the new placements.
+ * Modifications are only blocked while the last of these changes are applied
+ * and the distribution metadata is switched over.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "connection.h"
+#include "create_shards.h"
+#include "ddl_commands.h"
+#include "distribution_metadata.h"
+#include "move_shards.h"
+#include "repair_shards.h"
+
+#include <poll.h>
+#include <string.h>
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/tupdesc.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "nodes/primnodes.h"
+#include "storage/lock.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/elog.h"
+#include "utils/errcodes.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#include "utils/typcache.h"
+
+
+/*
+ * ShardColumnInfo holds what is needed to turn decoded changes of a shard back
+ * into SQL statements and, for hash partitioned tables, to find the shard to
+ * which a changed row belongs.
+ */
+typedef struct ShardColumnInfo
+{
+	List *columnNameList;       /* names of all columns of the table */
+	char *partitionColumnName;  /* name of the partition column */
+	Oid partitionTypeInput;     /* input function of the partition column */
+	Oid partitionTypeIOParam;   /* parameter to pass to that function */
+	FmgrInfo *hashFunction;     /* hash function, if hash partitioned */
+	char *hashFunctionName;     /* qualified name of the hash function */
+} ShardColumnInfo;
+
+
+/*
+ * DecodedColumn holds a single column value of a change printed by the output
+ * plugin. The literal may be used in SQL as is, whereas the text is the value's
+ * external representation.
+ */
+typedef struct DecodedColumn
+{
+	char *columnName;       /* unquoted column name */
+	char *typeName;         /* formatted type of the column */
+	char *valueLiteral;     /* quoted SQL literal of the value */
+	char *valueText;        /* text representation of the value */
+	bool isNull;            /* true if the value is null */
+	bool isUnchangedToast;  /* true if an update kept a toasted value */
+} DecodedColumn;
+
+
+/*
+ * DecodedChange represents a row inserted, updated, or deleted in a shard. As
+ * source placements use full replica identity, updates and deletes always
+ * carry the entire old row.
+ */
+typedef struct DecodedChange
+{
+	CmdType changeType;     /* CMD_INSERT, CMD_UPDATE, or CMD_DELETE */
+	List *oldColumnList;    /* DecodedColumn list of the old row */
+	List *newColumnList;    /* DecodedColumn list of the new row */
+} DecodedChange;
+
+
+/* local function forward declarations */
+static ShardPlacement * FindPlacementOnNode(List *shardPlacementList, char *nodeName,
+											int32 nodePort);
+static void CheckOnlineCopySupported(Oid distributedTableId);
+static OnlineCopySource * MakeOnlineCopySource(Oid distributedTableId, int64 shardId,
+											   char *nodeName, int32 nodePort);
+static OnlineCopyTarget * MakeOnlineCopyTarget(Oid distributedTableId, int64 shardId,
+											   char *nodeName, int32 nodePort);
+static ShardColumnInfo * BuildShardColumnInfo(Oid distributedTableId);
+static void CopyShardOnline(Oid distributedTableId, int64 shardId, List *sourceList);
+static void PrepareOnlineCopySource(Oid distributedTableId, OnlineCopySource *source,
+									ShardColumnInfo *columnInfo);
+static char * ReplicaIdentityResetCommand(OnlineCopySource *source);
+static char * CreateLogicalSlot(OnlineCopySource *source);
+static void StartTargetCopy(OnlineCopySource *source, OnlineCopyTarget *target,
+							char *snapshotName, ShardColumnInfo *columnInfo);
+static void CopySnapshotRows(List *sourceList);
+static bool PumpCopyData(OnlineCopyTarget *target);
+static void WaitForCopyData(List *targetList);
+static void FinishTargetCopy(OnlineCopyTarget *target);
+static int CatchUpSources(List *sourceList, ShardColumnInfo *columnInfo);
+static int CatchUpSource(OnlineCopySource *source, ShardColumnInfo *columnInfo);
+static void ApplyChangeBatches(OnlineCopySource *source);
+static bool ParseDecodedChange(char *changeText, char *shardName,
+							   DecodedChange *change);
+static char * ParseIdentifier(char **cursor);
+static DecodedColumn * ParseDecodedColumn(char **cursor);
+static char * ParseQuotedLiteral(char **cursor, char **valueText);
+static OnlineCopyTarget * ChangeTarget(OnlineCopySource *source, DecodedChange *change,
+									   ShardColumnInfo *columnInfo);
+static DecodedColumn * FindDecodedColumn(List *decodedColumnList, char *columnName);
+static char * DecodedChangeToSQL(DecodedChange *change, char *shardName,
+								 ShardColumnInfo *columnInfo);
+static void AppendRowCondition(StringInfo sqlString, char *quotedShardName,
+							   List *oldColumnList, ShardColumnInfo *columnInfo);
+static void AppendTypedValue(StringInfo sqlString, DecodedColumn *decodedColumn);
+static void DropLogicalSlots(List *sourceList);
+static void ResetReplicaIdentity(OnlineCopySource *source);
+static void DropShardPlacementTables(Oid distributedTableId, int64 shardId,
+									 List *shardPlacementList);
+static void CleanUpOnlineCopy(List *sourceList);
+static void CloseOnlineCopyConnections(List *sourceList);
+static PGconn * OpenConnectionOrError(char *nodeName, int32 nodePort,
+									  bool replication);
+static PGresult * ExecuteRemoteCommandOrError(PGconn *connection, const char *command,
+											  ExecStatusType expectedStatus);
+static void ReportRemoteErrorAndThrow(PGconn *connection, PGresult *result,
+									  const char *failedAction);
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(master_move_shard_placement);
+PG_FUNCTION_INFO_V1(master_split_shard);
+
+
+/*
+ * master_move_shard_placement implements a user-facing UDF to move a healthy
+ * shard placement from a source node to a target node which does not have a
+ * placement of the shard yet. Modifications of the shard continue while its
+ * rows are copied, and are only blocked while the final changes are applied.
+ * The new placement is then added in finalized state, and the source placement
+ * is marked as to be deleted; its table is left in place on the source node,
+ * with its original replica identity.
+ */
+Datum
+master_move_shard_placement(PG_FUNCTION_ARGS)
+{
+	int64 shardId = PG_GETARG_INT64(0);
+	char *sourceNodeName = text_to_cstring(PG_GETARG_TEXT_P(1));
+	int32 sourceNodePort = PG_GETARG_INT32(2);
+	char *targetNodeName = text_to_cstring(PG_GETARG_TEXT_P(3));
+	int32 targetNodePort = PG_GETARG_INT32(4);
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	Oid distributedTableId = shardInterval->relationId;
+
+	List *shardPlacementList = NIL;
+	ShardPlacement *sourcePlacement = NULL;
+	ShardPlacement *existingPlacement = NULL;
+	OnlineCopySource *source = NULL;
+	OnlineCopyTarget *target = NULL;
+
+	CheckOnlineCopySupported(distributedTableId);
+
+	/* prevent concurrent moves or splits of this shard */
+	LockShardRelocation(shardId);
+
+	shardPlacementList = LoadShardPlacementList(shardId);
+	sourcePlacement = FindPlacementOnNode(shardPlacementList, sourceNodeName,
+										  sourceNodePort);
+	if (sourcePlacement == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+						errmsg("could not find placement matching \"%s:%d\"",
+							   sourceNodeName, sourceNodePort),
+						errhint("Confirm the placement still exists and try again.")));
+	}
+
+	if (sourcePlacement->shardState != STATE_FINALIZED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("source placement must be in finalized state")));
+	}
+
+	existingPlacement = FindPlacementOnNode(shardPlacementList, targetNodeName,
+											targetNodePort);
+	if (existingPlacement != NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("target node already has a placement of shard "
+							   INT64_FORMAT, shardId),
+						errhint("Use master_copy_shard_placement to repair inactive "
+								"placements.")));
+	}
+
+	source = MakeOnlineCopySource(distributedTableId, shardId, sourceNodeName,
+								  sourceNodePort);
+	target = MakeOnlineCopyTarget(distributedTableId, shardId, targetNodeName,
+								  targetNodePort);
+	source->targetList = list_make1(target);
+
+	CopyShardOnline(distributedTableId, shardId, list_make1(source));
+
+	/* modifications are blocked until we commit, so switch placements over */
+	CreateShardPlacementRow(shardId, STATE_FINALIZED, targetNodeName, targetNodePort);
+	UpdateShardPlacementRowState(sourcePlacement->id, STATE_TO_DELETE);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * master_split_shard implements a user-facing UDF to split a shard of a hash
+ * partitioned table into two shards, the second of which starts at the given
+ * hash token. Each finalized placement of the shard is split into placements
+ * of both new shards on the same node while modifications continue. Once the
+ * new placements caught up, the metadata of the original shard is removed and
+ * its tables are dropped. The function returns the identifiers of the new
+ * shards.
+ */
+Datum
+master_split_shard(PG_FUNCTION_ARGS)
+{
+	int64 shardId = PG_GETARG_INT64(0);
+	int32 splitHashToken = PG_GETARG_INT32(1);
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	Oid distributedTableId = shardInterval->relationId;
+	int32 minHashToken = 0;
+	int32 maxHashToken = 0;
+
+	int64 lowerShardId = -1;
+	int64 upperShardId = -1;
+	List *finalizedPlacementList = NIL;
+	List *shardPlacementList = NIL;
+	List *sourceList = NIL;
+	ListCell *placementCell = NULL;
+	Datum newShardIdDatums[2];
+	ArrayType *newShardIdArray = NULL;
+
+	CheckOnlineCopySupported(distributedTableId);
+
+	if (PartitionType(distributedTableId) != HASH_PARTITION_TYPE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot split shard"),
+						errdetail("Only shards of hash partitioned tables may be "
+								  "split.")));
+	}
+
+	minHashToken = DatumGetInt32(shardInterval->minValue);
+	maxHashToken = DatumGetInt32(shardInterval->maxValue);
+	if (splitHashToken <= minHashToken || splitHashToken > maxHashToken)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("split value must lie within the shard's hash range"),
+						errdetail("Shard " INT64_FORMAT " covers hash tokens %d to "
+								  "%d; the split value must be greater than the "
+								  "first of these.", shardId, minHashToken,
+								  maxHashToken)));
+	}
+
+	/* prevent concurrent moves or splits of this shard */
+	LockShardRelocation(shardId);
+
+	finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
+	if (finalizedPlacementList == NIL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+						errmsg("could not find any finalized placements of shard "
+							   INT64_FORMAT, shardId)));
+	}
+
+	/* the new shards remain invisible to others until we commit */
+	lowerShardId = CreateShardRow(distributedTableId, SHARD_STORAGE_TABLE,
+								  IntegerToText(minHashToken),
+								  IntegerToText(splitHashToken - 1));
+	upperShardId = CreateShardRow(distributedTableId, SHARD_STORAGE_TABLE,
+								  IntegerToText(splitHashToken),
+								  IntegerToText(maxHashToken));
+
+	foreach(placementCell, finalizedPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		OnlineCopySource *source = NULL;
+		OnlineCopyTarget *lowerTarget = NULL;
+		OnlineCopyTarget *upperTarget = NULL;
+
+		source = MakeOnlineCopySource(distributedTableId, shardId, placement->nodeName,
+									  placement->nodePort);
+
+		lowerTarget = MakeOnlineCopyTarget(distributedTableId, lowerShardId,
+										   placement->nodeName, placement->nodePort);
+		lowerTarget->filterRows = true;
+		lowerTarget->minHashToken = minHashToken;
+		lowerTarget->maxHashToken = splitHashToken - 1;
+
+		upperTarget = MakeOnlineCopyTarget(distributedTableId, upperShardId,
+										   placement->nodeName, placement->nodePort);
+		upperTarget->filterRows = true;
+		upperTarget->minHashToken = splitHashToken;
+		upperTarget->maxHashToken = maxHashToken;
+
+		source->targetList = list_make2(lowerTarget, upperTarget);
+		sourceList = lappend(sourceList, source);
+	}
+
+	CopyShardOnline(distributedTableId, shardId, sourceList);
+
+	/* modifications are blocked until we commit, so replace the shard */
+	shardPlacementList = LoadShardPlacementList(shardId);
+	foreach(placementCell, shardPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+
+		DeleteShardPlacementRow(placement->id);
+	}
+
+	DeleteShardRow(shardId);
+
+	foreach(placementCell, finalizedPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+
+		CreateShardPlacementRow(lowerShardId, STATE_FINALIZED, placement->nodeName,
+								placement->nodePort);
+		CreateShardPlacementRow(upperShardId, STATE_FINALIZED, placement->nodeName,
+								placement->nodePort);
+	}
+
+	DropShardPlacementTables(distributedTableId, shardId, shardPlacementList);
+
+	newShardIdDatums[0] = Int64GetDatum(lowerShardId);
+	newShardIdDatums[1] = Int64GetDatum(upperShardId);
+	newShardIdArray = construct_array(newShardIdDatums, 2, INT8OID, sizeof(int64),
+									  FLOAT8PASSBYVAL, 'd');
+
+	PG_RETURN_ARRAYTYPE_P(newShardIdArray);
+}
+
+
+/*
+ * FindPlacementOnNode searches a provided list for a shard placement with the
+ * specified node name and port, and returns NULL if no such placement exists.
+ */
+static ShardPlacement *
+FindPlacementOnNode(List *shardPlacementList, char *nodeName, int32 nodePort)
+{
+	ListCell *shardPlacementCell = NULL;
+
+	foreach(shardPlacementCell, shardPlacementList)
+	{
+		ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
+
+		if (strncmp(nodeName, shardPlacement->nodeName, MAX_NODE_LENGTH) == 0 &&
+			nodePort == shardPlacement->nodePort)
+		{
+			return shardPlacement;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CheckOnlineCopySupported errors out if the shards of the given table cannot
+ * be copied online. Foreign tables cannot be decoded, so they are rejected.
+ */
+static void
+CheckOnlineCopySupported(Oid distributedTableId)
+{
+	char relationKind = get_rel_relkind(distributedTableId);
+	if (relationKind == RELKIND_FOREIGN_TABLE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot move or split shard"),
+						errdetail("Moving or splitting shards backed by foreign "
+								  "tables is not supported.")));
+	}
+}
+
+
+/*
+ * MakeOnlineCopySource returns a source without targets for the placement of
+ * the given shard on the specified node. The name of its replication slot is
+ * unique among concurrent copies from the same node.
+ */
+static OnlineCopySource *
+MakeOnlineCopySource(Oid distributedTableId, int64 shardId, char *nodeName,
+					 int32 nodePort)
+{
+	OnlineCopySource *source = palloc0(sizeof(OnlineCopySource));
+	char *shardName = get_rel_name(distributedTableId);
+
+	AppendShardIdToName(&shardName, shardId);
+
+	source->shardId = shardId;
+	source->shardName = shardName;
+	source->nodeName = nodeName;
+	source->nodePort = nodePort;
+
+	snprintf(source->slotName, NAMEDATALEN, LOGICAL_SLOT_NAME_FORMAT, shardId,
+			 MyProcPid);
+
+	return source;
+}
+
+
+/*
+ * MakeOnlineCopyTarget returns a target receiving all rows for a placement of
+ * the given shard on the specified node.
+ */
+static OnlineCopyTarget *
+MakeOnlineCopyTarget(Oid distributedTableId, int64 shardId, char *nodeName,
+					 int32 nodePort)
+{
+	OnlineCopyTarget *target = palloc0(sizeof(OnlineCopyTarget));
+	char *shardName = get_rel_name(distributedTableId);
+
+	AppendShardIdToName(&shardName, shardId);
+
+	target->shardId = shardId;
+	target->shardName = shardName;
+	target->nodeName = nodeName;
+	target->nodePort = nodePort;
+	target->changeBatch = makeStringInfo();
+
+	return target;
+}
+
+
+/*
+ * BuildShardColumnInfo collects the column names of the given table and, for
+ * hash partitioned tables, the functions needed to hash partition values.
+ */
+static ShardColumnInfo *
+BuildShardColumnInfo(Oid distributedTableId)
+{
+	ShardColumnInfo *columnInfo = palloc0(sizeof(ShardColumnInfo));
+	Relation distributedTable = relation_open(distributedTableId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedTable);
+	Var *partitionColumn = PartitionColumn(distributedTableId);
+	Oid partitionTypeId = partitionColumn->vartype;
+
+	for (int attributeIndex = 0; attributeIndex < tupleDescriptor->natts;
+		 attributeIndex++)
+	{
+		Form_pg_attribute attribute = tupleDescriptor->attrs[attributeIndex];
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		columnInfo->columnNameList = lappend(columnInfo->columnNameList,
+											 pstrdup(NameStr(attribute->attname)));
+	}
+
+	relation_close(distributedTable, AccessShareLock);
+
+	columnInfo->partitionColumnName = get_attname(distributedTableId,
+												  partitionColumn->varattno);
+	getTypeInputInfo(partitionTypeId, &columnInfo->partitionTypeInput,
+					 &columnInfo->partitionTypeIOParam);
+
+	if (PartitionType(distributedTableId) == HASH_PARTITION_TYPE)
+	{
+		TypeCacheEntry *typeEntry = lookup_type_cache(partitionTypeId,
+													  TYPECACHE_HASH_PROC_FINFO);
+		Oid hashFunctionId = typeEntry->hash_proc_finfo.fn_oid;
+
+		if (!OidIsValid(hashFunctionId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+							errmsg("could not identify a hash function for type %s",
+								   format_type_be(partitionTypeId)),
+							errdatatype(partitionTypeId)));
+		}
+
+		columnInfo->hashFunction = palloc0(sizeof(FmgrInfo));
+		fmgr_info_copy(columnInfo->hashFunction, &typeEntry->hash_proc_finfo,
+					   CurrentMemoryContext);
+		columnInfo->hashFunctionName =
+			quote_qualified_identifier(get_namespace_name(get_func_namespace(
+															  hashFunctionId)),
+									   get_func_name(hashFunctionId));
+	}
+
+	return columnInfo;
+}
+
+
+/*
+ * CopyShardOnline builds the target placements of all given sources. First, a
+ * logical replication slot is created on each source node, exporting the
+ * snapshot as of which that slot starts to capture changes. All rows visible
+ * in those snapshots are then copied to the targets in parallel. Afterwards,
+ * captured changes are applied to the targets in rounds until little remains
+ * to be done. Finally, modifications of the shard are blocked, the remaining
+ * changes applied, the slots dropped, and the replica identities of the source
+ * placements reset.
+ *
+ * On success, the function returns holding exclusive data and metadata locks
+ * on the shard, so that callers may switch the shard's placements over. If any
+ * step fails, all slots are dropped before the error is rethrown.
+ */
+static void
+CopyShardOnline(Oid distributedTableId, int64 shardId, List *sourceList)
+{
+	ShardColumnInfo *columnInfo = BuildShardColumnInfo(distributedTableId);
+
+	PG_TRY();
+	{
+		ListCell *sourceCell = NULL;
+		int changeCount = 0;
+
+		foreach(sourceCell, sourceList)
+		{
+			OnlineCopySource *source = (OnlineCopySource *) lfirst(sourceCell);
+
+			PrepareOnlineCopySource(distributedTableId, source, columnInfo);
+		}
+
+		CopySnapshotRows(sourceList);
+
+		for (int catchUpRound = 0; catchUpRound < MAX_CATCH_UP_ROUNDS; catchUpRound++)
+		{
+			changeCount = CatchUpSources(sourceList, columnInfo);
+			if (changeCount < CATCH_UP_CHANGE_THRESHOLD)
+			{
+				break;
+			}
+		}
+
+		/*
+		 * Modifications first lock the shard's metadata while planning, then
+		 * the shard's data while executing. Locking in the same order ensures
+		 * that we wait for in-flight modifications instead of deadlocking.
+		 */
+		LockShardDistributionMetadata(shardId, ExclusiveLock);
+		LockShardData(shardId, ExclusiveLock);
+
+		/* no further changes may happen, so apply all remaining ones */
+		CatchUpSources(sourceList, columnInfo);
+
+		DropLogicalSlots(sourceList);
+		CloseOnlineCopyConnections(sourceList);
+
+		foreach(sourceCell, sourceList)
+		{
+			OnlineCopySource *source = (OnlineCopySource *) lfirst(sourceCell);
+
+			ResetReplicaIdentity(source);
+		}
+	}
+	PG_CATCH();
+	{
+		CleanUpOnlineCopy(sourceList);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+
+/*
+ * PrepareOnlineCopySource recreates the tables of the source's targets, sets
+ * up the replication slot capturing changes of the source placement, and
+ * starts copying rows as of the slot's snapshot into each target.
+ */
+static void
+PrepareOnlineCopySource(Oid distributedTableId, OnlineCopySource *source,
+						ShardColumnInfo *columnInfo)
+{
+	StringInfo replicaIdentityCommand = makeStringInfo();
+	char *resetIdentityCommand = NULL;
+	ListCell *targetCell = NULL;
+	char *snapshotName = NULL;
+	bool commandsExecuted = false;
+
+	/*
+	 * Have updates and deletes log the entire old row, so that the row can be
+	 * identified on targets regardless of the table's keys. As changing this
+	 * setting locks out all writers, changes logged before it took effect are
+	 * committed before the slot is created. The original setting is restored
+	 * once the copy is over, whether it succeeds or not.
+	 */
+	resetIdentityCommand = ReplicaIdentityResetCommand(source);
+
+	appendStringInfo(replicaIdentityCommand, REPLICA_IDENTITY_FULL_COMMAND,
+					 quote_identifier(source->shardName));
+
+	commandsExecuted = ExecuteRemoteCommandList(source->nodeName, source->nodePort,
+												list_make1(replicaIdentityCommand->data));
+	if (!commandsExecuted)
+	{
+		ereport(ERROR, (errmsg("could not set replica identity of source placement"),
+						errhint("Consult recent messages in the server logs for "
+								"details.")));
+	}
+
+	source->resetIdentityCommand = resetIdentityCommand;
+
+	foreach(targetCell, source->targetList)
+	{
+		OnlineCopyTarget *target = (OnlineCopyTarget *) lfirst(targetCell);
+		List *ddlCommandList = RecreateTableDDLCommandList(distributedTableId,
+														   target->shardId);
+
+		commandsExecuted = ExecuteRemoteCommandList(target->nodeName, target->nodePort,
+													ddlCommandList);
+		if (!commandsExecuted)
+		{
+			ereport(ERROR, (errmsg("could not create shard table on target node"),
+							errhint("Consult recent messages in the server logs for "
+									"details.")));
+		}
+	}
+
+	snapshotName = CreateLogicalSlot(source);
+
+	foreach(targetCell, source->targetList)
+	{
+		OnlineCopyTarget *target = (OnlineCopyTarget *) lfirst(targetCell);
+
+		StartTargetCopy(source, target, snapshotName, columnInfo);
+	}
+
+	/* all copies imported the snapshot, so it need not be kept any longer */
+	PQfinish(source->replicationConnection);
+	source->replicationConnection = NULL;
+}
+
+
+/*
+ * ReplicaIdentityResetCommand returns the command which restores the current
+ * replica identity of the source placement's table, or NULL if the identity is
+ * already the one used during copies.
+ */
+static char *
+ReplicaIdentityResetCommand(OnlineCopySource *source)
+{
+	StringInfo identityQuery = makeStringInfo();
+	StringInfo resetCommand = makeStringInfo();
+	const char *quotedShardName = quote_identifier(source->shardName);
+	PGconn *connection = NULL;
+	PGresult *result = NULL;
+	char replicaIdentity = '\0';
+
+	connection = GetConnection(source->nodeName, source->nodePort, true);
+	if (connection == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("could not connect to \"%s:%d\"", source->nodeName,
+							   source->nodePort)));
+	}
+
+	appendStringInfo(identityQuery, REPLICA_IDENTITY_QUERY,
+					 quote_literal_cstr(quotedShardName));
+
+	result = ExecuteRemoteCommandOrError(connection, identityQuery->data,
+										 PGRES_TUPLES_OK);
+	replicaIdentity = PQgetvalue(result, 0, 0)[0];
+
+	switch (replicaIdentity)
+	{
+		case REPLICA_IDENTITY_FULL:
+		{
+			PQclear(result);
+			return NULL;
+		}
+
+		case REPLICA_IDENTITY_NOTHING:
+		{
+			appendStringInfo(resetCommand, REPLICA_IDENTITY_COMMAND, quotedShardName,
+							 "NOTHING");
+			break;
+		}
+
+		case REPLICA_IDENTITY_INDEX:
+		{
+			StringInfo usingIndex = makeStringInfo();
+
+			appendStringInfo(usingIndex, "USING INDEX %s", PQgetvalue(result, 0, 1));
+			appendStringInfo(resetCommand, REPLICA_IDENTITY_COMMAND, quotedShardName,
+							 usingIndex->data);
+			break;
+		}
+
+		default:
+		{
+			appendStringInfo(resetCommand, REPLICA_IDENTITY_COMMAND, quotedShardName,
+							 "DEFAULT");
+			break;
+		}
+	}
+
+	PQclear(result);
+
+	return resetCommand->data;
+}
+
+
+/*
+ * CreateLogicalSlot creates the logical replication slot of the given source
+ * using a replication connection, and returns the name of the snapshot that
+ * connection exports. The snapshot remains valid only until the connection is
+ * used again or closed.
+ */
+static char *
+CreateLogicalSlot(OnlineCopySource *source)
+{
+	StringInfo createSlotCommand = makeStringInfo();
+	PGresult *result = NULL;
+	char *snapshotName = NULL;
+
+	source->replicationConnection = OpenConnectionOrError(source->nodeName,
+														  source->nodePort, true);
+
+	appendStringInfo(createSlotCommand, CREATE_LOGICAL_SLOT_COMMAND,
+					 source->slotName, SHARD_MOVE_OUTPUT_PLUGIN);
+
+	result = PQexec(source->replicationConnection, createSlotCommand->data);
+	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	{
+		ReportRemoteError(source->replicationConnection, result);
+		PQclear(result);
+
+		ereport(ERROR, (errmsg("could not create logical replication slot on "
+							   "\"%s:%d\"", source->nodeName, source->nodePort),
+						errhint("Moving and splitting shards requires wal_level to "
+								"be logical and a free replication slot on the "
+								"node.")));
+	}
+
+	source->slotCreated = true;
+
+	/* the result holds the slot, its consistent point, snapshot, and plugin */
+	snapshotName = pstrdup(PQgetvalue(result, 0, 2));
+	PQclear(result);
+
+	return snapshotName;
+}
+
+
+/*
+ * StartTargetCopy opens connections to the source and target nodes of a copy,
+ * has the source connection import the given snapshot, and starts copying the
+ * target's rows from the source into the target.
+ */
+static void
+StartTargetCopy(OnlineCopySource *source, OnlineCopyTarget *target,
+				char *snapshotName, ShardColumnInfo *columnInfo)
+{
+	StringInfo setSnapshotCommand = makeStringInfo();
+	StringInfo copyOutCommand = makeStringInfo();
+	StringInfo copyInCommand = makeStringInfo();
+	const char *sourceShardName = quote_identifier(source->shardName);
+	PGresult *result = NULL;
+
+	target->copyOutConnection = OpenConnectionOrError(source->nodeName,
+													  source->nodePort, false);
+
+	result = ExecuteRemoteCommandOrError(target->copyOutConnection,
+										 BEGIN_REPEATABLE_READ_COMMAND,
+										 PGRES_COMMAND_OK);
+	PQclear(result);
+
+	appendStringInfo(setSnapshotCommand, SET_SNAPSHOT_COMMAND,
+					 quote_literal_cstr(snapshotName));
+	result = ExecuteRemoteCommandOrError(target->copyOutConnection,
+										 setSnapshotCommand->data, PGRES_COMMAND_OK);
+	PQclear(result);
+
+	if (target->filterRows)
+	{
+		appendStringInfo(copyOutCommand, COPY_OUT_HASH_RANGE_COMMAND, sourceShardName,
+						 columnInfo->hashFunctionName,
+						 quote_identifier(columnInfo->partitionColumnName),
+						 target->minHashToken, target->maxHashToken);
+	}
+	else
+	{
+		appendStringInfo(copyOutCommand, COPY_OUT_COMMAND, sourceShardName);
+	}
+
+	result = ExecuteRemoteCommandOrError(target->copyOutConnection,
+										 copyOutCommand->data, PGRES_COPY_OUT);
+	PQclear(result);
+
+	target->connection = OpenConnectionOrError(target->nodeName, target->nodePort,
+											   false);
+
+	appendStringInfo(copyInCommand, COPY_IN_COMMAND,
+					 quote_identifier(target->shardName));
+	result = ExecuteRemoteCommandOrError(target->connection, copyInCommand->data,
+										 PGRES_COPY_IN);
+	PQclear(result);
+}
+
+
+/*
+ * CopySnapshotRows streams rows from the source connections of all targets into
+ * the targets, serving whichever copies have data available. The function
+ * returns once every copy has completed.
+ */
+static void
+CopySnapshotRows(List *sourceList)
+{
+	List *targetList = NIL;
+	ListCell *sourceCell = NULL;
+	int activeCopyCount = 0;
+
+	foreach(sourceCell, sourceList)
+	{
+		OnlineCopySource *source = (OnlineCopySource *) lfirst(sourceCell);
+
+		targetList = list_concat(targetList, list_copy(source->targetList));
+	}
+
+	activeCopyCount = list_length(targetList);
+
+	while (activeCopyCount > 0)
+	{
+		ListCell *targetCell = NULL;
+		bool madeProgress = false;
+
+		foreach(targetCell, targetList)
+		{
+			OnlineCopyTarget *target = (OnlineCopyTarget *) lfirst(targetCell);
+
+			if (target->copyDone)
+			{
+				continue;
+			}
+
+			madeProgress |= PumpCopyData(target);
+
+			if (target->copyDone)
+			{
+				activeCopyCount--;
+			}
+		}
+
+		if (activeCopyCount > 0 && !madeProgress)
+		{
+			WaitForCopyData(targetList);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
+/*
+ * PumpCopyData forwards all copy data currently available on the target's
+ * source connection to the target, without waiting for more to arrive. Once
+ * the source completed its copy, the copy into the target is completed too.
+ * The function returns whether any data was forwarded.
+ */
+static bool
+PumpCopyData(OnlineCopyTarget *target)
+{
+	PGconn *copyOutConnection = target->copyOutConnection;
+	bool madeProgress = false;
+
+	if (!PQconsumeInput(copyOutConnection))
+	{
+		ReportRemoteErrorAndThrow(copyOutConnection, NULL, "copy shard rows");
+	}
+
+	for (;;)
+	{
+		char *copyData = NULL;
+		bool asynchronous = true;
+		int copyDataLength = PQgetCopyData(copyOutConnection, &copyData,
+										   asynchronous);
+
+		if (copyDataLength > 0)
+		{
+			int putStatus = PQputCopyData(target->connection, copyData, copyDataLength);
+			PQfreemem(copyData);
+
+			if (putStatus != 1)
+			{
+				ReportRemoteErrorAndThrow(target->connection, NULL, "copy shard rows");
+			}
+
+			madeProgress = true;
+		}
+		else if (copyDataLength == 0)
+		{
+			/* no complete row available yet */
+			break;
+		}
+		else if (copyDataLength == -1)
+		{
+			FinishTargetCopy(target);
+			madeProgress = true;
+			break;
+		}
+		else
+		{
+			ReportRemoteErrorAndThrow(copyOutConnection, NULL, "copy shard rows");
+		}
+	}
+
+	return madeProgress;
+}
+
+
+/*
+ * WaitForCopyData waits until one of the source connections of the unfinished
+ * copies becomes readable, or until a timeout elapses.
+ */
+static void
+WaitForCopyData(List *targetList)
+{
+	struct pollfd *pollFileDescriptors = palloc0(list_length(targetList) *
+												 sizeof(struct pollfd));
+	ListCell *targetCell = NULL;
+	int pollCount = 0;
+
+	foreach(targetCell, targetList)
+	{
+		OnlineCopyTarget *target = (OnlineCopyTarget *) lfirst(targetCell);
+
+		if (!target->copyDone)
+		{
+			pollFileDescriptors[pollCount].fd = PQsocket(target->copyOutConnection);
+			pollFileDescriptors[pollCount].events = POLLIN;
+			pollCount++;
+		}
+	}
+
+	(void) poll(pollFileDescriptors, pollCount, COPY_POLL_TIMEOUT_MS);
+
+	pfree(pollFileDescriptors);
+}
+
+
+/*
+ * FinishTargetCopy completes the copy into the given target after its source
+ * finished sending rows, and closes the source connection of the copy.
+ */
+static void
+FinishTargetCopy(OnlineCopyTarget *target)
+{
+	PGresult *result = PQgetResult(target->copyOutConnection);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportRemoteErrorAndThrow(target->copyOutConnection, result,
+								  "copy shard rows");
+	}
+
+	PQclear(result);
+
+	PQfinish(target->copyOutConnection);
+	target->copyOutConnection = NULL;
+
+	if (PQputCopyEnd(target->connection, NULL) != 1)
+	{
+		ReportRemoteErrorAndThrow(target->connection, NULL, "copy shard rows");
+	}
+
+	result = PQgetResult(target->connection);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportRemoteErrorAndThrow(target->connection, result, "copy shard rows");
+	}
+
+	PQclear(result);
+
+	/* consume the final null result of the copy */
+	result = PQgetResult(target->connection);
+	Assert(result == NULL);
+
+	target->copyDone = true;
+}
+
+
+/*
+ * CatchUpSources applies all changes captured by the slots of the given sources
+ * up to now to their targets, and returns the number of changes applied.
+ */
+static int
+CatchUpSources(List *sourceList, ShardColumnInfo *columnInfo)
+{
+	ListCell *sourceCell = NULL;
+	int changeCount = 0;
+
+	foreach(sourceCell, sourceList)
+	{
+		OnlineCopySource *source = (OnlineCopySource *) lfirst(sourceCell);
+
+		changeCount += CatchUpSource(source, columnInfo);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	return changeCount;
+}
+
+
+/*
+ * CatchUpSource fetches changes from the slot of the given source in batches,
+ * turns those made to the source's shard into SQL statements, and applies the
+ * statements to the respective targets. Each batch is applied to a target in
+ * a single transaction. The function returns the number of changes applied.
+ */
+static int
+CatchUpSource(OnlineCopySource *source, ShardColumnInfo *columnInfo)
+{
+	StringInfo getChangesQuery = makeStringInfo();
+	MemoryContext batchContext = NULL;
+	MemoryContext oldContext = NULL;
+	int changeCount = 0;
+	int rowCount = 0;
+
+	if (source->connection == NULL)
+	{
+		source->connection = OpenConnectionOrError(source->nodeName, source->nodePort,
+												   false);
+	}
+
+	appendStringInfo(getChangesQuery, GET_SLOT_CHANGES_QUERY, source->slotName,
+					 CATCH_UP_BATCH_SIZE);
+
+	batchContext = AllocSetContextCreate(CurrentMemoryContext,
+										 "Online Shard Copy Batch",
+										 ALLOCSET_DEFAULT_MINSIZE,
+										 ALLOCSET_DEFAULT_INITSIZE,
+										 ALLOCSET_DEFAULT_MAXSIZE);
+
+	do
+	{
+		PGresult *result = NULL;
+
+		oldContext = MemoryContextSwitchTo(batchContext);
+
+		result = ExecuteRemoteCommandOrError(source->connection, getChangesQuery->data,
+											 PGRES_TUPLES_OK);
+		rowCount = PQntuples(result);
+
+		for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			char *changeText = PQgetvalue(result, rowIndex, 0);
+			DecodedChange change;
+			OnlineCopyTarget *target = NULL;
+			char *changeStatement = NULL;
+
+			memset(&change, 0, sizeof(DecodedChange));
+
+			if (!ParseDecodedChange(changeText, source->shardName, &change))
+			{
+				continue;
+			}
+
+			target = ChangeTarget(source, &change, columnInfo);
+			changeStatement = DecodedChangeToSQL(&change, target->shardName,
+												 columnInfo);
+			if (changeStatement != NULL)
+			{
+				appendStringInfo(target->changeBatch, "%s;\n", changeStatement);
+				target->changeCount++;
+				changeCount++;
+			}
+		}
+
+		PQclear(result);
+
+		MemoryContextSwitchTo(oldContext);
+
+		ApplyChangeBatches(source);
+
+		MemoryContextReset(batchContext);
+	}
+	while (rowCount >= CATCH_UP_BATCH_SIZE);
+
+	MemoryContextDelete(batchContext);
+
+	return changeCount;
+}
+
+
+/*
+ * ApplyChangeBatches sends the statements batched up for each target of the
+ * given source to that target, and resets the batches.
+ */
+static void
+ApplyChangeBatches(OnlineCopySource *source)
+{
+	ListCell *targetCell = NULL;
+
+	foreach(targetCell, source->targetList)
+	{
+		OnlineCopyTarget *target = (OnlineCopyTarget *) lfirst(targetCell);
+		PGresult *result = NULL;
+
+		if (target->changeCount == 0)
+		{
+			continue;
+		}
+
+		/* statements sent at once run in a single implicit transaction */
+		result = ExecuteRemoteCommandOrError(target->connection,
+											 target->changeBatch->data,
+											 PGRES_COMMAND_OK);
+		PQclear(result);
+
+		resetStringInfo(target->changeBatch);
+		target->changeCount = 0;
+	}
+}
+
+
+/*
+ * ParseDecodedChange parses a line printed by the test_decoding output plugin
+ * into the given change. The function returns false for lines which do not
+ * describe a change to the table with the given name, such as the begin and
+ * commit of transactions, and errors out on lines it cannot interpret.
+ *
+ * Changes are printed as "table schema.name: INSERT: column[type]:value ...",
+ * where updates may print the old row after "old-key:" and the new row after
+ * "new-tuple:".
+ */
+static bool
+ParseDecodedChange(char *changeText, char *shardName, DecodedChange *change)
+{
+	const char *tablePrefix = "table ";
+	char *cursor = changeText;
+	char *tableName = NULL;
+	List **columnList = NULL;
+
+	if (strncmp(cursor, tablePrefix, strlen(tablePrefix)) != 0)
+	{
+		return false;
+	}
+
+	cursor += strlen(tablePrefix);
+
+	(void) ParseIdentifier(&cursor);
+	if (*cursor != '.')
+	{
+		ereport(ERROR, (errmsg("could not parse decoded change: %s", changeText)));
+	}
+
+	cursor++;
+	tableName = ParseIdentifier(&cursor);
+	if (*cursor != ':')
+	{
+		ereport(ERROR, (errmsg("could not parse decoded change: %s", changeText)));
+	}
+
+	cursor++;
+	if (strcmp(tableName, shardName) != 0)
+	{
+		return false;
+	}
+
+	if (strncmp(cursor, " INSERT:", 8) == 0)
+	{
+		change->changeType = CMD_INSERT;
+		columnList = &change->newColumnList;
+	}
+	else if (strncmp(cursor, " UPDATE:", 8) == 0)
+	{
+		change->changeType = CMD_UPDATE;
+		columnList = &change->newColumnList;
+	}
+	else if (strncmp(cursor, " DELETE:", 8) == 0)
+	{
+		change->changeType = CMD_DELETE;
+		columnList = &change->oldColumnList;
+	}
+	else
+	{
+		ereport(ERROR, (errmsg("could not parse decoded change: %s", changeText)));
+	}
+
+	cursor += 8;
+
+	if (strcmp(cursor, " (no-tuple-data)") == 0)
+	{
+		ereport(ERROR, (errmsg("decoded change lacks row data: %s", changeText),
+						errdetail("Source placements must use full replica "
+								  "identity.")));
+	}
+
+	while (*cursor == ' ')
+	{
+		cursor++;
+
+		if (strncmp(cursor, "old-key:", 8) == 0)
+		{
+			columnList = &change->oldColumnList;
+			cursor += 8;
+		}
+		else if (strncmp(cursor, "new-tuple:", 10) == 0)
+		{
+			columnList = &change->newColumnList;
+			cursor += 10;
+		}
+		else
+		{
+			DecodedColumn *decodedColumn = ParseDecodedColumn(&cursor);
+
+			*columnList = lappend(*columnList, decodedColumn);
+		}
+	}
+
+	if (*cursor != '\0')
+	{
+		ereport(ERROR, (errmsg("could not parse decoded change: %s", changeText)));
+	}
+
+	return true;
+}
+
+
+/*
+ * ParseIdentifier parses a possibly quoted identifier at the cursor, advances
+ * the cursor past it, and returns the unquoted identifier.
+ */
+static char *
+ParseIdentifier(char **cursor)
+{
+	StringInfo identifier = makeStringInfo();
+	char *position = *cursor;
+
+	if (*position == '"')
+	{
+		position++;
+
+		while (*position != '\0')
+		{
+			if (position[0] == '"' && position[1] == '"')
+			{
+				appendStringInfoChar(identifier, '"');
+				position += 2;
+			}
+			else if (position[0] == '"')
+			{
+				position++;
+				break;
+			}
+			else
+			{
+				appendStringInfoChar(identifier, *position);
+				position++;
+			}
+		}
+	}
+	else
+	{
+		while (*position != '\0' && strchr(".:[ ", *position) == NULL)
+		{
+			appendStringInfoChar(identifier, *position);
+			position++;
+		}
+	}
+
+	*cursor = position;
+
+	return identifier->data;
+}
+
+
+/*
+ * ParseDecodedColumn parses a single "column[type]:value" entry at the cursor,
+ * and advances the cursor past it.
+ */
+static DecodedColumn *
+ParseDecodedColumn(char **cursor)
+{
+	DecodedColumn *decodedColumn = palloc0(sizeof(DecodedColumn));
+	char *position = *cursor;
+	char *typeEnd = NULL;
+
+	decodedColumn->columnName = ParseIdentifier(&position);
+
+	/* array types end in brackets themselves, so search for the separator */
+	typeEnd = strstr(position, "]:");
+	if (*position != '[' || typeEnd == NULL)
+	{
+		ereport(ERROR, (errmsg("could not parse decoded column: %s", *cursor)));
+	}
+
+	decodedColumn->typeName = pnstrdup(position + 1, typeEnd - position - 1);
+	position = typeEnd + 2;
+
+	if (*position == '\'' || (position[0] == 'B' && position[1] == '\''))
+	{
+		decodedColumn->valueLiteral = ParseQuotedLiteral(&position,
+														 &decodedColumn->valueText);
+	}
+	else
+	{
+		char *valueEnd = strchr(position, ' ');
+		char *valueText = NULL;
+
+		if (valueEnd == NULL)
+		{
+			valueEnd = position + strlen(position);
+		}
+
+		valueText = pnstrdup(position, valueEnd - position);
+
+		if (strcmp(valueText, "null") == 0)
+		{
+			decodedColumn->isNull = true;
+		}
+		else if (strcmp(valueText, "unchanged-toast-datum") == 0)
+		{
+			decodedColumn->isUnchangedToast = true;
+		}
+		else
+		{
+			/* numbers and booleans are printed bare, but may be NaN or Infinity */
+			decodedColumn->valueLiteral = quote_literal_cstr(valueText);
+			decodedColumn->valueText = valueText;
+		}
+
+		position = valueEnd;
+	}
+
+	*cursor = position;
+
+	return decodedColumn;
+}
+
+
+/*
+ * ParseQuotedLiteral parses a quoted literal with doubled quotes at the cursor,
+ * optionally prefixed with B for bit strings. The function advances the cursor
+ * past the literal, returns the literal as is, and stores its unquoted value.
+ */
+static char *
+ParseQuotedLiteral(char **cursor, char **valueText)
+{
+	StringInfo unquotedValue = makeStringInfo();
+	char *literalStart = *cursor;
+	char *position = *cursor;
+
+	if (*position == 'B')
+	{
+		position++;
+	}
+
+	/* skip the opening quote */
+	position++;
+
+	for (;;)
+	{
+		if (*position == '\0')
+		{
+			ereport(ERROR, (errmsg("unterminated literal in decoded change: %s",
+								   literalStart)));
+		}
+		else if (position[0] == '\'' && position[1] == '\'')
+		{
+			appendStringInfoChar(unquotedValue, '\'');
+			position += 2;
+		}
+		else if (position[0] == '\'')
+		{
+			position++;
+			break;
+		}
+		else
+		{
+			appendStringInfoChar(unquotedValue, *position);
+			position++;
+		}
+	}
+
+	*cursor = position;
+	*valueText = unquotedValue->data;
+
+	return pnstrdup(literalStart, position - literalStart);
+}
+
+
+/*
+ * ChangeTarget returns the target to which the given change of the source's
+ * shard must be applied. When splitting, this is the target whose hash token
+ * range contains the hashed partition value of the changed row.
+ */
+static OnlineCopyTarget *
+ChangeTarget(OnlineCopySource *source, DecodedChange *change,
+			 ShardColumnInfo *columnInfo)
+{
+	OnlineCopyTarget *firstTarget = (OnlineCopyTarget *) linitial(source->targetList);
+	List *rowColumnList = change->oldColumnList;
+	DecodedColumn *partitionColumn = NULL;
+	Datum partitionValue = 0;
+	int32 hashToken = 0;
+	ListCell *targetCell = NULL;
+
+	if (!firstTarget->filterRows)
+	{
+		return firstTarget;
+	}
+
+	/* the partition value of rows cannot be updated, so use the old row */
+	if (change->changeType == CMD_INSERT)
+	{
+		rowColumnList = change->newColumnList;
+	}
+
+	partitionColumn = FindDecodedColumn(rowColumnList, columnInfo->partitionColumnName);
+	if (partitionColumn == NULL || partitionColumn->isNull)
+	{
+		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						errmsg("decoded change lacks a partition column value")));
+	}
+
+	partitionValue = OidInputFunctionCall(columnInfo->partitionTypeInput,
+										  partitionColumn->valueText,
+										  columnInfo->partitionTypeIOParam, -1);
+	hashToken = DatumGetInt32(FunctionCall1(columnInfo->hashFunction, partitionValue));
+
+	foreach(targetCell, source->targetList)
+	{
+		OnlineCopyTarget *target = (OnlineCopyTarget *) lfirst(targetCell);
+
+		if (hashToken >= target->minHashToken && hashToken <= target->maxHashToken)
+		{
+			return target;
+		}
+	}
+
+	ereport(ERROR, (errmsg("could not find a shard for hash token %d", hashToken)));
+
+	return NULL;
+}
+
+
+/*
+ * FindDecodedColumn returns the column with the given name from the provided
+ * list, or NULL if the list has no such column.
+ */
+static DecodedColumn *
+FindDecodedColumn(List *decodedColumnList, char *columnName)
+{
+	ListCell *decodedColumnCell = NULL;
+
+	foreach(decodedColumnCell, decodedColumnList)
+	{
+		DecodedColumn *decodedColumn = (DecodedColumn *) lfirst(decodedColumnCell);
+
+		if (strcmp(decodedColumn->columnName, columnName) == 0)
+		{
+			return decodedColumn;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * DecodedChangeToSQL returns a statement applying the given change to the table
+ * with the given name. Updates and deletes affect a single row equal to the old
+ * row of the change, so duplicate rows are handled correctly. The function
+ * returns NULL if the change does not alter any values.
+ */
+static char *
+DecodedChangeToSQL(DecodedChange *change, char *shardName, ShardColumnInfo *columnInfo)
+{
+	StringInfo sqlString = makeStringInfo();
+	const char *quotedShardName = quote_identifier(shardName);
+	ListCell *decodedColumnCell = NULL;
+	bool firstColumn = true;
+
+	if (change->changeType == CMD_INSERT)
+	{
+		appendStringInfo(sqlString, "INSERT INTO %s (", quotedShardName);
+
+		foreach(decodedColumnCell, change->newColumnList)
+		{
+			DecodedColumn *decodedColumn = (DecodedColumn *) lfirst(decodedColumnCell);
+
+			appendStringInfo(sqlString, "%s%s", (firstColumn ? "" : ", "),
+							 quote_identifier(decodedColumn->columnName));
+			firstColumn = false;
+		}
+
+		appendStringInfoString(sqlString, ") VALUES (");
+
+		firstColumn = true;
+		foreach(decodedColumnCell, change->newColumnList)
+		{
+			DecodedColumn *decodedColumn = (DecodedColumn *) lfirst(decodedColumnCell);
+
+			if (!firstColumn)
+			{
+				appendStringInfoString(sqlString, ", ");
+			}
+
+			AppendTypedValue(sqlString, decodedColumn);
+			firstColumn = false;
+		}
+
+		appendStringInfoChar(sqlString, ')');
+	}
+	else if (change->changeType == CMD_UPDATE)
+	{
+		appendStringInfo(sqlString, "UPDATE %s SET ", quotedShardName);
+
+		foreach(decodedColumnCell, change->newColumnList)
+		{
+			DecodedColumn *decodedColumn = (DecodedColumn *) lfirst(decodedColumnCell);
+
+			/* unchanged toasted values are not decoded, but need no update */
+			if (decodedColumn->isUnchangedToast)
+			{
+				continue;
+			}
+
+			appendStringInfo(sqlString, "%s%s = ", (firstColumn ? "" : ", "),
+							 quote_identifier(decodedColumn->columnName));
+			AppendTypedValue(sqlString, decodedColumn);
+			firstColumn = false;
+		}
+
+		if (firstColumn)
+		{
+			return NULL;
+		}
+
+		AppendRowCondition(sqlString, (char *) quotedShardName, change->oldColumnList,
+						   columnInfo);
+	}
+	else
+	{
+		appendStringInfo(sqlString, "DELETE FROM %s", quotedShardName);
+
+		AppendRowCondition(sqlString, (char *) quotedShardName, change->oldColumnList,
+						   columnInfo);
+	}
+
+	return sqlString->data;
+}
+
+
+/*
+ * AppendRowCondition appends a WHERE clause matching a single row equal to the
+ * given old row. As the output plugin omits null values of old rows, columns
+ * missing from the old row must be null.
+ */
+static void
+AppendRowCondition(StringInfo sqlString, char *quotedShardName, List *oldColumnList,
+				   ShardColumnInfo *columnInfo)
+{
+	ListCell *columnNameCell = NULL;
+	bool firstColumn = true;
+
+	if (oldColumnList == NIL)
+	{
+		ereport(ERROR, (errmsg("decoded change lacks the old row"),
+						errdetail("Source placements must use full replica "
+								  "identity.")));
+	}
+
+	appendStringInfo(sqlString, " WHERE ctid = (SELECT ctid FROM %s WHERE ",
+					 quotedShardName);
+
+	foreach(columnNameCell, columnInfo->columnNameList)
+	{
+		char *columnName = (char *) lfirst(columnNameCell);
+		DecodedColumn *decodedColumn = FindDecodedColumn(oldColumnList, columnName);
+
+		if (decodedColumn != NULL && decodedColumn->isUnchangedToast)
+		{
+			continue;
+		}
+
+		appendStringInfo(sqlString, "%s%s", (firstColumn ? "" : " AND "),
+						 quote_identifier(columnName));
+
+		if (decodedColumn == NULL || decodedColumn->isNull)
+		{
+			appendStringInfoString(sqlString, " IS NULL");
+		}
+		else
+		{
+			appendStringInfoString(sqlString, " = ");
+			AppendTypedValue(sqlString, decodedColumn);
+		}
+
+		firstColumn = false;
+	}
+
+	appendStringInfoString(sqlString, " LIMIT 1)");
+}
+
+
+/* AppendTypedValue appends the value of a decoded column, cast to its type. */
+static void
+AppendTypedValue(StringInfo sqlString, DecodedColumn *decodedColumn)
+{
+	if (decodedColumn->isNull)
+	{
+		appendStringInfoString(sqlString, "NULL");
+	}
+	else
+	{
+		appendStringInfo(sqlString, "%s::%s", decodedColumn->valueLiteral,
+						 decodedColumn->typeName);
+	}
+}
+
+
+/*
+ * DropLogicalSlots drops the replication slots of all given sources. A slot is
+ * only dropped after all changes it captured have been applied.
+ */
+static void
+DropLogicalSlots(List *sourceList)
+{
+	ListCell *sourceCell = NULL;
+
+	foreach(sourceCell, sourceList)
+	{
+		OnlineCopySource *source = (OnlineCopySource *) lfirst(sourceCell);
+		StringInfo dropSlotQuery = makeStringInfo();
+		PGresult *result = NULL;
+
+		if (!source->slotCreated)
+		{
+			continue;
+		}
+
+		appendStringInfo(dropSlotQuery, DROP_LOGICAL_SLOT_QUERY, source->slotName);
+
+		result = ExecuteRemoteCommandOrError(source->connection, dropSlotQuery->data,
+											 PGRES_TUPLES_OK);
+		PQclear(result);
+
+		source->slotCreated = false;
+	}
+}
+
+
+/*
+ * ResetReplicaIdentity restores the replica identity the source placement had
+ * before the copy, if it was changed. Failures are reported at the WARNING
+ * level, as this function also runs during error recovery.
+ */
+static void
+ResetReplicaIdentity(OnlineCopySource *source)
+{
+	PGconn *connection = NULL;
+	PGresult *result = NULL;
+	bool identityReset = false;
+
+	if (source->resetIdentityCommand == NULL)
+	{
+		return;
+	}
+
+	connection = OpenNodeConnection(source->nodeName, source->nodePort, false);
+	if (connection != NULL)
+	{
+		result = PQexec(connection, source->resetIdentityCommand);
+		identityReset = (PQresultStatus(result) == PGRES_COMMAND_OK);
+
+		PQclear(result);
+		PQfinish(connection);
+	}
+
+	if (!identityReset)
+	{
+		ereport(WARNING, (errmsg("could not reset replica identity of \"%s\" on "
+								 "\"%s:%d\"", source->shardName, source->nodeName,
+								 source->nodePort),
+						  errhint("Run \"%s\" on that node manually.",
+								  source->resetIdentityCommand)));
+	}
+
+	source->resetIdentityCommand = NULL;
+}
+
+
+/*
+ * DropShardPlacementTables drops the tables of the given placements of a shard
+ * whose metadata has been removed. As dropping cannot be undone, callers only
+ * do so once the metadata changes are complete. Tables which cannot be dropped
+ * are reported at the WARNING level and left in place.
+ */
+static void
+DropShardPlacementTables(Oid distributedTableId, int64 shardId,
+						 List *shardPlacementList)
+{
+	char *shardName = get_rel_name(distributedTableId);
+	StringInfo dropCommand = makeStringInfo();
+	ListCell *placementCell = NULL;
+
+	AppendShardIdToName(&shardName, shardId);
+	appendStringInfo(dropCommand, DROP_REGULAR_TABLE_COMMAND,
+					 quote_identifier(shardName));
+
+	foreach(placementCell, shardPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		bool commandsExecuted = false;
+
+		commandsExecuted = ExecuteRemoteCommandList(placement->nodeName,
+													placement->nodePort,
+													list_make1(dropCommand->data));
+		if (!commandsExecuted)
+		{
+			ereport(WARNING, (errmsg("could not drop table \"%s\" on \"%s:%d\"",
+									 shardName, placement->nodeName,
+									 placement->nodePort),
+							  errhint("Drop the table manually.")));
+		}
+	}
+}
+
+
+/*
+ * CleanUpOnlineCopy closes all connections used by a failed online copy and
+ * makes a best effort to drop the replication slots it created, as these would
+ * otherwise retain WAL on the source nodes indefinitely, and to reset the
+ * replica identities of the sources. Slots which cannot be dropped are reported
+ * at the WARNING level. As it runs during error recovery,
+ * this function must not throw errors itself.
+ */
+static void
+CleanUpOnlineCopy(List *sourceList)
+{
+	ListCell *sourceCell = NULL;
+
+	CloseOnlineCopyConnections(sourceList);
+
+	foreach(sourceCell, sourceList)
+	{
+		OnlineCopySource *source = (OnlineCopySource *) lfirst(sourceCell);
+		char dropSlotQuery[NAMEDATALEN + 64];
+		PGconn *connection = NULL;
+		PGresult *result = NULL;
+
+		ResetReplicaIdentity(source);
+
+		if (!source->slotCreated)
+		{
+			continue;
+		}
+
+		snprintf(dropSlotQuery, sizeof(dropSlotQuery), DROP_LOGICAL_SLOT_QUERY,
+				 source->slotName);
+
+		connection = OpenNodeConnection(source->nodeName, source->nodePort, false);
+		if (connection != NULL)
+		{
+			result = PQexec(connection, dropSlotQuery);
+			if (PQresultStatus(result) == PGRES_TUPLES_OK)
+			{
+				source->slotCreated = false;
+			}
+
+			PQclear(result);
+			PQfinish(connection);
+		}
+
+		if (source->slotCreated)
+		{
+			ereport(WARNING, (errmsg("could not drop replication slot \"%s\" on "
+									 "\"%s:%d\"", source->slotName, source->nodeName,
+									 source->nodePort),
+							  errhint("Drop the slot manually to release the WAL it "
+									  "retains.")));
+		}
+	}
+}
+
+
+/*
+ * CloseOnlineCopyConnections closes all connections used by the given sources
+ * and their targets which are still open.
+ */
+static void
+CloseOnlineCopyConnections(List *sourceList)
+{
+	ListCell *sourceCell = NULL;
+
+	foreach(sourceCell, sourceList)
+	{
+		OnlineCopySource *source = (OnlineCopySource *) lfirst(sourceCell);
+		ListCell *targetCell = NULL;
+
+		foreach(targetCell, source->targetList)
+		{
+			OnlineCopyTarget *target = (OnlineCopyTarget *) lfirst(targetCell);
+
+			if (target->copyOutConnection != NULL)
+			{
+				PQfinish(target->copyOutConnection);
+				target->copyOutConnection = NULL;
+			}
+
+			if (target->connection != NULL)
+			{
+				PQfinish(target->connection);
+				target->connection = NULL;
+			}
+		}
+
+		if (source->replicationConnection != NULL)
+		{
+			PQfinish(source->replicationConnection);
+			source->replicationConnection = NULL;
+		}
+
+		if (source->connection != NULL)
+		{
+			PQfinish(source->connection);
+			source->connection = NULL;
+		}
+	}
+}
+
+
+/*
+ * OpenConnectionOrError opens a new connection to the specified node which is
+ * not shared with other users, and errors out if none can be established.
+ */
+static PGconn *
+OpenConnectionOrError(char *nodeName, int32 nodePort, bool replication)
+{
+	PGconn *connection = OpenNodeConnection(nodeName, nodePort, replication);
+	if (connection == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("could not connect to \"%s:%d\"", nodeName, nodePort)));
+	}
+
+	return connection;
+}
+
+
+/*
+ * ExecuteRemoteCommandOrError executes the given command on the connection and
+ * returns its result, erroring out if the result does not have the expected
+ * status. The caller is responsible for clearing the result.
+ */
+static PGresult *
+ExecuteRemoteCommandOrError(PGconn *connection, const char *command,
+							ExecStatusType expectedStatus)
+{
+	PGresult *result = PQexec(connection, command);
+	if (PQresultStatus(result) != expectedStatus)
+	{
+		ReportRemoteErrorAndThrow(connection, result, "execute remote command");
+	}
+
+	return result;
+}
+
+
+/*
+ * ReportRemoteErrorAndThrow reports the error of the given connection or result
+ * at the WARNING level, clears the result, and errors out.
+ */
+static void
+ReportRemoteErrorAndThrow(PGconn *connection, PGresult *result,
+						  const char *failedAction)
+{
+	ReportRemoteError(connection, result);
+	PQclear(result);
+
+	ereport(ERROR, (errmsg("could not %s", failedAction),
+					errhint("Consult recent messages in the server logs for "
+							"details.")));
+}
@@ -16,12 +16,13 @@
 #include "funcapi.h"
 #include "libpq-fe.h"
 #include "miscadmin.h"
-#include "plpgsql.h"
 
 #include "pg_shard.h"
 #include "connection.h"
+#include "connection_broker.h"
 #include "create_shards.h"
 #include "distribution_metadata.h"
+#include "metadata_cache.h"
 #include "prune_shard_list.h"
 #include "ruleutils.h"
 
@@ -38,6 +39,7 @@
 #else
 #include "access/skey.h"
 #endif
+#include "access/transam.h"
 #include "access/tupdesc.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
@@ -59,14 +61,13 @@
 #include "nodes/pg_list.h"
 #include "nodes/plannodes.h"
 #include "nodes/primnodes.h"
+#include "nodes/relation.h"
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/planner.h"
 #include "optimizer/var.h"
-#include "parser/analyze.h"
 #include "parser/parse_node.h"
 #include "parser/parsetree.h"
-#include "parser/parse_type.h"
 #include "storage/lock.h"
 #include "tcop/dest.h"
 #include "tcop/tcopprot.h"
@@ -75,6 +76,7 @@
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/guc.h"
+#include "utils/int8.h"
 #include "utils/lsyscache.h"
 #include "utils/palloc.h"
 #include "utils/rel.h"
@@ -100,6 +102,15 @@ bool DtmTwoPhaseCommit = false;
 /* logs each statement used in a distributed plan */
 bool LogDistributedStatements = false;
 
+/*
+ * Planned statements may be copied by the plan cache, which only knows how to
+ * copy built-in nodes. So the planner hands distributed plans over wrapped in
+ * a CustomScan node, and the executor unwraps them before execution.
+ */
+static CustomScanMethods DistributedPlanMethods = {
+	"DistributedPlan", NULL, NULL, NULL
+};
+
 
 /* planner functions forward declarations */
 static PlannedStmt * PgShardPlanner(Query *parse, int cursorOptions,
@@ -109,6 +120,7 @@ static void ErrorIfQueryNotSupported(Query *queryTree);
 static Oid ExtractFirstDistributedTableId(Query *query);
 static bool ExtractRangeTableEntryWalker(Node *node, List **rangeTableList);
 static List * DistributedQueryShardList(Query *query);
+static List * DistributedTableShardList(Oid distributedTableId);
 static bool SelectFromMultipleShards(Query *query, List *queryShardList);
 static void ClassifyRestrictions(List *queryRestrictList, List **remoteRestrictList,
 								 List **localRestrictList);
@@ -123,18 +135,51 @@ static bool ExtractFromExpressionWalker(Node *node, List **qualifierList);
 static List * QueryFromList(List *rangeTableList);
 static List * TargetEntryList(List *expressionList);
 static CreateStmt * CreateTemporaryTableLikeStmt(Oid sourceRelationId);
+static char * TemporaryTableName(void);
 static DistributedPlan * BuildDistributedPlan(Query *query, List *shardIntervalList);
+static DistributedPlan * BuildParameterizedPlan(Query *originalQuery,
+												Query *parameterizedQuery,
+												int cursorOptions);
+static StringInfo DeparseShardQuery(Query *query, int64 shardId);
+static Task * BuildTask(int64 shardId, StringInfo queryString);
+static bool QueryContainsExternParams(Query *query);
+static bool ContainsExternParamsWalker(Node *node, void *context);
 
 /* executor functions forward declarations */
 static void PgShardExecutorStart(QueryDesc *queryDesc, int eflags);
+static PlannedStmt * SwapInLocalPlan(QueryDesc *queryDesc, Plan *localPlan);
 static bool IsPgShardPlan(PlannedStmt *plannedStmt);
+static bool IsWrappedDistributedPlan(Plan *plan);
+static Plan * WrapDistributedPlan(DistributedPlan *distributedPlan);
+static DistributedPlan * UnwrapDistributedPlan(Plan *plan);
+static List * SerializeTaskList(List *taskList);
+static List * DeserializeTaskList(List *serializedTaskList);
+static Value * MakeInt64Value(int64 value);
+static int64 Int64ValueGet(Value *value);
+static PlannedStmt * BindParameterizedPlan(PlannedStmt *parameterizedStatement,
+										   ParamListInfo boundParams);
+static Query * BindQueryParameters(Query *parameterizedQuery, ParamListInfo boundParams);
+static Task * FindShardTask(List *taskList, int64 shardId);
 static void NextExecutorStartHook(QueryDesc *queryDesc, int eflags);
 static LOCKMODE CommutativityRuleToLockMode(CmdType commandType);
 static void AcquireExecutorShardLocks(List *taskList, LOCKMODE lockMode);
 static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
 static void ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
 									   RangeVar *intermediateTable);
-static bool SendQueryInSingleRowMode(PGconn *connection, StringInfo query);
+static bool SendQueryInSingleRowMode(PGconn *connection, StringInfo query,
+									 ParamListInfo boundParams);
+static PGresult * ExecuteRemoteCommand(PGconn *connection, StringInfo query,
+									   ParamListInfo boundParams);
+static void BuildTaskParameters(ParamListInfo boundParams, Oid **parameterTypes,
+								const char ***parameterValues);
+static BrokerCommand * BuildBrokerCommand(char *nodeName, int32 nodePort,
+										  StringInfo query, ParamListInfo boundParams);
+static bool RouteThroughBroker(void);
+static char * PrepareTaskStatement(PGconn *connection, StringInfo query,
+								   ParamListInfo boundParams,
+								   const char ***parameterValues);
+static void StoreBrokerResult(BrokerResult *brokerResult, TupleDesc tupleDescriptor,
+							  Tuplestorestate *tupleStore);
 static bool StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 							 Tuplestorestate *tupleStore);
 static void TupleStoreToTable(RangeVar *tableRangeVar, List *remoteTargetList,
@@ -142,9 +187,11 @@ static void TupleStoreToTable(RangeVar *tableRangeVar, List *remoteTargetList,
 static void PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count);
 static int32 ExecuteDistributedModify(DistributedPlan *distributedPlan);
 static void PrepareDtmTransaction(Task *task);
-static csn_t SendDtmBeginTransaction(PGconn *connection);
-static bool SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId);
-static bool SendCommand(PGconn *connection, char *command);
+static NodeConnectionKey * FindDtmTransactionNode(char *nodeName, int32 nodePort);
+static csn_t SendDtmBeginTransaction(NodeConnectionKey *node);
+static bool SendDtmJoinTransaction(NodeConnectionKey *node, csn_t TransactionId);
+static bool SendCommand(NodeConnectionKey *node, char *command,
+						ExecStatusType expectedStatus, char **firstValue);
 static void FinishDtmTransaction(XactEvent event, void *arg);
 static void ExecuteSingleShardSelect(DistributedPlan *distributedPlan,
 									 EState *executorState, TupleDesc tupleDescriptor,
@@ -156,16 +203,6 @@ static void PgShardProcessUtility(Node *parsetree, const char *queryString,
 								  DestReceiver *dest, char *completionTag);
 static void ErrorOnDropIfDistributedTablesExist(DropStmt *dropStatement);
 
-/* PL/pgSQL plugin declarations */
-static void SetupPLErrorTransformation(PLpgSQL_execstate *estate, PLpgSQL_function *func);
-static void TeardownPLErrorTransformation(PLpgSQL_execstate *estate,
-										  PLpgSQL_function *func);
-static void PgShardErrorTransform(void *arg);
-static PLpgSQL_plugin PluginFuncs = {
-	.func_beg = SetupPLErrorTransformation,
-	.func_end = TeardownPLErrorTransformation
-};
-
 /* declarations for dynamic loading */
 PG_MODULE_MAGIC;
 
@@ -179,7 +216,8 @@ static ExecutorEnd_hook_type PreviousExecutorEndHook = NULL;
 static ProcessUtility_hook_type PreviousProcessUtilityHook = NULL;
 
 /* XTM stuff */
-static List *connectionsWithDtmTransactions = NIL;
+static List *connectionsWithDtmTransactions = NIL; /* NodeConnectionKey list */
+static bool dtmTransactionUsesBroker = false;
 static csn_t currentGlobalTransactionId = 0;
 static int	 currentLocalTransactionId = 0;
 static bool commitCallbackSet = false;
@@ -197,8 +235,6 @@ static bool commitCallbackSet = false;
 void
 _PG_init(void)
 {
-	PLpgSQL_plugin **plugin_ptr = NULL;
-
 	PreviousPlannerHook = planner_hook;
 	planner_hook = PgShardPlanner;
 
@@ -237,80 +273,13 @@ _PG_init(void)
 							 &LogDistributedStatements, false, PGC_USERSET, 0, NULL,
 							 NULL, NULL);
 
-	EmitWarningsOnPlaceholders("pg_shard");
-
-	/* install error transformation handler for PL/pgSQL invocations */
-	plugin_ptr = (PLpgSQL_plugin **) find_rendezvous_variable("PLpgSQL_plugin");
-	*plugin_ptr = &PluginFuncs;
-}
-
-
-/*
- * SetupPLErrorTransformation is intended to run before entering PL/pgSQL
- * functions. It pushes an error transform onto the error context stack.
- */
-static void
-SetupPLErrorTransformation(PLpgSQL_execstate *estate, PLpgSQL_function *func)
-{
-	ErrorContextCallback *pgShardErrorContext = NULL;
-	pgShardErrorContext = MemoryContextAllocZero(TopTransactionContext,
-												 sizeof(ErrorContextCallback));
-
-	pgShardErrorContext->previous = error_context_stack;
-	pgShardErrorContext->callback = PgShardErrorTransform;
-	pgShardErrorContext->arg = NULL;
-
-	error_context_stack = pgShardErrorContext;
-}
-
-
-/*
- * TeardownPLErrorTransformation is intended to run after a PL/pgSQL function
- * successfully returns. It pops the error context stack in order to remove and
- * free the transform placed on that stack by SetupPLErrorTransformation.
- */
-static void
-TeardownPLErrorTransformation(PLpgSQL_execstate *estate, PLpgSQL_function *func)
-{
-	ErrorContextCallback *pgShardErrorContext = error_context_stack;
-
-	error_context_stack = pgShardErrorContext->previous;
-	pfree(pgShardErrorContext);
-}
-
-
-/*
- * PgShardErrorTransform detects an uninformative error message produced when
- * a pg_shard-distributed relation is referenced in bare SQL within a PL/pgSQL
- * function and replaces it with a more specific message to help the user work
- * around the underlying issue.
- */
-static void
-PgShardErrorTransform(void *arg)
-{
-	int sqlCode = geterrcode();
-	MemoryContext errorContext = NULL;
-	ErrorData *errorData = NULL;
-
-	/* short-circuit if it's not an internal error */
-	if (sqlCode != ERRCODE_INTERNAL_ERROR)
-	{
-		return;
-	}
+	/* define the cache size and request shared memory for the metadata cache */
+	InitializeMetadataCache();
 
-	/* get current error data */
-	errorContext = MemoryContextSwitchTo(TopTransactionContext);
-	errorData = CopyErrorData();
-	MemoryContextSwitchTo(errorContext);
+	/* define the broker's settings and register it if it is enabled */
+	InitializeConnectionBroker();
 
-	/* if it's an error about a distributed plan, clean up the fields */
-	if (strcmp("unrecognized node type: 2100", errorData->message) == 0)
-	{
-		errcode(ERRCODE_FEATURE_NOT_SUPPORTED);
-		errmsg("cannot cache distributed plan");
-		errdetail("PL/pgSQL's statement caching is unsupported by pg_shard.");
-		errhint("Bypass caching by using the EXECUTE keyword instead.");
-	}
+	EmitWarningsOnPlaceholders("pg_shard");
 }
 
 
@@ -358,58 +327,85 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 		ErrorIfQueryNotSupported(distributedQuery);
 
 		/*
-		 * Compute the list of shards this query needs to access.
-		 * Error out if there are no existing shards for the table.
+		 * Parameters left in the query after standard planning have no values
+		 * yet, as is the case for generic plans of prepared statements. Rather
+		 * than failing to prune shards, we build a plan template which defers
+		 * shard selection until the plan is bound to parameter values.
 		 */
-		queryShardList = DistributedQueryShardList(distributedQuery);
-
-		/*
-		 * If a select query touches multiple shards, we don't push down the
-		 * query as-is, and instead only push down the filter clauses and select
-		 * needed columns. We then copy those results to a local temporary table
-		 * and then modify the original PostgreSQL plan to perform a sequential
-		 * scan on that temporary table.
-		 * XXX: This approach is limited as we cannot handle index or foreign
-		 * scans. We will revisit this by potentially using another type of scan
-		 * node instead of a sequential scan.
-		 */
-		selectFromMultipleShards = SelectFromMultipleShards(query, queryShardList);
-		if (selectFromMultipleShards)
+		if (QueryContainsExternParams(distributedQuery))
 		{
-			Oid distributedTableId = InvalidOid;
-			Query *localQuery = NULL;
-			List *queryRestrictList = QueryRestrictList(distributedQuery);
-			List *remoteRestrictList = NIL;
-			List *localRestrictList = NIL;
-
-			/* partition restrictions into remote and local lists */
-			ClassifyRestrictions(queryRestrictList, &remoteRestrictList,
-								 &localRestrictList);
-
-			/* build local and distributed query */
-			distributedQuery = RowAndColumnFilterQuery(distributedQuery,
-													   remoteRestrictList,
-													   localRestrictList);
-			localQuery = BuildLocalQuery(query, localRestrictList);
+			distributedPlan = BuildParameterizedPlan(query, distributedQuery,
+													 cursorOptions);
+		}
+		else
+		{
+			/*
+			 * Compute the list of shards this query needs to access.
+			 * Error out if there are no existing shards for the table.
+			 */
+			queryShardList = DistributedQueryShardList(distributedQuery);
 
 			/*
-			 * Force a sequential scan as we change the underlying table to
-			 * point to our intermediate temporary table which contains the
-			 * fetched data.
+			 * If a select query touches multiple shards, we don't push down the
+			 * query as-is, and instead only push down the filter clauses and
+			 * select needed columns. We then copy those results to a local
+			 * temporary table and then modify the original PostgreSQL plan to
+			 * perform a sequential scan on that temporary table.
+			 * XXX: This approach is limited as we cannot handle index or foreign
+			 * scans. We will revisit this by potentially using another type of
+			 * scan node instead of a sequential scan.
 			 */
-			plannedStatement = PlanSequentialScan(localQuery, cursorOptions, boundParams);
+			selectFromMultipleShards = SelectFromMultipleShards(query, queryShardList);
+			if (selectFromMultipleShards)
+			{
+				Oid distributedTableId = InvalidOid;
+				Query *localQuery = NULL;
+				List *queryRestrictList = QueryRestrictList(distributedQuery);
+				List *remoteRestrictList = NIL;
+				List *localRestrictList = NIL;
+
+				/* partition restrictions into remote and local lists */
+				ClassifyRestrictions(queryRestrictList, &remoteRestrictList,
+									 &localRestrictList);
+
+				/* build local and distributed query */
+				distributedQuery = RowAndColumnFilterQuery(distributedQuery,
+														   remoteRestrictList,
+														   localRestrictList);
+				localQuery = BuildLocalQuery(query, localRestrictList);
+
+				/*
+				 * Force a sequential scan as we change the underlying table to
+				 * point to our intermediate temporary table which contains the
+				 * fetched data.
+				 */
+				plannedStatement = PlanSequentialScan(localQuery, cursorOptions,
+													  boundParams);
+
+				/* construct a CreateStmt to clone the existing table */
+				distributedTableId = ExtractFirstDistributedTableId(distributedQuery);
+				createTemporaryTableStmt = CreateTemporaryTableLikeStmt(
+					distributedTableId);
+			}
 
-			/* construct a CreateStmt to clone the existing table */
-			distributedTableId = ExtractFirstDistributedTableId(distributedQuery);
-			createTemporaryTableStmt = CreateTemporaryTableLikeStmt(distributedTableId);
+			distributedPlan = BuildDistributedPlan(distributedQuery, queryShardList);
+			distributedPlan->selectFromMultipleShards = selectFromMultipleShards;
+			distributedPlan->createTemporaryTableStmt = createTemporaryTableStmt;
 		}
 
-		distributedPlan = BuildDistributedPlan(distributedQuery, queryShardList);
 		distributedPlan->originalPlan = plannedStatement->planTree;
-		distributedPlan->selectFromMultipleShards = selectFromMultipleShards;
-		distributedPlan->createTemporaryTableStmt = createTemporaryTableStmt;
 
-		plannedStatement->planTree = (Plan *) distributedPlan;
+		/*
+		 * The plan cache compares the cost of custom and generic plans to
+		 * decide whether prepared statements need planning for each execution,
+		 * so report the cost of the local plan rather than a cost of zero.
+		 */
+		distributedPlan->plan.startup_cost = plannedStatement->planTree->startup_cost;
+		distributedPlan->plan.total_cost = plannedStatement->planTree->total_cost;
+		distributedPlan->plan.plan_rows = plannedStatement->planTree->plan_rows;
+		distributedPlan->plan.plan_width = plannedStatement->planTree->plan_width;
+
+		plannedStatement->planTree = WrapDistributedPlan(distributedPlan);
 	}
 	else if (plannerType == PLANNER_TYPE_CITUSDB)
 	{
@@ -769,10 +765,24 @@ DistributedQueryShardList(Query *query)
 	List *prunedShardList = NIL;
 
 	Oid distributedTableId = ExtractFirstDistributedTableId(query);
-	List *shardIntervalList = NIL;
+	List *shardIntervalList = DistributedTableShardList(distributedTableId);
+
+	restrictClauseList = QueryRestrictList(query);
+	prunedShardList = PruneShardList(distributedTableId, restrictClauseList,
+									 shardIntervalList);
+
+	return prunedShardList;
+}
 
-	/* error out if no shards exist for the table */
-	shardIntervalList = LookupShardIntervalList(distributedTableId);
+
+/*
+ * DistributedTableShardList returns the list of all shards for the given
+ * distributed table, and errors out if the table has no shards.
+ */
+static List *
+DistributedTableShardList(Oid distributedTableId)
+{
+	List *shardIntervalList = LookupShardIntervalList(distributedTableId);
 	if (shardIntervalList == NIL)
 	{
 		char *relationName = get_rel_name(distributedTableId);
@@ -785,11 +795,7 @@ DistributedQueryShardList(Query *query)
 								"and try again.")));
 	}
 
-	restrictClauseList = QueryRestrictList(query);
-	prunedShardList = PruneShardList(distributedTableId, restrictClauseList,
-									 shardIntervalList);
-
-	return prunedShardList;
+	return shardIntervalList;
 }
 
 
@@ -1045,7 +1051,12 @@ ExtractPartitionValue(Query *query, Var *partitionColumn)
 												partitionColumn->varattno);
 	if (targetEntry != NULL)
 	{
-		Assert(IsA(targetEntry->expr, Const));
+		if (!IsA(targetEntry->expr, Const))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("values given for the partition column must be"
+								   " constants or constant expressions")));
+		}
 
 		partitionValue = (Const *) targetEntry->expr;
 	}
@@ -1143,9 +1154,7 @@ TargetEntryList(List *expressionList)
 static CreateStmt *
 CreateTemporaryTableLikeStmt(Oid sourceRelationId)
 {
-	static unsigned long temporaryTableId = 0;
 	CreateStmt *createStmt = NULL;
-	StringInfo clonedTableName = NULL;
 	RangeVar *clonedRelation = NULL;
 
 	char *sourceTableName = get_rel_name(sourceRelationId);
@@ -1157,13 +1166,7 @@ CreateTemporaryTableLikeStmt(Oid sourceRelationId)
 	tableLikeClause->relation = sourceRelation;
 	tableLikeClause->options = 0; /* don't copy over indexes/constraints etc */
 
-	/* create a unique name for the cloned table */
-	clonedTableName = makeStringInfo();
-	appendStringInfo(clonedTableName, "%s_%d_%lu", TEMPORARY_TABLE_PREFIX, MyProcPid,
-					 temporaryTableId);
-	temporaryTableId++;
-
-	clonedRelation = makeRangeVar(NULL, clonedTableName->data, -1);
+	clonedRelation = makeRangeVar(NULL, TemporaryTableName(), -1);
 	clonedRelation->relpersistence = RELPERSISTENCE_TEMP;
 
 	createStmt = makeNode(CreateStmt);
@@ -1175,6 +1178,21 @@ CreateTemporaryTableLikeStmt(Oid sourceRelationId)
 }
 
 
+/* TemporaryTableName returns a unique name for a temporary table. */
+static char *
+TemporaryTableName(void)
+{
+	static unsigned long temporaryTableId = 0;
+	StringInfo temporaryTableName = makeStringInfo();
+
+	appendStringInfo(temporaryTableName, "%s_%d_%lu", TEMPORARY_TABLE_PREFIX,
+					 MyProcPid, temporaryTableId);
+	temporaryTableId++;
+
+	return temporaryTableName->data;
+}
+
+
 /*
  * BuildDistributedPlan simply creates the DistributedPlan instance from the
  * provided query and shard interval list.
@@ -1192,53 +1210,161 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 	{
 		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
 		int64 shardId = shardInterval->id;
-		List *finalizedPlacementList = NIL;
-		FromExpr *joinTree = NULL;
-		Task *task = NULL;
-		StringInfo queryString = makeStringInfo();
+		StringInfo queryString = DeparseShardQuery(query, shardId);
+		Task *task = BuildTask(shardId, queryString);
 
-		/* grab shared metadata lock to stop concurrent placement additions */
-		LockShardDistributionMetadata(shardId, ShareLock);
+		taskList = lappend(taskList, task);
+	}
 
-		/* now safe to populate placement list */
-		finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
+	distributedPlan->taskList = taskList;
 
-		/*
-		 * Convert the qualifiers to an explicitly and'd clause, which is needed
-		 * before we deparse the query. This applies to SELECT, UPDATE and
-		 * DELETE statements.
-		 */
-		joinTree = query->jointree;
-		if ((joinTree != NULL) && (joinTree->quals != NULL))
-		{
-			Node *whereClause = joinTree->quals;
-			if (IsA(whereClause, List))
-			{
-				joinTree->quals = (Node *) make_ands_explicit((List *) whereClause);
-			}
-		}
+	return distributedPlan;
+}
 
-		deparse_shard_query(query, shardId, queryString);
 
-		if (LogDistributedStatements)
-		{
-			ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
-		}
+/*
+ * BuildParameterizedPlan creates a plan template for a query which references
+ * parameters that have no values yet. Since shards cannot be pruned without
+ * those values, the template holds a task for every shard of the table, each
+ * containing the query deparsed with $n placeholders in place of parameters.
+ * Binding the template to parameter values later on thus only requires shard
+ * pruning, which avoids re-planning and deparsing for each execution.
+ */
+static DistributedPlan *
+BuildParameterizedPlan(Query *originalQuery, Query *parameterizedQuery,
+					   int cursorOptions)
+{
+	DistributedPlan *distributedPlan = palloc0(sizeof(DistributedPlan));
+	Oid distributedTableId = ExtractFirstDistributedTableId(parameterizedQuery);
+	List *shardIntervalList = DistributedTableShardList(distributedTableId);
+	ListCell *shardIntervalCell = NULL;
+	List *taskList = NIL;
+
+	/* deparsing modifies the query, so keep the planned query intact */
+	Query *templateQuery = copyObject(parameterizedQuery);
+
+	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
+	distributedPlan->targetList = templateQuery->targetList;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		Task *task = (Task *) palloc0(sizeof(Task));
 
-		task = (Task *) palloc0(sizeof(Task));
-		task->queryString = queryString;
-		task->taskPlacementList = finalizedPlacementList;
-		task->shardId = shardId;
+		task->shardId = shardInterval->id;
+		task->queryString = DeparseShardQuery(templateQuery, task->shardId);
 
 		taskList = lappend(taskList, task);
 	}
 
 	distributedPlan->taskList = taskList;
+	distributedPlan->parameterizedQuery = parameterizedQuery;
+	distributedPlan->originalQuery = copyObject(originalQuery);
+	distributedPlan->cursorOptions = cursorOptions;
 
 	return distributedPlan;
 }
 
 
+/*
+ * DeparseShardQuery builds the query string to run the given query against
+ * the given shard. Note that the function converts the query's qualifiers to
+ * an explicitly and'd clause in place.
+ */
+static StringInfo
+DeparseShardQuery(Query *query, int64 shardId)
+{
+	StringInfo queryString = makeStringInfo();
+	FromExpr *joinTree = query->jointree;
+
+	/*
+	 * Convert the qualifiers to an explicitly and'd clause, which is needed
+	 * before we deparse the query. This applies to SELECT, UPDATE and DELETE
+	 * statements.
+	 */
+	if ((joinTree != NULL) && (joinTree->quals != NULL))
+	{
+		Node *whereClause = joinTree->quals;
+		if (IsA(whereClause, List))
+		{
+			joinTree->quals = (Node *) make_ands_explicit((List *) whereClause);
+		}
+	}
+
+	deparse_shard_query(query, shardId, queryString);
+
+	if (LogDistributedStatements)
+	{
+		ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
+	}
+
+	return queryString;
+}
+
+
+/*
+ * BuildTask creates a task to run the given query string against the finalized
+ * placements of the given shard.
+ */
+static Task *
+BuildTask(int64 shardId, StringInfo queryString)
+{
+	List *finalizedPlacementList = NIL;
+	Task *task = NULL;
+
+	/* grab shared metadata lock to stop concurrent placement additions */
+	LockShardDistributionMetadata(shardId, ShareLock);
+
+	/* now safe to populate placement list */
+	finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
+
+	task = (Task *) palloc0(sizeof(Task));
+	task->queryString = queryString;
+	task->taskPlacementList = finalizedPlacementList;
+	task->shardId = shardId;
+
+	return task;
+}
+
+
+/*
+ * QueryContainsExternParams returns whether the given query references any
+ * parameters supplied by the client, such as those of a prepared statement.
+ */
+static bool
+QueryContainsExternParams(Query *query)
+{
+	return query_tree_walker(query, ContainsExternParamsWalker, NULL, 0);
+}
+
+
+/* Walker function to find parameters supplied by the client in a query tree. */
+static bool
+ContainsExternParamsWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Param))
+	{
+		Param *param = (Param *) node;
+		if (param->paramkind == PARAM_EXTERN)
+		{
+			return true;
+		}
+	}
+	else if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ContainsExternParamsWalker,
+								 context, 0);
+	}
+
+	return expression_tree_walker(node, ContainsExternParamsWalker, context);
+}
+
+
 /*
  * PgShardExecutorStart sets up the executor state and queryDesc for pgShard
  * executed statements. The function also handles multi-shard selects
@@ -1253,15 +1379,39 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 
 	if (pgShardExecution)
 	{
-		DistributedPlan *distributedPlan = (DistributedPlan *) plannedStatement->planTree;
-		bool selectFromMultipleShards = distributedPlan->selectFromMultipleShards;
-		bool zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
+		DistributedPlan *distributedPlan = NULL;
+		bool selectFromMultipleShards = false;
+		bool zeroShardQuery = false;
+
+		/* execute an unwrapped copy of the plan, keeping the planned one intact */
+		if (IsWrappedDistributedPlan(plannedStatement->planTree))
+		{
+			distributedPlan = UnwrapDistributedPlan(plannedStatement->planTree);
+			plannedStatement = SwapInLocalPlan(queryDesc, (Plan *) distributedPlan);
+		}
+
+		distributedPlan = (DistributedPlan *) plannedStatement->planTree;
+
+		/*
+		 * Plan templates are shared across executions of a prepared statement,
+		 * so bind a copy to this execution's parameters and run that instead.
+		 */
+		if (distributedPlan->parameterizedQuery != NULL)
+		{
+			plannedStatement = BindParameterizedPlan(plannedStatement, queryDesc->params);
+			queryDesc->plannedstmt = plannedStatement;
+
+			distributedPlan = (DistributedPlan *) plannedStatement->planTree;
+		}
+
+		selectFromMultipleShards = distributedPlan->selectFromMultipleShards;
+		zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
 
 		if (zeroShardQuery)
 		{
 			/* if zero shards are involved, let non-INSERTs hit local table */
 			Plan *originalPlan = distributedPlan->originalPlan;
-			plannedStatement->planTree = originalPlan;
+			plannedStatement = SwapInLocalPlan(queryDesc, originalPlan);
 
 			if (plannedStatement->commandType == CMD_INSERT)
 			{
@@ -1318,21 +1468,37 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 			Oid intermediateResultTableId = InvalidOid;
 			bool missingOK = false;
 
-			/* execute the previously created statement to create a temp table */
-			CreateStmt *createStmt = distributedPlan->createTemporaryTableStmt;
+			/*
+			 * Execute the previously created statement to create a temp table.
+			 * As the plan may be executed again within the same transaction,
+			 * we give each execution's table a unique name.
+			 */
+			CreateStmt *createStmt = copyObject(distributedPlan->createTemporaryTableStmt);
 			const char *queryDescription = "create temp table like";
 			RangeVar *intermediateResultTable = createStmt->relation;
 
+			intermediateResultTable->relname = TemporaryTableName();
+
 			ProcessUtility((Node *) createStmt, queryDescription,
 						   PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
 
 			/* execute select queries and fetch results into the temp table */
 			ExecuteMultipleShardSelect(distributedPlan, intermediateResultTable);
 
-			/* update the query descriptor snapshot so results are visible */
+			/*
+			 * Update the query descriptor snapshot so results are visible. The
+			 * active snapshot may be shared with an outer statement, such as an
+			 * EXECUTE, so update a private copy of it instead.
+			 */
 			UnregisterSnapshot(queryDesc->snapshot);
+			PushCopiedSnapshot(GetActiveSnapshot());
 			UpdateActiveSnapshotCommandId();
 			queryDesc->snapshot = RegisterSnapshot(GetActiveSnapshot());
+			PopActiveSnapshot();
+
+			/* swap in modified (local) plan for compatibility with standard start hook */
+			originalPlan = distributedPlan->originalPlan;
+			plannedStatement = SwapInLocalPlan(queryDesc, originalPlan);
 
 			/* update sequential scan's table entry to point to intermediate table */
 			intermediateResultTableId = RangeVarGetRelid(intermediateResultTable,
@@ -1343,10 +1509,6 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 			Assert(sequentialScanRangeTable->rtekind == RTE_RELATION);
 			sequentialScanRangeTable->relid = intermediateResultTableId;
 
-			/* swap in modified (local) plan for compatibility with standard start hook */
-			originalPlan = distributedPlan->originalPlan;
-			plannedStatement->planTree = originalPlan;
-
 			NextExecutorStartHook(queryDesc, eflags);
 		}
 	}
@@ -1357,6 +1519,27 @@ PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
 }
 
 
+/*
+ * SwapInLocalPlan points the query descriptor at a copy of its planned
+ * statement which executes the given local plan instead, and returns that
+ * copy. Planned statements may be cached and reused for later executions, so
+ * they must not be modified in place.
+ */
+static PlannedStmt *
+SwapInLocalPlan(QueryDesc *queryDesc, Plan *localPlan)
+{
+	PlannedStmt *localStatement = (PlannedStmt *) palloc(sizeof(PlannedStmt));
+
+	memcpy(localStatement, queryDesc->plannedstmt, sizeof(PlannedStmt));
+	localStatement->rtable = copyObject(localStatement->rtable);
+	localStatement->planTree = localPlan;
+
+	queryDesc->plannedstmt = localStatement;
+
+	return localStatement;
+}
+
+
 /*
  * IsPgShardPlan determines whether the provided plannedStmt contains a plan
  * suitable for execution by PgShard.
@@ -1366,79 +1549,405 @@ IsPgShardPlan(PlannedStmt *plannedStmt)
 {
 	Plan *plan = plannedStmt->planTree;
 	NodeTag nodeTag = nodeTag(plan);
-	bool isPgShardPlan = ((DistributedNodeTag) nodeTag == T_DistributedPlan);
+	bool isPgShardPlan = ((DistributedNodeTag) nodeTag == T_DistributedPlan) ||
+						 IsWrappedDistributedPlan(plan);
 
 	return isPgShardPlan;
 }
 
 
 /*
- * NextExecutorStartHook simply encapsulates the common logic of calling the
- * next executor start hook in the chain or the standard executor start hook
- * if no other hooks are present.
+ * IsWrappedDistributedPlan determines whether the provided plan is a CustomScan
+ * node carrying a distributed plan, as produced by WrapDistributedPlan.
  */
-static void
-NextExecutorStartHook(QueryDesc *queryDesc, int eflags)
+static bool
+IsWrappedDistributedPlan(Plan *plan)
 {
-	/* call into the standard executor start, or hook if set */
-	if (PreviousExecutorStartHook != NULL)
-	{
-		PreviousExecutorStartHook(queryDesc, eflags);
-	}
-	else
-	{
-		standard_ExecutorStart(queryDesc, eflags);
-	}
+	return IsA(plan, CustomScan) &&
+		   ((CustomScan *) plan)->methods == &DistributedPlanMethods;
 }
 
 
 /*
- * CommutativityRuleToLockMode determines the commutativity rule for the given
- * command and returns the appropriate lock mode to enforce that rule. The
- * function assumes a SELECT doesn't modify state and therefore is commutative
- * with all other commands. The function also assumes that an INSERT commutes
- * with another INSERT, but not with an UPDATE/DELETE; and an UPDATE/DELETE
- * doesn't commute with an INSERT, UPDATE, or DELETE.
- *
- * The above mapping is overridden entirely when all_modifications_commutative
- * is set to true. In that case, all commands just claim a shared lock. This
- * allows the shard repair logic to lock out modifications while permitting all
- * commands to otherwise commute.
+ * WrapDistributedPlan stores the given distributed plan in the private list of
+ * a new CustomScan node, which copyObject is able to copy. Task placements are
+ * stored as well, so unwrapping a plan doesn't require metadata lookups.
  */
-static LOCKMODE
-CommutativityRuleToLockMode(CmdType commandType)
+static Plan *
+WrapDistributedPlan(DistributedPlan *distributedPlan)
 {
-	LOCKMODE lockMode = NoLock;
-
-	/* bypass commutativity checks when flag enabled */
-	if (AllModificationsCommutative)
-	{
-		return ShareLock;
-	}
-
-	if (commandType == CMD_SELECT)
-	{
-		lockMode = NoLock;
-	}
-	else if (commandType == CMD_INSERT)
-	{
-		lockMode = ShareLock;
-	}
-	else if (commandType == CMD_UPDATE || commandType == CMD_DELETE)
-	{
-		lockMode = ExclusiveLock;
-	}
-	else
-	{
-		ereport(ERROR, (errmsg("unrecognized operation code: %d", (int) commandType)));
-	}
-
-	return lockMode;
+	CustomScan *customScan = makeNode(CustomScan);
+	List *privateList = NIL;
+
+	customScan->scan.plan.startup_cost = distributedPlan->plan.startup_cost;
+	customScan->scan.plan.total_cost = distributedPlan->plan.total_cost;
+	customScan->scan.plan.plan_rows = distributedPlan->plan.plan_rows;
+	customScan->scan.plan.plan_width = distributedPlan->plan.plan_width;
+	customScan->methods = &DistributedPlanMethods;
+
+	/* the order of fields must match the one used in UnwrapDistributedPlan */
+	privateList = lappend(privateList, distributedPlan->originalPlan);
+	privateList = lappend(privateList, SerializeTaskList(distributedPlan->taskList));
+	privateList = lappend(privateList, distributedPlan->targetList);
+	privateList = lappend(privateList,
+						  makeInteger(distributedPlan->selectFromMultipleShards));
+	privateList = lappend(privateList, distributedPlan->createTemporaryTableStmt);
+	privateList = lappend(privateList, distributedPlan->parameterizedQuery);
+	privateList = lappend(privateList, distributedPlan->originalQuery);
+	privateList = lappend(privateList, makeInteger(distributedPlan->cursorOptions));
+
+	customScan->custom_private = privateList;
+
+	return (Plan *) customScan;
 }
 
 
 /*
- * AcquireExecutorShardLocks: acquire shard locks needed for execution of tasks
+ * UnwrapDistributedPlan rebuilds the distributed plan stored in the given
+ * CustomScan node by WrapDistributedPlan. The returned plan shares its nodes
+ * with the wrapped one, so callers must not modify them in place.
+ */
+static DistributedPlan *
+UnwrapDistributedPlan(Plan *plan)
+{
+	CustomScan *customScan = (CustomScan *) plan;
+	List *privateList = customScan->custom_private;
+	DistributedPlan *distributedPlan = palloc0(sizeof(DistributedPlan));
+
+	Assert(IsWrappedDistributedPlan(plan));
+	Assert(list_length(privateList) == 8);
+
+	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
+	distributedPlan->plan.startup_cost = plan->startup_cost;
+	distributedPlan->plan.total_cost = plan->total_cost;
+	distributedPlan->plan.plan_rows = plan->plan_rows;
+	distributedPlan->plan.plan_width = plan->plan_width;
+
+	distributedPlan->originalPlan = (Plan *) list_nth(privateList, 0);
+	distributedPlan->taskList = DeserializeTaskList((List *) list_nth(privateList, 1));
+	distributedPlan->targetList = (List *) list_nth(privateList, 2);
+	distributedPlan->selectFromMultipleShards = intVal(list_nth(privateList, 3));
+	distributedPlan->createTemporaryTableStmt = (CreateStmt *) list_nth(privateList, 4);
+	distributedPlan->parameterizedQuery = (Query *) list_nth(privateList, 5);
+	distributedPlan->originalQuery = (Query *) list_nth(privateList, 6);
+	distributedPlan->cursorOptions = intVal(list_nth(privateList, 7));
+
+	return distributedPlan;
+}
+
+
+/*
+ * SerializeTaskList converts the given list of tasks into a list of nodes. Each
+ * task becomes a list holding its query string, its shard identifier and the
+ * list of its placements. Bound parameters are not serialized, as they are
+ * only ever set on plans bound during execution.
+ */
+static List *
+SerializeTaskList(List *taskList)
+{
+	List *serializedTaskList = NIL;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		List *serializedPlacementList = NIL;
+		ListCell *placementCell = NULL;
+
+		Assert(task->boundParams == NULL);
+
+		foreach(placementCell, task->taskPlacementList)
+		{
+			ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+			List *serializedPlacement = list_make4(MakeInt64Value(placement->id),
+												   MakeInt64Value(placement->shardId),
+												   makeInteger(placement->shardState),
+												   makeString(placement->nodeName));
+
+			serializedPlacement = lappend(serializedPlacement,
+										  makeInteger(placement->nodePort));
+
+			serializedPlacementList = lappend(serializedPlacementList,
+											  serializedPlacement);
+		}
+
+		serializedTaskList = lappend(serializedTaskList,
+									 list_make3(makeString(task->queryString->data),
+												MakeInt64Value(task->shardId),
+												serializedPlacementList));
+	}
+
+	return serializedTaskList;
+}
+
+
+/*
+ * DeserializeTaskList rebuilds the list of tasks converted into nodes by
+ * SerializeTaskList.
+ */
+static List *
+DeserializeTaskList(List *serializedTaskList)
+{
+	List *taskList = NIL;
+	ListCell *serializedTaskCell = NULL;
+
+	foreach(serializedTaskCell, serializedTaskList)
+	{
+		List *serializedTask = (List *) lfirst(serializedTaskCell);
+		List *serializedPlacementList = (List *) lthird(serializedTask);
+		ListCell *serializedPlacementCell = NULL;
+		Task *task = (Task *) palloc0(sizeof(Task));
+
+		task->queryString = makeStringInfo();
+		appendStringInfoString(task->queryString, strVal(linitial(serializedTask)));
+		task->shardId = Int64ValueGet((Value *) lsecond(serializedTask));
+
+		foreach(serializedPlacementCell, serializedPlacementList)
+		{
+			List *serializedPlacement = (List *) lfirst(serializedPlacementCell);
+			ShardPlacement *placement = palloc0(sizeof(ShardPlacement));
+
+			placement->id = Int64ValueGet((Value *) list_nth(serializedPlacement, 0));
+			placement->shardId = Int64ValueGet((Value *) list_nth(serializedPlacement, 1));
+			placement->shardState = intVal(list_nth(serializedPlacement, 2));
+			placement->nodeName = strVal(list_nth(serializedPlacement, 3));
+			placement->nodePort = intVal(list_nth(serializedPlacement, 4));
+
+			task->taskPlacementList = lappend(task->taskPlacementList, placement);
+		}
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
+/* MakeInt64Value stores the given 64-bit integer in a string value node. */
+static Value *
+MakeInt64Value(int64 value)
+{
+	return makeString(psprintf(INT64_FORMAT, value));
+}
+
+
+/* Int64ValueGet returns the 64-bit integer stored by MakeInt64Value. */
+static int64
+Int64ValueGet(Value *value)
+{
+	int64 result = 0;
+
+	(void) scanint8(strVal(value), false, &result);
+
+	return result;
+}
+
+
+/*
+ * BindParameterizedPlan binds a plan template to the given parameter values.
+ * Shards are pruned using the parameter values, and the returned statement
+ * contains a plan with a task for each remaining shard. Tasks reuse the query
+ * strings deparsed during planning and send parameter values separately.
+ *
+ * Multi-shard SELECTs have to be planned over an intermediate table whose plan
+ * depends on the query's restrictions, so they are planned anew using the given
+ * parameter values instead.
+ */
+static PlannedStmt *
+BindParameterizedPlan(PlannedStmt *parameterizedStatement, ParamListInfo boundParams)
+{
+	DistributedPlan *parameterizedPlan =
+		(DistributedPlan *) parameterizedStatement->planTree;
+	Query *parameterizedQuery = parameterizedPlan->parameterizedQuery;
+	Query *boundQuery = BindQueryParameters(parameterizedQuery, boundParams);
+	List *queryShardList = DistributedQueryShardList(boundQuery);
+	PlannedStmt *boundStatement = NULL;
+
+	if (SelectFromMultipleShards(boundQuery, queryShardList))
+	{
+		Query *originalQuery = copyObject(parameterizedPlan->originalQuery);
+		int cursorOptions = parameterizedPlan->cursorOptions;
+
+		boundStatement = PgShardPlanner(originalQuery, cursorOptions, boundParams);
+		if (IsWrappedDistributedPlan(boundStatement->planTree))
+		{
+			boundStatement->planTree =
+				(Plan *) UnwrapDistributedPlan(boundStatement->planTree);
+		}
+	}
+	else
+	{
+		DistributedPlan *boundPlan = palloc0(sizeof(DistributedPlan));
+		ListCell *shardIntervalCell = NULL;
+		List *taskList = NIL;
+
+		foreach(shardIntervalCell, queryShardList)
+		{
+			ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+			int64 shardId = shardInterval->id;
+			Task *templateTask = FindShardTask(parameterizedPlan->taskList, shardId);
+			StringInfo queryString = NULL;
+			Task *task = NULL;
+
+			/* shards created after planning have no query string yet */
+			if (templateTask != NULL)
+			{
+				queryString = templateTask->queryString;
+			}
+			else
+			{
+				queryString = DeparseShardQuery(copyObject(parameterizedQuery), shardId);
+			}
+
+			task = BuildTask(shardId, queryString);
+			task->boundParams = boundParams;
+
+			taskList = lappend(taskList, task);
+		}
+
+		memcpy(boundPlan, parameterizedPlan, sizeof(DistributedPlan));
+		boundPlan->taskList = taskList;
+		boundPlan->parameterizedQuery = NULL;
+		boundPlan->originalQuery = NULL;
+
+		boundStatement = (PlannedStmt *) palloc(sizeof(PlannedStmt));
+		memcpy(boundStatement, parameterizedStatement, sizeof(PlannedStmt));
+		boundStatement->planTree = (Plan *) boundPlan;
+	}
+
+	if (IsPgShardPlan(boundStatement) &&
+		((DistributedPlan *) boundStatement->planTree)->parameterizedQuery != NULL)
+	{
+		ereport(ERROR, (errmsg("could not bind parameters of distributed query")));
+	}
+
+	return boundStatement;
+}
+
+
+/*
+ * BindQueryParameters returns a copy of the given planned query with all its
+ * parameters replaced by the given values, and the expressions containing them
+ * simplified as the planner would have done had the values been known. This
+ * function errors out if any parameters remain unbound.
+ */
+static Query *
+BindQueryParameters(Query *parameterizedQuery, ParamListInfo boundParams)
+{
+	Query *boundQuery = copyObject(parameterizedQuery);
+	FromExpr *joinTree = boundQuery->jointree;
+	PlannerGlobal *plannerGlobal = makeNode(PlannerGlobal);
+	PlannerInfo *plannerInfo = makeNode(PlannerInfo);
+
+	/* eval_const_expressions only needs the bound parameters from the planner */
+	plannerGlobal->boundParams = boundParams;
+	plannerInfo->glob = plannerGlobal;
+
+	boundQuery->targetList = (List *) eval_const_expressions(plannerInfo,
+															 (Node *) boundQuery->targetList);
+	if (joinTree != NULL)
+	{
+		joinTree->quals = eval_const_expressions(plannerInfo, joinTree->quals);
+	}
+
+	if (QueryContainsExternParams(boundQuery))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("could not bind parameters of distributed query"),
+						errdetail("Values must be supplied for all parameters of "
+								  "distributed queries.")));
+	}
+
+	return boundQuery;
+}
+
+
+/* FindShardTask returns the task for the given shard, or NULL if there is none. */
+static Task *
+FindShardTask(List *taskList, int64 shardId)
+{
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		if (task->shardId == shardId)
+		{
+			return task;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * NextExecutorStartHook simply encapsulates the common logic of calling the
+ * next executor start hook in the chain or the standard executor start hook
+ * if no other hooks are present.
+ */
+static void
+NextExecutorStartHook(QueryDesc *queryDesc, int eflags)
+{
+	/* call into the standard executor start, or hook if set */
+	if (PreviousExecutorStartHook != NULL)
+	{
+		PreviousExecutorStartHook(queryDesc, eflags);
+	}
+	else
+	{
+		standard_ExecutorStart(queryDesc, eflags);
+	}
+}
+
+
+/*
+ * CommutativityRuleToLockMode determines the commutativity rule for the given
+ * command and returns the appropriate lock mode to enforce that rule. The
+ * function assumes a SELECT doesn't modify state and therefore is commutative
+ * with all other commands. The function also assumes that an INSERT commutes
+ * with another INSERT, but not with an UPDATE/DELETE; and an UPDATE/DELETE
+ * doesn't commute with an INSERT, UPDATE, or DELETE.
+ *
+ * The above mapping is overridden entirely when all_modifications_commutative
+ * is set to true. In that case, all commands just claim a shared lock. This
+ * allows the shard repair logic to lock out modifications while permitting all
+ * commands to otherwise commute.
+ */
+static LOCKMODE
+CommutativityRuleToLockMode(CmdType commandType)
+{
+	LOCKMODE lockMode = NoLock;
+
+	/* bypass commutativity checks when flag enabled */
+	if (AllModificationsCommutative)
+	{
+		return ShareLock;
+	}
+
+	if (commandType == CMD_SELECT)
+	{
+		lockMode = NoLock;
+	}
+	else if (commandType == CMD_INSERT)
+	{
+		lockMode = ShareLock;
+	}
+	else if (commandType == CMD_UPDATE || commandType == CMD_DELETE)
+	{
+		lockMode = ExclusiveLock;
+	}
+	else
+	{
+		ereport(ERROR, (errmsg("unrecognized operation code: %d", (int) commandType)));
+	}
+
+	return lockMode;
+}
+
+
+/*
+ * AcquireExecutorShardLocks: acquire shard locks needed for execution of tasks
  * within a distributed plan.
  */
 static void
@@ -1543,6 +2052,7 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 	bool resultsOK = false;
 	List *taskPlacementList = task->taskPlacementList;
 	ListCell *taskPlacementCell = NULL;
+	bool useBroker = RouteThroughBroker();
 
 	/*
 	 * Try to run the query to completion on one placement. If the query fails
@@ -1555,14 +2065,34 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 		int32 nodePort = taskPlacement->nodePort;
 		bool queryOK = false;
 		bool storedOK = false;
+		PGconn *connection = NULL;
+
+		if (useBroker)
+		{
+			BrokerCommand *brokerCommand = BuildBrokerCommand(nodeName, nodePort,
+															  task->queryString,
+															  task->boundParams);
+			BrokerResult *brokerResult = BrokerExecuteCommand(brokerCommand,
+															  UseDtmTransactions);
+			if (brokerResult->resultStatus != PGRES_TUPLES_OK)
+			{
+				ReportBrokerError(brokerCommand, brokerResult);
+				continue;
+			}
 
-		PGconn *connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
+			StoreBrokerResult(brokerResult, tupleDescriptor, tupleStore);
+			resultsOK = true;
+			break;
+		}
+
+		connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
 		if (connection == NULL)
 		{
 			continue;
 		}
 
-		queryOK = SendQueryInSingleRowMode(connection, task->queryString);
+		queryOK = SendQueryInSingleRowMode(connection, task->queryString,
+										   task->boundParams);
 		if (!queryOK)
 		{
 			PurgeConnection(connection);
@@ -1589,15 +2119,35 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 /*
  * SendQueryInSingleRowMode sends the given query on the connection in an
  * asynchronous way. The function also sets the single-row mode on the
- * connection so that we receive results a row at a time.
+ * connection so that we receive results a row at a time. If parameter values
+ * are given, the query is run as a statement prepared on the connection.
  */
 static bool
-SendQueryInSingleRowMode(PGconn *connection, StringInfo query)
+SendQueryInSingleRowMode(PGconn *connection, StringInfo query,
+						 ParamListInfo boundParams)
 {
 	int querySent = 0;
 	int singleRowMode = 0;
 
-	querySent = PQsendQuery(connection, query->data);
+	if (boundParams != NULL)
+	{
+		const char **parameterValues = NULL;
+		char *statementName = PrepareTaskStatement(connection, query, boundParams,
+												   &parameterValues);
+		if (statementName == NULL)
+		{
+			return false;
+		}
+
+		querySent = PQsendQueryPrepared(connection, statementName,
+										boundParams->numParams, parameterValues,
+										NULL, NULL, 0);
+	}
+	else
+	{
+		querySent = PQsendQuery(connection, query->data);
+	}
+
 	if (querySent == 0)
 	{
 		ReportRemoteError(connection, NULL);
@@ -1615,6 +2165,195 @@ SendQueryInSingleRowMode(PGconn *connection, StringInfo query)
 }
 
 
+/*
+ * ExecuteRemoteCommand runs the given query on the connection and waits for its
+ * result. If parameter values are given, the query is run as a statement
+ * prepared on the connection. The function returns NULL if the statement could
+ * not be prepared; callers should treat that as a failed command.
+ */
+static PGresult *
+ExecuteRemoteCommand(PGconn *connection, StringInfo query, ParamListInfo boundParams)
+{
+	PGresult *result = NULL;
+
+	if (boundParams != NULL)
+	{
+		const char **parameterValues = NULL;
+		char *statementName = PrepareTaskStatement(connection, query, boundParams,
+												   &parameterValues);
+		if (statementName != NULL)
+		{
+			result = PQexecPrepared(connection, statementName, boundParams->numParams,
+									parameterValues, NULL, NULL, 0);
+		}
+	}
+	else
+	{
+		result = PQexec(connection, query->data);
+	}
+
+	return result;
+}
+
+
+/*
+ * PrepareTaskStatement makes sure a statement for the given parameterized query
+ * is prepared on the connection, and returns its name. The function also
+ * converts the given parameter values to their text representation for use in
+ * executing the statement. Parameters of user-defined types are left for the
+ * remote server to resolve, as type OIDs differ across servers.
+ */
+static char *
+PrepareTaskStatement(PGconn *connection, StringInfo query, ParamListInfo boundParams,
+					 const char ***parameterValues)
+{
+	int parameterCount = boundParams->numParams;
+	Oid *parameterTypes = NULL;
+
+	BuildTaskParameters(boundParams, &parameterTypes, parameterValues);
+
+	return PrepareRemoteStatement(connection, query->data, parameterCount,
+								  parameterTypes);
+}
+
+
+/*
+ * BuildTaskParameters converts the given parameter values to their text
+ * representation and determines the types to send along with them. Parameters
+ * of user-defined types are left for the remote server to resolve, as type OIDs
+ * differ across servers.
+ */
+static void
+BuildTaskParameters(ParamListInfo boundParams, Oid **parameterTypes,
+					const char ***parameterValues)
+{
+	int parameterCount = boundParams->numParams;
+	Oid *parameterTypeArray = (Oid *) palloc0(Max(parameterCount, 1) * sizeof(Oid));
+	const char **parameterValueArray = (const char **) palloc0(
+		Max(parameterCount, 1) * sizeof(char *));
+
+	for (int parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		ParamExternData *parameterData = &boundParams->params[parameterIndex];
+
+		/* give hook a chance in case parameter is dynamic */
+		if (!OidIsValid(parameterData->ptype) && boundParams->paramFetch != NULL)
+		{
+			(*boundParams->paramFetch)(boundParams, parameterIndex + 1);
+		}
+
+		if (parameterData->ptype < FirstNormalObjectId)
+		{
+			parameterTypeArray[parameterIndex] = parameterData->ptype;
+		}
+
+		if (!parameterData->isnull && OidIsValid(parameterData->ptype))
+		{
+			Oid typeOutputFunctionId = InvalidOid;
+			bool variableLengthType = false;
+
+			getTypeOutputInfo(parameterData->ptype, &typeOutputFunctionId,
+							  &variableLengthType);
+
+			parameterValueArray[parameterIndex] =
+				OidOutputFunctionCall(typeOutputFunctionId, parameterData->value);
+		}
+	}
+
+	*parameterTypes = parameterTypeArray;
+	*parameterValues = parameterValueArray;
+}
+
+
+/*
+ * BuildBrokerCommand builds the command which runs the given query on a node
+ * through the connection broker, along with the values of any parameters.
+ */
+static BrokerCommand *
+BuildBrokerCommand(char *nodeName, int32 nodePort, StringInfo query,
+				   ParamListInfo boundParams)
+{
+	BrokerCommand *brokerCommand = (BrokerCommand *) palloc0(sizeof(BrokerCommand));
+
+	brokerCommand->nodeName = nodeName;
+	brokerCommand->nodePort = nodePort;
+	brokerCommand->queryString = query->data;
+
+	if (boundParams != NULL)
+	{
+		brokerCommand->parameterCount = boundParams->numParams;
+		BuildTaskParameters(boundParams, &brokerCommand->parameterTypes,
+							&brokerCommand->parameterValues);
+	}
+
+	return brokerCommand;
+}
+
+
+/*
+ * RouteThroughBroker returns whether remote commands of the current statement
+ * should run through the connection broker. Distributed transactions make this
+ * choice once, when they begin, as all their commands to a node have to use the
+ * same connection.
+ */
+static bool
+RouteThroughBroker(void)
+{
+	if (UseDtmTransactions && connectionsWithDtmTransactions != NIL)
+	{
+		return dtmTransactionUsesBroker;
+	}
+
+	return ConnectionBrokerAvailable();
+}
+
+
+/*
+ * StoreBrokerResult builds tuples from the rows of a result received from the
+ * connection broker and stores them in the given tuple-store.
+ */
+static void
+StoreBrokerResult(BrokerResult *brokerResult, TupleDesc tupleDescriptor,
+				  Tuplestorestate *tupleStore)
+{
+	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+	int columnCount = brokerResult->columnCount;
+	char **columnArray = (char **) palloc0(Max(columnCount, 1) * sizeof(char *));
+	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
+													"StoreBrokerResult",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+
+	Assert(columnCount == tupleDescriptor->natts);
+
+	for (int rowIndex = 0; rowIndex < brokerResult->rowCount; rowIndex++)
+	{
+		HeapTuple heapTuple = NULL;
+		MemoryContext oldContext = NULL;
+
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			columnArray[columnIndex] = BrokerResultGetValue(brokerResult, rowIndex,
+															columnIndex);
+		}
+
+		/* protect against leaks in I/O functions, as in StoreQueryResult */
+		oldContext = MemoryContextSwitchTo(ioContext);
+
+		heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+
+		MemoryContextSwitchTo(oldContext);
+
+		tuplestore_puttuple(tupleStore, heapTuple);
+		MemoryContextReset(ioContext);
+	}
+
+	MemoryContextDelete(ioContext);
+	pfree(columnArray);
+}
+
+
 /*
  * StoreQueryResult gets the query results from the given connection, builds
  * tuples from the results and stores them in the given tuple-store. If the
@@ -1892,6 +2631,7 @@ ExecuteDistributedModify(DistributedPlan *plan)
 	ListCell *taskPlacementCell = NULL;
 	List *failedPlacementList = NIL;
 	ListCell *failedPlacementCell = NULL;
+	bool useBroker = false;
 
 	/* we only support a single modification to a single shard */
 	if (list_length(plan->taskList) != 1)
@@ -1906,6 +2646,8 @@ ExecuteDistributedModify(DistributedPlan *plan)
 		PrepareDtmTransaction(task);
 	}
 
+	useBroker = RouteThroughBroker();
+
 	foreach(taskPlacementCell, task->taskPlacementList)
 	{
 		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
@@ -1919,26 +2661,48 @@ ExecuteDistributedModify(DistributedPlan *plan)
 
 		Assert(taskPlacement->shardState == STATE_FINALIZED);
 
-		connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
-		if (connection == NULL)
+		if (useBroker)
 		{
-			failedPlacementList = lappend(failedPlacementList, taskPlacement);
-			continue;
-		}
+			BrokerCommand *brokerCommand = BuildBrokerCommand(nodeName, nodePort,
+															  task->queryString,
+															  task->boundParams);
+			BrokerResult *brokerResult = BrokerExecuteCommand(brokerCommand,
+															  UseDtmTransactions);
+			if (brokerResult->resultStatus != PGRES_COMMAND_OK)
+			{
+				ReportBrokerError(brokerCommand, brokerResult);
 
-		result = PQexec(connection, task->queryString->data);
-		if (PQresultStatus(result) != PGRES_COMMAND_OK)
+				failedPlacementList = lappend(failedPlacementList, taskPlacement);
+				continue;
+			}
+
+			currentAffectedTupleString = brokerResult->affectedTupleCount;
+		}
+		else
 		{
-			ReportRemoteError(connection, result);
-			PQclear(result);
+			connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
+			if (connection == NULL)
+			{
+				failedPlacementList = lappend(failedPlacementList, taskPlacement);
+				continue;
+			}
 
-			failedPlacementList = lappend(failedPlacementList, taskPlacement);
-			continue;
+			result = ExecuteRemoteCommand(connection, task->queryString,
+										  task->boundParams);
+			if (PQresultStatus(result) != PGRES_COMMAND_OK)
+			{
+				ReportRemoteError(connection, result);
+				PQclear(result);
+
+				failedPlacementList = lappend(failedPlacementList, taskPlacement);
+				continue;
+			}
+			TRACE("shard_xtm: conn#%p: \"%s\" to %s:%u\n",
+					connection, task->queryString->data, nodeName, nodePort);
+
+			currentAffectedTupleString = PQcmdTuples(result);
 		}
-		TRACE("shard_xtm: conn#%p: \"%s\" to %s:%u\n",
-				connection, task->queryString->data, nodeName, nodePort);
 
-		currentAffectedTupleString = PQcmdTuples(result);
 		currentAffectedTupleCount = pg_atoi(currentAffectedTupleString, sizeof(int32), 0);
 
 		if ((affectedTupleCount == -1) ||
@@ -1977,7 +2741,9 @@ ExecuteDistributedModify(DistributedPlan *plan)
 
 /*
  * PrepareDtmTransaction sends the necessary commands to the nodes to perform
- * a global transaction.
+ * a global transaction. When the transaction runs through the connection
+ * broker, the broker pins the connections it uses to this backend, so that
+ * all later commands of the transaction reach the same remote transactions.
  */
 static void
 PrepareDtmTransaction(Task *task)
@@ -1989,37 +2755,51 @@ PrepareDtmTransaction(Task *task)
 
 	oldContext = MemoryContextSwitchTo(TopTransactionContext);
 
+	if (connectionsWithDtmTransactions == NIL)
+	{
+		dtmTransactionUsesBroker = ConnectionBrokerAvailable();
+	}
+
 	foreach(taskPlacementCell, task->taskPlacementList)
 	{
 		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
 		char *nodeName = taskPlacement->nodeName;
 		int32 nodePort = taskPlacement->nodePort;
-		PGconn *connection = NULL;
+		NodeConnectionKey *node = NULL;
 
-		connection = GetConnection(nodeName, nodePort, true);
-		if (connection == NULL)
+		if (FindDtmTransactionNode(nodeName, nodePort) != NULL)
 		{
-			ereport(WARNING, (errmsg("failed to connect to %s:%d",
-									 nodeName, nodePort)));
-			abortTransaction = true;
+			/* already started a transaction */
 			continue;
 		}
 
-		if (list_member_ptr(connectionsWithDtmTransactions, connection))
+		node = (NodeConnectionKey *) palloc0(sizeof(NodeConnectionKey));
+		strlcpy(node->nodeName, nodeName, MAX_NODE_LENGTH + 1);
+		node->nodePort = nodePort;
+
+		if (!dtmTransactionUsesBroker && GetConnection(nodeName, nodePort, true) == NULL)
 		{
-			/* already started a transaction */
+			ereport(WARNING, (errmsg("failed to connect to %s:%d",
+									 nodeName, nodePort)));
+			abortTransaction = true;
 			continue;
 		}
-		if (!SendCommand(connection, "BEGIN"))
+
+		if (!SendCommand(node, "BEGIN", PGRES_COMMAND_OK, NULL))
 		{
-			PurgeConnection(connection);
+			PGconn *connection = NULL;
+			if (!dtmTransactionUsesBroker &&
+				(connection = GetConnection(nodeName, nodePort, false)) != NULL)
+			{
+				PurgeConnection(connection);
+			}
 			abortTransaction = true;
 			continue;
 		}
 		if (!currentGlobalTransactionId)
 		{
 			/* Send dtm_begin_transaction to the first node */
-			currentGlobalTransactionId = SendDtmBeginTransaction(connection);
+			currentGlobalTransactionId = SendDtmBeginTransaction(node);
 			if (!currentGlobalTransactionId)
 			{
 				ereport(WARNING, (errmsg("failed to parse remoteTransactionId result on %s:%d",
@@ -2027,22 +2807,22 @@ PrepareDtmTransaction(Task *task)
 				abortTransaction = true;
 				continue;
 			}
-			TRACE("shard_xtm: conn#%p: Sent dtm_begin() to %s:%u -> %llu\n",
-					 connection, nodeName, nodePort, currentGlobalTransactionId);
+			TRACE("shard_xtm: Sent dtm_begin() to %s:%u -> %llu\n",
+					 nodeName, nodePort, currentGlobalTransactionId);
 		}
 		else
 		{
 			/* Send dtm_join_transaction to the rest of the nodes */
-			if (!SendDtmJoinTransaction(connection, currentGlobalTransactionId))
+			if (!SendDtmJoinTransaction(node, currentGlobalTransactionId))
 			{
 				abortTransaction = true;
 				continue;
 			}
-			TRACE("shard_xtm: conn#%p: Sent dtm_access(%llu) to %s:%u\n",
-					 connection, currentGlobalTransactionId, nodeName, nodePort);
+			TRACE("shard_xtm: Sent dtm_access(%llu) to %s:%u\n",
+					 currentGlobalTransactionId, nodeName, nodePort);
 		}
 
-		newTransactions = lappend(newTransactions, connection);
+		newTransactions = lappend(newTransactions, node);
 	}
 
 	if (abortTransaction)
@@ -2051,7 +2831,7 @@ PrepareDtmTransaction(Task *task)
 
 		/* make sure we abort all pending transactions */
 		connectionsWithDtmTransactions = newTransactions;
-		
+
 		/*
 		 * Since pg_shard reuses connections across transactions on the master,
 		 * we need to abort pending transactions on the workers.
@@ -2060,21 +2840,11 @@ PrepareDtmTransaction(Task *task)
 		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
 	}
 
-	connectionsWithDtmTransactions = list_union(connectionsWithDtmTransactions,
-												newTransactions);
+	connectionsWithDtmTransactions = list_concat(connectionsWithDtmTransactions,
+												 newTransactions);
 
 	MemoryContextSwitchTo(oldContext);
 
-	if (abortTransaction)
-	{
-		/*
-		 * Since pg_shard reuses connections across transactions on the master,
-		 * we need to abort pending transactions on the workers.
-		 */
-		FinishDtmTransaction(XACT_EVENT_ABORT, NULL);
-		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
-	}
-
 	if (!commitCallbackSet)
 	{
 		RegisterXactCallback(FinishDtmTransaction, NULL);
@@ -2083,77 +2853,125 @@ PrepareDtmTransaction(Task *task)
 }
 
 
+/*
+ * FindDtmTransactionNode returns the node taking part in the current global
+ * transaction with the given name and port, or NULL if there is none.
+ */
+static NodeConnectionKey *
+FindDtmTransactionNode(char *nodeName, int32 nodePort)
+{
+	ListCell *nodeCell = NULL;
+
+	foreach(nodeCell, connectionsWithDtmTransactions)
+	{
+		NodeConnectionKey *node = (NodeConnectionKey *) lfirst(nodeCell);
+
+		if (node->nodePort == nodePort &&
+			strncmp(node->nodeName, nodeName, MAX_NODE_LENGTH + 1) == 0)
+		{
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+
 static csn_t
-SendDtmBeginTransaction(PGconn *connection)
+SendDtmBeginTransaction(NodeConnectionKey *node)
 {
-	PGresult *result = NULL;
 	char *resp = NULL;
 	csn_t remoteTransactionId;
+	char *command = DtmTwoPhaseCommit
+		? psprintf("SELECT dtm_extend('%d.%d')", MyProcPid, ++currentLocalTransactionId)
+		: "SELECT dtm_extend()";
 
-	
-	result = DtmTwoPhaseCommit
-		? PQexec(connection, psprintf("SELECT dtm_extend('%d.%d')", MyProcPid, ++currentLocalTransactionId))
-		: PQexec(connection, "SELECT dtm_extend()");
-	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	if (!SendCommand(node, command, PGRES_TUPLES_OK, &resp))
 	{
-		ReportRemoteError(connection, result);
-		PQclear(result);
 		return 0;
 	}
 
-	resp = PQgetvalue(result, 0, 0);
 	if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &remoteTransactionId) != 1)
 	{
-		ReportRemoteError(connection, result);
-		PQclear(result);
 		return 0;
 	}
 
-	PQclear(result);
 	return remoteTransactionId;
 }
 
 
 static bool
-SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId)
+SendDtmJoinTransaction(NodeConnectionKey *node, csn_t TransactionId)
 {
-	PGresult *result = NULL;
-	bool resultOK = true;
-
-	result = PQexec(connection, DtmTwoPhaseCommit
-					? psprintf("SELECT dtm_access(%llu, '%d.%d')", TransactionId, MyProcPid, currentLocalTransactionId)
-					: psprintf("SELECT dtm_access(%llu)", TransactionId));
-	if (PQresultStatus(result) != PGRES_TUPLES_OK)
-	{
-		ReportRemoteError(connection, result);
-		resultOK = false;
-	}
-
-	PQclear(result);
-
-	return resultOK;
+	return SendCommand(node, DtmTwoPhaseCommit
+					   ? psprintf("SELECT dtm_access(%llu, '%d.%d')", TransactionId, MyProcPid, currentLocalTransactionId)
+					   : psprintf("SELECT dtm_access(%llu)", TransactionId),
+					   PGRES_TUPLES_OK, NULL);
 }
 
 
+/*
+ * SendCommand runs a command of the current global transaction on the given
+ * node, through the connection broker or on the backend's own connection, and
+ * checks that it produced the expected status. If requested, the command's
+ * first value is returned as well.
+ */
 static bool
-SendCommand(PGconn *connection, char *command)
+SendCommand(NodeConnectionKey *node, char *command, ExecStatusType expectedStatus,
+			char **firstValue)
 {
-	PGresult *result = NULL;
 	bool resultOK = true;
 
-	result = PQexec(connection, command);
-	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	if (dtmTransactionUsesBroker)
 	{
-		ReportRemoteError(connection, result);
-		resultOK = false;
+		BrokerCommand brokerCommand;
+		BrokerResult *brokerResult = NULL;
+
+		memset(&brokerCommand, 0, sizeof(brokerCommand));
+		brokerCommand.nodeName = node->nodeName;
+		brokerCommand.nodePort = node->nodePort;
+		brokerCommand.queryString = command;
+
+		brokerResult = BrokerExecuteCommand(&brokerCommand, true);
+		if (brokerResult->resultStatus != expectedStatus)
+		{
+			ReportBrokerError(&brokerCommand, brokerResult);
+			resultOK = false;
+		}
+		else if (firstValue != NULL && brokerResult->rowCount > 0 &&
+				 brokerResult->columnCount > 0)
+		{
+			*firstValue = BrokerResultGetValue(brokerResult, 0, 0);
+		}
 	}
+	else
+	{
+		PGconn *connection = GetConnection(node->nodeName, node->nodePort, false);
+		PGresult *result = NULL;
 
-	PQclear(result);
+		if (connection == NULL)
+		{
+			return false;
+		}
+
+		result = PQexec(connection, command);
+		if (PQresultStatus(result) != expectedStatus)
+		{
+			ReportRemoteError(connection, result);
+			resultOK = false;
+		}
+		else if (firstValue != NULL && PQntuples(result) > 0 && PQnfields(result) > 0)
+		{
+			*firstValue = pstrdup(PQgetvalue(result, 0, 0));
+		}
+
+		PQclear(result);
+	}
 
 	return resultOK;
 }
 
-typedef bool (*DtmCommandResultHandler)(PGresult *result, void* arg);
+typedef bool (*DtmCommandResultHandler)(char *firstValue, void* arg);
 
 static bool RunDtmStatement(char const* sql, unsigned expectedStatus, DtmCommandResultHandler handler, void* arg)
 {
@@ -2161,31 +2979,88 @@ static bool RunDtmStatement(char const* sql, unsigned expectedStatus, DtmCommand
 	PGresult *result = NULL;
 	PGconn *connection = NULL;
 	bool allOk = true;
-	ListCell *connectionCell = NULL;
+	ListCell *nodeCell = NULL;
 	ListCell *nextCell = list_head(connectionsWithDtmTransactions);
 	ListCell *prevCell = NULL;
 
-	while ((connectionCell = nextCell) != NULL)
+	if (dtmTransactionUsesBroker)
+	{
+		List *brokerCommandList = NIL;
+		List *brokerResultList = NIL;
+		ListCell *commandCell = NULL;
+		ListCell *resultCell = NULL;
+
+		foreach(nodeCell, connectionsWithDtmTransactions)
+		{
+			NodeConnectionKey *node = (NodeConnectionKey *) lfirst(nodeCell);
+			BrokerCommand *brokerCommand = (BrokerCommand *) palloc0(sizeof(BrokerCommand));
+
+			brokerCommand->nodeName = node->nodeName;
+			brokerCommand->nodePort = node->nodePort;
+			brokerCommand->queryString = (char *) sql;
+
+			brokerCommandList = lappend(brokerCommandList, brokerCommand);
+		}
+
+		/* the broker sends all commands before waiting for any of them */
+		brokerResultList = BrokerExecuteCommandList(brokerCommandList, true);
+
+		forboth(commandCell, brokerCommandList, resultCell, brokerResultList)
+		{
+			BrokerCommand *brokerCommand = (BrokerCommand *) lfirst(commandCell);
+			BrokerResult *brokerResult = (BrokerResult *) lfirst(resultCell);
+			char *firstValue = NULL;
+
+			if (brokerResult->rowCount > 0 && brokerResult->columnCount > 0)
+			{
+				firstValue = BrokerResultGetValue(brokerResult, 0, 0);
+			}
+
+			if (brokerResult->resultStatus != expectedStatus ||
+				(handler && !handler(firstValue, arg)))
+			{
+				ReportBrokerError(brokerCommand, brokerResult);
+				allOk = false;
+			}
+		}
+
+		return allOk;
+	}
+
+	while ((nodeCell = nextCell) != NULL)
 	{
-		nextCell = lnext(connectionCell);
-		connection = (PGconn *) lfirst(connectionCell);
-		querySent = PQsendQuery(connection, sql);
+		NodeConnectionKey *node = (NodeConnectionKey *) lfirst(nodeCell);
+
+		nextCell = lnext(nodeCell);
+		connection = GetConnection(node->nodeName, node->nodePort, false);
+		querySent = (connection != NULL) ? PQsendQuery(connection, sql) : 0;
 		if (!querySent)
 		{
-			ReportRemoteError(connection, NULL);
-			list_delete_cell(connectionsWithDtmTransactions, connectionCell, prevCell);
-			PurgeConnection(connection);
+			if (connection != NULL)
+			{
+				ReportRemoteError(connection, NULL);
+				PurgeConnection(connection);
+			}
+			connectionsWithDtmTransactions = list_delete_cell(connectionsWithDtmTransactions,
+															  nodeCell, prevCell);
 			allOk = false;
 			continue;
 		}
-		prevCell = connectionCell;
+		prevCell = nodeCell;
 		TRACE("shard_xtm: conn#%p: Sent %s to %s:%s\n", connection, sql, PQhost(connection), PQport(connection));
 	}
-	foreach(connectionCell, connectionsWithDtmTransactions)
+	foreach(nodeCell, connectionsWithDtmTransactions)
 	{
-		connection = (PGconn *) lfirst(connectionCell);
+		NodeConnectionKey *node = (NodeConnectionKey *) lfirst(nodeCell);
+		char *firstValue = NULL;
+
+		connection = GetConnection(node->nodeName, node->nodePort, false);
 		result = PQgetResult(connection);
-		if (PQresultStatus(result) != expectedStatus || (handler && !handler(result, arg)))
+		if (PQntuples(result) > 0 && PQnfields(result) > 0)
+		{
+			firstValue = PQgetvalue(result, 0, 0);
+		}
+		if (PQresultStatus(result) != expectedStatus || (handler && !handler(firstValue, arg)))
 		{
 			ReportRemoteError(connection, result);
 			allOk = false;
@@ -2207,9 +3082,8 @@ static bool RunDtmFunction(char const* sql)
 }
 
 
-static bool DtmMaxCSN(PGresult *result, void* arg)
+static bool DtmMaxCSN(char *resp, void* arg)
 {
-	char* resp = PQgetvalue(result, 0, 0);
 	csn_t* maxCSN = (csn_t*)arg;
 	csn_t csn = 0;
 	if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &csn) != 1)
@@ -2230,6 +3104,9 @@ FinishDtmTransaction(XactEvent event, void * arg)
 {
 	if ((event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT) && connectionsWithDtmTransactions)
 	{
+		/* waiting for the broker must not be interrupted once committing */
+		HOLD_INTERRUPTS();
+
 		if (DtmTwoPhaseCommit) 
 		{ 
 			if (event == XACT_EVENT_COMMIT)
@@ -2256,6 +3133,9 @@ FinishDtmTransaction(XactEvent event, void * arg)
 		} else { 
 			RunDtmCommand("COMMIT");
 		}
+
+		RESUME_INTERRUPTS();
+
 		/*
 		 * Calling unregister inside callback itself leads to segfault when
 		 * there are several callbacks on the same event.
@@ -2265,6 +3145,7 @@ FinishDtmTransaction(XactEvent event, void * arg)
 		 */
 		connectionsWithDtmTransactions = NIL;
 		currentGlobalTransactionId = 0;
+		dtmTransactionUsesBroker = false;
 	}
 }
 
@@ -2418,50 +3299,6 @@ PgShardProcessUtility(Node *parsetree, const char *queryString,
 			}
 		}
 	}
-	else if (statementType == T_PrepareStmt)
-	{
-		PrepareStmt *prepareStatement = (PrepareStmt *) parsetree;
-		Query *parsedQuery = NULL;
-		Node *rawQuery = copyObject(prepareStatement->query);
-		int argumentCount = list_length(prepareStatement->argtypes);
-		Oid *argumentTypeArray = NULL;
-		PlannerType plannerType = PLANNER_INVALID_FIRST;
-
-		/* transform list of TypeNames to array of type OID's if they exist */
-		if (argumentCount > 0)
-		{
-			List *argumentTypeList = prepareStatement->argtypes;
-			ListCell *argumentTypeCell = NULL;
-			uint32 argumentTypeIndex = 0;
-
-			ParseState *parseState = make_parsestate(NULL);
-			parseState->p_sourcetext = queryString;
-
-			argumentTypeArray = (Oid *) palloc0(argumentCount * sizeof(Oid));
-
-			foreach(argumentTypeCell, argumentTypeList)
-			{
-				TypeName *typeName = lfirst(argumentTypeCell);
-				Oid typeId = typenameTypeId(parseState, typeName);
-
-				argumentTypeArray[argumentTypeIndex] = typeId;
-				argumentTypeIndex++;
-			}
-		}
-
-		/* analyze the statement using these parameter types */
-		parsedQuery = parse_analyze_varparams(rawQuery, queryString,
-											  &argumentTypeArray, &argumentCount);
-
-		/* determine if the query runs on a distributed table */
-		plannerType = DeterminePlannerType(parsedQuery);
-		if (plannerType == PLANNER_TYPE_PG_SHARD)
-		{
-			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg("PREPARE commands on distributed tables "
-								   "are unsupported")));
-		}
-	}
 	else if (statementType == T_CopyStmt)
 	{
 		CopyStmt *copyStatement = (CopyStmt *) parsetree;
@@ -16,8 +16,8 @@
 #include "fmgr.h"
 
 #include "distribution_metadata.h"
+#include "metadata_cache.h"
 #include "prune_shard_list.h"
-#include "create_shards.h"
 
 #include <stddef.h>
 
@@ -69,51 +69,9 @@ static OpExpr * MakeOpExpressionWithZeroConst(void);
 static List * BuildRestrictInfoList(List *qualList);
 static Node * BuildBaseConstraint(Var *column);
 static void UpdateConstraint(Node *baseConstraint, ShardInterval *shardInterval);
+static Const * PartitionColumnEqualityValue(List *whereClauseList, Var *partitionColumn);
+static Datum HashConstantValue(Const *constant);
 
-static HTAB* shardPlacementCache;
-
-typedef struct ShardPlacementEntryCacheEntry
-{
-	Oid tableId;
-	List** placements;
-} ShardPlacementCacheEntry;
-
-#define MAX_DISTRIBUTED_TABLES 101
-
-static List* 
-LookupShardPlacementCache(Oid relationId, int shardHashCode)
-{
-	ShardPlacementCacheEntry* entry = NULL;
-
-	if (shardPlacementCache == NULL)
-	{
-		HASHCTL info;
-		int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
-		memset(&info, 0, sizeof(info));
-		info.keysize = sizeof(Oid);
-		info.entrysize = sizeof(ShardPlacementCacheEntry);
-		info.hcxt = CacheMemoryContext;
-
-		shardPlacementCache = hash_create("pg_shard placement cache", MAX_DISTRIBUTED_TABLES, &info, hashFlags);
-	}
-	entry = hash_search(shardPlacementCache, &relationId, HASH_FIND, NULL);
-	return (entry != NULL) ? entry->placements[shardHashCode] : NULL;
-}
-
-static void 
-AddToShardPlacementCache(Oid relationId, int shardHashCode, int shardCount, List* shardPlacements)
-{
-	MemoryContext oldContext = MemoryContextSwitchTo(CacheMemoryContext);
-	bool found = false;
-	ShardPlacementCacheEntry* entry = (ShardPlacementCacheEntry*)hash_search(shardPlacementCache, &relationId, HASH_ENTER, &found);
-	if (!found)
-	{
-		entry->placements = palloc0(shardCount*sizeof(List*));
-	}
-	entry->placements[shardHashCode] = list_copy(shardPlacements);
-	MemoryContextSwitchTo(oldContext);
-}
 
 /*
  * PruneShardList prunes shards from given list based on the selection criteria,
@@ -126,9 +84,7 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 	ListCell *shardIntervalCell = NULL;
 	List *restrictInfoList = NIL;
 	Node *baseConstraint = NULL;
-	int shardHashCode = -1;
-	int shardCount = shardIntervalList->length;
-	uint32 hashTokenIncrement = (uint32)(HASH_TOKEN_COUNT / shardCount);
+	DistTableCacheEntry *cacheEntry = LookupDistTableCacheEntry(relationId);
 	Var *partitionColumn = PartitionColumn(relationId);
 	char partitionMethod = PartitionType(relationId);
 
@@ -146,49 +102,33 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 		{
 			Node *hashedNode = NULL;
 			List *hashedClauseList = NULL;
-			if (whereClauseList && whereClauseList->length == 1)
-			{
-				Expr* predicate = (Expr *)lfirst(list_head(whereClauseList));
 
-				if (IsA(predicate, OpExpr))
+			/*
+			 * If the caller passed the table's cached shard list and the clauses
+			 * restrict the partition column to a single value, a binary search of
+			 * the sorted shard intervals finds the only shard we need to keep.
+			 */
+			if (shardIntervalList == cacheEntry->shardIntervalList)
+			{
+				Const *partitionValue = PartitionColumnEqualityValue(whereClauseList,
+																	 partitionColumn);
+				if (partitionValue != NULL)
 				{
-					OpExpr *operatorExpression = (OpExpr *) predicate;
-					Oid leftHashFunction = InvalidOid;
-					Oid rightHashFunction = InvalidOid;
-					if (get_op_hash_functions(operatorExpression->opno,
-											  &leftHashFunction,
-											  &rightHashFunction)				
-						&& SimpleOpExpression(predicate)
-						&& OpExpressionContainsColumn(operatorExpression,
-													  partitionColumn))
+					Datum hashedValue = HashConstantValue(partitionValue);
+					ShardInterval *shardInterval = FindShardIntervalByValue(cacheEntry,
+																			hashedValue);
+					if (shardInterval != NULL)
 					{
-						Node *leftOperand = get_leftop(predicate);
-						Node *rightOperand = get_rightop(predicate);
-						Const *constant = (Const*)(IsA(rightOperand, Const) ? rightOperand : leftOperand);
-						TypeCacheEntry *typeEntry = lookup_type_cache(constant->consttype, TYPECACHE_HASH_PROC_FINFO);
-						FmgrInfo *hashFunction = &(typeEntry->hash_proc_finfo);
-						if (OidIsValid(hashFunction->fn_oid))
-						{
-							int hashedValue = DatumGetInt32(FunctionCall1(hashFunction, constant->constvalue));
-							shardHashCode = (int)((uint32)(hashedValue - INT32_MIN) / hashTokenIncrement);
-							remainingShardList = LookupShardPlacementCache(relationId, shardHashCode);
-							if (remainingShardList != NULL)
-							{
-								return remainingShardList;
-							}
-						}
+						return list_make1(shardInterval);
 					}
 				}
 			}
+
 			hashedNode = HashableClauseMutator((Node *) whereClauseList,
 											   partitionColumn);
 			hashedClauseList = (List *) hashedNode;
 			restrictInfoList = BuildRestrictInfoList(hashedClauseList);
 
-			/* override the partition column for hash partitioning */
-			partitionColumn = MakeInt4Column();
-			restrictInfoList = BuildRestrictInfoList(hashedClauseList);
-
 			/* override the partition column for hash partitioning */
 			partitionColumn = MakeInt4Column();
 			break;
@@ -224,25 +164,10 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 		}
 		else
 		{
-			remainingShardList = lappend(remainingShardList, &(shardInterval->id));
-		}
-	}
-	if (shardHashCode >= 0)
-	{
-		ShardInterval* shardInterval = (ShardInterval *) linitial(remainingShardList);
-		int64 shardId = shardInterval->id;
-		int32 shardMinHashToken = INT32_MIN + (shardId * hashTokenIncrement);
-		int32 shardMaxHashToken = shardMinHashToken + (hashTokenIncrement - 1);
-		if (shardId == (shardCount - 1))
-		{
-			shardMaxHashToken = INT32_MAX;
-		}
-		if (DatumGetInt32(shardInterval->minValue) == shardMinHashToken &&
-			DatumGetInt32(shardInterval->maxValue) == shardMaxHashToken)
-		{		
-			AddToShardPlacementCache(relationId, shardHashCode, shardIntervalList->length, remainingShardList);
+			remainingShardList = lappend(remainingShardList, shardInterval);
 		}
 	}
+
 	return remainingShardList;
 }
 
@@ -599,8 +524,6 @@ MakeHashedOperatorExpression(OpExpr *operatorExpression)
 	Var *hashedColumn = NULL;
 	Datum hashedValue = 0;
 	Const *hashedConstant = NULL;
-	FmgrInfo *hashFunction = NULL;
-	TypeCacheEntry *typeEntry = NULL;
 
 	Node *leftOperand = get_leftop((Expr *) operatorExpression);
 	Node *rightOperand = get_rightop((Expr *) operatorExpression);
@@ -622,8 +545,37 @@ MakeHashedOperatorExpression(OpExpr *operatorExpression)
 	/* Get a column with int4 type */
 	hashedColumn = MakeInt4Column();
 
+	hashedValue = HashConstantValue(constant);
+	hashedConstant = MakeInt4Constant(hashedValue);
+
+	/* Now create the expression with modified partition column and hashed constant */
+	hashedExpression = (OpExpr *) make_opclause(operatorId,
+												InvalidOid, /* no result type yet */
+												false,    /* no return set */
+												(Expr *) hashedColumn,
+												(Expr *) hashedConstant,
+												InvalidOid, InvalidOid);
+
+	/* Set implementing function id and result type */
+	hashedExpression->opfuncid = get_opcode(operatorId);
+	hashedExpression->opresulttype = get_func_rettype(hashedExpression->opfuncid);
+
+	return hashedExpression;
+}
+
+
+/*
+ * HashConstantValue hashes the value of the given constant using the hash
+ * function of the constant's type, and returns the resulting hash token.
+ */
+static Datum
+HashConstantValue(Const *constant)
+{
+	FmgrInfo *hashFunction = NULL;
+
 	/* Load the hash function from type cache */
-	typeEntry = lookup_type_cache(constant->consttype, TYPECACHE_HASH_PROC_FINFO);
+	TypeCacheEntry *typeEntry = lookup_type_cache(constant->consttype,
+												  TYPECACHE_HASH_PROC_FINFO);
 	hashFunction = &(typeEntry->hash_proc_finfo);
 	if (!OidIsValid(hashFunction->fn_oid))
 	{
@@ -637,22 +589,53 @@ MakeHashedOperatorExpression(OpExpr *operatorExpression)
 	 * Note that any changes to PostgreSQL's hashing functions will change the
 	 * new value created by this function.
 	 */
-	hashedValue = FunctionCall1(hashFunction, constant->constvalue);
-	hashedConstant = MakeInt4Constant(hashedValue);
+	return FunctionCall1(hashFunction, constant->constvalue);
+}
 
-	/* Now create the expression with modified partition column and hashed constant */
-	hashedExpression = (OpExpr *) make_opclause(operatorId,
-												InvalidOid, /* no result type yet */
-												false,    /* no return set */
-												(Expr *) hashedColumn,
-												(Expr *) hashedConstant,
-												InvalidOid, InvalidOid);
 
-	/* Set implementing function id and result type */
-	hashedExpression->opfuncid = get_opcode(operatorId);
-	hashedExpression->opresulttype = get_func_rettype(hashedExpression->opfuncid);
+/*
+ * PartitionColumnEqualityValue searches the given clause list for a hashable
+ * equality between the partition column and a non-null constant, and returns
+ * that constant. The function returns NULL if no such clause exists.
+ */
+static Const *
+PartitionColumnEqualityValue(List *whereClauseList, Var *partitionColumn)
+{
+	ListCell *whereClauseCell = NULL;
 
-	return hashedExpression;
+	foreach(whereClauseCell, whereClauseList)
+	{
+		Expr *whereClause = (Expr *) lfirst(whereClauseCell);
+		OpExpr *operatorExpression = NULL;
+		Oid leftHashFunction = InvalidOid;
+		Oid rightHashFunction = InvalidOid;
+		Node *rightOperand = NULL;
+
+		if (!SimpleOpExpression(whereClause))
+		{
+			continue;
+		}
+
+		operatorExpression = (OpExpr *) whereClause;
+		if (!get_op_hash_functions(operatorExpression->opno, &leftHashFunction,
+								   &rightHashFunction) ||
+			!OpExpressionContainsColumn(operatorExpression, partitionColumn))
+		{
+			continue;
+		}
+
+		rightOperand = get_rightop(whereClause);
+		if (IsA(rightOperand, Const))
+		{
+			return (Const *) rightOperand;
+		}
+		else
+		{
+			return (Const *) get_leftop(whereClause);
+		}
+	}
+
+	return NULL;
 }
 
 
@@ -46,7 +46,6 @@
 /* local function forward declarations */
 static ShardPlacement * SearchShardPlacementInList(List *shardPlacementList,
 												   text *nodeName, int32 nodePort);
-static List * RecreateTableDDLCommandList(Oid relationId, int64 shardId);
 static bool CopyDataFromFinalizedPlacement(Oid distributedTableId, int64 shardId,
 										   ShardPlacement *healthyPlacement,
 										   ShardPlacement *placementToRepair);
@@ -246,7 +245,7 @@ SearchShardPlacementInList(List *shardPlacementList, text *nodeNameText, int32 n
  * TABLE" or "DROP FOREIGN TABLE" statement to facilitate total recreation of a
  * placement.
  */
-static List *
+List *
 RecreateTableDDLCommandList(Oid relationId, int64 shardId)
 {
 	char *relationName = get_rel_name(relationId);
@@ -37,6 +37,8 @@ extern Datum fake_fdw_handler(PG_FUNCTION_ARGS);
 extern Datum initialize_remote_temp_table(PG_FUNCTION_ARGS);
 extern Datum count_remote_temp_table_rows(PG_FUNCTION_ARGS);
 extern Datum get_and_purge_connection(PG_FUNCTION_ARGS);
+extern Datum connection_broker_available(PG_FUNCTION_ARGS);
+extern Datum execute_through_broker(PG_FUNCTION_ARGS);
 
 /* function declarations for exercising metadata functions */
 extern Datum load_shard_id_array(PG_FUNCTION_ARGS);
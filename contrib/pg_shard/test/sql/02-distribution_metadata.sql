@@ -182,7 +182,7 @@ DELETE FROM pgs_distribution_metadata.shard
 -- verify that an eager load shows them missing
 SELECT load_shard_id_array('events', false);
 
--- but they live on in the cache
+-- and that the cache was invalidated by their removal
 SELECT load_shard_id_array('events', true);
 
 -- create second table to distribute
@@ -37,6 +37,19 @@ SELECT master_copy_shard_placement(20, 'localhost', :worker_port, 'dummyhost', :
 -- also try to copy from an inactive placement
 SELECT master_copy_shard_placement(20, 'otherhost', :worker_port, '127.0.0.1', :worker_port);
 
+-- moving placements checks its input as well: the target must lack a placement
+SELECT master_move_shard_placement(20, 'localhost', :worker_port, 'dummyhost', :worker_port);
+
+-- and the source placement must be finalized
+SELECT master_move_shard_placement(20, 'otherhost', :worker_port, 'newhost', :worker_port);
+
+-- splitting requires a split value within the shard's hash range
+SELECT master_split_shard(20, -2147483648);
+
+-- Successful moves and splits cannot be tested here: creating the replication
+-- slot on the "worker" waits for the transaction of the master, which writes
+-- the metadata of the new shards, to finish. They need a separate worker.
+
 -- next, create an empty "shard" for the table
 CREATE TABLE customer_engagements_20 ( LIKE customer_engagements );
 
@@ -89,6 +102,9 @@ CREATE FOREIGN TABLE remote_engagements_30 (
 -- oops! we don't support repairing shards backed by foreign tables
 SELECT master_copy_shard_placement(30, 'localhost', :worker_port, '127.0.0.1', :worker_port);
 
+-- nor moving them
+SELECT master_move_shard_placement(30, 'localhost', :worker_port, 'newhost', :worker_port);
+
 -- At this point, we've tested recreating a shard's table, but haven't seen
 -- whether the rows themselves are correctly copied. We'll insert a few rows
 -- into our "shard" and use our hack to get the pg_shard worker to connect back
@@ -157,7 +157,7 @@ $sharded_execute$;
 -- test use of bare SQL within plpgsql
 DO $sharded_sql$
 	BEGIN
-		SELECT COUNT(*) FROM articles WHERE author_id = 1 AND author_id = 2;
+		PERFORM COUNT(*) FROM articles WHERE author_id = 1 AND author_id = 2;
 	END
 $sharded_sql$;
 
@@ -208,3 +208,27 @@ SELECT author_id FROM articles
 -- verify temp tables used by cross-shard queries do not persist
 SELECT COUNT(*) FROM pg_class WHERE relname LIKE 'pg_shard_temp_table%' AND
 									relkind = 'r';
+
+-- prepared statements touching a single shard are planned once
+PREPARE author_article_count (bigint) AS
+	SELECT count(*) FROM articles WHERE author_id = $1;
+EXECUTE author_article_count(1);
+EXECUTE author_article_count(2);
+EXECUTE author_article_count(3);
+EXECUTE author_article_count(4);
+EXECUTE author_article_count(5);
+EXECUTE author_article_count(6);
+EXECUTE author_article_count(7);
+
+-- prepared statements touching multiple shards are planned per execution
+PREPARE long_article_count (integer) AS
+	SELECT count(*) FROM articles WHERE word_count > $1;
+EXECUTE long_article_count(10000);
+EXECUTE long_article_count(10000);
+EXECUTE long_article_count(10000);
+EXECUTE long_article_count(10000);
+EXECUTE long_article_count(10000);
+EXECUTE long_article_count(10000);
+EXECUTE long_article_count(10000);
+
+DEALLOCATE ALL;
@@ -16,5 +16,7 @@ DECLARE all_sharded_rows CURSOR FOR SELECT * FROM sharded_table;
 -- EXPLAIN support isn't implemented
 EXPLAIN SELECT * FROM sharded_table;
 
--- PREPARE support isn't implemented
+-- PREPARE is supported, but execution still requires shards
 PREPARE sharded_query (bigint) AS SELECT * FROM sharded_table WHERE id = $1;
+EXECUTE sharded_query(1);
+DEALLOCATE sharded_query;
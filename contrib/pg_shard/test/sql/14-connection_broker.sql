@@ -0,0 +1,44 @@
+-- ===================================================================
+-- create test functions
+-- ===================================================================
+
+CREATE FUNCTION connection_broker_available()
+	RETURNS bool
+	AS 'pg_shard'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION execute_through_broker(cstring, integer, text)
+	RETURNS text
+	AS 'pg_shard'
+	LANGUAGE C STRICT;
+
+-- ===================================================================
+-- test connection broker functionality
+-- ===================================================================
+
+-- the broker only runs if pg_shard.connection_broker_slots is set
+SELECT connection_broker_available();
+
+-- squelch WARNINGs that contain worker_port
+SET client_min_messages TO ERROR;
+
+-- run a command on localhost
+SELECT execute_through_broker('localhost', :worker_port, 'SELECT 1');
+
+-- failed commands leave the broker running
+SELECT execute_through_broker('localhost', :worker_port, 'SELECT 1/0');
+SELECT execute_through_broker('localhost', :worker_port, 'SELECT 2');
+
+-- as do connections which fail
+SELECT execute_through_broker('adeadhost', :worker_port, 'SELECT 1');
+SELECT execute_through_broker('localhost', :worker_port, 'SELECT 3');
+
+-- and errors raised in the broker itself
+SELECT execute_through_broker(repeat('a', 256)::cstring, :worker_port, 'SELECT 1');
+SELECT execute_through_broker('localhost', :worker_port, 'SELECT 4');
+
+-- commands without rows return the number of rows they affected
+SELECT execute_through_broker('localhost', :worker_port,
+							  'CREATE TEMPORARY TABLE broker_test AS SELECT 1');
+
+SET client_min_messages TO DEFAULT;
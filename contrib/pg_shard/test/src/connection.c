@@ -16,12 +16,14 @@
 #include "libpq-fe.h"
 
 #include "connection.h"
+#include "connection_broker.h"
 #include "test_helper_functions.h"
 
 #include <stddef.h>
 #include <string.h>
 
 #include "catalog/pg_type.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 
 
@@ -33,6 +35,8 @@ static Datum ExtractIntegerDatum(char *input);
 PG_FUNCTION_INFO_V1(initialize_remote_temp_table);
 PG_FUNCTION_INFO_V1(count_remote_temp_table_rows);
 PG_FUNCTION_INFO_V1(get_and_purge_connection);
+PG_FUNCTION_INFO_V1(connection_broker_available);
+PG_FUNCTION_INFO_V1(execute_through_broker);
 
 
 /*
@@ -126,6 +130,61 @@ get_and_purge_connection(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * connection_broker_available returns whether the connection broker is running
+ * and has a free slot for the current backend.
+ */
+Datum
+connection_broker_available(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(ConnectionBrokerAvailable());
+}
+
+
+/*
+ * execute_through_broker runs the provided command on the specified host and
+ * port through the connection broker, and returns the first value of its
+ * result, or the number of rows it affected if it returned none. If the
+ * command fails, this function emits a warning and returns NULL.
+ */
+Datum
+execute_through_broker(PG_FUNCTION_ARGS)
+{
+	BrokerCommand brokerCommand;
+	BrokerResult *brokerResult = NULL;
+	char *value = NULL;
+
+	memset(&brokerCommand, 0, sizeof(brokerCommand));
+	brokerCommand.nodeName = PG_GETARG_CSTRING(0);
+	brokerCommand.nodePort = PG_GETARG_INT32(1);
+	brokerCommand.queryString = text_to_cstring(PG_GETARG_TEXT_P(2));
+
+	brokerResult = BrokerExecuteCommand(&brokerCommand, false);
+	if (brokerResult->resultStatus != PGRES_TUPLES_OK &&
+		brokerResult->resultStatus != PGRES_COMMAND_OK)
+	{
+		ReportBrokerError(&brokerCommand, brokerResult);
+		PG_RETURN_NULL();
+	}
+
+	if (brokerResult->rowCount > 0 && brokerResult->columnCount > 0)
+	{
+		value = BrokerResultGetValue(brokerResult, 0, 0);
+	}
+	else
+	{
+		value = brokerResult->affectedTupleCount;
+	}
+
+	if (value == NULL)
+	{
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_TEXT_P(cstring_to_text(value));
+}
+
+
 /*
  * ExtractIntegerDatum transforms an integer in textual form into a Datum.
  */
@@ -0,0 +1,44 @@
+-- needed by triggers on our metadata tables
+CREATE FUNCTION invalidate_distribution_metadata_cache()
+RETURNS trigger
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+DO $$
+BEGIN
+	-- under CitusDB the metadata relations are views, which aren't cached
+	IF (SELECT relkind = 'r'
+		FROM   pg_class
+		WHERE  oid = 'pgs_distribution_metadata.partition'::regclass) THEN
+
+		-- drop cached metadata of distributed tables whose metadata changes
+		CREATE TRIGGER partition_cache_invalidate
+			AFTER INSERT OR UPDATE OR DELETE ON pgs_distribution_metadata.partition
+			FOR EACH ROW
+			EXECUTE PROCEDURE invalidate_distribution_metadata_cache('relation_id');
+		CREATE TRIGGER shard_cache_invalidate
+			AFTER INSERT OR UPDATE OR DELETE ON pgs_distribution_metadata.shard
+			FOR EACH ROW
+			EXECUTE PROCEDURE invalidate_distribution_metadata_cache('relation_id');
+		CREATE TRIGGER shard_placement_cache_invalidate
+			AFTER INSERT OR UPDATE OR DELETE ON pgs_distribution_metadata.shard_placement
+			FOR EACH ROW
+			EXECUTE PROCEDURE invalidate_distribution_metadata_cache('shard_id');
+	END IF;
+END;
+$$;
+
+-- move and split shards while modifications continue
+CREATE FUNCTION master_move_shard_placement(shard_id bigint,
+											source_node_name text,
+											source_node_port integer,
+											target_node_name text,
+											target_node_port integer)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION master_split_shard(shard_id bigint, split_value integer)
+RETURNS bigint[]
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
@@ -97,6 +97,7 @@ static bool DtmRecordCommits;
 static Snapshot DtmGetSnapshot(Snapshot snapshot);
 static TransactionId DtmGetOldestXmin(Relation rel, bool ignoreVacuum);
 static bool DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
+static void DtmXidInMVCCSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot, bool *inSnapshot, bool *resolved);
 static TransactionId DtmAdjustOldestXid(TransactionId xid);
 static bool DtmDetectGlobalDeadLock(PGPROC *proc);
 static cid_t DtmGetCsn(TransactionId xid);
@@ -113,7 +114,8 @@ static TransactionManager DtmTM = {
 	PgGetGlobalTransactionId,
 	DtmXidInMVCCSnapshot,
 	DtmDetectGlobalDeadLock,
-	DtmGetName
+	DtmGetName,
+	DtmXidInMVCCSnapshotBatch
 };
 
 void		_PG_init(void);
@@ -591,6 +593,54 @@ DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 	return PgXidInMVCCSnapshot(xid, snapshot);
 }
 
+/*
+ * Check visibility of several XIDs (usually all XIDs of heap page) with single lock acquisition.
+ * In-doubt transactions are left unresolved: DtmXidInMVCCSnapshot will wait for them if needed.
+ */
+static void
+DtmXidInMVCCSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot, bool *inSnapshot, bool *resolved)
+{
+	int			i;
+
+	SpinLockAcquire(&local->lock);
+	for (i = 0; i < nXids; i++)
+	{
+		DtmTransStatus *ts = (DtmTransStatus *) hash_search(xid2status, &xids[i], HASH_FIND, NULL);
+
+		if (ts == NULL)
+		{
+			/* unknown to DTM: mark to be checked by standard rules after releasing the lock */
+			resolved[i] = false;
+			inSnapshot[i] = true;
+		}
+		else if (ts->cid > dtm_tx.snapshot)
+		{
+			resolved[i] = true;
+			inSnapshot[i] = true;
+		}
+		else if (ts->status == TRANSACTION_STATUS_IN_PROGRESS)
+		{
+			resolved[i] = false;
+			inSnapshot[i] = false;
+		}
+		else
+		{
+			resolved[i] = true;
+			inSnapshot[i] = ts->status == TRANSACTION_STATUS_ABORTED;
+		}
+	}
+	SpinLockRelease(&local->lock);
+
+	for (i = 0; i < nXids; i++)
+	{
+		if (!resolved[i] && inSnapshot[i])
+		{
+			inSnapshot[i] = PgXidInMVCCSnapshot(xids[i], snapshot);
+			resolved[i] = true;
+		}
+	}
+}
+
 void
 DtmInitialize()
 {
@@ -0,0 +1 @@
+../../dtmbench/dtmbench.cpp
\ No newline at end of file
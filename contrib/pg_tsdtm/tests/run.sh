@@ -1,4 +1,4 @@
-./dtmbench  \
+./dtmbench -t tsdtm \
  -c "dbname=postgres host=localhost port=5432 sslmode=disable" \
  -c "dbname=postgres host=localhost port=5433 sslmode=disable" \
  -c "dbname=postgres host=localhost port=5434 sslmode=disable" \
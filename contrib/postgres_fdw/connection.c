@@ -38,6 +38,10 @@
  * commands at the same nesting depth on the remote as we're executing at
  * ourselves, so that rolling back a subtransaction will kill the right
  * queries and not the wrong ones.
+ *
+ * At most one asynchronous request can be in progress on the connection.
+ * pending_callback is then set and has to be called to receive its result
+ * before any other command is sent (see CompletePendingRequest).
  */
 typedef Oid ConnCacheKey;
 
@@ -49,6 +53,9 @@ typedef struct ConnCacheEntry
 								 * one level of subxact open, etc */
 	bool		have_prep_stmt; /* have we prepared any stmts in this xact? */
 	bool		have_error;		/* have any subxacts aborted in this xact? */
+	PgFdwCompletePendingRequest pending_callback;	/* receiver of result of
+													 * async request, or NULL */
+	void	   *pending_arg;	/* argument of pending_callback */
 } ConnCacheEntry;
 
 /*
@@ -63,6 +70,9 @@ static unsigned int prep_stmt_number = 0;
 /* tracks whether any work is needed in callback functions */
 static bool xact_got_connection = false;
 
+/* number of connections with asynchronous request in progress */
+static int	pending_requests = 0;
+
 typedef long long csn_t;
 static csn_t currentGlobalTransactionId = 0;
 static int	currentLocalTransactionId = 0;
@@ -75,6 +85,9 @@ static void do_sql_command(PGconn *conn, const char *sql);
 static void do_sql_send_command(PGconn *conn, const char *sql);
 static void do_sql_wait_command(PGconn *conn, const char *sql);
 static void begin_remote_xact(ConnCacheEntry *entry);
+static ConnCacheEntry *find_conn_entry(PGconn *conn);
+static void complete_pending_request(ConnCacheEntry *entry);
+static void discard_pending_request(ConnCacheEntry *entry);
 static void pgfdw_xact_callback(XactEvent event, void *arg);
 static void pgfdw_subxact_callback(SubXactEvent event,
 					   SubTransactionId mySubid,
@@ -145,6 +158,8 @@ GetConnection(UserMapping *user, bool will_prep_stmt)
 		entry->xact_depth = 0;
 		entry->have_prep_stmt = false;
 		entry->have_error = false;
+		entry->pending_callback = NULL;
+		entry->pending_arg = NULL;
 	}
 
 	/*
@@ -406,6 +421,10 @@ begin_remote_xact(ConnCacheEntry *entry)
 {
 	int			curlevel = GetCurrentTransactionNestLevel();
 
+	/* We are going to send commands, so let the pending request finish */
+	if (entry->xact_depth < curlevel)
+		complete_pending_request(entry);
+
 	/* Start main transaction if we haven't yet */
 	if (entry->xact_depth <= 0)
 	{
@@ -429,37 +448,47 @@ begin_remote_xact(ConnCacheEntry *entry)
 			sql = "START TRANSACTION ISOLATION LEVEL SERIALIZABLE";
 		else
 			sql = "START TRANSACTION ISOLATION LEVEL REPEATABLE READ";
-		do_sql_command(entry->conn, sql);
-		entry->xact_depth = 1;
 		if (UseTsDtmTransactions)
 		{
+			PGresult   *res;
+
+			/*
+			 * Obtain or import the snapshot in the same round trip as the
+			 * start of the remote transaction: PQexec returns the result of
+			 * the last command, or the error if any command failed.
+			 */
 			if (!currentGlobalTransactionId)
+				sql = psprintf("%s; SELECT public.dtm_extend('%d.%d')",
+							   sql, MyProcPid, ++currentLocalTransactionId);
+			else
+				sql = psprintf("%s; SELECT public.dtm_access(%llu, '%d.%d')",
+							   sql, currentGlobalTransactionId, MyProcPid, currentLocalTransactionId);
+
+			/*
+			 * The remote transaction is already started if the snapshot
+			 * command fails, so make sure abort processing rolls it back.
+			 */
+			entry->xact_depth = 1;
+			res = PQexec(entry->conn, sql);
+			if (PQresultStatus(res) != PGRES_TUPLES_OK)
 			{
-				PGresult   *res = PQexec(entry->conn, psprintf("SELECT public.dtm_extend('%d.%d')",
-									MyProcPid, ++currentLocalTransactionId));
-				char	   *resp;
-
-				if (PQresultStatus(res) != PGRES_TUPLES_OK)
-				{
-					pgfdw_report_error(ERROR, res, entry->conn, true, sql);
-				}
-				resp = PQgetvalue(res, 0, 0);
-				if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &currentGlobalTransactionId) != 1)
-				{
-					pgfdw_report_error(ERROR, res, entry->conn, true, sql);
-				}
-				PQclear(res);
+				pgfdw_report_error(ERROR, res, entry->conn, true, sql);
 			}
-			else
+			if (!currentGlobalTransactionId)
 			{
-				PGresult   *res = PQexec(entry->conn, psprintf("SELECT public.dtm_access(%llu, '%d.%d')", currentGlobalTransactionId, MyProcPid, currentLocalTransactionId));
+				char	   *resp = PQgetvalue(res, 0, 0);
 
-				if (PQresultStatus(res) != PGRES_TUPLES_OK)
+				if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &currentGlobalTransactionId) != 1)
 				{
 					pgfdw_report_error(ERROR, res, entry->conn, true, sql);
 				}
-				PQclear(res);
 			}
+			PQclear(res);
+		}
+		else
+		{
+			do_sql_command(entry->conn, sql);
+			entry->xact_depth = 1;
 		}
 	}
 
@@ -491,6 +520,89 @@ ReleaseConnection(PGconn *conn)
 	 */
 }
 
+/*
+ * Find connection cache entry of the connection.
+ */
+static ConnCacheEntry *
+find_conn_entry(PGconn *conn)
+{
+	HASH_SEQ_STATUS scan;
+	ConnCacheEntry *entry;
+
+	hash_seq_init(&scan, ConnectionHash);
+	while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
+	{
+		if (entry->conn == conn)
+		{
+			hash_seq_term(&scan);
+			return entry;
+		}
+	}
+	elog(ERROR, "postgres_fdw connection %p is not found in cache", conn);
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * Remember that an asynchronous request was sent on the connection.  The
+ * callback is called by whoever needs the connection next, and must read all
+ * results of the request without throwing an error.
+ */
+void
+SetPendingRequest(PGconn *conn, PgFdwCompletePendingRequest callback, void *arg)
+{
+	ConnCacheEntry *entry = find_conn_entry(conn);
+
+	Assert(entry->pending_callback == NULL);
+	entry->pending_callback = callback;
+	entry->pending_arg = arg;
+	pending_requests++;
+}
+
+/*
+ * Receive result of the asynchronous request in progress on the connection,
+ * if any.  This must be called before sending anything on a connection which
+ * might be shared with an asynchronous scan.
+ */
+void
+CompletePendingRequest(PGconn *conn)
+{
+	if (pending_requests == 0)
+		return;
+	complete_pending_request(find_conn_entry(conn));
+}
+
+static void
+complete_pending_request(ConnCacheEntry *entry)
+{
+	PgFdwCompletePendingRequest callback = entry->pending_callback;
+
+	if (callback != NULL)
+	{
+		entry->pending_callback = NULL;
+		pending_requests--;
+		callback(entry->pending_arg);
+	}
+}
+
+/*
+ * Throw away result of the pending request.  This is used at (sub)transaction
+ * end, when the requesting scan might not exist anymore; if it does, it will
+ * notice that its request was lost.
+ */
+static void
+discard_pending_request(ConnCacheEntry *entry)
+{
+	PGresult   *res;
+
+	if (entry->pending_callback != NULL)
+	{
+		entry->pending_callback = NULL;
+		pending_requests--;
+		while ((res = PQgetResult(entry->conn)) != NULL)
+			PQclear(res);
+	}
+}
+
 /*
  * Assign a "unique" number for a cursor.
  *
@@ -588,6 +700,13 @@ pgfdw_report_error(int elevel, PGresult *res, PGconn *conn,
 
 typedef bool (*DtmCommandResultHandler) (PGresult *result, void *arg);
 
+/*
+ * Send statement to all participants of the global transaction at once and
+ * then collect their results, so that the statement is executed concurrently.
+ * Statement may consist of several commands: expectedStatus and handler
+ * are applied to the result of the last one (or to the error, if some
+ * command failed).
+ */
 static bool
 RunDtmStatement(char const * sql, unsigned expectedStatus, DtmCommandResultHandler handler, void *arg)
 {
@@ -600,6 +719,7 @@ RunDtmStatement(char const * sql, unsigned expectedStatus, DtmCommandResultHandl
 	{
 		if (entry->xact_depth > 0)
 		{
+			discard_pending_request(entry);
 			do_sql_send_command(entry->conn, sql);
 		}
 	}
@@ -609,8 +729,14 @@ RunDtmStatement(char const * sql, unsigned expectedStatus, DtmCommandResultHandl
 	{
 		if (entry->xact_depth > 0)
 		{
-			PGresult   *result = PQgetResult(entry->conn);
+			PGresult   *result = NULL;
+			PGresult   *next;
 
+			while ((next = PQgetResult(entry->conn)) != NULL)
+			{
+				PQclear(result);
+				result = next;
+			}
 			if (PQresultStatus(result) != expectedStatus || (handler && !handler(result, arg)))
 			{
 				elog(WARNING, "Failed command %s: status=%d, expected status=%d", sql, PQresultStatus(result), expectedStatus);
@@ -618,7 +744,6 @@ RunDtmStatement(char const * sql, unsigned expectedStatus, DtmCommandResultHandl
 				allOk = false;
 			}
 			PQclear(result);
-			PQgetResult(entry->conn);	/* consume NULL result */
 		}
 	}
 	return allOk;
@@ -680,12 +805,18 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 				{
 					csn_t		maxCSN = 0;
 
-					if (!RunDtmCommand(psprintf("PREPARE TRANSACTION '%d.%d'",
-									MyProcPid, currentLocalTransactionId)) ||
-						!RunDtmFunction(psprintf("SELECT public.dtm_begin_prepare('%d.%d')",
-									MyProcPid, currentLocalTransactionId)) ||
-						!RunDtmStatement(psprintf("SELECT public.dtm_prepare('%d.%d',0)",
-												  MyProcPid, currentLocalTransactionId), PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
+					/*
+					 * Prepare and propose CSN in a single round trip to all
+					 * participants.  COMMIT PREPARED can not be combined with
+					 * other commands, as it can't run in a multi-command string.
+					 */
+					if (!RunDtmStatement(psprintf("PREPARE TRANSACTION '%d.%d'; "
+												  "SELECT public.dtm_begin_prepare('%d.%d'); "
+												  "SELECT public.dtm_prepare('%d.%d',0)",
+												  MyProcPid, currentLocalTransactionId,
+												  MyProcPid, currentLocalTransactionId,
+												  MyProcPid, currentLocalTransactionId),
+										 PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
 						!RunDtmFunction(psprintf("SELECT public.dtm_end_prepare('%d.%d',%lld)",
 							MyProcPid, currentLocalTransactionId, maxCSN)) ||
 						!RunDtmCommand(psprintf("COMMIT PREPARED '%d.%d'",
@@ -718,6 +849,9 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 		if (entry->conn == NULL)
 			continue;
 
+		/* Scans are over, nobody needs result of pending request */
+		discard_pending_request(entry);
+
 		/* If it has an open remote transaction, try to close it */
 		if (entry->xact_depth > 0)
 		{
@@ -885,6 +1019,11 @@ pgfdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
 			elog(ERROR, "missed cleaning up remote subtransaction at level %d",
 				 entry->xact_depth);
 
+		if (event == SUBXACT_EVENT_PRE_COMMIT_SUB)
+			complete_pending_request(entry);
+		else
+			discard_pending_request(entry);
+
 		if (event == SUBXACT_EVENT_PRE_COMMIT_SUB)
 		{
 			/* Commit all remote subtransactions during pre-commit */
@@ -968,13 +968,16 @@ appendWhereClause(List *exprs, deparse_expr_cxt *context)
  *
  * The statement text is appended to buf, and we also create an integer List
  * of the columns being retrieved by RETURNING (if any), which is returned
- * to *retrieved_attrs.
+ * to *retrieved_attrs.  The length of the statement up to the end of the
+ * VALUES list (or -1 for DEFAULT VALUES) is returned to *values_end_len,
+ * for rebuildInsertSql.
  */
 void
 deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *targetAttrs, bool doNothing,
-				 List *returningList, List **retrieved_attrs)
+				 List *returningList, List **retrieved_attrs,
+				 int *values_end_len)
 {
 	AttrNumber	pindex;
 	bool		first;
@@ -1014,9 +1017,13 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 		}
 
 		appendStringInfoChar(buf, ')');
+		*values_end_len = buf->len;
 	}
 	else
+	{
 		appendStringInfoString(buf, " DEFAULT VALUES");
+		*values_end_len = -1;
+	}
 
 	if (doNothing)
 		appendStringInfoString(buf, " ON CONFLICT DO NOTHING");
@@ -1026,6 +1033,43 @@ deparseInsertSql(StringInfo buf, PlannerInfo *root,
 						 returningList, retrieved_attrs);
 }
 
+/*
+ * rebuild remote INSERT statement built by deparseInsertSql to insert
+ * num_rows rows at once
+ *
+ * The VALUES list of the original statement is extended with rows of
+ * parameters, numbered consecutively; num_params is the number of
+ * parameters in one row.
+ */
+void
+rebuildInsertSql(StringInfo buf, const char *orig_query,
+				 int values_end_len, int num_params, int num_rows)
+{
+	int			pindex = num_params + 1;
+	int			i;
+	int			j;
+
+	Assert(values_end_len > 0);
+
+	appendBinaryStringInfo(buf, orig_query, values_end_len);
+
+	for (i = 1; i < num_rows; i++)
+	{
+		appendStringInfoString(buf, ", (");
+		for (j = 0; j < num_params; j++)
+		{
+			if (j > 0)
+				appendStringInfoString(buf, ", ");
+			appendStringInfo(buf, "$%d", pindex);
+			pindex++;
+		}
+		appendStringInfoChar(buf, ')');
+	}
+
+	/* ON CONFLICT and RETURNING clauses, if any */
+	appendStringInfoString(buf, orig_query + values_end_len);
+}
+
 /*
  * deparse remote UPDATE statement
  *
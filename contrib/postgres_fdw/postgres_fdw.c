@@ -50,6 +50,9 @@ PG_MODULE_MAGIC;
 /* If no remote estimates, assume a sort costs 20% extra */
 #define DEFAULT_FDW_SORT_MULTIPLIER 1.2
 
+/* Maximum number of parameters of a remote statement (protocol limit) */
+#define PGFDW_MAX_QUERY_PARAMS		65535
+
 /*
  * Indexes of FDW-private information stored in fdw_private lists.
  *
@@ -64,7 +67,9 @@ enum FdwScanPrivateIndex
 	/* Integer list of attribute numbers retrieved by the SELECT */
 	FdwScanPrivateRetrievedAttrs,
 	/* Integer representing the desired fetch_size */
-	FdwScanPrivateFetchSize
+	FdwScanPrivateFetchSize,
+	/* Integer (boolean) representing whether the scan may run asynchronously */
+	FdwScanPrivateAsyncCapable
 };
 
 /*
@@ -76,6 +81,7 @@ enum FdwScanPrivateIndex
  *	  (NIL for a DELETE)
  * 3) Boolean flag showing if the remote query has a RETURNING clause
  * 4) Integer list of attribute numbers retrieved by RETURNING, if any
+ * 5) Length of INSERT statement up to the end of VALUES list, or -1
  */
 enum FdwModifyPrivateIndex
 {
@@ -86,7 +92,9 @@ enum FdwModifyPrivateIndex
 	/* has-returning flag (as an integer Value node) */
 	FdwModifyPrivateHasReturning,
 	/* Integer list of attribute numbers retrieved by RETURNING */
-	FdwModifyPrivateRetrievedAttrs
+	FdwModifyPrivateRetrievedAttrs,
+	/* Length of INSERT statement up to the end of VALUES (as an integer) */
+	FdwModifyPrivateLen
 };
 
 /*
@@ -124,6 +132,11 @@ typedef struct PgFdwScanState
 	MemoryContext temp_cxt;		/* context for per-tuple temporary data */
 
 	int			fetch_size;		/* number of tuples per fetch */
+
+	/* for asynchronous execution under Append */
+	bool		async_capable;	/* may the scan be executed asynchronously? */
+	bool		request_pending;	/* is our FETCH in progress on conn? */
+	PGresult   *pending_result; /* result of completed asynchronous FETCH */
 } PgFdwScanState;
 
 /*
@@ -149,6 +162,12 @@ typedef struct PgFdwModifyState
 	int			p_nums;			/* number of parameters to transmit */
 	FmgrInfo   *p_flinfo;		/* output conversion functions for them */
 
+	/* for batch insert */
+	int			values_end_len;	/* length of query up to end of VALUES */
+	int			batch_size;		/* max # of rows inserted at once */
+	char	   *p_batch_name;	/* name of prepared statement inserting
+								 * batch_size rows, if created */
+
 	/* working memory context */
 	MemoryContext temp_cxt;		/* context for per-tuple temporary data */
 } PgFdwModifyState;
@@ -222,6 +241,8 @@ static void postgresBeginForeignScan(ForeignScanState *node, int eflags);
 static TupleTableSlot *postgresIterateForeignScan(ForeignScanState *node);
 static void postgresReScanForeignScan(ForeignScanState *node);
 static void postgresEndForeignScan(ForeignScanState *node);
+static bool postgresStartForeignScanAsync(ForeignScanState *node);
+static pgsocket postgresForeignScanAsyncSocket(ForeignScanState *node);
 static void postgresAddForeignUpdateTargets(Query *parsetree,
 								RangeTblEntry *target_rte,
 								Relation target_relation);
@@ -238,6 +259,11 @@ static TupleTableSlot *postgresExecForeignInsert(EState *estate,
 						  ResultRelInfo *resultRelInfo,
 						  TupleTableSlot *slot,
 						  TupleTableSlot *planSlot);
+static int	postgresGetForeignModifyBatchSize(ResultRelInfo *resultRelInfo);
+static TupleTableSlot **postgresExecForeignBatchInsert(EState *estate,
+							   ResultRelInfo *resultRelInfo,
+							   TupleTableSlot **slots,
+							   int *numSlots);
 static TupleTableSlot *postgresExecForeignUpdate(EState *estate,
 						  ResultRelInfo *resultRelInfo,
 						  TupleTableSlot *slot,
@@ -285,13 +311,20 @@ static bool ec_member_matches_foreign(PlannerInfo *root, RelOptInfo *rel,
 						  void *arg);
 static void create_cursor(ForeignScanState *node);
 static void fetch_more_data(ForeignScanState *node);
+static void fetch_more_data_begin(ForeignScanState *node);
+static bool receive_fetch_result(PgFdwScanState *fsstate);
+static void complete_pending_fetch(void *arg);
 static void close_cursor(PGconn *conn, unsigned int cursor_number);
 static void prepare_foreign_modify(PgFdwModifyState *fmstate);
+static char *prepare_foreign_statement(PgFdwModifyState *fmstate,
+						  const char *query);
+static void deallocate_foreign_statement(PgFdwModifyState *fmstate,
+							 const char *p_name);
 static const char **convert_prep_stmt_params(PgFdwModifyState *fmstate,
 						 ItemPointer tupleid,
 						 TupleTableSlot *slot);
 static void store_returning_result(PgFdwModifyState *fmstate,
-					   TupleTableSlot *slot, PGresult *res);
+					   TupleTableSlot *slot, PGresult *res, int row);
 static int postgresAcquireSampleRowsFunc(Relation relation, int elevel,
 							  HeapTuple *rows, int targrows,
 							  double *totalrows,
@@ -330,6 +363,8 @@ postgres_fdw_handler(PG_FUNCTION_ARGS)
 	routine->PlanForeignModify = postgresPlanForeignModify;
 	routine->BeginForeignModify = postgresBeginForeignModify;
 	routine->ExecForeignInsert = postgresExecForeignInsert;
+	routine->GetForeignModifyBatchSize = postgresGetForeignModifyBatchSize;
+	routine->ExecForeignBatchInsert = postgresExecForeignBatchInsert;
 	routine->ExecForeignUpdate = postgresExecForeignUpdate;
 	routine->ExecForeignDelete = postgresExecForeignDelete;
 	routine->EndForeignModify = postgresEndForeignModify;
@@ -345,6 +380,10 @@ postgres_fdw_handler(PG_FUNCTION_ARGS)
 	/* Support functions for IMPORT FOREIGN SCHEMA */
 	routine->ImportForeignSchema = postgresImportForeignSchema;
 
+	/* Support functions for asynchronous execution */
+	routine->StartForeignScanAsync = postgresStartForeignScanAsync;
+	routine->ForeignScanAsyncSocket = postgresForeignScanAsyncSocket;
+
 	PG_RETURN_POINTER(routine);
 }
 
@@ -383,6 +422,7 @@ postgresGetForeignRelSize(PlannerInfo *root,
 	fpinfo->fdw_tuple_cost = DEFAULT_FDW_TUPLE_COST;
 	fpinfo->shippable_extensions = NIL;
 	fpinfo->fetch_size = 100;
+	fpinfo->async_capable = false;
 
 	foreach(lc, fpinfo->server->options)
 	{
@@ -399,6 +439,8 @@ postgresGetForeignRelSize(PlannerInfo *root,
 				ExtractExtensionList(defGetString(def), false);
 		else if (strcmp(def->defname, "fetch_size") == 0)
 			fpinfo->fetch_size = strtol(defGetString(def), NULL, 10);
+		else if (strcmp(def->defname, "async_capable") == 0)
+			fpinfo->async_capable = defGetBoolean(def);
 	}
 	foreach(lc, fpinfo->table->options)
 	{
@@ -408,6 +450,8 @@ postgresGetForeignRelSize(PlannerInfo *root,
 			fpinfo->use_remote_estimate = defGetBoolean(def);
 		else if (strcmp(def->defname, "fetch_size") == 0)
 			fpinfo->fetch_size = strtol(defGetString(def), NULL, 10);
+		else if (strcmp(def->defname, "async_capable") == 0)
+			fpinfo->async_capable = defGetBoolean(def);
 	}
 
 	/*
@@ -1015,9 +1059,10 @@ postgresGetForeignPlan(PlannerInfo *root,
 	 * Build the fdw_private list that will be available to the executor.
 	 * Items in the list must match enum FdwScanPrivateIndex, above.
 	 */
-	fdw_private = list_make3(makeString(sql.data),
+	fdw_private = list_make4(makeString(sql.data),
 							 retrieved_attrs,
-							 makeInteger(fpinfo->fetch_size));
+							 makeInteger(fpinfo->fetch_size),
+							 makeInteger(fpinfo->async_capable));
 
 	/*
 	 * Create the ForeignScan node from target list, filtering expressions,
@@ -1096,6 +1141,8 @@ postgresBeginForeignScan(ForeignScanState *node, int eflags)
 											   FdwScanPrivateRetrievedAttrs);
 	fsstate->fetch_size = intVal(list_nth(fsplan->fdw_private,
 										  FdwScanPrivateFetchSize));
+	fsstate->async_capable = intVal(list_nth(fsplan->fdw_private,
+											 FdwScanPrivateAsyncCapable));
 
 	/* Create contexts for batches of tuples and per-tuple temp workspace. */
 	fsstate->batch_cxt = AllocSetContextCreate(estate->es_query_cxt,
@@ -1203,10 +1250,26 @@ postgresReScanForeignScan(ForeignScanState *node)
 	char		sql[64];
 	PGresult   *res;
 
+	bool		fetch_in_progress;
+
 	/* If we haven't created the cursor yet, nothing to do. */
 	if (!fsstate->cursor_exists)
 		return;
 
+	/*
+	 * Throw away result of asynchronous FETCH, if any: it has moved the
+	 * cursor, so we can't just rescan the tuples we have in memory.
+	 */
+	fetch_in_progress = fsstate->request_pending || fsstate->pending_result;
+	if (fsstate->request_pending)
+		CompletePendingRequest(fsstate->conn);
+	fsstate->request_pending = false;
+	if (fsstate->pending_result)
+	{
+		PQclear(fsstate->pending_result);
+		fsstate->pending_result = NULL;
+	}
+
 	/*
 	 * If any internal parameters affecting this node have changed, we'd
 	 * better destroy and recreate the cursor.  Otherwise, rewinding it should
@@ -1219,7 +1282,7 @@ postgresReScanForeignScan(ForeignScanState *node)
 		snprintf(sql, sizeof(sql), "CLOSE c%u",
 				 fsstate->cursor_number);
 	}
-	else if (fsstate->fetch_ct_2 > 1)
+	else if (fsstate->fetch_ct_2 > 1 || fetch_in_progress)
 	{
 		snprintf(sql, sizeof(sql), "MOVE BACKWARD ALL IN c%u",
 				 fsstate->cursor_number);
@@ -1235,6 +1298,7 @@ postgresReScanForeignScan(ForeignScanState *node)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fsstate->conn);
 	res = PQexec(fsstate->conn, sql);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
 		pgfdw_report_error(ERROR, res, fsstate->conn, true, sql);
@@ -1261,6 +1325,15 @@ postgresEndForeignScan(ForeignScanState *node)
 	if (fsstate == NULL)
 		return;
 
+	/* Receive and throw away result of asynchronous FETCH, if any */
+	if (fsstate->request_pending)
+		CompletePendingRequest(fsstate->conn);
+	if (fsstate->pending_result)
+	{
+		PQclear(fsstate->pending_result);
+		fsstate->pending_result = NULL;
+	}
+
 	/* Close the cursor if open, to prevent accumulation of cursors */
 	if (fsstate->cursor_exists)
 		close_cursor(fsstate->conn, fsstate->cursor_number);
@@ -1272,6 +1345,72 @@ postgresEndForeignScan(ForeignScanState *node)
 	/* MemoryContexts will be deleted automatically. */
 }
 
+/*
+ * postgresStartForeignScanAsync
+ *		Send the first FETCH of the scan without waiting for its result,
+ *		if the scan is allowed to be executed asynchronously.
+ */
+static bool
+postgresStartForeignScanAsync(ForeignScanState *node)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+
+	if (fsstate == NULL || !fsstate->async_capable)
+		return false;
+
+	if (!fsstate->request_pending && fsstate->pending_result == NULL &&
+		fsstate->next_tuple >= fsstate->num_tuples &&
+		!(fsstate->cursor_exists && fsstate->eof_reached))
+		fetch_more_data_begin(node);
+
+	return true;
+}
+
+/*
+ * postgresForeignScanAsyncSocket
+ *		Return socket to wait on if the next tuple has to be received from
+ *		the remote server and hasn't arrived yet.  The next FETCH is sent
+ *		here as soon as the current batch is consumed.
+ */
+static pgsocket
+postgresForeignScanAsyncSocket(ForeignScanState *node)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+	PGconn	   *conn = fsstate->conn;
+
+	/* Buffered tuples or end of scan can be returned right away */
+	if (fsstate->next_tuple < fsstate->num_tuples)
+		return PGINVALID_SOCKET;
+	if (!fsstate->request_pending &&
+		(fsstate->pending_result != NULL ||
+		 (fsstate->cursor_exists && fsstate->eof_reached)))
+		return PGINVALID_SOCKET;
+
+	if (!fsstate->request_pending)
+		fetch_more_data_begin(node);
+
+	/*
+	 * Collect the results which have already arrived.  Don't wait if the
+	 * connection is broken or all results are received: let fetch_more_data()
+	 * report the error or process the result.  If our request was lost,
+	 * nothing is in progress and the same happens.
+	 */
+	if (PQconsumeInput(conn))
+	{
+		while (!PQisBusy(conn))
+		{
+			if (!receive_fetch_result(fsstate))
+				break;
+		}
+		if (PQisBusy(conn))
+			return PQsocket(conn);
+	}
+
+	if (fsstate->request_pending)
+		CompletePendingRequest(conn);
+	return PGINVALID_SOCKET;
+}
+
 /*
  * postgresAddForeignUpdateTargets
  *		Add resjunk column(s) needed for update/delete on a foreign table
@@ -1334,6 +1473,7 @@ postgresPlanForeignModify(PlannerInfo *root,
 	List	   *returningList = NIL;
 	List	   *retrieved_attrs = NIL;
 	bool		doNothing = false;
+	int			values_end_len = -1;
 
 	initStringInfo(&sql);
 
@@ -1405,7 +1545,7 @@ postgresPlanForeignModify(PlannerInfo *root,
 		case CMD_INSERT:
 			deparseInsertSql(&sql, root, resultRelation, rel,
 							 targetAttrs, doNothing, returningList,
-							 &retrieved_attrs);
+							 &retrieved_attrs, &values_end_len);
 			break;
 		case CMD_UPDATE:
 			deparseUpdateSql(&sql, root, resultRelation, rel,
@@ -1428,10 +1568,11 @@ postgresPlanForeignModify(PlannerInfo *root,
 	 * Build the fdw_private list that will be available to the executor.
 	 * Items in the list must match enum FdwModifyPrivateIndex, above.
 	 */
-	return list_make4(makeString(sql.data),
-					  targetAttrs,
-					  makeInteger((retrieved_attrs != NIL)),
-					  retrieved_attrs);
+	return lappend(list_make4(makeString(sql.data),
+							  targetAttrs,
+							  makeInteger((retrieved_attrs != NIL)),
+							  retrieved_attrs),
+				   makeInteger(values_end_len));
 }
 
 /*
@@ -1493,6 +1634,8 @@ postgresBeginForeignModify(ModifyTableState *mtstate,
 											 FdwModifyPrivateHasReturning));
 	fmstate->retrieved_attrs = (List *) list_nth(fdw_private,
 											 FdwModifyPrivateRetrievedAttrs);
+	fmstate->values_end_len = intVal(list_nth(fdw_private,
+											  FdwModifyPrivateLen));
 
 	/* Create context for per-tuple temp workspace. */
 	fmstate->temp_cxt = AllocSetContextCreate(estate->es_query_cxt,
@@ -1544,6 +1687,34 @@ postgresBeginForeignModify(ModifyTableState *mtstate,
 
 	Assert(fmstate->p_nums <= n_params);
 
+	/*
+	 * Rows can be inserted in batches if the statement has a VALUES list.
+	 * The option specified on the table overrides the server's one.  The
+	 * number of parameters of a statement is limited by the protocol.
+	 */
+	fmstate->batch_size = 1;
+	if (operation == CMD_INSERT && fmstate->values_end_len > 0)
+	{
+		ForeignServer *server = GetForeignServer(table->serverid);
+
+		foreach(lc, server->options)
+		{
+			DefElem    *def = (DefElem *) lfirst(lc);
+
+			if (strcmp(def->defname, "batch_size") == 0)
+				fmstate->batch_size = strtol(defGetString(def), NULL, 10);
+		}
+		foreach(lc, table->options)
+		{
+			DefElem    *def = (DefElem *) lfirst(lc);
+
+			if (strcmp(def->defname, "batch_size") == 0)
+				fmstate->batch_size = strtol(defGetString(def), NULL, 10);
+		}
+		fmstate->batch_size = Min(fmstate->batch_size,
+								  PGFDW_MAX_QUERY_PARAMS / fmstate->p_nums);
+	}
+
 	resultRelInfo->ri_FdwState = fmstate;
 }
 
@@ -1575,6 +1746,7 @@ postgresExecForeignInsert(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1591,7 +1763,7 @@ postgresExecForeignInsert(EState *estate,
 	{
 		n_rows = PQntuples(res);
 		if (n_rows > 0)
-			store_returning_result(fmstate, slot, res);
+			store_returning_result(fmstate, slot, res, 0);
 	}
 	else
 		n_rows = atoi(PQcmdTuples(res));
@@ -1605,6 +1777,121 @@ postgresExecForeignInsert(EState *estate,
 	return (n_rows > 0) ? slot : NULL;
 }
 
+/*
+ * postgresGetForeignModifyBatchSize
+ *		Report the number of rows to insert into a foreign table at once
+ */
+static int
+postgresGetForeignModifyBatchSize(ResultRelInfo *resultRelInfo)
+{
+	PgFdwModifyState *fmstate = (PgFdwModifyState *) resultRelInfo->ri_FdwState;
+
+	/* If fmstate is NULL, we are in EXPLAIN; nothing will be inserted */
+	if (fmstate == NULL)
+		return 1;
+
+	return fmstate->batch_size;
+}
+
+/*
+ * postgresExecForeignBatchInsert
+ *		Insert multiple rows into a foreign table in a single round trip
+ *
+ * Full batches use a prepared statement inserting batch_size rows, the last
+ * incomplete batch is sent as an unprepared statement.  If there is a
+ * RETURNING clause, its results are stored in the leading slots.
+ */
+static TupleTableSlot **
+postgresExecForeignBatchInsert(EState *estate,
+							   ResultRelInfo *resultRelInfo,
+							   TupleTableSlot **slots,
+							   int *numSlots)
+{
+	PgFdwModifyState *fmstate = (PgFdwModifyState *) resultRelInfo->ri_FdwState;
+	int			nrows = *numSlots;
+	const char **p_values;
+	StringInfoData sql;
+	PGresult   *res;
+	int			n_rows;
+	int			i;
+
+	/* Set up the prepared statement on the remote server, if we didn't yet */
+	if (nrows == fmstate->batch_size && !fmstate->p_batch_name)
+	{
+		initStringInfo(&sql);
+		rebuildInsertSql(&sql, fmstate->query, fmstate->values_end_len,
+						 fmstate->p_nums, fmstate->batch_size);
+		fmstate->p_batch_name = prepare_foreign_statement(fmstate, sql.data);
+		pfree(sql.data);
+	}
+
+	/* Convert parameters of all rows to text form */
+	p_values = (const char **)
+		MemoryContextAlloc(fmstate->temp_cxt,
+						   sizeof(char *) * fmstate->p_nums * nrows);
+	for (i = 0; i < nrows; i++)
+		memcpy(p_values + i * fmstate->p_nums,
+			   convert_prep_stmt_params(fmstate, NULL, slots[i]),
+			   sizeof(char *) * fmstate->p_nums);
+
+	/*
+	 * Execute the statement, and check for success.
+	 *
+	 * We don't use a PG_TRY block here, so be careful not to throw error
+	 * without releasing the PGresult.
+	 */
+	CompletePendingRequest(fmstate->conn);
+	if (nrows == fmstate->batch_size)
+		res = PQexecPrepared(fmstate->conn,
+							 fmstate->p_batch_name,
+							 fmstate->p_nums * nrows,
+							 p_values,
+							 NULL,
+							 NULL,
+							 0);
+	else
+	{
+		initStringInfo(&sql);
+		rebuildInsertSql(&sql, fmstate->query, fmstate->values_end_len,
+						 fmstate->p_nums, nrows);
+		res = PQexecParams(fmstate->conn,
+						   sql.data,
+						   fmstate->p_nums * nrows,
+						   NULL,
+						   p_values,
+						   NULL,
+						   NULL,
+						   0);
+		pfree(sql.data);
+	}
+	if (PQresultStatus(res) !=
+		(fmstate->has_returning ? PGRES_TUPLES_OK : PGRES_COMMAND_OK))
+		pgfdw_report_error(ERROR, res, fmstate->conn, true, fmstate->query);
+
+	/* Check number of rows affected, and fetch RETURNING tuples if any */
+	if (fmstate->has_returning)
+	{
+		n_rows = PQntuples(res);
+		for (i = 0; i < n_rows; i++)
+			store_returning_result(fmstate, slots[i], res, i);
+	}
+	else
+		n_rows = atoi(PQcmdTuples(res));
+
+	/* And clean up */
+	PQclear(res);
+
+	MemoryContextReset(fmstate->temp_cxt);
+
+	/*
+	 * Fewer rows are inserted if a remote trigger skipped some.  The
+	 * executor only uses the returned slots for RETURNING and AFTER ROW
+	 * triggers, whose data we fetched above, so that's fine.
+	 */
+	*numSlots = n_rows;
+	return slots;
+}
+
 /*
  * postgresExecForeignUpdate
  *		Update one row in a foreign table
@@ -1645,6 +1932,7 @@ postgresExecForeignUpdate(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1661,7 +1949,7 @@ postgresExecForeignUpdate(EState *estate,
 	{
 		n_rows = PQntuples(res);
 		if (n_rows > 0)
-			store_returning_result(fmstate, slot, res);
+			store_returning_result(fmstate, slot, res, 0);
 	}
 	else
 		n_rows = atoi(PQcmdTuples(res));
@@ -1715,6 +2003,7 @@ postgresExecForeignDelete(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1731,7 +2020,7 @@ postgresExecForeignDelete(EState *estate,
 	{
 		n_rows = PQntuples(res);
 		if (n_rows > 0)
-			store_returning_result(fmstate, slot, res);
+			store_returning_result(fmstate, slot, res, 0);
 	}
 	else
 		n_rows = atoi(PQcmdTuples(res));
@@ -1759,24 +2048,17 @@ postgresEndForeignModify(EState *estate,
 	if (fmstate == NULL)
 		return;
 
-	/* If we created a prepared statement, destroy it */
+	/* If we created prepared statements, destroy them */
 	if (fmstate->p_name)
 	{
-		char		sql[64];
-		PGresult   *res;
-
-		snprintf(sql, sizeof(sql), "DEALLOCATE %s", fmstate->p_name);
-
-		/*
-		 * We don't use a PG_TRY block here, so be careful not to throw error
-		 * without releasing the PGresult.
-		 */
-		res = PQexec(fmstate->conn, sql);
-		if (PQresultStatus(res) != PGRES_COMMAND_OK)
-			pgfdw_report_error(ERROR, res, fmstate->conn, true, sql);
-		PQclear(res);
+		deallocate_foreign_statement(fmstate, fmstate->p_name);
 		fmstate->p_name = NULL;
 	}
+	if (fmstate->p_batch_name)
+	{
+		deallocate_foreign_statement(fmstate, fmstate->p_batch_name);
+		fmstate->p_batch_name = NULL;
+	}
 
 	/* Release remote connection */
 	ReleaseConnection(fmstate->conn);
@@ -2048,6 +2330,7 @@ get_remote_estimate(const char *sql, PGconn *conn,
 		/*
 		 * Execute EXPLAIN remotely.
 		 */
+		CompletePendingRequest(conn);
 		res = PQexec(conn, sql);
 		if (PQresultStatus(res) != PGRES_TUPLES_OK)
 			pgfdw_report_error(ERROR, res, conn, false, sql);
@@ -2181,6 +2464,7 @@ create_cursor(ForeignScanState *node)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(conn);
 	res = PQexecParams(conn, buf.data, numParams, NULL, values,
 					   NULL, NULL, 0);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
@@ -2225,10 +2509,30 @@ fetch_more_data(ForeignScanState *node)
 		int			numrows;
 		int			i;
 
-		snprintf(sql, sizeof(sql), "FETCH %d FROM c%u",
-				 fsstate->fetch_size, fsstate->cursor_number);
+		if (fsstate->request_pending || fsstate->pending_result)
+		{
+			/* Use result of the FETCH sent by fetch_more_data_begin() */
+			if (fsstate->request_pending)
+				CompletePendingRequest(conn);
+			if (fsstate->request_pending)
+			{
+				fsstate->request_pending = false;
+				ereport(ERROR,
+						(errcode(ERRCODE_FDW_ERROR),
+						 errmsg("asynchronous fetch from foreign table \"%s\" was cancelled",
+								RelationGetRelationName(fsstate->rel))));
+			}
+			res = fsstate->pending_result;
+			fsstate->pending_result = NULL;
+		}
+		else
+		{
+			snprintf(sql, sizeof(sql), "FETCH %d FROM c%u",
+					 fsstate->fetch_size, fsstate->cursor_number);
 
-		res = PQexec(conn, sql);
+			CompletePendingRequest(conn);
+			res = PQexec(conn, sql);
+		}
 		/* On error, report the original query, not the FETCH. */
 		if (PQresultStatus(res) != PGRES_TUPLES_OK)
 			pgfdw_report_error(ERROR, res, conn, false, fsstate->query);
@@ -2270,6 +2574,91 @@ fetch_more_data(ForeignScanState *node)
 	MemoryContextSwitchTo(oldcontext);
 }
 
+/*
+ * Send FETCH for the node's cursor without waiting for the result, which is
+ * then processed by fetch_more_data().  The cursor is declared if needed; if
+ * the query has no parameters, DECLARE and FETCH are sent together, so that
+ * the first batch of rows costs a single round trip.
+ */
+static void
+fetch_more_data_begin(ForeignScanState *node)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+	PGconn	   *conn = fsstate->conn;
+	char	   *sql;
+
+	Assert(!fsstate->request_pending && fsstate->pending_result == NULL);
+
+	if (!fsstate->cursor_exists && fsstate->numParams == 0)
+	{
+		sql = psprintf("DECLARE c%u CURSOR FOR\n%s; FETCH %d FROM c%u",
+					   fsstate->cursor_number, fsstate->query,
+					   fsstate->fetch_size, fsstate->cursor_number);
+
+		/* Mark the cursor as created, as create_cursor() does */
+		fsstate->cursor_exists = true;
+		fsstate->tuples = NULL;
+		fsstate->num_tuples = 0;
+		fsstate->next_tuple = 0;
+		fsstate->fetch_ct_2 = 0;
+		fsstate->eof_reached = false;
+	}
+	else
+	{
+		if (!fsstate->cursor_exists)
+			create_cursor(node);
+		sql = psprintf("FETCH %d FROM c%u",
+					   fsstate->fetch_size, fsstate->cursor_number);
+	}
+
+	CompletePendingRequest(conn);
+	if (!PQsendQuery(conn, sql))
+		pgfdw_report_error(ERROR, NULL, conn, false, fsstate->query);
+	pfree(sql);
+
+	fsstate->request_pending = true;
+	SetPendingRequest(conn, complete_pending_fetch, fsstate);
+}
+
+/*
+ * Receive the next result of the asynchronous request and save it for
+ * fetch_more_data(): the first failure, if any, or the FETCH result.
+ * Returns false when all results have been received.
+ */
+static bool
+receive_fetch_result(PgFdwScanState *fsstate)
+{
+	PGresult   *res = PQgetResult(fsstate->conn);
+
+	if (res == NULL)
+		return false;
+
+	if (fsstate->pending_result == NULL ||
+		PQresultStatus(fsstate->pending_result) == PGRES_COMMAND_OK)
+	{
+		PQclear(fsstate->pending_result);
+		fsstate->pending_result = res;
+	}
+	else
+		PQclear(res);
+	return true;
+}
+
+/*
+ * Receive the rest of the asynchronous FETCH results.  Called by connection.c
+ * before anything else is sent on the connection, so this must not throw an
+ * error.
+ */
+static void
+complete_pending_fetch(void *arg)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) arg;
+
+	while (receive_fetch_result(fsstate))
+		;
+	fsstate->request_pending = false;
+}
+
 /*
  * Force assorted GUC parameters to settings that ensure that we'll output
  * data values in a form that is unambiguous to the remote server.
@@ -2335,6 +2724,7 @@ close_cursor(PGconn *conn, unsigned int cursor_number)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(conn);
 	res = PQexec(conn, sql);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
 		pgfdw_report_error(ERROR, res, conn, true, sql);
@@ -2347,6 +2737,18 @@ close_cursor(PGconn *conn, unsigned int cursor_number)
  */
 static void
 prepare_foreign_modify(PgFdwModifyState *fmstate)
+{
+	/* This action shows that the prepare has been done. */
+	fmstate->p_name = prepare_foreign_statement(fmstate, fmstate->query);
+}
+
+/*
+ * prepare_foreign_statement
+ *		Establish a prepared statement on the connection of the modify
+ *		operation, and return its name
+ */
+static char *
+prepare_foreign_statement(PgFdwModifyState *fmstate, const char *query)
 {
 	char		prep_name[NAMEDATALEN];
 	char	   *p_name;
@@ -2367,18 +2769,41 @@ prepare_foreign_modify(PgFdwModifyState *fmstate)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	CompletePendingRequest(fmstate->conn);
 	res = PQprepare(fmstate->conn,
 					p_name,
-					fmstate->query,
+					query,
 					0,
 					NULL);
 
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
-		pgfdw_report_error(ERROR, res, fmstate->conn, true, fmstate->query);
+		pgfdw_report_error(ERROR, res, fmstate->conn, true, query);
 	PQclear(res);
 
-	/* This action shows that the prepare has been done. */
-	fmstate->p_name = p_name;
+	return p_name;
+}
+
+/*
+ * deallocate_foreign_statement
+ *		Destroy a prepared statement made by prepare_foreign_statement
+ */
+static void
+deallocate_foreign_statement(PgFdwModifyState *fmstate, const char *p_name)
+{
+	char		sql[64];
+	PGresult   *res;
+
+	snprintf(sql, sizeof(sql), "DEALLOCATE %s", p_name);
+
+	/*
+	 * We don't use a PG_TRY block here, so be careful not to throw error
+	 * without releasing the PGresult.
+	 */
+	CompletePendingRequest(fmstate->conn);
+	res = PQexec(fmstate->conn, sql);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		pgfdw_report_error(ERROR, res, fmstate->conn, true, sql);
+	PQclear(res);
 }
 
 /*
@@ -2447,20 +2872,20 @@ convert_prep_stmt_params(PgFdwModifyState *fmstate,
 
 /*
  * store_returning_result
- *		Store the result of a RETURNING clause
+ *		Store the result of a RETURNING clause from the given row of res
  *
  * On error, be sure to release the PGresult on the way out.  Callers do not
  * have PG_TRY blocks to ensure this happens.
  */
 static void
 store_returning_result(PgFdwModifyState *fmstate,
-					   TupleTableSlot *slot, PGresult *res)
+					   TupleTableSlot *slot, PGresult *res, int row)
 {
 	PG_TRY();
 	{
 		HeapTuple	newtup;
 
-		newtup = make_tuple_from_result_row(res, 0,
+		newtup = make_tuple_from_result_row(res, row,
 											fmstate->rel,
 											fmstate->attinmeta,
 											fmstate->retrieved_attrs,
@@ -3228,9 +3653,11 @@ postgres_fdw_exec(PG_FUNCTION_ARGS)
 	ForeignTable *table = GetForeignTable(relid);
 	ForeignServer *server = GetForeignServer(table->serverid);
 	UserMapping *user = GetUserMapping(userid, server->serverid);
-	PGconn	   *conn = GetConnection(server, user, false);
-	PGresult   *res = PQexec(conn, sql);
+	PGconn	   *conn = GetConnection(user, false);
+	PGresult   *res;
 
+	CompletePendingRequest(conn);
+	res = PQexec(conn, sql);
 	PQclear(res);
 	ReleaseConnection(conn);
 	PG_RETURN_VOID();
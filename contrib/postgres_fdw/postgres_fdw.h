@@ -55,15 +55,22 @@ typedef struct PgFdwRelationInfo
 	UserMapping *user;			/* only set in use_remote_estimate mode */
 
 	int			fetch_size;      /* fetch size for this remote table */
+	bool		async_capable;	/* may scans run asynchronously under Append? */
 } PgFdwRelationInfo;
 
 /* in postgres_fdw.c */
+extern bool UseTsDtmTransactions;
 extern int	set_transmission_modes(void);
 extern void reset_transmission_modes(int nestlevel);
 
 /* in connection.c */
+typedef void (*PgFdwCompletePendingRequest) (void *arg);
+
 extern PGconn *GetConnection(UserMapping *user, bool will_prep_stmt);
 extern void ReleaseConnection(PGconn *conn);
+extern void SetPendingRequest(PGconn *conn,
+				  PgFdwCompletePendingRequest callback, void *arg);
+extern void CompletePendingRequest(PGconn *conn);
 extern unsigned int GetCursorNumber(PGconn *conn);
 extern unsigned int GetPrepStmtNumber(PGconn *conn);
 extern void pgfdw_report_error(int elevel, PGresult *res, PGconn *conn,
@@ -88,7 +95,9 @@ extern bool is_foreign_expr(PlannerInfo *root,
 extern void deparseInsertSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *targetAttrs, bool doNothing, List *returningList,
-				 List **retrieved_attrs);
+				 List **retrieved_attrs, int *values_end_len);
+extern void rebuildInsertSql(StringInfo buf, const char *orig_query,
+				 int values_end_len, int num_params, int num_rows);
 extern void deparseUpdateSql(StringInfo buf, PlannerInfo *root,
 				 Index rtindex, Relation rel,
 				 List *targetAttrs, List *returningList,
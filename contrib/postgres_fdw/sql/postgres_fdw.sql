@@ -973,3 +973,150 @@ WHERE ftrelid = 'table30000'::regclass
 AND ftoptions @> array['fetch_size=60000'];
 
 ROLLBACK;
+
+-- ===================================================================
+-- test batch insert
+-- ===================================================================
+CREATE TABLE batch_loct (f1 int PRIMARY KEY, f2 text);
+CREATE FOREIGN TABLE batch_ft (f1 int, f2 text)
+  SERVER loopback OPTIONS (table_name 'batch_loct', batch_size '10');
+
+-- two full batches and a tail batch
+INSERT INTO batch_ft SELECT g, 'row ' || g FROM generate_series(1, 25) g;
+SELECT count(*), min(f1), max(f1) FROM batch_loct;
+
+-- RETURNING, with a full and a tail batch
+INSERT INTO batch_ft SELECT g, 'row ' || g FROM generate_series(26, 37) g
+  RETURNING *;
+
+-- a failing row is reported when its batch is sent
+INSERT INTO batch_ft SELECT g, 'dup' FROM generate_series(36, 40) g;
+SELECT count(*) FROM batch_loct WHERE f2 = 'dup';
+
+-- local triggers
+CREATE TABLE batch_log (op text, f1 int, f2 text);
+CREATE FUNCTION batch_brtrig() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+  NEW.f2 := NEW.f2 || ' (before)';
+  RETURN NEW;
+END $$;
+CREATE FUNCTION batch_artrig() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+  INSERT INTO batch_log VALUES (TG_WHEN, NEW.f1, NEW.f2);
+  RETURN NEW;
+END $$;
+CREATE TRIGGER batch_br BEFORE INSERT ON batch_ft
+  FOR EACH ROW EXECUTE PROCEDURE batch_brtrig();
+CREATE TRIGGER batch_ar AFTER INSERT ON batch_ft
+  FOR EACH ROW EXECUTE PROCEDURE batch_artrig();
+INSERT INTO batch_ft SELECT g, 'row ' || g FROM generate_series(41, 52) g
+  RETURNING f1, f2;
+SELECT * FROM batch_log ORDER BY f1;
+DROP TRIGGER batch_br ON batch_ft;
+DROP TRIGGER batch_ar ON batch_ft;
+
+-- remote triggers may skip rows; RETURNING reports the inserted ones
+CREATE FUNCTION batch_skip_odd() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+  IF NEW.f1 % 2 = 1 THEN
+    RETURN NULL;
+  END IF;
+  RETURN NEW;
+END $$;
+CREATE TRIGGER batch_skip BEFORE INSERT ON batch_loct
+  FOR EACH ROW EXECUTE PROCEDURE batch_skip_odd();
+INSERT INTO batch_ft SELECT g, 'row ' || g FROM generate_series(61, 73) g
+  RETURNING *;
+DROP TRIGGER batch_skip ON batch_loct;
+
+-- ON CONFLICT DO NOTHING and WITH CHECK OPTION insert row by row
+INSERT INTO batch_ft SELECT g, 'conflict ' || g FROM generate_series(35, 40) g
+  ON CONFLICT DO NOTHING;
+SELECT count(*) FROM batch_loct WHERE f2 LIKE 'conflict%';
+INSERT INTO batch_ft SELECT g, 'conflict ' || g FROM generate_series(50, 56) g
+  ON CONFLICT DO NOTHING RETURNING *;
+CREATE VIEW batch_wcov AS SELECT * FROM batch_ft WHERE f1 < 100
+  WITH CHECK OPTION;
+INSERT INTO batch_wcov SELECT g, 'view ' || g FROM generate_series(95, 105) g;
+INSERT INTO batch_wcov SELECT g, 'view ' || g FROM generate_series(81, 92) g;
+SELECT count(*) FROM batch_loct WHERE f2 LIKE 'view%';
+
+-- the batch size is capped by the protocol's parameter limit
+ALTER FOREIGN TABLE batch_ft OPTIONS (SET batch_size '100000');
+INSERT INTO batch_ft SELECT g, 'big ' || g FROM generate_series(1001, 1500) g;
+SELECT count(*) FROM batch_loct WHERE f2 LIKE 'big%';
+
+DROP VIEW batch_wcov;
+DROP FOREIGN TABLE batch_ft;
+DROP TABLE batch_loct, batch_log;
+DROP FUNCTION batch_brtrig();
+DROP FUNCTION batch_artrig();
+DROP FUNCTION batch_skip_odd();
+
+-- ===================================================================
+-- test asynchronous execution
+-- ===================================================================
+DO $d$
+    BEGIN
+        EXECUTE $$CREATE SERVER loopback2 FOREIGN DATA WRAPPER postgres_fdw
+            OPTIONS (dbname '$$||current_database()||$$',
+                     port '$$||current_setting('port')||$$',
+                     async_capable 'true'
+            )$$;
+    END;
+$d$;
+CREATE USER MAPPING FOR CURRENT_USER SERVER loopback2;
+
+CREATE TABLE async_base1 (a int, b int, c text);
+CREATE TABLE async_base2 (a int, b int, c text);
+CREATE TABLE async_base3 (a int, b int, c text);
+INSERT INTO async_base1 SELECT g, g % 10, to_char(g, 'FM0000') FROM generate_series(1, 200) g;
+INSERT INTO async_base2 SELECT g, g % 10, to_char(g, 'FM0000') FROM generate_series(201, 400) g;
+INSERT INTO async_base3 SELECT g, g % 10, to_char(g, 'FM0000') FROM generate_series(401, 600) g;
+
+-- p1 and p3 share a connection, p2 has its own; p3 is not asynchronous
+CREATE TABLE async_pt (a int, b int, c text);
+CREATE FOREIGN TABLE async_p1 () INHERITS (async_pt)
+  SERVER loopback OPTIONS (table_name 'async_base1', async_capable 'true',
+                           fetch_size '30');
+CREATE FOREIGN TABLE async_p2 () INHERITS (async_pt)
+  SERVER loopback2 OPTIONS (table_name 'async_base2');
+CREATE FOREIGN TABLE async_p3 () INHERITS (async_pt)
+  SERVER loopback OPTIONS (table_name 'async_base3');
+INSERT INTO async_pt VALUES (0, 0, 'local');
+
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT * FROM async_pt WHERE b = 5 AND a % 50 = 5;
+SELECT * FROM async_pt WHERE b = 5 AND a % 50 = 5 ORDER BY a;
+SELECT count(*), sum(a), min(c), max(c) FROM async_pt;
+
+-- stopping early leaves requests in flight; later commands must cope
+SELECT count(*) FROM (SELECT * FROM async_pt LIMIT 75) s;
+SELECT count(*) FROM async_p1;
+SELECT count(*) FROM async_p3;
+
+-- rescans with changing parameters, in a correlated subquery
+CREATE TABLE async_local (a int);
+INSERT INTO async_local VALUES (5), (250), (555), (1000);
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT l.a, (SELECT string_agg(t.c, ',' ORDER BY t.c) FROM async_pt t
+               WHERE t.a % 100 = l.a % 100)
+  FROM async_local l;
+SELECT l.a, (SELECT string_agg(t.c, ',' ORDER BY t.c) FROM async_pt t
+               WHERE t.a % 100 = l.a % 100)
+  FROM async_local l ORDER BY l.a;
+
+-- UNION ALL of foreign tables on both servers
+SELECT b, count(*) FROM
+  (SELECT b FROM async_p1 UNION ALL SELECT b FROM async_p2) s
+  GROUP BY b ORDER BY b;
+
+-- turning it off per table
+ALTER FOREIGN TABLE async_p1 OPTIONS (SET async_capable 'false');
+ALTER SERVER loopback2 OPTIONS (SET async_capable 'false');
+SELECT count(*), sum(a) FROM async_pt;
+
+DROP TABLE async_pt CASCADE;
+DROP TABLE async_base1, async_base2, async_base3, async_local;
+DROP USER MAPPING FOR CURRENT_USER SERVER loopback2;
+DROP SERVER loopback2;
@@ -76,6 +76,192 @@
  * ----------------------------------------------------------------
  */
 
+/*
+ * tupdesc_init_deform
+ *		Set up the descriptor's deform info: count its leading fixed-width
+ *		attributes, and cache their offsets in attcacheoff.
+ *
+ * Those offsets hold in any tuple that has no nulls among the attributes,
+ * so they can be extracted with no per-tuple offset computation.
+ */
+static void
+tupdesc_init_deform(TupleDesc tupleDesc)
+{
+	Form_pg_attribute *att = tupleDesc->attrs;
+	int			natts = tupleDesc->natts;
+	long		off = 0;
+	int			j;
+
+	for (j = 0; j < natts; j++)
+	{
+		if (att[j]->attlen <= 0)
+			break;
+
+		off = att_align_nominal(off, att[j]->attalign);
+		att[j]->attcacheoff = off;
+		off += att[j]->attlen;
+	}
+
+	tupleDesc->tdnfixed = j;
+}
+
+/*
+ * first_null_attr
+ *		Return the number of the first attribute in [attnum, natts) that the
+ *		null bitmap marks as null, or natts if there's none.
+ *
+ * Bitmap bytes without any nulls are skipped eight attributes at a time.
+ */
+static inline int
+first_null_attr(bits8 *bp, int attnum, int natts)
+{
+	while (attnum < natts)
+	{
+		if ((attnum & 0x07) == 0 && bp[attnum >> 3] == 0xFF)
+		{
+			attnum += 8;
+			continue;
+		}
+		if (att_isnull(attnum, bp))
+			return attnum;
+		attnum++;
+	}
+	return natts;
+}
+
+/*
+ * heap_deform_attrs
+ *		Extract attributes attnum .. natts-1 of a tuple into values/isnull.
+ *
+ * *offp and *slowp carry the offset of the end of the previously extracted
+ * attribute, and whether attcacheoff can no longer be used, from one call to
+ * the next; both must be zero/false when starting at the first attribute.
+ * The caller must ensure natts doesn't exceed the tuple's attribute count.
+ *
+ * This is the common code of heap_deform_tuple and slot_deform_tuple.
+ */
+static inline void
+heap_deform_attrs(TupleDesc tupleDesc, HeapTupleHeader tup,
+				  int attnum, int natts, Datum *values, bool *isnull,
+				  long *offp, bool *slowp)
+{
+	Form_pg_attribute *att = tupleDesc->attrs;
+	bool		hasnulls = (tup->t_infomask & HEAP_HASNULL) != 0;
+	char	   *tp = (char *) tup + tup->t_hoff;	/* ptr to tuple data */
+	bits8	   *bp = tup->t_bits;	/* ptr to null bitmap in tuple */
+	long		off = *offp;	/* offset in tuple data */
+	bool		slow = *slowp;	/* can we use/set attcacheoff? */
+
+	if (tupleDesc->tdnfixed < 0)
+		tupdesc_init_deform(tupleDesc);
+
+	/*
+	 * Until we pass a null or a variable-width attribute, every attribute is
+	 * at its cached offset, so first extract as many as we can that way.
+	 */
+	if (!slow)
+	{
+		int			lim = Min(natts, tupleDesc->tdnfixed);
+
+		if (hasnulls)
+			lim = first_null_attr(bp, attnum, lim);
+
+		if (attnum < lim)
+		{
+			for (; attnum < lim; attnum++)
+			{
+				Form_pg_attribute thisatt = att[attnum];
+
+				values[attnum] = fetchatt(thisatt, tp + thisatt->attcacheoff);
+				isnull[attnum] = false;
+			}
+			off = att[attnum - 1]->attcacheoff + att[attnum - 1]->attlen;
+		}
+	}
+
+	if (tupleDesc->tdnfixed == tupleDesc->natts)
+	{
+		/*
+		 * All attributes are fixed-width, so we only get here past a null.
+		 * Nominal alignment is always right for fixed-width values, so none
+		 * of the varlena handling below is needed.
+		 */
+		for (; attnum < natts; attnum++)
+		{
+			Form_pg_attribute thisatt = att[attnum];
+
+			if (hasnulls && att_isnull(attnum, bp))
+			{
+				values[attnum] = (Datum) 0;
+				isnull[attnum] = true;
+				slow = true;	/* can't use attcacheoff anymore */
+				continue;
+			}
+
+			isnull[attnum] = false;
+			off = att_align_nominal(off, thisatt->attalign);
+			values[attnum] = fetchatt(thisatt, tp + off);
+			off += thisatt->attlen;
+		}
+	}
+	else
+	{
+		for (; attnum < natts; attnum++)
+		{
+			Form_pg_attribute thisatt = att[attnum];
+
+			if (hasnulls && att_isnull(attnum, bp))
+			{
+				values[attnum] = (Datum) 0;
+				isnull[attnum] = true;
+				slow = true;	/* can't use attcacheoff anymore */
+				continue;
+			}
+
+			isnull[attnum] = false;
+
+			if (!slow && thisatt->attcacheoff >= 0)
+				off = thisatt->attcacheoff;
+			else if (thisatt->attlen == -1)
+			{
+				/*
+				 * We can only cache the offset for a varlena attribute if the
+				 * offset is already suitably aligned, so that there would be
+				 * no pad bytes in any case: then the offset will be valid for
+				 * either an aligned or unaligned value.
+				 */
+				if (!slow &&
+					off == att_align_nominal(off, thisatt->attalign))
+					thisatt->attcacheoff = off;
+				else
+				{
+					off = att_align_pointer(off, thisatt->attalign, -1,
+											tp + off);
+					slow = true;
+				}
+			}
+			else
+			{
+				/* not varlena, so safe to use att_align_nominal */
+				off = att_align_nominal(off, thisatt->attalign);
+
+				if (!slow)
+					thisatt->attcacheoff = off;
+			}
+
+			values[attnum] = fetchatt(thisatt, tp + off);
+
+			off = att_addlength_pointer(off, thisatt->attlen, tp + off);
+
+			if (thisatt->attlen <= 0)
+				slow = true;	/* can't use attcacheoff anymore */
+		}
+	}
+
+	*offp = off;
+	*slowp = slow;
+}
+
 
 /*
  * heap_compute_data_size
@@ -358,7 +544,9 @@ nocachegetattr(HeapTuple tuple,
 	char	   *tp;				/* ptr to data part of tuple */
 	bits8	   *bp = tup->t_bits;		/* ptr to null bitmap in tuple */
 	bool		slow = false;	/* do we have to walk attrs? */
+	bool		usecache = true;	/* can we use/set attcacheoff? */
 	int			off;			/* current offset within data */
+	int			i;
 
 	/* ----------------
 	 *	 Three cases:
@@ -415,125 +603,76 @@ nocachegetattr(HeapTuple tuple,
 		}
 
 		/*
-		 * Otherwise, check for non-fixed-length attrs up to and including
-		 * target.  If there aren't any, it's safe to cheaply initialize the
-		 * cached offsets for these attrs.
+		 * Otherwise, see whether the target lies within the descriptor's
+		 * leading run of fixed-width attributes.  If so, its offset doesn't
+		 * depend on the tuple, and setting up the descriptor's deform info
+		 * computes and caches it (along with the offsets of all the other
+		 * attributes in that run, in hope of avoiding future visits to this
+		 * routine).
 		 */
-		if (HeapTupleHasVarWidth(tuple))
-		{
-			int			j;
-
-			for (j = 0; j <= attnum; j++)
-			{
-				if (att[j]->attlen <= 0)
-				{
-					slow = true;
-					break;
-				}
-			}
-		}
+		if (tupleDesc->tdnfixed < 0)
+			tupdesc_init_deform(tupleDesc);
+		if (attnum < tupleDesc->tdnfixed)
+			return fetchatt(att[attnum],
+							tp + att[attnum]->attcacheoff);
 	}
 
-	if (!slow)
+	/*
+	 * Now we know that we have to walk the tuple CAREFULLY.  But we still
+	 * might be able to cache some offsets for next time.
+	 *
+	 * Note - This loop is a little tricky.  For each non-null attribute, we
+	 * have to first account for alignment padding before the attr, then
+	 * advance over the attr based on its length.  Nulls have no storage and
+	 * no alignment padding either.  We can use/set attcacheoff until we reach
+	 * either a null or a var-width attribute.
+	 */
+	off = 0;
+	for (i = 0;; i++)		/* loop exit is at "break" */
 	{
-		int			natts = tupleDesc->natts;
-		int			j = 1;
-
-		/*
-		 * If we get here, we have a tuple with no nulls or var-widths up to
-		 * and including the target attribute, so we can use the cached offset
-		 * ... only we don't have it yet, or we'd not have got here.  Since
-		 * it's cheap to compute offsets for fixed-width columns, we take the
-		 * opportunity to initialize the cached offsets for *all* the leading
-		 * fixed-width columns, in hope of avoiding future visits to this
-		 * routine.
-		 */
-		att[0]->attcacheoff = 0;
-
-		/* we might have set some offsets in the slow path previously */
-		while (j < natts && att[j]->attcacheoff > 0)
-			j++;
-
-		off = att[j - 1]->attcacheoff + att[j - 1]->attlen;
-
-		for (; j < natts; j++)
+		if (HeapTupleHasNulls(tuple) && att_isnull(i, bp))
 		{
-			if (att[j]->attlen <= 0)
-				break;
-
-			off = att_align_nominal(off, att[j]->attalign);
-
-			att[j]->attcacheoff = off;
-
-			off += att[j]->attlen;
+			usecache = false;
+			continue;		/* this cannot be the target att */
 		}
 
-		Assert(j > attnum);
-
-		off = att[attnum]->attcacheoff;
-	}
-	else
-	{
-		bool		usecache = true;
-		int			i;
-
-		/*
-		 * Now we know that we have to walk the tuple CAREFULLY.  But we still
-		 * might be able to cache some offsets for next time.
-		 *
-		 * Note - This loop is a little tricky.  For each non-null attribute,
-		 * we have to first account for alignment padding before the attr,
-		 * then advance over the attr based on its length.  Nulls have no
-		 * storage and no alignment padding either.  We can use/set
-		 * attcacheoff until we reach either a null or a var-width attribute.
-		 */
-		off = 0;
-		for (i = 0;; i++)		/* loop exit is at "break" */
+		/* If we know the next offset, we can skip the rest */
+		if (usecache && att[i]->attcacheoff >= 0)
+			off = att[i]->attcacheoff;
+		else if (att[i]->attlen == -1)
 		{
-			if (HeapTupleHasNulls(tuple) && att_isnull(i, bp))
+			/*
+			 * We can only cache the offset for a varlena attribute if the
+			 * offset is already suitably aligned, so that there would be no
+			 * pad bytes in any case: then the offset will be valid for either
+			 * an aligned or unaligned value.
+			 */
+			if (usecache &&
+				off == att_align_nominal(off, att[i]->attalign))
+				att[i]->attcacheoff = off;
+			else
 			{
+				off = att_align_pointer(off, att[i]->attalign, -1,
+										tp + off);
 				usecache = false;
-				continue;		/* this cannot be the target att */
 			}
+		}
+		else
+		{
+			/* not varlena, so safe to use att_align_nominal */
+			off = att_align_nominal(off, att[i]->attalign);
 
-			/* If we know the next offset, we can skip the rest */
-			if (usecache && att[i]->attcacheoff >= 0)
-				off = att[i]->attcacheoff;
-			else if (att[i]->attlen == -1)
-			{
-				/*
-				 * We can only cache the offset for a varlena attribute if the
-				 * offset is already suitably aligned, so that there would be
-				 * no pad bytes in any case: then the offset will be valid for
-				 * either an aligned or unaligned value.
-				 */
-				if (usecache &&
-					off == att_align_nominal(off, att[i]->attalign))
-					att[i]->attcacheoff = off;
-				else
-				{
-					off = att_align_pointer(off, att[i]->attalign, -1,
-											tp + off);
-					usecache = false;
-				}
-			}
-			else
-			{
-				/* not varlena, so safe to use att_align_nominal */
-				off = att_align_nominal(off, att[i]->attalign);
-
-				if (usecache)
-					att[i]->attcacheoff = off;
-			}
+			if (usecache)
+				att[i]->attcacheoff = off;
+		}
 
-			if (i == attnum)
-				break;
+		if (i == attnum)
+			break;
 
-			off = att_addlength_pointer(off, att[i]->attlen, tp + off);
+		off = att_addlength_pointer(off, att[i]->attlen, tp + off);
 
-			if (usecache && att[i]->attlen <= 0)
-				usecache = false;
-		}
+		if (usecache && att[i]->attlen <= 0)
+			usecache = false;
 	}
 
 	return fetchatt(att[attnum], tp + off);
@@ -868,14 +1007,10 @@ heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 				  Datum *values, bool *isnull)
 {
 	HeapTupleHeader tup = tuple->t_data;
-	bool		hasnulls = HeapTupleHasNulls(tuple);
-	Form_pg_attribute *att = tupleDesc->attrs;
 	int			tdesc_natts = tupleDesc->natts;
 	int			natts;			/* number of atts to extract */
 	int			attnum;
-	char	   *tp;				/* ptr to tuple data */
-	long		off;			/* offset in tuple data */
-	bits8	   *bp = tup->t_bits;		/* ptr to null bitmap in tuple */
+	long		off = 0;		/* offset in tuple data */
 	bool		slow = false;	/* can we use/set attcacheoff? */
 
 	natts = HeapTupleHeaderGetNatts(tup);
@@ -887,66 +1022,13 @@ heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 	 */
 	natts = Min(natts, tdesc_natts);
 
-	tp = (char *) tup + tup->t_hoff;
-
-	off = 0;
-
-	for (attnum = 0; attnum < natts; attnum++)
-	{
-		Form_pg_attribute thisatt = att[attnum];
-
-		if (hasnulls && att_isnull(attnum, bp))
-		{
-			values[attnum] = (Datum) 0;
-			isnull[attnum] = true;
-			slow = true;		/* can't use attcacheoff anymore */
-			continue;
-		}
-
-		isnull[attnum] = false;
-
-		if (!slow && thisatt->attcacheoff >= 0)
-			off = thisatt->attcacheoff;
-		else if (thisatt->attlen == -1)
-		{
-			/*
-			 * We can only cache the offset for a varlena attribute if the
-			 * offset is already suitably aligned, so that there would be no
-			 * pad bytes in any case: then the offset will be valid for either
-			 * an aligned or unaligned value.
-			 */
-			if (!slow &&
-				off == att_align_nominal(off, thisatt->attalign))
-				thisatt->attcacheoff = off;
-			else
-			{
-				off = att_align_pointer(off, thisatt->attalign, -1,
-										tp + off);
-				slow = true;
-			}
-		}
-		else
-		{
-			/* not varlena, so safe to use att_align_nominal */
-			off = att_align_nominal(off, thisatt->attalign);
-
-			if (!slow)
-				thisatt->attcacheoff = off;
-		}
-
-		values[attnum] = fetchatt(thisatt, tp + off);
-
-		off = att_addlength_pointer(off, thisatt->attlen, tp + off);
-
-		if (thisatt->attlen <= 0)
-			slow = true;		/* can't use attcacheoff anymore */
-	}
+	heap_deform_attrs(tupleDesc, tup, 0, natts, values, isnull, &off, &slow);
 
 	/*
 	 * If tuple doesn't have all the atts indicated by tupleDesc, read the
 	 * rest as null
 	 */
-	for (; attnum < tdesc_natts; attnum++)
+	for (attnum = natts; attnum < tdesc_natts; attnum++)
 	{
 		values[attnum] = (Datum) 0;
 		isnull[attnum] = true;
@@ -969,15 +1051,8 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 {
 	HeapTuple	tuple = slot->tts_tuple;
 	TupleDesc	tupleDesc = slot->tts_tupleDescriptor;
-	Datum	   *values = slot->tts_values;
-	bool	   *isnull = slot->tts_isnull;
-	HeapTupleHeader tup = tuple->t_data;
-	bool		hasnulls = HeapTupleHasNulls(tuple);
-	Form_pg_attribute *att = tupleDesc->attrs;
 	int			attnum;
-	char	   *tp;				/* ptr to tuple data */
 	long		off;			/* offset in tuple data */
-	bits8	   *bp = tup->t_bits;		/* ptr to null bitmap in tuple */
 	bool		slow;			/* can we use/set attcacheoff? */
 
 	/*
@@ -998,63 +1073,13 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 		slow = slot->tts_slow;
 	}
 
-	tp = (char *) tup + tup->t_hoff;
-
-	for (; attnum < natts; attnum++)
-	{
-		Form_pg_attribute thisatt = att[attnum];
-
-		if (hasnulls && att_isnull(attnum, bp))
-		{
-			values[attnum] = (Datum) 0;
-			isnull[attnum] = true;
-			slow = true;		/* can't use attcacheoff anymore */
-			continue;
-		}
-
-		isnull[attnum] = false;
-
-		if (!slow && thisatt->attcacheoff >= 0)
-			off = thisatt->attcacheoff;
-		else if (thisatt->attlen == -1)
-		{
-			/*
-			 * We can only cache the offset for a varlena attribute if the
-			 * offset is already suitably aligned, so that there would be no
-			 * pad bytes in any case: then the offset will be valid for either
-			 * an aligned or unaligned value.
-			 */
-			if (!slow &&
-				off == att_align_nominal(off, thisatt->attalign))
-				thisatt->attcacheoff = off;
-			else
-			{
-				off = att_align_pointer(off, thisatt->attalign, -1,
-										tp + off);
-				slow = true;
-			}
-		}
-		else
-		{
-			/* not varlena, so safe to use att_align_nominal */
-			off = att_align_nominal(off, thisatt->attalign);
-
-			if (!slow)
-				thisatt->attcacheoff = off;
-		}
-
-		values[attnum] = fetchatt(thisatt, tp + off);
-
-		off = att_addlength_pointer(off, thisatt->attlen, tp + off);
-
-		if (thisatt->attlen <= 0)
-			slow = true;		/* can't use attcacheoff anymore */
-	}
+	heap_deform_attrs(tupleDesc, tuple->t_data, attnum, natts,
+					  slot->tts_values, slot->tts_isnull, &off, &slow);
 
 	/*
 	 * Save state for next execution
 	 */
-	slot->tts_nvalid = attnum;
+	slot->tts_nvalid = Max(natts, attnum);
 	slot->tts_off = off;
 	slot->tts_slow = slow;
 }
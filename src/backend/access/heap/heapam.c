@@ -420,6 +420,10 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 	 */
 	all_visible = PageIsAllVisible(dp) && !snapshot->takenDuringRecovery;
 
+	/* Let distributed transaction manager check all XIDs of the page at once */
+	if (!all_visible)
+		HeapPagePrefetchVisibility(buffer, snapshot);
+
 	for (lineoff = FirstOffsetNumber, lpp = PageGetItemId(dp, lineoff);
 		 lineoff <= lines;
 		 lineoff++, lpp++)
@@ -447,6 +451,8 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 		}
 	}
 
+	HeapPageResetVisibility();
+
 	LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
 
 	Assert(ntup <= MaxHeapTuplesPerPage);
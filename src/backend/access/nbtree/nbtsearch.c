@@ -30,6 +30,8 @@ static bool _bt_readpage(IndexScanDesc scan, ScanDirection dir,
 static void _bt_saveitem(BTScanOpaque so, int itemIndex,
 			 OffsetNumber offnum, IndexTuple itup);
 static bool _bt_steppage(IndexScanDesc scan, ScanDirection dir);
+static bool _bt_readnextpage(IndexScanDesc scan, BlockNumber blkno,
+				 ScanDirection dir);
 static Buffer _bt_walk_left(Relation rel, Buffer buf);
 static bool _bt_endpoint(IndexScanDesc scan, ScanDirection dir);
 static void _bt_drop_lock_and_maybe_pin(IndexScanDesc scan, BTScanPos sp);
@@ -536,6 +538,7 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 	int			i;
 	StrategyNumber strat_total;
 	BTScanPosItem *currItem;
+	BlockNumber blkno;
 
 	Assert(!BTScanPosIsValid(so->currPos));
 
@@ -552,7 +555,37 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 	 * never be satisfied (eg, x == 1 AND x > 2).
 	 */
 	if (!so->qual_ok)
+	{
+		_bt_parallel_done(scan);
 		return false;
+	}
+
+	/*
+	 * For parallel scans, get the starting page from shared state.  If the
+	 * scan has not started, proceed to find the first leaf page in the usual
+	 * way while keeping other participants waiting.  If the scan has
+	 * already begun, use the page number from the shared structure.
+	 */
+	if (scan->parallel_scan != NULL)
+	{
+		/* only forward scans of simple scan keys can be run in parallel */
+		if (!ScanDirectionIsForward(dir) || so->numArrayKeys != 0)
+			elog(ERROR, "unsupported parallel btree scan");
+
+		if (!_bt_parallel_seize(scan, &blkno))
+			return false;
+		else if (blkno != P_NONE)
+		{
+			so->currPos.moreLeft = false;
+			so->currPos.moreRight = true;
+			so->numKilled = 0;
+			so->markItemIndex = -1;
+
+			if (!_bt_readnextpage(scan, blkno, dir))
+				return false;
+			goto readcomplete;
+		}
+	}
 
 	/*----------
 	 * Examine the scan keys to discover where we need to start the scan.
@@ -763,7 +796,10 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 
 			Assert(subkey->sk_flags & SK_ROW_MEMBER);
 			if (subkey->sk_flags & SK_ISNULL)
+			{
+				_bt_parallel_done(scan);
 				return false;
+			}
 			memcpy(scankeys + i, subkey, sizeof(ScanKeyData));
 
 			/*
@@ -982,6 +1018,7 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 		 * because nothing finer to lock exists.
 		 */
 		PredicateLockRelation(rel, scan->xs_snapshot);
+		_bt_parallel_done(scan);
 		return false;
 	}
 	else
@@ -1076,6 +1113,7 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 		_bt_drop_lock_and_maybe_pin(scan, &so->currPos);
 	}
 
+readcomplete:
 	/* OK, itemIndex says what to return */
 	currItem = &so->currPos.items[so->currPos.itemIndex];
 	scan->xs_ctup.t_self = currItem->heapTid;
@@ -1148,6 +1186,10 @@ _bt_next(IndexScanDesc scan, ScanDirection dir)
  * moreLeft or moreRight (as appropriate) is cleared if _bt_checkkeys reports
  * that there can be no more matching tuples in the current scan direction.
  *
+ * In the case of a parallel scan, caller must have called _bt_parallel_seize
+ * prior to calling this function; this function will invoke
+ * _bt_parallel_release before returning.
+ *
  * Returns true if any matching items found on the page, false if none.
  */
 static bool
@@ -1193,6 +1235,10 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 	 */
 	so->currPos.nextPage = opaque->btpo_next;
 
+	/* allow next page be processed by parallel worker */
+	if (scan->parallel_scan != NULL)
+		_bt_parallel_release(scan, opaque->btpo_next);
+
 	/* initialize tuple workspace to empty */
 	so->currPos.nextTupleOffset = 0;
 
@@ -1340,8 +1386,7 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 	if (ScanDirectionIsForward(dir))
 	{
 		/* Walk right to the next page with data */
-		/* We must rely on the previously saved nextPage link! */
-		BlockNumber blkno = so->currPos.nextPage;
+		BlockNumber blkno;
 
 		/* Remember we left a page with data */
 		so->currPos.moreLeft = true;
@@ -1349,34 +1394,32 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 		/* release the previous buffer, if pinned */
 		BTScanPosUnpinIfPinned(so->currPos);
 
-		for (;;)
+		if (scan->parallel_scan != NULL)
 		{
-			/* if we're at end of scan, give up */
-			if (blkno == P_NONE || !so->currPos.moreRight)
+			/*
+			 * Pages are handed out by the shared state.  If this page was
+			 * the last one with matches, no later page can have any either,
+			 * so end the scan for everybody.
+			 */
+			if (!so->currPos.moreRight)
 			{
+				_bt_parallel_done(scan);
 				BTScanPosInvalidate(so->currPos);
 				return false;
 			}
-			/* check for interrupts while we're not holding any buffer lock */
-			CHECK_FOR_INTERRUPTS();
-			/* step right one page */
-			so->currPos.buf = _bt_getbuf(rel, blkno, BT_READ);
-			/* check for deleted page */
-			page = BufferGetPage(so->currPos.buf);
-			opaque = (BTPageOpaque) PageGetSpecialPointer(page);
-			if (!P_IGNORE(opaque))
+			if (!_bt_parallel_seize(scan, &blkno))
 			{
-				PredicateLockPage(rel, blkno, scan->xs_snapshot);
-				/* see if there are any matches on this page */
-				/* note that this will clear moreRight if we can stop */
-				if (_bt_readpage(scan, dir, P_FIRSTDATAKEY(opaque)))
-					break;
+				BTScanPosInvalidate(so->currPos);
+				return false;
 			}
-
-			/* nope, keep going */
-			blkno = opaque->btpo_next;
-			_bt_relbuf(rel, so->currPos.buf);
 		}
+		else
+		{
+			/* We must rely on the previously saved nextPage link! */
+			blkno = so->currPos.nextPage;
+		}
+
+		return _bt_readnextpage(scan, blkno, dir);
 	}
 	else
 	{
@@ -1454,6 +1497,83 @@ _bt_steppage(IndexScanDesc scan, ScanDirection dir)
 	return true;
 }
 
+/*
+ *	_bt_readnextpage() -- Read the first page with data at or to the right
+ *						  of blkno, for a forward scan
+ *
+ * On entry, no buffer is pinned or locked for so->currPos.  For a parallel
+ * scan the caller must have seized the scan, and blkno is the page it got.
+ *
+ * On success exit, so->currPos is updated to contain data from the next
+ * interesting page, and we return TRUE with the lock dropped as in
+ * _bt_steppage.  If there are no more matching records, we drop all locks
+ * and pins, set so->currPos.buf to InvalidBuffer, and return FALSE.
+ */
+static bool
+_bt_readnextpage(IndexScanDesc scan, BlockNumber blkno, ScanDirection dir)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	Relation	rel = scan->indexRelation;
+	Page		page;
+	BTPageOpaque opaque;
+
+	Assert(ScanDirectionIsForward(dir));
+
+	for (;;)
+	{
+		/* if we're at end of scan, give up */
+		if (blkno == P_NONE || !so->currPos.moreRight)
+		{
+			_bt_parallel_done(scan);
+			BTScanPosInvalidate(so->currPos);
+			return false;
+		}
+		/* check for interrupts while we're not holding any buffer lock */
+		CHECK_FOR_INTERRUPTS();
+		/* step right one page */
+		so->currPos.buf = _bt_getbuf(rel, blkno, BT_READ);
+		/* check for deleted page */
+		page = BufferGetPage(so->currPos.buf);
+		opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+		if (!P_IGNORE(opaque))
+		{
+			PredicateLockPage(rel, blkno, scan->xs_snapshot);
+			/* see if there are any matches on this page */
+			/* note that this will clear moreRight if we can stop */
+			if (_bt_readpage(scan, dir, P_FIRSTDATAKEY(opaque)))
+				break;
+		}
+		else if (scan->parallel_scan != NULL)
+		{
+			/* _bt_readpage didn't hand the right-link on; do it here */
+			_bt_parallel_release(scan, opaque->btpo_next);
+		}
+
+		/* nope, keep going */
+		if (scan->parallel_scan != NULL)
+		{
+			_bt_relbuf(rel, so->currPos.buf);
+			if (!so->currPos.moreRight)
+				continue;		/* ends the scan, see above */
+			if (!_bt_parallel_seize(scan, &blkno))
+			{
+				BTScanPosInvalidate(so->currPos);
+				return false;
+			}
+		}
+		else
+		{
+			blkno = opaque->btpo_next;
+			_bt_relbuf(rel, so->currPos.buf);
+		}
+	}
+
+	/* Drop the lock, and maybe the pin, on the current page */
+	_bt_drop_lock_and_maybe_pin(scan, &so->currPos);
+
+	return true;
+}
+
 /*
  * _bt_walk_left() -- step left one page, if possible
  *
@@ -1688,6 +1808,7 @@ _bt_endpoint(IndexScanDesc scan, ScanDirection dir)
 		 */
 		PredicateLockRelation(rel, scan->xs_snapshot);
 		BTScanPosInvalidate(so->currPos);
+		_bt_parallel_done(scan);
 		return false;
 	}
 
@@ -55,6 +55,14 @@
  * This code isn't concerned about the FSM at all. The caller is responsible
  * for initializing that.
  *
+ * A build can be done in parallel: the leader and its workers claim chunks
+ * of the heap from a shared counter, and each spools and sorts the index
+ * tuples it finds in its own chunks.  Each worker then streams its sorted
+ * output to the leader through a shm_mq, and the leader merges those streams
+ * with the output of its own sort (see tuplesort_attach_streams) while it
+ * loads the pages.  Only the page loading is serial, and it needs no more
+ * than a tuple per participant in memory.
+ *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -67,10 +75,15 @@
 #include "postgres.h"
 
 #include "access/nbtree.h"
+#include "access/parallel.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "access/xloginsert.h"
+#include "catalog/index.h"
 #include "miscadmin.h"
+#include "storage/proc.h"
 #include "storage/smgr.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/rel.h"
 #include "utils/sortsupport.h"
@@ -90,6 +103,72 @@ struct BTSpool
 	bool		isunique;
 };
 
+/* Working state for btbuild and its callback */
+typedef struct
+{
+	bool		isUnique;
+	bool		haveDead;
+	Relation	heapRel;
+	BTSpool    *spool;
+
+	/*
+	 * spool2 is needed only when the index is a unique index. Dead tuples are
+	 * put into spool2 instead of spool in order to avoid uniqueness check.
+	 */
+	BTSpool    *spool2;
+	double		indtuples;
+} BTBuildState;
+
+/* Magic numbers for parallel state sharing */
+#define PARALLEL_KEY_BTREE_SHARED		UINT64CONST(0xA000000000000001)
+#define PARALLEL_KEY_TUPLE_QUEUE		UINT64CONST(0xA000000000000002)
+
+/* Size of each queue through which a worker streams its sorted tuples */
+#define PARALLEL_BTREE_QUEUE_SIZE		65536
+
+/* Heap chunks per participant; more chunks balance the load better */
+#define PARALLEL_BTREE_CHUNKS			8
+
+/*
+ * Status record for a parallel btree build, stored in the DSM segment.
+ *
+ * Participants claim chunks of heap blocks by advancing nextblock.  Chunks
+ * consist of whole pages, so a HOT chain never straddles two participants.
+ * Each worker adds its statistics to the totals once it's done scanning;
+ * the leader reads them after all workers have finished.
+ */
+typedef struct BTShared
+{
+	/* Immutable state */
+	Oid			heaprelid;
+	Oid			indexrelid;
+	bool		isunique;
+	int			sortmem;		/* sort memory per participant, in kB */
+	BlockNumber nblocks;		/* number of heap blocks to scan */
+	BlockNumber chunksize;		/* number of heap blocks claimed at a time */
+
+	/* Mutable state, protected by mutex */
+	slock_t		mutex;
+	BlockNumber nextblock;		/* first block not yet claimed */
+	double		reltuples;		/* heap tuples scanned by workers */
+	double		indtuples;		/* index tuples spooled by workers */
+	bool		brokenhotchain; /* did any worker see a broken HOT chain? */
+} BTShared;
+
+/*
+ * Leader's private state for a parallel btree build.  Worker i streams its
+ * live tuples through livequeues[i], and, for a unique index, its dead
+ * tuples through deadqueues[i].
+ */
+typedef struct BTLeader
+{
+	ParallelContext *pcxt;
+	BTShared   *btshared;
+	int			nworkers;		/* number of workers actually launched */
+	shm_mq_handle **livequeues;
+	shm_mq_handle **deadqueues;
+} BTLeader;
+
 /*
  * Status record for a btree page being built.  We have one of these
  * for each active tree level.
@@ -128,6 +207,23 @@ typedef struct BTWriteState
 } BTWriteState;
 
 
+static void btbuildCallback(Relation index,
+				HeapTuple htup,
+				Datum *values,
+				bool *isnull,
+				bool tupleIsAlive,
+				void *state);
+static BTLeader *_bt_begin_parallel(Relation heap, Relation index,
+				   bool isunique, int request);
+static double _bt_parallel_heapscan(BTBuildState *buildstate,
+					  BTShared *btshared, Relation index,
+					  IndexInfo *indexInfo);
+static void _bt_parallel_leafbuild(BTLeader *btleader,
+					   BTBuildState *buildstate);
+static void _bt_parallel_send(BTBuildState *buildstate,
+				  shm_mq_handle **queues);
+static void _bt_end_parallel(BTLeader *btleader, IndexInfo *indexInfo,
+				 double *reltuples, double *indtuples);
 static Page _bt_blnewpage(uint32 level);
 static BTPageState *_bt_pagestate(BTWriteState *wstate, uint32 level);
 static void _bt_slideleft(Page page);
@@ -146,27 +242,164 @@ static void _bt_load(BTWriteState *wstate,
 
 
 /*
- * create and initialize a spool structure
+ *	btbuild() -- build a new btree index.
  */
-BTSpool *
-_bt_spoolinit(Relation heap, Relation index, bool isunique, bool isdead)
+IndexBuildResult *
+btbuild(Relation heap, Relation index, IndexInfo *indexInfo)
 {
-	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
-	int			btKbytes;
+	IndexBuildResult *result;
+	double		reltuples;
+	BTBuildState buildstate;
+	BTLeader   *btleader = NULL;
+	int			sortmem = maintenance_work_mem;
+
+	buildstate.isUnique = indexInfo->ii_Unique;
+	buildstate.haveDead = false;
+	buildstate.heapRel = heap;
+	buildstate.spool = NULL;
+	buildstate.spool2 = NULL;
+	buildstate.indtuples = 0;
 
-	btspool->heap = heap;
-	btspool->index = index;
-	btspool->isunique = isunique;
+#ifdef BTREE_BUILD_STATS
+	if (log_btree_build_stats)
+		ResetUsage();
+#endif   /* BTREE_BUILD_STATS */
+
+	/*
+	 * We expect to be called exactly once for any index relation. If that's
+	 * not the case, big trouble's what we have.
+	 */
+	if (RelationGetNumberOfBlocks(index) != 0)
+		elog(ERROR, "index \"%s\" already contains data",
+			 RelationGetRelationName(index));
+
+	/*
+	 * Launch workers if a parallel build was requested.  If none could be
+	 * started, we just do the whole build ourselves.
+	 */
+	if (indexInfo->ii_ParallelWorkers > 0)
+		btleader = _bt_begin_parallel(heap, index, indexInfo->ii_Unique,
+									  indexInfo->ii_ParallelWorkers);
+	if (btleader != NULL)
+		sortmem = btleader->btshared->sortmem;
 
 	/*
 	 * We size the sort area as maintenance_work_mem rather than work_mem to
 	 * speed index creation.  This should be OK since a single backend can't
-	 * run multiple index creations in parallel.  Note that creation of a
-	 * unique index actually requires two BTSpool objects.  We expect that the
-	 * second one (for dead tuples) won't get very full, so we give it only
-	 * work_mem.
+	 * run multiple index creations in parallel.  (A parallel build divides
+	 * it among the participants.)
+	 */
+	buildstate.spool = _bt_spoolinit(heap, index, indexInfo->ii_Unique,
+									 sortmem);
+
+	/*
+	 * If building a unique index, put dead tuples in a second spool to keep
+	 * them out of the uniqueness check.  We expect that the second spool
+	 * won't get very full, so we give it only work_mem.
 	 */
-	btKbytes = isdead ? work_mem : maintenance_work_mem;
+	if (indexInfo->ii_Unique)
+		buildstate.spool2 = _bt_spoolinit(heap, index, false, work_mem);
+
+	/* do the heap scan, or our share of it */
+	if (btleader == NULL)
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
+									   btbuildCallback, (void *) &buildstate);
+	else
+		reltuples = _bt_parallel_heapscan(&buildstate, btleader->btshared,
+										  index, indexInfo);
+
+	if (btleader == NULL)
+	{
+		/* okay, all heap tuples are indexed */
+		if (buildstate.spool2 && !buildstate.haveDead)
+		{
+			/* spool2 turns out to be unnecessary */
+			_bt_spooldestroy(buildstate.spool2);
+			buildstate.spool2 = NULL;
+		}
+
+		/*
+		 * Finish the build by (1) completing the sort of the spool file, (2)
+		 * inserting the sorted tuples into btree pages and (3) building the
+		 * upper levels.
+		 */
+		_bt_leafbuild(buildstate.spool, buildstate.spool2);
+	}
+	else
+	{
+		/*
+		 * Same, but merging in the workers' output; a worker may have found
+		 * dead tuples even if we didn't, so spool2 has to stay.  Then add
+		 * the workers' statistics to ours.
+		 */
+		_bt_parallel_leafbuild(btleader, &buildstate);
+		_bt_end_parallel(btleader, indexInfo,
+						 &reltuples, &buildstate.indtuples);
+	}
+
+	_bt_spooldestroy(buildstate.spool);
+	if (buildstate.spool2)
+		_bt_spooldestroy(buildstate.spool2);
+
+#ifdef BTREE_BUILD_STATS
+	if (log_btree_build_stats)
+	{
+		ShowUsage("BTREE BUILD STATS");
+		ResetUsage();
+	}
+#endif   /* BTREE_BUILD_STATS */
+
+	/*
+	 * Return statistics
+	 */
+	result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+
+	result->heap_tuples = reltuples;
+	result->index_tuples = buildstate.indtuples;
+
+	return result;
+}
+
+/*
+ * Per-tuple callback from IndexBuildHeapScan
+ */
+static void
+btbuildCallback(Relation index,
+				HeapTuple htup,
+				Datum *values,
+				bool *isnull,
+				bool tupleIsAlive,
+				void *state)
+{
+	BTBuildState *buildstate = (BTBuildState *) state;
+
+	/*
+	 * insert the index tuple into the appropriate spool file for subsequent
+	 * processing
+	 */
+	if (tupleIsAlive || buildstate->spool2 == NULL)
+		_bt_spool(buildstate->spool, &htup->t_self, values, isnull);
+	else
+	{
+		/* dead tuples are put into spool2 */
+		buildstate->haveDead = true;
+		_bt_spool(buildstate->spool2, &htup->t_self, values, isnull);
+	}
+
+	buildstate->indtuples += 1;
+}
+
+/*
+ * create and initialize a spool structure, with a sort area of btKbytes
+ */
+BTSpool *
+_bt_spoolinit(Relation heap, Relation index, bool isunique, int btKbytes)
+{
+	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
+
+	btspool->heap = heap;
+	btspool->index = index;
+	btspool->isunique = isunique;
 	btspool->sortstate = tuplesort_begin_index_btree(heap, index, isunique,
 													 btKbytes, false);
 
@@ -831,3 +1064,361 @@ _bt_load(BTWriteState *wstate, BTSpool *btspool, BTSpool *btspool2)
 		smgrimmedsync(wstate->index->rd_smgr, MAIN_FORKNUM);
 	}
 }
+
+
+/*
+ * Parallel build support.
+ */
+
+
+/*
+ * Create a parallel context and launch workers for a parallel btree build.
+ *
+ * request is the number of workers wanted.  Returns NULL if no worker could
+ * be launched, in which case the caller should build the index serially.
+ */
+static BTLeader *
+_bt_begin_parallel(Relation heap, Relation index, bool isunique, int request)
+{
+	ParallelContext *pcxt;
+	BTShared   *btshared;
+	BTLeader   *btleader;
+	char	   *queuespace;
+	int			nqueues = isunique ? 2 : 1;
+	int			nparticipants = request + 1;
+	int			i;
+
+	EnterParallelMode();
+	Assert(request > 0);
+	pcxt = CreateParallelContext(_bt_parallel_build_main, request);
+
+	/* Estimate space for our shared state, and for the tuple queues */
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(BTShared));
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   PARALLEL_BTREE_QUEUE_SIZE * nqueues * request);
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+
+	/* Initialize the shared state */
+	btshared = (BTShared *) shm_toc_allocate(pcxt->toc, sizeof(BTShared));
+	btshared->heaprelid = RelationGetRelid(heap);
+	btshared->indexrelid = RelationGetRelid(index);
+	btshared->isunique = isunique;
+	btshared->sortmem = Max(maintenance_work_mem / nparticipants, 64);
+	btshared->nblocks = RelationGetNumberOfBlocks(heap);
+	btshared->chunksize = Max(btshared->nblocks /
+							  (nparticipants * PARALLEL_BTREE_CHUNKS), 1);
+	SpinLockInit(&btshared->mutex);
+	btshared->nextblock = 0;
+	btshared->reltuples = 0;
+	btshared->indtuples = 0;
+	btshared->brokenhotchain = false;
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_BTREE_SHARED, btshared);
+
+	/* Create the queues, and become the receiver for each */
+	queuespace = shm_toc_allocate(pcxt->toc,
+							PARALLEL_BTREE_QUEUE_SIZE * nqueues * request);
+	for (i = 0; i < nqueues * request; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(queuespace + i * PARALLEL_BTREE_QUEUE_SIZE,
+						   (Size) PARALLEL_BTREE_QUEUE_SIZE);
+		shm_mq_set_receiver(mq, MyProc);
+	}
+	shm_toc_insert(pcxt->toc, PARALLEL_KEY_TUPLE_QUEUE, queuespace);
+
+	LaunchParallelWorkers(pcxt);
+
+	if (pcxt->nworkers_launched == 0)
+	{
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		return NULL;
+	}
+
+	btleader = (BTLeader *) palloc0(sizeof(BTLeader));
+	btleader->pcxt = pcxt;
+	btleader->btshared = btshared;
+	btleader->nworkers = pcxt->nworkers_launched;
+
+	/*
+	 * Attach to the queues of the workers that were launched, which are
+	 * always the first ones.  Passing the worker's handle makes a receive
+	 * return SHM_MQ_DETACHED if the worker dies before attaching.
+	 */
+	btleader->livequeues = (shm_mq_handle **)
+		palloc(btleader->nworkers * sizeof(shm_mq_handle *));
+	if (isunique)
+		btleader->deadqueues = (shm_mq_handle **)
+			palloc(btleader->nworkers * sizeof(shm_mq_handle *));
+	for (i = 0; i < btleader->nworkers; i++)
+	{
+		char	   *workerspace;
+
+		workerspace = queuespace + i * nqueues * PARALLEL_BTREE_QUEUE_SIZE;
+		btleader->livequeues[i] = shm_mq_attach((shm_mq *) workerspace,
+												pcxt->seg,
+												pcxt->worker[i].bgwhandle);
+		if (isunique)
+			btleader->deadqueues[i] =
+				shm_mq_attach((shm_mq *) (workerspace +
+										  PARALLEL_BTREE_QUEUE_SIZE),
+							  pcxt->seg,
+							  pcxt->worker[i].bgwhandle);
+	}
+
+	return btleader;
+}
+
+/*
+ * Scan chunks of the heap claimed from the shared state until there are no
+ * more, spooling index tuples into buildstate's spools.  Used by the leader
+ * and the workers alike.  Returns the number of heap tuples scanned.
+ */
+static double
+_bt_parallel_heapscan(BTBuildState *buildstate, BTShared *btshared,
+					  Relation index, IndexInfo *indexInfo)
+{
+	double		reltuples = 0;
+
+	for (;;)
+	{
+		BlockNumber startblock;
+		BlockNumber numblocks;
+
+		SpinLockAcquire(&btshared->mutex);
+		startblock = btshared->nextblock;
+		numblocks = Min(btshared->chunksize,
+						btshared->nblocks - Min(startblock, btshared->nblocks));
+		btshared->nextblock += numblocks;
+		SpinLockRelease(&btshared->mutex);
+
+		if (numblocks == 0)
+			break;
+
+		reltuples += IndexBuildHeapRangeScan(buildstate->heapRel, index,
+											 indexInfo, false, false,
+											 startblock, numblocks,
+											 btbuildCallback,
+											 (void *) buildstate);
+	}
+
+	return reltuples;
+}
+
+/*
+ * Leader's counterpart of _bt_leafbuild: finish the sort of our own spools,
+ * and build the btree from their output merged with the workers' streams.
+ */
+static void
+_bt_parallel_leafbuild(BTLeader *btleader, BTBuildState *buildstate)
+{
+	BTSpool    *spool = buildstate->spool;
+	BTSpool    *spool2 = buildstate->spool2;
+	BTSpool    *mergespool;
+	BTSpool    *mergespool2 = NULL;
+
+	tuplesort_performsort(spool->sortstate);
+	mergespool = _bt_spoolinit(spool->heap, spool->index, spool->isunique,
+							   btleader->btshared->sortmem);
+	tuplesort_attach_streams(mergespool->sortstate, btleader->nworkers,
+							 btleader->livequeues, spool->sortstate);
+
+	if (spool2 != NULL)
+	{
+		tuplesort_performsort(spool2->sortstate);
+		mergespool2 = _bt_spoolinit(spool2->heap, spool2->index, false,
+									work_mem);
+		tuplesort_attach_streams(mergespool2->sortstate, btleader->nworkers,
+								 btleader->deadqueues, spool2->sortstate);
+	}
+
+	_bt_leafbuild(mergespool, mergespool2);
+
+	_bt_spooldestroy(mergespool);
+	if (mergespool2)
+		_bt_spooldestroy(mergespool2);
+}
+
+/*
+ * Stream the sorted contents of a worker's spools to the leader, one index
+ * tuple per message.
+ *
+ * For a unique index, the leader merges the live and dead streams against
+ * each other in _bt_load, so it may want the next tuple of either one.  We
+ * must therefore never block on one queue while the other could make
+ * progress: we send without waiting, and sleep on our latch only when
+ * neither queue has room.  For the same reason each queue is detached as
+ * soon as its spool is exhausted, since that's how the leader learns that
+ * the stream is complete; otherwise it could be stuck waiting for the end
+ * of an empty dead-tuple stream while we wait for it to drain the live one.
+ */
+static void
+_bt_parallel_send(BTBuildState *buildstate, shm_mq_handle **queues)
+{
+	BTSpool    *spools[2];
+	IndexTuple	itup[2];
+	bool		should_free[2];
+	int			nspools = (buildstate->spool2 != NULL) ? 2 : 1;
+	int			i;
+
+	spools[0] = buildstate->spool;
+	spools[1] = buildstate->spool2;
+	for (i = 0; i < nspools; i++)
+	{
+		itup[i] = tuplesort_getindextuple(spools[i]->sortstate, true,
+										  &should_free[i]);
+		if (itup[i] == NULL)
+			shm_mq_detach(shm_mq_get_queue(queues[i]));
+	}
+
+	for (;;)
+	{
+		bool		pending = false;
+		bool		progress = false;
+
+		for (i = 0; i < nspools; i++)
+		{
+			shm_mq_result res;
+
+			if (itup[i] == NULL)
+				continue;
+			pending = true;
+
+			res = shm_mq_send(queues[i], IndexTupleSize(itup[i]), itup[i],
+							  true);
+			if (res == SHM_MQ_WOULD_BLOCK)
+				continue;
+
+			/*
+			 * If the leader went away, it must be erroring out, and will
+			 * terminate us shortly; there's no point in going on.
+			 */
+			if (res == SHM_MQ_DETACHED)
+				return;
+
+			if (should_free[i])
+				pfree(itup[i]);
+			itup[i] = tuplesort_getindextuple(spools[i]->sortstate, true,
+											  &should_free[i]);
+			if (itup[i] == NULL)
+				shm_mq_detach(shm_mq_get_queue(queues[i]));
+			progress = true;
+		}
+
+		if (!pending)
+			break;
+
+		if (!progress)
+		{
+			WaitLatch(MyLatch, WL_LATCH_SET, 0);
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+}
+
+/*
+ * Wait for the workers to finish, add their statistics to the leader's, and
+ * shut down parallel mode.  Must only be called once the workers' streams
+ * have been read to the end, since they can't finish before that.
+ */
+static void
+_bt_end_parallel(BTLeader *btleader, IndexInfo *indexInfo,
+				 double *reltuples, double *indtuples)
+{
+	BTShared   *btshared = btleader->btshared;
+
+	/* This also reports any error raised by a worker */
+	WaitForParallelWorkersToFinish(btleader->pcxt);
+
+	SpinLockAcquire(&btshared->mutex);
+	*reltuples += btshared->reltuples;
+	*indtuples += btshared->indtuples;
+	if (btshared->brokenhotchain)
+		indexInfo->ii_BrokenHotChain = true;
+	SpinLockRelease(&btshared->mutex);
+
+	DestroyParallelContext(btleader->pcxt);
+	ExitParallelMode();
+}
+
+/*
+ * Main entry point for a parallel btree build worker.
+ *
+ * The worker scans its share of the heap and sorts the resulting index
+ * tuples just like the leader does, then streams them to the leader.
+ */
+void
+_bt_parallel_build_main(dsm_segment *seg, shm_toc *toc)
+{
+	BTShared   *btshared;
+	char	   *queuespace;
+	shm_mq_handle *queues[2];
+	Relation	heapRel;
+	Relation	indexRel;
+	IndexInfo  *indexInfo;
+	BTBuildState buildstate;
+	double		reltuples;
+	int			nqueues;
+	int			i;
+
+	btshared = (BTShared *) shm_toc_lookup(toc, PARALLEL_KEY_BTREE_SHARED);
+	nqueues = btshared->isunique ? 2 : 1;
+
+	/* Become the sender of our queues */
+	queuespace = shm_toc_lookup(toc, PARALLEL_KEY_TUPLE_QUEUE);
+	queuespace += ParallelWorkerNumber * nqueues * PARALLEL_BTREE_QUEUE_SIZE;
+	for (i = 0; i < nqueues; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = (shm_mq *) (queuespace + i * PARALLEL_BTREE_QUEUE_SIZE);
+		shm_mq_set_sender(mq, MyProc);
+		queues[i] = shm_mq_attach(mq, seg, NULL);
+	}
+
+	/*
+	 * The leader holds a stronger lock than these, but since we're in its
+	 * lock group, we won't conflict with it.
+	 */
+	heapRel = heap_open(btshared->heaprelid, ShareLock);
+	indexRel = index_open(btshared->indexrelid, RowExclusiveLock);
+	indexInfo = BuildIndexInfo(indexRel);
+
+	buildstate.isUnique = btshared->isunique;
+	buildstate.haveDead = false;
+	buildstate.heapRel = heapRel;
+	buildstate.spool = _bt_spoolinit(heapRel, indexRel, btshared->isunique,
+									 btshared->sortmem);
+	buildstate.spool2 = NULL;
+	if (btshared->isunique)
+		buildstate.spool2 = _bt_spoolinit(heapRel, indexRel, false, work_mem);
+	buildstate.indtuples = 0;
+
+	reltuples = _bt_parallel_heapscan(&buildstate, btshared, indexRel,
+									  indexInfo);
+
+	/* Report our share of the statistics */
+	SpinLockAcquire(&btshared->mutex);
+	btshared->reltuples += reltuples;
+	btshared->indtuples += buildstate.indtuples;
+	if (indexInfo->ii_BrokenHotChain)
+		btshared->brokenhotchain = true;
+	SpinLockRelease(&btshared->mutex);
+
+	tuplesort_performsort(buildstate.spool->sortstate);
+	if (buildstate.spool2)
+		tuplesort_performsort(buildstate.spool2->sortstate);
+
+	_bt_parallel_send(&buildstate, queues);
+
+	_bt_spooldestroy(buildstate.spool);
+	if (buildstate.spool2)
+		_bt_spooldestroy(buildstate.spool2);
+
+	index_close(indexRel, RowExclusiveLock);
+	heap_close(heapRel, ShareLock);
+}
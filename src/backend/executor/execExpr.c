@@ -0,0 +1,1026 @@
+/*-------------------------------------------------------------------------
+ *
+ * execExpr.c
+ *	  Compile expression state trees into flat step programs, and run them
+ *
+ * ExecCompileExpr walks an ExprState tree built by ExecInitExpr and emits
+ * one ExprEvalStep per node it knows how to evaluate, in evaluation order,
+ * so that children always run before their parents.  The resulting program
+ * is executed by ExecInterpExpr, which becomes the root ExprState's evalfunc.
+ * Compared to recursive evaluation this avoids a function-pointer call and
+ * the associated isNull/isDone bookkeeping per node, deforms each input
+ * tuple once up front to the highest attribute any Var of the expression
+ * needs, and stores function arguments (including constants, which are
+ * stored once at compile time) directly into the FunctionCallInfoData they
+ * are passed in.
+ *
+ * Node types without a dedicated step are evaluated through their existing
+ * evalfunc by an EEOP_LEGACY step; ExecInitExpr compiles the children of
+ * such nodes separately, so most of an expression is covered even when it
+ * contains, say, a CASE.  Expressions that can return sets are never
+ * compiled, since the step machinery has no notion of isDone.
+ *
+ * As with the recursive evaluator, permission checks and function lookups
+ * are done on first execution rather than at initialization: the program's
+ * first run finishes setting up every function step and performs the
+ * one-time Var type checks, see ExecPrepareExprProgram.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/execExpr.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "catalog/objectaccess.h"
+#include "executor/execExpr.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "pgstat.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+
+/*
+ * Use computed-goto-based opcode dispatch when the compiler supports it;
+ * it lets the branch predictor learn per-opcode successor patterns, which a
+ * single switch statement's indirect jump can't.
+ */
+#if defined(__GNUC__)
+#define EEO_USE_COMPUTED_GOTO
+#endif
+
+#ifdef EEO_USE_COMPUTED_GOTO
+#define EEO_SWITCH()
+#define EEO_CASE(name)		CASE_##name:
+#define EEO_DISPATCH()		goto *dispatch_table[op->opcode]
+#else
+#define EEO_SWITCH()		starteval: switch ((ExprEvalOp) op->opcode)
+#define EEO_CASE(name)		case name:
+#define EEO_DISPATCH()		goto starteval
+#endif
+
+#define EEO_NEXT() \
+	do { \
+		op++; \
+		EEO_DISPATCH(); \
+	} while (0)
+
+#define EEO_JUMP(stepno) \
+	do { \
+		op = &program->steps[stepno]; \
+		EEO_DISPATCH(); \
+	} while (0)
+
+
+/* working state while compiling */
+typedef struct ExprCompileState
+{
+	ExprEvalProgram *program;
+	int			last_inner;		/* highest attnum referenced in each slot */
+	int			last_outer;
+	int			last_scan;
+} ExprCompileState;
+
+static bool ExecExprHasStep(Expr *node);
+static ExprEvalStep *ExprEvalPushStep(ExprEvalProgram *program,
+				 ExprEvalOp opcode, Datum *resv, bool *resnull);
+static void ExecCompileExprRec(ExprCompileState *cs, ExprState *state,
+				   Datum *resv, bool *resnull);
+static void ExecCompileFunc(ExprCompileState *cs, ExprState *state,
+				Oid funcid, Oid inputcollid, List *args,
+				Datum *resv, bool *resnull);
+static void ExecCompileBool(ExprCompileState *cs, BoolExprState *bstate,
+				Datum *resv, bool *resnull);
+static Datum ExecInterpExpr(ExprState *state, ExprContext *econtext,
+			   bool *isNull, ExprDoneCond *isDone);
+static void ExecPrepareExprProgram(ExprEvalProgram *program,
+					   ExprContext *econtext);
+static void ExecPrepareFunc(ExprEvalStep *op, MemoryContext mcxt);
+static void CheckVarSlotCompatibility(TupleTableSlot *slot, Var *variable);
+static void ExecEvalFuncExprFusage(ExprEvalStep *op);
+static void ExecEvalFuncExprStrictFusage(ExprEvalStep *op);
+
+
+/*
+ * ExecCompileExpr: compile the tree rooted at 'state' into a step program
+ *
+ * If the root node type has a step implementation and the expression can't
+ * return a set, build the program and redirect state->evalfunc to it;
+ * otherwise leave the state alone.  Must be called in the memory context
+ * the state tree lives in.
+ */
+void
+ExecCompileExpr(ExprState *state)
+{
+	Expr	   *node = state->expr;
+	ExprEvalProgram *program;
+	ExprCompileState cs;
+	ExprEvalStep *fetchsteps;
+	int			nfetch;
+	int			i;
+
+	/*
+	 * Lone leaf nodes already have cheap evalfuncs of their own, so there's
+	 * nothing to be gained by compiling them.
+	 */
+	if (IsA(node, Var) || IsA(node, Const) || !ExecExprHasStep(node))
+		return;
+	if (expression_returns_set((Node *) node))
+		return;
+
+	program = (ExprEvalProgram *) palloc0(sizeof(ExprEvalProgram));
+	program->mcxt = CurrentMemoryContext;
+	program->steps_alloc = 16;
+	program->steps = (ExprEvalStep *)
+		palloc(program->steps_alloc * sizeof(ExprEvalStep));
+
+	cs.program = program;
+	cs.last_inner = cs.last_outer = cs.last_scan = 0;
+
+	ExecCompileExprRec(&cs, state, &program->resvalue, &program->resnull);
+	ExprEvalPushStep(program, EEOP_DONE, NULL, NULL);
+
+	/*
+	 * Now that we know how many attributes of each slot the Vars need,
+	 * prepend the steps deforming them, and adjust the jump targets for the
+	 * steps that were inserted before them.
+	 */
+	nfetch = (cs.last_inner > 0) + (cs.last_outer > 0) + (cs.last_scan > 0);
+	if (nfetch > 0)
+	{
+		ExprEvalStep *steps;
+
+		steps = (ExprEvalStep *)
+			palloc((nfetch + program->nsteps) * sizeof(ExprEvalStep));
+		memcpy(steps + nfetch, program->steps,
+			   program->nsteps * sizeof(ExprEvalStep));
+		pfree(program->steps);
+		program->steps = steps;
+		program->nsteps += nfetch;
+		program->steps_alloc = program->nsteps;
+
+		for (i = nfetch; i < program->nsteps; i++)
+		{
+			switch (steps[i].opcode)
+			{
+				case EEOP_BOOL_AND_STEP_FIRST:
+				case EEOP_BOOL_AND_STEP:
+				case EEOP_BOOL_OR_STEP_FIRST:
+				case EEOP_BOOL_OR_STEP:
+					steps[i].d.boolexpr.jumpdone += nfetch;
+					break;
+				default:
+					break;
+			}
+		}
+
+		fetchsteps = steps;
+		if (cs.last_inner > 0)
+		{
+			fetchsteps->opcode = EEOP_INNER_FETCHSOME;
+			fetchsteps->d.fetch.last_var = cs.last_inner;
+			fetchsteps++;
+		}
+		if (cs.last_outer > 0)
+		{
+			fetchsteps->opcode = EEOP_OUTER_FETCHSOME;
+			fetchsteps->d.fetch.last_var = cs.last_outer;
+			fetchsteps++;
+		}
+		if (cs.last_scan > 0)
+		{
+			fetchsteps->opcode = EEOP_SCAN_FETCHSOME;
+			fetchsteps->d.fetch.last_var = cs.last_scan;
+			fetchsteps++;
+		}
+	}
+
+	state->program = program;
+	state->evalfunc = ExecInterpExpr;
+}
+
+/*
+ * Does the node type have a dedicated step implementation?
+ */
+static bool
+ExecExprHasStep(Expr *node)
+{
+	switch (nodeTag(node))
+	{
+		case T_Var:
+			/* whole-row and system columns go through slot_getattr etc */
+			return ((Var *) node)->varattno > 0;
+		case T_Const:
+		case T_FuncExpr:
+		case T_OpExpr:
+		case T_BoolExpr:
+		case T_RelabelType:
+			return true;
+		case T_NullTest:
+			return !((NullTest *) node)->argisrow;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Append a step to the program, returning a pointer to it.  The pointer is
+ * only valid until the next step is pushed.
+ */
+static ExprEvalStep *
+ExprEvalPushStep(ExprEvalProgram *program, ExprEvalOp opcode,
+				 Datum *resv, bool *resnull)
+{
+	ExprEvalStep *op;
+
+	if (program->nsteps >= program->steps_alloc)
+	{
+		program->steps_alloc *= 2;
+		program->steps = (ExprEvalStep *)
+			repalloc(program->steps,
+					 program->steps_alloc * sizeof(ExprEvalStep));
+	}
+
+	op = &program->steps[program->nsteps++];
+	memset(op, 0, sizeof(ExprEvalStep));
+	op->opcode = opcode;
+	op->resvalue = resv;
+	op->resnull = resnull;
+
+	return op;
+}
+
+/*
+ * Append the steps evaluating 'state' into *resv / *resnull.
+ */
+static void
+ExecCompileExprRec(ExprCompileState *cs, ExprState *state,
+				   Datum *resv, bool *resnull)
+{
+	Expr	   *node = state->expr;
+	ExprEvalStep *op;
+
+	/* Guard against stack overflow due to overly complex expressions */
+	check_stack_depth();
+
+	if (!ExecExprHasStep(node))
+	{
+		op = ExprEvalPushStep(cs->program, EEOP_LEGACY, resv, resnull);
+		op->d.legacy.state = state;
+		return;
+	}
+
+	switch (nodeTag(node))
+	{
+		case T_Var:
+			{
+				Var		   *variable = (Var *) node;
+				ExprEvalOp	opcode;
+
+				/* INDEX_VAR is handled by default case, as elsewhere */
+				switch (variable->varno)
+				{
+					case INNER_VAR:
+						opcode = EEOP_INNER_VAR;
+						cs->last_inner = Max(cs->last_inner,
+											 variable->varattno);
+						break;
+					case OUTER_VAR:
+						opcode = EEOP_OUTER_VAR;
+						cs->last_outer = Max(cs->last_outer,
+											 variable->varattno);
+						break;
+					default:
+						opcode = EEOP_SCAN_VAR;
+						cs->last_scan = Max(cs->last_scan,
+											variable->varattno);
+						break;
+				}
+				op = ExprEvalPushStep(cs->program, opcode, resv, resnull);
+				op->d.var.attnum = variable->varattno - 1;
+				op->d.var.var = variable;
+			}
+			break;
+		case T_Const:
+			{
+				Const	   *con = (Const *) node;
+
+				op = ExprEvalPushStep(cs->program, EEOP_CONST, resv, resnull);
+				op->d.constval.value = con->constvalue;
+				op->d.constval.isnull = con->constisnull;
+			}
+			break;
+		case T_FuncExpr:
+			{
+				FuncExpr   *funcexpr = (FuncExpr *) node;
+
+				ExecCompileFunc(cs, state,
+								funcexpr->funcid, funcexpr->inputcollid,
+								((FuncExprState *) state)->args,
+								resv, resnull);
+			}
+			break;
+		case T_OpExpr:
+			{
+				OpExpr	   *opexpr = (OpExpr *) node;
+
+				ExecCompileFunc(cs, state,
+								opexpr->opfuncid, opexpr->inputcollid,
+								((FuncExprState *) state)->args,
+								resv, resnull);
+			}
+			break;
+		case T_BoolExpr:
+			ExecCompileBool(cs, (BoolExprState *) state, resv, resnull);
+			break;
+		case T_RelabelType:
+			/* a no-op at runtime; evaluate the argument into our target */
+			ExecCompileExprRec(cs, ((GenericExprState *) state)->arg,
+							   resv, resnull);
+			break;
+		case T_NullTest:
+			{
+				NullTest   *ntest = (NullTest *) node;
+
+				ExecCompileExprRec(cs, ((NullTestState *) state)->arg,
+								   resv, resnull);
+				switch (ntest->nulltesttype)
+				{
+					case IS_NULL:
+						ExprEvalPushStep(cs->program, EEOP_NULLTEST_ISNULL,
+										 resv, resnull);
+						break;
+					case IS_NOT_NULL:
+						ExprEvalPushStep(cs->program, EEOP_NULLTEST_ISNOTNULL,
+										 resv, resnull);
+						break;
+					default:
+						elog(ERROR, "unrecognized nulltesttype: %d",
+							 (int) ntest->nulltesttype);
+				}
+			}
+			break;
+		default:
+			elog(ERROR, "unrecognized node type: %d", (int) nodeTag(node));
+			break;
+	}
+}
+
+/*
+ * Append the steps for a function or operator call.  Arguments are
+ * evaluated straight into the call's FunctionCallInfoData; constant
+ * arguments are stored there right away and need no step at all.
+ */
+static void
+ExecCompileFunc(ExprCompileState *cs, ExprState *state,
+				Oid funcid, Oid inputcollid, List *args,
+				Datum *resv, bool *resnull)
+{
+	int			nargs = list_length(args);
+	FmgrInfo   *finfo;
+	FunctionCallInfo fcinfo;
+	ExprEvalStep *op;
+	ListCell   *lc;
+	int			argno;
+
+	/*
+	 * Let the recursive evaluator raise the error for this at runtime, as it
+	 * always has; see init_fcache.
+	 */
+	if (nargs > FUNC_MAX_ARGS)
+	{
+		op = ExprEvalPushStep(cs->program, EEOP_LEGACY, resv, resnull);
+		op->d.legacy.state = state;
+		return;
+	}
+
+	finfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo));
+	fcinfo = (FunctionCallInfo) palloc0(sizeof(FunctionCallInfoData));
+	InitFunctionCallInfoData(*fcinfo, finfo, nargs, inputcollid, NULL, NULL);
+
+	argno = 0;
+	foreach(lc, args)
+	{
+		ExprState  *argstate = (ExprState *) lfirst(lc);
+
+		if (IsA(argstate->expr, Const))
+		{
+			Const	   *con = (Const *) argstate->expr;
+
+			fcinfo->arg[argno] = con->constvalue;
+			fcinfo->argnull[argno] = con->constisnull;
+		}
+		else
+			ExecCompileExprRec(cs, argstate,
+							   &fcinfo->arg[argno], &fcinfo->argnull[argno]);
+		argno++;
+	}
+
+	op = ExprEvalPushStep(cs->program, EEOP_FUNCEXPR, resv, resnull);
+	op->d.func.funcid = funcid;
+	op->d.func.expr = state->expr;
+	op->d.func.finfo = finfo;
+	op->d.func.fcinfo_data = fcinfo;
+	op->d.func.fn_addr = NULL;	/* filled in by ExecPrepareFunc */
+	op->d.func.nargs = nargs;
+}
+
+/*
+ * Append the steps for an AND, OR or NOT.
+ *
+ * Every argument of an AND/OR is evaluated into the BoolExpr's own result
+ * location, followed by a step that either short-circuits to the end, or
+ * remembers whether a NULL was seen.  The last such step computes the final
+ * result.
+ */
+static void
+ExecCompileBool(ExprCompileState *cs, BoolExprState *bstate,
+				Datum *resv, bool *resnull)
+{
+	BoolExpr   *boolexpr = (BoolExpr *) bstate->xprstate.expr;
+	int			nargs = list_length(bstate->args);
+	ExprEvalOp	firstop;
+	ExprEvalOp	midop;
+	ExprEvalOp	lastop;
+	List	   *adjust_jumps = NIL;
+	bool	   *anynull;
+	ListCell   *lc;
+	int			argno;
+
+	switch (boolexpr->boolop)
+	{
+		case AND_EXPR:
+			firstop = EEOP_BOOL_AND_STEP_FIRST;
+			midop = EEOP_BOOL_AND_STEP;
+			lastop = EEOP_BOOL_AND_STEP_LAST;
+			break;
+		case OR_EXPR:
+			firstop = EEOP_BOOL_OR_STEP_FIRST;
+			midop = EEOP_BOOL_OR_STEP;
+			lastop = EEOP_BOOL_OR_STEP_LAST;
+			break;
+		case NOT_EXPR:
+			Assert(nargs == 1);
+			ExecCompileExprRec(cs, (ExprState *) linitial(bstate->args),
+							   resv, resnull);
+			ExprEvalPushStep(cs->program, EEOP_BOOL_NOT_STEP, resv, resnull);
+			return;
+		default:
+			elog(ERROR, "unrecognized boolop: %d",
+				 (int) boolexpr->boolop);
+			return;				/* keep compiler quiet */
+	}
+
+	/* an AND or OR of a single argument is just that argument */
+	if (nargs == 1)
+	{
+		ExecCompileExprRec(cs, (ExprState *) linitial(bstate->args),
+						   resv, resnull);
+		return;
+	}
+
+	anynull = (bool *) palloc(sizeof(bool));
+
+	argno = 0;
+	foreach(lc, bstate->args)
+	{
+		ExprEvalStep *op;
+		ExprEvalOp	opcode;
+
+		ExecCompileExprRec(cs, (ExprState *) lfirst(lc), resv, resnull);
+
+		if (argno == 0)
+			opcode = firstop;
+		else if (argno == nargs - 1)
+			opcode = lastop;
+		else
+			opcode = midop;
+
+		op = ExprEvalPushStep(cs->program, opcode, resv, resnull);
+		op->d.boolexpr.anynull = anynull;
+		op->d.boolexpr.jumpdone = -1;	/* computed below */
+
+		adjust_jumps = lappend_int(adjust_jumps, cs->program->nsteps - 1);
+		argno++;
+	}
+
+	/* short-circuiting jumps go to the step after the last argument's */
+	foreach(lc, adjust_jumps)
+	{
+		ExprEvalStep *op = &cs->program->steps[lfirst_int(lc)];
+
+		op->d.boolexpr.jumpdone = cs->program->nsteps;
+	}
+	list_free(adjust_jumps);
+}
+
+
+/*
+ * ExecInterpExpr: evaluate a compiled expression
+ *
+ * This is the evalfunc of every compiled ExprState.
+ */
+static Datum
+ExecInterpExpr(ExprState *state, ExprContext *econtext,
+			   bool *isNull, ExprDoneCond *isDone)
+{
+	ExprEvalProgram *program = state->program;
+	ExprEvalStep *op;
+	TupleTableSlot *innerslot;
+	TupleTableSlot *outerslot;
+	TupleTableSlot *scanslot;
+
+#ifdef EEO_USE_COMPUTED_GOTO
+	/* must be kept in the same order as enum ExprEvalOp */
+	static const void *const dispatch_table[] = {
+		&&CASE_EEOP_DONE,
+		&&CASE_EEOP_INNER_FETCHSOME,
+		&&CASE_EEOP_OUTER_FETCHSOME,
+		&&CASE_EEOP_SCAN_FETCHSOME,
+		&&CASE_EEOP_INNER_VAR,
+		&&CASE_EEOP_OUTER_VAR,
+		&&CASE_EEOP_SCAN_VAR,
+		&&CASE_EEOP_CONST,
+		&&CASE_EEOP_FUNCEXPR,
+		&&CASE_EEOP_FUNCEXPR_STRICT,
+		&&CASE_EEOP_FUNCEXPR_STRICT_1,
+		&&CASE_EEOP_FUNCEXPR_STRICT_2,
+		&&CASE_EEOP_FUNCEXPR_FUSAGE,
+		&&CASE_EEOP_FUNCEXPR_STRICT_FUSAGE,
+		&&CASE_EEOP_BOOL_AND_STEP_FIRST,
+		&&CASE_EEOP_BOOL_AND_STEP,
+		&&CASE_EEOP_BOOL_AND_STEP_LAST,
+		&&CASE_EEOP_BOOL_OR_STEP_FIRST,
+		&&CASE_EEOP_BOOL_OR_STEP,
+		&&CASE_EEOP_BOOL_OR_STEP_LAST,
+		&&CASE_EEOP_BOOL_NOT_STEP,
+		&&CASE_EEOP_NULLTEST_ISNULL,
+		&&CASE_EEOP_NULLTEST_ISNOTNULL,
+		&&CASE_EEOP_LEGACY,
+		&&CASE_EEOP_LAST
+	};
+
+	StaticAssertStmt(EEOP_LAST + 1 == lengthof(dispatch_table),
+					 "dispatch_table out of whack with ExprEvalOp");
+#endif
+
+	if (isDone)
+		*isDone = ExprSingleResult;
+
+	/*
+	 * The recursive evaluator checks the stack depth in every function call;
+	 * once per program is enough here, as only EEOP_LEGACY steps recurse.
+	 */
+	check_stack_depth();
+
+	if (!program->prepared)
+		ExecPrepareExprProgram(program, econtext);
+
+	innerslot = econtext->ecxt_innertuple;
+	outerslot = econtext->ecxt_outertuple;
+	scanslot = econtext->ecxt_scantuple;
+
+	op = program->steps;
+
+	EEO_DISPATCH();
+
+	EEO_SWITCH()
+	{
+		EEO_CASE(EEOP_DONE)
+		{
+			*isNull = program->resnull;
+			return program->resvalue;
+		}
+
+		EEO_CASE(EEOP_INNER_FETCHSOME)
+		{
+			if (innerslot->tts_nvalid < op->d.fetch.last_var)
+				slot_getsomeattrs(innerslot, op->d.fetch.last_var);
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_OUTER_FETCHSOME)
+		{
+			if (outerslot->tts_nvalid < op->d.fetch.last_var)
+				slot_getsomeattrs(outerslot, op->d.fetch.last_var);
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_SCAN_FETCHSOME)
+		{
+			if (scanslot->tts_nvalid < op->d.fetch.last_var)
+				slot_getsomeattrs(scanslot, op->d.fetch.last_var);
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_INNER_VAR)
+		{
+			int			attnum = op->d.var.attnum;
+
+			Assert(attnum >= 0 && attnum < innerslot->tts_nvalid);
+			*op->resvalue = innerslot->tts_values[attnum];
+			*op->resnull = innerslot->tts_isnull[attnum];
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_OUTER_VAR)
+		{
+			int			attnum = op->d.var.attnum;
+
+			Assert(attnum >= 0 && attnum < outerslot->tts_nvalid);
+			*op->resvalue = outerslot->tts_values[attnum];
+			*op->resnull = outerslot->tts_isnull[attnum];
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_SCAN_VAR)
+		{
+			int			attnum = op->d.var.attnum;
+
+			Assert(attnum >= 0 && attnum < scanslot->tts_nvalid);
+			*op->resvalue = scanslot->tts_values[attnum];
+			*op->resnull = scanslot->tts_isnull[attnum];
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_CONST)
+		{
+			*op->resvalue = op->d.constval.value;
+			*op->resnull = op->d.constval.isnull;
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_FUNCEXPR)
+		{
+			FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
+
+			fcinfo->isnull = false;
+			*op->resvalue = (op->d.func.fn_addr) (fcinfo);
+			*op->resnull = fcinfo->isnull;
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_FUNCEXPR_STRICT)
+		{
+			FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
+			int			argno;
+
+			/* strict function, so check for NULL args */
+			for (argno = 0; argno < op->d.func.nargs; argno++)
+			{
+				if (fcinfo->argnull[argno])
+				{
+					*op->resvalue = (Datum) 0;
+					*op->resnull = true;
+					EEO_NEXT();
+				}
+			}
+			fcinfo->isnull = false;
+			*op->resvalue = (op->d.func.fn_addr) (fcinfo);
+			*op->resnull = fcinfo->isnull;
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_FUNCEXPR_STRICT_1)
+		{
+			FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
+
+			if (fcinfo->argnull[0])
+			{
+				*op->resvalue = (Datum) 0;
+				*op->resnull = true;
+				EEO_NEXT();
+			}
+			fcinfo->isnull = false;
+			*op->resvalue = (op->d.func.fn_addr) (fcinfo);
+			*op->resnull = fcinfo->isnull;
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_FUNCEXPR_STRICT_2)
+		{
+			FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
+
+			if (fcinfo->argnull[0] || fcinfo->argnull[1])
+			{
+				*op->resvalue = (Datum) 0;
+				*op->resnull = true;
+				EEO_NEXT();
+			}
+			fcinfo->isnull = false;
+			*op->resvalue = (op->d.func.fn_addr) (fcinfo);
+			*op->resnull = fcinfo->isnull;
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_FUNCEXPR_FUSAGE)
+		{
+			ExecEvalFuncExprFusage(op);
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_FUNCEXPR_STRICT_FUSAGE)
+		{
+			ExecEvalFuncExprStrictFusage(op);
+			EEO_NEXT();
+		}
+
+		/*
+		 * If any of the clauses is FALSE, the AND result is FALSE regardless
+		 * of the states of the rest of the clauses, so we can stop evaluating
+		 * and return FALSE immediately.  If none are FALSE and one or more is
+		 * NULL, we return NULL; otherwise we return TRUE.  See ExecEvalAnd.
+		 */
+		EEO_CASE(EEOP_BOOL_AND_STEP_FIRST)
+		{
+			*op->d.boolexpr.anynull = false;
+
+			/* FALL THROUGH to EEOP_BOOL_AND_STEP */
+		}
+
+		EEO_CASE(EEOP_BOOL_AND_STEP)
+		{
+			if (*op->resnull)
+				*op->d.boolexpr.anynull = true;
+			else if (!DatumGetBool(*op->resvalue))
+			{
+				/* result is already set to FALSE, need not change it */
+				EEO_JUMP(op->d.boolexpr.jumpdone);
+			}
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_BOOL_AND_STEP_LAST)
+		{
+			if (*op->resnull)
+			{
+				/* result is already set to NULL, need not change it */
+			}
+			else if (!DatumGetBool(*op->resvalue))
+			{
+				/* result is already set to FALSE, need not change it */
+			}
+			else if (*op->d.boolexpr.anynull)
+			{
+				*op->resvalue = (Datum) 0;
+				*op->resnull = true;
+			}
+			else
+			{
+				/* result is already set to TRUE, need not change it */
+			}
+			EEO_NEXT();
+		}
+
+		/*
+		 * If any of the clauses is TRUE, the OR result is TRUE regardless of
+		 * the states of the rest of the clauses, so we can stop evaluating
+		 * and return TRUE immediately.  If none are TRUE and one or more is
+		 * NULL, we return NULL; otherwise we return FALSE.  See ExecEvalOr.
+		 */
+		EEO_CASE(EEOP_BOOL_OR_STEP_FIRST)
+		{
+			*op->d.boolexpr.anynull = false;
+
+			/* FALL THROUGH to EEOP_BOOL_OR_STEP */
+		}
+
+		EEO_CASE(EEOP_BOOL_OR_STEP)
+		{
+			if (*op->resnull)
+				*op->d.boolexpr.anynull = true;
+			else if (DatumGetBool(*op->resvalue))
+			{
+				/* result is already set to TRUE, need not change it */
+				EEO_JUMP(op->d.boolexpr.jumpdone);
+			}
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_BOOL_OR_STEP_LAST)
+		{
+			if (*op->resnull)
+			{
+				/* result is already set to NULL, need not change it */
+			}
+			else if (DatumGetBool(*op->resvalue))
+			{
+				/* result is already set to TRUE, need not change it */
+			}
+			else if (*op->d.boolexpr.anynull)
+			{
+				*op->resvalue = (Datum) 0;
+				*op->resnull = true;
+			}
+			else
+			{
+				/* result is already set to FALSE, need not change it */
+			}
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_BOOL_NOT_STEP)
+		{
+			/* a NULL input yields a NULL result, which is already set */
+			if (!*op->resnull)
+				*op->resvalue = BoolGetDatum(!DatumGetBool(*op->resvalue));
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_NULLTEST_ISNULL)
+		{
+			*op->resvalue = BoolGetDatum(*op->resnull);
+			*op->resnull = false;
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_NULLTEST_ISNOTNULL)
+		{
+			*op->resvalue = BoolGetDatum(!*op->resnull);
+			*op->resnull = false;
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_LEGACY)
+		{
+			*op->resvalue = ExecEvalExpr(op->d.legacy.state, econtext,
+										 op->resnull, NULL);
+			EEO_NEXT();
+		}
+
+		EEO_CASE(EEOP_LAST)
+		{
+			/* unreachable */
+			Assert(false);
+			elog(ERROR, "unrecognized expression step opcode: %d",
+				 op->opcode);
+		}
+	}
+
+	/* keep compiler quiet */
+	*isNull = true;
+	return (Datum) 0;
+}
+
+/*
+ * Do the work the recursive evaluator does on the first execution of each
+ * node: check that Vars still match the slots' tuple descriptors, and look
+ * up the functions to call.  Function steps are switched to their final
+ * opcode here.
+ */
+static void
+ExecPrepareExprProgram(ExprEvalProgram *program, ExprContext *econtext)
+{
+	int			i;
+
+	for (i = 0; i < program->nsteps; i++)
+	{
+		ExprEvalStep *op = &program->steps[i];
+
+		switch (op->opcode)
+		{
+			case EEOP_INNER_VAR:
+				CheckVarSlotCompatibility(econtext->ecxt_innertuple,
+										  op->d.var.var);
+				break;
+			case EEOP_OUTER_VAR:
+				CheckVarSlotCompatibility(econtext->ecxt_outertuple,
+										  op->d.var.var);
+				break;
+			case EEOP_SCAN_VAR:
+				CheckVarSlotCompatibility(econtext->ecxt_scantuple,
+										  op->d.var.var);
+				break;
+			case EEOP_FUNCEXPR:
+				ExecPrepareFunc(op, program->mcxt);
+				break;
+			default:
+				break;
+		}
+	}
+
+	program->prepared = true;
+}
+
+/*
+ * Finish setting up a function call step; cf. init_fcache.
+ */
+static void
+ExecPrepareFunc(ExprEvalStep *op, MemoryContext mcxt)
+{
+	Oid			funcid = op->d.func.funcid;
+	FmgrInfo   *finfo = op->d.func.finfo;
+	AclResult	aclresult;
+
+	/* Check permission to call function */
+	aclresult = pg_proc_aclcheck(funcid, GetUserId(), ACL_EXECUTE);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, ACL_KIND_PROC, get_func_name(funcid));
+	InvokeFunctionExecuteHook(funcid);
+
+	/* Set up the primary fmgr lookup information */
+	fmgr_info_cxt(funcid, finfo, mcxt);
+	fmgr_info_set_expr((Node *) op->d.func.expr, finfo);
+	op->d.func.fn_addr = finfo->fn_addr;
+
+	/* should have been caught by expression_returns_set */
+	if (finfo->fn_retset)
+		elog(ERROR, "set-valued function called in context that cannot accept a set");
+
+	if (pgstat_track_functions <= finfo->fn_stats)
+	{
+		if (finfo->fn_strict && op->d.func.nargs == 1)
+			op->opcode = EEOP_FUNCEXPR_STRICT_1;
+		else if (finfo->fn_strict && op->d.func.nargs == 2)
+			op->opcode = EEOP_FUNCEXPR_STRICT_2;
+		else if (finfo->fn_strict && op->d.func.nargs > 0)
+			op->opcode = EEOP_FUNCEXPR_STRICT;
+		else
+			op->opcode = EEOP_FUNCEXPR;
+	}
+	else
+	{
+		if (finfo->fn_strict && op->d.func.nargs > 0)
+			op->opcode = EEOP_FUNCEXPR_STRICT_FUSAGE;
+		else
+			op->opcode = EEOP_FUNCEXPR_FUSAGE;
+	}
+}
+
+/*
+ * Check that a Var still matches the slot it will be fetched from; this is
+ * the one-time check done by ExecEvalScalarVar.
+ */
+static void
+CheckVarSlotCompatibility(TupleTableSlot *slot, Var *variable)
+{
+	TupleDesc	slot_tupdesc = slot->tts_tupleDescriptor;
+	AttrNumber	attnum = variable->varattno;
+	Form_pg_attribute attr;
+
+	Assert(attnum > 0);
+
+	if (attnum > slot_tupdesc->natts)	/* should never happen */
+		elog(ERROR, "attribute number %d exceeds number of columns %d",
+			 attnum, slot_tupdesc->natts);
+
+	attr = slot_tupdesc->attrs[attnum - 1];
+
+	/* can't check type if dropped, since atttypid is probably 0 */
+	if (!attr->attisdropped)
+	{
+		if (variable->vartype != attr->atttypid)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("attribute %d has wrong type", attnum),
+					 errdetail("Table has type %s, but query expects %s.",
+							   format_type_be(attr->atttypid),
+							   format_type_be(variable->vartype))));
+	}
+}
+
+/*
+ * Function call steps used when track_functions is collecting statistics
+ * for the function; kept out of line since that's the uncommon case.
+ */
+static void
+ExecEvalFuncExprFusage(ExprEvalStep *op)
+{
+	FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
+	PgStat_FunctionCallUsage fcusage;
+
+	pgstat_init_function_usage(fcinfo, &fcusage);
+
+	fcinfo->isnull = false;
+	*op->resvalue = (op->d.func.fn_addr) (fcinfo);
+	*op->resnull = fcinfo->isnull;
+
+	pgstat_end_function_usage(&fcusage, true);
+}
+
+static void
+ExecEvalFuncExprStrictFusage(ExprEvalStep *op)
+{
+	FunctionCallInfo fcinfo = op->d.func.fcinfo_data;
+	int			argno;
+
+	/* strict function, so check for NULL args */
+	for (argno = 0; argno < op->d.func.nargs; argno++)
+	{
+		if (fcinfo->argnull[argno])
+		{
+			*op->resvalue = (Datum) 0;
+			*op->resnull = true;
+			return;
+		}
+	}
+
+	ExecEvalFuncExprFusage(op);
+}
@@ -20,15 +20,33 @@
 
 #include "executor/executor.h"
 #include "miscadmin.h"
+#include "utils/hashutils.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 
 
-static TupleHashTable CurTupleHashTable = NULL;
+static uint32 TupleHashTableHash(struct tuplehash_hash *tb,
+				   const TupleHashEntry entry);
+static int TupleHashTableMatch(struct tuplehash_hash *tb,
+					const TupleHashEntry entry1,
+					const TupleHashEntry entry2);
 
-static uint32 TupleHashTableHash(const void *key, Size keysize);
-static int TupleHashTableMatch(const void *key1, const void *key2,
-					Size keysize);
+/*
+ * Define parameters for tuple hash table code generation.  The interface is
+ * *also* declared in execnodes.h (to generate the types, which are
+ * externally visible).
+ */
+#define SH_PREFIX tuplehash
+#define SH_ELEMENT_TYPE TupleHashBucketData
+#define SH_KEY_TYPE TupleHashEntry
+#define SH_KEY entry
+#define SH_HASH_KEY(tb, key) TupleHashTableHash(tb, key)
+#define SH_EQUAL(tb, a, b) (TupleHashTableMatch(tb, a, b) == 0)
+#define SH_SCOPE extern
+#define SH_STORE_HASH
+#define SH_GET_HASH(tb, a) a->hash
+#define SH_DEFINE
+#include "lib/simplehash.h"
 
 
 /*****************************************************************************
@@ -263,6 +281,13 @@ execTuplesHashPrepare(int numCols,
  *	entrysize: size of each entry (at least sizeof(TupleHashEntryData))
  *	tablecxt: memory context in which to store table and table entries
  *	tempcxt: short-lived context for evaluation hash and comparison functions
+ *	hash_iv: initial value mixed into every hash value
+ *
+ * Tables whose contents may be read out in hash order and inserted into
+ * another table (say, a hash aggregate below a hashed SubPlan) must not hash
+ * identically, or the second table's linear probing degenerates; callers
+ * therefore pass a value that differs from table to table, such as their
+ * plan node's ID.
  *
  * The function arrays may be made with execTuplesHashPrepare().  Note they
  * are not cross-type functions, but expect to see the table datatype(s)
@@ -276,10 +301,10 @@ BuildTupleHashTable(int numCols, AttrNumber *keyColIdx,
 					FmgrInfo *eqfunctions,
 					FmgrInfo *hashfunctions,
 					long nbuckets, Size entrysize,
-					MemoryContext tablecxt, MemoryContext tempcxt)
+					MemoryContext tablecxt, MemoryContext tempcxt,
+					uint32 hash_iv)
 {
 	TupleHashTable hashtable;
-	HASHCTL		hash_ctl;
 
 	Assert(nbuckets > 0);
 	Assert(entrysize >= sizeof(TupleHashEntryData));
@@ -301,16 +326,10 @@ BuildTupleHashTable(int numCols, AttrNumber *keyColIdx,
 	hashtable->inputslot = NULL;
 	hashtable->in_hash_funcs = NULL;
 	hashtable->cur_eq_funcs = NULL;
+	hashtable->hash_iv = murmurhash32(hash_iv);
 
-	MemSet(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(TupleHashEntryData);
-	hash_ctl.entrysize = entrysize;
-	hash_ctl.hash = TupleHashTableHash;
-	hash_ctl.match = TupleHashTableMatch;
-	hash_ctl.hcxt = tablecxt;
-	hashtable->hashtab = hash_create("TupleHashTable", nbuckets,
-									 &hash_ctl,
-					HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+	hashtable->hashtab = tuplehash_create(tablecxt, (uint32) nbuckets,
+										  hashtable);
 
 	return hashtable;
 }
@@ -331,10 +350,9 @@ TupleHashEntry
 LookupTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 					 bool *isnew)
 {
+	TupleHashBucketData *bucket;
 	TupleHashEntry entry;
 	MemoryContext oldContext;
-	TupleHashTable saveCurHT;
-	TupleHashEntryData dummy;
 	bool		found;
 
 	/* If first time through, clone the input slot to make table slot */
@@ -356,53 +374,45 @@ LookupTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 	/* Need to run the hash functions in short-lived context */
 	oldContext = MemoryContextSwitchTo(hashtable->tempcxt);
 
-	/*
-	 * Set up data needed by hash and match functions
-	 *
-	 * We save and restore CurTupleHashTable just in case someone manages to
-	 * invoke this code re-entrantly.
-	 */
+	/* Set up data needed by hash and match functions */
 	hashtable->inputslot = slot;
 	hashtable->in_hash_funcs = hashtable->tab_hash_funcs;
 	hashtable->cur_eq_funcs = hashtable->tab_eq_funcs;
 
-	saveCurHT = CurTupleHashTable;
-	CurTupleHashTable = hashtable;
-
-	/* Search the hash table */
-	dummy.firstTuple = NULL;	/* flag to reference inputslot */
-	entry = (TupleHashEntry) hash_search(hashtable->hashtab,
-										 &dummy,
-										 isnew ? HASH_ENTER : HASH_FIND,
-										 &found);
-
+	/*
+	 * Search the hash table.  A NULL key stands for the tuple in inputslot,
+	 * which avoids materializing virtual input tuples unless they actually
+	 * need to get copied into the table.
+	 */
 	if (isnew)
 	{
+		bucket = tuplehash_insert(hashtable->hashtab, NULL, &found);
+
 		if (found)
 		{
 			/* found pre-existing entry */
+			entry = bucket->entry;
 			*isnew = false;
 		}
 		else
 		{
 			/*
-			 * created new entry
-			 *
-			 * Zero any caller-requested space in the entry.  (This zaps the
-			 * "key data" dynahash.c copied into the new entry, but we don't
-			 * care since we're about to overwrite it anyway.)
+			 * created new bucket; make its entry, zeroing any caller-requested
+			 * space, and copy the first tuple into the table context
 			 */
-			MemSet(entry, 0, hashtable->entrysize);
-
-			/* Copy the first tuple into the table context */
 			MemoryContextSwitchTo(hashtable->tablecxt);
+			entry = (TupleHashEntry) palloc0(hashtable->entrysize);
 			entry->firstTuple = ExecCopySlotMinimalTuple(slot);
+			bucket->entry = entry;
 
 			*isnew = true;
 		}
 	}
-
-	CurTupleHashTable = saveCurHT;
+	else
+	{
+		bucket = tuplehash_lookup(hashtable->hashtab, NULL);
+		entry = bucket ? bucket->entry : NULL;
+	}
 
 	MemoryContextSwitchTo(oldContext);
 
@@ -423,70 +433,49 @@ FindTupleHashEntry(TupleHashTable hashtable, TupleTableSlot *slot,
 				   FmgrInfo *eqfunctions,
 				   FmgrInfo *hashfunctions)
 {
-	TupleHashEntry entry;
+	TupleHashBucketData *bucket;
 	MemoryContext oldContext;
-	TupleHashTable saveCurHT;
-	TupleHashEntryData dummy;
 
 	/* Need to run the hash functions in short-lived context */
 	oldContext = MemoryContextSwitchTo(hashtable->tempcxt);
 
-	/*
-	 * Set up data needed by hash and match functions
-	 *
-	 * We save and restore CurTupleHashTable just in case someone manages to
-	 * invoke this code re-entrantly.
-	 */
+	/* Set up data needed by hash and match functions */
 	hashtable->inputslot = slot;
 	hashtable->in_hash_funcs = hashfunctions;
 	hashtable->cur_eq_funcs = eqfunctions;
 
-	saveCurHT = CurTupleHashTable;
-	CurTupleHashTable = hashtable;
-
-	/* Search the hash table */
-	dummy.firstTuple = NULL;	/* flag to reference inputslot */
-	entry = (TupleHashEntry) hash_search(hashtable->hashtab,
-										 &dummy,
-										 HASH_FIND,
-										 NULL);
-
-	CurTupleHashTable = saveCurHT;
+	/* Search the hash table; a NULL key stands for the inputslot */
+	bucket = tuplehash_lookup(hashtable->hashtab, NULL);
 
 	MemoryContextSwitchTo(oldContext);
 
-	return entry;
+	return bucket ? bucket->entry : NULL;
 }
 
 /*
  * Compute the hash value for a tuple
  *
- * The passed-in key is a pointer to TupleHashEntryData.  In an actual hash
- * table entry, the firstTuple field points to a tuple (in MinimalTuple
- * format).  LookupTupleHashEntry sets up a dummy TupleHashEntryData with a
- * NULL firstTuple field --- that cues us to look at the inputslot instead.
- * This convention avoids the need to materialize virtual input tuples unless
- * they actually need to get copied into the table.
- *
- * CurTupleHashTable must be set before calling this, since dynahash.c
- * doesn't provide any API that would let us get at the hashtable otherwise.
+ * The passed-in key is a TupleHashEntry.  In an actual hash table entry, the
+ * firstTuple field points to a tuple (in MinimalTuple format).  Lookups pass
+ * a NULL key instead --- that cues us to look at the inputslot.  This
+ * convention avoids the need to materialize virtual input tuples unless they
+ * actually need to get copied into the table.
  *
  * Also, the caller must select an appropriate memory context for running
- * the hash functions. (dynahash.c doesn't change CurrentMemoryContext.)
+ * the hash functions. (simplehash.h doesn't change CurrentMemoryContext.)
  */
 static uint32
-TupleHashTableHash(const void *key, Size keysize)
+TupleHashTableHash(struct tuplehash_hash *tb, const TupleHashEntry entry)
 {
-	MinimalTuple tuple = ((const TupleHashEntryData *) key)->firstTuple;
-	TupleTableSlot *slot;
-	TupleHashTable hashtable = CurTupleHashTable;
+	TupleHashTable hashtable = (TupleHashTable) tb->private_data;
 	int			numCols = hashtable->numCols;
 	AttrNumber *keyColIdx = hashtable->keyColIdx;
+	TupleTableSlot *slot;
 	FmgrInfo   *hashfunctions;
-	uint32		hashkey = 0;
+	uint32		hashkey = hashtable->hash_iv;
 	int			i;
 
-	if (tuple == NULL)
+	if (entry == NULL)
 	{
 		/* Process the current input tuple for the table */
 		slot = hashtable->inputslot;
@@ -495,9 +484,9 @@ TupleHashTableHash(const void *key, Size keysize)
 	else
 	{
 		/* Process a tuple already stored in the table */
-		/* (this case never actually occurs in current dynahash.c code) */
+		/* (this case never actually occurs, since we store the hashes) */
 		slot = hashtable->tableslot;
-		ExecStoreMinimalTuple(tuple, slot, false);
+		ExecStoreMinimalTuple(entry->firstTuple, slot, false);
 		hashfunctions = hashtable->tab_hash_funcs;
 	}
 
@@ -522,42 +511,41 @@ TupleHashTableHash(const void *key, Size keysize)
 		}
 	}
 
-	return hashkey;
+	/*
+	 * The rotate-and-xor combination above leaves the low-order bits poorly
+	 * mixed when there are several key columns or the datatype hash
+	 * functions are weak, and the table uses exactly those bits to pick a
+	 * bucket.  Finalize the hash so that they depend on the whole key.
+	 */
+	return murmurhash32(hashkey);
 }
 
 /*
  * See whether two tuples (presumably of the same hash value) match
  *
- * As above, the passed pointers are pointers to TupleHashEntryData.
- *
- * CurTupleHashTable must be set before calling this, since dynahash.c
- * doesn't provide any API that would let us get at the hashtable otherwise.
+ * As above, the passed keys are TupleHashEntry pointers, NULL standing for
+ * the inputslot.
  *
  * Also, the caller must select an appropriate memory context for running
- * the compare functions.  (dynahash.c doesn't change CurrentMemoryContext.)
+ * the compare functions.  (simplehash.h doesn't change CurrentMemoryContext.)
  */
 static int
-TupleHashTableMatch(const void *key1, const void *key2, Size keysize)
+TupleHashTableMatch(struct tuplehash_hash *tb, const TupleHashEntry entry1,
+					const TupleHashEntry entry2)
 {
-	MinimalTuple tuple1 = ((const TupleHashEntryData *) key1)->firstTuple;
-
-#ifdef USE_ASSERT_CHECKING
-	MinimalTuple tuple2 = ((const TupleHashEntryData *) key2)->firstTuple;
-#endif
+	TupleHashTable hashtable = (TupleHashTable) tb->private_data;
 	TupleTableSlot *slot1;
 	TupleTableSlot *slot2;
-	TupleHashTable hashtable = CurTupleHashTable;
 
 	/*
-	 * We assume that dynahash.c will only ever call us with the first
-	 * argument being an actual table entry, and the second argument being
-	 * LookupTupleHashEntry's dummy TupleHashEntryData.  The other direction
-	 * could be supported too, but is not currently used by dynahash.c.
+	 * simplehash.h always calls us with the first argument being an actual
+	 * table entry, and the second argument being the lookup key, which is
+	 * always NULL.
 	 */
-	Assert(tuple1 != NULL);
+	Assert(entry1 != NULL);
 	slot1 = hashtable->tableslot;
-	ExecStoreMinimalTuple(tuple1, slot1, false);
-	Assert(tuple2 == NULL);
+	ExecStoreMinimalTuple(entry1->firstTuple, slot1, false);
+	Assert(entry2 == NULL);
 	slot2 = hashtable->inputslot;
 
 	/* For crosstype comparisons, the inputslot must be first */
@@ -41,6 +41,7 @@
 #include "access/tupconvert.h"
 #include "catalog/objectaccess.h"
 #include "catalog/pg_type.h"
+#include "executor/execExpr.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSubplan.h"
 #include "funcapi.h"
@@ -89,6 +90,7 @@ static Datum ExecEvalParamExec(ExprState *exprstate, ExprContext *econtext,
 				  bool *isNull, ExprDoneCond *isDone);
 static Datum ExecEvalParamExtern(ExprState *exprstate, ExprContext *econtext,
 					bool *isNull, ExprDoneCond *isDone);
+static ExprState *ExecInitExprRec(Expr *node, PlanState *parent);
 static void init_fcache(Oid foid, Oid input_collation, FuncExprState *fcache,
 			MemoryContext fcacheCxt, bool needDescForSets);
 static void ShutdownFuncExpr(Datum arg);
@@ -4447,12 +4449,52 @@ ExecEvalExprSwitchContext(ExprState *expression,
  * 'parent' may be NULL if we are preparing an expression that is not
  * associated with a plan tree.  (If so, it can't have aggs or subplans.)
  * This case should usually come through ExecPrepareExpr, not directly here.
+ *
+ * Each returned state tree (each list member's, for a List) is also handed
+ * to ExecCompileExpr, which may turn it into a flat step program; see
+ * executor/execExpr.h.
  */
 ExprState *
 ExecInitExpr(Expr *node, PlanState *parent)
 {
 	ExprState  *state;
 
+	if (node == NULL)
+		return NULL;
+
+	/* compile each member of a list separately, they're evaluated so */
+	if (IsA(node, List))
+	{
+		List	   *outlist = NIL;
+		ListCell   *l;
+
+		foreach(l, (List *) node)
+		{
+			outlist = lappend(outlist,
+							  ExecInitExpr((Expr *) lfirst(l), parent));
+		}
+		return (ExprState *) outlist;
+	}
+
+	state = ExecInitExprRec(node, parent);
+	ExecCompileExpr(state);
+
+	return state;
+}
+
+/*
+ * ExecInitExprRec: guts of ExecInitExpr
+ *
+ * Node types that ExecCompileExpr can compile initialize their children
+ * with this, so that the children become part of the parent's program.
+ * Other node types use ExecInitExpr, making each child the root of a
+ * program of its own.
+ */
+static ExprState *
+ExecInitExprRec(Expr *node, PlanState *parent)
+{
+	ExprState  *state;
+
 	if (node == NULL)
 		return NULL;
 
@@ -4618,7 +4660,7 @@ ExecInitExpr(Expr *node, PlanState *parent)
 
 				fstate->xprstate.evalfunc = (ExprStateEvalFunc) ExecEvalFunc;
 				fstate->args = (List *)
-					ExecInitExpr((Expr *) funcexpr->args, parent);
+					ExecInitExprRec((Expr *) funcexpr->args, parent);
 				fstate->func.fn_oid = InvalidOid;		/* not initialized */
 				state = (ExprState *) fstate;
 			}
@@ -4630,7 +4672,7 @@ ExecInitExpr(Expr *node, PlanState *parent)
 
 				fstate->xprstate.evalfunc = (ExprStateEvalFunc) ExecEvalOper;
 				fstate->args = (List *)
-					ExecInitExpr((Expr *) opexpr->args, parent);
+					ExecInitExprRec((Expr *) opexpr->args, parent);
 				fstate->func.fn_oid = InvalidOid;		/* not initialized */
 				state = (ExprState *) fstate;
 			}
@@ -4694,7 +4736,7 @@ ExecInitExpr(Expr *node, PlanState *parent)
 						break;
 				}
 				bstate->args = (List *)
-					ExecInitExpr((Expr *) boolexpr->args, parent);
+					ExecInitExprRec((Expr *) boolexpr->args, parent);
 				state = (ExprState *) bstate;
 			}
 			break;
@@ -4756,7 +4798,7 @@ ExecInitExpr(Expr *node, PlanState *parent)
 				GenericExprState *gstate = makeNode(GenericExprState);
 
 				gstate->xprstate.evalfunc = (ExprStateEvalFunc) ExecEvalRelabelType;
-				gstate->arg = ExecInitExpr(relabel->arg, parent);
+				gstate->arg = ExecInitExprRec(relabel->arg, parent);
 				state = (ExprState *) gstate;
 			}
 			break;
@@ -5093,7 +5135,10 @@ ExecInitExpr(Expr *node, PlanState *parent)
 				NullTestState *nstate = makeNode(NullTestState);
 
 				nstate->xprstate.evalfunc = (ExprStateEvalFunc) ExecEvalNullTest;
-				nstate->arg = ExecInitExpr(ntest->arg, parent);
+				if (ntest->argisrow)
+					nstate->arg = ExecInitExpr(ntest->arg, parent);
+				else
+					nstate->arg = ExecInitExprRec(ntest->arg, parent);
 				nstate->argdesc = NULL;
 				state = (ExprState *) nstate;
 			}
@@ -5146,8 +5191,8 @@ ExecInitExpr(Expr *node, PlanState *parent)
 				foreach(l, (List *) node)
 				{
 					outlist = lappend(outlist,
-									  ExecInitExpr((Expr *) lfirst(l),
-												   parent));
+									  ExecInitExprRec((Expr *) lfirst(l),
+													  parent));
 				}
 				/* Don't fall through to the "common" code below */
 				return (ExprState *) outlist;
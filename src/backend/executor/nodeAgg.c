@@ -81,10 +81,11 @@
  *	  pass-by-reference, we have to be careful to copy it into a longer-lived
  *	  memory context, and free the prior value to avoid memory leakage.  We
  *	  store transvalues in another set of econtexts, aggstate->aggcontexts
- *	  (one per grouping set, see below), which are also used for the hashtable
- *	  structures in AGG_HASHED mode.  These econtexts are rescanned, not just
- *	  reset, at group boundaries so that aggregate transition functions can
- *	  register shutdown callbacks via AggRegisterCallback.
+ *	  (one per grouping set, see below), or, for hashed grouping, in
+ *	  aggstate->hashcontext, which also holds the hashtable structures.
+ *	  These econtexts are rescanned, not just reset, at group boundaries so
+ *	  that aggregate transition functions can register shutdown callbacks via
+ *	  AggRegisterCallback.
  *
  *	  The node's regular econtext (aggstate->ss.ps.ps_ExprContext) is used to
  *	  run finalize functions and compute the output tuple; this context can be
@@ -119,6 +120,23 @@
  *	  need some fallback logic to use this, since there's no Aggref node
  *	  for a window function.)
  *
+ *	  Spilling to disk:
+ *
+ *	  In AGG_HASHED mode, the planner sizes the hash table from its estimate
+ *	  of the number of groups, but that estimate can be far off.  So while
+ *	  filling the hash table, we keep an eye on the memory it uses, and once
+ *	  that exceeds work_mem we stop creating new groups.  From then on, input
+ *	  tuples that belong to groups already in the table are still aggregated
+ *	  as usual, but the others are written out to one of several spill files,
+ *	  partitioned by some bits of their hash value.  After the groups in the
+ *	  hash table have been returned, the table is emptied and each spill file
+ *	  in turn is read back as a new batch of input, spilling again (using the
+ *	  next bits of the hash value) if needed.  Since all the tuples of a group
+ *	  that isn't in the table go to the same partition, no group is ever
+ *	  split between two batches.  This is only done when there is a single
+ *	  hash table; with several hashed grouping sets (see below), the planner
+ *	  only chooses hashing if it expects all the tables to fit in memory.
+ *
  *	  Grouping sets:
  *
  *	  A list of grouping sets which is structurally equivalent to a ROLLUP
@@ -148,7 +166,17 @@
  *	  sensitive to the grouping set for which the aggregate function is
  *	  currently being called.
  *
- *	  TODO: AGG_HASHED doesn't support multiple grouping sets yet.
+ *	  Plain aggregation and sorted grouping are handled in agg_retrieve_direct,
+ *	  and the sorted phases are numbered from 1.  Phase 0 is reserved for
+ *	  hashing: each grouping set computed by hashing gets a hash table of its
+ *	  own (see AggStatePerHashData), and a single pass over the input fills
+ *	  all of them at once, without any sorting.  In AGG_HASHED mode, all the
+ *	  grouping sets are hashed, so phase 0 is the only phase.  In AGG_MIXED
+ *	  mode, the hash tables are filled while the input is read for phase 1
+ *	  (which must then be sorted on that phase's grouping columns), and their
+ *	  contents are returned after all the sorted phases are done.  Empty
+ *	  grouping sets are never hashed, since they must produce a row even if
+ *	  there is no input at all.
  *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -174,8 +202,11 @@
 #include "optimizer/tlist.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
+#include "storage/buffile.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/dynahash.h"
+#include "utils/hashutils.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
@@ -418,9 +449,14 @@ typedef struct AggStatePerGroupData
  *
  * Accordingly, each phase specifies a list of grouping sets and group clause
  * information, plus each phase after the first also has a sort order.
+ *
+ * Phase 0 is the hashing phase, if any; its grouping sets are the hashed
+ * ones, one per entry in aggstate->perhash.  It has no eqfunctions or
+ * sortnode.  The sorted phases start at 1.
  */
 typedef struct AggStatePerPhaseData
 {
+	AggStrategy aggstrategy;	/* strategy for this phase */
 	int			numsets;		/* number of grouping sets (or 0) */
 	int		   *gset_lengths;	/* lengths of grouping sets */
 	Bitmapset **grouped_cols;	/* column groupings for rollup */
@@ -429,6 +465,24 @@ typedef struct AggStatePerPhaseData
 	Sort	   *sortnode;		/* Sort node for input ordering for phase */
 }	AggStatePerPhaseData;
 
+/*
+ * AggStatePerHashData - per-hashtable state
+ *
+ * When doing grouping sets with hashing, we have one of these for each
+ * hashed grouping set.  (When hashing without grouping sets, we have just
+ * one of them.)
+ */
+typedef struct AggStatePerHashData
+{
+	TupleHashTable hashtable;	/* hash table with one entry per group */
+	TupleHashIterator hashiter; /* for iterating through hash table */
+	TupleTableSlot *hashslot;	/* slot for loading hash table */
+	FmgrInfo   *hashfunctions;	/* per-grouping-field hash fns */
+	FmgrInfo   *eqfunctions;	/* per-grouping-field equality fns */
+	List	   *hash_needed;	/* list of columns needed in hash table */
+	Agg		   *aggnode;		/* Agg node for this grouping set */
+}	AggStatePerHashData;
+
 /*
  * To implement hashed aggregation, we need a hashtable that stores a
  * representative tuple and an array of AggStatePerGroup structs for each
@@ -444,6 +498,37 @@ typedef struct AggHashEntryData
 	AggStatePerGroupData pergroup[FLEXIBLE_ARRAY_MEMBER];
 }	AggHashEntryData;
 
+/*
+ * Hash aggregation spill state.
+ *
+ * While spilling, each input tuple whose group isn't in the hash table is
+ * written to the partition selected by the next "nbits" bits of its hash
+ * value (after the "used_bits" already used to choose the batch being
+ * processed).  When the input is exhausted, each non-empty partition becomes
+ * a HashAggBatch, to be processed later.
+ */
+typedef struct HashAggSpillData
+{
+	int			npartitions;	/* number of spill files */
+	int			nbits;			/* log2(npartitions) */
+	BufFile   **partitions;		/* spill files, created on demand */
+} HashAggSpillData;
+
+typedef struct HashAggBatch
+{
+	BufFile    *input_file;		/* spilled tuples, rewound for reading */
+	int			used_bits;		/* hash bits used to partition this batch */
+} HashAggBatch;
+
+/*
+ * How often, in input tuples aggregated into the hash table, to check its
+ * memory use.  Walking the contexts isn't free, so we don't do it for every
+ * tuple.  We count tuples rather than new groups because the transition
+ * states of existing groups can keep growing too.
+ */
+#define HASHAGG_CHECK_INTERVAL		64
+
+static void select_current_set(AggState *aggstate, int setno, bool is_hash);
 static void initialize_phase(AggState *aggstate, int newphase);
 static TupleTableSlot *fetch_input_tuple(AggState *aggstate);
 static void initialize_aggregates(AggState *aggstate,
@@ -452,7 +537,8 @@ static void initialize_aggregates(AggState *aggstate,
 static void advance_transition_function(AggState *aggstate,
 							AggStatePerTrans pertrans,
 							AggStatePerGroup pergroupstate);
-static void advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup);
+static void advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup,
+				   AggStatePerGroup *hash_pergroups);
 static void advance_combine_function(AggState *aggstate,
 						 AggStatePerTrans pertrans,
 						 AggStatePerGroup pergroupstate);
@@ -472,17 +558,26 @@ static void prepare_projection_slot(AggState *aggstate,
 						int currentSet);
 static void finalize_aggregates(AggState *aggstate,
 					AggStatePerAgg peragg,
-					AggStatePerGroup pergroup,
-					int currentSet);
+					AggStatePerGroup pergroup);
 static TupleTableSlot *project_aggregates(AggState *aggstate);
 static Bitmapset *find_unaggregated_cols(AggState *aggstate);
 static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
 static void build_hash_table(AggState *aggstate);
 static AggHashEntry lookup_hash_entry(AggState *aggstate,
 				  TupleTableSlot *inputslot);
+static bool lookup_hash_entries(AggState *aggstate, TupleTableSlot *inputslot);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
 static void agg_fill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
+static bool agg_refill_hash_table(AggState *aggstate);
+static uint32 hash_agg_hash_value(AggState *aggstate);
+static void hash_agg_check_limits(AggState *aggstate);
+static void hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *slot,
+					 uint32 hashvalue);
+static void hash_agg_finish_spill(AggState *aggstate);
+static TupleTableSlot *hash_agg_read_spilled(AggState *aggstate, BufFile *file,
+					  uint32 *hashvalue);
+static void hash_agg_reset_spill(AggState *aggstate);
 static Datum GetAggInitVal(Datum textInitVal, Oid transtype);
 static void build_pertrans_for_aggref(AggStatePerTrans pertrans,
 						  AggState *aggsate, EState *estate,
@@ -498,13 +593,30 @@ static int find_compatible_pertrans(AggState *aggstate, Aggref *newagg,
 
 
 /*
- * Switch to phase "newphase", which must either be 0 (to reset) or
+ * Select the current grouping set; affects current_set and curaggcontext.
+ */
+static void
+select_current_set(AggState *aggstate, int setno, bool is_hash)
+{
+	if (is_hash)
+		aggstate->curaggcontext = aggstate->hashcontext;
+	else
+		aggstate->curaggcontext = aggstate->aggcontexts[setno];
+
+	aggstate->current_set = setno;
+}
+
+/*
+ * Switch to phase "newphase", which must either be 0 or 1 (to reset) or
  * current_phase + 1. Juggle the tuplesorts accordingly.
+ *
+ * Phase 0 is for hashing, which we currently handle last in the AGG_MIXED
+ * case, so when entering phase 0, all we need to do is drop open sorts.
  */
 static void
 initialize_phase(AggState *aggstate, int newphase)
 {
-	Assert(newphase == 0 || newphase == aggstate->current_phase + 1);
+	Assert(newphase <= 1 || newphase == aggstate->current_phase + 1);
 
 	/*
 	 * Whatever the previous state, we're now done with whatever input
@@ -516,7 +628,7 @@ initialize_phase(AggState *aggstate, int newphase)
 		aggstate->sort_in = NULL;
 	}
 
-	if (newphase == 0)
+	if (newphase <= 1)
 	{
 		/*
 		 * Discard any existing output tuplesort.
@@ -543,7 +655,7 @@ initialize_phase(AggState *aggstate, int newphase)
 	 * If this isn't the last phase, we need to sort appropriately for the
 	 * next phase in sequence.
 	 */
-	if (newphase < aggstate->numphases - 1)
+	if (newphase > 0 && newphase < aggstate->numphases - 1)
 	{
 		Sort	   *sortnode = aggstate->phases[newphase + 1].sortnode;
 		PlanState  *outerNode = outerPlanState(aggstate);
@@ -564,7 +676,7 @@ initialize_phase(AggState *aggstate, int newphase)
 }
 
 /*
- * Fetch a tuple from either the outer plan (for phase 0) or from the sorter
+ * Fetch a tuple from either the outer plan (for the first phase) or from the sorter
  * populated by the previous phase.  Copy it to the sorter for the next phase
  * if any.
  */
@@ -649,7 +761,7 @@ initialize_aggregate(AggState *aggstate, AggStatePerTrans pertrans,
 		MemoryContext oldContext;
 
 		oldContext = MemoryContextSwitchTo(
-		aggstate->aggcontexts[aggstate->current_set]->ecxt_per_tuple_memory);
+								 aggstate->curaggcontext->ecxt_per_tuple_memory);
 		pergroupstate->transValue = datumCopy(pertrans->initValue,
 											  pertrans->transtypeByVal,
 											  pertrans->transtypeLen);
@@ -700,7 +812,7 @@ initialize_aggregates(AggState *aggstate,
 
 			pergroupstate = &pergroup[transno + (setno * (aggstate->numtrans))];
 
-			aggstate->current_set = setno;
+			select_current_set(aggstate, setno, false);
 
 			initialize_aggregate(aggstate, pertrans, pergroupstate);
 		}
@@ -753,7 +865,7 @@ advance_transition_function(AggState *aggstate,
 			 * do not need to pfree the old transValue, since it's NULL.
 			 */
 			oldContext = MemoryContextSwitchTo(
-											   aggstate->aggcontexts[aggstate->current_set]->ecxt_per_tuple_memory);
+								 aggstate->curaggcontext->ecxt_per_tuple_memory);
 			pergroupstate->transValue = datumCopy(fcinfo->arg[1],
 												  pertrans->transtypeByVal,
 												  pertrans->transtypeLen);
@@ -801,7 +913,7 @@ advance_transition_function(AggState *aggstate,
 	{
 		if (!fcinfo->isnull)
 		{
-			MemoryContextSwitchTo(aggstate->aggcontexts[aggstate->current_set]->ecxt_per_tuple_memory);
+			MemoryContextSwitchTo(aggstate->curaggcontext->ecxt_per_tuple_memory);
 			newVal = datumCopy(newVal,
 							   pertrans->transtypeByVal,
 							   pertrans->transtypeLen);
@@ -819,17 +931,23 @@ advance_transition_function(AggState *aggstate,
 /*
  * Advance each aggregate transition state for one input tuple.  The input
  * tuple has been stored in tmpcontext->ecxt_outertuple, so that it is
- * accessible to ExecEvalExpr.  pergroup is the array of per-group structs to
- * use (this might be in a hashtable entry).
+ * accessible to ExecEvalExpr.
+ *
+ * pergroup is the array of per-group structs to use for the sorted grouping
+ * sets of the current phase, or NULL if there are none.  hash_pergroups is
+ * an array of pointers to the per-group structs in the hashtable entries,
+ * one for each hashed grouping set, or NULL if not hashing.
  *
  * When called, CurrentMemoryContext should be the per-query context.
  */
 static void
-advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup)
+advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup,
+				   AggStatePerGroup *hash_pergroups)
 {
 	int			transno;
 	int			setno = 0;
 	int			numGroupingSets = Max(aggstate->phase->numsets, 1);
+	int			numHashes = aggstate->num_hashes;
 	int			numTrans = aggstate->numtrans;
 
 	Assert(!aggstate->combineStates);
@@ -905,13 +1023,30 @@ advance_aggregates(AggState *aggstate, AggStatePerGroup pergroup)
 				fcinfo->argnull[i + 1] = slot->tts_isnull[i];
 			}
 
-			for (setno = 0; setno < numGroupingSets; setno++)
+			if (pergroup)
 			{
-				AggStatePerGroup pergroupstate = &pergroup[transno + (setno * numTrans)];
+				/* advance transition states for sorted grouping */
+				for (setno = 0; setno < numGroupingSets; setno++)
+				{
+					AggStatePerGroup pergroupstate = &pergroup[transno + (setno * numTrans)];
 
-				aggstate->current_set = setno;
+					select_current_set(aggstate, setno, false);
 
-				advance_transition_function(aggstate, pertrans, pergroupstate);
+					advance_transition_function(aggstate, pertrans, pergroupstate);
+				}
+			}
+
+			if (hash_pergroups)
+			{
+				/* advance transition states for hashed grouping */
+				for (setno = 0; setno < numHashes; setno++)
+				{
+					AggStatePerGroup pergroupstate = &hash_pergroups[setno][transno];
+
+					select_current_set(aggstate, setno, true);
+
+					advance_transition_function(aggstate, pertrans, pergroupstate);
+				}
 			}
 		}
 	}
@@ -984,7 +1119,7 @@ advance_combine_function(AggState *aggstate,
 			if (!pertrans->transtypeByVal)
 			{
 				oldContext = MemoryContextSwitchTo(
-												   aggstate->aggcontexts[aggstate->current_set]->ecxt_per_tuple_memory);
+								 aggstate->curaggcontext->ecxt_per_tuple_memory);
 				pergroupstate->transValue = datumCopy(fcinfo->arg[1],
 													pertrans->transtypeByVal,
 													  pertrans->transtypeLen);
@@ -1026,7 +1161,7 @@ advance_combine_function(AggState *aggstate,
 	{
 		if (!fcinfo->isnull)
 		{
-			MemoryContextSwitchTo(aggstate->aggcontexts[aggstate->current_set]->ecxt_per_tuple_memory);
+			MemoryContextSwitchTo(aggstate->curaggcontext->ecxt_per_tuple_memory);
 			newVal = datumCopy(newVal,
 							   pertrans->transtypeByVal,
 							   pertrans->transtypeLen);
@@ -1398,26 +1533,22 @@ prepare_projection_slot(AggState *aggstate, TupleTableSlot *slot, int currentSet
 /*
  * Compute the final value of all aggregates for one group.
  *
- * This function handles only one grouping set at a time.
+ * This function handles only one grouping set at a time, which the caller
+ * must have selected.  It's also the caller's responsibility to adjust the
+ * supplied pergroup parameter to point to the current set's transvalues.
  *
  * Results are stored in the output econtext aggvalues/aggnulls.
  */
 static void
 finalize_aggregates(AggState *aggstate,
 					AggStatePerAgg peraggs,
-					AggStatePerGroup pergroup,
-					int currentSet)
+					AggStatePerGroup pergroup)
 {
 	ExprContext *econtext = aggstate->ss.ps.ps_ExprContext;
 	Datum	   *aggvalues = econtext->ecxt_aggvalues;
 	bool	   *aggnulls = econtext->ecxt_aggnulls;
 	int			aggno;
 
-	Assert(currentSet == 0 ||
-		   ((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED);
-
-	aggstate->current_set = currentSet;
-
 	for (aggno = 0; aggno < aggstate->numaggs; aggno++)
 	{
 		AggStatePerAgg peragg = &peraggs[aggno];
@@ -1425,11 +1556,12 @@ finalize_aggregates(AggState *aggstate,
 		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
 		AggStatePerGroup pergroupstate;
 
-		pergroupstate = &pergroup[transno + (currentSet * (aggstate->numtrans))];
+		pergroupstate = &pergroup[transno];
 
 		if (pertrans->numSortCols > 0)
 		{
-			Assert(((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED);
+			/* sorted input is only possible in the sorted phases */
+			Assert(aggstate->current_phase > 0);
 
 			if (pertrans->numInputs == 1)
 				process_ordered_aggregate_single(aggstate,
@@ -1533,31 +1665,37 @@ find_unaggregated_cols_walker(Node *node, Bitmapset **colnos)
 }
 
 /*
- * Initialize the hash table to empty.
+ * Initialize the hash tables, one per hashed grouping set, to empty.
  *
- * The hash table always lives in the aggcontext memory context.
+ * The hash tables always live in the hashcontext memory context.
  */
 static void
 build_hash_table(AggState *aggstate)
 {
-	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
 	MemoryContext tmpmem = aggstate->tmpcontext->ecxt_per_tuple_memory;
 	Size		entrysize;
-
-	Assert(node->aggstrategy == AGG_HASHED);
-	Assert(node->numGroups > 0);
+	int			i;
 
 	entrysize = offsetof(AggHashEntryData, pergroup) +
 		aggstate->numaggs * sizeof(AggStatePerGroupData);
 
-	aggstate->hashtable = BuildTupleHashTable(node->numCols,
-											  node->grpColIdx,
-											  aggstate->phase->eqfunctions,
-											  aggstate->hashfunctions,
-											  node->numGroups,
-											  entrysize,
-							 aggstate->aggcontexts[0]->ecxt_per_tuple_memory,
-											  tmpmem);
+	for (i = 0; i < aggstate->num_hashes; i++)
+	{
+		AggStatePerHash perhash = &aggstate->perhash[i];
+		Agg		   *aggnode = perhash->aggnode;
+
+		Assert(aggnode->numGroups > 0);
+
+		perhash->hashtable = BuildTupleHashTable(aggnode->numCols,
+												 aggnode->grpColIdx,
+												 perhash->eqfunctions,
+												 perhash->hashfunctions,
+												 aggnode->numGroups,
+												 entrysize,
+							  aggstate->hashcontext->ecxt_per_tuple_memory,
+												 tmpmem,
+									  aggstate->ss.ps.plan->plan_node_id);
+	}
 }
 
 /*
@@ -1579,6 +1717,9 @@ build_hash_table(AggState *aggstate)
  * Note that the list is preserved over ExecReScanAgg, so we allocate it in
  * the per-query context (unlike the hash table itself).
  *
+ * With grouping sets, the grouping columns of the other grouping sets are
+ * left out, since they are nulled out on projection anyway.
+ *
  * Note: at present, searching the tlist/qual is not really necessary since
  * the parser should disallow any unaggregated references to ungrouped
  * columns.  However, the search will be needed when we add support for
@@ -1586,16 +1727,20 @@ build_hash_table(AggState *aggstate)
  * haven't been explicitly grouped by.
  */
 static List *
-find_hash_columns(AggState *aggstate)
+find_hash_columns(AggState *aggstate, AggStatePerHash perhash)
 {
-	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	Agg		   *node = perhash->aggnode;
 	Bitmapset  *colnos;
 	List	   *collist;
+	ListCell   *lc;
 	int			i;
 
 	/* Find Vars that will be needed in tlist and qual */
 	colnos = find_unaggregated_cols(aggstate);
-	/* Add in all the grouping columns */
+	/* Leave out the grouping columns of all grouping sets ... */
+	foreach(lc, aggstate->all_grouped_cols)
+		colnos = bms_del_member(colnos, lfirst_int(lc));
+	/* ... and add in the grouping columns of this one */
 	for (i = 0; i < node->numCols; i++)
 		colnos = bms_add_member(colnos, node->grpColIdx[i]);
 	/* Convert to list, using lcons so largest element ends up first */
@@ -1622,21 +1767,26 @@ hash_agg_entry_size(int numAggs)
 	entrysize = offsetof(AggHashEntryData, pergroup) +
 		numAggs * sizeof(AggStatePerGroupData);
 	entrysize = MAXALIGN(entrysize);
-	/* Account for hashtable overhead (assuming fill factor = 1) */
-	entrysize += 3 * sizeof(void *);
+	/* Account for the hash bucket and the entry's palloc overhead */
+	entrysize += sizeof(TupleHashBucketData) + 2 * sizeof(void *);
 	return entrysize;
 }
 
 /*
  * Find or create a hashtable entry for the tuple group containing the
- * given tuple.
+ * given tuple, in the hash table of the current grouping set.
+ *
+ * If the hash table has outgrown work_mem, no new groups are created, and
+ * NULL is returned if the tuple's group isn't already in the table; the
+ * caller must spill the tuple.
  *
  * When called, CurrentMemoryContext should be the per-query context.
  */
 static AggHashEntry
 lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 {
-	TupleTableSlot *hashslot = aggstate->hashslot;
+	AggStatePerHash perhash = &aggstate->perhash[aggstate->current_set];
+	TupleTableSlot *hashslot = perhash->hashslot;
 	ListCell   *l;
 	AggHashEntry entry;
 	bool		isnew;
@@ -1650,8 +1800,8 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 	}
 
 	/* transfer just the needed columns into hashslot */
-	slot_getsomeattrs(inputslot, linitial_int(aggstate->hash_needed));
-	foreach(l, aggstate->hash_needed)
+	slot_getsomeattrs(inputslot, linitial_int(perhash->hash_needed));
+	foreach(l, perhash->hash_needed)
 	{
 		int			varNumber = lfirst_int(l) - 1;
 
@@ -1659,20 +1809,73 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 		hashslot->tts_isnull[varNumber] = inputslot->tts_isnull[varNumber];
 	}
 
+	/* in spill mode, only look for an existing entry */
+	if (aggstate->hash_spill_mode)
+		return (AggHashEntry) LookupTupleHashEntry(perhash->hashtable,
+												   hashslot,
+												   NULL);
+
 	/* find or create the hashtable entry using the filtered tuple */
-	entry = (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
+	entry = (AggHashEntry) LookupTupleHashEntry(perhash->hashtable,
 												hashslot,
 												&isnew);
 
 	if (isnew)
 	{
+		int			transno;
+
 		/* initialize aggregates for new tuple group */
-		initialize_aggregates(aggstate, entry->pergroup, 0);
+		for (transno = 0; transno < aggstate->numtrans; transno++)
+			initialize_aggregate(aggstate, &aggstate->pertrans[transno],
+								 &entry->pergroup[transno]);
+
+		aggstate->hash_ngroups++;
 	}
 
+	/*
+	 * Every so often, see if the hash table has become too big.  We can only
+	 * spill if there's just one hash table, though.
+	 */
+	if (aggstate->num_hashes == 1 &&
+		++aggstate->hash_ntuples % HASHAGG_CHECK_INTERVAL == 0)
+		hash_agg_check_limits(aggstate);
+
 	return entry;
 }
 
+/*
+ * Look up the hashtable entries for the current input tuple in the hash
+ * tables of all the hashed grouping sets, storing pointers to their per-group
+ * states in aggstate->hash_pergroup, for advance_aggregates.
+ *
+ * Returns false if the tuple's group isn't in the hash table because we're
+ * spilling; the caller must then spill the tuple.  (That's only possible when
+ * there's a single hash table.)
+ */
+static bool
+lookup_hash_entries(AggState *aggstate, TupleTableSlot *inputslot)
+{
+	AggStatePerGroup *pergroups = aggstate->hash_pergroup;
+	int			setno;
+
+	for (setno = 0; setno < aggstate->num_hashes; setno++)
+	{
+		AggHashEntry entry;
+
+		select_current_set(aggstate, setno, true);
+
+		entry = lookup_hash_entry(aggstate, inputslot);
+		if (entry == NULL)
+		{
+			Assert(aggstate->num_hashes == 1);
+			return false;
+		}
+		pergroups[setno] = entry->pergroup;
+	}
+
+	return true;
+}
+
 /*
  * ExecAgg -
  *
@@ -1715,11 +1918,13 @@ ExecAgg(AggState *node)
 	if (!node->agg_done)
 	{
 		/* Dispatch based on strategy */
-		switch (node->phase->aggnode->aggstrategy)
+		switch (node->phase->aggstrategy)
 		{
 			case AGG_HASHED:
 				if (!node->table_filled)
 					agg_fill_hash_table(node);
+				/* FALLTHROUGH */
+			case AGG_MIXED:
 				result = agg_retrieve_hash_table(node);
 				break;
 			default:
@@ -1745,6 +1950,7 @@ agg_retrieve_direct(AggState *aggstate)
 	ExprContext *tmpcontext;
 	AggStatePerAgg peragg;
 	AggStatePerGroup pergroup;
+	AggStatePerGroup *hash_pergroups;
 	TupleTableSlot *outerslot;
 	TupleTableSlot *firstSlot;
 	TupleTableSlot *result;
@@ -1831,6 +2037,21 @@ agg_retrieve_direct(AggState *aggstate)
 				node = aggstate->phase->aggnode;
 				numReset = numGroupingSets;
 			}
+			else if (((Agg *) aggstate->ss.ps.plan)->aggstrategy == AGG_MIXED)
+			{
+				/*
+				 * Mixed mode; we've output all the sorted groups and have
+				 * full hash tables, so switch to outputting those.
+				 */
+				initialize_phase(aggstate, 0);
+				hash_agg_finish_spill(aggstate);
+				aggstate->hash_batches_used = 1;
+				aggstate->table_filled = true;
+				ResetTupleHashIterator(aggstate->perhash[0].hashtable,
+									   &aggstate->perhash[0].hashiter);
+				select_current_set(aggstate, 0, true);
+				return agg_retrieve_hash_table(aggstate);
+			}
 			else
 			{
 				aggstate->agg_done = true;
@@ -1980,8 +2201,26 @@ agg_retrieve_direct(AggState *aggstate)
 				 */
 				for (;;)
 				{
+					/*
+					 * During phase 1 only of a mixed agg, we need to update
+					 * the hash tables as well.  If the tuple's group has to
+					 * be spilled, we only advance the sorted groups here.
+					 */
+					hash_pergroups = NULL;
+					if (aggstate->num_hashes > 0 &&
+						aggstate->current_phase == 1)
+					{
+						if (lookup_hash_entries(aggstate,
+												tmpcontext->ecxt_outertuple))
+							hash_pergroups = aggstate->hash_pergroup;
+						else
+							hash_agg_spill_tuple(aggstate,
+												 tmpcontext->ecxt_outertuple,
+												 hash_agg_hash_value(aggstate));
+					}
+
 					if (!aggstate->combineStates)
-						advance_aggregates(aggstate, pergroup);
+						advance_aggregates(aggstate, pergroup, hash_pergroups);
 					else
 						combine_aggregates(aggstate, pergroup);
 
@@ -2043,7 +2282,11 @@ agg_retrieve_direct(AggState *aggstate)
 
 		prepare_projection_slot(aggstate, econtext->ecxt_outertuple, currentSet);
 
-		finalize_aggregates(aggstate, peragg, pergroup, currentSet);
+		select_current_set(aggstate, currentSet, false);
+
+		finalize_aggregates(aggstate,
+							peragg,
+							pergroup + (currentSet * aggstate->numtrans));
 
 		/*
 		 * If there's no row to project right now, we must continue rather
@@ -2065,7 +2308,6 @@ static void
 agg_fill_hash_table(AggState *aggstate)
 {
 	ExprContext *tmpcontext;
-	AggHashEntry entry;
 	TupleTableSlot *outerslot;
 
 	/*
@@ -2087,26 +2329,103 @@ agg_fill_hash_table(AggState *aggstate)
 		/* set up for advance_aggregates call */
 		tmpcontext->ecxt_outertuple = outerslot;
 
-		/* Find or build hashtable entry for this tuple's group */
-		entry = lookup_hash_entry(aggstate, outerslot);
-
-		/* Advance the aggregates */
-		if (!aggstate->combineStates)
-			advance_aggregates(aggstate, entry->pergroup);
+		/* Find or build hashtable entries for this tuple's groups */
+		if (!lookup_hash_entries(aggstate, outerslot))
+		{
+			/* Not in the hash table; spill the tuple for a later batch */
+			hash_agg_spill_tuple(aggstate, outerslot,
+								 hash_agg_hash_value(aggstate));
+		}
+		else if (!aggstate->combineStates)
+			advance_aggregates(aggstate, NULL, aggstate->hash_pergroup);
 		else
-			combine_aggregates(aggstate, entry->pergroup);
+			combine_aggregates(aggstate, aggstate->hash_pergroup[0]);
 
 		/* Reset per-input-tuple context after each tuple */
 		ResetExprContext(tmpcontext);
 	}
 
+	/* Set aside whatever we spilled as batches for later */
+	hash_agg_finish_spill(aggstate);
+	aggstate->hash_batches_used = 1;
+
 	aggstate->table_filled = true;
-	/* Initialize to walk the hash table */
-	ResetTupleHashIterator(aggstate->hashtable, &aggstate->hashiter);
+	/* Initialize to walk the first hash table */
+	select_current_set(aggstate, 0, true);
+	ResetTupleHashIterator(aggstate->perhash[0].hashtable,
+						   &aggstate->perhash[0].hashiter);
+}
+
+/*
+ * ExecAgg for hashed case: refill the hash table from the next spilled
+ * batch, if any.  Returns false if there are no more batches.
+ *
+ * The batch is processed just like the original input, and may spill
+ * again into batches of its own.
+ */
+static bool
+agg_refill_hash_table(AggState *aggstate)
+{
+	ExprContext *tmpcontext = aggstate->tmpcontext;
+	AggStatePerHash perhash = &aggstate->perhash[0];
+	HashAggBatch *batch;
+	TupleTableSlot *slot;
+	uint32		hashvalue;
+
+	if (aggstate->hash_batches == NIL)
+		return false;
+
+	/* we only ever spill with a single hash table */
+	Assert(aggstate->num_hashes == 1);
+
+	batch = (HashAggBatch *) linitial(aggstate->hash_batches);
+	aggstate->hash_batches = list_delete_first(aggstate->hash_batches);
+
+	/*
+	 * Empty the hash table.  We're done with its groups, so it's fine for
+	 * any shutdown callbacks registered by the transition functions to run.
+	 */
+	ReScanExprContext(aggstate->hashcontext);
+	build_hash_table(aggstate);
+	aggstate->hash_ngroups = 0;
+	aggstate->hash_ntuples = 0;
+	aggstate->hash_used_bits = batch->used_bits;
+	aggstate->hash_batches_used++;
+
+	while ((slot = hash_agg_read_spilled(aggstate, batch->input_file,
+										 &hashvalue)) != NULL)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		/* set up for advance_aggregates call */
+		tmpcontext->ecxt_outertuple = slot;
+
+		if (!lookup_hash_entries(aggstate, slot))
+			hash_agg_spill_tuple(aggstate, slot, hashvalue);
+		else if (!aggstate->combineStates)
+			advance_aggregates(aggstate, NULL, aggstate->hash_pergroup);
+		else
+			combine_aggregates(aggstate, aggstate->hash_pergroup[0]);
+
+		ResetExprContext(tmpcontext);
+	}
+
+	BufFileClose(batch->input_file);
+	pfree(batch);
+
+	hash_agg_finish_spill(aggstate);
+
+	select_current_set(aggstate, 0, true);
+	ResetTupleHashIterator(perhash->hashtable, &perhash->hashiter);
+
+	return true;
 }
 
 /*
- * ExecAgg for hashed case: phase 2, retrieving groups from hash table
+ * ExecAgg for hashed case: retrieving groups from hash tables
+ *
+ * With several hashed grouping sets, the hash tables are scanned one after
+ * another; aggstate->current_set tells which one we're on.
  */
 static TupleTableSlot *
 agg_retrieve_hash_table(AggState *aggstate)
@@ -2114,6 +2433,7 @@ agg_retrieve_hash_table(AggState *aggstate)
 	ExprContext *econtext;
 	AggStatePerAgg peragg;
 	AggStatePerGroup pergroup;
+	AggStatePerHash perhash;
 	AggHashEntry entry;
 	TupleTableSlot *firstSlot;
 	TupleTableSlot *result;
@@ -2126,6 +2446,12 @@ agg_retrieve_hash_table(AggState *aggstate)
 	peragg = aggstate->peragg;
 	firstSlot = aggstate->ss.ss_ScanTupleSlot;
 
+	/*
+	 * Note that perhash (and therefore anything accessed through it) can
+	 * change inside the loop, as we change between grouping sets.
+	 */
+	perhash = &aggstate->perhash[aggstate->current_set];
+
 	/*
 	 * We loop retrieving groups until we find one satisfying
 	 * aggstate->ss.ps.qual
@@ -2135,10 +2461,32 @@ agg_retrieve_hash_table(AggState *aggstate)
 		/*
 		 * Find the next entry in the hash table
 		 */
-		entry = (AggHashEntry) ScanTupleHashTable(&aggstate->hashiter);
+		entry = (AggHashEntry) ScanTupleHashTable(perhash->hashtable,
+												  &perhash->hashiter);
 		if (entry == NULL)
 		{
-			/* No more entries in hashtable, so done */
+			int			nextset = aggstate->current_set + 1;
+
+			if (nextset < aggstate->num_hashes)
+			{
+				/*
+				 * Switch to next grouping set, reinitialize, and restart the
+				 * loop.
+				 */
+				select_current_set(aggstate, nextset, true);
+
+				perhash = &aggstate->perhash[aggstate->current_set];
+
+				ResetTupleHashIterator(perhash->hashtable, &perhash->hashiter);
+
+				continue;
+			}
+
+			/* No more entries in hashtable; move on to the next batch */
+			if (agg_refill_hash_table(aggstate))
+				continue;
+
+			/* No more batches either, so done */
 			aggstate->agg_done = TRUE;
 			return NULL;
 		}
@@ -2160,16 +2508,18 @@ agg_retrieve_hash_table(AggState *aggstate)
 							  firstSlot,
 							  false);
 
-		pergroup = entry->pergroup;
-
-		finalize_aggregates(aggstate, peragg, pergroup, 0);
-
 		/*
 		 * Use the representative input tuple for any references to
 		 * non-aggregated input columns in the qual and tlist.
 		 */
 		econtext->ecxt_outertuple = firstSlot;
 
+		prepare_projection_slot(aggstate, firstSlot, aggstate->current_set);
+
+		pergroup = entry->pergroup;
+
+		finalize_aggregates(aggstate, peragg, pergroup);
+
 		result = project_aggregates(aggstate);
 		if (result)
 			return result;
@@ -2179,6 +2529,273 @@ agg_retrieve_hash_table(AggState *aggstate)
 	return NULL;
 }
 
+/*
+ * Compute the hash value of the grouping columns of the tuple that
+ * lookup_hash_entry last loaded into hashslot, for choosing the partition
+ * to spill it to.
+ */
+static uint32
+hash_agg_hash_value(AggState *aggstate)
+{
+	AggStatePerHash perhash = &aggstate->perhash[aggstate->current_set];
+	Agg		   *node = perhash->aggnode;
+	TupleTableSlot *hashslot = perhash->hashslot;
+	MemoryContext oldContext;
+	uint32		hashkey = 0;
+	int			i;
+
+	/* Need to run the hash functions in short-lived context */
+	oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < node->numCols; i++)
+	{
+		AttrNumber	att = node->grpColIdx[i];
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		/* treat nulls as having hash key 0 */
+		if (!hashslot->tts_isnull[att - 1])
+		{
+			uint32		hkey;
+
+			hkey = DatumGetUInt32(FunctionCall1(&perhash->hashfunctions[i],
+											hashslot->tts_values[att - 1]));
+			hashkey ^= hkey;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* partitions are chosen by the high-order bits, so mix them well too */
+	return murmurhash32(hashkey);
+}
+
+/*
+ * Check whether the hash table has outgrown work_mem, and if so, switch to
+ * spill mode.
+ *
+ * We choose the number of partitions from the planner's estimate of the
+ * number of groups (scaled down to the current batch) and the number of
+ * groups that fit in memory, so that each batch will hopefully fit.
+ */
+static void
+hash_agg_check_limits(AggState *aggstate)
+{
+	Agg		   *node = aggstate->perhash[0].aggnode;
+	HashAggSpill spill;
+	Size		mem_used;
+	double		est_groups;
+	int			npartitions;
+	int			nbits;
+
+	mem_used = MemoryContextMemAllocated(aggstate->hashcontext->ecxt_per_tuple_memory,
+										 true);
+	if (mem_used <= work_mem * 1024L)
+		return;
+
+	est_groups = (double) node->numGroups /
+		(double) ((uint64) 1 << aggstate->hash_used_bits);
+	npartitions = (int) Min(est_groups / aggstate->hash_ngroups + 1,
+							HASHAGG_MAX_PARTITIONS);
+	nbits = my_log2(Max(npartitions, HASHAGG_MIN_PARTITIONS));
+
+	/*
+	 * If we've run out of hash bits to partition on, all that's left are
+	 * groups whose hash values collide completely; there's no point in
+	 * spilling those, so just let the hash table grow.
+	 */
+	nbits = Min(nbits, 32 - aggstate->hash_used_bits);
+	if (nbits <= 0)
+		return;
+
+	spill = (HashAggSpill) MemoryContextAllocZero(aggstate->ss.ps.state->es_query_cxt,
+												  sizeof(HashAggSpillData));
+	spill->nbits = nbits;
+	spill->npartitions = 1 << nbits;
+	spill->partitions = (BufFile **)
+		MemoryContextAllocZero(aggstate->ss.ps.state->es_query_cxt,
+							   spill->npartitions * sizeof(BufFile *));
+
+	aggstate->hash_spill = spill;
+	aggstate->hash_spill_mode = true;
+}
+
+/*
+ * Write a tuple whose group isn't in the hash table to its spill partition.
+ */
+static void
+hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *slot,
+					 uint32 hashvalue)
+{
+	HashAggSpill spill = aggstate->hash_spill;
+	MinimalTuple tuple;
+	int			partno;
+	size_t		written;
+
+	Assert(spill != NULL);
+
+	/* use the next nbits bits of the hash value, from the top */
+	partno = (int) ((hashvalue << aggstate->hash_used_bits) >>
+					(32 - spill->nbits));
+
+	if (spill->partitions[partno] == NULL)
+	{
+		MemoryContext oldContext;
+
+		oldContext = MemoryContextSwitchTo(aggstate->ss.ps.state->es_query_cxt);
+		spill->partitions[partno] = BufFileCreateTemp(false);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	tuple = ExecFetchSlotMinimalTuple(slot);
+
+	written = BufFileWrite(spill->partitions[partno],
+						   (void *) &hashvalue, sizeof(uint32));
+	if (written != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-agg temporary file: %m")));
+
+	written = BufFileWrite(spill->partitions[partno],
+						   (void *) tuple, tuple->t_len);
+	if (written != tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-agg temporary file: %m")));
+
+	aggstate->hash_disk_used += sizeof(uint32) + tuple->t_len;
+}
+
+/*
+ * At the end of an input batch, turn the spill partitions written while
+ * reading it into batches to be processed later, and leave spill mode.
+ */
+static void
+hash_agg_finish_spill(AggState *aggstate)
+{
+	HashAggSpill spill = aggstate->hash_spill;
+	MemoryContext oldContext;
+	int			partno;
+
+	aggstate->hash_spill_mode = false;
+	if (spill == NULL)
+		return;
+
+	oldContext = MemoryContextSwitchTo(aggstate->ss.ps.state->es_query_cxt);
+
+	for (partno = 0; partno < spill->npartitions; partno++)
+	{
+		BufFile    *file = spill->partitions[partno];
+		HashAggBatch *batch;
+
+		if (file == NULL)
+			continue;
+
+		if (BufFileSeek(file, 0, 0L, SEEK_SET))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+				   errmsg("could not rewind hash-agg temporary file: %m")));
+
+		batch = (HashAggBatch *) palloc(sizeof(HashAggBatch));
+		batch->input_file = file;
+		batch->used_bits = aggstate->hash_used_bits + spill->nbits;
+
+		/*
+		 * Process the newest batches first, so that a batch that spills
+		 * again has its own batches done before its siblings; that keeps
+		 * the amount of data on disk down.
+		 */
+		aggstate->hash_batches = lcons(batch, aggstate->hash_batches);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	pfree(spill->partitions);
+	pfree(spill);
+	aggstate->hash_spill = NULL;
+}
+
+/*
+ * Read the next tuple from a spill file into hash_spill_slot, and return
+ * the slot, or NULL at end of file.
+ */
+static TupleTableSlot *
+hash_agg_read_spilled(AggState *aggstate, BufFile *file, uint32 *hashvalue)
+{
+	TupleTableSlot *slot = aggstate->hash_spill_slot;
+	uint32		header[2];
+	size_t		nread;
+	MinimalTuple tuple;
+
+	/*
+	 * Since both the hash value and the MinimalTuple length word are uint32,
+	 * we can read them both in one BufFileRead() call without any type
+	 * cheating.
+	 */
+	nread = BufFileRead(file, (void *) header, sizeof(header));
+	if (nread == 0)				/* end of file */
+	{
+		ExecClearTuple(slot);
+		return NULL;
+	}
+	if (nread != sizeof(header))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from hash-agg temporary file: %m")));
+	*hashvalue = header[0];
+	tuple = (MinimalTuple) palloc(header[1]);
+	tuple->t_len = header[1];
+	nread = BufFileRead(file,
+						(void *) ((char *) tuple + sizeof(uint32)),
+						header[1] - sizeof(uint32));
+	if (nread != header[1] - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from hash-agg temporary file: %m")));
+	return ExecStoreMinimalTuple(tuple, slot, true);
+}
+
+/*
+ * Discard all spill files and batches, as well as the spilling statistics.
+ */
+static void
+hash_agg_reset_spill(AggState *aggstate)
+{
+	HashAggSpill spill = aggstate->hash_spill;
+	ListCell   *lc;
+
+	if (spill != NULL)
+	{
+		int			partno;
+
+		for (partno = 0; partno < spill->npartitions; partno++)
+		{
+			if (spill->partitions[partno])
+				BufFileClose(spill->partitions[partno]);
+		}
+		pfree(spill->partitions);
+		pfree(spill);
+		aggstate->hash_spill = NULL;
+	}
+
+	foreach(lc, aggstate->hash_batches)
+	{
+		HashAggBatch *batch = (HashAggBatch *) lfirst(lc);
+
+		BufFileClose(batch->input_file);
+	}
+	list_free_deep(aggstate->hash_batches);
+	aggstate->hash_batches = NIL;
+
+	aggstate->hash_ngroups = 0;
+	aggstate->hash_ntuples = 0;
+	aggstate->hash_spill_mode = false;
+	aggstate->hash_used_bits = 0;
+	aggstate->hash_batches_used = 0;
+	aggstate->hash_disk_used = 0;
+}
+
 /* -----------------
  * ExecInitAgg
  *
@@ -2198,10 +2815,14 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 				transno,
 				aggno;
 	int			phase;
+	int			phaseidx;
+	int			hashidx;
 	ListCell   *l;
 	Bitmapset  *all_grouped_cols = NULL;
 	int			numGroupingSets = 1;
 	int			numPhases;
+	int			numHashes;
+	bool		use_hashing;
 	int			i = 0;
 	int			j = 0;
 
@@ -2219,7 +2840,6 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->numaggs = 0;
 	aggstate->numtrans = 0;
 	aggstate->maxsets = 0;
-	aggstate->hashfunctions = NULL;
 	aggstate->projected_set = -1;
 	aggstate->current_set = 0;
 	aggstate->peragg = NULL;
@@ -2231,18 +2851,35 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->input_done = false;
 	aggstate->pergroup = NULL;
 	aggstate->grp_firstTuple = NULL;
-	aggstate->hashtable = NULL;
 	aggstate->sort_in = NULL;
 	aggstate->sort_out = NULL;
+	aggstate->hash_ngroups = 0;
+	aggstate->hash_ntuples = 0;
+	aggstate->hash_spill_mode = false;
+	aggstate->hash_used_bits = 0;
+	aggstate->hash_spill = NULL;
+	aggstate->hash_batches = NIL;
+	aggstate->hash_batches_used = 0;
+	aggstate->hash_disk_used = 0;
+
+	use_hashing = (node->aggstrategy == AGG_HASHED ||
+				   node->aggstrategy == AGG_MIXED);
+
+	/*
+	 * Phase 0 is for hashing; the sorted phases, if any, start at 1.  If the
+	 * top node is hashed, it's the first hashed grouping set, otherwise it's
+	 * the first sorted phase.
+	 */
+	numPhases = (use_hashing ? 1 : 2);
+	numHashes = (use_hashing ? 1 : 0);
 
 	/*
 	 * Calculate the maximum number of grouping sets in any phase; this
-	 * determines the size of some allocations.
+	 * determines the size of some allocations.  Also count the additional
+	 * phases and hash tables.
 	 */
 	if (node->groupingSets)
 	{
-		Assert(node->aggstrategy != AGG_HASHED);
-
 		numGroupingSets = list_length(node->groupingSets);
 
 		foreach(l, node->chain)
@@ -2251,11 +2888,20 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 
 			numGroupingSets = Max(numGroupingSets,
 								  list_length(agg->groupingSets));
+
+			/*
+			 * Additional AGG_HASHED aggs become part of phase 0, but all
+			 * others add an extra phase.
+			 */
+			if (agg->aggstrategy != AGG_HASHED)
+				++numPhases;
+			else
+				++numHashes;
 		}
 	}
 
 	aggstate->maxsets = numGroupingSets;
-	aggstate->numphases = numPhases = 1 + list_length(node->chain);
+	aggstate->numphases = numPhases;
 
 	aggstate->aggcontexts = (ExprContext **)
 		palloc0(sizeof(ExprContext *) * numGroupingSets);
@@ -2272,6 +2918,10 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	 * in the regular per-query memory context are driven by a simple
 	 * decision: we want to reset the aggcontext at group boundaries (if not
 	 * hashing) and in ExecReScanAgg to recover no-longer-wanted space.
+	 *
+	 * Hashed grouping sets all keep their transition values, as well as the
+	 * hash tables themselves, in a separate hashcontext, which is only reset
+	 * in ExecReScanAgg (and between batches, when spilling).
 	 */
 	ExecAssignExprContext(estate, &aggstate->ss.ps);
 	aggstate->tmpcontext = aggstate->ss.ps.ps_ExprContext;
@@ -2282,6 +2932,12 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		aggstate->aggcontexts[i] = aggstate->ss.ps.ps_ExprContext;
 	}
 
+	if (use_hashing)
+	{
+		ExecAssignExprContext(estate, &aggstate->ss.ps);
+		aggstate->hashcontext = aggstate->ss.ps.ps_ExprContext;
+	}
+
 	ExecAssignExprContext(estate, &aggstate->ss.ps);
 
 	/*
@@ -2289,8 +2945,8 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	 */
 	ExecInitScanTupleSlot(estate, &aggstate->ss);
 	ExecInitResultTupleSlot(estate, &aggstate->ss.ps);
-	aggstate->hashslot = ExecInitExtraTupleSlot(estate);
 	aggstate->sort_slot = ExecInitExtraTupleSlot(estate);
+	aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate);
 
 	/*
 	 * initialize child expressions
@@ -2326,6 +2982,9 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	if (node->chain)
 		ExecSetSlotDescriptor(aggstate->sort_slot,
 						 aggstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
+	if (use_hashing)
+		ExecSetSlotDescriptor(aggstate->hash_spill_slot,
+						 aggstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
 
 	/*
 	 * Initialize result tuple type and projection info.
@@ -2359,18 +3018,31 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 
 	aggstate->phases = palloc0(numPhases * sizeof(AggStatePerPhaseData));
 
-	for (phase = 0; phase < numPhases; ++phase)
+	aggstate->num_hashes = numHashes;
+	if (numHashes)
+	{
+		aggstate->perhash = palloc0(sizeof(AggStatePerHashData) * numHashes);
+		aggstate->phases[0].numsets = 0;
+		if (node->groupingSets)
+		{
+			aggstate->phases[0].gset_lengths = palloc(numHashes * sizeof(int));
+			aggstate->phases[0].grouped_cols = palloc(numHashes * sizeof(Bitmapset *));
+		}
+	}
+
+	phase = 0;
+	hashidx = 0;
+	for (phaseidx = 0; phaseidx <= list_length(node->chain); ++phaseidx)
 	{
-		AggStatePerPhase phasedata = &aggstate->phases[phase];
+		AggStatePerPhase phasedata;
 		Agg		   *aggnode;
 		Sort	   *sortnode;
 		int			num_sets;
 
-		if (phase > 0)
+		if (phaseidx > 0)
 		{
-			aggnode = list_nth(node->chain, phase - 1);
+			aggnode = list_nth(node->chain, phaseidx - 1);
 			sortnode = (Sort *) aggnode->plan.lefttree;
-			Assert(IsA(sortnode, Sort));
 		}
 		else
 		{
@@ -2378,6 +3050,47 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 			sortnode = NULL;
 		}
 
+		if (aggnode->aggstrategy == AGG_HASHED ||
+			aggnode->aggstrategy == AGG_MIXED)
+		{
+			AggStatePerHash perhash;
+
+			/* phase 0 always points to the "real" Agg in the hash case */
+			phasedata = &aggstate->phases[0];
+			phasedata->aggnode = node;
+			phasedata->aggstrategy = node->aggstrategy;
+
+			/* but the actual Agg node representing this hash is saved here */
+			perhash = &aggstate->perhash[hashidx];
+			perhash->aggnode = aggnode;
+			perhash->hashslot = ExecInitExtraTupleSlot(estate);
+			execTuplesHashPrepare(aggnode->numCols,
+								  aggnode->grpOperators,
+								  &perhash->eqfunctions,
+								  &perhash->hashfunctions);
+
+			if (node->groupingSets)
+			{
+				Bitmapset  *cols = NULL;
+
+				/* planner makes the set's columns all of the key columns */
+				for (j = 0; j < aggnode->numCols; ++j)
+					cols = bms_add_member(cols, aggnode->grpColIdx[j]);
+
+				phasedata->grouped_cols[hashidx] = cols;
+				phasedata->gset_lengths[hashidx] = aggnode->numCols;
+				phasedata->numsets++;
+
+				all_grouped_cols = bms_add_members(all_grouped_cols, cols);
+			}
+
+			hashidx++;
+			continue;
+		}
+
+		phasedata = &aggstate->phases[++phase];
+		Assert(phase == 1 || IsA(sortnode, Sort));
+
 		phasedata->numsets = num_sets = list_length(aggnode->groupingSets);
 
 		if (num_sets)
@@ -2405,7 +3118,7 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		}
 		else
 		{
-			Assert(phase == 0);
+			Assert(phaseidx == 0);
 
 			phasedata->gset_lengths = NULL;
 			phasedata->grouped_cols = NULL;
@@ -2424,6 +3137,7 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		}
 
 		phasedata->aggnode = aggnode;
+		phasedata->aggstrategy = aggnode->aggstrategy;
 		phasedata->sortnode = sortnode;
 	}
 
@@ -2435,21 +3149,24 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 		aggstate->all_grouped_cols = lcons_int(i, aggstate->all_grouped_cols);
 
 	/*
-	 * Hashing can only appear in the initial phase.
+	 * Initialize current phase-dependent values to initial phase.  The
+	 * initial phase is 1 (first sort pass) for all strategies that use
+	 * sorting (if hashing is being done too, then phase 0 is processed last);
+	 * but if only hashing is being done, then phase 0 is all there is.
 	 */
-
 	if (node->aggstrategy == AGG_HASHED)
-		execTuplesHashPrepare(node->numCols,
-							  node->grpOperators,
-							  &aggstate->phases[0].eqfunctions,
-							  &aggstate->hashfunctions);
-
-	/*
-	 * Initialize current phase-dependent values to initial phase
-	 */
-
-	aggstate->current_phase = 0;
-	initialize_phase(aggstate, 0);
+	{
+		aggstate->current_phase = 0;
+		initialize_phase(aggstate, 0);
+		select_current_set(aggstate, 0, true);
+	}
+	else
+	{
+		aggstate->current_phase = 1;
+		initialize_phase(aggstate, 0);
+		initialize_phase(aggstate, 1);
+		select_current_set(aggstate, 0, false);
+	}
 
 	/*
 	 * Set up aggregate-result storage in the output expr context, and also
@@ -2465,14 +3182,19 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->peragg = peraggs;
 	aggstate->pertrans = pertransstates;
 
-	if (node->aggstrategy == AGG_HASHED)
+	if (use_hashing)
 	{
 		build_hash_table(aggstate);
 		aggstate->table_filled = false;
+		aggstate->hash_pergroup = (AggStatePerGroup *)
+			palloc0(sizeof(AggStatePerGroup) * numHashes);
 		/* Compute the columns we actually need to hash on */
-		aggstate->hash_needed = find_hash_columns(aggstate);
+		for (i = 0; i < numHashes; i++)
+			aggstate->perhash[i].hash_needed =
+				find_hash_columns(aggstate, &aggstate->perhash[i]);
 	}
-	else
+
+	if (node->aggstrategy != AGG_HASHED)
 	{
 		AggStatePerGroup pergroup;
 
@@ -2922,7 +3644,8 @@ build_pertrans_for_aggref(AggStatePerTrans pertrans,
 		 * We don't implement DISTINCT or ORDER BY aggs in the HASHED case
 		 * (yet)
 		 */
-		Assert(((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED);
+		Assert(((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED &&
+			   ((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_MIXED);
 
 		/* If we have only one input, we need its len/byval info. */
 		if (numInputs == 1)
@@ -3144,6 +3867,9 @@ ExecEndAgg(AggState *node)
 	if (node->sort_out)
 		tuplesort_end(node->sort_out);
 
+	/* And any spill files */
+	hash_agg_reset_spill(node);
+
 	for (transno = 0; transno < node->numtrans; transno++)
 	{
 		AggStatePerTrans pertrans = &node->pertrans[transno];
@@ -3158,6 +3884,8 @@ ExecEndAgg(AggState *node)
 	/* And ensure any agg shutdown callbacks have been called */
 	for (setno = 0; setno < numGroupingSets; setno++)
 		ReScanExprContext(node->aggcontexts[setno]);
+	if (node->hashcontext)
+		ReScanExprContext(node->hashcontext);
 
 	/*
 	 * We don't actually free any ExprContexts here (see comment in
@@ -3200,12 +3928,16 @@ ExecReScanAgg(AggState *node)
 
 		/*
 		 * If we do have the hash table and the subplan does not have any
-		 * parameter changes, then we can just rescan the existing hash table;
-		 * no need to build it again.
+		 * parameter changes, then we can just rescan the existing hash
+		 * tables; no need to build them again.  That's not possible if we had
+		 * to spill, since then the table only holds the groups of the last
+		 * batch.
 		 */
-		if (outerPlan->chgParam == NULL)
+		if (outerPlan->chgParam == NULL && node->hash_disk_used == 0)
 		{
-			ResetTupleHashIterator(node->hashtable, &node->hashiter);
+			select_current_set(node, 0, true);
+			ResetTupleHashIterator(node->perhash[0].hashtable,
+								   &node->perhash[0].hashiter);
 			return;
 		}
 	}
@@ -3232,8 +3964,8 @@ ExecReScanAgg(AggState *node)
 	 * rather than just reset because transfns may have registered callbacks
 	 * that need to be run now.)
 	 *
-	 * Note that with AGG_HASHED, the hash table is allocated in a sub-context
-	 * of the aggcontext. This used to be an issue, but now, resetting a
+	 * Note that with hashing, the hash tables are allocated in a sub-context
+	 * of the hashcontext. This used to be an issue, but now, resetting a
 	 * context automatically deletes sub-contexts too.
 	 */
 
@@ -3241,6 +3973,8 @@ ExecReScanAgg(AggState *node)
 	{
 		ReScanExprContext(node->aggcontexts[setno]);
 	}
+	if (node->hashcontext)
+		ReScanExprContext(node->hashcontext);
 
 	/* Release first tuple of group, if we have made a copy */
 	if (node->grp_firstTuple != NULL)
@@ -3254,13 +3988,17 @@ ExecReScanAgg(AggState *node)
 	MemSet(econtext->ecxt_aggvalues, 0, sizeof(Datum) * node->numaggs);
 	MemSet(econtext->ecxt_aggnulls, 0, sizeof(bool) * node->numaggs);
 
-	if (aggnode->aggstrategy == AGG_HASHED)
+	if (aggnode->aggstrategy == AGG_HASHED ||
+		aggnode->aggstrategy == AGG_MIXED)
 	{
-		/* Rebuild an empty hash table */
+		/* Forget any spilled data, and rebuild empty hash tables */
+		hash_agg_reset_spill(node);
 		build_hash_table(node);
 		node->table_filled = false;
+		/* iterator will be reset when the table is filled */
 	}
-	else
+
+	if (aggnode->aggstrategy != AGG_HASHED)
 	{
 		/*
 		 * Reset the per-group state (in particular, mark transvalues null)
@@ -3268,8 +4006,8 @@ ExecReScanAgg(AggState *node)
 		MemSet(node->pergroup, 0,
 			 sizeof(AggStatePerGroupData) * node->numaggs * numGroupingSets);
 
-		/* reset to phase 0 */
-		initialize_phase(node, 0);
+		/* reset to phase 1 */
+		initialize_phase(node, 1);
 
 		node->input_done = false;
 		node->projected_set = -1;
@@ -3310,7 +4048,7 @@ AggCheckCallContext(FunctionCallInfo fcinfo, MemoryContext *aggcontext)
 		if (aggcontext)
 		{
 			AggState   *aggstate = ((AggState *) fcinfo->context);
-			ExprContext *cxt = aggstate->aggcontexts[aggstate->current_set];
+			ExprContext *cxt = aggstate->curaggcontext;
 
 			*aggcontext = cxt->ecxt_per_tuple_memory;
 		}
@@ -3399,7 +4137,7 @@ AggRegisterCallback(FunctionCallInfo fcinfo,
 	if (fcinfo->context && IsA(fcinfo->context, AggState))
 	{
 		AggState   *aggstate = (AggState *) fcinfo->context;
-		ExprContext *cxt = aggstate->aggcontexts[aggstate->current_set];
+		ExprContext *cxt = aggstate->curaggcontext;
 
 		RegisterExprContextCallback(cxt, func, arg);
 
@@ -36,6 +36,14 @@
  *			  nil	nil		 ...    ...    ...
  *								 subplans
  *
+ *		If some subplans are foreign scans whose FDW supports asynchronous
+ *		execution, the first remote request of all such subplans is sent
+ *		before any tuple is fetched, and tuples are then returned from
+ *		whichever subplan is ready, waiting on the sockets of the busy
+ *		ones only when no subplan can make progress.  The order of the
+ *		returned tuples is not defined in this mode, so it is used only
+ *		for forward scans.
+ *
  *		Append nodes are currently used for unions, and to support
  *		inheritance queries, where several relations need to be scanned.
  *		For example, in our standard person/student/employee/student-emp
@@ -57,10 +65,27 @@
 
 #include "postgres.h"
 
+#include <sys/time.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
 #include "executor/execdebug.h"
 #include "executor/nodeAppend.h"
+#include "executor/nodeForeignscan.h"
+#include "foreign/fdwapi.h"
+#include "miscadmin.h"
 
 static bool exec_append_initialize_next(AppendState *appendstate);
+static TupleTableSlot *exec_append_async(AppendState *node);
+static void exec_append_wait(pgsocket *socks, int nsocks);
+static void exec_append_start_async(AppendState *node);
 
 
 /* ----------------------------------------------------------------
@@ -169,6 +194,29 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 		i++;
 	}
 
+	/*
+	 * Asynchronous execution changes the order of the returned tuples, so
+	 * don't use it if a backward scan may be requested, nor in EvalPlanQual
+	 * rechecks, which fetch a single tuple anyway.
+	 */
+	appendstate->as_async = false;
+	appendstate->as_async_started = false;
+	appendstate->as_asyncplans = (bool *) palloc0(nplans * sizeof(bool));
+	appendstate->as_finished = (bool *) palloc0(nplans * sizeof(bool));
+	appendstate->as_waitsocks = (pgsocket *) palloc0(nplans * sizeof(pgsocket));
+	if (nplans > 1 && estate->es_epqTuple == NULL &&
+		!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_EXPLAIN_ONLY)))
+	{
+		for (i = 0; i < nplans; i++)
+		{
+			PlanState  *subnode = appendplanstates[i];
+
+			if (IsA(subnode, ForeignScanState) &&
+			((ForeignScanState *) subnode)->fdwroutine->StartForeignScanAsync)
+				appendstate->as_async = true;
+		}
+	}
+
 	/*
 	 * initialize output tuple type
 	 */
@@ -193,6 +241,9 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 TupleTableSlot *
 ExecAppend(AppendState *node)
 {
+	if (node->as_async)
+		return exec_append_async(node);
+
 	for (;;)
 	{
 		PlanState  *subnode;
@@ -234,6 +285,156 @@ ExecAppend(AppendState *node)
 	}
 }
 
+/* ----------------------------------------------------------------
+ *		exec_append_start_async
+ *
+ *		Lets all asynchronous subplans send their first request.
+ * ----------------------------------------------------------------
+ */
+static void
+exec_append_start_async(AppendState *node)
+{
+	int			i;
+
+	for (i = 0; i < node->as_nplans; i++)
+	{
+		PlanState  *subnode = node->appendplans[i];
+
+		node->as_asyncplans[i] = false;
+		node->as_finished[i] = false;
+		if (!IsA(subnode, ForeignScanState))
+			continue;
+
+		/* Apply pending rescan first, so that it doesn't cancel the request */
+		if (subnode->chgParam != NULL)
+			ExecReScan(subnode);
+
+		node->as_asyncplans[i] =
+			ExecForeignScanStartAsync((ForeignScanState *) subnode);
+	}
+	node->as_async_started = true;
+}
+
+/* ----------------------------------------------------------------
+ *		exec_append_async
+ *
+ *		Returns the next tuple from any subplan which can produce it
+ *		without blocking.  Subplans are polled round-robin starting
+ *		with the one which returned the previous tuple, so that its
+ *		buffered tuples are consumed before checking the others.
+ *		Synchronous subplans are always considered ready.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+exec_append_async(AppendState *node)
+{
+	if (!node->as_async_started)
+		exec_append_start_async(node);
+
+	for (;;)
+	{
+		int			nsocks = 0;
+		bool		unfinished = false;
+		int			n;
+
+		CHECK_FOR_INTERRUPTS();
+
+		for (n = 0; n < node->as_nplans; n++)
+		{
+			int			i = (node->as_whichplan + n) % node->as_nplans;
+			PlanState  *subnode = node->appendplans[i];
+			TupleTableSlot *result;
+
+			if (node->as_finished[i])
+				continue;
+			unfinished = true;
+
+			if (node->as_asyncplans[i])
+			{
+				pgsocket	sock;
+
+				sock = ExecForeignScanAsyncSocket((ForeignScanState *) subnode);
+				if (sock != PGINVALID_SOCKET)
+				{
+					node->as_waitsocks[nsocks++] = sock;
+					continue;
+				}
+			}
+
+			result = ExecProcNode(subnode);
+			if (!TupIsNull(result))
+			{
+				node->as_whichplan = i;
+				return result;
+			}
+			node->as_finished[i] = true;
+		}
+
+		if (!unfinished)
+			return ExecClearTuple(node->ps.ps_ResultTupleSlot);
+
+		/* All unfinished subplans wait for remote servers */
+		if (nsocks > 0)
+			exec_append_wait(node->as_waitsocks, nsocks);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		exec_append_wait
+ *
+ *		Waits until one of the sockets becomes readable.  A signal
+ *		interrupts the wait, so that the caller can service it; the
+ *		timeout only covers a signal arriving just before the wait
+ *		starts.  We use poll(2) if available, otherwise select(2).
+ * ----------------------------------------------------------------
+ */
+static void
+exec_append_wait(pgsocket *socks, int nsocks)
+{
+	int			timeout_ms = 1000;
+	int			rc;
+
+#ifdef HAVE_POLL
+	{
+		struct pollfd *fds;
+		int			i;
+
+		fds = (struct pollfd *) palloc(nsocks * sizeof(struct pollfd));
+		for (i = 0; i < nsocks; i++)
+		{
+			fds[i].fd = socks[i];
+			fds[i].events = POLLIN | POLLERR;
+			fds[i].revents = 0;
+		}
+		rc = poll(fds, nsocks, timeout_ms);
+		pfree(fds);
+	}
+#else							/* !HAVE_POLL */
+	{
+		fd_set		waitset;
+		pgsocket	maxsock = PGINVALID_SOCKET;
+		struct timeval timeout;
+		int			i;
+
+		FD_ZERO(&waitset);
+		for (i = 0; i < nsocks; i++)
+		{
+			FD_SET(socks[i], &waitset);
+			if (maxsock == PGINVALID_SOCKET || socks[i] > maxsock)
+				maxsock = socks[i];
+		}
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_usec = (timeout_ms % 1000) * 1000;
+		rc = select(maxsock + 1, &waitset, NULL, NULL, &timeout);
+	}
+#endif   /* HAVE_POLL */
+
+	if (rc < 0 && errno != EINTR)
+		ereport(ERROR,
+				(errcode_for_socket_access(),
+				 errmsg("could not wait for foreign scans: %m")));
+}
+
 /* ----------------------------------------------------------------
  *		ExecEndAppend
  *
@@ -286,5 +487,6 @@ ExecReScanAppend(AppendState *node)
 			ExecReScan(subnode);
 	}
 	node->as_whichplan = 0;
+	node->as_async_started = false;
 	exec_append_initialize_next(node);
 }
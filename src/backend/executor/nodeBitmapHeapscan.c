@@ -32,6 +32,10 @@
  *		ExecInitBitmapHeapScan		creates and initializes state info.
  *		ExecReScanBitmapHeapScan	prepares to rescan the plan.
  *		ExecEndBitmapHeapScan		releases all storage.
+ *		ExecBitmapHeapEstimate		estimates DSM space for a parallel scan.
+ *		ExecBitmapHeapInitializeDSM	initializes DSM for a parallel scan.
+ *		ExecBitmapHeapReInitializeDSM	resets DSM before a parallel rescan.
+ *		ExecBitmapHeapInitializeWorker	attaches a worker to a parallel scan.
  */
 #include "postgres.h"
 
@@ -39,9 +43,12 @@
 #include "access/transam.h"
 #include "executor/execdebug.h"
 #include "executor/nodeBitmapHeapscan.h"
+#include "miscadmin.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
+#include "storage/dsm.h"
 #include "storage/predicate.h"
+#include "storage/spin.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/spccache.h"
@@ -49,8 +56,68 @@
 #include "utils/tqual.h"
 
 
+/*
+ * In a parallel bitmap heap scan, one participant builds the bitmap and
+ * copies it into a DSM segment of its own; the others wait for that and then
+ * attach to the segment, so that all of them can iterate over the bitmap
+ * together.  This struct, stored in the parallel query's DSM, coordinates
+ * that.  The prefetch counters are shared as well, so that the participants
+ * together keep the shared prefetch iterator the right distance ahead of
+ * the shared main iterator.
+ */
+typedef enum
+{
+	BM_INITIAL,					/* nobody has started building the bitmap */
+	BM_INPROGRESS,				/* somebody is building it */
+	BM_FINISHED					/* bitmap is available in bitmap_handle */
+} SharedBitmapState;
+
+typedef struct ParallelBitmapHeapState
+{
+	slock_t		mutex;			/* protects the fields below */
+	SharedBitmapState state;
+	dsm_handle	bitmap_handle;	/* segment holding the shared bitmap */
+	uint32		bitmap_cookie;	/* identifies that segment, see below */
+	int			prefetch_pages; /* # pages prefetch iterator is ahead */
+	int			prefetch_target;	/* current target prefetch distance */
+} ParallelBitmapHeapState;
+
+/*
+ * Header of the segment holding a shared bitmap.  It is followed by the
+ * state of the main and the prefetch iteration, and then by the flattened
+ * bitmap itself.
+ *
+ * The segment goes away once every participant attached to it has detached,
+ * which they only do when they are done with the scan.  A participant that
+ * arrives later than that may find the handle gone, or even reused for some
+ * unrelated segment; the cookie lets it tell the difference.  Either way,
+ * there is no work left for it.
+ */
+typedef struct SharedBitmapHeader
+{
+	uint32		cookie;
+} SharedBitmapHeader;
+
+#define SHARED_BITMAP_ITERATOR_OFFSET	MAXALIGN(sizeof(SharedBitmapHeader))
+#define SHARED_BITMAP_PREFETCH_OFFSET \
+	(SHARED_BITMAP_ITERATOR_OFFSET + MAXALIGN(tbm_shared_iterator_size()))
+#define SHARED_BITMAP_DATA_OFFSET \
+	(SHARED_BITMAP_PREFETCH_OFFSET + MAXALIGN(tbm_shared_iterator_size()))
+
+/* How long to sleep while waiting for another participant to build the bitmap */
+#define BITMAP_SHARED_WAIT_USEC		1000L
+
 static TupleTableSlot *BitmapHeapNext(BitmapHeapScanState *node);
 static void bitgetpage(HeapScanDesc scan, TBMIterateResult *tbmres);
+static inline void BitmapAdjustPrefetchIterator(BitmapHeapScanState *node,
+							 TBMIterateResult *tbmres);
+static inline void BitmapAdjustPrefetchTarget(BitmapHeapScanState *node);
+static inline void BitmapPrefetch(BitmapHeapScanState *node,
+			   HeapScanDesc scan);
+static bool BitmapShouldInitializeSharedState(ParallelBitmapHeapState *pstate);
+static void BitmapShareBitmap(BitmapHeapScanState *node);
+static void BitmapAttachSharedBitmap(BitmapHeapScanState *node);
+static void BitmapReleaseBitmap(BitmapHeapScanState *node);
 
 
 /* ----------------------------------------------------------------
@@ -65,12 +132,8 @@ BitmapHeapNext(BitmapHeapScanState *node)
 	ExprContext *econtext;
 	HeapScanDesc scan;
 	TIDBitmap  *tbm;
-	TBMIterator *tbmiterator;
 	TBMIterateResult *tbmres;
-
-#ifdef USE_PREFETCH
-	TBMIterator *prefetch_iterator;
-#endif
+	ParallelBitmapHeapState *pstate = node->pstate;
 	OffsetNumber targoffset;
 	TupleTableSlot *slot;
 
@@ -80,12 +143,7 @@ BitmapHeapNext(BitmapHeapScanState *node)
 	econtext = node->ss.ps.ps_ExprContext;
 	slot = node->ss.ss_ScanTupleSlot;
 	scan = node->ss.ss_currentScanDesc;
-	tbm = node->tbm;
-	tbmiterator = node->tbmiterator;
 	tbmres = node->tbmres;
-#ifdef USE_PREFETCH
-	prefetch_iterator = node->prefetch_iterator;
-#endif
 
 	/*
 	 * If we haven't yet performed the underlying index scan, do it, and begin
@@ -98,26 +156,45 @@ BitmapHeapNext(BitmapHeapScanState *node)
 	 * desired prefetch distance, which starts small and increases up to the
 	 * node->prefetch_maximum.  This is to avoid doing a lot of prefetching in
 	 * a scan that stops after a few tuples because of a LIMIT.
+	 *
+	 * In a parallel scan, both iterators and both counters are shared by all
+	 * participants; see ParallelBitmapHeapState.
 	 */
-	if (tbm == NULL)
+	if (!node->initialized)
 	{
-		tbm = (TIDBitmap *) MultiExecProcNode(outerPlanState(node));
+		if (!pstate)
+		{
+			tbm = (TIDBitmap *) MultiExecProcNode(outerPlanState(node));
 
-		if (!tbm || !IsA(tbm, TIDBitmap))
-			elog(ERROR, "unrecognized result from subplan");
+			if (!tbm || !IsA(tbm, TIDBitmap))
+				elog(ERROR, "unrecognized result from subplan");
 
-		node->tbm = tbm;
-		node->tbmiterator = tbmiterator = tbm_begin_iterate(tbm);
-		node->tbmres = tbmres = NULL;
+			node->tbm = tbm;
+			node->tbmiterator = tbm_begin_iterate(tbm);
 
 #ifdef USE_PREFETCH
-		if (node->prefetch_maximum > 0)
+			if (node->prefetch_maximum > 0)
+			{
+				node->prefetch_iterator = tbm_begin_iterate(tbm);
+				node->prefetch_pages = 0;
+				node->prefetch_target = -1;
+			}
+#endif   /* USE_PREFETCH */
+		}
+		else
 		{
-			node->prefetch_iterator = prefetch_iterator = tbm_begin_iterate(tbm);
-			node->prefetch_pages = 0;
-			node->prefetch_target = -1;
+			/*
+			 * The first participant to get here builds the bitmap and shares
+			 * it; everyone else waits for that to be done.
+			 */
+			if (BitmapShouldInitializeSharedState(pstate))
+				BitmapShareBitmap(node);
+
+			BitmapAttachSharedBitmap(node);
 		}
-#endif   /* USE_PREFETCH */
+
+		node->tbmres = tbmres = NULL;
+		node->initialized = true;
 	}
 
 	for (;;)
@@ -130,28 +207,19 @@ BitmapHeapNext(BitmapHeapScanState *node)
 		 */
 		if (tbmres == NULL)
 		{
-			node->tbmres = tbmres = tbm_iterate(tbmiterator);
+			if (!pstate)
+				tbmres = tbm_iterate(node->tbmiterator);
+			else if (node->shared_tbmiterator)
+				tbmres = tbm_shared_iterate(node->shared_tbmiterator);
+			node->tbmres = tbmres;
+
 			if (tbmres == NULL)
 			{
 				/* no more entries in the bitmap */
 				break;
 			}
 
-#ifdef USE_PREFETCH
-			if (node->prefetch_pages > 0)
-			{
-				/* The main iterator has closed the distance by one page */
-				node->prefetch_pages--;
-			}
-			else if (prefetch_iterator)
-			{
-				/* Do not let the prefetch iterator get behind the main one */
-				TBMIterateResult *tbmpre = tbm_iterate(prefetch_iterator);
-
-				if (tbmpre == NULL || tbmpre->blockno != tbmres->blockno)
-					elog(ERROR, "prefetch and main iterators are out of sync");
-			}
-#endif   /* USE_PREFETCH */
+			BitmapAdjustPrefetchIterator(node, tbmres);
 
 			/*
 			 * Ignore any claimed entries past what we think is the end of the
@@ -180,23 +248,8 @@ BitmapHeapNext(BitmapHeapScanState *node)
 			 */
 			scan->rs_cindex = 0;
 
-#ifdef USE_PREFETCH
-
-			/*
-			 * Increase prefetch target if it's not yet at the max.  Note that
-			 * we will increase it to zero after fetching the very first
-			 * page/tuple, then to one after the second tuple is fetched, then
-			 * it doubles as later pages are fetched.
-			 */
-			if (node->prefetch_target >= node->prefetch_maximum)
-				 /* don't increase any further */ ;
-			else if (node->prefetch_target >= node->prefetch_maximum / 2)
-				node->prefetch_target = node->prefetch_maximum;
-			else if (node->prefetch_target > 0)
-				node->prefetch_target *= 2;
-			else
-				node->prefetch_target++;
-#endif   /* USE_PREFETCH */
+			/* Adjust the prefetch target */
+			BitmapAdjustPrefetchTarget(node);
 		}
 		else
 		{
@@ -211,8 +264,19 @@ BitmapHeapNext(BitmapHeapScanState *node)
 			 * Try to prefetch at least a few pages even before we get to the
 			 * second page if we don't stop reading after the first tuple.
 			 */
-			if (node->prefetch_target < node->prefetch_maximum)
-				node->prefetch_target++;
+			if (!pstate)
+			{
+				if (node->prefetch_target < node->prefetch_maximum)
+					node->prefetch_target++;
+			}
+			else if (pstate->prefetch_target < node->prefetch_maximum)
+			{
+				/* take spinlock while updating shared state */
+				SpinLockAcquire(&pstate->mutex);
+				if (pstate->prefetch_target < node->prefetch_maximum)
+					pstate->prefetch_target++;
+				SpinLockRelease(&pstate->mutex);
+			}
 #endif   /* USE_PREFETCH */
 		}
 
@@ -225,8 +289,6 @@ BitmapHeapNext(BitmapHeapScanState *node)
 			continue;
 		}
 
-#ifdef USE_PREFETCH
-
 		/*
 		 * We issue prefetch requests *after* fetching the current page to try
 		 * to avoid having prefetching interfere with the main I/O. Also, this
@@ -234,24 +296,7 @@ BitmapHeapNext(BitmapHeapScanState *node)
 		 * to do on the current page, else we may uselessly prefetch the same
 		 * page we are just about to request for real.
 		 */
-		if (prefetch_iterator)
-		{
-			while (node->prefetch_pages < node->prefetch_target)
-			{
-				TBMIterateResult *tbmpre = tbm_iterate(prefetch_iterator);
-
-				if (tbmpre == NULL)
-				{
-					/* No more pages to prefetch */
-					tbm_end_iterate(prefetch_iterator);
-					node->prefetch_iterator = prefetch_iterator = NULL;
-					break;
-				}
-				node->prefetch_pages++;
-				PrefetchBuffer(scan->rs_rd, MAIN_FORKNUM, tbmpre->blockno);
-			}
-		}
-#endif   /* USE_PREFETCH */
+		BitmapPrefetch(node, scan);
 
 		/*
 		 * Okay to fetch the tuple
@@ -305,6 +350,332 @@ BitmapHeapNext(BitmapHeapScanState *node)
 	return ExecClearTuple(slot);
 }
 
+/*
+ * BitmapAdjustPrefetchIterator - Adjust the prefetch iterator
+ *
+ * Called after the main iterator has returned tbmres.
+ */
+static inline void
+BitmapAdjustPrefetchIterator(BitmapHeapScanState *node,
+							 TBMIterateResult *tbmres)
+{
+#ifdef USE_PREFETCH
+	ParallelBitmapHeapState *pstate = node->pstate;
+
+	if (!pstate)
+	{
+		if (node->prefetch_pages > 0)
+		{
+			/* The main iterator has closed the distance by one page */
+			node->prefetch_pages--;
+		}
+		else if (node->prefetch_iterator)
+		{
+			/* Do not let the prefetch iterator get behind the main one */
+			TBMIterateResult *tbmpre = tbm_iterate(node->prefetch_iterator);
+
+			if (tbmpre == NULL || tbmpre->blockno != tbmres->blockno)
+				elog(ERROR, "prefetch and main iterators are out of sync");
+		}
+		return;
+	}
+
+	if (node->prefetch_maximum > 0)
+	{
+		SpinLockAcquire(&pstate->mutex);
+		if (pstate->prefetch_pages > 0)
+		{
+			/* The main iterator has closed the distance by one page */
+			pstate->prefetch_pages--;
+			SpinLockRelease(&pstate->mutex);
+		}
+		else
+		{
+			/* Release the mutex before iterating */
+			SpinLockRelease(&pstate->mutex);
+
+			/*
+			 * Do not let the prefetch iterator get behind the main one.
+			 * Other participants advance both iterators concurrently, so we
+			 * can't insist on seeing the same page here.
+			 */
+			if (node->shared_prefetch_iterator)
+				tbm_shared_iterate(node->shared_prefetch_iterator);
+		}
+	}
+#endif   /* USE_PREFETCH */
+}
+
+/*
+ * BitmapAdjustPrefetchTarget - Adjust the prefetch target
+ *
+ * Increase prefetch target if it's not yet at the max.  Note that
+ * we will increase it to zero after fetching the very first
+ * page/tuple, then to one after the second tuple is fetched, then
+ * it doubles as later pages are fetched.
+ */
+static inline void
+BitmapAdjustPrefetchTarget(BitmapHeapScanState *node)
+{
+#ifdef USE_PREFETCH
+	ParallelBitmapHeapState *pstate = node->pstate;
+	int		   *target;
+
+	if (!pstate)
+		target = &node->prefetch_target;
+	else
+	{
+		/* Do an unlocked check first to save spinlock acquisitions. */
+		if (pstate->prefetch_target >= node->prefetch_maximum)
+			return;
+		SpinLockAcquire(&pstate->mutex);
+		target = &pstate->prefetch_target;
+	}
+
+	if (*target >= node->prefetch_maximum)
+		 /* don't increase any further */ ;
+	else if (*target >= node->prefetch_maximum / 2)
+		*target = node->prefetch_maximum;
+	else if (*target > 0)
+		*target *= 2;
+	else
+		(*target)++;
+
+	if (pstate)
+		SpinLockRelease(&pstate->mutex);
+#endif   /* USE_PREFETCH */
+}
+
+/*
+ * BitmapPrefetch - Prefetch, if prefetch_pages are behind prefetch_target
+ */
+static inline void
+BitmapPrefetch(BitmapHeapScanState *node, HeapScanDesc scan)
+{
+#ifdef USE_PREFETCH
+	ParallelBitmapHeapState *pstate = node->pstate;
+
+	if (!pstate)
+	{
+		TBMIterator *prefetch_iterator = node->prefetch_iterator;
+
+		if (prefetch_iterator)
+		{
+			while (node->prefetch_pages < node->prefetch_target)
+			{
+				TBMIterateResult *tbmpre = tbm_iterate(prefetch_iterator);
+
+				if (tbmpre == NULL)
+				{
+					/* No more pages to prefetch */
+					tbm_end_iterate(prefetch_iterator);
+					node->prefetch_iterator = NULL;
+					break;
+				}
+				node->prefetch_pages++;
+				PrefetchBuffer(scan->rs_rd, MAIN_FORKNUM, tbmpre->blockno);
+			}
+		}
+		return;
+	}
+
+	if (pstate->prefetch_pages < pstate->prefetch_target)
+	{
+		TBMSharedIterator *prefetch_iterator = node->shared_prefetch_iterator;
+
+		if (prefetch_iterator)
+		{
+			for (;;)
+			{
+				TBMIterateResult *tbmpre;
+				bool		do_prefetch = false;
+
+				/*
+				 * Recheck under the mutex.  If some other participant has
+				 * already done enough prefetching, we needn't do anything.
+				 */
+				SpinLockAcquire(&pstate->mutex);
+				if (pstate->prefetch_pages < pstate->prefetch_target)
+				{
+					pstate->prefetch_pages++;
+					do_prefetch = true;
+				}
+				SpinLockRelease(&pstate->mutex);
+
+				if (!do_prefetch)
+					return;
+
+				tbmpre = tbm_shared_iterate(prefetch_iterator);
+				if (tbmpre == NULL)
+				{
+					/* No more pages to prefetch */
+					tbm_end_shared_iterate(prefetch_iterator);
+					node->shared_prefetch_iterator = NULL;
+					break;
+				}
+
+				PrefetchBuffer(scan->rs_rd, MAIN_FORKNUM, tbmpre->blockno);
+			}
+		}
+	}
+#endif   /* USE_PREFETCH */
+}
+
+/*
+ * BitmapShouldInitializeSharedState - decide who builds the shared bitmap
+ *
+ * Returns true if the caller is the first participant to get here, in which
+ * case it must build and share the bitmap.  Otherwise, waits until whoever
+ * did that is finished, and returns false.
+ */
+static bool
+BitmapShouldInitializeSharedState(ParallelBitmapHeapState *pstate)
+{
+	SharedBitmapState state;
+
+	for (;;)
+	{
+		SpinLockAcquire(&pstate->mutex);
+		state = pstate->state;
+		if (pstate->state == BM_INITIAL)
+			pstate->state = BM_INPROGRESS;
+		SpinLockRelease(&pstate->mutex);
+
+		if (state != BM_INPROGRESS)
+			break;
+
+		/* Somebody else is building the bitmap; wait for it */
+		CHECK_FOR_INTERRUPTS();
+		pg_usleep(BITMAP_SHARED_WAIT_USEC);
+	}
+
+	return (state == BM_INITIAL);
+}
+
+/*
+ * BitmapShareBitmap - build the bitmap and publish it to all participants
+ *
+ * The bitmap is built privately by the child nodes as usual, then copied
+ * into a new DSM segment.  The private copy is freed right away; this
+ * participant attaches to the shared one like everybody else.
+ */
+static void
+BitmapShareBitmap(BitmapHeapScanState *node)
+{
+	ParallelBitmapHeapState *pstate = node->pstate;
+	TIDBitmap  *tbm;
+	dsm_segment *seg;
+	char	   *base;
+	SharedBitmapHeader *header;
+
+	tbm = (TIDBitmap *) MultiExecProcNode(outerPlanState(node));
+
+	if (!tbm || !IsA(tbm, TIDBitmap))
+		elog(ERROR, "unrecognized result from subplan");
+
+	seg = dsm_create(add_size(SHARED_BITMAP_DATA_OFFSET,
+							  tbm_shared_size(tbm)), 0);
+	base = dsm_segment_address(seg);
+	header = (SharedBitmapHeader *) base;
+	header->cookie = (uint32) random();
+	tbm_init_shared_iterator((TBMSharedIteratorState *)
+							 (base + SHARED_BITMAP_ITERATOR_OFFSET));
+	tbm_init_shared_iterator((TBMSharedIteratorState *)
+							 (base + SHARED_BITMAP_PREFETCH_OFFSET));
+	tbm_share(tbm, base + SHARED_BITMAP_DATA_OFFSET);
+	tbm_free(tbm);
+
+	node->bitmap_seg = seg;
+
+	SpinLockAcquire(&pstate->mutex);
+	pstate->bitmap_handle = dsm_segment_handle(seg);
+	pstate->bitmap_cookie = header->cookie;
+	pstate->prefetch_pages = 0;
+	pstate->prefetch_target = -1;
+	pstate->state = BM_FINISHED;
+	SpinLockRelease(&pstate->mutex);
+}
+
+/*
+ * BitmapAttachSharedBitmap - begin iterating over the shared bitmap
+ *
+ * If the segment has already gone away, the iteration is over and the
+ * shared iterators are left NULL.
+ */
+static void
+BitmapAttachSharedBitmap(BitmapHeapScanState *node)
+{
+	ParallelBitmapHeapState *pstate = node->pstate;
+	dsm_segment *seg = node->bitmap_seg;
+	char	   *base;
+
+	if (seg == NULL)
+	{
+		dsm_handle	handle;
+		uint32		cookie;
+
+		SpinLockAcquire(&pstate->mutex);
+		Assert(pstate->state == BM_FINISHED);
+		handle = pstate->bitmap_handle;
+		cookie = pstate->bitmap_cookie;
+		SpinLockRelease(&pstate->mutex);
+
+		/* A handle we already have mapped can't be ours; it was reused */
+		if (dsm_find_mapping(handle) != NULL)
+			return;
+		seg = dsm_attach(handle);
+		if (seg == NULL)
+			return;
+		if (((SharedBitmapHeader *) dsm_segment_address(seg))->cookie != cookie)
+		{
+			dsm_detach(seg);
+			return;
+		}
+		node->bitmap_seg = seg;
+	}
+
+	base = dsm_segment_address(seg);
+	node->shared_tbmiterator =
+		tbm_attach_shared_iterate(base + SHARED_BITMAP_DATA_OFFSET,
+								  (TBMSharedIteratorState *)
+								  (base + SHARED_BITMAP_ITERATOR_OFFSET));
+#ifdef USE_PREFETCH
+	if (node->prefetch_maximum > 0)
+		node->shared_prefetch_iterator =
+			tbm_attach_shared_iterate(base + SHARED_BITMAP_DATA_OFFSET,
+									  (TBMSharedIteratorState *)
+									  (base + SHARED_BITMAP_PREFETCH_OFFSET));
+#endif   /* USE_PREFETCH */
+}
+
+/*
+ * BitmapReleaseBitmap - release the bitmap and any iterators over it
+ */
+static void
+BitmapReleaseBitmap(BitmapHeapScanState *node)
+{
+	if (node->tbmiterator)
+		tbm_end_iterate(node->tbmiterator);
+	if (node->prefetch_iterator)
+		tbm_end_iterate(node->prefetch_iterator);
+	if (node->tbm)
+		tbm_free(node->tbm);
+	if (node->shared_tbmiterator)
+		tbm_end_shared_iterate(node->shared_tbmiterator);
+	if (node->shared_prefetch_iterator)
+		tbm_end_shared_iterate(node->shared_prefetch_iterator);
+	if (node->bitmap_seg)
+		dsm_detach(node->bitmap_seg);
+	node->tbm = NULL;
+	node->tbmiterator = NULL;
+	node->tbmres = NULL;
+	node->prefetch_iterator = NULL;
+	node->shared_tbmiterator = NULL;
+	node->shared_prefetch_iterator = NULL;
+	node->bitmap_seg = NULL;
+	node->initialized = false;
+}
+
 /*
  * bitgetpage - subroutine for BitmapHeapNext()
  *
@@ -454,16 +825,11 @@ ExecReScanBitmapHeapScan(BitmapHeapScanState *node)
 	/* rescan to release any page pin */
 	heap_rescan(node->ss.ss_currentScanDesc, NULL);
 
-	if (node->tbmiterator)
-		tbm_end_iterate(node->tbmiterator);
-	if (node->prefetch_iterator)
-		tbm_end_iterate(node->prefetch_iterator);
-	if (node->tbm)
-		tbm_free(node->tbm);
-	node->tbm = NULL;
-	node->tbmiterator = NULL;
-	node->tbmres = NULL;
-	node->prefetch_iterator = NULL;
+	/*
+	 * In a parallel scan, the shared state is reset separately, by
+	 * ExecBitmapHeapReInitializeDSM.
+	 */
+	BitmapReleaseBitmap(node);
 
 	ExecScanReScan(&node->ss);
 
@@ -510,12 +876,7 @@ ExecEndBitmapHeapScan(BitmapHeapScanState *node)
 	/*
 	 * release bitmap if any
 	 */
-	if (node->tbmiterator)
-		tbm_end_iterate(node->tbmiterator);
-	if (node->prefetch_iterator)
-		tbm_end_iterate(node->prefetch_iterator);
-	if (node->tbm)
-		tbm_free(node->tbm);
+	BitmapReleaseBitmap(node);
 
 	/*
 	 * close heap scan
@@ -567,6 +928,12 @@ ExecInitBitmapHeapScan(BitmapHeapScan *node, EState *estate, int eflags)
 	scanstate->prefetch_target = 0;
 	/* may be updated below */
 	scanstate->prefetch_maximum = target_prefetch_pages;
+	scanstate->initialized = false;
+	scanstate->pscan_len = 0;
+	scanstate->pstate = NULL;
+	scanstate->bitmap_seg = NULL;
+	scanstate->shared_tbmiterator = NULL;
+	scanstate->shared_prefetch_iterator = NULL;
 
 	/*
 	 * Miscellaneous initialization
@@ -653,3 +1020,79 @@ ExecInitBitmapHeapScan(BitmapHeapScan *node, EState *estate, int eflags)
 	 */
 	return scanstate;
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapEstimate
+ *
+ *		estimates the space required to serialize bitmap scan node.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapEstimate(BitmapHeapScanState *node,
+					   ParallelContext *pcxt)
+{
+	node->pscan_len = sizeof(ParallelBitmapHeapState);
+	shm_toc_estimate_chunk(&pcxt->estimator, node->pscan_len);
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapInitializeDSM
+ *
+ *		Set up the shared state of a parallel bitmap heap scan.  The bitmap
+ *		itself is only built, into a segment of its own, once the scan runs.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapInitializeDSM(BitmapHeapScanState *node,
+							ParallelContext *pcxt)
+{
+	ParallelBitmapHeapState *pstate;
+
+	pstate = shm_toc_allocate(pcxt->toc, node->pscan_len);
+	SpinLockInit(&pstate->mutex);
+	pstate->state = BM_INITIAL;
+	pstate->bitmap_handle = 0;
+	pstate->bitmap_cookie = 0;
+	pstate->prefetch_pages = 0;
+	pstate->prefetch_target = 0;
+	shm_toc_insert(pcxt->toc, node->ss.ps.plan->plan_node_id, pstate);
+	node->pstate = pstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapReInitializeDSM
+ *
+ *		Reset shared state before beginning a fresh scan.  Called in the
+ *		leader only, while no workers are running.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapReInitializeDSM(BitmapHeapScanState *node,
+							  ParallelContext *pcxt)
+{
+	ParallelBitmapHeapState *pstate = node->pstate;
+
+	pstate->state = BM_INITIAL;
+	pstate->bitmap_handle = 0;
+	pstate->bitmap_cookie = 0;
+	pstate->prefetch_pages = 0;
+	pstate->prefetch_target = 0;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBitmapHeapInitializeWorker
+ *
+ *		Copy relevant information from TOC into planstate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecBitmapHeapInitializeWorker(BitmapHeapScanState *node, shm_toc *toc)
+{
+	node->pstate = shm_toc_lookup(toc, node->ss.ps.plan->plan_node_id);
+}
@@ -344,3 +344,37 @@ ExecForeignScanInitializeWorker(ForeignScanState *node, shm_toc *toc)
 		fdwroutine->InitializeWorkerForeignScan(node, toc, coordinate);
 	}
 }
+
+/* ----------------------------------------------------------------
+ *		ExecForeignScanStartAsync
+ *
+ *		Ask the FDW to send the first remote request without waiting
+ *		for its result.  Returns false if the scan can't be executed
+ *		asynchronously, in which case it is run in the usual way.
+ * ----------------------------------------------------------------
+ */
+bool
+ExecForeignScanStartAsync(ForeignScanState *node)
+{
+	FdwRoutine *fdwroutine = node->fdwroutine;
+
+	if (fdwroutine->StartForeignScanAsync == NULL ||
+		fdwroutine->ForeignScanAsyncSocket == NULL)
+		return false;
+
+	return fdwroutine->StartForeignScanAsync(node);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecForeignScanAsyncSocket
+ *
+ *		Returns the socket the caller has to wait on before the next
+ *		ExecProcNode call, or PGINVALID_SOCKET if the next tuple (or the
+ *		end of the scan) can be returned without blocking.
+ * ----------------------------------------------------------------
+ */
+pgsocket
+ExecForeignScanAsyncSocket(ForeignScanState *node)
+{
+	return node->fdwroutine->ForeignScanAsyncSocket(node);
+}
@@ -0,0 +1,510 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeGatherMerge.c
+ *	  Support routines for merging the sorted results of a plan run by
+ *	  multiple workers.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * A Gather Merge executor launches parallel workers to run multiple copies
+ * of a plan, just like Gather, and usually runs the plan itself as well.
+ * Each copy's output is sorted, so rather than returning tuples in whatever
+ * order they arrive, it merges the streams with a binary heap, the same way
+ * MergeAppend merges its sorted subplans.  This lets the workers do the
+ * sorting in parallel, and gives the planner an ordered parallel path to use
+ * for ORDER BY ... LIMIT and merge joins.
+ *
+ * To merge, we need the next tuple of every stream that is still active, so
+ * unlike Gather we must wait for a worker that has nothing to send yet.  The
+ * leader's own stream is read first, so that the leader has done its share
+ * of any work the workers might be waiting for before it blocks on them.
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeGatherMerge.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/relscan.h"
+#include "access/xact.h"
+#include "executor/execdebug.h"
+#include "executor/execParallel.h"
+#include "executor/nodeGatherMerge.h"
+#include "executor/tqueue.h"
+#include "lib/binaryheap.h"
+#include "miscadmin.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+
+/*
+ * We have one slot for each stream: the leader's comes first, then one for
+ * each worker we might get.  We use SlotNumber to store slot indexes.
+ */
+typedef int32 SlotNumber;
+
+static TupleTableSlot *gather_merge_getnext(GatherMergeState *gm_state);
+static bool gather_merge_readnext(GatherMergeState *gm_state,
+					  SlotNumber slotno);
+static int	heap_compare_slots(Datum a, Datum b, void *arg);
+static void ExecShutdownGatherMergeWorkers(GatherMergeState *node);
+
+
+/* ----------------------------------------------------------------
+ *		ExecInitGatherMerge
+ * ----------------------------------------------------------------
+ */
+GatherMergeState *
+ExecInitGatherMerge(GatherMerge *node, EState *estate, int eflags)
+{
+	GatherMergeState *gm_state;
+	Plan	   *outerNode;
+	bool		hasoid;
+	TupleDesc	tupDesc;
+	int			i;
+
+	/* Gather Merge node doesn't have innerPlan node. */
+	Assert(innerPlan(node) == NULL);
+
+	/* check for unsupported flags */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	gm_state = makeNode(GatherMergeState);
+	gm_state->ps.plan = (Plan *) node;
+	gm_state->ps.state = estate;
+	gm_state->need_to_scan_locally = true;
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * create expression context for node
+	 */
+	ExecAssignExprContext(estate, &gm_state->ps);
+
+	/*
+	 * initialize child expressions
+	 */
+	gm_state->ps.targetlist = (List *)
+		ExecInitExpr((Expr *) node->plan.targetlist,
+					 (PlanState *) gm_state);
+	gm_state->ps.qual = (List *)
+		ExecInitExpr((Expr *) node->plan.qual,
+					 (PlanState *) gm_state);
+
+	/*
+	 * tuple table initialization
+	 */
+	ExecInitResultTupleSlot(estate, &gm_state->ps);
+
+	/*
+	 * now initialize outer plan
+	 */
+	outerNode = outerPlan(node);
+	outerPlanState(gm_state) = ExecInitNode(outerNode, estate, eflags);
+
+	gm_state->ps.ps_TupFromTlist = false;
+
+	/*
+	 * Initialize result tuple type and projection info.
+	 */
+	ExecAssignResultTypeFromTL(&gm_state->ps);
+	ExecAssignProjectionInfo(&gm_state->ps, NULL);
+
+	/*
+	 * Set up a slot for each worker's stream, with the same tuple descriptor
+	 * as the outer plan.  The leader's slot is just whatever the outer plan
+	 * returns.
+	 */
+	if (!ExecContextForcesOids(&gm_state->ps, &hasoid))
+		hasoid = false;
+	tupDesc = ExecTypeFromTL(outerNode->targetlist, hasoid);
+	gm_state->gm_slots = (TupleTableSlot **)
+		palloc0((node->num_workers + 1) * sizeof(TupleTableSlot *));
+	for (i = 1; i <= node->num_workers; i++)
+	{
+		gm_state->gm_slots[i] = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(gm_state->gm_slots[i], tupDesc);
+	}
+	gm_state->gm_heap = binaryheap_allocate(node->num_workers + 1,
+											heap_compare_slots,
+											gm_state);
+
+	/*
+	 * initialize sort-key information
+	 */
+	gm_state->gm_nkeys = node->numCols;
+	gm_state->gm_sortkeys = palloc0(sizeof(SortSupportData) * node->numCols);
+
+	for (i = 0; i < node->numCols; i++)
+	{
+		SortSupport sortKey = gm_state->gm_sortkeys + i;
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = node->collations[i];
+		sortKey->ssup_nulls_first = node->nullsFirst[i];
+		sortKey->ssup_attno = node->sortColIdx[i];
+
+		/* As in MergeAppend, abbreviated keys wouldn't pay for themselves */
+		sortKey->abbreviate = false;
+
+		PrepareSortSupportFromOrderingOp(node->sortOperators[i], sortKey);
+	}
+
+	return gm_state;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecGatherMerge(node)
+ *
+ *		Scans the relation via multiple workers and returns
+ *		the next qualifying tuple, in sort order.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecGatherMerge(GatherMergeState *node)
+{
+	TupleTableSlot *slot;
+	TupleTableSlot *resultSlot;
+	ExprDoneCond isDone;
+	ExprContext *econtext;
+	int			i;
+
+	/*
+	 * As with Gather, initialize the parallel context and workers on first
+	 * execution rather than during node initialization.
+	 */
+	if (!node->initialized)
+	{
+		EState	   *estate = node->ps.state;
+		GatherMerge *gm = (GatherMerge *) node->ps.plan;
+
+		/*
+		 * Sometimes we might have to run without parallelism; but if
+		 * parallel mode is active then we can try to fire up some workers.
+		 */
+		node->nreaders = 0;
+		if (gm->num_workers > 0 && IsInParallelMode())
+		{
+			TupleDesc	tupDesc = node->gm_slots[1]->tts_tupleDescriptor;
+			ParallelContext *pcxt;
+
+			/* Initialize the workers required to execute Gather Merge node. */
+			if (!node->pei)
+				node->pei = ExecInitParallelPlan(node->ps.lefttree,
+												 estate,
+												 gm->num_workers);
+
+			/*
+			 * Register backend workers. We might not get as many as we
+			 * requested, or indeed any at all.
+			 */
+			pcxt = node->pei->pcxt;
+			LaunchParallelWorkers(pcxt);
+
+			/* Set up tuple queue readers to read the results. */
+			if (pcxt->nworkers > 0)
+			{
+				node->reader =
+					palloc(pcxt->nworkers * sizeof(TupleQueueReader *));
+
+				for (i = 0; i < pcxt->nworkers; ++i)
+				{
+					if (pcxt->worker[i].bgwhandle == NULL)
+						continue;
+
+					shm_mq_set_handle(node->pei->tqueue[i],
+									  pcxt->worker[i].bgwhandle);
+					node->reader[node->nreaders++] =
+						CreateTupleQueueReader(node->pei->tqueue[i],
+											   tupDesc);
+				}
+			}
+		}
+
+		node->need_to_scan_locally = true;
+		node->initialized = true;
+	}
+
+	/*
+	 * Check to see if we're still projecting out tuples from a previous scan
+	 * tuple (because there is a function-returning-set in the projection
+	 * expressions).  If so, try to project another one.
+	 */
+	if (node->ps.ps_TupFromTlist)
+	{
+		resultSlot = ExecProject(node->ps.ps_ProjInfo, &isDone);
+		if (isDone == ExprMultipleResult)
+			return resultSlot;
+		/* Done with that source tuple... */
+		node->ps.ps_TupFromTlist = false;
+	}
+
+	/*
+	 * Reset per-tuple memory context to free any expression evaluation
+	 * storage allocated in the previous tuple cycle.  Note we can't do this
+	 * until we're done projecting.
+	 */
+	econtext = node->ps.ps_ExprContext;
+	ResetExprContext(econtext);
+
+	/* Get and return the next tuple, projecting if necessary. */
+	for (;;)
+	{
+		/* Get the next tuple in sort order from any of the streams. */
+		slot = gather_merge_getnext(node);
+		if (TupIsNull(slot))
+			return NULL;
+
+		/*
+		 * form the result tuple using ExecProject(), and return it --- unless
+		 * the projection produces an empty set, in which case we must loop
+		 * back around for another tuple
+		 */
+		econtext->ecxt_outertuple = slot;
+		resultSlot = ExecProject(node->ps.ps_ProjInfo, &isDone);
+
+		if (isDone != ExprEndResult)
+		{
+			node->ps.ps_TupFromTlist = (isDone == ExprMultipleResult);
+			return resultSlot;
+		}
+	}
+
+	return slot;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndGatherMerge
+ *
+ *		frees any storage allocated through C routines.
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndGatherMerge(GatherMergeState *node)
+{
+	ExecShutdownGatherMerge(node);
+	ExecFreeExprContext(&node->ps);
+	ExecClearTuple(node->ps.ps_ResultTupleSlot);
+	ExecEndNode(outerPlanState(node));
+}
+
+/*
+ * Return the slot holding the next tuple in sort order, or NULL once all
+ * the streams are exhausted.
+ */
+static TupleTableSlot *
+gather_merge_getnext(GatherMergeState *gm_state)
+{
+	SlotNumber	i;
+
+	if (!gm_state->gm_initialized)
+	{
+		/*
+		 * First time through: fetch the first tuple of each stream, our own
+		 * first, and set up the heap.
+		 */
+		for (i = 0; i <= gm_state->nreaders; i++)
+		{
+			if (gather_merge_readnext(gm_state, i))
+				binaryheap_add_unordered(gm_state->gm_heap, Int32GetDatum(i));
+		}
+		binaryheap_build(gm_state->gm_heap);
+		gm_state->gm_initialized = true;
+	}
+	else if (!binaryheap_empty(gm_state->gm_heap))
+	{
+		/*
+		 * Otherwise, replace the tuple we returned last time with the next
+		 * one from the same stream, and let it find its place in the heap.
+		 */
+		i = DatumGetInt32(binaryheap_first(gm_state->gm_heap));
+		if (gather_merge_readnext(gm_state, i))
+			binaryheap_replace_first(gm_state->gm_heap, Int32GetDatum(i));
+		else
+			(void) binaryheap_remove_first(gm_state->gm_heap);
+	}
+
+	if (binaryheap_empty(gm_state->gm_heap))
+	{
+		/* All the streams are exhausted, and so is the heap */
+		ExecShutdownGatherMergeWorkers(gm_state);
+		return NULL;
+	}
+
+	i = DatumGetInt32(binaryheap_first(gm_state->gm_heap));
+	return gm_state->gm_slots[i];
+}
+
+/*
+ * Fetch the next tuple of the given stream into its slot, waiting for it if
+ * it comes from a worker.  Returns false if the stream is exhausted.
+ */
+static bool
+gather_merge_readnext(GatherMergeState *gm_state, SlotNumber slotno)
+{
+	TupleQueueReader *reader;
+	HeapTuple	tup;
+	bool		readerdone;
+
+	/* Our own stream comes from running the plan locally */
+	if (slotno == 0)
+	{
+		PlanState  *outerPlan = outerPlanState(gm_state);
+		TupleTableSlot *outerTupleSlot;
+
+		if (!gm_state->need_to_scan_locally)
+			return false;
+
+		outerTupleSlot = ExecProcNode(outerPlan);
+		if (TupIsNull(outerTupleSlot))
+		{
+			gm_state->need_to_scan_locally = false;
+			return false;
+		}
+		gm_state->gm_slots[slotno] = outerTupleSlot;
+		return true;
+	}
+
+	/* Make sure we've read all messages from workers. */
+	HandleParallelMessages();
+
+	reader = gm_state->reader[slotno - 1];
+	tup = TupleQueueReaderNext(reader, false, &readerdone);
+	if (readerdone)
+	{
+		ExecClearTuple(gm_state->gm_slots[slotno]);
+		return false;
+	}
+	Assert(HeapTupleIsValid(tup));
+
+	ExecStoreTuple(tup,			/* tuple to store */
+				   gm_state->gm_slots[slotno],	/* slot to store it in */
+				   InvalidBuffer,	/* buffer associated with this tuple */
+				   true);		/* pfree this pointer if not from heap */
+	return true;
+}
+
+/*
+ * Compare the tuples in the two given slots.
+ */
+static int32
+heap_compare_slots(Datum a, Datum b, void *arg)
+{
+	GatherMergeState *node = (GatherMergeState *) arg;
+	SlotNumber	slot1 = DatumGetInt32(a);
+	SlotNumber	slot2 = DatumGetInt32(b);
+
+	TupleTableSlot *s1 = node->gm_slots[slot1];
+	TupleTableSlot *s2 = node->gm_slots[slot2];
+	int			nkey;
+
+	Assert(!TupIsNull(s1));
+	Assert(!TupIsNull(s2));
+
+	for (nkey = 0; nkey < node->gm_nkeys; nkey++)
+	{
+		SortSupport sortKey = node->gm_sortkeys + nkey;
+		AttrNumber	attno = sortKey->ssup_attno;
+		Datum		datum1,
+					datum2;
+		bool		isNull1,
+					isNull2;
+		int			compare;
+
+		datum1 = slot_getattr(s1, attno, &isNull1);
+		datum2 = slot_getattr(s2, attno, &isNull2);
+
+		compare = ApplySortComparator(datum1, isNull1,
+									  datum2, isNull2,
+									  sortKey);
+		if (compare != 0)
+			return -compare;
+	}
+	return 0;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecShutdownGatherMergeWorkers
+ *
+ *		Destroy the parallel workers.  Collect all the stats after
+ *		workers are stopped, else some work done by workers won't be
+ *		accounted.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecShutdownGatherMergeWorkers(GatherMergeState *node)
+{
+	/* Shut down tuple queue readers before shutting down workers. */
+	if (node->reader != NULL)
+	{
+		int			i;
+
+		for (i = 0; i < node->nreaders; ++i)
+			DestroyTupleQueueReader(node->reader[i]);
+
+		pfree(node->reader);
+		node->reader = NULL;
+	}
+
+	/* Now shut down the workers. */
+	if (node->pei != NULL)
+		ExecParallelFinish(node->pei);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecShutdownGatherMerge
+ *
+ *		Destroy the setup for parallel workers including parallel context.
+ *		Collect all the stats after workers are stopped, else some work
+ *		done by workers won't be accounted.
+ * ----------------------------------------------------------------
+ */
+void
+ExecShutdownGatherMerge(GatherMergeState *node)
+{
+	ExecShutdownGatherMergeWorkers(node);
+
+	/* Now destroy the parallel context. */
+	if (node->pei != NULL)
+	{
+		ExecParallelCleanup(node->pei);
+		node->pei = NULL;
+	}
+}
+
+/* ----------------------------------------------------------------
+ *						Join Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecReScanGatherMerge
+ *
+ *		Re-initialize the workers and rescans a relation via them.
+ * ----------------------------------------------------------------
+ */
+void
+ExecReScanGatherMerge(GatherMergeState *node)
+{
+	/*
+	 * As in ExecReScanGather, shut down the workers gracefully and reuse
+	 * the parallel context for the rescan.  The streams are set up again,
+	 * perhaps with a different number of workers, on the next call.
+	 */
+	ExecShutdownGatherMergeWorkers(node);
+
+	node->initialized = false;
+	node->gm_initialized = false;
+	binaryheap_reset(node->gm_heap);
+
+	if (node->pei)
+		ExecParallelReinitialize(node->pei);
+
+	ExecReScan(node->ps.lefttree);
+}
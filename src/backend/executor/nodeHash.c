@@ -32,6 +32,7 @@
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
 #include "miscadmin.h"
+#include "storage/dsm.h"
 #include "utils/dynahash.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
@@ -47,9 +48,59 @@ static void ExecHashSkewTableInsert(HashJoinTable hashtable,
 						uint32 hashvalue,
 						int bucketNumber);
 static void ExecHashRemoveNextSkewBucket(HashJoinTable hashtable);
+static double ExecHashBuildShared(HashState *node);
+static void ExecHashCreateShared(HashJoinTable hashtable);
+static bool ExecHashAttachShared(HashJoinTable hashtable);
+static void ExecHashLoadShared(HashJoinTable hashtable, Size offset);
+static void ExecHashWaitForPhase(ParallelHashJoinState *pstate,
+					 ParallelHashJoinPhase phase);
 
 static void *dense_alloc(HashJoinTable hashtable, Size size);
 
+/*
+ * Segment holding a shared hash table: a SharedHashTableHeader, then the
+ * array of bucket heads, then the tuples.  See ParallelHashJoinState.
+ */
+typedef struct SharedHashTableHeader
+{
+	uint32		cookie;			/* must match ParallelHashJoinState's */
+	int			nbuckets;		/* # buckets (a power of 2) */
+	double		ntuples;		/* # tuples in the table */
+	Size		tuples_offset;	/* start of the tuples */
+} SharedHashTableHeader;
+
+#define SHARED_HASH_BUCKETS_OFFSET	MAXALIGN(sizeof(SharedHashTableHeader))
+
+/* Sleep between checks while waiting for the other participants */
+#define SHARED_HASH_WAIT_USEC		1000L
+
+/*
+ * In a shared hash table, bucket heads and tuple links are offsets from the
+ * start of the segment, with 0 meaning none.
+ */
+static inline HashJoinTuple
+ExecHashFirstTuple(HashJoinTable hashtable, int bucketno)
+{
+	Size		offset;
+
+	if (hashtable->parallel_state == NULL)
+		return hashtable->buckets[bucketno];
+	if (hashtable->shared_buckets == NULL)
+		return NULL;
+	offset = (Size) pg_atomic_read_u64(&hashtable->shared_buckets[bucketno]);
+	return offset == 0 ? NULL :
+		(HashJoinTuple) (hashtable->shared_base + offset);
+}
+
+static inline HashJoinTuple
+ExecHashNextTuple(HashJoinTable hashtable, HashJoinTuple tuple)
+{
+	if (hashtable->parallel_state == NULL)
+		return tuple->next.unshared;
+	return tuple->next.shared == 0 ? NULL :
+		(HashJoinTuple) (hashtable->shared_base + tuple->next.shared);
+}
+
 /* ----------------------------------------------------------------
  *		ExecHash
  *
@@ -90,6 +141,18 @@ MultiExecHash(HashState *node)
 	outerNode = outerPlanState(node);
 	hashtable = node->hashtable;
 
+	/*
+	 * A parallel-aware hash join builds one table with the other participants
+	 */
+	if (hashtable->parallel_state != NULL)
+	{
+		double		ntuples = ExecHashBuildShared(node);
+
+		if (node->ps.instrument)
+			InstrStopNode(node->ps.instrument, ntuples);
+		return NULL;
+	}
+
 	/*
 	 * set expression context
 	 */
@@ -243,7 +306,8 @@ ExecEndHash(HashState *node)
  * ----------------------------------------------------------------
  */
 HashJoinTable
-ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
+ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls,
+					ParallelHashJoinState *parallel_state)
 {
 	HashJoinTable hashtable;
 	Plan	   *outerNode;
@@ -267,6 +331,13 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 							OidIsValid(node->skewTable),
 							&nbuckets, &nbatch, &num_skew_mcvs);
 
+	/*
+	 * A shared table is never split into batches, and is sized once all the
+	 * participants know how many tuples they have; see ExecHashBuildShared.
+	 */
+	if (parallel_state != NULL)
+		nbatch = 1;
+
 	/* nbuckets must be a power of 2 */
 	log2_nbuckets = my_log2(nbuckets);
 	Assert(nbuckets == (1 << log2_nbuckets));
@@ -306,6 +377,10 @@ ExecHashTableCreate(Hash *node, List *hashOperators, bool keepNulls)
 	hashtable->spaceAllowedSkew =
 		hashtable->spaceAllowed * SKEW_WORK_MEM_PERCENT / 100;
 	hashtable->chunks = NULL;
+	hashtable->parallel_state = parallel_state;
+	hashtable->shared_seg = NULL;
+	hashtable->shared_base = NULL;
+	hashtable->shared_buckets = NULL;
 
 #ifdef HJDEBUG
 	printf("Hashjoin %p: initial nbatch = %d, nbuckets = %d\n",
@@ -581,6 +656,10 @@ ExecHashTableDestroy(HashJoinTable hashtable)
 			BufFileClose(hashtable->outerBatchFile[i]);
 	}
 
+	/* Detach from the shared table, if any */
+	if (hashtable->shared_seg != NULL)
+		dsm_detach(hashtable->shared_seg);
+
 	/* Release working memory (batchCxt is a child, so it goes away too) */
 	MemoryContextDelete(hashtable->hashCxt);
 
@@ -707,7 +786,7 @@ ExecHashIncreaseNumBatches(HashJoinTable hashtable)
 				memcpy(copyTuple, hashTuple, hashTupleSize);
 
 				/* and add it back to the appropriate bucket */
-				copyTuple->next = hashtable->buckets[bucketno];
+				copyTuple->next.unshared = hashtable->buckets[bucketno];
 				hashtable->buckets[bucketno] = copyTuple;
 			}
 			else
@@ -808,7 +887,7 @@ ExecHashIncreaseNumBuckets(HashJoinTable hashtable)
 									  &bucketno, &batchno);
 
 			/* add the tuple to the proper bucket */
-			hashTuple->next = hashtable->buckets[bucketno];
+			hashTuple->next.unshared = hashtable->buckets[bucketno];
 			hashtable->buckets[bucketno] = hashTuple;
 
 			/* advance index past the tuple */
@@ -870,7 +949,7 @@ ExecHashTableInsert(HashJoinTable hashtable,
 		HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(hashTuple));
 
 		/* Push it onto the front of the bucket's list */
-		hashTuple->next = hashtable->buckets[bucketno];
+		hashTuple->next.unshared = hashtable->buckets[bucketno];
 		hashtable->buckets[bucketno] = hashTuple;
 
 		/*
@@ -1077,11 +1156,11 @@ ExecScanHashBucket(HashJoinState *hjstate,
 	 * otherwise scan the standard hashtable bucket.
 	 */
 	if (hashTuple != NULL)
-		hashTuple = hashTuple->next;
+		hashTuple = ExecHashNextTuple(hashtable, hashTuple);
 	else if (hjstate->hj_CurSkewBucketNo != INVALID_SKEW_BUCKET_NO)
 		hashTuple = hashtable->skewBucket[hjstate->hj_CurSkewBucketNo]->tuples;
 	else
-		hashTuple = hashtable->buckets[hjstate->hj_CurBucketNo];
+		hashTuple = ExecHashFirstTuple(hashtable, hjstate->hj_CurBucketNo);
 
 	while (hashTuple != NULL)
 	{
@@ -1105,7 +1184,7 @@ ExecScanHashBucket(HashJoinState *hjstate,
 			}
 		}
 
-		hashTuple = hashTuple->next;
+		hashTuple = ExecHashNextTuple(hashtable, hashTuple);
 	}
 
 	/*
@@ -1156,7 +1235,7 @@ ExecScanHashTableForUnmatched(HashJoinState *hjstate, ExprContext *econtext)
 		 * bucket.
 		 */
 		if (hashTuple != NULL)
-			hashTuple = hashTuple->next;
+			hashTuple = hashTuple->next.unshared;
 		else if (hjstate->hj_CurBucketNo < hashtable->nbuckets)
 		{
 			hashTuple = hashtable->buckets[hjstate->hj_CurBucketNo];
@@ -1195,7 +1274,7 @@ ExecScanHashTableForUnmatched(HashJoinState *hjstate, ExprContext *econtext)
 				return true;
 			}
 
-			hashTuple = hashTuple->next;
+			hashTuple = hashTuple->next.unshared;
 		}
 	}
 
@@ -1248,7 +1327,7 @@ ExecHashTableResetMatchFlags(HashJoinTable hashtable)
 	/* Reset all flags in the main table ... */
 	for (i = 0; i < hashtable->nbuckets; i++)
 	{
-		for (tuple = hashtable->buckets[i]; tuple != NULL; tuple = tuple->next)
+		for (tuple = hashtable->buckets[i]; tuple != NULL; tuple = tuple->next.unshared)
 			HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(tuple));
 	}
 
@@ -1258,7 +1337,7 @@ ExecHashTableResetMatchFlags(HashJoinTable hashtable)
 		int			j = hashtable->skewBucketNums[i];
 		HashSkewBucket *skewBucket = hashtable->skewBucket[j];
 
-		for (tuple = skewBucket->tuples; tuple != NULL; tuple = tuple->next)
+		for (tuple = skewBucket->tuples; tuple != NULL; tuple = tuple->next.unshared)
 			HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(tuple));
 	}
 }
@@ -1510,7 +1589,7 @@ ExecHashSkewTableInsert(HashJoinTable hashtable,
 	HeapTupleHeaderClearMatch(HJTUPLE_MINTUPLE(hashTuple));
 
 	/* Push it onto the front of the skew bucket's list */
-	hashTuple->next = hashtable->skewBucket[bucketNumber]->tuples;
+	hashTuple->next.unshared = hashtable->skewBucket[bucketNumber]->tuples;
 	hashtable->skewBucket[bucketNumber]->tuples = hashTuple;
 
 	/* Account for space used, and back off if we've used too much */
@@ -1559,7 +1638,7 @@ ExecHashRemoveNextSkewBucket(HashJoinTable hashtable)
 	hashTuple = bucket->tuples;
 	while (hashTuple != NULL)
 	{
-		HashJoinTuple nextHashTuple = hashTuple->next;
+		HashJoinTuple nextHashTuple = hashTuple->next.unshared;
 		MinimalTuple tuple;
 		Size		tupleSize;
 
@@ -1585,7 +1664,7 @@ ExecHashRemoveNextSkewBucket(HashJoinTable hashtable)
 			memcpy(copyTuple, hashTuple, tupleSize);
 			pfree(hashTuple);
 
-			copyTuple->next = hashtable->buckets[bucketno];
+			copyTuple->next.unshared = hashtable->buckets[bucketno];
 			hashtable->buckets[bucketno] = copyTuple;
 
 			/* We have reduced skew space, but overall space doesn't change */
@@ -1714,3 +1793,292 @@ dense_alloc(HashJoinTable hashtable, Size size)
 	/* return pointer to the start of the tuple memory */
 	return ptr;
 }
+
+/*
+ * ExecHashBuildShared
+ *		build a hash table shared by the participants of a parallel-aware
+ *		hash join
+ *
+ * See ParallelHashJoinState for the protocol.  Returns the number of tuples
+ * this participant contributed.
+ */
+static double
+ExecHashBuildShared(HashState *node)
+{
+	HashJoinTable hashtable = node->hashtable;
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	PlanState  *outerNode = outerPlanState(node);
+	ExprContext *econtext = node->ps.ps_ExprContext;
+	TupleTableSlot *slot;
+	uint32		hashvalue;
+	double		ntuples = 0;
+	Size		space = 0;
+	Size		offset;
+	bool		participate;
+	bool		last;
+
+	/* Join in, unless the build is already past the point where we'd help */
+	SpinLockAcquire(&pstate->mutex);
+	participate = (pstate->phase == PHJ_BUILDING);
+	if (participate)
+		pstate->nparticipants++;
+	SpinLockRelease(&pstate->mutex);
+
+	if (!participate)
+	{
+		ExecHashWaitForPhase(pstate, PHJ_PROBING);
+
+		/*
+		 * If the table is gone, everybody else has finished the join, so
+		 * there's nothing left to probe it with either.
+		 */
+		if (!ExecHashAttachShared(hashtable))
+			hashtable->totalTuples = 0;
+		return 0;
+	}
+
+	/* Hash our share of the inner relation into private memory */
+	for (;;)
+	{
+		slot = ExecProcNode(outerNode);
+		if (TupIsNull(slot))
+			break;
+		econtext->ecxt_innertuple = slot;
+		if (ExecHashGetHashValue(hashtable, econtext, node->hashkeys,
+								 false, hashtable->keepNulls,
+								 &hashvalue))
+		{
+			MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot);
+			int			hashTupleSize = HJTUPLE_OVERHEAD + tuple->t_len;
+			HashJoinTuple hashTuple;
+
+			hashTuple = (HashJoinTuple) dense_alloc(hashtable, hashTupleSize);
+			hashTuple->hashvalue = hashvalue;
+			memcpy(HJTUPLE_MINTUPLE(hashTuple), tuple, tuple->t_len);
+			space += MAXALIGN(hashTupleSize);
+			ntuples += 1;
+		}
+	}
+
+	/*
+	 * Reserve room for our tuples in the shared table.  The last participant
+	 * to get here creates it, and closes the build to latecomers right away.
+	 */
+	SpinLockAcquire(&pstate->mutex);
+	offset = pstate->tuple_space;
+	pstate->tuple_space += space;
+	pstate->ntuples += ntuples;
+	pstate->nscanned++;
+	last = (pstate->nscanned == pstate->nparticipants);
+	if (last)
+		pstate->phase = PHJ_CREATING;
+	SpinLockRelease(&pstate->mutex);
+
+	if (last)
+		ExecHashCreateShared(hashtable);
+	else
+		ExecHashWaitForPhase(pstate, PHJ_LOADING);
+
+	if (!ExecHashAttachShared(hashtable))
+		elog(ERROR, "could not attach to shared hash table");
+
+	ExecHashLoadShared(hashtable, offset);
+
+	/* The table is complete when everybody has loaded their tuples */
+	SpinLockAcquire(&pstate->mutex);
+	if (++pstate->nloaded == pstate->nparticipants)
+		pstate->phase = PHJ_PROBING;
+	SpinLockRelease(&pstate->mutex);
+
+	ExecHashWaitForPhase(pstate, PHJ_PROBING);
+
+	return ntuples;
+}
+
+/*
+ * ExecHashCreateShared
+ *		create the segment for a shared hash table, once all participants
+ *		have reserved space for their tuples
+ */
+static void
+ExecHashCreateShared(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	SharedHashTableHeader *header;
+	pg_atomic_uint64 *buckets;
+	dsm_segment *seg;
+	Size		tuple_space;
+	Size		tuples_offset;
+	double		ntuples;
+	double		dbuckets;
+	int			nbuckets;
+	int			i;
+
+	SpinLockAcquire(&pstate->mutex);
+	Assert(pstate->phase == PHJ_CREATING);
+	tuple_space = pstate->tuple_space;
+	ntuples = pstate->ntuples;
+	SpinLockRelease(&pstate->mutex);
+
+	/* Unlike a private table, we know exactly how many tuples there are */
+	dbuckets = ceil(ntuples / NTUP_PER_BUCKET);
+	dbuckets = Min(dbuckets, (double) (INT_MAX / 2));
+	nbuckets = Max((int) dbuckets, 1024);
+	nbuckets = 1 << my_log2(nbuckets);
+
+	tuples_offset = MAXALIGN(add_size(SHARED_HASH_BUCKETS_OFFSET,
+							  mul_size(nbuckets, sizeof(pg_atomic_uint64))));
+	seg = dsm_create(add_size(tuples_offset, tuple_space), 0);
+
+	header = (SharedHashTableHeader *) dsm_segment_address(seg);
+	header->cookie = (uint32) random();
+	header->nbuckets = nbuckets;
+	header->ntuples = ntuples;
+	header->tuples_offset = tuples_offset;
+	buckets = (pg_atomic_uint64 *)
+		((char *) header + SHARED_HASH_BUCKETS_OFFSET);
+	for (i = 0; i < nbuckets; i++)
+		pg_atomic_init_u64(&buckets[i], 0);
+
+	hashtable->shared_seg = seg;
+
+	SpinLockAcquire(&pstate->mutex);
+	pstate->handle = dsm_segment_handle(seg);
+	pstate->cookie = header->cookie;
+	pstate->phase = PHJ_LOADING;
+	SpinLockRelease(&pstate->mutex);
+}
+
+/*
+ * ExecHashAttachShared
+ *		set up this participant's view of the shared hash table
+ *
+ * Returns false if the segment has already gone away.
+ */
+static bool
+ExecHashAttachShared(HashJoinTable hashtable)
+{
+	ParallelHashJoinState *pstate = hashtable->parallel_state;
+	dsm_segment *seg = hashtable->shared_seg;
+	SharedHashTableHeader *header;
+
+	if (seg == NULL)
+	{
+		dsm_handle	handle;
+		uint32		cookie;
+
+		SpinLockAcquire(&pstate->mutex);
+		Assert(pstate->phase >= PHJ_LOADING);
+		handle = pstate->handle;
+		cookie = pstate->cookie;
+		SpinLockRelease(&pstate->mutex);
+
+		/* A handle we already have mapped can't be ours; it was reused */
+		if (dsm_find_mapping(handle) != NULL)
+			return false;
+		seg = dsm_attach(handle);
+		if (seg == NULL)
+			return false;
+		if (((SharedHashTableHeader *) dsm_segment_address(seg))->cookie != cookie)
+		{
+			dsm_detach(seg);
+			return false;
+		}
+		hashtable->shared_seg = seg;
+	}
+
+	header = (SharedHashTableHeader *) dsm_segment_address(seg);
+	hashtable->shared_base = (char *) header;
+	hashtable->shared_buckets = (pg_atomic_uint64 *)
+		(hashtable->shared_base + SHARED_HASH_BUCKETS_OFFSET);
+	hashtable->nbuckets = header->nbuckets;
+	hashtable->log2_nbuckets = my_log2(header->nbuckets);
+	hashtable->nbuckets_original = hashtable->nbuckets;
+	hashtable->nbuckets_optimal = hashtable->nbuckets;
+	hashtable->log2_nbuckets_optimal = hashtable->log2_nbuckets;
+	hashtable->totalTuples = header->ntuples;
+
+	/* Report the size of the whole table in EXPLAIN ANALYZE */
+	hashtable->spaceUsed = dsm_segment_map_length(seg);
+	hashtable->spacePeak = Max(hashtable->spacePeak, hashtable->spaceUsed);
+
+	return true;
+}
+
+/*
+ * ExecHashLoadShared
+ *		copy this participant's tuples into the shared hash table, at the
+ *		given offset within the tuple space, and link them into the buckets
+ */
+static void
+ExecHashLoadShared(HashJoinTable hashtable, Size offset)
+{
+	SharedHashTableHeader *header;
+	HashMemoryChunk chunk;
+	Size		dest;
+
+	header = (SharedHashTableHeader *) hashtable->shared_base;
+	dest = header->tuples_offset + offset;
+
+	for (chunk = hashtable->chunks; chunk != NULL; chunk = chunk->next)
+	{
+		size_t		idx = 0;
+
+		while (idx < chunk->used)
+		{
+			HashJoinTuple hashTuple = (HashJoinTuple) (chunk->data + idx);
+			MinimalTuple tuple = HJTUPLE_MINTUPLE(hashTuple);
+			int			hashTupleSize = (HJTUPLE_OVERHEAD + tuple->t_len);
+			HashJoinTuple copyTuple;
+			pg_atomic_uint64 *bucket;
+			uint64		head;
+			int			bucketno;
+			int			batchno;
+
+			copyTuple = (HashJoinTuple) (hashtable->shared_base + dest);
+			memcpy(copyTuple, hashTuple, hashTupleSize);
+
+			/* push it onto its bucket's list */
+			ExecHashGetBucketAndBatch(hashtable, hashTuple->hashvalue,
+									  &bucketno, &batchno);
+			bucket = &hashtable->shared_buckets[bucketno];
+			head = pg_atomic_read_u64(bucket);
+			do
+			{
+				copyTuple->next.shared = (Size) head;
+			} while (!pg_atomic_compare_exchange_u64(bucket, &head, dest));
+
+			dest += MAXALIGN(hashTupleSize);
+			idx += MAXALIGN(hashTupleSize);
+		}
+	}
+
+	/* The private copies and buckets aren't needed any more */
+	MemoryContextReset(hashtable->batchCxt);
+	hashtable->chunks = NULL;
+	hashtable->buckets = NULL;
+}
+
+/*
+ * ExecHashWaitForPhase
+ *		wait until the shared hash table build has reached the given phase
+ */
+static void
+ExecHashWaitForPhase(ParallelHashJoinState *pstate,
+					 ParallelHashJoinPhase phase)
+{
+	for (;;)
+	{
+		ParallelHashJoinPhase current;
+
+		SpinLockAcquire(&pstate->mutex);
+		current = pstate->phase;
+		SpinLockRelease(&pstate->mutex);
+
+		if (current >= phase)
+			break;
+
+		CHECK_FOR_INTERRUPTS();
+		pg_usleep(SHARED_HASH_WAIT_USEC);
+	}
+}
@@ -168,7 +168,8 @@ ExecHashJoin(HashJoinState *node)
 				 */
 				hashtable = ExecHashTableCreate((Hash *) hashNode->ps.plan,
 												node->hj_HashOperators,
-												HJ_FILL_INNER(node));
+												HJ_FILL_INNER(node),
+												node->hj_ParallelState);
 				node->hj_HashTable = hashtable;
 
 				/*
@@ -296,7 +297,9 @@ ExecHashJoin(HashJoinState *node)
 				if (joinqual == NIL || ExecQual(joinqual, econtext, false))
 				{
 					node->hj_MatchedOuter = true;
-					HeapTupleHeaderSetMatch(HJTUPLE_MINTUPLE(node->hj_CurTuple));
+					/* only right/full joins look at the inner match flags */
+					if (HJ_FILL_INNER(node))
+						HeapTupleHeaderSetMatch(HJTUPLE_MINTUPLE(node->hj_CurTuple));
 
 					/* In an antijoin, we never return a matched tuple */
 					if (node->js.jointype == JOIN_ANTI)
@@ -590,6 +593,7 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	hjstate->hj_JoinState = HJ_BUILD_HASHTABLE;
 	hjstate->hj_MatchedOuter = false;
 	hjstate->hj_OuterNotEmpty = false;
+	hjstate->hj_ParallelState = NULL;
 
 	return hjstate;
 }
@@ -948,11 +952,13 @@ ExecReScanHashJoin(HashJoinState *node)
 	 * primarily because batch temp files may have already been released. But
 	 * if it's a single-batch join, and there is no parameter change for the
 	 * inner subnode, then we can just re-use the existing hash table without
-	 * rebuilding it.
+	 * rebuilding it.  A shared hash table is always rebuilt, along with the
+	 * shared state the leader has just reset.
 	 */
 	if (node->hj_HashTable != NULL)
 	{
 		if (node->hj_HashTable->nbatch == 1 &&
+			node->hj_HashTable->parallel_state == NULL &&
 			node->js.ps.righttree->chgParam == NULL)
 		{
 			/*
@@ -1011,3 +1017,81 @@ ExecReScanHashJoin(HashJoinState *node)
 	if (node->js.ps.lefttree->chgParam == NULL)
 		ExecReScan(node->js.ps.lefttree);
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Hash Join Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinEstimate
+ *
+ *		estimates the space required for the shared build state.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashJoinEstimate(HashJoinState *node, ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(ParallelHashJoinState));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinInitializeDSM
+ *
+ *		Set up the shared build state of a parallel-aware hash join.  The
+ *		hash table itself gets a segment of its own once it has been sized.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashJoinInitializeDSM(HashJoinState *node, ParallelContext *pcxt)
+{
+	ParallelHashJoinState *pstate;
+
+	pstate = shm_toc_allocate(pcxt->toc, sizeof(ParallelHashJoinState));
+	SpinLockInit(&pstate->mutex);
+	pstate->phase = PHJ_BUILDING;
+	pstate->nparticipants = 0;
+	pstate->nscanned = 0;
+	pstate->nloaded = 0;
+	pstate->tuple_space = 0;
+	pstate->ntuples = 0;
+	pstate->handle = 0;
+	pstate->cookie = 0;
+	shm_toc_insert(pcxt->toc, node->js.ps.plan->plan_node_id, pstate);
+	node->hj_ParallelState = pstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinReInitializeDSM
+ *
+ *		Reset the shared build state before the join is rescanned.  Called
+ *		in the leader only, while no workers are running.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashJoinReInitializeDSM(HashJoinState *node, ParallelContext *pcxt)
+{
+	ParallelHashJoinState *pstate = node->hj_ParallelState;
+
+	pstate->phase = PHJ_BUILDING;
+	pstate->nparticipants = 0;
+	pstate->nscanned = 0;
+	pstate->nloaded = 0;
+	pstate->tuple_space = 0;
+	pstate->ntuples = 0;
+	pstate->handle = 0;
+	pstate->cookie = 0;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecHashJoinInitializeWorker
+ *
+ *		Copy relevant information from TOC into planstate.
+ * ----------------------------------------------------------------
+ */
+void
+ExecHashJoinInitializeWorker(HashJoinState *node, shm_toc *toc)
+{
+	node->hj_ParallelState = shm_toc_lookup(toc, node->js.ps.plan->plan_node_id);
+}
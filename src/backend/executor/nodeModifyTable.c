@@ -51,6 +51,7 @@
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/tqual.h"
+#include "utils/tuplestore.h"
 
 
 static bool ExecOnConflictUpdate(ModifyTableState *mtstate,
@@ -61,6 +62,14 @@ static bool ExecOnConflictUpdate(ModifyTableState *mtstate,
 					 EState *estate,
 					 bool canSetTag,
 					 TupleTableSlot **returning);
+static void ExecBatchInsertAddRow(ModifyTableState *mtstate,
+					  ResultRelInfo *resultRelInfo,
+					  TupleTableSlot *slot,
+					  EState *estate);
+static void ExecBatchInsert(ModifyTableState *mtstate,
+				ResultRelInfo *resultRelInfo,
+				EState *estate);
+static TupleTableSlot *ExecBatchInsertReturning(ModifyTableState *mtstate);
 
 /*
  * Verify that the tuples to be produced by INSERT or UPDATE match the
@@ -294,6 +303,16 @@ ExecInsert(ModifyTableState *mtstate,
 	}
 	else if (resultRelInfo->ri_FdwRoutine)
 	{
+		/*
+		 * If the FDW inserts rows in batches, just remember the row: the rest
+		 * of the work is done by ExecBatchInsert when the batch is sent.
+		 */
+		if (resultRelInfo->ri_BatchSize > 1)
+		{
+			ExecBatchInsertAddRow(mtstate, resultRelInfo, slot, estate);
+			return NULL;
+		}
+
 		/*
 		 * insert into foreign table: let the FDW do it
 		 */
@@ -502,6 +521,140 @@ ExecInsert(ModifyTableState *mtstate,
 	return NULL;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecBatchInsertAddRow
+ *
+ *		Buffer a row to be inserted into a foreign table, and send the
+ *		batch to the FDW once it is full.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecBatchInsertAddRow(ModifyTableState *mtstate,
+					  ResultRelInfo *resultRelInfo,
+					  TupleTableSlot *slot,
+					  EState *estate)
+{
+	TupleTableSlot *batchslot;
+
+	if (resultRelInfo->ri_Slots == NULL)
+		resultRelInfo->ri_Slots = (TupleTableSlot **)
+			MemoryContextAllocZero(estate->es_query_cxt,
+				   resultRelInfo->ri_BatchSize * sizeof(TupleTableSlot *));
+
+	/* Slots are created on first use and reused by the following batches */
+	batchslot = resultRelInfo->ri_Slots[resultRelInfo->ri_NumSlots];
+	if (batchslot == NULL)
+	{
+		MemoryContext oldcontext;
+
+		oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+		batchslot = MakeSingleTupleTableSlot(slot->tts_tupleDescriptor);
+		MemoryContextSwitchTo(oldcontext);
+		resultRelInfo->ri_Slots[resultRelInfo->ri_NumSlots] = batchslot;
+	}
+	ExecCopySlot(batchslot, slot);
+
+	if (++resultRelInfo->ri_NumSlots == resultRelInfo->ri_BatchSize)
+		ExecBatchInsert(mtstate, resultRelInfo, estate);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBatchInsert
+ *
+ *		Insert the buffered rows into a foreign table, and do for each
+ *		inserted row what ExecInsert does after the insertion: fire
+ *		AFTER ROW triggers, check WITH CHECK OPTIONs, and compute the
+ *		RETURNING list.  RETURNING results are saved in a tuplestore,
+ *		from which ExecModifyTable returns them one at a time.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecBatchInsert(ModifyTableState *mtstate,
+				ResultRelInfo *resultRelInfo,
+				EState *estate)
+{
+	Oid			relid = RelationGetRelid(resultRelInfo->ri_RelationDesc);
+	TupleTableSlot **rslots;
+	int			numInserted = resultRelInfo->ri_NumSlots;
+	int			i;
+
+	rslots = resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert(estate,
+															  resultRelInfo,
+												   resultRelInfo->ri_Slots,
+																&numInserted);
+
+	for (i = 0; i < numInserted; i++)
+	{
+		TupleTableSlot *slot = rslots[i];
+		HeapTuple	tuple;
+
+		/* FDW might have changed tuple */
+		tuple = ExecMaterializeSlot(slot);
+		tuple->t_tableOid = relid;
+
+		if (mtstate->canSetTag)
+		{
+			(estate->es_processed)++;
+			estate->es_lastoid = InvalidOid;
+			setLastTid(&(tuple->t_self));
+		}
+
+		/* AFTER ROW INSERT Triggers */
+		ExecARInsertTriggers(estate, resultRelInfo, tuple, NIL);
+
+		if (resultRelInfo->ri_WithCheckOptions != NIL)
+			ExecWithCheckOptions(WCO_VIEW_CHECK, resultRelInfo, slot, estate);
+
+		/*
+		 * Process RETURNING if present.  The RETURNING list of INSERT can
+		 * only reference the target relation, so no plan slot is needed.
+		 */
+		if (resultRelInfo->ri_projectReturning)
+		{
+			TupleTableSlot *rslot;
+
+			rslot = ExecProcessReturning(resultRelInfo->ri_projectReturning,
+										 slot, NULL);
+			if (mtstate->mt_batch_returning == NULL)
+			{
+				MemoryContext oldcontext;
+
+				oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+				mtstate->mt_batch_returning =
+					tuplestore_begin_heap(false, false, work_mem);
+				MemoryContextSwitchTo(oldcontext);
+			}
+			tuplestore_puttupleslot(mtstate->mt_batch_returning, rslot);
+		}
+	}
+
+	for (i = 0; i < resultRelInfo->ri_NumSlots; i++)
+		ExecClearTuple(resultRelInfo->ri_Slots[i]);
+	resultRelInfo->ri_NumSlots = 0;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecBatchInsertReturning
+ *
+ *		Return the next saved RETURNING result of batch inserts, if any.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecBatchInsertReturning(ModifyTableState *mtstate)
+{
+	TupleTableSlot *slot = mtstate->ps.ps_ResultTupleSlot;
+
+	if (mtstate->mt_batch_returning == NULL)
+		return NULL;
+
+	if (tuplestore_gettupleslot(mtstate->mt_batch_returning, true, false, slot))
+		return slot;
+
+	/* All results are returned; start over for the next batch */
+	tuplestore_clear(mtstate->mt_batch_returning);
+	return NULL;
+}
+
 /* ----------------------------------------------------------------
  *		ExecDelete
  *
@@ -1321,6 +1474,20 @@ ExecModifyTable(ModifyTableState *node)
 	if (node->mt_done)
 		return NULL;
 
+	/*
+	 * Return RETURNING results of the last inserted batch first.  If they
+	 * were produced by the final batch, the subplans are already done.
+	 */
+	slot = ExecBatchInsertReturning(node);
+	if (slot)
+		return slot;
+	if (node->mt_whichplan >= node->mt_nplans)
+	{
+		fireASTriggers(node);
+		node->mt_done = true;
+		return NULL;
+	}
+
 	/*
 	 * On first call, fire BEFORE STATEMENT triggers before proceeding.
 	 */
@@ -1476,6 +1643,10 @@ ExecModifyTable(ModifyTableState *node)
 				break;
 		}
 
+		/* The row might have completed a batch insert */
+		if (!slot)
+			slot = ExecBatchInsertReturning(node);
+
 		/*
 		 * If we got a RETURNING result, return it to caller.  We'll continue
 		 * the work on next call.
@@ -1490,6 +1661,18 @@ ExecModifyTable(ModifyTableState *node)
 	/* Restore es_result_relation_info before exiting */
 	estate->es_result_relation_info = saved_resultRelInfo;
 
+	/* Insert rows remaining in incomplete batches */
+	for (resultRelInfo = node->resultRelInfo;
+		 resultRelInfo < node->resultRelInfo + node->mt_nplans;
+		 resultRelInfo++)
+	{
+		if (resultRelInfo->ri_NumSlots > 0)
+			ExecBatchInsert(node, resultRelInfo, estate);
+	}
+	slot = ExecBatchInsertReturning(node);
+	if (slot)
+		return slot;
+
 	/*
 	 * We're done, but fire AFTER STATEMENT triggers before exiting.
 	 */
@@ -1595,6 +1778,21 @@ ExecInitModifyTable(ModifyTable *node, EState *estate, int eflags)
 															 eflags);
 		}
 
+		/*
+		 * Ask FDW whether it wants rows to be inserted in batches.  Rows
+		 * skipped by ON CONFLICT DO NOTHING can't be matched up with the
+		 * slots they were sent in, and WITH CHECK OPTIONs must see each row
+		 * as it was inserted, so those statements insert row by row.
+		 */
+		if (operation == CMD_INSERT &&
+			node->onConflictAction == ONCONFLICT_NONE &&
+			node->withCheckOptionLists == NIL &&
+			resultRelInfo->ri_FdwRoutine != NULL &&
+			resultRelInfo->ri_FdwRoutine->GetForeignModifyBatchSize != NULL &&
+			resultRelInfo->ri_FdwRoutine->ExecForeignBatchInsert != NULL)
+			resultRelInfo->ri_BatchSize =
+				resultRelInfo->ri_FdwRoutine->GetForeignModifyBatchSize(resultRelInfo);
+
 		resultRelInfo++;
 		i++;
 	}
@@ -1910,12 +2108,26 @@ ExecEndModifyTable(ModifyTableState *node)
 	{
 		ResultRelInfo *resultRelInfo = node->resultRelInfo + i;
 
+		if (resultRelInfo->ri_Slots != NULL)
+		{
+			int			j;
+
+			for (j = 0; j < resultRelInfo->ri_BatchSize; j++)
+			{
+				if (resultRelInfo->ri_Slots[j] != NULL)
+					ExecDropSingleTupleTableSlot(resultRelInfo->ri_Slots[j]);
+			}
+		}
+
 		if (resultRelInfo->ri_FdwRoutine != NULL &&
 			resultRelInfo->ri_FdwRoutine->EndForeignModify != NULL)
 			resultRelInfo->ri_FdwRoutine->EndForeignModify(node->ps.state,
 														   resultRelInfo);
 	}
 
+	if (node->mt_batch_returning != NULL)
+		tuplestore_end(node->mt_batch_returning);
+
 	/*
 	 * Free the exprcontext
 	 */
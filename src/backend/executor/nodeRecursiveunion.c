@@ -50,7 +50,8 @@ build_hash_table(RecursiveUnionState *rustate)
 											 node->numGroups,
 											 sizeof(RUHashEntryData),
 											 rustate->tableContext,
-											 rustate->tempContext);
+											 rustate->tempContext,
+											 node->plan.plan_node_id);
 }
 
 
@@ -143,7 +143,8 @@ build_hash_table(SetOpState *setopstate)
 												node->numGroups,
 												sizeof(SetOpHashEntryData),
 												setopstate->tableContext,
-												setopstate->tempContext);
+												setopstate->tempContext,
+												node->plan.plan_node_id);
 }
 
 /*
@@ -438,7 +439,8 @@ setop_retrieve_hash_table(SetOpState *setopstate)
 		/*
 		 * Find the next entry in the hash table
 		 */
-		entry = (SetOpHashEntry) ScanTupleHashTable(&setopstate->hashiter);
+		entry = (SetOpHashEntry) ScanTupleHashTable(setopstate->hashtable,
+													&setopstate->hashiter);
 		if (entry == NULL)
 		{
 			/* No more entries in hashtable, so done */
@@ -28,6 +28,10 @@
  * into a bitmap, and it can also happen internally when we AND a lossy
  * and a non-lossy page.
  *
+ * A finished bitmap can also be flattened into shared memory, so that the
+ * processes taking part in a parallel query can iterate over it together.
+ * Each page is then handed out to exactly one of the participants.
+ *
  *
  * Copyright (c) 2003-2016, PostgreSQL Global Development Group
  *
@@ -43,7 +47,10 @@
 #include "access/htup_details.h"
 #include "nodes/bitmapset.h"
 #include "nodes/tidbitmap.h"
-#include "utils/hsearch.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/hashutils.h"
+#include "utils/memutils.h"
 
 /*
  * The maximum number of tuples per page is not large (typically 256 with
@@ -97,17 +104,18 @@
 typedef struct PagetableEntry
 {
 	BlockNumber blockno;		/* page number (hashtable key) */
+	char		status;			/* hash entry status */
 	bool		ischunk;		/* T = lossy storage, F = exact */
 	bool		recheck;		/* should the tuples be rechecked? */
 	bitmapword	words[Max(WORDS_PER_PAGE, WORDS_PER_CHUNK)];
 } PagetableEntry;
 
 /*
- * dynahash.c is optimized for relatively large, long-lived hash tables.
- * This is not ideal for TIDBitMap, particularly when we are using a bitmap
- * scan on the inside of a nestloop join: a bitmap may well live only long
- * enough to accumulate one entry in such cases.  We therefore avoid creating
- * an actual hashtable until we need two pagetable entries.  When just one
+ * We want to avoid the overhead of creating the hashtable, which is
+ * comparatively large, when not necessary. Particularly when we are using a
+ * bitmap scan on the inside of a nestloop join: a bitmap may well live only
+ * long enough to accumulate one entry in such cases.  We therefore avoid
+ * creating an actual hashtable until we need two pagetable entries.  When just one
  * pagetable entry is needed, we store it in a fixed field of TIDBitMap.
  * (NOTE: we don't get rid of the hashtable if the bitmap later shrinks down
  * to zero or one page again.  So, status can be TBM_HASH even when nentries
@@ -128,12 +136,13 @@ struct TIDBitmap
 	NodeTag		type;			/* to make it a valid Node */
 	MemoryContext mcxt;			/* memory context containing me */
 	TBMStatus	status;			/* see codes above */
-	HTAB	   *pagetable;		/* hash table of PagetableEntry's */
+	struct pagetable_hash *pagetable;	/* hash table of PagetableEntry's */
 	int			nentries;		/* number of entries in pagetable */
 	int			maxentries;		/* limit on same to meet maxbytes */
 	int			npages;			/* number of exact entries in pagetable */
 	int			nchunks;		/* number of lossy entries in pagetable */
 	bool		iterating;		/* tbm_begin_iterate called? */
+	uint32		lossify_start;	/* offset to start lossifying hashtable at */
 	PagetableEntry entry1;		/* used when status == TBM_ONE_PAGE */
 	/* these are valid when iterating is true: */
 	PagetableEntry **spages;	/* sorted exact-page list, or NULL */
@@ -155,6 +164,41 @@ struct TBMIterator
 	TBMIterateResult output;	/* MUST BE LAST (because variable-size) */
 };
 
+/*
+ * Flattened form of a TIDBitmap, built by tbm_share.  It is simply the
+ * sorted exact-page entries followed by the sorted lossy-chunk entries, so
+ * it contains no pointers and can live at any address in shared memory.
+ */
+typedef struct TBMSharedBitmap
+{
+	int			npages;			/* number of exact entries */
+	int			nchunks;		/* number of lossy entries */
+	PagetableEntry entries[FLEXIBLE_ARRAY_MEMBER];	/* pages, then chunks */
+} TBMSharedBitmap;
+
+/*
+ * Progress of an iteration over a shared bitmap.  This has the same meaning
+ * as the fields of TBMIterator, but is kept in shared memory and advanced
+ * under the spinlock by every process attached to it.
+ */
+struct TBMSharedIteratorState
+{
+	slock_t		mutex;			/* protects the fields below */
+	int			spageptr;		/* next exact-page index */
+	int			schunkptr;		/* next lossy-chunk index */
+	int			schunkbit;		/* next bit to check in current chunk */
+};
+
+/*
+ * Backend-local handle on a shared iteration.
+ */
+struct TBMSharedIterator
+{
+	TBMSharedBitmap *bitmap;	/* flattened bitmap we're iterating over */
+	TBMSharedIteratorState *state;		/* shared progress */
+	TBMIterateResult output;	/* MUST BE LAST (because variable-size) */
+};
+
 
 /* Local function prototypes */
 static void tbm_union_page(TIDBitmap *a, const PagetableEntry *bpage);
@@ -167,6 +211,21 @@ static bool tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_lossify(TIDBitmap *tbm);
 static int	tbm_comparator(const void *left, const void *right);
+static void tbm_sort_pages(TIDBitmap *tbm);
+static void tbm_extract_page_tuples(const PagetableEntry *page,
+						TBMIterateResult *output);
+
+/* define hashtable mapping block numbers to PagetableEntry's */
+#define SH_PREFIX pagetable
+#define SH_ELEMENT_TYPE PagetableEntry
+#define SH_KEY_TYPE BlockNumber
+#define SH_KEY blockno
+#define SH_HASH_KEY(tb, key) murmurhash32(key)
+#define SH_EQUAL(tb, a, b) a == b
+#define SH_SCOPE static inline
+#define SH_DEFINE
+#define SH_DECLARE
+#include "lib/simplehash.h"
 
 
 /*
@@ -189,15 +248,14 @@ tbm_create(long maxbytes)
 	tbm->status = TBM_EMPTY;
 
 	/*
-	 * Estimate number of hashtable entries we can have within maxbytes. This
-	 * estimates the hash overhead at MAXALIGN(sizeof(HASHELEMENT)) plus a
-	 * pointer per hash entry, which is crude but good enough for our purpose.
+	 * Estimate number of hashtable entries we can have within maxbytes.  The
+	 * entries are stored in the hash table's bucket array itself, so there's
+	 * no per-entry overhead beyond the unused buckets, which we ignore.
 	 * Also count an extra Pointer per entry for the arrays created during
 	 * iteration readout.
 	 */
 	nbuckets = maxbytes /
-		(MAXALIGN(sizeof(HASHELEMENT)) + MAXALIGN(sizeof(PagetableEntry))
-		 + sizeof(Pointer) + sizeof(Pointer));
+		(sizeof(PagetableEntry) + sizeof(Pointer) + sizeof(Pointer));
 	nbuckets = Min(nbuckets, INT_MAX - 1);		/* safety limit */
 	nbuckets = Max(nbuckets, 16);		/* sanity limit */
 	tbm->maxentries = (int) nbuckets;
@@ -212,32 +270,26 @@ tbm_create(long maxbytes)
 static void
 tbm_create_pagetable(TIDBitmap *tbm)
 {
-	HASHCTL		hash_ctl;
-
 	Assert(tbm->status != TBM_HASH);
 	Assert(tbm->pagetable == NULL);
 
-	/* Create the hashtable proper */
-	MemSet(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(BlockNumber);
-	hash_ctl.entrysize = sizeof(PagetableEntry);
-	hash_ctl.hcxt = tbm->mcxt;
-	tbm->pagetable = hash_create("TIDBitmap",
-								 128,	/* start small and extend */
-								 &hash_ctl,
-								 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	/* Create the hashtable proper; start small and extend */
+	tbm->pagetable = pagetable_create(tbm->mcxt, 128, NULL);
 
 	/* If entry1 is valid, push it into the hashtable */
 	if (tbm->status == TBM_ONE_PAGE)
 	{
 		PagetableEntry *page;
 		bool		found;
+		char		oldstatus;
 
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &tbm->entry1.blockno,
-											  HASH_ENTER, &found);
+		page = pagetable_insert(tbm->pagetable,
+								tbm->entry1.blockno,
+								&found);
 		Assert(!found);
+		oldstatus = page->status;
 		memcpy(page, &tbm->entry1, sizeof(PagetableEntry));
+		page->status = oldstatus;
 	}
 
 	tbm->status = TBM_HASH;
@@ -250,7 +302,7 @@ void
 tbm_free(TIDBitmap *tbm)
 {
 	if (tbm->pagetable)
-		hash_destroy(tbm->pagetable);
+		pagetable_destroy(tbm->pagetable);
 	if (tbm->spages)
 		pfree(tbm->spages);
 	if (tbm->schunks)
@@ -357,12 +409,12 @@ tbm_union(TIDBitmap *a, const TIDBitmap *b)
 		tbm_union_page(a, &b->entry1);
 	else
 	{
-		HASH_SEQ_STATUS status;
+		pagetable_iterator i;
 		PagetableEntry *bpage;
 
 		Assert(b->status == TBM_HASH);
-		hash_seq_init(&status, b->pagetable);
-		while ((bpage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		pagetable_start_iterate(b->pagetable, &i);
+		while ((bpage = pagetable_iterate(b->pagetable, &i)) != NULL)
 			tbm_union_page(a, bpage);
 	}
 }
@@ -449,12 +501,12 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 	}
 	else
 	{
-		HASH_SEQ_STATUS status;
+		pagetable_iterator i;
 		PagetableEntry *apage;
 
 		Assert(a->status == TBM_HASH);
-		hash_seq_init(&status, a->pagetable);
-		while ((apage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		pagetable_start_iterate(a->pagetable, &i);
+		while ((apage = pagetable_iterate(a->pagetable, &i)) != NULL)
 		{
 			if (tbm_intersect_page(a, apage, b))
 			{
@@ -464,9 +516,7 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 				else
 					a->npages--;
 				a->nentries--;
-				if (hash_search(a->pagetable,
-								(void *) &apage->blockno,
-								HASH_REMOVE, NULL) == NULL)
+				if (!pagetable_delete(a->pagetable, apage->blockno))
 					elog(ERROR, "hash table corrupted");
 			}
 		}
@@ -598,15 +648,25 @@ tbm_begin_iterate(TIDBitmap *tbm)
 	iterator->schunkptr = 0;
 	iterator->schunkbit = 0;
 
-	/*
-	 * If we have a hashtable, create and fill the sorted page lists, unless
-	 * we already did that for a previous iterator.  Note that the lists are
-	 * attached to the bitmap not the iterator, so they can be used by more
-	 * than one iterator.
-	 */
+	tbm_sort_pages(tbm);
+
+	return iterator;
+}
+
+/*
+ * tbm_sort_pages - build the sorted page lists and make the bitmap read-only
+ *
+ * If we have a hashtable, create and fill the sorted page lists, unless
+ * we already did that for a previous iterator.  Note that the lists are
+ * attached to the bitmap not the iterator, so they can be used by more
+ * than one iterator.
+ */
+static void
+tbm_sort_pages(TIDBitmap *tbm)
+{
 	if (tbm->status == TBM_HASH && !tbm->iterating)
 	{
-		HASH_SEQ_STATUS status;
+		pagetable_iterator i;
 		PagetableEntry *page;
 		int			npages;
 		int			nchunks;
@@ -620,9 +680,9 @@ tbm_begin_iterate(TIDBitmap *tbm)
 				MemoryContextAlloc(tbm->mcxt,
 								   tbm->nchunks * sizeof(PagetableEntry *));
 
-		hash_seq_init(&status, tbm->pagetable);
+		pagetable_start_iterate(tbm->pagetable, &i);
 		npages = nchunks = 0;
-		while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		while ((page = pagetable_iterate(tbm->pagetable, &i)) != NULL)
 		{
 			if (page->ischunk)
 				tbm->schunks[nchunks++] = page;
@@ -640,8 +700,6 @@ tbm_begin_iterate(TIDBitmap *tbm)
 	}
 
 	tbm->iterating = true;
-
-	return iterator;
 }
 
 /*
@@ -717,8 +775,6 @@ tbm_iterate(TBMIterator *iterator)
 	if (iterator->spageptr < tbm->npages)
 	{
 		PagetableEntry *page;
-		int			ntuples;
-		int			wordnum;
 
 		/* In ONE_PAGE state, we don't allocate an spages[] array */
 		if (tbm->status == TBM_ONE_PAGE)
@@ -726,28 +782,7 @@ tbm_iterate(TBMIterator *iterator)
 		else
 			page = tbm->spages[iterator->spageptr];
 
-		/* scan bitmap to extract individual offset numbers */
-		ntuples = 0;
-		for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
-		{
-			bitmapword	w = page->words[wordnum];
-
-			if (w != 0)
-			{
-				int			off = wordnum * BITS_PER_BITMAPWORD + 1;
-
-				while (w != 0)
-				{
-					if (w & 1)
-						output->offsets[ntuples++] = (OffsetNumber) off;
-					off++;
-					w >>= 1;
-				}
-			}
-		}
-		output->blockno = page->blockno;
-		output->ntuples = ntuples;
-		output->recheck = page->recheck;
+		tbm_extract_page_tuples(page, output);
 		iterator->spageptr++;
 		return output;
 	}
@@ -756,6 +791,39 @@ tbm_iterate(TBMIterator *iterator)
 	return NULL;
 }
 
+/*
+ * tbm_extract_page_tuples - fill *output from an exact page entry
+ */
+static void
+tbm_extract_page_tuples(const PagetableEntry *page, TBMIterateResult *output)
+{
+	int			ntuples;
+	int			wordnum;
+
+	/* scan bitmap to extract individual offset numbers */
+	ntuples = 0;
+	for (wordnum = 0; wordnum < WORDS_PER_PAGE; wordnum++)
+	{
+		bitmapword	w = page->words[wordnum];
+
+		if (w != 0)
+		{
+			int			off = wordnum * BITS_PER_BITMAPWORD + 1;
+
+			while (w != 0)
+			{
+				if (w & 1)
+					output->offsets[ntuples++] = (OffsetNumber) off;
+				off++;
+				w >>= 1;
+			}
+		}
+	}
+	output->blockno = page->blockno;
+	output->ntuples = ntuples;
+	output->recheck = page->recheck;
+}
+
 /*
  * tbm_end_iterate - finish an iteration over a TIDBitmap
  *
@@ -769,6 +837,210 @@ tbm_end_iterate(TBMIterator *iterator)
 	pfree(iterator);
 }
 
+/*
+ * tbm_shared_size - size of the flattened form of a TIDBitmap
+ *
+ * This is the amount of (MAXALIGN'd) memory the caller must provide to
+ * tbm_share.
+ */
+Size
+tbm_shared_size(const TIDBitmap *tbm)
+{
+	Size		size;
+
+	size = mul_size(tbm->npages + tbm->nchunks, sizeof(PagetableEntry));
+	return add_size(offsetof(TBMSharedBitmap, entries), size);
+}
+
+/*
+ * tbm_share - flatten a TIDBitmap into caller-supplied shared memory
+ *
+ * dest must point to at least tbm_shared_size(tbm) bytes.  The result can
+ * be iterated over by any process that maps it, independently of the local
+ * TIDBitmap, which the caller may free afterwards.  As with
+ * tbm_begin_iterate, the bitmap may no longer be modified once this is done.
+ */
+void
+tbm_share(TIDBitmap *tbm, void *dest)
+{
+	TBMSharedBitmap *shared = (TBMSharedBitmap *) dest;
+	int			i;
+
+	tbm_sort_pages(tbm);
+	tbm->iterating = true;
+
+	shared->npages = tbm->npages;
+	shared->nchunks = tbm->nchunks;
+
+	/* In ONE_PAGE state, we don't allocate an spages[] array */
+	if (tbm->status == TBM_ONE_PAGE)
+	{
+		Assert(tbm->npages == 1);
+		memcpy(&shared->entries[0], &tbm->entry1, sizeof(PagetableEntry));
+	}
+	else
+	{
+		for (i = 0; i < tbm->npages; i++)
+			memcpy(&shared->entries[i], tbm->spages[i],
+				   sizeof(PagetableEntry));
+	}
+	for (i = 0; i < tbm->nchunks; i++)
+		memcpy(&shared->entries[tbm->npages + i], tbm->schunks[i],
+			   sizeof(PagetableEntry));
+}
+
+/*
+ * tbm_shared_iterator_size - size of a TBMSharedIteratorState
+ */
+Size
+tbm_shared_iterator_size(void)
+{
+	return sizeof(TBMSharedIteratorState);
+}
+
+/*
+ * tbm_init_shared_iterator - prepare shared memory to track an iteration
+ *
+ * The state must be (re)initialized by a single process before anyone
+ * attaches to it.  Several independent iterations over the same shared
+ * bitmap may exist, each with its own state.
+ */
+void
+tbm_init_shared_iterator(TBMSharedIteratorState *istate)
+{
+	SpinLockInit(&istate->mutex);
+	istate->spageptr = 0;
+	istate->schunkptr = 0;
+	istate->schunkbit = 0;
+}
+
+/*
+ * tbm_attach_shared_iterate - join a shared iteration
+ *
+ * bitmap is memory filled in by tbm_share, and istate is iteration state
+ * set up by tbm_init_shared_iterator.  Every process attached to the same
+ * istate receives a disjoint subset of the bitmap's pages; taken together
+ * they see every page exactly once.  Within one process, pages are still
+ * delivered in ascending order.
+ *
+ * The TBMSharedIterator struct is created in the caller's memory context.
+ */
+TBMSharedIterator *
+tbm_attach_shared_iterate(void *bitmap, TBMSharedIteratorState *istate)
+{
+	TBMSharedIterator *iterator;
+
+	iterator = (TBMSharedIterator *) palloc(sizeof(TBMSharedIterator) +
+								 MAX_TUPLES_PER_PAGE * sizeof(OffsetNumber));
+	iterator->bitmap = (TBMSharedBitmap *) bitmap;
+	iterator->state = istate;
+
+	return iterator;
+}
+
+/*
+ * tbm_shared_iterate - claim the next page of a shared iteration
+ *
+ * The result has the same meaning as for tbm_iterate.  Only the choice of
+ * the next page is made while holding the spinlock; decoding its tuple
+ * offsets is done afterwards, since the flattened bitmap is read-only.
+ */
+TBMIterateResult *
+tbm_shared_iterate(TBMSharedIterator *iterator)
+{
+	TBMSharedBitmap *bitmap = iterator->bitmap;
+	TBMSharedIteratorState *istate = iterator->state;
+	TBMIterateResult *output = &(iterator->output);
+	PagetableEntry *pages = bitmap->entries;
+	PagetableEntry *chunks = bitmap->entries + bitmap->npages;
+	PagetableEntry *page = NULL;
+	BlockNumber chunk_blockno = InvalidBlockNumber;
+
+	SpinLockAcquire(&istate->mutex);
+
+	/*
+	 * If lossy chunk pages remain, make sure we've advanced schunkptr/
+	 * schunkbit to the next set bit.  Empty words are skipped as a whole to
+	 * keep the time spent holding the spinlock short.
+	 */
+	while (istate->schunkptr < bitmap->nchunks)
+	{
+		PagetableEntry *chunk = &chunks[istate->schunkptr];
+		int			schunkbit = istate->schunkbit;
+
+		while (schunkbit < PAGES_PER_CHUNK)
+		{
+			bitmapword	w = chunk->words[WORDNUM(schunkbit)] >> BITNUM(schunkbit);
+
+			if (w == 0)
+				schunkbit = (WORDNUM(schunkbit) + 1) * BITS_PER_BITMAPWORD;
+			else if (w & 1)
+				break;
+			else
+				schunkbit++;
+		}
+		if (schunkbit < PAGES_PER_CHUNK)
+		{
+			istate->schunkbit = schunkbit;
+			break;
+		}
+		/* advance to next chunk */
+		istate->schunkptr++;
+		istate->schunkbit = 0;
+	}
+
+	/*
+	 * If both chunk and per-page data remain, must output the numerically
+	 * earlier page.
+	 */
+	if (istate->schunkptr < bitmap->nchunks)
+	{
+		BlockNumber blockno;
+
+		blockno = chunks[istate->schunkptr].blockno + istate->schunkbit;
+		if (istate->spageptr >= bitmap->npages ||
+			blockno < pages[istate->spageptr].blockno)
+		{
+			chunk_blockno = blockno;
+			istate->schunkbit++;
+		}
+	}
+	if (chunk_blockno == InvalidBlockNumber &&
+		istate->spageptr < bitmap->npages)
+		page = &pages[istate->spageptr++];
+
+	SpinLockRelease(&istate->mutex);
+
+	if (chunk_blockno != InvalidBlockNumber)
+	{
+		/* Return a lossy page indicator from the chunk */
+		output->blockno = chunk_blockno;
+		output->ntuples = -1;
+		output->recheck = true;
+		return output;
+	}
+
+	if (page != NULL)
+	{
+		tbm_extract_page_tuples(page, output);
+		return output;
+	}
+
+	/* Nothing more in the bitmap */
+	return NULL;
+}
+
+/*
+ * tbm_end_shared_iterate - finish this process's part of a shared iteration
+ *
+ * The shared memory itself belongs to the caller and is not touched.
+ */
+void
+tbm_end_shared_iterate(TBMSharedIterator *iterator)
+{
+	pfree(iterator);
+}
+
 /*
  * tbm_find_pageentry - find a PagetableEntry for the pageno
  *
@@ -791,9 +1063,7 @@ tbm_find_pageentry(const TIDBitmap *tbm, BlockNumber pageno)
 		return page;
 	}
 
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &pageno,
-										  HASH_FIND, NULL);
+	page = pagetable_lookup(tbm->pagetable, pageno);
 	if (page == NULL)
 		return NULL;
 	if (page->ischunk)
@@ -834,15 +1104,16 @@ tbm_get_pageentry(TIDBitmap *tbm, BlockNumber pageno)
 		}
 
 		/* Look up or create an entry */
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &pageno,
-											  HASH_ENTER, &found);
+		page = pagetable_insert(tbm->pagetable, pageno, &found);
 	}
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
+		char		oldstatus = page->status;
+
 		MemSet(page, 0, sizeof(PagetableEntry));
+		page->status = oldstatus;
 		page->blockno = pageno;
 		/* must count it too */
 		tbm->nentries++;
@@ -869,9 +1140,7 @@ tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno)
 
 	bitno = pageno % PAGES_PER_CHUNK;
 	chunk_pageno = pageno - bitno;
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_FIND, NULL);
+	page = pagetable_lookup(tbm->pagetable, chunk_pageno);
 	if (page != NULL && page->ischunk)
 	{
 		int			wordnum = WORDNUM(bitno);
@@ -912,9 +1181,7 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	 */
 	if (bitno != 0)
 	{
-		if (hash_search(tbm->pagetable,
-						(void *) &pageno,
-						HASH_REMOVE, NULL) != NULL)
+		if (pagetable_delete(tbm->pagetable, pageno))
 		{
 			/* It was present, so adjust counts */
 			tbm->nentries--;
@@ -923,14 +1190,15 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	}
 
 	/* Look up or create entry for chunk-header page */
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_ENTER, &found);
+	page = pagetable_insert(tbm->pagetable, chunk_pageno, &found);
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
+		char		oldstatus = page->status;
+
 		MemSet(page, 0, sizeof(PagetableEntry));
+		page->status = oldstatus;
 		page->blockno = chunk_pageno;
 		page->ischunk = true;
 		/* must count it too */
@@ -940,7 +1208,10 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	else if (!page->ischunk)
 	{
 		/* chunk header page was formerly non-lossy, make it lossy */
+		char		oldstatus = page->status;
+
 		MemSet(page, 0, sizeof(PagetableEntry));
+		page->status = oldstatus;
 		page->blockno = chunk_pageno;
 		page->ischunk = true;
 		/* we assume it had some tuple bit(s) set, so mark it lossy */
@@ -962,7 +1233,7 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 static void
 tbm_lossify(TIDBitmap *tbm)
 {
-	HASH_SEQ_STATUS status;
+	pagetable_iterator i;
 	PagetableEntry *page;
 
 	/*
@@ -977,8 +1248,8 @@ tbm_lossify(TIDBitmap *tbm)
 	Assert(!tbm->iterating);
 	Assert(tbm->status == TBM_HASH);
 
-	hash_seq_init(&status, tbm->pagetable);
-	while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+	pagetable_start_iterate_at(tbm->pagetable, &i, tbm->lossify_start);
+	while ((page = pagetable_iterate(tbm->pagetable, &i)) != NULL)
 	{
 		if (page->ischunk)
 			continue;			/* already a chunk header */
@@ -995,15 +1266,19 @@ tbm_lossify(TIDBitmap *tbm)
 
 		if (tbm->nentries <= tbm->maxentries / 2)
 		{
-			/* we have done enough */
-			hash_seq_term(&status);
+			/*
+			 * We have made enough room.  Remember where to start lossifying
+			 * next round, so we evenly iterate over the hashtable.
+			 */
+			tbm->lossify_start = i.cur;
 			break;
 		}
 
 		/*
 		 * Note: tbm_mark_page_lossy may have inserted a lossy chunk into the
-		 * hashtable.  We can continue the same seq_search scan since we do
-		 * not care whether we visit lossy chunks or not.
+		 * hashtable and may have deleted the non-lossy chunk.  We can
+		 * continue the same hash table scan, since failure to visit one
+		 * element or visiting the newly inserted element, isn't fatal.
 		 */
 	}
 
@@ -98,6 +98,7 @@ static Path *get_cheapest_parameterized_child_path(PlannerInfo *root,
 									  Relids required_outer);
 static List *accumulate_append_subpath(List *subpaths, Path *path);
 static void set_dummy_rel_pathlist(RelOptInfo *rel);
+static bool pathkeys_parallel_sortable(RelOptInfo *rel, List *pathkeys);
 static void set_subquery_pathlist(PlannerInfo *root, RelOptInfo *rel,
 					  Index rti, RangeTblEntry *rte);
 static void set_function_pathlist(PlannerInfo *root, RelOptInfo *rel,
@@ -628,11 +629,21 @@ set_plain_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 	if (rel->consider_parallel && required_outer == NULL)
 		create_parallel_paths(root, rel);
 
-	/* Consider index scans */
+	/* Consider index scans, including parallel ones */
 	create_index_paths(root, rel);
 
 	/* Consider TID scans */
 	create_tidscan_paths(root, rel);
+
+	/*
+	 * If this is a baserel, consider gathering any partial paths we may have
+	 * just created.  If we gathered an inheritance child, we could end up
+	 * with a very large number of gather nodes, each trying to grab its own
+	 * pool of workers, so don't do this in that case.  Instead, we'll
+	 * consider gathering partial paths for the appendrel.
+	 */
+	if (rel->reloptkind == RELOPT_BASEREL)
+		generate_gather_paths(root, rel);
 }
 
 /*
@@ -641,6 +652,24 @@ set_plain_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
  */
 static void
 create_parallel_paths(PlannerInfo *root, RelOptInfo *rel)
+{
+	int		parallel_degree;
+
+	parallel_degree = compute_parallel_degree(rel, rel->pages);
+	if (parallel_degree <= 0)
+		return;
+
+	/* Add an unordered partial path based on a parallel sequential scan. */
+	add_partial_path(rel, create_seqscan_path(root, rel, NULL, parallel_degree));
+}
+
+/*
+ * compute_parallel_degree
+ *	  Choose the number of workers for a parallel scan of 'rel' which
+ *	  is expected to read 'pages' pages, or return 0 if it isn't worth it.
+ */
+int
+compute_parallel_degree(RelOptInfo *rel, BlockNumber pages)
 {
 	int		parallel_threshold = 1000;
 	int		parallel_degree = 1;
@@ -652,15 +681,15 @@ create_parallel_paths(PlannerInfo *root, RelOptInfo *rel)
 	 * just for this relation, but when combined with all of its inheritance siblings
 	 * it may well pay off.
 	 */
-	if (rel->pages < parallel_threshold && rel->reloptkind == RELOPT_BASEREL)
-		return;
+	if (pages < parallel_threshold && rel->reloptkind == RELOPT_BASEREL)
+		return 0;
 
 	/*
 	 * Limit the degree of parallelism logarithmically based on the size of the
 	 * relation.  This probably needs to be a good deal more sophisticated, but we
 	 * need something here for now.
 	 */
-	while (rel->pages > parallel_threshold * 3 &&
+	while (pages > parallel_threshold * 3 &&
 		   parallel_degree < max_parallel_degree)
 	{
 		parallel_degree++;
@@ -669,18 +698,7 @@ create_parallel_paths(PlannerInfo *root, RelOptInfo *rel)
 			break;
 	}
 
-	/* Add an unordered partial path based on a parallel sequential scan. */
-	add_partial_path(rel, create_seqscan_path(root, rel, NULL, parallel_degree));
-
-	/*
-	 * If this is a baserel, consider gathering any partial paths we may have
-	 * just created.  If we gathered an inheritance child, we could end up
-	 * with a very large number of gather nodes, each trying to grab its own
-	 * pool of workers, so don't do this in that case.  Instead, we'll
-	 * consider gathering partial paths for the appendrel.
-	 */
-	if (rel->reloptkind == RELOPT_BASEREL)
-		generate_gather_paths(root, rel);
+	return parallel_degree;
 }
 
 /*
@@ -1913,24 +1931,97 @@ generate_gather_paths(PlannerInfo *root, RelOptInfo *rel)
 {
 	Path	   *cheapest_partial_path;
 	Path	   *simple_gather_path;
+	ListCell   *lc;
 
 	/* If there are no partial paths, there's nothing to do here. */
 	if (rel->partial_pathlist == NIL)
 		return;
 
 	/*
-	 * The output of Gather is currently always unsorted, so there's only one
-	 * partial path of interest: the cheapest one.
-	 *
-	 * Eventually, we should have a Gather Merge operation that can merge
-	 * multiple tuple streams together while preserving their ordering.  We
-	 * could usefully generate such a path from each partial path that has
-	 * non-NIL pathkeys.
+	 * The output of Gather is always unsorted, so there's only one partial
+	 * path of interest to it: the cheapest one.
 	 */
 	cheapest_partial_path = linitial(rel->partial_pathlist);
 	simple_gather_path = (Path *)
 		create_gather_path(root, rel, cheapest_partial_path, NULL);
 	add_path(rel, simple_gather_path);
+
+	/*
+	 * Gather Merge preserves the ordering of its input streams, so generate
+	 * such a path from each partial path that has non-NIL pathkeys.  These
+	 * compete with sorting the output of a plain Gather in the leader, and
+	 * may feed merge joins and ORDER BY above this rel.
+	 */
+	foreach(lc, rel->partial_pathlist)
+	{
+		Path	   *subpath = (Path *) lfirst(lc);
+
+		if (subpath->pathkeys == NIL || subpath->parallel_degree == 0)
+			continue;
+
+		add_path(rel, (Path *)
+				 create_gather_merge_path(root, rel, subpath,
+										  subpath->pathkeys, NULL));
+	}
+
+	/*
+	 * For the final scan/join rel, also consider having each worker sort its
+	 * share of the cheapest partial path into the order the query wants, so
+	 * that the sort itself runs in parallel and the leader only merges.
+	 */
+	if (root->query_pathkeys != NIL &&
+		cheapest_partial_path->parallel_degree > 0 &&
+		bms_equal(rel->relids, root->all_baserels) &&
+		!pathkeys_contained_in(root->query_pathkeys,
+							   cheapest_partial_path->pathkeys) &&
+		pathkeys_parallel_sortable(rel, root->query_pathkeys))
+	{
+		add_path(rel, (Path *)
+				 create_gather_merge_path(root, rel, cheapest_partial_path,
+										  root->query_pathkeys, NULL));
+	}
+}
+
+/*
+ * pathkeys_parallel_sortable
+ *		Check whether a worker could sort rows of 'rel' by 'pathkeys'.
+ *
+ * Each pathkey needs an equivalence class member computable from the rel,
+ * and we insist that every such member is parallel-safe, since we don't know
+ * which of them createplan.c will pick as the sort expression.
+ */
+static bool
+pathkeys_parallel_sortable(RelOptInfo *rel, List *pathkeys)
+{
+	ListCell   *lc;
+
+	foreach(lc, pathkeys)
+	{
+		PathKey    *pathkey = (PathKey *) lfirst(lc);
+		EquivalenceClass *ec = pathkey->pk_eclass;
+		bool		found = false;
+		ListCell   *lc2;
+
+		if (ec->ec_has_volatile)
+			return false;
+
+		foreach(lc2, ec->ec_members)
+		{
+			EquivalenceMember *em = (EquivalenceMember *) lfirst(lc2);
+
+			if (em->em_is_child ||
+				!bms_is_subset(em->em_relids, rel->relids))
+				continue;
+			if (has_parallel_hazard((Node *) em->em_expr, false))
+				return false;
+			found = true;
+		}
+
+		if (!found)
+			return false;
+	}
+
+	return true;
 }
 
 /*
@@ -2865,6 +2956,10 @@ print_path(PlannerInfo *root, Path *path, int indent)
 			ptype = "Gather";
 			subpath = ((GatherPath *) path)->subpath;
 			break;
+		case T_GatherMergePath:
+			ptype = "GatherMerge";
+			subpath = ((GatherMergePath *) path)->subpath;
+			break;
 		case T_NestPath:
 			ptype = "NestLoop";
 			join = true;
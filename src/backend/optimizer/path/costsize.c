@@ -79,6 +79,7 @@
 #include "access/htup_details.h"
 #include "access/tsmapi.h"
 #include "executor/executor.h"
+#include "executor/nodeAgg.h"
 #include "executor/nodeHash.h"
 #include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
@@ -125,6 +126,7 @@ bool		enable_nestloop = true;
 bool		enable_material = true;
 bool		enable_mergejoin = true;
 bool		enable_hashjoin = true;
+bool		enable_parallel_hash = true;
 
 typedef struct
 {
@@ -176,6 +178,35 @@ clamp_row_est(double nrows)
 }
 
 
+/*
+ * get_parallel_divisor
+ *	  Estimate the fraction of the work of a partial path that each
+ *	  participant does, expressed as the number of participants to divide by.
+ */
+static double
+get_parallel_divisor(Path *path)
+{
+	double		parallel_divisor = path->parallel_degree;
+	double		leader_contribution;
+
+	/*
+	 * Early experience with parallel query suggests that when there is only
+	 * one worker, the leader often makes a very substantial contribution to
+	 * executing the parallel portion of the plan, but as more workers are
+	 * added, it does less and less, because it's busy reading tuples from the
+	 * workers and doing whatever non-paralell post-processing is needed.  By
+	 * the time we reach 4 workers, the leader no longer makes a meaningful
+	 * contribution.  Thus, for now, estimate that the leader spends 30% of
+	 * its time servicing each worker, and the remainder executing the
+	 * parallel plan.
+	 */
+	leader_contribution = 1.0 - (0.3 * path->parallel_degree);
+	if (leader_contribution > 0)
+		parallel_divisor += leader_contribution;
+
+	return parallel_divisor;
+}
+
 /*
  * cost_seqscan
  *	  Determines and returns the cost of scanning a relation sequentially.
@@ -229,23 +260,7 @@ cost_seqscan(Path *path, PlannerInfo *root,
 	/* Adjust costing for parallelism, if used. */
 	if (path->parallel_degree > 0)
 	{
-		double	parallel_divisor = path->parallel_degree;
-		double	leader_contribution;
-
-		/*
-		 * Early experience with parallel query suggests that when there is
-		 * only one worker, the leader often makes a very substantial
-		 * contribution to executing the parallel portion of the plan, but as
-		 * more workers are added, it does less and less, because it's busy
-		 * reading tuples from the workers and doing whatever non-paralell
-		 * post-processing is needed.  By the time we reach 4 workers, the
-		 * leader no longer makes a meaningful contribution.  Thus, for now,
-		 * estimate that the leader spends 30% of its time servicing each
-		 * worker, and the remainder executing the parallel plan.
-		 */
-		leader_contribution = 1.0 - (0.3 * path->parallel_degree);
-		if (leader_contribution > 0)
-			parallel_divisor += leader_contribution;
+		double	parallel_divisor = get_parallel_divisor(path);
 
 		/*
 		 * In the case of a parallel plan, the row count needs to represent
@@ -372,6 +387,65 @@ cost_gather(GatherPath *path, PlannerInfo *root,
 	path->path.total_cost = (startup_cost + run_cost);
 }
 
+/*
+ * cost_gather_merge
+ *	  Determines and returns the cost of gather merge path.
+ *
+ * GatherMerge merges several pre-sorted input streams, using a heap that at
+ * any given instant holds the next tuple from each stream.  The input costs
+ * are passed separately because a Sort may have to be added below the
+ * GatherMerge in each worker; the caller includes it in them.
+ *
+ * 'rel' is the relation to be operated upon
+ * 'param_info' is the ParamPathInfo if this is a parameterized path, else NULL
+ * 'input_startup_cost' is the startup cost for reading the input data
+ * 'input_total_cost' is the total cost for reading the input data
+ */
+void
+cost_gather_merge(GatherMergePath *path, PlannerInfo *root,
+				  RelOptInfo *rel, ParamPathInfo *param_info,
+				  Cost input_startup_cost, Cost input_total_cost)
+{
+	Cost		startup_cost = 0;
+	Cost		run_cost = 0;
+	Cost		comparison_cost;
+	double		N;
+	double		logN;
+
+	/* Mark the path with the correct row estimate */
+	if (param_info)
+		path->path.rows = param_info->ppi_rows;
+	else
+		path->path.rows = rel->rows;
+
+	/* The leader participates too, so there is one more stream to merge */
+	N = (double) path->path.parallel_degree + 1;
+	logN = LOG2(N);
+
+	/* Assumed cost per tuple comparison */
+	comparison_cost = 2.0 * cpu_operator_cost;
+
+	/* Heap creation cost */
+	startup_cost += comparison_cost * N * logN;
+
+	/* Per-tuple heap maintenance cost */
+	run_cost += path->path.rows * comparison_cost * logN;
+
+	/* small cost for heap management, like cost_merge_append */
+	run_cost += cpu_operator_cost * path->path.rows;
+
+	/*
+	 * Parallel setup and communication cost.  Unlike Gather, we can't take
+	 * tuples from whichever worker happens to be ready, but have to wait for
+	 * the one whose stream holds the next tuple; charge a bit extra for that.
+	 */
+	startup_cost += parallel_setup_cost;
+	run_cost += parallel_tuple_cost * path->path.rows * 1.05;
+
+	path->path.startup_cost = startup_cost + input_startup_cost;
+	path->path.total_cost = (startup_cost + run_cost + input_total_cost);
+}
+
 /*
  * cost_index
  *	  Determines and returns the cost of scanning a relation using an index.
@@ -411,6 +485,7 @@ cost_index(IndexPath *path, PlannerInfo *root, double loop_count)
 				max_IO_cost;
 	QualCost	qpqual_cost;
 	Cost		cpu_per_tuple;
+	Cost		cpu_run_cost;
 	double		tuples_fetched;
 	double		pages_fetched;
 
@@ -599,7 +674,25 @@ cost_index(IndexPath *path, PlannerInfo *root, double loop_count)
 	startup_cost += qpqual_cost.startup;
 	cpu_per_tuple = cpu_tuple_cost + qpqual_cost.per_tuple;
 
-	run_cost += cpu_per_tuple * tuples_fetched;
+	cpu_run_cost = cpu_per_tuple * tuples_fetched;
+
+	/* Adjust costing for parallelism, if used. */
+	if (path->path.parallel_degree > 0)
+	{
+		double		parallel_divisor = get_parallel_divisor(&path->path);
+
+		/* As in cost_seqscan, rows are those returned by each participant */
+		path->path.rows = clamp_row_est(path->path.rows / parallel_divisor);
+
+		/*
+		 * The participants claim disjoint sets of leaf pages, so the CPU
+		 * cost is divided among them.  As for a parallel sequential scan,
+		 * we assume the I/O cost can't be amortized.
+		 */
+		cpu_run_cost /= parallel_divisor;
+	}
+
+	run_cost += cpu_run_cost;
 
 	path->path.startup_cost = startup_cost;
 	path->path.total_cost = startup_cost + run_cost;
@@ -809,6 +902,7 @@ cost_bitmap_heap_scan(Path *path, PlannerInfo *root, RelOptInfo *baserel,
 	Selectivity indexSelectivity;
 	QualCost	qpqual_cost;
 	Cost		cpu_per_tuple;
+	Cost		cpu_run_cost;
 	Cost		cost_per_page;
 	double		tuples_fetched;
 	double		pages_fetched;
@@ -908,7 +1002,27 @@ cost_bitmap_heap_scan(Path *path, PlannerInfo *root, RelOptInfo *baserel,
 	startup_cost += qpqual_cost.startup;
 	cpu_per_tuple = cpu_tuple_cost + qpqual_cost.per_tuple;
 
-	run_cost += cpu_per_tuple * tuples_fetched;
+	cpu_run_cost = cpu_per_tuple * tuples_fetched;
+
+	/* Adjust costing for parallelism, if used. */
+	if (path->parallel_degree > 0)
+	{
+		double		parallel_divisor = get_parallel_divisor(path);
+
+		/* As in cost_seqscan, rows are those returned by each participant */
+		path->rows = clamp_row_est(path->rows / parallel_divisor);
+
+		/*
+		 * The bitmap is built only once, so its cost (already charged as
+		 * startup cost) isn't divided.  The heap pages are divided among
+		 * the participants, and so is the CPU cost of processing their
+		 * tuples; as for a parallel sequential scan, we assume the I/O cost
+		 * can't be amortized.
+		 */
+		cpu_run_cost /= parallel_divisor;
+	}
+
+	run_cost += cpu_run_cost;
 
 	path->startup_cost = startup_cost;
 	path->total_cost = startup_cost + run_cost;
@@ -1650,7 +1764,8 @@ cost_material(Path *path,
  * we are using a hashed Agg node just to do grouping).
  *
  * Note: when aggstrategy == AGG_SORTED, caller must ensure that input costs
- * are for appropriately-sorted input.
+ * are for appropriately-sorted input.  AGG_MIXED is costed like AGG_SORTED;
+ * the caller adds the cost of any additional hashed grouping sets.
  */
 void
 cost_agg(Path *path, PlannerInfo *root,
@@ -1704,7 +1819,7 @@ cost_agg(Path *path, PlannerInfo *root,
 		total_cost = startup_cost + cpu_tuple_cost;
 		output_tuples = 1;
 	}
-	else if (aggstrategy == AGG_SORTED)
+	else if (aggstrategy == AGG_SORTED || aggstrategy == AGG_MIXED)
 	{
 		/* Here we are able to deliver output on-the-fly */
 		startup_cost = input_startup_cost;
@@ -1735,6 +1850,51 @@ cost_agg(Path *path, PlannerInfo *root,
 	path->total_cost = total_cost;
 }
 
+/*
+ * cost_agg_spill
+ *	  Adds to a hashed Agg path, as costed by cost_agg, the cost of spilling
+ *	  to disk if its hash table is not expected to fit in work_mem.
+ *
+ * 'hashentrysize' is the estimated space per group in the hash table.
+ * 'input_tuples' and 'input_width' describe the input relation.
+ *
+ * Once the hash table is full, the input tuples of the groups that didn't
+ * make it into the table are written out and read back, once per level of
+ * partitioning needed to make each batch fit; we charge sequential I/O for
+ * that, plus the CPU cost of processing those tuples again.  All of this
+ * happens before the first group can be returned.
+ */
+void
+cost_agg_spill(Path *path, double numGroups, double hashentrysize,
+			   double input_tuples, int input_width)
+{
+	double		hashtablesize = numGroups * hashentrysize;
+	double		mem_limit = work_mem * 1024.0;
+	double		spill_fraction;
+	double		spill_tuples;
+	double		spill_pages;
+	double		depth;
+	Cost		spill_cost;
+
+	if (hashtablesize <= mem_limit)
+		return;
+
+	/* groups beyond those that fit in memory spill, with all their input */
+	spill_fraction = 1.0 - mem_limit / hashtablesize;
+	spill_tuples = input_tuples * spill_fraction;
+	spill_pages = page_size(spill_tuples, input_width);
+
+	/* number of times the spilled data goes to disk and back */
+	depth = ceil(log(hashtablesize / mem_limit) / log(HASHAGG_MAX_PARTITIONS));
+	depth = Max(depth, 1.0);
+
+	spill_cost = 2.0 * seq_page_cost * spill_pages * depth;
+	spill_cost += cpu_tuple_cost * spill_tuples * depth;
+
+	path->startup_cost += spill_cost;
+	path->total_cost += spill_cost;
+}
+
 /*
  * cost_windowagg
  *		Determines and returns the cost of performing a WindowAgg plan node,
@@ -2623,6 +2783,8 @@ cached_scansel(PlannerInfo *root, RestrictInfo *rinfo, PathKey *pathkey)
  * 'inner_path' is the inner input to the join
  * 'sjinfo' is extra info about the join for selectivity estimation
  * 'semifactors' contains valid data if jointype is SEMI or ANTI
+ * 'parallel_hash' is true if the (partial) inner path is to be hashed into
+ *		a table shared by all participants
  */
 void
 initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
@@ -2630,12 +2792,14 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 					  List *hashclauses,
 					  Path *outer_path, Path *inner_path,
 					  SpecialJoinInfo *sjinfo,
-					  SemiAntiJoinFactors *semifactors)
+					  SemiAntiJoinFactors *semifactors,
+					  bool parallel_hash)
 {
 	Cost		startup_cost = 0;
 	Cost		run_cost = 0;
 	double		outer_path_rows = outer_path->rows;
 	double		inner_path_rows = inner_path->rows;
+	double		inner_path_rows_total = inner_path_rows;
 	int			num_hashclauses = list_length(hashclauses);
 	int			numbuckets;
 	int			numbatches;
@@ -2669,8 +2833,14 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	 *
 	 * XXX at some point it might be interesting to try to account for skew
 	 * optimization in the cost estimate, but for now, we don't.
+	 *
+	 * A shared hash table holds the inner rows of all the participants,
+	 * though each of them only hashes its own share.
 	 */
-	ExecChooseHashTableSize(inner_path_rows,
+	if (parallel_hash)
+		inner_path_rows_total *= get_parallel_divisor(inner_path);
+
+	ExecChooseHashTableSize(inner_path_rows_total,
 							inner_path->parent->width,
 							true,		/* useskew */
 							&numbuckets,
@@ -2704,6 +2874,7 @@ initial_cost_hashjoin(PlannerInfo *root, JoinCostWorkspace *workspace,
 	workspace->run_cost = run_cost;
 	workspace->numbuckets = numbuckets;
 	workspace->numbatches = numbatches;
+	workspace->inner_rows_total = inner_path_rows_total;
 }
 
 /*
@@ -2727,7 +2898,7 @@ final_cost_hashjoin(PlannerInfo *root, HashPath *path,
 	Path	   *outer_path = path->jpath.outerjoinpath;
 	Path	   *inner_path = path->jpath.innerjoinpath;
 	double		outer_path_rows = outer_path->rows;
-	double		inner_path_rows = inner_path->rows;
+	double		inner_path_rows = workspace->inner_rows_total;
 	List	   *hashclauses = path->path_hashclauses;
 	Cost		startup_cost = workspace->startup_cost;
 	Cost		run_cost = workspace->run_cost;
@@ -336,8 +336,35 @@ create_index_paths(PlannerInfo *root, RelOptInfo *rel)
 
 		bitmapqual = choose_bitmap_and(root, rel, bitindexpaths);
 		bpath = create_bitmap_heap_path(root, rel, bitmapqual,
-										rel->lateral_relids, 1.0);
+										rel->lateral_relids, 1.0, 0);
 		add_path(rel, (Path *) bpath);
+
+		/*
+		 * Also consider a parallel bitmap heap scan, in which one participant
+		 * builds the bitmap and all of them share the heap pages it covers.
+		 * Size it by the number of heap pages it is expected to visit; there
+		 * can't be more of those than there are matching tuples.
+		 */
+		if (rel->consider_parallel && rel->lateral_relids == NULL &&
+			bitmapqual->parallel_safe)
+		{
+			Cost		indexTotalCost;
+			Selectivity indexSelectivity;
+			double		pages;
+			int			parallel_degree;
+
+			cost_bitmap_tree_node(bitmapqual, &indexTotalCost,
+								  &indexSelectivity);
+			pages = Min(indexSelectivity * rel->tuples, (double) rel->pages);
+			parallel_degree = compute_parallel_degree(rel,
+												(BlockNumber) ceil(pages));
+			if (parallel_degree > 0)
+			{
+				bpath = create_bitmap_heap_path(root, rel, bitmapqual,
+												NULL, 1.0, parallel_degree);
+				add_partial_path(rel, (Path *) bpath);
+			}
+		}
 	}
 
 	/*
@@ -409,7 +436,7 @@ create_index_paths(PlannerInfo *root, RelOptInfo *rel)
 			required_outer = get_bitmap_tree_required_outer(bitmapqual);
 			loop_count = get_loop_count(root, rel->relid, required_outer);
 			bpath = create_bitmap_heap_path(root, rel, bitmapqual,
-											required_outer, loop_count);
+											required_outer, loop_count, 0);
 			add_path(rel, (Path *) bpath);
 		}
 	}
@@ -868,6 +895,7 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 	List	   *orderbyclausecols;
 	List	   *index_pathkeys;
 	List	   *useful_pathkeys;
+	bool		found_saop_clause;
 	bool		found_lower_saop_clause;
 	bool		pathkeys_possibly_useful;
 	bool		index_is_ordered;
@@ -915,6 +943,7 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 	 */
 	index_clauses = NIL;
 	clause_columns = NIL;
+	found_saop_clause = false;
 	found_lower_saop_clause = false;
 	outer_relids = bms_copy(rel->lateral_relids);
 	for (indexcol = 0; indexcol < index->ncolumns; indexcol++)
@@ -938,6 +967,7 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 					/* Caller had better intend this only for bitmap scan */
 					Assert(scantype == ST_BITMAPSCAN);
 				}
+				found_saop_clause = true;
 				if (indexcol > 0)
 				{
 					if (skip_lower_saop)
@@ -1041,8 +1071,46 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 								  NoMovementScanDirection,
 								  index_only_scan,
 								  outer_relids,
-								  loop_count);
+								  loop_count,
+								  0);
 		result = lappend(result, ipath);
+
+		/*
+		 * If appropriate, consider a parallel scan of the index too.  Its
+		 * participants divide the leaf pages among themselves, which works
+		 * only for a single forward pass over the index: parameterized
+		 * paths, ScalarArrayOpExpr quals (which make btree restart the scan
+		 * for each array element) and ordering operators are ruled out.
+		 */
+		if (index->amcanparallel && rel->consider_parallel &&
+			outer_relids == NULL && scantype != ST_BITMAPSCAN &&
+			!found_saop_clause && orderbyclauses == NIL)
+		{
+			double		pages;
+			int			parallel_degree;
+
+			/* size the scan by the heap or index pages it is expected to read */
+			pages = ipath->indexselectivity * Max(rel->pages, index->pages);
+			parallel_degree = compute_parallel_degree(rel,
+												(BlockNumber) ceil(pages));
+			if (parallel_degree > 0)
+			{
+				ipath = create_index_path(root, index,
+										  index_clauses,
+										  clause_columns,
+										  NIL,
+										  NIL,
+										  useful_pathkeys,
+										  index_is_ordered ?
+										  ForwardScanDirection :
+										  NoMovementScanDirection,
+										  index_only_scan,
+										  NULL,
+										  loop_count,
+										  parallel_degree);
+				add_partial_path(rel, (Path *) ipath);
+			}
+		}
 	}
 
 	/*
@@ -1065,7 +1133,8 @@ build_index_paths(PlannerInfo *root, RelOptInfo *rel,
 									  BackwardScanDirection,
 									  index_only_scan,
 									  outer_relids,
-									  loop_count);
+									  loop_count,
+									  0);
 			result = lappend(result, ipath);
 		}
 	}
@@ -17,6 +17,7 @@
 #include <math.h>
 
 #include "executor/executor.h"
+#include "executor/nodeHash.h"
 #include "foreign/fdwapi.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
@@ -512,7 +513,7 @@ try_hashjoin_path(PlannerInfo *root,
 	 */
 	initial_cost_hashjoin(root, &workspace, jointype, hashclauses,
 						  outer_path, inner_path,
-						  extra->sjinfo, &extra->semifactors);
+						  extra->sjinfo, &extra->semifactors, false);
 
 	if (add_path_precheck(joinrel,
 						  workspace.startup_cost, workspace.total_cost,
@@ -529,7 +530,8 @@ try_hashjoin_path(PlannerInfo *root,
 									  inner_path,
 									  extra->restrictlist,
 									  required_outer,
-									  hashclauses));
+									  hashclauses,
+									  false));
 	}
 	else
 	{
@@ -542,6 +544,9 @@ try_hashjoin_path(PlannerInfo *root,
  * try_partial_hashjoin_path
  *	  Consider a partial hashjoin join path; if it appears useful, push it into
  *	  the joinrel's partial_pathlist via add_partial_path().
+ *
+ * If parallel_hash is true, inner_path is partial too, and the participants
+ * build a single shared hash table from it.
  */
 static void
 try_partial_hashjoin_path(PlannerInfo *root,
@@ -550,7 +555,8 @@ try_partial_hashjoin_path(PlannerInfo *root,
 						  Path *inner_path,
 						  List *hashclauses,
 						  JoinType jointype,
-						  JoinPathExtraData *extra)
+						  JoinPathExtraData *extra,
+						  bool parallel_hash)
 {
 	JoinCostWorkspace workspace;
 
@@ -575,10 +581,33 @@ try_partial_hashjoin_path(PlannerInfo *root,
 	 */
 	initial_cost_hashjoin(root, &workspace, jointype, hashclauses,
 						  outer_path, inner_path,
-						  extra->sjinfo, &extra->semifactors);
+						  extra->sjinfo, &extra->semifactors, parallel_hash);
 	if (!add_partial_path_precheck(joinrel, workspace.total_cost, NIL))
 		return;
 
+	/*
+	 * A shared hash table can't be split into batches, so it has to fit in
+	 * work_mem.  While it is being built, the participants also hold private
+	 * copies of their tuples, so there must be room for it twice over.
+	 */
+	if (parallel_hash)
+	{
+		int			numbuckets;
+		int			numbatches;
+		int			num_skew_mcvs;
+
+		if (workspace.numbatches > 1)
+			return;
+		ExecChooseHashTableSize(workspace.inner_rows_total * 2,
+								inner_path->parent->width,
+								false,
+								&numbuckets,
+								&numbatches,
+								&num_skew_mcvs);
+		if (numbatches > 1)
+			return;
+	}
+
 	/* Might be good enough to be worth trying, so let's try it. */
 	add_partial_path(joinrel, (Path *)
 			 create_hashjoin_path(root,
@@ -591,7 +620,8 @@ try_partial_hashjoin_path(PlannerInfo *root,
 								  inner_path,
 								  extra->restrictlist,
 								  NULL,
-								  hashclauses));
+								  hashclauses,
+								  parallel_hash));
 }
 
 /*
@@ -1287,6 +1317,7 @@ hash_inner_and_outer(PlannerInfo *root,
 					 JoinType jointype,
 					 JoinPathExtraData *extra)
 {
+	JoinType	save_jointype = jointype;
 	bool		isouterjoin = IS_OUTER_JOIN(jointype);
 	List	   *hashclauses;
 	ListCell   *l;
@@ -1451,7 +1482,7 @@ hash_inner_and_outer(PlannerInfo *root,
 		 * able to properly guarantee uniqueness.  Also, the resulting path
 		 * must not be parameterized.
 		 */
-		if (joinrel->consider_parallel && jointype != JOIN_UNIQUE_OUTER &&
+		if (joinrel->consider_parallel && save_jointype != JOIN_UNIQUE_OUTER &&
 			outerrel->partial_pathlist != NIL &&
 			bms_is_empty(joinrel->lateral_relids))
 		{
@@ -1490,7 +1521,24 @@ hash_inner_and_outer(PlannerInfo *root,
 				try_partial_hashjoin_path(root, joinrel,
 										  cheapest_partial_outer,
 										  cheapest_safe_inner,
-										  hashclauses, jointype, extra);
+										  hashclauses, jointype, extra,
+										  false);
+
+			/*
+			 * We can also hash a partial inner path into a single table
+			 * shared by all participants, instead of having each of them
+			 * hash the whole inner relation.  The shared table doesn't track
+			 * matched inner tuples, so right and full joins can't do this,
+			 * and a partial path can't be unique-ified.
+			 */
+			if (enable_parallel_hash && innerrel->partial_pathlist != NIL &&
+				(save_jointype == JOIN_INNER || save_jointype == JOIN_LEFT ||
+				 save_jointype == JOIN_SEMI || save_jointype == JOIN_ANTI))
+				try_partial_hashjoin_path(root, joinrel,
+										  cheapest_partial_outer,
+									(Path *) linitial(innerrel->partial_pathlist),
+										  hashclauses, jointype, extra,
+										  true);
 		}
 	}
 }
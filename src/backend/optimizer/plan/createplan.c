@@ -62,6 +62,8 @@ static SampleScan *create_samplescan_plan(PlannerInfo *root, Path *best_path,
 					   List *tlist, List *scan_clauses);
 static Gather *create_gather_plan(PlannerInfo *root,
 				   GatherPath *best_path);
+static GatherMerge *create_gather_merge_plan(PlannerInfo *root,
+						 GatherMergePath *best_path);
 static Scan *create_indexscan_plan(PlannerInfo *root, IndexPath *best_path,
 					  List *tlist, List *scan_clauses, bool indexonly);
 static BitmapHeapScan *create_bitmap_scan_plan(PlannerInfo *root,
@@ -285,6 +287,10 @@ create_plan_recurse(PlannerInfo *root, Path *best_path)
 			plan = (Plan *) create_gather_plan(root,
 											   (GatherPath *) best_path);
 			break;
+		case T_GatherMerge:
+			plan = (Plan *) create_gather_merge_plan(root,
+												(GatherMergePath *) best_path);
+			break;
 		default:
 			elog(ERROR, "unrecognized node type: %d",
 				 (int) best_path->pathtype);
@@ -1146,6 +1152,65 @@ create_gather_plan(PlannerInfo *root, GatherPath *best_path)
 	return gather_plan;
 }
 
+/*
+ * create_gather_merge_plan
+ *
+ *	  Create a Gather Merge plan for 'best_path' and (recursively)
+ *	  plans for its subpaths.  Each worker runs a copy of the subplan; a
+ *	  Sort is inserted below the Gather Merge if the subplan isn't already
+ *	  suitably ordered.
+ */
+static GatherMerge *
+create_gather_merge_plan(PlannerInfo *root, GatherMergePath *best_path)
+{
+	GatherMerge *gm_plan = makeNode(GatherMerge);
+	Plan	   *plan = &gm_plan->plan;
+	List	   *pathkeys = best_path->path.pathkeys;
+	Plan	   *subplan;
+
+	subplan = create_plan_recurse(root, best_path->subpath);
+
+	disuse_physical_tlist(root, subplan, best_path->subpath);
+
+	/*
+	 * Compute sort column info, adding resjunk sort columns to the subplan's
+	 * tlist if needed.  As with MergeAppend, we don't have a separate
+	 * make_xxx function, since the sort info comes from this step.
+	 */
+	subplan = prepare_sort_from_pathkeys(root, subplan, pathkeys,
+										 best_path->subpath->parent->relids,
+										 NULL,
+										 false,
+										 &gm_plan->numCols,
+										 &gm_plan->sortColIdx,
+										 &gm_plan->sortOperators,
+										 &gm_plan->collations,
+										 &gm_plan->nullsFirst);
+
+	/* Now, insert a Sort node if subplan isn't sufficiently ordered */
+	if (!pathkeys_contained_in(pathkeys, best_path->subpath->pathkeys))
+		subplan = (Plan *) make_sort(root, subplan, gm_plan->numCols,
+									 gm_plan->sortColIdx,
+									 gm_plan->sortOperators,
+									 gm_plan->collations,
+									 gm_plan->nullsFirst,
+									 -1.0);
+
+	/* cost should be inserted by copy_generic_path_info */
+	plan->targetlist = subplan->targetlist;
+	plan->qual = NIL;
+	plan->lefttree = subplan;
+	plan->righttree = NULL;
+	gm_plan->num_workers = best_path->path.parallel_degree;
+
+	copy_generic_path_info(plan, &best_path->path);
+
+	/* use parallel mode for parallel plans. */
+	root->glob->parallelModeNeeded = true;
+
+	return gm_plan;
+}
+
 
 /*****************************************************************************
  *
@@ -5215,6 +5280,7 @@ is_projection_capable_plan(Plan *plan)
 		case T_Append:
 		case T_MergeAppend:
 		case T_RecursiveUnion:
+		case T_GatherMerge:
 			return false;
 		default:
 			break;
@@ -18,9 +18,12 @@
 #include <limits.h>
 #include <math.h>
 
+#include "access/genam.h"
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/parallel.h"
 #include "access/xact.h"
+#include "catalog/catalog.h"
 #include "executor/executor.h"
 #include "executor/nodeAgg.h"
 #include "foreign/fdwapi.h"
@@ -98,6 +101,10 @@ static bool choose_hashed_grouping(PlannerInfo *root,
 					   double path_rows, int path_width,
 					   Path *cheapest_path, Path *sorted_path,
 					   double dNumGroups, AggClauseCosts *agg_costs);
+static Bitmapset *choose_hashed_grouping_sets(PlannerInfo *root,
+							double path_rows, int path_width,
+							Path *cheapest_path, AggClauseCosts *agg_costs,
+							List *rollup_groupclauses, List *rollup_lists);
 static bool choose_hashed_distinct(PlannerInfo *root,
 					   double tuple_fraction, double limit_tuples,
 					   double path_rows, int path_width,
@@ -133,6 +140,7 @@ static Plan *build_grouping_chain(PlannerInfo *root,
 					 bool need_sort_for_grouping,
 					 List *rollup_groupclauses,
 					 List *rollup_lists,
+					 Bitmapset *hashed_rollups,
 					 AttrNumber *groupColIdx,
 					 AggClauseCosts *agg_costs,
 					 long numGroups,
@@ -1469,6 +1477,8 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 		int			maxref = 0;
 		List	   *rollup_lists = NIL;
 		List	   *rollup_groupclauses = NIL;
+		Bitmapset  *hashed_rollups = NULL;
+		bool		top_rollup_hashed = false;
 		standard_qp_extra qp_extra;
 		RelOptInfo *final_rel;
 		Path	   *cheapest_path;
@@ -1862,13 +1872,22 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 		{
 			/*
 			 * If grouping, decide whether to use sorted or hashed grouping.
-			 * If grouping sets are present, we can currently do only sorted
-			 * grouping.
+			 * If grouping sets are present, the top Agg node always does the
+			 * grouping, but some or all of the grouping sets may be hashed.
 			 */
 
 			if (parse->groupingSets)
 			{
 				use_hashed_grouping = false;
+				hashed_rollups =
+					choose_hashed_grouping_sets(root,
+												path_rows, path_width,
+												cheapest_path, &agg_costs,
+												rollup_groupclauses,
+												rollup_lists);
+				top_rollup_hashed =
+					bms_is_member(list_length(rollup_lists) - 1,
+								  hashed_rollups);
 			}
 			else
 			{
@@ -1907,9 +1926,12 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 		/*
 		 * Select the best path.  If we are doing hashed grouping, we will
 		 * always read all the input tuples, so use the cheapest-total path.
-		 * Otherwise, the comparison above is correct.
+		 * The same goes if the top rollup of grouping sets is hashed, since
+		 * then nothing needs sorted input.  Otherwise, the comparison above
+		 * is correct.
 		 */
-		if (use_hashed_grouping || use_hashed_distinct || !sorted_path)
+		if (use_hashed_grouping || use_hashed_distinct || top_rollup_hashed ||
+			!sorted_path)
 			best_path = cheapest_path;
 		else
 			best_path = sorted_path;
@@ -1948,6 +1970,7 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 
 			/* Detect if we'll need an explicit sort for grouping */
 			if (parse->groupClause && !use_hashed_grouping &&
+				!top_rollup_hashed &&
 			  !pathkeys_contained_in(root->group_pathkeys, current_pathkeys))
 				need_sort_for_grouping = true;
 
@@ -2064,11 +2087,12 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 				 * Aggregation and/or non-degenerate grouping sets.
 				 *
 				 * Output is in sorted order by group_pathkeys if, and only
-				 * if, there is a single rollup operation on a non-empty list
-				 * of grouping expressions.
+				 * if, there is a single sorted rollup operation on a
+				 * non-empty list of grouping expressions.
 				 */
 				if (list_length(rollup_groupclauses) == 1
-					&& list_length(linitial(rollup_groupclauses)) > 0)
+					&& list_length(linitial(rollup_groupclauses)) > 0
+					&& hashed_rollups == NULL)
 					current_pathkeys = root->group_pathkeys;
 				else
 					current_pathkeys = NIL;
@@ -2079,6 +2103,7 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 												   need_sort_for_grouping,
 												   rollup_groupclauses,
 												   rollup_lists,
+												   hashed_rollups,
 												   groupColIdx,
 												   &agg_costs,
 												   numGroups,
@@ -2516,6 +2541,13 @@ remap_groupColIdx(PlannerInfo *root, List *groupClause)
  * participate in the plan directly, but they are both a convenient way to
  * represent the required data and a convenient way to account for the costs
  * of execution.
+ *
+ * The non-empty grouping sets of the rollups listed (by index) in
+ * hashed_rollups are instead done by hashing, each one by an AGG_HASHED node
+ * of its own.  The first of those becomes the real Agg node, marked
+ * AGG_MIXED if any sorted rollups remain; the other hashed nodes come first
+ * in the chain, followed by the sorted ones, starting with the top rollup,
+ * which is the one the input is sorted for and so gets no Sort node.
  */
 static Plan *
 build_grouping_chain(PlannerInfo *root,
@@ -2524,6 +2556,7 @@ build_grouping_chain(PlannerInfo *root,
 					 bool need_sort_for_grouping,
 					 List *rollup_groupclauses,
 					 List *rollup_lists,
+					 Bitmapset *hashed_rollups,
 					 AttrNumber *groupColIdx,
 					 AggClauseCosts *agg_costs,
 					 long numGroups,
@@ -2531,6 +2564,8 @@ build_grouping_chain(PlannerInfo *root,
 {
 	AttrNumber *top_grpColIdx = groupColIdx;
 	List	   *chain = NIL;
+	List	   *hashed_chain = NIL;
+	int			topRollup = list_length(rollup_groupclauses) - 1;
 
 	/*
 	 * Prepare the grpColIdx for the real Agg node first, because we may need
@@ -2544,6 +2579,7 @@ build_grouping_chain(PlannerInfo *root,
 	 */
 	if (need_sort_for_grouping)
 	{
+		Assert(!bms_is_member(topRollup, hashed_rollups));
 		result_plan = (Plan *)
 			make_sort_from_groupcols(root,
 									 llast(rollup_groupclauses),
@@ -2551,6 +2587,76 @@ build_grouping_chain(PlannerInfo *root,
 									 result_plan);
 	}
 
+	/*
+	 * Generate a hashed Agg node for each non-empty grouping set of the
+	 * hashed rollups.  Each gets its own estimate of the number of groups,
+	 * since the executor sizes its hash table from that.  The sets of a
+	 * rollup are prefixes of its groupClause, so the key columns are too.
+	 */
+	if (hashed_rollups)
+	{
+		ListCell   *lc,
+				   *lc2;
+		int			rollupno = 0;
+
+		forboth(lc, rollup_groupclauses, lc2, rollup_lists)
+		{
+			List	   *groupClause = (List *) lfirst(lc);
+			List	   *gsets = (List *) lfirst(lc2);
+			AttrNumber *new_grpColIdx;
+			List	   *groupExprs;
+			ListCell   *lc3;
+
+			if (!bms_is_member(rollupno++, hashed_rollups))
+				continue;
+
+			new_grpColIdx = remap_groupColIdx(root, groupClause);
+			groupExprs = get_sortgrouplist_exprs(groupClause,
+												 parse->targetList);
+
+			foreach(lc3, gsets)
+			{
+				List	   *gset = (List *) lfirst(lc3);
+				double		dNumGroups;
+				Plan	   *agg_plan;
+
+				/* empty sets are never hashed */
+				if (gset == NIL)
+					continue;
+
+				dNumGroups = estimate_num_groups(root, groupExprs,
+												 result_plan->plan_rows,
+												 &gset);
+
+				agg_plan = (Plan *) make_agg(root,
+											 tlist,
+											 (List *) parse->havingQual,
+											 AGG_HASHED,
+											 agg_costs,
+											 list_length(gset),
+											 new_grpColIdx,
+										   extract_grouping_ops(groupClause),
+											 list_make1(gset),
+								   (long) Min(dNumGroups, (double) LONG_MAX),
+											 false,
+											 true,
+											 result_plan);
+
+				/*
+				 * As for the sorted side nodes below, correct the costs for
+				 * the input plan and nuke stuff we don't need.
+				 */
+				agg_plan->startup_cost -= result_plan->total_cost;
+				agg_plan->total_cost -= result_plan->total_cost;
+				agg_plan->targetlist = NIL;
+				agg_plan->qual = NIL;
+				agg_plan->lefttree = NULL;
+
+				hashed_chain = lappend(hashed_chain, agg_plan);
+			}
+		}
+	}
+
 	/*
 	 * Generate the side nodes that describe the other sort and group
 	 * operations besides the top one.
@@ -2559,6 +2665,7 @@ build_grouping_chain(PlannerInfo *root,
 	{
 		ListCell   *lc,
 				   *lc2;
+		int			rollupno = 0;
 
 		Assert(list_length(rollup_groupclauses) == list_length(rollup_lists));
 		forboth(lc, rollup_groupclauses, lc2, rollup_lists)
@@ -2573,6 +2680,10 @@ build_grouping_chain(PlannerInfo *root,
 			if (lnext(lc) == NULL)
 				break;
 
+			/* and skip the hashed ones */
+			if (bms_is_member(rollupno++, hashed_rollups))
+				continue;
+
 			new_grpColIdx = remap_groupColIdx(root, groupClause);
 
 			sort_plan = (Plan *)
@@ -2616,6 +2727,90 @@ build_grouping_chain(PlannerInfo *root,
 		}
 	}
 
+	/*
+	 * If anything is hashed, the top rollup's remaining sorted grouping sets
+	 * (if any) become the first sorted phase, working on the input as it
+	 * comes; then the first hashed node is the real Agg node.
+	 */
+	if (hashed_chain)
+	{
+		List	   *groupClause = (List *) llast(rollup_groupclauses);
+		List	   *gsets = (List *) llast(rollup_lists);
+		Agg		   *first_hashed = (Agg *) linitial(hashed_chain);
+		bool		have_sorted;
+		ListCell   *lc;
+
+		if (bms_is_member(topRollup, hashed_rollups))
+		{
+			List	   *empty_sets = NIL;
+
+			foreach(lc, gsets)
+			{
+				if (lfirst(lc) == NIL)
+					empty_sets = lappend(empty_sets, NIL);
+			}
+			gsets = empty_sets;
+		}
+
+		if (gsets)
+		{
+			int			numGroupCols = list_length(linitial(gsets));
+			Plan	   *agg_plan;
+
+			agg_plan = (Plan *) make_agg(root,
+										 tlist,
+										 (List *) parse->havingQual,
+								 (numGroupCols > 0) ? AGG_SORTED : AGG_PLAIN,
+										 agg_costs,
+										 numGroupCols,
+										 top_grpColIdx,
+										 extract_grouping_ops(groupClause),
+										 gsets,
+										 numGroups,
+										 false,
+										 true,
+										 result_plan);
+
+			agg_plan->startup_cost -= result_plan->total_cost;
+			agg_plan->total_cost -= result_plan->total_cost;
+			agg_plan->targetlist = NIL;
+			agg_plan->qual = NIL;
+			agg_plan->lefttree = NULL;
+
+			chain = lcons(agg_plan, chain);
+		}
+
+		have_sorted = (chain != NIL);
+		chain = list_concat(list_copy_tail(hashed_chain, 1), chain);
+
+		result_plan = (Plan *) make_agg(root,
+										tlist,
+										(List *) parse->havingQual,
+										have_sorted ? AGG_MIXED : AGG_HASHED,
+										agg_costs,
+										first_hashed->numCols,
+										first_hashed->grpColIdx,
+										first_hashed->grpOperators,
+										first_hashed->groupingSets,
+										numGroups,
+										false,
+										true,
+										result_plan);
+
+		/* the executor sizes the first hash table from this */
+		((Agg *) result_plan)->numGroups = first_hashed->numGroups;
+		((Agg *) result_plan)->chain = chain;
+
+		foreach(lc, chain)
+		{
+			Plan	   *subplan = lfirst(lc);
+
+			result_plan->total_cost += subplan->total_cost;
+		}
+
+		return result_plan;
+	}
+
 	/*
 	 * Now make the final Agg node
 	 */
@@ -3726,8 +3921,9 @@ choose_hashed_grouping(PlannerInfo *root,
 		return false;
 
 	/*
-	 * Don't do it if it doesn't look like the hashtable will fit into
-	 * work_mem.
+	 * Estimate the hash table's size; if it won't fit into work_mem, the
+	 * hashed plan will have to spill to disk, which cost_agg_spill charges
+	 * for.
 	 */
 
 	/* Estimate per-hash-entry space at tuple width... */
@@ -3737,9 +3933,6 @@ choose_hashed_grouping(PlannerInfo *root,
 	/* plus the per-hash-entry overhead */
 	hashentrysize += hash_agg_entry_size(agg_costs->numAggs);
 
-	if (hashentrysize * dNumGroups > work_mem * 1024L)
-		return false;
-
 	/*
 	 * When we have both GROUP BY and DISTINCT, use the more-rigorous of
 	 * DISTINCT and ORDER BY as the assumed required output sort order. This
@@ -3773,6 +3966,8 @@ choose_hashed_grouping(PlannerInfo *root,
 			 numGroupCols, dNumGroups,
 			 cheapest_path->startup_cost, cheapest_path->total_cost,
 			 path_rows);
+	cost_agg_spill(&hashed_p, dNumGroups, hashentrysize,
+				   path_rows, path_width);
 	/* Result of hashed agg is always unsorted */
 	if (target_pathkeys)
 		cost_sort(&hashed_p, root, target_pathkeys, hashed_p.total_cost,
@@ -3827,6 +4022,116 @@ choose_hashed_grouping(PlannerInfo *root,
 	return false;
 }
 
+/*
+ * choose_hashed_grouping_sets - which rollups should be done by hashing?
+ *
+ * Returns the set of indexes (into rollup_lists) of the rollups whose
+ * non-empty grouping sets are to be hashed instead of sorted.  Every hashed
+ * grouping set needs a hash table of its own, and the executor can only
+ * spill when there is a single one, so we only hash as long as all the
+ * tables together are expected to fit in work_mem.  Hashing a rollup other
+ * than the top one saves a sort of the whole input, while the per-tuple
+ * costs are the same either way; so we take the smallest rollups first.
+ *
+ * The top rollup is the one the input is sorted for.  We hash it only if
+ * all the others are hashed too, and the sort wouldn't be free or useful
+ * for the ORDER BY anyway.  Empty grouping sets are never hashed.
+ */
+static Bitmapset *
+choose_hashed_grouping_sets(PlannerInfo *root,
+							double path_rows, int path_width,
+							Path *cheapest_path, AggClauseCosts *agg_costs,
+							List *rollup_groupclauses, List *rollup_lists)
+{
+	Query	   *parse = root->parse;
+	int			numRollups = list_length(rollup_lists);
+	int			topRollup = numRollups - 1;
+	Bitmapset  *hashed_rollups = NULL;
+	double	   *rollup_space;
+	double		availspace = work_mem * 1024.0;
+	Size		hashentrysize;
+	ListCell   *lc,
+			   *lc2;
+	int			i;
+
+	/* Same restrictions as for choose_hashed_grouping */
+	if (agg_costs->numOrderedAggs > 0 ||
+		!grouping_is_hashable(parse->groupClause) ||
+		!enable_hashagg)
+		return NULL;
+
+	/* Estimate per-hash-entry space the same way as choose_hashed_grouping */
+	hashentrysize = MAXALIGN(path_width) + MAXALIGN(SizeofMinimalTupleHeader);
+	hashentrysize += agg_costs->transitionSpace;
+	hashentrysize += hash_agg_entry_size(agg_costs->numAggs);
+
+	/*
+	 * Estimate the space needed to hash each rollup; -1 marks a rollup that
+	 * can't be hashed as a whole because it contains an empty set.
+	 */
+	rollup_space = (double *) palloc(numRollups * sizeof(double));
+
+	i = 0;
+	forboth(lc, rollup_groupclauses, lc2, rollup_lists)
+	{
+		List	   *groupExprs = get_sortgrouplist_exprs(lfirst(lc),
+														 parse->targetList);
+		ListCell   *lc3;
+
+		rollup_space[i] = 0;
+		foreach(lc3, (List *) lfirst(lc2))
+		{
+			List	   *gset = lfirst(lc3);
+
+			if (gset == NIL)
+			{
+				if (i != topRollup)
+					rollup_space[i] = -1;
+				continue;
+			}
+			if (rollup_space[i] >= 0)
+				rollup_space[i] += hashentrysize *
+					estimate_num_groups(root, groupExprs, path_rows, &gset);
+		}
+		i++;
+	}
+
+	/* Greedily hash the smallest of the other rollups while they fit */
+	for (;;)
+	{
+		int			best = -1;
+
+		for (i = 0; i < topRollup; i++)
+		{
+			if (rollup_space[i] < 0 || bms_is_member(i, hashed_rollups))
+				continue;
+			if (best < 0 || rollup_space[i] < rollup_space[best])
+				best = i;
+		}
+		if (best < 0 || rollup_space[best] > availspace)
+			break;
+
+		hashed_rollups = bms_add_member(hashed_rollups, best);
+		availspace -= rollup_space[best];
+	}
+
+	/*
+	 * With a single rollup, sorted grouping delivers its output in order, so
+	 * don't throw that away if the ORDER BY can use it.
+	 */
+	if (bms_num_members(hashed_rollups) == topRollup &&
+		rollup_space[topRollup] <= availspace &&
+		!pathkeys_contained_in(root->group_pathkeys,
+							   cheapest_path->pathkeys) &&
+		(numRollups > 1 || root->sort_pathkeys == NIL ||
+		 !pathkeys_contained_in(root->sort_pathkeys, root->group_pathkeys)))
+		hashed_rollups = bms_add_member(hashed_rollups, topRollup);
+
+	pfree(rollup_space);
+
+	return hashed_rollups;
+}
+
 /*
  * choose_hashed_distinct - should we use hashing for DISTINCT?
  *
@@ -3894,8 +4199,9 @@ choose_hashed_distinct(PlannerInfo *root,
 		return false;
 
 	/*
-	 * Don't do it if it doesn't look like the hashtable will fit into
-	 * work_mem.
+	 * Estimate the hash table's size; if it won't fit into work_mem, the
+	 * hashed plan will have to spill to disk, which cost_agg_spill charges
+	 * for.
 	 */
 
 	/* Estimate per-hash-entry space at tuple width... */
@@ -3903,9 +4209,6 @@ choose_hashed_distinct(PlannerInfo *root,
 	/* plus the per-hash-entry overhead */
 	hashentrysize += hash_agg_entry_size(0);
 
-	if (hashentrysize * dNumDistinctRows > work_mem * 1024L)
-		return false;
-
 	/*
 	 * See if the estimated cost is no more than doing it the other way. While
 	 * avoiding the need for sorted input is usually a win, the fact that the
@@ -3923,6 +4226,8 @@ choose_hashed_distinct(PlannerInfo *root,
 			 numDistinctCols, dNumDistinctRows,
 			 cheapest_startup_cost, cheapest_total_cost,
 			 path_rows);
+	cost_agg_spill(&hashed_p, dNumDistinctRows, hashentrysize,
+				   path_rows, path_width);
 
 	/*
 	 * Result of hashed agg is always unsorted, so if ORDER BY is present we
@@ -4760,7 +5065,78 @@ plan_cluster_use_sort(Oid tableOid, Oid indexOid)
 	indexScanPath = create_index_path(root, indexInfo,
 									  NIL, NIL, NIL, NIL, NIL,
 									  ForwardScanDirection, false,
-									  NULL, 1.0);
+									  NULL, 1.0, 0);
 
 	return (seqScanAndSortPath.total_cost < indexScanPath->path.total_cost);
 }
+
+/*
+ * plan_create_index_workers
+ *		Use the planner to decide how many parallel workers CREATE INDEX
+ *		should request
+ *
+ * tableOid is the table on which the index is to be built, and indexOid is
+ * the OID of the (already created, still empty) btree index.  We apply the
+ * same rule that sizes a parallel sequential scan of the table, since the
+ * workers will scan the table between them; 0 means a serial build.
+ *
+ * Note: caller had better already hold some type of lock on the table and
+ * index.
+ */
+int
+plan_create_index_workers(Oid tableOid, Oid indexOid)
+{
+	RelOptInfo *rel;
+	Relation	heap;
+	Relation	index;
+	bool		parallel_safe;
+	BlockNumber pages;
+	double		tuples;
+	double		allvisfrac;
+
+	/* Same restrictions as for parallel query; see standard_planner */
+	if (!IsUnderPostmaster || dynamic_shared_memory_type == DSM_IMPL_NONE ||
+		max_parallel_degree == 0 || IsInParallelMode() ||
+		IsolationIsSerializable())
+		return 0;
+
+	heap = heap_open(tableOid, NoLock);
+	index = index_open(indexOid, NoLock);
+
+	/*
+	 * Workers can't see the leader's local buffers, nor would they know that
+	 * a system catalog's indexes are being rebuilt, so those are built
+	 * serially.  Index expressions and predicates are evaluated by the
+	 * workers, so they'd better be parallel-safe.
+	 */
+	parallel_safe = !RelationUsesLocalBuffers(heap) &&
+		!IsSystemRelation(heap) &&
+		!has_parallel_hazard((Node *) RelationGetIndexExpressions(index),
+							 false) &&
+		!has_parallel_hazard((Node *) RelationGetIndexPredicate(index),
+							 false);
+
+	index_close(index, NoLock);
+
+	if (!parallel_safe)
+	{
+		heap_close(heap, NoLock);
+		return 0;
+	}
+
+	/*
+	 * Estimate the table's size the way get_relation_info would.  We mustn't
+	 * use build_simple_rel here, since that would look at the table's
+	 * indexes, including the one we're about to fill, whose metapage hasn't
+	 * been written yet.
+	 */
+	estimate_rel_size(heap, NULL, &pages, &tuples, &allvisfrac);
+	heap_close(heap, NoLock);
+
+	/* compute_parallel_degree needs nothing else from the RelOptInfo */
+	rel = makeNode(RelOptInfo);
+	rel->reloptkind = RELOPT_BASEREL;
+	rel->pages = pages;
+
+	return compute_parallel_degree(rel, rel->pages);
+}
@@ -86,6 +86,14 @@
  * we preread from a tape, so as to maintain the locality of access described
  * above.  Nonetheless, with large workMem we can have many tapes.
  *
+ * A parallel sort is performed by having each worker sort its share of the
+ * input with its own Tuplesortstate, and then stream the sorted output to
+ * the leader through a shm_mq.  The leader attaches those streams (plus,
+ * optionally, the output of its own local sort) to a fresh Tuplesortstate
+ * with tuplesort_attach_streams(); tuplesort_performsort() then sets up a
+ * final on-the-fly merge of the streams, using a heap just like the final
+ * merge of tapes.  Each stream is in effect a single presorted run.
+ *
  *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -187,7 +195,8 @@ typedef enum
 	TSS_BUILDRUNS,				/* Loading tuples; writing to tape */
 	TSS_SORTEDINMEM,			/* Sort completed entirely in memory */
 	TSS_SORTEDONTAPE,			/* Sort completed, final run is on tape */
-	TSS_FINALMERGE				/* Performing final merge on-the-fly */
+	TSS_FINALMERGE,				/* Performing final merge on-the-fly */
+	TSS_STREAMMERGE				/* Performing final merge of streams */
 } TupSortStatus;
 
 /*
@@ -336,6 +345,16 @@ struct Tuplesortstate
 	int			current;		/* array index (only used if SORTEDINMEM) */
 	bool		eof_reached;	/* reached EOF (needed for cursors) */
 
+	/*
+	 * These variables are used when merging presorted streams; see
+	 * tuplesort_attach_streams.  During the merge, the tupindex of each heap
+	 * entry is the source it was read from: streams are numbered from 0, and
+	 * localsort, if any, comes last.
+	 */
+	int			nstreams;		/* number of attached streams */
+	shm_mq_handle **streams;	/* queues carrying presorted tuples */
+	Tuplesortstate *localsort;	/* completed sort merged with the streams */
+
 	/* markpos_xxx holds marked position for mark and restore */
 	long		markpos_block;	/* tape block# (only used if SORTEDONTAPE) */
 	int			markpos_offset; /* saved "current", or offset in tape block */
@@ -468,6 +487,8 @@ static void mergeonerun(Tuplesortstate *state);
 static void beginmerge(Tuplesortstate *state);
 static void mergepreread(Tuplesortstate *state);
 static void mergeprereadone(Tuplesortstate *state, int srcTape);
+static void beginstreammerge(Tuplesortstate *state);
+static bool readstreamtup(Tuplesortstate *state, SortTuple *stup, int srcno);
 static void dumptuples(Tuplesortstate *state, bool alltuples);
 static void make_bounded_heap(Tuplesortstate *state);
 static void sort_bounded_heap(Tuplesortstate *state);
@@ -1568,6 +1589,41 @@ consider_abort_common(Tuplesortstate *state)
 	return false;
 }
 
+/*
+ * Arrange for the sort's output to be the merge of presorted streams.
+ *
+ * Each of the nstreams queues must deliver tuples already sorted the same
+ * way as this sort, one tuple per message, and the sender must detach when
+ * done.  If localsort is not NULL, its output (it must already have been
+ * through tuplesort_performsort) is merged in as well.  No tuples may be
+ * put into this sort; call tuplesort_performsort to begin the merge, and
+ * fetch the result as usual.  The caller retains ownership of the queues
+ * and of localsort, which must outlive this sort's final merge.
+ *
+ * Currently only btree index sorts are supported, since the stream format
+ * is simply the IndexTuple.
+ */
+void
+tuplesort_attach_streams(Tuplesortstate *state, int nstreams,
+						 shm_mq_handle **streams, Tuplesortstate *localsort)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(state->sortcontext);
+
+	Assert(state->status == TSS_INITIAL);
+	Assert(state->memtupcount == 0);
+	Assert(state->comparetup == comparetup_index_btree);
+	Assert(!state->randomAccess && !state->bounded);
+	Assert(nstreams > 0);
+
+	state->nstreams = nstreams;
+	state->streams = (shm_mq_handle **)
+		palloc(nstreams * sizeof(shm_mq_handle *));
+	memcpy(state->streams, streams, nstreams * sizeof(shm_mq_handle *));
+	state->localsort = localsort;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
 /*
  * All tuples have been provided; finish the sort.
  */
@@ -1586,6 +1642,16 @@ tuplesort_performsort(Tuplesortstate *state)
 	{
 		case TSS_INITIAL:
 
+			/*
+			 * If we were given presorted streams, all that's left to do is
+			 * to set up their final merge.
+			 */
+			if (state->streams != NULL)
+			{
+				beginstreammerge(state);
+				break;
+			}
+
 			/*
 			 * We were able to accumulate all the tuples within the allowed
 			 * amount of memory.  Just qsort 'em and we're done.
@@ -1652,6 +1718,10 @@ tuplesort_performsort(Tuplesortstate *state)
 			elog(LOG, "performsort done (except %d-way final merge): %s",
 				 state->activeTapes,
 				 pg_rusage_show(&state->ru_start));
+		else if (state->status == TSS_STREAMMERGE)
+			elog(LOG, "performsort done (except %d-way stream merge): %s",
+				 state->nstreams + (state->localsort != NULL ? 1 : 0),
+				 pg_rusage_show(&state->ru_start));
 		else
 			elog(LOG, "performsort done: %s",
 				 pg_rusage_show(&state->ru_start));
@@ -1856,6 +1926,27 @@ tuplesort_gettuple_common(Tuplesortstate *state, bool forward,
 			}
 			return false;
 
+		case TSS_STREAMMERGE:
+			Assert(forward);
+			*should_free = true;
+
+			if (state->memtupcount > 0)
+			{
+				int			srcno = state->memtuples[0].tupindex;
+				SortTuple	newtup;
+
+				*stup = state->memtuples[0];
+				/* returned tuple is no longer counted in our memory space */
+				if (stup->tuple)
+					FREEMEM(state, GetMemoryChunkSpace(stup->tuple));
+				tuplesort_heap_siftup(state, false);
+				/* replace it with the next tuple from the same source */
+				if (readstreamtup(state, &newtup, srcno))
+					tuplesort_heap_insert(state, &newtup, srcno, false);
+				return true;
+			}
+			return false;
+
 		default:
 			elog(ERROR, "invalid tuplesort state");
 			return false;		/* keep compiler quiet */
@@ -2013,6 +2104,7 @@ tuplesort_skiptuples(Tuplesortstate *state, int64 ntuples, bool forward)
 
 		case TSS_SORTEDONTAPE:
 		case TSS_FINALMERGE:
+		case TSS_STREAMMERGE:
 
 			/*
 			 * We could probably optimize these cases better, but for now it's
@@ -2615,6 +2707,103 @@ mergeprereadone(Tuplesortstate *state, int srcTape)
 	state->availMem = priorAvail - spaceUsed;
 }
 
+/*
+ * beginstreammerge - initialize for the final merge of attached streams
+ *
+ * We fill the heap with the first tuple of each source; after that, every
+ * tuple returned is replaced by the next one from the source it came from.
+ */
+static void
+beginstreammerge(Tuplesortstate *state)
+{
+	int			nsources = state->nstreams + (state->localsort ? 1 : 0);
+	int			srcno;
+
+	Assert(state->memtupcount == 0);
+
+	if (state->sortKeys != NULL && state->sortKeys->abbrev_converter != NULL)
+	{
+		/*
+		 * Streamed tuples don't carry abbreviated keys, and the local sort
+		 * may have given up on them, so disable abbreviation here too.
+		 */
+		state->sortKeys->abbrev_converter = NULL;
+		state->sortKeys->comparator = state->sortKeys->abbrev_full_comparator;
+
+		/* Not strictly necessary, but be tidy */
+		state->sortKeys->abbrev_abort = NULL;
+		state->sortKeys->abbrev_full_comparator = NULL;
+	}
+
+	/* The heap needs one slot per source */
+	if (state->memtupsize < nsources)
+	{
+		FREEMEM(state, GetMemoryChunkSpace(state->memtuples));
+		state->memtupsize = nsources;
+		state->memtuples = (SortTuple *)
+			repalloc(state->memtuples, state->memtupsize * sizeof(SortTuple));
+		USEMEM(state, GetMemoryChunkSpace(state->memtuples));
+	}
+
+	for (srcno = 0; srcno < nsources; srcno++)
+	{
+		SortTuple	stup;
+
+		if (readstreamtup(state, &stup, srcno))
+			tuplesort_heap_insert(state, &stup, srcno, false);
+	}
+
+	state->status = TSS_STREAMMERGE;
+}
+
+/*
+ * readstreamtup - fetch the next tuple from merge source srcno
+ *
+ * Returns FALSE if the source is exhausted.  A stream is exhausted when its
+ * sender detaches; if that happened because the sender failed, the caller
+ * will hear about it when it waits for the workers to finish.
+ */
+static bool
+readstreamtup(Tuplesortstate *state, SortTuple *stup, int srcno)
+{
+	if (srcno < state->nstreams)
+	{
+		shm_mq_result res;
+		Size		nbytes;
+		void	   *data;
+
+		res = shm_mq_receive(state->streams[srcno], &nbytes, &data, false);
+		if (res == SHM_MQ_DETACHED)
+			return false;
+		Assert(res == SHM_MQ_SUCCESS);
+
+		/* data points into the queue, so copy it into sort memory */
+		COPYTUP(state, stup, data);
+	}
+	else
+	{
+		Tuplesortstate *localsort = state->localsort;
+		MemoryContext oldcontext;
+		SortTuple	ltup;
+		bool		should_free;
+		bool		found;
+
+		oldcontext = MemoryContextSwitchTo(localsort->sortcontext);
+		found = tuplesort_gettuple_common(localsort, true, &ltup,
+										  &should_free);
+		MemoryContextSwitchTo(oldcontext);
+
+		if (!found)
+			return false;
+
+		COPYTUP(state, stup, ltup.tuple);
+		if (should_free)
+			pfree(ltup.tuple);
+	}
+
+	return true;
+}
+
 /*
  * dumptuples - remove tuples from heap and write to tape
  *
@@ -2825,6 +3014,9 @@ tuplesort_get_stats(Tuplesortstate *state,
 		case TSS_FINALMERGE:
 			*sortMethod = "external merge";
 			break;
+		case TSS_STREAMMERGE:
+			*sortMethod = "parallel merge";
+			break;
 		default:
 			*sortMethod = "still in progress";
 			break;
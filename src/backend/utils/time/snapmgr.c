@@ -819,6 +819,9 @@ AtSubCommit_Snapshot(int level)
 void
 AtSubAbort_Snapshot(int level)
 {
+	/* Results of the batch visibility check may refer to a freed snapshot */
+	HeapPageResetVisibility();
+
 	/* Forget the active snapshots set by this subtransaction */
 	while (ActiveSnapshot && ActiveSnapshot->as_level >= level)
 	{
@@ -853,6 +856,8 @@ AtSubAbort_Snapshot(int level)
 void
 AtEOXact_Snapshot(bool isCommit)
 {
+	HeapPageResetVisibility();
+
 	/*
 	 * In transaction-snapshot mode we must release our privately-managed
 	 * reference to the transaction snapshot.  We must decrement
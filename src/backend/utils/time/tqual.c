@@ -81,6 +81,19 @@ SnapshotData SnapshotSelfData = {HeapTupleSatisfiesSelf};
 SnapshotData SnapshotAnyData = {HeapTupleSatisfiesAny};
 SnapshotData SnapshotToastData = {HeapTupleSatisfiesToast};
 
+/*
+ * Results of batch check of XIDs of the heap page being scanned against the
+ * snapshot (see HeapPagePrefetchVisibility).  XIDs are sorted for binary
+ * search.
+ */
+#define MaxPrefetchedXids (MaxHeapTuplesPerPage * 2)
+
+static Snapshot PrefetchedSnapshot = NULL;
+static int	nPrefetchedXids;
+static TransactionId PrefetchedXids[MaxPrefetchedXids];
+static bool PrefetchedInSnapshot[MaxPrefetchedXids];
+static bool PrefetchedResolved[MaxPrefetchedXids];
+
 /* local functions */
 static bool XidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
 
@@ -1458,9 +1471,105 @@ HeapTupleIsSurelyDead(HeapTuple htup, TransactionId OldestXmin)
 bool
 XidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 {
+	if (snapshot == PrefetchedSnapshot)
+	{
+		TransactionId *found = (TransactionId *) bsearch(&xid, PrefetchedXids, nPrefetchedXids,
+										sizeof(TransactionId), xidComparator);
+
+		if (found != NULL && PrefetchedResolved[found - PrefetchedXids])
+			return PrefetchedInSnapshot[found - PrefetchedXids];
+	}
 	return TM->IsInSnapshot(xid, snapshot);
 }
 
+/*
+ * HeapPagePrefetchVisibility
+ *		Check xmin/xmax of all tuples of the page against the MVCC snapshot
+ *		with one call of the transaction manager.
+ *
+ * Results are used by XidInMVCCSnapshot until HeapPageResetVisibility is
+ * called.  The caller must hold at least share lock on the buffer.  Nothing
+ * is done for the standard transaction manager, for which the per-XID check
+ * is cheap, nor for transaction managers that don't provide a batch check.
+ */
+void
+HeapPagePrefetchVisibility(Buffer buffer, Snapshot snapshot)
+{
+	Page		page = BufferGetPage(buffer);
+	OffsetNumber lines = PageGetMaxOffsetNumber(page);
+	OffsetNumber lineoff;
+	int			nXids = 0;
+	int			i,
+				j;
+
+	PrefetchedSnapshot = NULL;
+
+	if (TM->IsInSnapshotBatch == NULL ||
+		TM->IsInSnapshotBatch == PgXidInMVCCSnapshotBatch ||
+		snapshot->satisfies != HeapTupleSatisfiesMVCC)
+		return;
+
+	for (lineoff = FirstOffsetNumber; lineoff <= lines; lineoff++)
+	{
+		ItemId		lpp = PageGetItemId(page, lineoff);
+		HeapTupleHeader tuple;
+
+		if (!ItemIdIsNormal(lpp))
+			continue;
+
+		tuple = (HeapTupleHeader) PageGetItem(page, lpp);
+		if (!HeapTupleHeaderXminInvalid(tuple) &&
+			!HeapTupleHeaderXminFrozen(tuple) &&
+			TransactionIdIsNormal(HeapTupleHeaderGetRawXmin(tuple)))
+			PrefetchedXids[nXids++] = HeapTupleHeaderGetRawXmin(tuple);
+		if (!(tuple->t_infomask & (HEAP_XMAX_INVALID | HEAP_XMAX_IS_MULTI)) &&
+			TransactionIdIsNormal(HeapTupleHeaderGetRawXmax(tuple)))
+			PrefetchedXids[nXids++] = HeapTupleHeaderGetRawXmax(tuple);
+	}
+	if (nXids == 0)
+		return;
+
+	/* Sort and remove duplicates: usually many tuples are inserted by the same transaction */
+	qsort(PrefetchedXids, nXids, sizeof(TransactionId), xidComparator);
+	for (i = 1, j = 0; i < nXids; i++)
+	{
+		if (PrefetchedXids[i] != PrefetchedXids[j])
+			PrefetchedXids[++j] = PrefetchedXids[i];
+	}
+	nPrefetchedXids = j + 1;
+
+	TM->IsInSnapshotBatch(PrefetchedXids, nPrefetchedXids, snapshot,
+						  PrefetchedInSnapshot, PrefetchedResolved);
+	PrefetchedSnapshot = snapshot;
+}
+
+/*
+ * HeapPageResetVisibility
+ *		Forget results of HeapPagePrefetchVisibility.
+ */
+void
+HeapPageResetVisibility(void)
+{
+	PrefetchedSnapshot = NULL;
+}
+
+/*
+ * PgXidInMVCCSnapshotBatch
+ *		Default implementation of the batch check: check XIDs one by one.
+ */
+void
+PgXidInMVCCSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot,
+						 bool *inSnapshot, bool *resolved)
+{
+	int			i;
+
+	for (i = 0; i < nXids; i++)
+	{
+		inSnapshot[i] = TM->IsInSnapshot(xids[i], snapshot);
+		resolved[i] = true;
+	}
+}
+
 /*
  * XidInMVCCSnapshot
  *		Is the given XID still-in-progress according to the snapshot?
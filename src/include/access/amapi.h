@@ -104,6 +104,15 @@ typedef void (*ammarkpos_function) (IndexScanDesc scan);
 /* restore marked scan position */
 typedef void (*amrestrpos_function) (IndexScanDesc scan);
 
+/* estimate size of AM-specific shared state of a parallel scan */
+typedef Size (*amestimateparallelscan_function) (void);
+
+/* initialize AM-specific shared state of a parallel scan */
+typedef void (*aminitparallelscan_function) (void *target);
+
+/* reset AM-specific shared state of a parallel scan for a rescan */
+typedef void (*amparallelrescan_function) (IndexScanDesc scan);
+
 
 /*
  * API struct for an index AM.  Note this must be stored in a single palloc'd
@@ -142,6 +151,8 @@ typedef struct IndexAmRoutine
 	bool		amclusterable;
 	/* does AM handle predicate locks? */
 	bool		ampredlocks;
+	/* does AM support parallel scan? */
+	bool		amcanparallel;
 	/* type of data stored in index, or InvalidOid if variable */
 	Oid			amkeytype;
 
@@ -162,6 +173,11 @@ typedef struct IndexAmRoutine
 	amendscan_function amendscan;
 	ammarkpos_function ammarkpos;		/* can be NULL */
 	amrestrpos_function amrestrpos;		/* can be NULL */
+
+	/* interface functions to support parallel index scans */
+	amestimateparallelscan_function amestimateparallelscan;		/* can be NULL */
+	aminitparallelscan_function aminitparallelscan;		/* can be NULL */
+	amparallelrescan_function amparallelrescan;		/* can be NULL */
 } IndexAmRoutine;
 
 
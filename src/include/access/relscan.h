@@ -76,6 +76,22 @@ typedef struct HeapScanDescData
 	OffsetNumber rs_vistuples[MaxHeapTuplesPerPage];	/* their offsets */
 }	HeapScanDescData;
 
+/*
+ * Shared state for parallel index scan.
+ *
+ * Like ParallelHeapScanDescData, this lives in the DSM segment of the
+ * parallel query and is pointed to by the IndexScanDesc of each participant.
+ * The index AM's own shared state follows the serialized snapshot, at
+ * ps_offset bytes from the start of the structure.
+ */
+typedef struct ParallelIndexScanDescData
+{
+	Oid			ps_relid;		/* OID of the heap relation */
+	Oid			ps_indexid;		/* OID of the index */
+	Size		ps_offset;		/* offset of AM-specific shared state */
+	char		ps_snapshot_data[FLEXIBLE_ARRAY_MEMBER];
+}	ParallelIndexScanDescData;
+
 /*
  * We use the same IndexScanDescData structure for both amgettuple-based
  * and amgetbitmap-based index scans.  Some fields are only relevant in
@@ -125,6 +141,10 @@ typedef struct IndexScanDescData
 
 	/* state data for traversing HOT chains in index_getnext */
 	bool		xs_continue_hot;	/* T if must keep walking HOT chain */
+
+	/* parallel index scan information, in shared memory */
+	ParallelIndexScanDesc parallel_scan;
+	bool		xs_temp_snap;	/* unregister snapshot at scan end? */
 }	IndexScanDescData;
 
 /* Struct for heap-or-index scans of system tables */
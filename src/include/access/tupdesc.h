@@ -67,6 +67,12 @@ typedef struct tupleConstr
  * context and go away when the context is freed.  We set the tdrefcount
  * field of such a descriptor to -1, while reference-counted descriptors
  * always have tdrefcount >= 0.
+ *
+ * tdnfixed caches how many leading attributes have a fixed width; as long as
+ * a tuple has no nulls among them, their offsets (kept in attcacheoff) are
+ * the same in every tuple, so they can be extracted without walking the
+ * tuple.  It is computed by heaptuple.c the first time a tuple is deformed
+ * with the descriptor, and must be reset to -1 whenever attributes change.
  */
 typedef struct tupleDesc
 {
@@ -78,6 +84,8 @@ typedef struct tupleDesc
 	int32		tdtypmod;		/* typmod for tuple type */
 	bool		tdhasoid;		/* tuple has oid attribute in its header */
 	int			tdrefcount;		/* reference count, or -1 if not counting */
+	int			tdnfixed;		/* # of leading fixed-width attributes, or -1
+								 * if not computed yet */
 }	*TupleDesc;
 
 
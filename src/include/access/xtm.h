@@ -71,6 +71,18 @@ typedef struct
 
 	/* Get transaction manager name */
 	char const *(*GetName) (void);
+
+	/*
+	 * Check several XIDs at once (e.g. xmin/xmax of all tuples of a heap
+	 * page) against the snapshot, so that transaction manager can resolve
+	 * them with a single lock acquisition.  inSnapshot[i] is set to the
+	 * result of IsInSnapshot(xids[i], snapshot) if resolved[i] is set to
+	 * true.  XIDs which can not be resolved without waiting (e.g. in-doubt
+	 * transactions) should be left unresolved: IsInSnapshot is called for
+	 * them if they are really needed.  May be NULL, in which case
+	 * IsInSnapshot is used for every XID.
+	 */
+	void		(*IsInSnapshotBatch) (TransactionId *xids, int nXids, Snapshot snapshot, bool *inSnapshot, bool *resolved);
 }	TransactionManager;
 
 /* Get pointer to transaction manager: actually returns content of TM variable */
@@ -83,6 +95,8 @@ extern TransactionManager PgTM; /* Standard PostgreSQL transaction manager */
 /* Standard PostgreSQL function implementing TM interface */
 extern bool PgXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
 
+extern void PgXidInMVCCSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot, bool *inSnapshot, bool *resolved);
+
 extern void PgTransactionIdSetTreeStatus(TransactionId xid, int nsubxids,
 				   TransactionId *subxids, XidStatus status, XLogRecPtr lsn);
 extern XidStatus PgTransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn);
@@ -0,0 +1,172 @@
+/*-------------------------------------------------------------------------
+ *
+ * execExpr.h
+ *	  Compilation of expression state trees into flat step programs
+ *
+ * ExecInitExpr builds an ExprState tree paralleling the Expr tree, as it
+ * always has.  For the common node types (scalar Vars, Consts, function and
+ * operator calls, boolean operators, scalar null tests and relabelings) the
+ * tree rooted at an ExprState is then additionally compiled into a linear
+ * array of ExprEvalSteps, which ExecInterpExpr runs in a single loop instead
+ * of recursing through evalfunc pointers.  Any other node type inside such a
+ * tree becomes an EEOP_LEGACY step, which evaluates that subtree through its
+ * ExprState's evalfunc as before.
+ *
+ * Each step stores its result into the locations given by resvalue and
+ * resnull; a function call's arguments are evaluated directly into its
+ * FunctionCallInfoData, so no intermediate copying is needed.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/executor/execExpr.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef EXEC_EXPR_H
+#define EXEC_EXPR_H
+
+#include "nodes/execnodes.h"
+
+/*
+ * Discriminator for ExprEvalSteps.
+ *
+ * The order of this enum must match the dispatch table in ExecInterpExpr.
+ */
+typedef enum ExprEvalOp
+{
+	/* entire expression has been evaluated completely, return */
+	EEOP_DONE,
+
+	/* apply slot_getsomeattrs on corresponding tuple slot */
+	EEOP_INNER_FETCHSOME,
+	EEOP_OUTER_FETCHSOME,
+	EEOP_SCAN_FETCHSOME,
+
+	/* compute non-system Var value from already-deformed slot */
+	EEOP_INNER_VAR,
+	EEOP_OUTER_VAR,
+	EEOP_SCAN_VAR,
+
+	/* evaluate a Const whose value isn't stored directly into its target */
+	EEOP_CONST,
+
+	/*
+	 * Evaluate function call (including OpExprs etc).  EEOP_FUNCEXPR is also
+	 * the opcode the step is created with; the first execution of the
+	 * program replaces it by the most specialized variant below.
+	 */
+	EEOP_FUNCEXPR,
+	EEOP_FUNCEXPR_STRICT,
+	EEOP_FUNCEXPR_STRICT_1,
+	EEOP_FUNCEXPR_STRICT_2,
+	EEOP_FUNCEXPR_FUSAGE,
+	EEOP_FUNCEXPR_STRICT_FUSAGE,
+
+	/*
+	 * Evaluate boolean AND expression, one step per subexpression.  FIRST
+	 * resets the null tracking, LAST computes the final result.
+	 */
+	EEOP_BOOL_AND_STEP_FIRST,
+	EEOP_BOOL_AND_STEP,
+	EEOP_BOOL_AND_STEP_LAST,
+
+	/* similarly for boolean OR expression */
+	EEOP_BOOL_OR_STEP_FIRST,
+	EEOP_BOOL_OR_STEP,
+	EEOP_BOOL_OR_STEP_LAST,
+
+	/* evaluate boolean NOT expression */
+	EEOP_BOOL_NOT_STEP,
+
+	/* scalar NullTest */
+	EEOP_NULLTEST_ISNULL,
+	EEOP_NULLTEST_ISNOTNULL,
+
+	/* evaluate a subtree through its ExprState's evalfunc */
+	EEOP_LEGACY,
+
+	/* non-existent operation, used e.g. to check array lengths */
+	EEOP_LAST
+} ExprEvalOp;
+
+
+typedef struct ExprEvalStep
+{
+	/* ExprEvalOp of this step */
+	int			opcode;
+
+	/* where to store the result of this step */
+	Datum	   *resvalue;
+	bool	   *resnull;
+
+	/* per-opcode data; jump targets are indexes into the step array */
+	union
+	{
+		/* for EEOP_*_FETCHSOME */
+		struct
+		{
+			int			last_var;	/* highest attribute number to deform */
+		}			fetch;
+
+		/* for EEOP_*_VAR */
+		struct
+		{
+			int			attnum; /* zero-based attribute number */
+			Var		   *var;	/* original Var, for the first-time checks */
+		}			var;
+
+		/* for EEOP_CONST */
+		struct
+		{
+			Datum		value;
+			bool		isnull;
+		}			constval;
+
+		/* for EEOP_FUNCEXPR_* */
+		struct
+		{
+			Oid			funcid;
+			Expr	   *expr;	/* FuncExpr/OpExpr, for fmgr_info_set_expr */
+			FmgrInfo   *finfo;
+			FunctionCallInfo fcinfo_data;
+			PGFunction	fn_addr;	/* copied from finfo once looked up */
+			int			nargs;
+		}			func;
+
+		/* for EEOP_BOOL_*_STEP */
+		struct
+		{
+			bool	   *anynull;	/* track if any input was NULL */
+			int			jumpdone;	/* jump here if result determined */
+		}			boolexpr;
+
+		/* for EEOP_LEGACY */
+		struct
+		{
+			ExprState  *state;
+		}			legacy;
+	}			d;
+} ExprEvalStep;
+
+
+/*
+ * A compiled expression, hung off the root ExprState it was built from.
+ */
+typedef struct ExprEvalProgram
+{
+	ExprEvalStep *steps;		/* array of steps, ending with EEOP_DONE */
+	int			nsteps;			/* number of valid steps */
+	int			steps_alloc;	/* allocated length of steps array */
+	bool		prepared;		/* first-execution checks done? */
+	MemoryContext mcxt;			/* context the program was built in */
+
+	/* the root step stores the expression's result here */
+	Datum		resvalue;
+	bool		resnull;
+} ExprEvalProgram;
+
+
+extern void ExecCompileExpr(ExprState *state);
+
+#endif   /* EXEC_EXPR_H */
@@ -15,7 +15,10 @@
 #define HASHJOIN_H
 
 #include "nodes/execnodes.h"
+#include "port/atomics.h"
 #include "storage/buffile.h"
+#include "storage/dsm.h"
+#include "storage/spin.h"
 
 /* ----------------------------------------------------------------
  *				hash-join hash table structures
@@ -54,6 +57,9 @@
  * inner batch file.  Subsequently, while reading either inner or outer batch
  * files, we might find tuples that no longer belong to the current batch;
  * if so, we just dump them out to the correct batch file.
+ *
+ * A parallel-aware hash join instead builds one hash table shared by all
+ * the participants, in a DSM segment; see ParallelHashJoinState below.
  * ----------------------------------------------------------------
  */
 
@@ -63,7 +69,12 @@
 
 typedef struct HashJoinTupleData
 {
-	struct HashJoinTupleData *next;		/* link to next tuple in same bucket */
+	/* link to next tuple in same bucket */
+	union
+	{
+		struct HashJoinTupleData *unshared;
+		Size		shared;		/* offset within the shared segment, or 0 */
+	}			next;
 	uint32		hashvalue;		/* tuple's hash code */
 	/* Tuple data, in MinimalTuple format, follows on a MAXALIGN boundary */
 }	HashJoinTupleData;
@@ -123,6 +134,51 @@ typedef struct HashMemoryChunkData *HashMemoryChunk;
 #define HASH_CHUNK_SIZE			(32 * 1024L)
 #define HASH_CHUNK_THRESHOLD	(HASH_CHUNK_SIZE / 4)
 
+/*
+ * A parallel-aware hash join builds a single hash table shared by all the
+ * participants.  Each participant first hashes its share of the (partial)
+ * inner plan into private memory.  When they have all finished, the last one
+ * creates a DSM segment big enough for everybody's tuples, and each copies
+ * its own tuples into the part of the segment it reserved, linking them into
+ * the shared buckets with compare-and-exchange.  Since the segment can be
+ * mapped at different addresses in different processes, bucket heads and
+ * tuple links are offsets from the start of the segment.
+ *
+ * Only a single batch is supported, since batch files can't be shared
+ * between processes.  So the planner refuses a parallel-aware hash join
+ * (and enable_parallel_hash turns it off altogether) unless the estimated
+ * size of the shared table, together with the private copies of its tuples
+ * that the participants hold while building it, fits in work_mem.  Matched
+ * inner tuples aren't tracked, so right and full joins can't be done this
+ * way either.
+ *
+ * A participant that arrives after the build has begun can't help, since the
+ * inner plan has been consumed by then; it just waits for the table to be
+ * completed and attaches to it.  The last participant to finish hashing
+ * moves the build out of PHJ_BUILDING while it still holds the mutex, so
+ * that nobody can join in after it and decide to create a second table.
+ */
+typedef enum
+{
+	PHJ_BUILDING,				/* participants are hashing inner tuples */
+	PHJ_CREATING,				/* the last of them is creating the table */
+	PHJ_LOADING,				/* copying them into the shared table */
+	PHJ_PROBING					/* shared table is complete */
+} ParallelHashJoinPhase;
+
+typedef struct ParallelHashJoinState
+{
+	slock_t		mutex;			/* protects all the fields below */
+	ParallelHashJoinPhase phase;
+	int			nparticipants;	/* # processes building the table */
+	int			nscanned;		/* # of them done hashing inner tuples */
+	int			nloaded;		/* # of them done loading the shared table */
+	Size		tuple_space;	/* tuple space reserved so far */
+	double		ntuples;		/* # tuples reported so far */
+	dsm_handle	handle;			/* segment holding the table, once created */
+	uint32		cookie;			/* identifies that segment */
+} ParallelHashJoinState;
+
 typedef struct HashJoinTableData
 {
 	int			nbuckets;		/* # buckets in the in-memory hash table */
@@ -186,6 +242,12 @@ typedef struct HashJoinTableData
 
 	/* used for dense allocation of tuples (into linked chunks) */
 	HashMemoryChunk chunks;		/* one list for the whole batch */
+
+	/* used only if the table is shared by a parallel-aware hash join */
+	ParallelHashJoinState *parallel_state;	/* shared control, or NULL */
+	dsm_segment *shared_seg;	/* segment holding the shared table */
+	char	   *shared_base;	/* its address in this process */
+	pg_atomic_uint64 *shared_buckets;	/* bucket heads, as offsets */
 }	HashJoinTableData;
 
 #endif   /* HASHJOIN_H */
@@ -16,6 +16,10 @@
 
 #include "nodes/execnodes.h"
 
+/* Limits on the number of partitions a hashed Agg spills to at once */
+#define HASHAGG_MIN_PARTITIONS		4
+#define HASHAGG_MAX_PARTITIONS		32
+
 extern AggState *ExecInitAgg(Agg *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecAgg(AggState *node);
 extern void ExecEndAgg(AggState *node);
@@ -29,4 +29,7 @@ extern void ExecForeignScanInitializeDSM(ForeignScanState *node,
 extern void ExecForeignScanInitializeWorker(ForeignScanState *node,
 											shm_toc *toc);
 
+extern bool ExecForeignScanStartAsync(ForeignScanState *node);
+extern pgsocket ExecForeignScanAsyncSocket(ForeignScanState *node);
+
 #endif   /* NODEFOREIGNSCAN_H */
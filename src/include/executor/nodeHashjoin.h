@@ -14,6 +14,7 @@
 #ifndef NODEHASHJOIN_H
 #define NODEHASHJOIN_H
 
+#include "access/parallel.h"
 #include "nodes/execnodes.h"
 #include "storage/buffile.h"
 
@@ -25,4 +26,12 @@ extern void ExecReScanHashJoin(HashJoinState *node);
 extern void ExecHashJoinSaveTuple(MinimalTuple tuple, uint32 hashvalue,
 					  BufFile **fileptr);
 
+/* parallel hash join support */
+extern void ExecHashJoinEstimate(HashJoinState *node, ParallelContext *pcxt);
+extern void ExecHashJoinInitializeDSM(HashJoinState *node,
+						  ParallelContext *pcxt);
+extern void ExecHashJoinReInitializeDSM(HashJoinState *node,
+							ParallelContext *pcxt);
+extern void ExecHashJoinInitializeWorker(HashJoinState *node, shm_toc *toc);
+
 #endif   /* NODEHASHJOIN_H */
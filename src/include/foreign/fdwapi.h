@@ -79,6 +79,13 @@ typedef TupleTableSlot *(*ExecForeignInsert_function) (EState *estate,
 														TupleTableSlot *slot,
 												   TupleTableSlot *planSlot);
 
+typedef int (*GetForeignModifyBatchSize_function) (ResultRelInfo *rinfo);
+
+typedef TupleTableSlot **(*ExecForeignBatchInsert_function) (EState *estate,
+														ResultRelInfo *rinfo,
+													   TupleTableSlot **slots,
+															int *numSlots);
+
 typedef TupleTableSlot *(*ExecForeignUpdate_function) (EState *estate,
 														ResultRelInfo *rinfo,
 														TupleTableSlot *slot,
@@ -131,6 +138,10 @@ typedef void (*InitializeDSMForeignScan_function) (ForeignScanState *node,
 typedef void (*InitializeWorkerForeignScan_function) (ForeignScanState *node,
 													  shm_toc *toc,
 													  void *coordinate);
+
+typedef bool (*StartForeignScanAsync_function) (ForeignScanState *node);
+typedef pgsocket (*ForeignScanAsyncSocket_function) (ForeignScanState *node);
+
 /*
  * FdwRoutine is the struct returned by a foreign-data wrapper's handler
  * function.  It provides pointers to the callback functions needed by the
@@ -167,6 +178,8 @@ typedef struct FdwRoutine
 	PlanForeignModify_function PlanForeignModify;
 	BeginForeignModify_function BeginForeignModify;
 	ExecForeignInsert_function ExecForeignInsert;
+	GetForeignModifyBatchSize_function GetForeignModifyBatchSize;
+	ExecForeignBatchInsert_function ExecForeignBatchInsert;
 	ExecForeignUpdate_function ExecForeignUpdate;
 	ExecForeignDelete_function ExecForeignDelete;
 	EndForeignModify_function EndForeignModify;
@@ -191,6 +204,10 @@ typedef struct FdwRoutine
 	EstimateDSMForeignScan_function EstimateDSMForeignScan;
 	InitializeDSMForeignScan_function InitializeDSMForeignScan;
 	InitializeWorkerForeignScan_function InitializeWorkerForeignScan;
+
+	/* Support functions for asynchronous execution under Append node */
+	StartForeignScanAsync_function StartForeignScanAsync;
+	ForeignScanAsyncSocket_function ForeignScanAsyncSocket;
 } FdwRoutine;
 
 
@@ -50,9 +50,10 @@
  *		ReadyForInserts		is it valid for inserts?
  *		Concurrent			are we doing a concurrent index build?
  *		BrokenHotChain		did we detect any broken HOT chains?
+ *		ParallelWorkers		# of workers requested (excludes leader)
  *
- * ii_Concurrent and ii_BrokenHotChain are used only during index build;
- * they're conventionally set to false otherwise.
+ * ii_Concurrent, ii_BrokenHotChain, and ii_ParallelWorkers are used only
+ * during index build; they're conventionally set to false/0 otherwise.
  * ----------------
  */
 typedef struct IndexInfo
@@ -74,6 +75,7 @@ typedef struct IndexInfo
 	bool		ii_ReadyForInserts;
 	bool		ii_Concurrent;
 	bool		ii_BrokenHotChain;
+	int			ii_ParallelWorkers;
 } IndexInfo;
 
 /* ----------------
@@ -318,6 +320,9 @@ typedef struct JunkFilter
  *		projectReturning		for computing a RETURNING list
  *		onConflictSetProj		for computing ON CONFLICT DO UPDATE SET
  *		onConflictSetWhere		list of ON CONFLICT DO UPDATE exprs (qual)
+ *		BatchSize				max # of rows inserted into foreign table at once
+ *		NumSlots				# of rows buffered for batch insert
+ *		Slots					buffered rows of batch insert
  * ----------------
  */
 typedef struct ResultRelInfo
@@ -341,6 +346,9 @@ typedef struct ResultRelInfo
 	ProjectionInfo *ri_projectReturning;
 	ProjectionInfo *ri_onConflictSetProj;
 	List	   *ri_onConflictSetWhere;
+	int			ri_BatchSize;
+	int			ri_NumSlots;
+	TupleTableSlot **ri_Slots;
 } ResultRelInfo;
 
 /* ----------------
@@ -489,6 +497,10 @@ typedef struct ExecAuxRowMark
  * are set to point to the caller's function arrays while doing such a search.
  * During LookupTupleHashEntry(), they point to tab_hash_funcs and
  * tab_eq_funcs respectively.
+ *
+ * The underlying open-addressing table (see lib/simplehash.h) only holds
+ * fixed-size buckets, each pointing to a separately allocated, variable
+ * size entry and caching the entry's hash value.
  * ----------------------------------------------------------------
  */
 typedef struct TupleHashEntryData *TupleHashEntry;
@@ -496,14 +508,28 @@ typedef struct TupleHashTableData *TupleHashTable;
 
 typedef struct TupleHashEntryData
 {
-	/* firstTuple must be the first field in this struct! */
 	MinimalTuple firstTuple;	/* copy of first tuple in this group */
 	/* there may be additional data beyond the end of this struct */
 } TupleHashEntryData;			/* VARIABLE LENGTH STRUCT */
 
+typedef struct TupleHashBucketData
+{
+	TupleHashEntry entry;		/* the entry; NULL as key means inputslot */
+	uint32		hash;			/* hash value of the entry's key columns */
+	char		status;			/* hash status */
+} TupleHashBucketData;
+
+/* define parameters necessary to generate the tuple hash table interface */
+#define SH_PREFIX tuplehash
+#define SH_ELEMENT_TYPE TupleHashBucketData
+#define SH_KEY_TYPE TupleHashEntry
+#define SH_SCOPE extern
+#define SH_DECLARE
+#include "lib/simplehash.h"
+
 typedef struct TupleHashTableData
 {
-	HTAB	   *hashtab;		/* underlying dynahash table */
+	tuplehash_hash *hashtab;	/* underlying hash table */
 	int			numCols;		/* number of columns in lookup key */
 	AttrNumber *keyColIdx;		/* attr numbers of key columns */
 	FmgrInfo   *tab_hash_funcs; /* hash functions for table datatype(s) */
@@ -511,6 +537,7 @@ typedef struct TupleHashTableData
 	MemoryContext tablecxt;		/* memory context containing table */
 	MemoryContext tempcxt;		/* context for function evaluations */
 	Size		entrysize;		/* actual size to make each hash entry */
+	uint32		hash_iv;		/* hash-function IV */
 	TupleTableSlot *tableslot;	/* slot for referencing table entries */
 	/* The following fields are set transiently for each table search: */
 	TupleTableSlot *inputslot;	/* current input tuple's slot */
@@ -518,24 +545,27 @@ typedef struct TupleHashTableData
 	FmgrInfo   *cur_eq_funcs;	/* equality functions for input vs. table */
 }	TupleHashTableData;
 
-typedef HASH_SEQ_STATUS TupleHashIterator;
+typedef tuplehash_iterator TupleHashIterator;
 
 /*
  * Use InitTupleHashIterator/TermTupleHashIterator for a read/write scan.
- * Use ResetTupleHashIterator if the table can be frozen (in this case no
- * explicit scan termination is needed).
+ * Use ResetTupleHashIterator to restart a scan of a table that is no longer
+ * being added to.  No new entries may be added while a scan is in progress.
  */
 #define InitTupleHashIterator(htable, iter) \
-	hash_seq_init(iter, (htable)->hashtab)
+	tuplehash_start_iterate((htable)->hashtab, iter)
 #define TermTupleHashIterator(iter) \
-	hash_seq_term(iter)
+	((void) 0)
 #define ResetTupleHashIterator(htable, iter) \
-	do { \
-		hash_freeze((htable)->hashtab); \
-		hash_seq_init(iter, (htable)->hashtab); \
-	} while (0)
-#define ScanTupleHashTable(iter) \
-	((TupleHashEntry) hash_seq_search(iter))
+	InitTupleHashIterator(htable, iter)
+#define ScanTupleHashTable(htable, iter) \
+	TupleHashBucketGetEntry(tuplehash_iterate((htable)->hashtab, iter))
+
+static inline TupleHashEntry
+TupleHashBucketGetEntry(TupleHashBucketData *bucket)
+{
+	return bucket ? bucket->entry : NULL;
+}
 
 
 /* ----------------------------------------------------------------
@@ -559,7 +589,10 @@ typedef HASH_SEQ_STATUS TupleHashIterator;
  * local run-time state (such as Var, Const, or Param).
  *
  * To save on dispatch overhead, each ExprState node contains a function
- * pointer to the routine to execute to evaluate the node.
+ * pointer to the routine to execute to evaluate the node.  If the tree
+ * rooted at the node has been compiled into a flat step program, the
+ * function pointer runs that program instead, and the child ExprStates are
+ * only used for the subtrees the program can't handle itself.
  * ----------------
  */
 
@@ -575,6 +608,8 @@ struct ExprState
 	NodeTag		type;
 	Expr	   *expr;			/* associated Expr node */
 	ExprStateEvalFunc evalfunc; /* routine to run to execute node */
+	struct ExprEvalProgram *program;	/* compiled steps, if any (see
+										 * executor/execExpr.h) */
 };
 
 /* ----------------
@@ -1134,6 +1169,8 @@ typedef struct ModifyTableState
 										 * tlist  */
 	TupleTableSlot *mt_conflproj;		/* CONFLICT ... SET ... projection
 										 * target */
+	Tuplestorestate *mt_batch_returning;	/* RETURNING results of batch
+											 * inserts not returned yet */
 } ModifyTableState;
 
 /* ----------------
@@ -1141,6 +1178,11 @@ typedef struct ModifyTableState
  *
  *		nplans			how many plans are in the array
  *		whichplan		which plan is being executed (0 .. n-1)
+ *		async			true if some subplans are executed asynchronously
+ *		async_started	true if asynchronous subplans have been started
+ *		asyncplans		which subplans are executed asynchronously
+ *		finished		which subplans have returned all their tuples
+ *		waitsocks		sockets of the subplans waiting for remote servers
  * ----------------
  */
 typedef struct AppendState
@@ -1149,6 +1191,11 @@ typedef struct AppendState
 	PlanState **appendplans;	/* array of PlanStates for my inputs */
 	int			as_nplans;
 	int			as_whichplan;
+	bool		as_async;
+	bool		as_async_started;
+	bool	   *as_asyncplans;
+	bool	   *as_finished;
+	pgsocket   *as_waitsocks;
 } AppendState;
 
 /* ----------------
@@ -1314,6 +1361,7 @@ typedef struct
  *		RuntimeContext	   expr context for evaling runtime Skeys
  *		RelationDesc	   index relation descriptor
  *		ScanDesc		   index scan descriptor
+ *		PscanLen		   size of parallel index scan descriptor
  *
  *		ReorderQueue	   tuples that need reordering due to re-check
  *		ReachedEnd		   have we fetched all tuples from index already?
@@ -1339,6 +1387,7 @@ typedef struct IndexScanState
 	ExprContext *iss_RuntimeContext;
 	Relation	iss_RelationDesc;
 	IndexScanDesc iss_ScanDesc;
+	Size		iss_PscanLen;
 
 	/* These are needed for re-checking ORDER BY expr ordering */
 	pairingheap *iss_ReorderQueue;
@@ -1366,6 +1415,7 @@ typedef struct IndexScanState
  *		ScanDesc		   index scan descriptor
  *		VMBuffer		   buffer in use for visibility map testing, if any
  *		HeapFetches		   number of tuples we were forced to fetch from heap
+ *		PscanLen		   size of parallel index-only scan descriptor
  * ----------------
  */
 typedef struct IndexOnlyScanState
@@ -1384,6 +1434,7 @@ typedef struct IndexOnlyScanState
 	IndexScanDesc ioss_ScanDesc;
 	Buffer		ioss_VMBuffer;
 	long		ioss_HeapFetches;
+	Size		ioss_PscanLen;
 } IndexOnlyScanState;
 
 /* ----------------
@@ -1431,6 +1482,12 @@ typedef struct BitmapIndexScanState
  *		prefetch_pages	   # pages prefetch iterator is ahead of current
  *		prefetch_target    current target prefetch distance
  *		prefetch_maximum   maximum value for prefetch_target
+ *		initialized		   is the bitmap ready to be iterated over?
+ *		pscan_len		   size of the shared state for a parallel scan
+ *		pstate			   shared state for a parallel scan, or NULL
+ *		bitmap_seg		   DSM segment holding the shared bitmap, if attached
+ *		shared_tbmiterator iterator for a shared bitmap
+ *		shared_prefetch_iterator  prefetch iterator for a shared bitmap
  * ----------------
  */
 typedef struct BitmapHeapScanState
@@ -1446,6 +1503,13 @@ typedef struct BitmapHeapScanState
 	int			prefetch_pages;
 	int			prefetch_target;
 	int			prefetch_maximum;
+	bool		initialized;
+	Size		pscan_len;
+	/* use "struct" so we needn't expose these here */
+	struct ParallelBitmapHeapState *pstate;
+	struct dsm_segment *bitmap_seg;
+	TBMSharedIterator *shared_tbmiterator;
+	TBMSharedIterator *shared_prefetch_iterator;
 } BitmapHeapScanState;
 
 /* ----------------
@@ -1749,6 +1813,7 @@ typedef struct MergeJoinState
  *		hj_JoinState			current state of ExecHashJoin state machine
  *		hj_MatchedOuter			true if found a join match for current outer
  *		hj_OuterNotEmpty		true if outer relation known not empty
+ *		hj_ParallelState		shared build state, if parallel-aware
  * ----------------
  */
 
@@ -1776,6 +1841,7 @@ typedef struct HashJoinState
 	int			hj_JoinState;
 	bool		hj_MatchedOuter;
 	bool		hj_OuterNotEmpty;
+	struct ParallelHashJoinState *hj_ParallelState;
 } HashJoinState;
 
 
@@ -1845,6 +1911,8 @@ typedef struct AggStatePerAggData *AggStatePerAgg;
 typedef struct AggStatePerTransData *AggStatePerTrans;
 typedef struct AggStatePerGroupData *AggStatePerGroup;
 typedef struct AggStatePerPhaseData *AggStatePerPhase;
+typedef struct AggStatePerHashData *AggStatePerHash;
+typedef struct HashAggSpillData *HashAggSpill;
 
 typedef struct AggState
 {
@@ -1855,11 +1923,12 @@ typedef struct AggState
 	AggStatePerPhase phase;		/* pointer to current phase data */
 	int			numphases;		/* number of phases */
 	int			current_phase;	/* current phase number */
-	FmgrInfo   *hashfunctions;	/* per-grouping-field hash fns */
 	AggStatePerAgg peragg;		/* per-Aggref information */
 	AggStatePerTrans pertrans;	/* per-Trans state information */
+	ExprContext *hashcontext;	/* econtext for long-lived data (hashtable) */
 	ExprContext **aggcontexts;	/* econtexts for long-lived data (per GS) */
 	ExprContext *tmpcontext;	/* econtext for input expressions */
+	ExprContext *curaggcontext; /* currently active aggcontext */
 	AggStatePerTrans curpertrans;	/* currently active trans state */
 	bool		input_done;		/* indicates end of input */
 	bool		agg_done;		/* indicates completion of Agg scan */
@@ -1879,12 +1948,21 @@ typedef struct AggState
 	/* these fields are used in AGG_PLAIN and AGG_SORTED modes: */
 	AggStatePerGroup pergroup;	/* per-Aggref-per-group working state */
 	HeapTuple	grp_firstTuple; /* copy of first tuple of current group */
-	/* these fields are used in AGG_HASHED mode: */
-	TupleHashTable hashtable;	/* hash table with one entry per group */
-	TupleTableSlot *hashslot;	/* slot for loading hash table */
-	List	   *hash_needed;	/* list of columns needed in hash table */
+	/* these fields are used in AGG_HASHED and AGG_MIXED modes: */
 	bool		table_filled;	/* hash table filled yet? */
-	TupleHashIterator hashiter; /* for iterating through hash table */
+	int			num_hashes;		/* number of hash tables */
+	AggStatePerHash perhash;	/* array of per-hashtable data */
+	AggStatePerGroup *hash_pergroup;	/* array of per-group pointers */
+	/* spilling to disk is only done with a single hash table: */
+	long		hash_ngroups;	/* number of groups in hash table */
+	long		hash_ntuples;	/* # of input tuples aggregated into it */
+	bool		hash_spill_mode;	/* spilling tuples of new groups? */
+	int			hash_used_bits; /* hash bits used to partition current input */
+	HashAggSpill hash_spill;	/* partitions being written, if spilling */
+	List	   *hash_batches;	/* spilled batches yet to be processed */
+	TupleTableSlot *hash_spill_slot;	/* slot for reading spilled tuples */
+	int			hash_batches_used;	/* # of batches processed, for EXPLAIN */
+	Size		hash_disk_used; /* bytes written to spill files, for EXPLAIN */
 } AggState;
 
 /* ----------------
@@ -1989,6 +2067,35 @@ typedef struct GatherState
 	bool		need_to_scan_locally;
 } GatherState;
 
+/* ----------------
+ * GatherMergeState information
+ *
+ *		Gather Merge nodes launch 1 or more parallel workers, run a subplan
+ *		in those workers, and merge their presorted results.  The leader's
+ *		own stream, if it runs the subplan too, comes last in gm_slots.
+ *
+ *		nkeys			number of sort key columns
+ *		sortkeys		sort keys in SortSupport representation
+ *		slots			current tuple of each stream
+ *		heap			heap of streams with a current tuple
+ *		gm_initialized	true if we have fetched first tuple from each stream
+ * ----------------
+ */
+typedef struct GatherMergeState
+{
+	PlanState	ps;				/* its first field is NodeTag */
+	bool		initialized;
+	struct ParallelExecutorInfo *pei;
+	int			nreaders;
+	struct TupleQueueReader **reader;
+	bool		need_to_scan_locally;
+	int			gm_nkeys;
+	SortSupport gm_sortkeys;	/* array of length gm_nkeys */
+	TupleTableSlot **gm_slots;	/* array of length nreaders + 1 */
+	struct binaryheap *gm_heap; /* binary heap of slot indices */
+	bool		gm_initialized; /* are all streams started? */
+} GatherMergeState;
+
 /* ----------------
  *	 HashState information
  * ----------------
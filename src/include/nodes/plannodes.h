@@ -707,6 +707,12 @@ typedef struct Group
  * aggregation, we can work with presorted input or unsorted input;
  * the latter strategy uses an internal hashtable.
  *
+ * With grouping sets, some of the sets may be computed by sorting and
+ * others by hashing, in a single node: see the comments in nodeAgg.c.  In
+ * that case the top node is AGG_MIXED, and its chain contains an AGG_HASHED
+ * node for each additional hashed grouping set, along with the AGG_SORTED
+ * (or AGG_PLAIN) nodes for the sorted rollups.
+ *
  * Notice the lack of any direct info about the aggregate functions to be
  * computed.  They are found by scanning the node's tlist and quals during
  * executor startup.  (It is possible that there are no aggregate functions;
@@ -718,7 +724,8 @@ typedef enum AggStrategy
 {
 	AGG_PLAIN,					/* simple agg across all input rows */
 	AGG_SORTED,					/* grouped agg, input must be sorted */
-	AGG_HASHED					/* grouped agg, use internal hashtable */
+	AGG_HASHED,					/* grouped agg, use internal hashtable */
+	AGG_MIXED					/* grouped agg, hash and sort both used */
 } AggStrategy;
 
 typedef struct Agg
@@ -778,6 +785,25 @@ typedef struct Gather
 	bool		invisible;		/* suppress EXPLAIN display (for testing)? */
 } Gather;
 
+/* ------------
+ *		gather merge node
+ *
+ * Like Gather, but merges the presorted outputs of the participants so
+ * that the result is sorted too.
+ * ------------
+ */
+typedef struct GatherMerge
+{
+	Plan		plan;
+	int			num_workers;
+	/* remaining fields are just like the sort-key info in struct Sort */
+	int			numCols;		/* number of sort-key columns */
+	AttrNumber *sortColIdx;		/* their indexes in the target list */
+	Oid		   *sortOperators;	/* OIDs of operators to sort them by */
+	Oid		   *collations;		/* OIDs of collations */
+	bool	   *nullsFirst;		/* NULLS FIRST/LAST directions */
+} GatherMerge;
+
 /* ----------------
  *		hash build node
  *
@@ -577,6 +577,7 @@ typedef struct IndexOptInfo
 	bool		amsearchnulls;	/* can AM search for NULL/NOT NULL entries? */
 	bool		amhasgettuple;	/* does AM have amgettuple interface? */
 	bool		amhasgetbitmap; /* does AM have amgetbitmap interface? */
+	bool		amcanparallel;	/* does AM support parallel scan? */
 	/* Rather than include amapi.h here, we declare amcostestimate like this */
 	void		(*amcostestimate) ();	/* AM's cost estimator */
 } IndexOptInfo;
@@ -1072,6 +1073,17 @@ typedef struct GatherPath
 	bool		single_copy;	/* path must not be executed >1x */
 } GatherPath;
 
+/*
+ * GatherMergePath runs several copies of a plan in parallel and merges
+ * their results, which must all be sorted by the path's pathkeys.  If the
+ * subpath isn't sorted that way already, each copy sorts its own output.
+ */
+typedef struct GatherMergePath
+{
+	Path		path;
+	Path	   *subpath;		/* path for each worker */
+} GatherMergePath;
+
 /*
  * All join-type paths share these fields.
  */
@@ -1735,6 +1747,7 @@ typedef struct JoinCostWorkspace
 	/* private for cost_hashjoin code */
 	int			numbuckets;
 	int			numbatches;
+	double		inner_rows_total;	/* # tuples in the hash table */
 } JoinCostWorkspace;
 
 #endif   /* RELATION_H */
@@ -34,6 +34,10 @@ typedef struct TIDBitmap TIDBitmap;
 /* Likewise, TBMIterator is private */
 typedef struct TBMIterator TBMIterator;
 
+/* ... and so are the shared-iteration state and its backend-local handle */
+typedef struct TBMSharedIteratorState TBMSharedIteratorState;
+typedef struct TBMSharedIterator TBMSharedIterator;
+
 /* Result structure for tbm_iterate */
 typedef struct
 {
@@ -63,4 +67,13 @@ extern TBMIterator *tbm_begin_iterate(TIDBitmap *tbm);
 extern TBMIterateResult *tbm_iterate(TBMIterator *iterator);
 extern void tbm_end_iterate(TBMIterator *iterator);
 
+extern Size tbm_shared_size(const TIDBitmap *tbm);
+extern void tbm_share(TIDBitmap *tbm, void *dest);
+extern Size tbm_shared_iterator_size(void);
+extern void tbm_init_shared_iterator(TBMSharedIteratorState *istate);
+extern TBMSharedIterator *tbm_attach_shared_iterate(void *bitmap,
+						  TBMSharedIteratorState *istate);
+extern TBMIterateResult *tbm_shared_iterate(TBMSharedIterator *iterator);
+extern void tbm_end_shared_iterate(TBMSharedIterator *iterator);
+
 #endif   /* TIDBITMAP_H */
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * hashutils.h
+ *	  Utilities for working with hash values.
+ *
+ * Portions Copyright (c) 2016, PostgreSQL Global Development Group
+ *
+ * src/include/utils/hashutils.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef HASHUTILS_H
+#define HASHUTILS_H
+
+/*
+ * Simple inline murmur hash implementation hashing a 32 bit integer, for
+ * performance.  Also useful as a finalizer, to spread a hash value that
+ * was combined from several weaker ones over all 32 bits before it is
+ * used to index a linear-probing hash table.
+ */
+static inline uint32
+murmurhash32(uint32 data)
+{
+	uint32		h = data;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+#endif   /* HASHUTILS_H */
@@ -88,6 +88,8 @@ extern bool HeapTupleIsSurelyDead(HeapTuple htup,
 
 extern void HeapTupleSetHintBits(HeapTupleHeader tuple, Buffer buffer,
 					 uint16 infomask, TransactionId xid);
+extern void HeapPagePrefetchVisibility(Buffer buffer, Snapshot snapshot);
+extern void HeapPageResetVisibility(void);
 extern bool HeapTupleHeaderIsOnlyLocked(HeapTupleHeader tuple);
 
 /*
@@ -23,6 +23,7 @@
 #include "access/itup.h"
 #include "executor/tuptable.h"
 #include "fmgr.h"
+#include "storage/shm_mq.h"
 #include "utils/relcache.h"
 
 
@@ -56,6 +57,10 @@ typedef struct Tuplesortstate Tuplesortstate;
  *
  * The "index_hash" API is similar to index_btree, but the tuples are
  * actually sorted by their hash codes not the raw data.
+ *
+ * An index_btree sort can instead be fed with streams of tuples presorted
+ * by parallel workers, using tuplesort_attach_streams; the sort then just
+ * merges them.
  */
 
 extern Tuplesortstate *tuplesort_begin_heap(TupleDesc tupDesc,
@@ -90,6 +95,10 @@ extern void tuplesort_putindextuplevalues(Tuplesortstate *state,
 extern void tuplesort_putdatum(Tuplesortstate *state, Datum val,
 				   bool isNull);
 
+extern void tuplesort_attach_streams(Tuplesortstate *state, int nstreams,
+						 shm_mq_handle **streams,
+						 Tuplesortstate *localsort);
+
 extern void tuplesort_performsort(Tuplesortstate *state);
 
 extern bool tuplesort_gettupleslot(Tuplesortstate *state, bool forward,
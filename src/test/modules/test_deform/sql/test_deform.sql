@@ -0,0 +1,40 @@
+CREATE EXTENSION test_deform;
+
+--
+-- Check that attributes extracted through a slot agree with heap_getattr and
+-- heap_deform_tuple, for the various shapes the deforming code specializes.
+--
+
+-- only fixed-width columns; nulls in both the first and second bitmap byte
+CREATE TABLE deform_fixed (
+	c1 int4, c2 int8, c3 int2, c4 float8, c5 bool, c6 int4,
+	c7 int8, c8 int2, c9 float4, c10 int4, c11 int8, c12 int2);
+INSERT INTO deform_fixed
+	SELECT g, g, g % 100, g, g % 2 = 0, g, g, g % 7, g, g, g, g % 5
+	FROM generate_series(1, 100) g;
+INSERT INTO deform_fixed
+	SELECT g, g, g % 100, g, g % 2 = 0, g, g, g % 7, g,
+		   CASE WHEN g % 2 = 0 THEN NULL ELSE g END, g,
+		   CASE WHEN g % 3 = 0 THEN NULL ELSE g % 5 END
+	FROM generate_series(1, 100) g;
+INSERT INTO deform_fixed (c1, c4, c12)
+	SELECT g, g, g FROM generate_series(1, 100) g;
+SELECT test_deform('deform_fixed', 2, true);
+
+-- fixed-width prefix followed by variable-width columns
+CREATE TABLE deform_mixed (
+	a int4, b int8, c text, d int4, e numeric, f int2, g text);
+INSERT INTO deform_mixed
+	SELECT g, g, repeat('x', g % 200), g, g * 1.5, g % 100,
+		   CASE WHEN g % 4 = 0 THEN NULL ELSE 'v' || g END
+	FROM generate_series(1, 200) g;
+INSERT INTO deform_mixed (a, c, f)
+	SELECT g, 'y', g FROM generate_series(1, 100) g;
+SELECT test_deform('deform_mixed', 1, true);
+
+-- tuples with fewer attributes than the descriptor
+ALTER TABLE deform_mixed ADD COLUMN h int4;
+INSERT INTO deform_mixed (a, h) VALUES (1, 1);
+SELECT test_deform('deform_mixed', 1, true);
+
+DROP TABLE deform_fixed, deform_mixed;
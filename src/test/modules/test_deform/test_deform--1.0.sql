@@ -0,0 +1,10 @@
+/* src/test/modules/test_deform/test_deform--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION test_deform" to load this file. \quit
+
+CREATE FUNCTION test_deform(rel pg_catalog.regclass,
+					   loops pg_catalog.int4 default 1,
+					   verify pg_catalog.bool default false)
+    RETURNS pg_catalog.int8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
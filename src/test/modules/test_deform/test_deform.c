@@ -0,0 +1,151 @@
+/*--------------------------------------------------------------------------
+ *
+ * test_deform.c
+ *		Test code and microbenchmark for tuple deforming.
+ *
+ * test_deform() scans a table and extracts all attributes of every tuple
+ * through a tuple table slot, the way scan nodes do, a given number of
+ * times.  Timing it (e.g. with psql's \timing) on a suitably shaped table
+ * measures deforming throughput with little else in the way; optionally, it
+ * cross-checks the slot's values against heap_getattr and heap_deform_tuple.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *		src/test/modules/test_deform/test_deform.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/pg_class.h"
+#include "executor/tuptable.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/datum.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(test_deform);
+
+static void verify_deform(HeapTuple tuple, TupleDesc tupdesc,
+			  TupleTableSlot *slot, Datum *values, bool *isnull);
+
+/*
+ * test_deform(rel regclass, loops int4, verify bool) returns int8
+ *
+ * Returns the total number of attributes extracted.
+ */
+Datum
+test_deform(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		loops = PG_GETARG_INT32(1);
+	bool		verify = PG_GETARG_BOOL(2);
+	Relation	rel;
+	TupleDesc	tupdesc;
+	TupleTableSlot *slot;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	Datum	   *values;
+	bool	   *isnull;
+	AclResult	aclresult;
+	int64		nattrs = 0;
+
+	if (loops < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("loop count must be positive")));
+
+	rel = heap_open(relid, AccessShareLock);
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION &&
+		rel->rd_rel->relkind != RELKIND_MATVIEW)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table or materialized view",
+						RelationGetRelationName(rel))));
+
+	aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, ACL_KIND_CLASS,
+					   RelationGetRelationName(rel));
+
+	tupdesc = RelationGetDescr(rel);
+	slot = MakeSingleTupleTableSlot(tupdesc);
+	values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+	isnull = (bool *) palloc(tupdesc->natts * sizeof(bool));
+
+	scan = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		int			i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		for (i = 0; i < loops; i++)
+		{
+			/* storing the tuple afresh forgets the extracted attributes */
+			ExecStoreTuple(tuple, slot, InvalidBuffer, false);
+			slot_getallattrs(slot);
+			nattrs += tupdesc->natts;
+		}
+
+		if (verify)
+			verify_deform(tuple, tupdesc, slot, values, isnull);
+	}
+	heap_endscan(scan);
+
+	ExecDropSingleTupleTableSlot(slot);
+	heap_close(rel, AccessShareLock);
+
+	PG_RETURN_INT64(nattrs);
+}
+
+/*
+ * Check that the slot's values agree with heap_getattr and heap_deform_tuple.
+ */
+static void
+verify_deform(HeapTuple tuple, TupleDesc tupdesc, TupleTableSlot *slot,
+			  Datum *values, bool *isnull)
+{
+	int			attnum;
+
+	heap_deform_tuple(tuple, tupdesc, values, isnull);
+
+	for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+	{
+		Form_pg_attribute att = tupdesc->attrs[attnum - 1];
+		Datum		getattr_value;
+		bool		getattr_isnull;
+		Datum		slot_value = slot->tts_values[attnum - 1];
+		bool		slot_isnull = slot->tts_isnull[attnum - 1];
+
+		getattr_value = heap_getattr(tuple, attnum, tupdesc, &getattr_isnull);
+
+		if (slot_isnull != getattr_isnull ||
+			slot_isnull != isnull[attnum - 1])
+			elog(ERROR, "attribute %d of tuple (%u,%u) has inconsistent null flags",
+				 attnum,
+				 ItemPointerGetBlockNumber(&tuple->t_self),
+				 ItemPointerGetOffsetNumber(&tuple->t_self));
+
+		if (slot_isnull)
+			continue;
+
+		if (!datumIsEqual(slot_value, getattr_value,
+						  att->attbyval, att->attlen) ||
+			!datumIsEqual(slot_value, values[attnum - 1],
+						  att->attbyval, att->attlen))
+			elog(ERROR, "attribute %d of tuple (%u,%u) has inconsistent values",
+				 attnum,
+				 ItemPointerGetBlockNumber(&tuple->t_self),
+				 ItemPointerGetOffsetNumber(&tuple->t_self));
+	}
+}
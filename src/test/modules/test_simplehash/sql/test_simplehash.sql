@@ -0,0 +1,36 @@
+CREATE EXTENSION test_simplehash;
+
+--
+-- Check that tuple hash tables find every group, including ones that only
+-- differ in their nulls, and survive being copied in iteration order into
+-- another table.
+--
+CREATE TABLE hash_ints (a int4, b int8);
+INSERT INTO hash_ints
+	SELECT g % 5000, g % 7 FROM generate_series(1, 20000) g;
+INSERT INTO hash_ints VALUES (NULL, 1), (1, NULL), (NULL, NULL), (NULL, NULL);
+SELECT test_tuplehash('hash_ints', 2, true);
+SELECT count(*) FROM (SELECT DISTINCT a, b FROM hash_ints) s;
+
+-- sequential keys, the usual bad case for a weak hash in linear probing
+CREATE TABLE hash_seq (a int4);
+INSERT INTO hash_seq SELECT g FROM generate_series(1, 50000) g;
+SELECT test_tuplehash('hash_seq', 1, true);
+
+CREATE TABLE hash_text (t text, n numeric);
+INSERT INTO hash_text
+	SELECT 'key' || (g % 1000), g % 3 FROM generate_series(1, 5000) g;
+SELECT test_tuplehash('hash_text', 1, true);
+
+-- a column without hash support is rejected
+CREATE TABLE hash_point (p point);
+SELECT test_tuplehash('hash_point');
+
+--
+-- TID bitmaps: exact pages only, then a limit that forces lossy pages.
+--
+SELECT test_tidbitmap(0);
+SELECT test_tidbitmap(10000, 2);
+SELECT test_tidbitmap(200000, 1, 64) > 0 AS has_lossy;
+
+DROP TABLE hash_ints, hash_seq, hash_text, hash_point;
@@ -0,0 +1,16 @@
+/* src/test/modules/test_simplehash/test_simplehash--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION test_simplehash" to load this file. \quit
+
+CREATE FUNCTION test_tuplehash(rel pg_catalog.regclass,
+					   loops pg_catalog.int4 default 1,
+					   verify pg_catalog.bool default false)
+    RETURNS pg_catalog.int8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
+
+CREATE FUNCTION test_tidbitmap(npages pg_catalog.int4,
+					   loops pg_catalog.int4 default 1,
+					   maxkb pg_catalog.int4 default 4096)
+    RETURNS pg_catalog.int8 STRICT
+	AS 'MODULE_PATHNAME' LANGUAGE C;
@@ -0,0 +1,341 @@
+/*--------------------------------------------------------------------------
+ *
+ * test_simplehash.c
+ *		Test code and microbenchmarks for the simplehash-based hash tables.
+ *
+ * test_tuplehash() fills a TupleHashTable, the table behind hash
+ * aggregation, SetOp, RecursiveUnion and hashed SubPlans, from the rows of a
+ * given table; test_tidbitmap() fills and iterates a TIDBitmap, as a bitmap
+ * heap scan does.  Timing them (e.g. with psql's \timing) measures the hash
+ * tables with little else in the way; both also check their results.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *		src/test/modules/test_simplehash/test_simplehash.c
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/pg_class.h"
+#include "executor/executor.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "nodes/tidbitmap.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/typcache.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(test_tuplehash);
+PG_FUNCTION_INFO_V1(test_tidbitmap);
+
+static int64 fill_tuplehash(TupleHashTable hashtable, Relation rel,
+			   TupleTableSlot *slot);
+static void verify_tuplehash(TupleHashTable hashtable, int64 ngroups,
+				 Relation rel, TupleTableSlot *slot,
+				 int numCols, AttrNumber *keyColIdx,
+				 FmgrInfo *eqfunctions, FmgrInfo *hashfunctions,
+				 MemoryContext tempcxt);
+
+/*
+ * test_tuplehash(rel regclass, loops int4, verify bool) returns int8
+ *
+ * Builds a hash table keyed on all columns of the given table and inserts
+ * all of its rows, "loops" times over.  Returns the number of distinct rows.
+ *
+ * If "verify" is true, also checks that every row can be found again, and
+ * that copying the table's contents in iteration order into a second table,
+ * as happens when one hashing node feeds another, yields the same groups.
+ */
+Datum
+test_tuplehash(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		loops = PG_GETARG_INT32(1);
+	bool		verify = PG_GETARG_BOOL(2);
+	Relation	rel;
+	TupleDesc	tupdesc;
+	TupleTableSlot *slot;
+	AttrNumber *keyColIdx;
+	Oid		   *eqOperators;
+	FmgrInfo   *eqfunctions;
+	FmgrInfo   *hashfunctions;
+	MemoryContext tablecxt;
+	MemoryContext tempcxt;
+	AclResult	aclresult;
+	int64		ngroups = 0;
+	int			i;
+
+	if (loops < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("loop count must be positive")));
+
+	rel = heap_open(relid, AccessShareLock);
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION &&
+		rel->rd_rel->relkind != RELKIND_MATVIEW)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table or materialized view",
+						RelationGetRelationName(rel))));
+
+	aclresult = pg_class_aclcheck(relid, GetUserId(), ACL_SELECT);
+	if (aclresult != ACLCHECK_OK)
+		aclcheck_error(aclresult, ACL_KIND_CLASS,
+					   RelationGetRelationName(rel));
+
+	tupdesc = RelationGetDescr(rel);
+	if (tupdesc->natts < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"%s\" has no columns",
+						RelationGetRelationName(rel))));
+
+	/* Key on every column, using each type's default hash equality */
+	keyColIdx = (AttrNumber *) palloc(tupdesc->natts * sizeof(AttrNumber));
+	eqOperators = (Oid *) palloc(tupdesc->natts * sizeof(Oid));
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Oid			typid = tupdesc->attrs[i]->atttypid;
+		TypeCacheEntry *typentry;
+
+		typentry = lookup_type_cache(typid, TYPECACHE_EQ_OPR);
+		if (!OidIsValid(typentry->eq_opr) ||
+			!op_hashjoinable(typentry->eq_opr, typid))
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_FUNCTION),
+					 errmsg("could not identify a hashable equality operator for type %s",
+							format_type_be(typid))));
+		keyColIdx[i] = i + 1;
+		eqOperators[i] = typentry->eq_opr;
+	}
+	execTuplesHashPrepare(tupdesc->natts, eqOperators,
+						  &eqfunctions, &hashfunctions);
+
+	slot = MakeSingleTupleTableSlot(tupdesc);
+	tablecxt = AllocSetContextCreate(CurrentMemoryContext,
+									 "test_tuplehash table",
+									 ALLOCSET_DEFAULT_MINSIZE,
+									 ALLOCSET_DEFAULT_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE);
+	tempcxt = AllocSetContextCreate(CurrentMemoryContext,
+									"test_tuplehash temp",
+									ALLOCSET_SMALL_MINSIZE,
+									ALLOCSET_SMALL_INITSIZE,
+									ALLOCSET_SMALL_MAXSIZE);
+
+	for (i = 0; i < loops; i++)
+	{
+		TupleHashTable hashtable;
+
+		/* start small, so that growing the table is part of the work */
+		hashtable = BuildTupleHashTable(tupdesc->natts, keyColIdx,
+										eqfunctions, hashfunctions,
+										256, sizeof(TupleHashEntryData),
+										tablecxt, tempcxt, 1);
+		ngroups = fill_tuplehash(hashtable, rel, slot);
+
+		if (verify)
+			verify_tuplehash(hashtable, ngroups, rel, slot,
+							 tupdesc->natts, keyColIdx,
+							 eqfunctions, hashfunctions, tempcxt);
+
+		MemoryContextReset(tablecxt);
+	}
+
+	MemoryContextDelete(tempcxt);
+	MemoryContextDelete(tablecxt);
+	ExecDropSingleTupleTableSlot(slot);
+	heap_close(rel, AccessShareLock);
+
+	PG_RETURN_INT64(ngroups);
+}
+
+/*
+ * Insert every visible row of rel; returns the number of new entries.
+ */
+static int64
+fill_tuplehash(TupleHashTable hashtable, Relation rel, TupleTableSlot *slot)
+{
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	int64		ngroups = 0;
+
+	scan = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		bool		isnew;
+
+		CHECK_FOR_INTERRUPTS();
+
+		ExecStoreTuple(tuple, slot, InvalidBuffer, false);
+		LookupTupleHashEntry(hashtable, slot, &isnew);
+		if (isnew)
+			ngroups++;
+	}
+	heap_endscan(scan);
+
+	return ngroups;
+}
+
+/*
+ * Check the contents of a table filled by fill_tuplehash.
+ */
+static void
+verify_tuplehash(TupleHashTable hashtable, int64 ngroups,
+				 Relation rel, TupleTableSlot *slot,
+				 int numCols, AttrNumber *keyColIdx,
+				 FmgrInfo *eqfunctions, FmgrInfo *hashfunctions,
+				 MemoryContext tempcxt)
+{
+	TupleHashTable copytable;
+	TupleHashIterator iter;
+	TupleHashEntry entry;
+	TupleTableSlot *copyslot;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+	int64		nentries = 0;
+
+	/* every row must be found again */
+	scan = heap_beginscan(rel, GetActiveSnapshot(), 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		ExecStoreTuple(tuple, slot, InvalidBuffer, false);
+		if (FindTupleHashEntry(hashtable, slot,
+							   eqfunctions, hashfunctions) == NULL)
+			elog(ERROR, "tuple (%u,%u) not found in hash table",
+				 ItemPointerGetBlockNumber(&tuple->t_self),
+				 ItemPointerGetOffsetNumber(&tuple->t_self));
+	}
+	heap_endscan(scan);
+
+	/*
+	 * Copy the entries, in iteration order, into a second table with a
+	 * different IV.  Every entry must be new there, and there must be exactly
+	 * as many as were counted while filling.
+	 */
+	copytable = BuildTupleHashTable(numCols, keyColIdx,
+									eqfunctions, hashfunctions,
+									256, sizeof(TupleHashEntryData),
+									hashtable->tablecxt, tempcxt, 2);
+	copyslot = MakeSingleTupleTableSlot(RelationGetDescr(rel));
+
+	InitTupleHashIterator(hashtable, &iter);
+	while ((entry = ScanTupleHashTable(hashtable, &iter)) != NULL)
+	{
+		bool		isnew;
+
+		CHECK_FOR_INTERRUPTS();
+
+		ExecStoreMinimalTuple(entry->firstTuple, copyslot, false);
+		LookupTupleHashEntry(copytable, copyslot, &isnew);
+		if (!isnew)
+			elog(ERROR, "hash table iteration returned a group twice");
+		nentries++;
+	}
+	TermTupleHashIterator(&iter);
+
+	if (nentries != ngroups)
+		elog(ERROR, "hash table iteration returned " INT64_FORMAT " groups, expected " INT64_FORMAT,
+			 nentries, ngroups);
+
+	ExecDropSingleTupleTableSlot(copyslot);
+}
+
+/*
+ * test_tidbitmap(npages int4, loops int4, maxkb int4) returns int8
+ *
+ * Adds ten tuples on each of "npages" pages, visited in scrambled order and
+ * spread over the whole block number range, to a TIDBitmap limited to
+ * "maxkb" kilobytes, then iterates over it; "loops" times over.  Returns the
+ * number of pages that came back lossy in the last round, after checking
+ * that all pages came back exactly once and in order.
+ */
+Datum
+test_tidbitmap(PG_FUNCTION_ARGS)
+{
+	int32		npages = PG_GETARG_INT32(0);
+	int32		loops = PG_GETARG_INT32(1);
+	int32		maxkb = PG_GETARG_INT32(2);
+	ItemPointerData tids[10];
+	int64		nlossy = 0;
+	int			i;
+
+	if (npages < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("page count must not be negative")));
+	if (loops < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("loop count must be positive")));
+	if (maxkb < 64)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("bitmap size limit must be at least 64 kB")));
+
+	for (i = 0; i < loops; i++)
+	{
+		TIDBitmap  *tbm;
+		TBMIterator *iterator;
+		TBMIterateResult *tbmres;
+		BlockNumber prevblock = InvalidBlockNumber;
+		int64		nreturned = 0;
+		int32		p;
+
+		tbm = tbm_create((long) maxkb * 1024L);
+
+		for (p = 0; p < npages; p++)
+		{
+			/* multiplying by an odd constant permutes the 31-bit range */
+			BlockNumber blockno = ((uint32) p * 2654435761U) & 0x7FFFFFFF;
+			int			t;
+
+			CHECK_FOR_INTERRUPTS();
+
+			for (t = 0; t < lengthof(tids); t++)
+				ItemPointerSet(&tids[t], blockno, t * 2 + 1);
+			tbm_add_tuples(tbm, tids, lengthof(tids), false);
+		}
+
+		nlossy = 0;
+		iterator = tbm_begin_iterate(tbm);
+		while ((tbmres = tbm_iterate(iterator)) != NULL)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			if (prevblock != InvalidBlockNumber && tbmres->blockno <= prevblock)
+				elog(ERROR, "bitmap returned block %u after block %u",
+					 tbmres->blockno, prevblock);
+			prevblock = tbmres->blockno;
+
+			if (tbmres->ntuples < 0)
+				nlossy++;
+			else if (tbmres->ntuples != lengthof(tids))
+				elog(ERROR, "bitmap returned %d tuples for block %u, expected %d",
+					 tbmres->ntuples, tbmres->blockno, (int) lengthof(tids));
+			nreturned++;
+		}
+		tbm_end_iterate(iterator);
+		tbm_free(tbm);
+
+		if (nreturned != npages)
+			elog(ERROR, "bitmap returned " INT64_FORMAT " pages, expected %d",
+				 nreturned, npages);
+	}
+
+	PG_RETURN_INT64(nlossy);
+}
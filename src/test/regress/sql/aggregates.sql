@@ -755,3 +755,13 @@ create aggregate my_half_sum(int4)
 select my_sum(one),my_half_sum(one) from (values(1),(2),(3),(4)) t(one);
 
 rollback;
+
+-- Hash aggregation that overflows work_mem must spill to disk and still
+-- produce every group exactly once
+begin;
+set local work_mem = '64kB';
+set local enable_sort = off;
+select count(*) as ngroups, sum(c) as ntuples, sum(m) as summax from
+  (select g % 10000 as k, count(*) as c, max(g) as m
+   from generate_series(1, 40000) g group by g % 10000) s;
+rollback;
@@ -0,0 +1,130 @@
+--
+-- EXPRESSIONS
+-- Test expression evaluation, both the compiled step programs and the
+-- nodes that are still evaluated recursively
+--
+
+create temp table expr_tbl (
+  id int,
+  a bool,
+  b bool,
+  x int,
+  y int,
+  v varchar(10)
+);
+
+insert into expr_tbl values
+  (1, true,  true,  1,    10,   'one'),
+  (2, true,  false, 0,    20,   'two'),
+  (3, true,  null,  null, 30,   null),
+  (4, false, true,  2,    null, 'four'),
+  (5, false, false, null, null, ''),
+  (6, false, null,  5,    0,    'six'),
+  (7, null,  true,  0,    null, null),
+  (8, null,  false, 7,    7,    'eight'),
+  (9, null,  null,  null, 3,    'nine');
+
+--
+-- AND, OR and NOT, with NULLs in every position
+--
+select id, a, b, a and b as "and", a or b as "or", not a as "not",
+       a and b and a as and3, a or b or a as or3,
+       not (a and not b) as nested
+  from expr_tbl order by id;
+
+-- the result of AND/OR used as input to other steps
+select id, (a and b) is null as and_null, (a or b) is not null as or_notnull,
+       coalesce(a and b, true) as coalesced
+  from expr_tbl order by id;
+
+-- AND and OR stop at the first argument that decides the result, so the
+-- later arguments mustn't be evaluated at all
+select id, x, x <> 0 and 100 / x > 10 as and_guard,
+       x = 0 or 100 / x > 10 as or_guard
+  from expr_tbl order by id;
+select id from expr_tbl where not (x = 0 or 100 / x < 50) order by id;
+
+-- but a NULL doesn't decide the result
+select id, x, x is null or x <> 0 and 100 / x > 10 as guard
+  from expr_tbl where x <> 0 or x is null order by id;
+select id, null::bool and 100 / x > 0 from expr_tbl where x = 0;
+
+--
+-- Strict and non-strict function calls with NULL arguments
+--
+create function expr_nonstrict(int, int) returns int
+  language plpgsql called on null input
+  as $$ begin return coalesce($1, -1) * 100 + coalesce($2, -1); end $$;
+
+select id, x, y, abs(x) as strict1, x + y as strict2,
+       substr(v, x, y) as strict3, expr_nonstrict(x, y) as nonstrict,
+       expr_nonstrict(x, 42) as nonstrict_const,
+       abs(x + y) as nested, x + abs(y) - 1 as mixed
+  from expr_tbl order by id;
+
+-- constant arguments, including NULL ones
+select id, x + null as plusnull, x * 2 + 1 as consts,
+       expr_nonstrict(null, x) as nonstrict_null
+  from expr_tbl order by id;
+
+-- calls counted by track_functions
+begin;
+set local track_functions = 'all';
+select id, expr_nonstrict(x, null) from expr_tbl where id < 4 order by id;
+select calls from pg_stat_xact_user_functions
+  where funcname = 'expr_nonstrict';
+commit;
+
+--
+-- NullTest and RelabelType, alone and nested
+--
+select id, v, v::text is null as relabel_isnull,
+       v::text is not null as relabel_notnull,
+       (v::text is null) is not null as nested,
+       not (v::text is not null) as negated,
+       length(v::text) as relabeled_arg,
+       (v::text)::varchar(10) = 'six'::text as relabel_twice
+  from expr_tbl order by id;
+
+select id from expr_tbl where v is not null and x is not null and y is null;
+
+--
+-- Nodes evaluated by the recursive code, inside and around compiled steps
+--
+select id,
+       case when x > 1 then x else -x end as casexpr,
+       coalesce(x, y, 0) + 1 as coalesceexpr,
+       a and (case when x is null then null else x > 0 end) as and_case,
+       x in (0, 1, null) as inlist,
+       nullif(x, 0) is null as nullifexpr,
+       (x, y) is null as rownull,
+       (x, y) is not null as rownotnull,
+       greatest(x, y) as greatestexpr,
+       abs(coalesce(x, -5)) as func_over_legacy,
+       case when a then x + y end is null as null_over_legacy
+  from expr_tbl order by id;
+
+-- a short-circuited argument that would have been evaluated recursively
+select id, x, x <> 0 and case when 100 / x > 10 then true end as guard
+  from expr_tbl order by id;
+
+-- subplans
+select id, x, x = any (select y from expr_tbl) as anysub,
+       (select count(*) from expr_tbl t2 where t2.y = t1.x or t1.x is null)
+         as correlated
+  from expr_tbl t1 order by id;
+
+--
+-- Vars from both sides of a join, in join quals and the target list
+--
+set enable_hashjoin = off;
+set enable_mergejoin = off;
+select t1.id, t2.id, t1.x + t2.y as sum,
+       t1.a or t2.b as either
+  from expr_tbl t1 join expr_tbl t2
+    on t1.x + 1 = t2.y / 10 and (t1.a or t2.a is null)
+  order by 1, 2;
+reset enable_hashjoin;
+reset enable_mergejoin;
+
+drop function expr_nonstrict(int, int);
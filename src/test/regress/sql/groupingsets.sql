@@ -42,6 +42,7 @@ create function gstest_data(v integer, out a integer, out b integer)
   $f$ language plpgsql;
 
 -- basic functionality
+set enable_hashagg = false;  -- test hashing explicitly later
 
 -- simple rollup with multiple plain aggregates, with and without ordering
 -- (and with ordering differing from grouping)
@@ -224,4 +225,27 @@ select array(select row(v.a,s1.*) from (select two,four, count(*) from onek grou
 select sum(ten) from onek group by two, rollup(four::text) order by 1;
 select sum(ten) from onek group by rollup(four::text), two order by 1;
 
+-- hashed grouping sets, alone and mixed with sorted rollups
+set enable_hashagg = true;
+
+select a, b, grouping(a,b), sum(v), count(*)
+  from gstest1 group by grouping sets ((a),(b)) order by 3,1,2;
+
+select a, b, grouping(a,b), sum(v), count(*)
+  from gstest1 group by grouping sets ((a,b),(a),(b),()) order by 3,1,2;
+
+select a, b, sum(v)
+  from gstest1 group by grouping sets ((a),(b)) having count(*) > 1
+  order by 1,2;
+
+select a, b, c, count(*)
+  from gstest2 group by grouping sets ((a,b),(c)) order by 1,2,3;
+
+-- rescan of hashed grouping sets
+select v.x, s.*
+  from (values (1),(2)) v(x)
+  left join lateral (select a, b, count(*) from gstest1 where a = v.x
+                     group by grouping sets ((a),(b))) s on true
+  order by 1,2,3;
+
 -- end
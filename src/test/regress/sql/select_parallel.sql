@@ -0,0 +1,153 @@
+--
+-- PARALLEL
+--
+
+-- a table big enough to get parallel plans
+create table para_t as
+  select g as a, g % 1000 as b, repeat('x', 60) as c
+  from generate_series(1, 150000) g;
+create index para_t_a on para_t (a);
+create index para_t_b on para_t (b);
+vacuum analyze para_t;
+
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set max_parallel_degree = 4;
+
+--
+-- parallel index scans and index-only scans
+--
+set enable_seqscan = off;
+set enable_bitmapscan = off;
+explain (costs off)
+  select count(*), sum(b) from para_t where a < 120000;
+select count(*), sum(b) from para_t where a < 120000;
+explain (costs off)
+  select count(*), sum(a) from para_t where a > 30000;
+select count(*), sum(a) from para_t where a > 30000;
+-- scans that find nothing or stop after a few leaf pages
+select count(*) from para_t where a > 200000;
+select count(*) from para_t where a between 70000 and 70100 and b = 50;
+reset enable_seqscan;
+reset enable_bitmapscan;
+
+--
+-- parallel bitmap heap scans
+--
+set enable_seqscan = off;
+set enable_indexscan = off;
+explain (costs off)
+  select count(*), sum(a) from para_t where b < 600;
+select count(*), sum(a) from para_t where b < 600;
+explain (costs off)
+  select count(*), sum(a) from para_t where b < 100 or b > 899;
+select count(*), sum(a) from para_t where b < 100 or b > 899;
+-- with a lossy bitmap, tuples have to be rechecked
+set work_mem = 64;
+explain (costs off)
+  select count(*), sum(a) from para_t where b < 600;
+select count(*), sum(a) from para_t where b < 600;
+reset work_mem;
+reset enable_seqscan;
+reset enable_indexscan;
+
+--
+-- gather merge
+--
+-- over a partial path that is already sorted
+set enable_seqscan = off;
+set enable_bitmapscan = off;
+explain (costs off)
+  select a, b from para_t where a > 10000 and b % 7 = 0 order by a;
+select count(*), sum(a) from
+  (select a, lag(a) over () as pa
+   from (select a from para_t where a > 10000 and b % 7 = 0 order by a) s) t
+  where pa >= a;
+-- stopping before the workers are done
+select a, b from para_t where a > 10000 and b % 7 = 0 order by a limit 5;
+reset enable_seqscan;
+reset enable_bitmapscan;
+-- with each worker sorting its share of the rows
+explain (costs off)
+  select b, a from para_t order by b, a;
+explain (costs off)
+select count(*) from
+  (select b, a, lag(b) over () as pb, lag(a) over () as pa
+   from (select b, a from para_t order by b, a) s) t
+  where (pb, pa) > (b, a);
+select count(*) from
+  (select b, a, lag(b) over () as pb, lag(a) over () as pa
+   from (select b, a from para_t order by b, a) s) t
+  where (pb, pa) > (b, a);
+select b, a from para_t where b % 10 = 3 order by b desc, a offset 14995;
+
+--
+-- hash join with a shared hash table
+--
+set work_mem = '32MB';
+explain (costs off)
+  select count(*) from para_t t1 join para_t t2 on t1.a = t2.a + 1;
+select count(*) from para_t t1 join para_t t2 on t1.a = t2.a + 1;
+explain (costs off)
+  select count(*) from para_t t1
+    where exists (select 1 from para_t t2 where t2.a = t1.a * 3);
+select count(*) from para_t t1
+  where exists (select 1 from para_t t2 where t2.a = t1.a * 3);
+explain (costs off)
+  select count(*) from para_t t1
+    where not exists (select 1 from para_t t2 where t2.a = t1.a * 3);
+select count(*) from para_t t1
+  where not exists (select 1 from para_t t2 where t2.a = t1.a * 3);
+-- the same joins, with each participant building its own hash table
+set enable_parallel_hash = off;
+explain (costs off)
+  select count(*) from para_t t1 join para_t t2 on t1.a = t2.a + 1;
+select count(*) from para_t t1 join para_t t2 on t1.a = t2.a + 1;
+select count(*) from para_t t1
+  where exists (select 1 from para_t t2 where t2.a = t1.a * 3);
+reset enable_parallel_hash;
+-- a shared hash table must fit in memory as a single batch
+set work_mem = '1MB';
+explain (costs off)
+  select count(*) from para_t t1 join para_t t2 on t1.a = t2.a + 1;
+select count(*) from para_t t1 join para_t t2 on t1.a = t2.a + 1;
+reset work_mem;
+
+--
+-- parallel btree build
+--
+-- leave some dead tuples behind, which a unique build sorts separately
+delete from para_t where a % 10 = 0;
+create temp table para_tt as select * from para_t;
+set client_min_messages = debug1;
+create index para_t_ba on para_t (b, a desc);
+-- the key reported depends on which participant saw the duplicate first
+\set VERBOSITY terse
+create unique index para_t_u on para_t (b);
+\set VERBOSITY default
+create unique index para_t_u on para_t (a);
+-- expressions and predicates are evaluated by the workers
+create index para_t_expr on para_t ((a + b)) where b < 10;
+-- workers can't read a temporary table
+create index para_tt_a on para_tt (a);
+reset client_min_messages;
+set enable_seqscan = off;
+set enable_bitmapscan = off;
+explain (costs off)
+  select count(*), sum(a) from para_t where a > 100;
+select count(*), sum(a) from para_t where a > 100;
+explain (costs off)
+  select b, a from para_t where b = 7 order by b, a desc limit 3;
+select b, a from para_t where b = 7 order by b, a desc limit 3;
+explain (costs off)
+  select count(*), sum(a + b) from para_t where a + b > 0 and b < 10;
+select count(*), sum(a + b) from para_t where a + b > 0 and b < 10;
+reset enable_seqscan;
+reset enable_bitmapscan;
+drop table para_tt;
+
+reset max_parallel_degree;
+reset parallel_tuple_cost;
+reset parallel_setup_cost;
+
+drop table para_t;